@@ -47,8 +47,10 @@ ErrorStatus can1SetConnection(CANConnection Connection);
 CANSettings* can1GetSettings();
 ErrorStatus can1UpdateWithNewSettings();
 SemaphoreHandle_t* can1GetSettingsSemaphore();
+ErrorStatus can1SetTrigger(CaptureTriggerSettings* Settings);
 
 uint32_t can1GetCurrentWriteAddress();
+CaptureLogStatistics* can1GetLogStatistics();
 ErrorStatus can1Clear();
 void can1ClearFlash();
 
@@ -30,6 +30,8 @@
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f4xx_hal.h"
 #include "simple_gui.h"
+#include "capture_trigger.h"
+#include "capture_log.h"
 
 /* Defines -------------------------------------------------------------------*/
 #define IS_CAN_CONNECTION(X)	(((X) == CANConnection_Disconnected) || \
@@ -164,6 +166,8 @@ typedef struct
 	uint32_t writeAddress;
 	uint32_t numOfCharactersDisplayed;
 	uint32_t numOfMessagesSaved;
+
+	CaptureTriggerSettings trigger;
 } CANSettings;
 
 typedef struct
@@ -0,0 +1,94 @@
+/**
+ *******************************************************************************
+ * @file  capture_log.h
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date  2016-11-14
+ * @brief
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef CAPTURE_LOG_H_
+#define CAPTURE_LOG_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx_hal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include <stdbool.h>
+
+/* Defines -------------------------------------------------------------------*/
+#define CAPTURE_LOG_PAGE_SIZE		(256)	/* Same as a program page in the SPI FLASH */
+#define CAPTURE_LOG_NUM_OF_PAGES	(4)
+
+/* Typedefs ------------------------------------------------------------------*/
+/* Called from the log task when data has been programmed, records are counted per append */
+typedef void (*CaptureLogWritten)(uint32_t NumOfBytes, uint32_t NumOfRecords);
+
+typedef struct
+{
+	uint8_t data[CAPTURE_LOG_PAGE_SIZE];
+	uint32_t address;					/* FLASH address of data[0], page aligned */
+	volatile uint32_t count;			/* Bytes in data, counted from the start of the page */
+	volatile uint32_t numOfRecords;		/* Records that end in this page */
+	uint32_t programmed;				/* Bytes that are in the FLASH */
+	uint32_t numOfRecordsWritten;
+} CaptureLogPage;
+
+typedef struct
+{
+	uint32_t bytesPerSecond;			/* Programmed during the last measurement period */
+	uint32_t peakBytesPerSecond;
+	uint32_t bytesWritten;
+	uint32_t numOfPrograms;
+	uint32_t bytesDropped;				/* Records that didn't fit in the page buffers */
+	uint32_t recordsDropped;
+} CaptureLogStatistics;
+
+typedef struct CaptureLog
+{
+	uint32_t startAddress;
+	uint32_t endAddress;
+	CaptureLogWritten written;
+
+	/* Ring of pages, the RX interrupt fills one while the log task programs the older ones */
+	CaptureLogPage pages[CAPTURE_LOG_NUM_OF_PAGES];
+	volatile uint32_t fillPage;
+	volatile uint32_t writePage;
+	volatile uint32_t nextAddress;
+	volatile bool enabled;
+
+	TickType_t lastProgramTick;
+	TickType_t periodStartTick;
+	uint32_t periodBytes;
+	CaptureLogStatistics statistics;
+
+	struct CaptureLog* pNext;
+} CaptureLog;
+
+/* Function prototypes -------------------------------------------------------*/
+void captureLogTask(void *pvParameters);
+void captureLogInit(CaptureLog* Log, uint32_t StartAddress, uint32_t Size, CaptureLogWritten Written);
+void captureLogStop(CaptureLog* Log);
+void captureLogStart(CaptureLog* Log);
+bool captureLogAppendFromISR(CaptureLog* Log, const void* Data, uint32_t Size);
+
+#endif /* CAPTURE_LOG_H_ */
@@ -0,0 +1,105 @@
+/**
+ *******************************************************************************
+ * @file  capture_trigger.h
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date  2016-10-10
+ * @brief
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef CAPTURE_TRIGGER_H_
+#define CAPTURE_TRIGGER_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx_hal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <stdbool.h>
+
+/* Defines -------------------------------------------------------------------*/
+#define CAPTURE_TRIGGER_MAX_SEQUENCE_LENGTH	(16)
+
+#define IS_CAPTURE_TRIGGER_MODE(X)	(((X) == CaptureTriggerMode_Off) || \
+									 ((X) == CaptureTriggerMode_Sequence) || \
+									 ((X) == CaptureTriggerMode_CanId) || \
+									 ((X) == CaptureTriggerMode_IdleGap))
+
+#define IS_CAPTURE_TRIGGER_SETTINGS(X)	(IS_CAPTURE_TRIGGER_MODE((X)->mode) && \
+										 (X)->sequenceLength <= CAPTURE_TRIGGER_MAX_SEQUENCE_LENGTH)
+
+/* Typedefs ------------------------------------------------------------------*/
+typedef enum
+{
+	CaptureTriggerMode_Off,			/* Everything is saved */
+	CaptureTriggerMode_Sequence,	/* A byte sequence in the data */
+	CaptureTriggerMode_CanId,		/* A CAN message where (id & mask) == (canId & mask) */
+	CaptureTriggerMode_IdleGap,		/* The first item after at least idleGapMs of silence */
+} CaptureTriggerMode;
+
+/* Part of the channel settings so it is saved to SPI FLASH together with them */
+typedef struct
+{
+	CaptureTriggerMode mode;
+	uint8_t sequence[CAPTURE_TRIGGER_MAX_SEQUENCE_LENGTH];
+	uint32_t sequenceLength;
+	uint32_t canId;
+	uint32_t canIdMask;
+	uint32_t idleGapMs;
+	uint32_t preTriggerItems;		/* Items kept from before a hit */
+	uint32_t postTriggerItems;		/* Items kept after a hit, a new hit restarts the count */
+} CaptureTriggerSettings;
+
+/* Called with every item that should be saved, from the same context as the process functions */
+typedef void (*CaptureTriggerOutput)(const void* Item);
+
+typedef struct
+{
+	CaptureTriggerSettings* settings;
+	CaptureTriggerOutput output;
+
+	/* Pre-trigger ring, the memory is supplied by the channel */
+	uint8_t* ring;
+	uint32_t itemSize;
+	uint32_t ringCapacity;
+	uint32_t ringHead;
+	uint32_t ringCount;
+
+	/* Sequence matcher, failure[i] is the length of the longest proper prefix
+	 * of sequence[0..i] that is also a suffix of it */
+	uint8_t failure[CAPTURE_TRIGGER_MAX_SEQUENCE_LENGTH];
+	uint32_t matchLength;
+
+	uint32_t postRemaining;
+	TickType_t lastItemTick;
+	bool hasLastItem;
+
+	uint32_t numOfHits;
+	uint32_t numOfItemsDropped;
+} CaptureTrigger;
+
+/* Function prototypes -------------------------------------------------------*/
+void captureTriggerInit(CaptureTrigger* Trigger, CaptureTriggerSettings* Settings, void* RingBuffer,
+						uint32_t ItemSize, uint32_t RingCapacity, CaptureTriggerOutput Output);
+void captureTriggerReset(CaptureTrigger* Trigger);
+void captureTriggerProcessByte(CaptureTrigger* Trigger, uint8_t Byte, TickType_t Tick);
+void captureTriggerProcessCanMessage(CaptureTrigger* Trigger, const void* Message, uint32_t Id, TickType_t Tick);
+
+#endif /* CAPTURE_TRIGGER_H_ */
@@ -47,6 +47,8 @@ void guiCan1BitRateButtonCallback(GUITouchEvent Event, uint32_t ButtonId);
 void guiCan1BitRateSelectionCallback(GUITouchEvent Event, uint32_t ButtonId);
 void guiCan1UpdateGuiElementsReadFromSettings();
 void guiCan1ClearButtonCallback(GUITouchEvent Event, uint32_t ButtonId);
+void guiCan1TriggerButtonCallback(GUITouchEvent Event, uint32_t ButtonId);
+void guiCan1TriggerWindowButtonCallback(GUITouchEvent Event, uint32_t ButtonId);
 void guiCan1InitGuiElements();
 
 
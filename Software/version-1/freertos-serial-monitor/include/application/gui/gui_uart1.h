@@ -44,6 +44,8 @@ void guiUart1EnableButtonCallback(GUITouchEvent Event, uint32_t ButtonId);
 void guiUart1VoltageLevelButtonCallback(GUITouchEvent Event, uint32_t ButtonId);
 void guiUart1FormatButtonCallback(GUITouchEvent Event, uint32_t ButtonId);
 void guiUart1DebugButtonCallback(GUITouchEvent Event, uint32_t ButtonId);
+void guiUart1TriggerButtonCallback(GUITouchEvent Event, uint32_t ButtonId);
+void guiUart1TriggerWindowButtonCallback(GUITouchEvent Event, uint32_t ButtonId);
 void guiUart1TopButtonCallback(GUITouchEvent Event, uint32_t ButtonId);
 void guiUart1BaudRateButtonCallback(GUITouchEvent Event, uint32_t ButtonId);
 void guiUart1ParityButtonCallback(GUITouchEvent Event, uint32_t ButtonId);
@@ -51,6 +51,7 @@ ErrorStatus rs232UpdateWithNewSettings();
 SemaphoreHandle_t* rs232GetSettingsSemaphore();
 ErrorStatus rs232Clear();
 uint32_t rs232GetCurrentWriteAddress();
+CaptureLogStatistics* rs232GetLogStatistics();
 
 void rs232Transmit(uint8_t* Data, uint32_t Size);
 void rs232ClearFlash();
@@ -51,8 +51,10 @@ ErrorStatus uart1SetConnection(UARTConnection Connection);
 UARTSettings* uart1GetSettings();
 ErrorStatus uart1UpdateWithNewSettings();
 SemaphoreHandle_t* uart1GetSettingsSemaphore();
+ErrorStatus uart1SetTrigger(CaptureTriggerSettings* Settings);
 ErrorStatus uart1Clear();
 uint32_t uart1GetCurrentWriteAddress();
+CaptureLogStatistics* uart1GetLogStatistics();
 
 void uart1Transmit(uint8_t* Data, uint32_t Size);
 void uart1ClearFlash();
@@ -52,6 +52,7 @@ ErrorStatus uart2UpdateWithNewSettings();
 SemaphoreHandle_t* uart2GetSettingsSemaphore();
 ErrorStatus uart2Clear();
 uint32_t uart2GetCurrentWriteAddress();
+CaptureLogStatistics* uart2GetLogStatistics();
 
 void uart2Transmit(uint8_t* Data, uint32_t Size);
 void uart2ClearFlash();
@@ -30,6 +30,8 @@
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f4xx_hal.h"
 #include "simple_gui.h"
+#include "capture_trigger.h"
+#include "capture_log.h"
 
 /* Defines -------------------------------------------------------------------*/
 #define IS_UART_CONNECTION(X)	(((X) == UARTConnection_Disconnected) || \
@@ -118,6 +120,8 @@ typedef struct
 	uint32_t writeAddress;
 	uint32_t amountOfDataSaved;
 
+	CaptureTriggerSettings trigger;
+
 	/* TODO: Parity bits, stop bits etc */
 } UARTSettings;
 
@@ -40,6 +40,7 @@
 ErrorStatus SPI_FLASH_Init();
 uint32_t SPI_FLASH_ReadID();
 void SPI_FLASH_WriteBuffer(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite);
+ErrorStatus SPI_FLASH_WritePageDMA(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite, TickType_t BlockTime);
 void SPI_FLASH_WriteByte(uint32_t WriteAddress, uint8_t Byte);
 void SPI_FLASH_WriteByteFromISR(uint32_t WriteAddress, uint8_t Byte);
 void SPI_FLASH_ReadBuffer(uint8_t* pBuffer, uint32_t ReadAddress, uint32_t NumByteToRead);
@@ -91,6 +91,8 @@ typedef enum
 	GUIButtonId_Can1BitRate,
 	GUIButtonId_Can1Termination,
 	GUIButtonId_Can1Clear,
+	GUIButtonId_Can1Trigger,
+	GUIButtonId_Can1TriggerWindow,
 	GUIButtonId_Can1BitRate10k,
 	GUIButtonId_Can1BitRate20k,
 	GUIButtonId_Can1BitRate50k,
@@ -123,6 +125,8 @@ typedef enum
 	GUIButtonId_Uart1Format,
 	GUIButtonId_Uart1Clear,
 	GUIButtonId_Uart1Debug,
+	GUIButtonId_Uart1Trigger,
+	GUIButtonId_Uart1TriggerWindow,
 	GUIButtonId_Uart1SidebarBackwards,
 	GUIButtonId_Uart1SidebarForwards,
 
@@ -31,6 +31,7 @@
 #include "spi_flash.h"
 
 #include <string.h>
+#include <stddef.h>
 #include <stdbool.h>
 
 /* Private defines -----------------------------------------------------------*/
@@ -42,7 +43,7 @@
 #define CAN1_RX_GPIO_PORT			GPIOB
 #define CAN1_RX_AF					GPIO_AF9_CAN1
 
-#define RX_BUFFER_SIZE	(256)
+#define TRIGGER_RING_SIZE	(32)
 
 /* Private typedefs ----------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
@@ -105,6 +106,12 @@ static CANSettings prvCurrentSettings = {
 		.writeAddress					= FLASH_ADR_CAN1_DATA,
 		.numOfCharactersDisplayed		= 0,
 		.numOfMessagesSaved				= 0,
+		.trigger.mode					= CaptureTriggerMode_Off,
+		.trigger.canId					= 0x000,
+		.trigger.canIdMask				= 0x7FF,
+		.trigger.idleGapMs				= 100,
+		.trigger.preTriggerItems		= 8,
+		.trigger.postTriggerItems		= 32,
 };
 
 static uint8_t* prvCanStatusMessages[4] = {
@@ -117,17 +124,10 @@ static uint8_t* prvCanStatusMessages[4] = {
 static SemaphoreHandle_t xSemaphore;
 static SemaphoreHandle_t xSettingsSemaphore;
 
-static CANMessage prvRxBuffer1[RX_BUFFER_SIZE];
-static uint32_t prvRxBuffer1CurrentIndex = 0;
-static uint32_t prvRxBuffer1Count = 0;
-static CANBufferState prvRxBuffer1State = CANBufferState_Writing;
-static TimerHandle_t prvBuffer1ClearTimer;
+static CaptureLog prvLog;
 
-static CANMessage prvRxBuffer2[RX_BUFFER_SIZE];
-static uint32_t prvRxBuffer2CurrentIndex = 0;
-static uint32_t prvRxBuffer2Count = 0;
-static CANBufferState prvRxBuffer2State = CANBufferState_Writing;
-static TimerHandle_t prvBuffer2ClearTimer;
+static CaptureTrigger prvTrigger;
+static CANMessage prvTriggerRing[TRIGGER_RING_SIZE];
 
 static bool prvDoneInitializing = false;
 
@@ -137,8 +137,8 @@ static ErrorStatus prvEnableCan1Interface();
 static ErrorStatus prvDisableCan1Interface();
 static ErrorStatus prvReadSettingsFromSpiFlash();
 
-static void prvBuffer1ClearTimerCallback();
-static void prvBuffer2ClearTimerCallback();
+static void prvLogWritten(uint32_t NumOfBytes, uint32_t NumOfRecords);
+static void prvStoreReceivedMessage(const void* Item);
 
 /* Functions -----------------------------------------------------------------*/
 /**
@@ -154,9 +154,12 @@ void can1Task(void *pvParameters)
 	/* Mutex semaphore for accessing the settings for this channel */
 	xSettingsSemaphore = xSemaphoreCreateMutex();
 
-	/* Create software timers */
-	prvBuffer1ClearTimer = xTimerCreate("Buf1ClearCan1", 10, pdFALSE, 0, prvBuffer1ClearTimerCallback);
-	prvBuffer2ClearTimer = xTimerCreate("Buf2ClearCan1", 10, pdFALSE, 0, prvBuffer2ClearTimerCallback);
+	/* Received messages go through the trigger before they are added to the log */
+	captureTriggerInit(&prvTrigger, &prvCurrentSettings.trigger, prvTriggerRing,
+					   sizeof(CANMessage), TRIGGER_RING_SIZE, prvStoreReceivedMessage);
+
+	/* Received messages are gathered in pages that the log task programs to the SPI FLASH */
+	captureLogInit(&prvLog, FLASH_ADR_CAN1_DATA, FLASH_CHANNEL_DATA_SIZE, prvLogWritten);
 
 	/* Initialize hardware */
 	prvHardwareInit();
@@ -346,6 +349,26 @@ SemaphoreHandle_t* can1GetSettingsSemaphore()
 	return &xSettingsSemaphore;
 }
 
+/**
+ * @brief	Set new trigger settings, the trigger is restarted
+ * @param	Settings: The new settings
+ * @retval	SUCCESS: Everything went ok
+ * @retval	ERROR: Something went wrong
+ */
+ErrorStatus can1SetTrigger(CaptureTriggerSettings* Settings)
+{
+	if (!IS_CAPTURE_TRIGGER_SETTINGS(Settings))
+		return ERROR;
+
+	/* The RX interrupt uses the trigger so it's kept out while it's changed */
+	taskENTER_CRITICAL();
+	memcpy(&prvCurrentSettings.trigger, Settings, sizeof(CaptureTriggerSettings));
+	captureTriggerReset(&prvTrigger);
+	taskEXIT_CRITICAL();
+
+	return SUCCESS;
+}
+
 /**
  * @brief	Returns the address which the data will be written to next
  * @param	None
@@ -356,6 +379,16 @@ uint32_t can1GetCurrentWriteAddress()
 	return prvCurrentSettings.writeAddress;
 }
 
+/**
+ * @brief	Get the statistics of the logging to SPI FLASH
+ * @param	None
+ * @retval	A pointer to the statistics
+ */
+CaptureLogStatistics* can1GetLogStatistics()
+{
+	return &prvLog.statistics;
+}
+
 /**
  * @brief	Clear the channel
  * @param	None
@@ -367,6 +400,9 @@ ErrorStatus can1Clear()
 	/* Try to take the settings semaphore */
 	if (xSettingsSemaphore != 0 && xSemaphoreTake(xSettingsSemaphore, 1000) == pdTRUE)
 	{
+		/* Nothing may be programmed while the FLASH is cleared */
+		captureLogStop(&prvLog);
+
 		prvCurrentSettings.displayedDataStartAddress = FLASH_ADR_CAN1_DATA;
 		prvCurrentSettings.lastDisplayDataStartAddress = FLASH_ADR_CAN1_DATA;
 		prvCurrentSettings.displayedDataEndAddress = FLASH_ADR_CAN1_DATA;
@@ -379,6 +415,8 @@ ErrorStatus can1Clear()
 		/* Clear the FLASH */
 		can1ClearFlash();
 
+		captureLogStart(&prvLog);
+
 		/* Give back the semaphore now that we are done */
 		xSemaphoreGive(xSettingsSemaphore);
 
@@ -557,6 +595,8 @@ static ErrorStatus prvDisableCan1Interface()
 	HAL_NVIC_DisableIRQ(CAN1_RX0_IRQn);
 	HAL_NVIC_DisableIRQ(CAN1_TX_IRQn);
 
+	captureTriggerReset(&prvTrigger);
+
 	return SUCCESS;
 }
 
@@ -574,7 +614,8 @@ static ErrorStatus prvReadSettingsFromSpiFlash()
 		/* Check to make sure the data is reasonable */
 		if (IS_CAN_CONNECTION(settings.connection) &&
 			IS_CAN_TERMINATION(settings.termination) &&
-			IS_CAN_BIT_RATE(settings.bitRate))
+			IS_CAN_BIT_RATE(settings.bitRate) &&
+			IS_CAPTURE_TRIGGER_SETTINGS(&settings.trigger))
 		{
 			/* Try to take the settings semaphore */
 			if (xSettingsSemaphore != 0 && xSemaphoreTake(xSettingsSemaphore, 100) == pdTRUE)
@@ -584,6 +625,7 @@ static ErrorStatus prvReadSettingsFromSpiFlash()
 				prvCurrentSettings.connection = CANConnection_Disconnected;
 				prvCurrentSettings.termination = CANTermination_Disconnected;
 				can1UpdateWithNewSettings();
+				captureTriggerReset(&prvTrigger);
 				/* Give back the semaphore now that we are done */
 				xSemaphoreGive(xSettingsSemaphore);
 				return SUCCESS;
@@ -602,85 +644,31 @@ static ErrorStatus prvReadSettingsFromSpiFlash()
 }
 
 /**
- * @brief	Callback for the buffer 1 software timer
- * @param	None
+ * @brief	Called from the log task when received messages have been programmed to the SPI FLASH
+ * @param	NumOfBytes: Number of bytes programmed
+ * @param	NumOfRecords: Number of messages that are now all in the FLASH
  * @retval	None
  */
-static void prvBuffer1ClearTimerCallback()
+static void prvLogWritten(uint32_t NumOfBytes, uint32_t NumOfRecords)
 {
-	/* Set the buffer to reading state */
-	prvRxBuffer1State = CANBufferState_Reading;
-
-	/* Write the data to FLASH */
-	for (uint32_t i = 0; i < prvRxBuffer1Count; i++)
-	{
-		uint8_t* pData = (uint8_t*)&prvRxBuffer1[i];
-
-		/* ID - 4 bytes */
-		SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, *(pData++));
-		SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, *(pData++));
-		SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, *(pData++));
-		SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, *(pData++));
-
-		/* DLC - 1 byte */
-		SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, *(pData));
-
-		/* Data - 0-8 bytes */
-		uint8_t dlc = *pData++;
-		for (uint32_t n = 0; n < dlc; n++)
-		{
-			SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, *(pData++));
-		}
-
-		/* Update how many message we have saved */
-		prvCurrentSettings.numOfMessagesSaved++;
-	}
-
-	/* Reset the buffer */
-	prvRxBuffer1CurrentIndex = 0;
-	prvRxBuffer1Count = 0;
-	prvRxBuffer1State = CANBufferState_Writing;
+	prvCurrentSettings.writeAddress += NumOfBytes;
+	prvCurrentSettings.numOfMessagesSaved += NumOfRecords;
 }
 
 /**
- * @brief	Callback for the buffer 2 software timer
- * @param	None
+ * @brief	Add a received message to the log, called by the trigger from the RX interrupt
+ * @param	Item: Pointer to the message
  * @retval	None
  */
-static void prvBuffer2ClearTimerCallback()
+static void prvStoreReceivedMessage(const void* Item)
 {
-	/* Set the buffer to reading state */
-	prvRxBuffer2State = CANBufferState_Reading;
-
-	/* Write the data to FLASH */
-	for (uint32_t i = 0; i < prvRxBuffer2Count; i++)
-	{
-		uint8_t* pData = (uint8_t*)&prvRxBuffer2[i];
+	/* ID - 4 bytes, DLC - 1 byte and Data - 0-8 bytes */
+	const CANMessage* message = (const CANMessage*)Item;
+	uint32_t size = offsetof(CANMessage, data) + message->dlc;
 
-		/* ID - 4 bytes */
-		SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, *(pData++));
-		SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, *(pData++));
-		SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, *(pData++));
-		SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, *(pData++));
-
-		/* DLC - 1 byte */
-		SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, *(pData));
-
-		/* Data - 0-8 bytes */
-		uint8_t dlc = *pData++;
-		for (uint32_t n = 0; n < dlc; n++)
-		{
-			SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, *(pData++));
-		}
-
-		/* Update how many message we have saved */
-		prvCurrentSettings.numOfMessagesSaved++;
-	}
-
-	/* Reset the buffer */
-	prvRxBuffer2CurrentIndex = 0;
-	prvRxBuffer2Count = 0;
-	prvRxBuffer2State = CANBufferState_Writing;
+	HAL_GPIO_TogglePin(GPIOC, GPIO_PIN_3);
+	/* A message that doesn't fit is counted as dropped in the log statistics */
+	captureLogAppendFromISR(&prvLog, message, size);
 }
 
 /* Interrupt Handlers --------------------------------------------------------*/
@@ -737,48 +725,13 @@ void can1RxCpltCallback()
 //		uint8_t ubKeyNumber = CAN_Handle.pRxMsg->Data[0];
 //	}
 
-	if (prvRxBuffer1State != CANBufferState_Reading && prvRxBuffer1Count < RX_BUFFER_SIZE)
-	{
-		HAL_GPIO_TogglePin(GPIOC, GPIO_PIN_3);
-		prvRxBuffer1State = CANBufferState_Writing;
-		/* Save the message */
-		prvRxBuffer1[prvRxBuffer1CurrentIndex].id = CAN_Handle.pRxMsg->StdId;
-		prvRxBuffer1[prvRxBuffer1CurrentIndex].dlc = CAN_Handle.pRxMsg->DLC;
-		for (uint32_t i = 0; i < CAN_Handle.pRxMsg->DLC; i++)
-			prvRxBuffer1[prvRxBuffer1CurrentIndex].data[i] = CAN_Handle.pRxMsg->Data[i];
-
-		/* Increment the counters */
-		prvRxBuffer1CurrentIndex++;
-		prvRxBuffer1Count++;
-
-		/* Start the timer which will clear the buffer if it's not already started */
-		if (xTimerIsTimerActive(prvBuffer1ClearTimer) == pdFALSE)
-			xTimerStartFromISR(prvBuffer1ClearTimer, NULL);
-	}
-	else if (prvRxBuffer2State != CANBufferState_Reading && prvRxBuffer2Count < RX_BUFFER_SIZE)
-	{
-		HAL_GPIO_TogglePin(GPIOC, GPIO_PIN_3);
-		prvRxBuffer2State = CANBufferState_Writing;
-		/* Save the message */
-		prvRxBuffer2[prvRxBuffer1CurrentIndex].id = CAN_Handle.pRxMsg->StdId;
-		prvRxBuffer2[prvRxBuffer1CurrentIndex].dlc = CAN_Handle.pRxMsg->DLC;
-		for (uint32_t i = 0; i < CAN_Handle.pRxMsg->DLC; i++)
-			prvRxBuffer2[prvRxBuffer1CurrentIndex].data[i] = CAN_Handle.pRxMsg->Data[i];
-
-		/* Increment the counters */
-		prvRxBuffer2CurrentIndex++;
-		prvRxBuffer2Count++;
-
-		/* Start the timer which will clear the buffer if it's not already started */
-		if (xTimerIsTimerActive(prvBuffer2ClearTimer) == pdFALSE)
-			xTimerStartFromISR(prvBuffer2ClearTimer, NULL);
-	}
-	else
-	{
-		/* No buffer available, something has gone wrong */
-		HAL_GPIO_TogglePin(GPIOC, GPIO_PIN_3);
-	}
-
+	/* Save the message */
+	CANMessage message = {0};
+	message.id = CAN_Handle.pRxMsg->StdId;
+	message.dlc = CAN_Handle.pRxMsg->DLC;
+	for (uint32_t i = 0; i < CAN_Handle.pRxMsg->DLC; i++)
+		message.data[i] = CAN_Handle.pRxMsg->Data[i];
+	captureTriggerProcessCanMessage(&prvTrigger, &message, message.id, xTaskGetTickCountFromISR());
 
 	/* Receive */
 	if (HAL_CAN_Receive_IT(&CAN_Handle, CAN_FIFO0) != HAL_OK)
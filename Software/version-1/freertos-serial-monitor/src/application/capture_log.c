@@ -0,0 +1,317 @@
+/**
+ *******************************************************************************
+ * @file  capture_log.c
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date  2016-11-14
+ * @brief
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "capture_log.h"
+
+#include "spi_flash.h"
+
+#include <string.h>
+
+/* Private defines -----------------------------------------------------------*/
+/* A page that is still being filled is programmed when it's been this long since the last program */
+#define CAPTURE_LOG_FLUSH_TIME_MS		(10)
+#define CAPTURE_LOG_MEASURE_TIME_MS		(1000)
+#define CAPTURE_LOG_FLASH_BLOCK_TIME	(100)
+
+/* Private typedefs ----------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+/* Held by the log task while it programs so a log can be stopped between two programs */
+static SemaphoreHandle_t xLogSemaphore = 0;
+/* Given from the RX interrupts when a page is full */
+static SemaphoreHandle_t xWakeSemaphore = 0;
+
+static CaptureLog* prvFirstLog = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void prvCreateSemaphores();
+static void prvReset(CaptureLog* Log);
+static void prvResetPage(CaptureLogPage* Page, uint32_t Address);
+static void prvProgramPages(CaptureLog* Log);
+static void prvUpdateStatistics(CaptureLog* Log);
+
+/* Functions -----------------------------------------------------------------*/
+/**
+ * @brief	The task that programs the pages of all logs to the SPI FLASH
+ * @param	pvParameters:
+ * @retval	None
+ */
+void captureLogTask(void *pvParameters)
+{
+	prvCreateSemaphores();
+
+	while (1)
+	{
+		/* Woken when a page is full, partly filled pages are programmed on the timeout */
+		xSemaphoreTake(xWakeSemaphore, CAPTURE_LOG_FLUSH_TIME_MS / portTICK_PERIOD_MS);
+
+		if (xSemaphoreTake(xLogSemaphore, portMAX_DELAY) == pdTRUE)
+		{
+			for (CaptureLog* log = prvFirstLog; log != 0; log = log->pNext)
+			{
+				prvProgramPages(log);
+				prvUpdateStatistics(log);
+			}
+
+			/* Give back the semaphore now that we are done */
+			xSemaphoreGive(xLogSemaphore);
+		}
+	}
+}
+
+/**
+ * @brief	Initialize a log and add it to the logs handled by the log task, it's started
+ * @param	Log: The log to initialize
+ * @param	StartAddress: FLASH address of the first byte
+ * @param	Size: Size of the FLASH area in bytes, records that don't fit are dropped
+ * @param	Written: Function called from the log task with the amount of data that has been programmed
+ * @retval	None
+ */
+void captureLogInit(CaptureLog* Log, uint32_t StartAddress, uint32_t Size, CaptureLogWritten Written)
+{
+	prvCreateSemaphores();
+
+	Log->startAddress = StartAddress;
+	Log->endAddress = StartAddress + Size;
+	Log->written = Written;
+	prvReset(Log);
+	Log->enabled = true;
+
+	/* The log task walks the list so it's only changed while the task isn't programming */
+	if (xSemaphoreTake(xLogSemaphore, portMAX_DELAY) == pdTRUE)
+	{
+		Log->pNext = prvFirstLog;
+		prvFirstLog = Log;
+		xSemaphoreGive(xLogSemaphore);
+	}
+}
+
+/**
+ * @brief	Stop the log, everything that hasn't been programmed is thrown away and
+ * 			new records are dropped until it's started again
+ * @note	Nothing is programmed to the FLASH once this has returned so the area can be erased
+ * @param	Log: The log to stop
+ * @retval	None
+ */
+void captureLogStop(CaptureLog* Log)
+{
+	/* Wait for the log task to finish programming */
+	if (xSemaphoreTake(xLogSemaphore, portMAX_DELAY) == pdTRUE)
+	{
+		Log->enabled = false;
+		xSemaphoreGive(xLogSemaphore);
+	}
+}
+
+/**
+ * @brief	Start the log from the start address
+ * @param	Log: The log to start
+ * @retval	None
+ */
+void captureLogStart(CaptureLog* Log)
+{
+	/* The RX interrupt uses the log so it's kept out while it's reset */
+	taskENTER_CRITICAL();
+	prvReset(Log);
+	Log->enabled = true;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief	Add a record to the log, all of it or nothing is added
+ * @note	Must be called from one interrupt or with interrupts masked, not from several
+ * @param	Log: The log to add to
+ * @param	Data: The record
+ * @param	Size: Size of the record in bytes, at most CAPTURE_LOG_PAGE_SIZE * (CAPTURE_LOG_NUM_OF_PAGES - 1)
+ * @retval	true: The record was added
+ * @retval	false: The record didn't fit and was dropped
+ */
+bool captureLogAppendFromISR(CaptureLog* Log, const void* Data, uint32_t Size)
+{
+	const uint8_t* pData = (const uint8_t*)Data;
+	CaptureLogPage* page = &Log->pages[Log->fillPage];
+
+	/* Room left in the page being filled and in the pages that are already programmed */
+	uint32_t freePages = (Log->writePage + CAPTURE_LOG_NUM_OF_PAGES - Log->fillPage - 1) % CAPTURE_LOG_NUM_OF_PAGES;
+	uint32_t room = CAPTURE_LOG_PAGE_SIZE - page->count + freePages * CAPTURE_LOG_PAGE_SIZE;
+	if (!Log->enabled || Size > room || Size > Log->endAddress - Log->nextAddress)
+	{
+		Log->statistics.bytesDropped += Size;
+		Log->statistics.recordsDropped++;
+		return false;
+	}
+
+	while (Size != 0)
+	{
+		if (page->count == CAPTURE_LOG_PAGE_SIZE)
+		{
+			Log->fillPage = (Log->fillPage + 1) % CAPTURE_LOG_NUM_OF_PAGES;
+			page = &Log->pages[Log->fillPage];
+			prvResetPage(page, Log->nextAddress);
+		}
+
+		uint32_t numOfBytes = CAPTURE_LOG_PAGE_SIZE - page->count;
+		if (numOfBytes > Size)
+			numOfBytes = Size;
+		memcpy(&page->data[page->count], pData, numOfBytes);
+		page->count += numOfBytes;
+		Log->nextAddress += numOfBytes;
+		pData += numOfBytes;
+		Size -= numOfBytes;
+	}
+	page->numOfRecords++;
+
+	/* Wake the log task as soon as a page can be programmed as a whole */
+	if (page->count == CAPTURE_LOG_PAGE_SIZE && xWakeSemaphore != 0)
+		xSemaphoreGiveFromISR(xWakeSemaphore, NULL);
+
+	return true;
+}
+
+/* Private functions .--------------------------------------------------------*/
+/**
+ * @brief	Create the semaphores, the log task and the channels can get here first
+ * @param	None
+ * @retval	None
+ */
+static void prvCreateSemaphores()
+{
+	vTaskSuspendAll();
+	if (xLogSemaphore == 0)
+	{
+		xLogSemaphore = xSemaphoreCreateMutex();
+		vSemaphoreCreateBinary(xWakeSemaphore);
+		xSemaphoreTake(xWakeSemaphore, 0);
+	}
+	xTaskResumeAll();
+}
+
+/**
+ * @brief	Reset a log to the start address
+ * @param	Log: The log to reset
+ * @retval	None
+ */
+static void prvReset(CaptureLog* Log)
+{
+	Log->fillPage = 0;
+	Log->writePage = 0;
+	Log->nextAddress = Log->startAddress;
+	prvResetPage(&Log->pages[0], Log->startAddress);
+
+	Log->lastProgramTick = xTaskGetTickCount();
+	Log->periodStartTick = Log->lastProgramTick;
+	Log->periodBytes = 0;
+	memset(&Log->statistics, 0, sizeof(CaptureLogStatistics));
+}
+
+/**
+ * @brief	Reset a page so that it starts at an address
+ * @param	Page: The page to reset
+ * @param	Address: FLASH address of the first byte that will be added, the bytes
+ * 			before it in the same FLASH page are left as they are
+ * @retval	None
+ */
+static void prvResetPage(CaptureLogPage* Page, uint32_t Address)
+{
+	Page->address = Address - (Address % CAPTURE_LOG_PAGE_SIZE);
+	Page->count = Address % CAPTURE_LOG_PAGE_SIZE;
+	Page->programmed = Page->count;
+	Page->numOfRecords = 0;
+	Page->numOfRecordsWritten = 0;
+}
+
+/**
+ * @brief	Program the full pages of a log and the page being filled if it's time to
+ * @param	Log: The log
+ * @retval	None
+ */
+static void prvProgramPages(CaptureLog* Log)
+{
+	while (Log->enabled)
+	{
+		/* Take a copy of what the RX interrupt may change */
+		taskENTER_CRITICAL();
+		CaptureLogPage* page = &Log->pages[Log->writePage];
+		bool isFillPage = (Log->writePage == Log->fillPage);
+		uint32_t count = page->count;
+		uint32_t numOfRecords = page->numOfRecords;
+		taskEXIT_CRITICAL();
+
+		/* A page that is still being filled is programmed after a while so that slow data
+		 * doesn't give one program for every few bytes */
+		TickType_t now = xTaskGetTickCount();
+		if (isFillPage && count != CAPTURE_LOG_PAGE_SIZE &&
+			now - Log->lastProgramTick < CAPTURE_LOG_FLUSH_TIME_MS / portTICK_PERIOD_MS)
+			return;
+
+		if (count > page->programmed)
+		{
+			uint32_t numOfBytes = count - page->programmed;
+			/* Tried again the next time if the FLASH is busy for too long */
+			if (SPI_FLASH_WritePageDMA(&page->data[page->programmed], page->address + page->programmed,
+									   numOfBytes, CAPTURE_LOG_FLASH_BLOCK_TIME) != SUCCESS)
+				return;
+
+			uint32_t numOfRecordsWritten = numOfRecords - page->numOfRecordsWritten;
+			page->programmed = count;
+			page->numOfRecordsWritten = numOfRecords;
+
+			Log->lastProgramTick = now;
+			Log->periodBytes += numOfBytes;
+			Log->statistics.bytesWritten += numOfBytes;
+			Log->statistics.numOfPrograms++;
+			Log->written(numOfBytes, numOfRecordsWritten);
+		}
+
+		/* The page being filled stays until the RX interrupt moves on from it */
+		if (isFillPage)
+			return;
+
+		taskENTER_CRITICAL();
+		Log->writePage = (Log->writePage + 1) % CAPTURE_LOG_NUM_OF_PAGES;
+		taskEXIT_CRITICAL();
+	}
+}
+
+/**
+ * @brief	Update the throughput of a log when a measurement period has passed
+ * @param	Log: The log
+ * @retval	None
+ */
+static void prvUpdateStatistics(CaptureLog* Log)
+{
+	TickType_t elapsed = xTaskGetTickCount() - Log->periodStartTick;
+	if (elapsed >= CAPTURE_LOG_MEASURE_TIME_MS / portTICK_PERIOD_MS)
+	{
+		Log->statistics.bytesPerSecond = (uint32_t)(((uint64_t)Log->periodBytes * configTICK_RATE_HZ) / elapsed);
+		if (Log->statistics.bytesPerSecond > Log->statistics.peakBytesPerSecond)
+			Log->statistics.peakBytesPerSecond = Log->statistics.bytesPerSecond;
+
+		Log->periodStartTick += elapsed;
+		Log->periodBytes = 0;
+	}
+}
+
+/* Interrupt Handlers --------------------------------------------------------*/
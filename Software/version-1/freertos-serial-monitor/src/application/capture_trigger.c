@@ -0,0 +1,245 @@
+/**
+ *******************************************************************************
+ * @file  capture_trigger.c
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date  2016-10-10
+ * @brief	Trigger stage between a channel's receive interrupt and its RX
+ * 			buffers. Incoming items (bytes or CAN messages) are held in a
+ * 			small pre-trigger ring until a trigger hits, then the ring and
+ * 			the following postTriggerItems are passed on to be saved. Items
+ * 			outside such a window are dropped so the SPI FLASH only gets the
+ * 			data around the events of interest.
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "capture_trigger.h"
+
+#include <string.h>
+
+/* Private defines -----------------------------------------------------------*/
+/* Private typedefs ----------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static void prvProcessItem(CaptureTrigger* Trigger, const void* Item, bool Hit);
+static bool prvIdleGapHit(CaptureTrigger* Trigger, TickType_t Tick);
+
+/* Functions -----------------------------------------------------------------*/
+/**
+ * @brief	Initialize a trigger
+ * @param	Trigger: The trigger to initialize
+ * @param	Settings: The settings to use, normally part of the channel settings
+ * @param	RingBuffer: Memory for the pre-trigger ring, RingCapacity * ItemSize bytes
+ * @param	ItemSize: Size of one item in bytes
+ * @param	RingCapacity: Max number of items in the ring
+ * @param	Output: Function that is called with every item that should be saved
+ * @retval	None
+ */
+void captureTriggerInit(CaptureTrigger* Trigger, CaptureTriggerSettings* Settings, void* RingBuffer,
+						uint32_t ItemSize, uint32_t RingCapacity, CaptureTriggerOutput Output)
+{
+	Trigger->settings = Settings;
+	Trigger->output = Output;
+	Trigger->ring = (uint8_t*)RingBuffer;
+	Trigger->itemSize = ItemSize;
+	Trigger->ringCapacity = RingCapacity;
+	captureTriggerReset(Trigger);
+}
+
+/**
+ * @brief	Reset the trigger, has to be done after the settings have been changed
+ * @param	Trigger: The trigger to reset
+ * @retval	None
+ */
+void captureTriggerReset(CaptureTrigger* Trigger)
+{
+	CaptureTriggerSettings* settings = Trigger->settings;
+
+	Trigger->ringHead = 0;
+	Trigger->ringCount = 0;
+	Trigger->matchLength = 0;
+	Trigger->postRemaining = 0;
+	Trigger->hasLastItem = false;
+	Trigger->numOfHits = 0;
+	Trigger->numOfItemsDropped = 0;
+
+	if (settings->sequenceLength > CAPTURE_TRIGGER_MAX_SEQUENCE_LENGTH)
+		settings->sequenceLength = CAPTURE_TRIGGER_MAX_SEQUENCE_LENGTH;
+
+	/* Build the failure table so that a partial match never has to be re-read */
+	uint32_t length = 0;
+	if (settings->sequenceLength != 0)
+		Trigger->failure[0] = 0;
+	for (uint32_t i = 1; i < settings->sequenceLength; i++)
+	{
+		while (length > 0 && settings->sequence[i] != settings->sequence[length])
+			length = Trigger->failure[length - 1];
+		if (settings->sequence[i] == settings->sequence[length])
+			length++;
+		Trigger->failure[i] = length;
+	}
+}
+
+/**
+ * @brief	Process a received byte
+ * @param	Trigger: The trigger to use
+ * @param	Byte: The byte
+ * @param	Tick: The tick count when the byte was received
+ * @retval	None
+ */
+void captureTriggerProcessByte(CaptureTrigger* Trigger, uint8_t Byte, TickType_t Tick)
+{
+	CaptureTriggerSettings* settings = Trigger->settings;
+	bool hit = false;
+
+	switch (settings->mode)
+	{
+		case CaptureTriggerMode_Off:
+			Trigger->output(&Byte);
+			return;
+
+		case CaptureTriggerMode_Sequence:
+			if (settings->sequenceLength != 0)
+			{
+				while (Trigger->matchLength > 0 && Byte != settings->sequence[Trigger->matchLength])
+					Trigger->matchLength = Trigger->failure[Trigger->matchLength - 1];
+				if (Byte == settings->sequence[Trigger->matchLength])
+					Trigger->matchLength++;
+				/* The hit is on the last byte, the ones before it are in the ring */
+				if (Trigger->matchLength == settings->sequenceLength)
+				{
+					Trigger->matchLength = Trigger->failure[Trigger->matchLength - 1];
+					hit = true;
+				}
+			}
+			break;
+
+		case CaptureTriggerMode_IdleGap:
+			hit = prvIdleGapHit(Trigger, Tick);
+			break;
+
+		default:
+			break;
+	}
+
+	prvProcessItem(Trigger, &Byte, hit);
+}
+
+/**
+ * @brief	Process a received CAN message
+ * @param	Trigger: The trigger to use
+ * @param	Message: The message to pass on, Trigger->itemSize bytes
+ * @param	Id: The identifier of the message
+ * @param	Tick: The tick count when the message was received
+ * @retval	None
+ */
+void captureTriggerProcessCanMessage(CaptureTrigger* Trigger, const void* Message, uint32_t Id, TickType_t Tick)
+{
+	CaptureTriggerSettings* settings = Trigger->settings;
+	bool hit = false;
+
+	switch (settings->mode)
+	{
+		case CaptureTriggerMode_Off:
+			Trigger->output(Message);
+			return;
+
+		case CaptureTriggerMode_CanId:
+			hit = ((Id & settings->canIdMask) == (settings->canId & settings->canIdMask));
+			break;
+
+		case CaptureTriggerMode_IdleGap:
+			hit = prvIdleGapHit(Trigger, Tick);
+			break;
+
+		default:
+			break;
+	}
+
+	prvProcessItem(Trigger, Message, hit);
+}
+
+/* Private functions .--------------------------------------------------------*/
+/**
+ * @brief	Pass on or buffer an item depending on if it's inside a trigger window
+ * @param	Trigger: The trigger to use
+ * @param	Item: The item
+ * @param	Hit: true if the item is a trigger hit
+ * @retval	None
+ */
+static void prvProcessItem(CaptureTrigger* Trigger, const void* Item, bool Hit)
+{
+	if (Hit)
+	{
+		/* Flush the ring oldest first, it is empty if we are already inside a window */
+		while (Trigger->ringCount != 0)
+		{
+			Trigger->output(&Trigger->ring[Trigger->ringHead * Trigger->itemSize]);
+			Trigger->ringHead = (Trigger->ringHead + 1) % Trigger->ringCapacity;
+			Trigger->ringCount--;
+		}
+		Trigger->output(Item);
+		Trigger->postRemaining = Trigger->settings->postTriggerItems;
+		Trigger->numOfHits++;
+	}
+	else if (Trigger->postRemaining != 0)
+	{
+		Trigger->output(Item);
+		Trigger->postRemaining--;
+	}
+	else
+	{
+		uint32_t preTriggerItems = Trigger->settings->preTriggerItems;
+		if (preTriggerItems > Trigger->ringCapacity)
+			preTriggerItems = Trigger->ringCapacity;
+
+		if (preTriggerItems == 0)
+		{
+			Trigger->numOfItemsDropped++;
+			return;
+		}
+
+		/* Drop the oldest items to make room */
+		while (Trigger->ringCount >= preTriggerItems)
+		{
+			Trigger->ringHead = (Trigger->ringHead + 1) % Trigger->ringCapacity;
+			Trigger->ringCount--;
+			Trigger->numOfItemsDropped++;
+		}
+
+		uint32_t index = (Trigger->ringHead + Trigger->ringCount) % Trigger->ringCapacity;
+		memcpy(&Trigger->ring[index * Trigger->itemSize], Item, Trigger->itemSize);
+		Trigger->ringCount++;
+	}
+}
+
+/**
+ * @brief	Check if there has been enough silence before this item, the first item after a reset is a hit
+ * @param	Trigger: The trigger to use
+ * @param	Tick: The tick count when the item was received
+ * @retval	true if it's a hit
+ */
+static bool prvIdleGapHit(CaptureTrigger* Trigger, TickType_t Tick)
+{
+	bool hit = (!Trigger->hasLastItem ||
+				(Tick - Trigger->lastItemTick) >= Trigger->settings->idleGapMs / portTICK_PERIOD_MS);
+	Trigger->lastItemTick = Tick;
+	Trigger->hasLastItem = true;
+	return hit;
+}
@@ -30,6 +30,7 @@
 
 /* Private defines -----------------------------------------------------------*/
 #define MAX_MESSAGES_IN_LIST	64
+#define NUM_OF_TRIGGER_WINDOWS	(3)
 
 /* Private typedefs ----------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
@@ -43,9 +44,14 @@ static uint32_t prvNextIndexInList = 0;
 static uint32_t prvNumOfMessagesDisplayed = 0;
 static bool prvClearingInProgress = false;
 
+/* Messages kept before and after a trigger hit */
+static const uint32_t prvTriggerWindows[NUM_OF_TRIGGER_WINDOWS][2] = {{4, 16}, {8, 32}, {32, 128}};
+static const char* prvTriggerWindowTexts[NUM_OF_TRIGGER_WINDOWS] = {"-4 / +16 msg", "-8 / +32 msg", "-32 / +128 msg"};
+
 /* Private function prototypes -----------------------------------------------*/
 static void prvInsertMessageInList(CANMessage NewMessage);
 static void prvWriteMessageListToDisplay();
+static void prvUpdateTriggerButtons(CaptureTriggerSettings* Trigger);
 
 /* Functions -----------------------------------------------------------------*/
 /**
@@ -195,6 +201,54 @@ void guiCan1TerminationButtonCallback(GUITouchEvent Event, uint32_t ButtonId)
 	}
 }
 
+/**
+ * @brief	Callback for the trigger button, steps through the trigger modes
+ * @param	Event: The event that caused the callback
+ * @param	ButtonId: The button ID that the event happened on
+ * @retval	None
+ */
+void guiCan1TriggerButtonCallback(GUITouchEvent Event, uint32_t ButtonId)
+{
+	if (Event == GUITouchEvent_Up)
+	{
+		CaptureTriggerSettings trigger = can1GetSettings()->trigger;
+		if (trigger.mode == CaptureTriggerMode_Off)
+			trigger.mode = CaptureTriggerMode_CanId;
+		else if (trigger.mode == CaptureTriggerMode_CanId)
+			trigger.mode = CaptureTriggerMode_IdleGap;
+		else
+			trigger.mode = CaptureTriggerMode_Off;
+
+		if (can1SetTrigger(&trigger) == SUCCESS)
+			prvUpdateTriggerButtons(&trigger);
+	}
+}
+
+/**
+ * @brief	Callback for the trigger window button, steps through the window sizes
+ * @param	Event: The event that caused the callback
+ * @param	ButtonId: The button ID that the event happened on
+ * @retval	None
+ */
+void guiCan1TriggerWindowButtonCallback(GUITouchEvent Event, uint32_t ButtonId)
+{
+	if (Event == GUITouchEvent_Up)
+	{
+		CaptureTriggerSettings trigger = can1GetSettings()->trigger;
+		uint32_t next = 0;
+		for (uint32_t i = 0; i < NUM_OF_TRIGGER_WINDOWS; i++)
+		{
+			if (trigger.preTriggerItems == prvTriggerWindows[i][0])
+				next = (i + 1) % NUM_OF_TRIGGER_WINDOWS;
+		}
+		trigger.preTriggerItems = prvTriggerWindows[next][0];
+		trigger.postTriggerItems = prvTriggerWindows[next][1];
+
+		if (can1SetTrigger(&trigger) == SUCCESS)
+			prvUpdateTriggerButtons(&trigger);
+	}
+}
+
 /**
  * @brief
  * @param	Event: The event that caused the callback
@@ -358,6 +412,8 @@ void guiCan1UpdateGuiElementsReadFromSettings()
 		default:
 			break;
 	}
+	/* Update the trigger texts to match what is actually set */
+	prvUpdateTriggerButtons(&settings->trigger);
 }
 
 /**
@@ -545,6 +601,54 @@ void guiCan1InitGuiElements()
 	prvButton.textSize[0] = LCDFontEnlarge_1x;
 	GUIButton_Add(&prvButton);
 
+	/* CAN1 Trigger Button */
+	prvButton.object.id = GUIButtonId_Can1Trigger;
+	prvButton.object.xPos = 650;
+	prvButton.object.yPos = 300;
+	prvButton.object.width = 150;
+	prvButton.object.height = 50;
+	prvButton.object.border = GUIBorder_Top | GUIBorder_Bottom | GUIBorder_Left;
+	prvButton.object.borderThickness = 1;
+	prvButton.object.borderColor = GUI_WHITE;
+	prvButton.object.containerPage = GUIContainerPage_1;
+	prvButton.enabledTextColor = GUI_WHITE;
+	prvButton.enabledBackgroundColor = GUI_BLUE;
+	prvButton.disabledTextColor = GUI_WHITE;
+	prvButton.disabledBackgroundColor = GUI_BLUE;
+	prvButton.pressedTextColor = GUI_BLUE;
+	prvButton.pressedBackgroundColor = GUI_WHITE;
+	prvButton.state = GUIButtonState_Disabled;
+	prvButton.touchCallback = guiCan1TriggerButtonCallback;
+	prvButton.text[0] = "Trigger:";
+	prvButton.text[1] = "Off";
+	prvButton.textSize[0] = LCDFontEnlarge_1x;
+	prvButton.textSize[1] = LCDFontEnlarge_1x;
+	GUIButton_Add(&prvButton);
+
+	/* CAN1 Trigger Window Button */
+	prvButton.object.id = GUIButtonId_Can1TriggerWindow;
+	prvButton.object.xPos = 650;
+	prvButton.object.yPos = 350;
+	prvButton.object.width = 150;
+	prvButton.object.height = 50;
+	prvButton.object.border = GUIBorder_Top | GUIBorder_Bottom | GUIBorder_Left;
+	prvButton.object.borderThickness = 1;
+	prvButton.object.borderColor = GUI_WHITE;
+	prvButton.object.containerPage = GUIContainerPage_1;
+	prvButton.enabledTextColor = GUI_WHITE;
+	prvButton.enabledBackgroundColor = GUI_BLUE;
+	prvButton.disabledTextColor = GUI_WHITE;
+	prvButton.disabledBackgroundColor = GUI_BLUE;
+	prvButton.pressedTextColor = GUI_BLUE;
+	prvButton.pressedBackgroundColor = GUI_WHITE;
+	prvButton.state = GUIButtonState_Disabled;
+	prvButton.touchCallback = guiCan1TriggerWindowButtonCallback;
+	prvButton.text[0] = "Trigger Window:";
+	prvButton.text[1] = "-8 / +32 msg";
+	prvButton.textSize[0] = LCDFontEnlarge_1x;
+	prvButton.textSize[1] = LCDFontEnlarge_1x;
+	GUIButton_Add(&prvButton);
+
 
 	/* CAN1 10k bit rate Button */
 	prvButton.object.id = GUIButtonId_Can1BitRate10k;
@@ -738,6 +842,8 @@ void guiCan1InitGuiElements()
 	prvContainer.buttons[1] = GUIButton_GetFromId(GUIButtonId_Can1BitRate);
 	prvContainer.buttons[2] = GUIButton_GetFromId(GUIButtonId_Can1Termination);
 	prvContainer.buttons[3] = GUIButton_GetFromId(GUIButtonId_Can1Clear);
+	prvContainer.buttons[4] = GUIButton_GetFromId(GUIButtonId_Can1Trigger);
+	prvContainer.buttons[5] = GUIButton_GetFromId(GUIButtonId_Can1TriggerWindow);
 	prvContainer.textBoxes[0] = GUITextBox_GetFromId(GUITextBoxId_Can1Label);
 	GUIContainer_Add(&prvContainer);
 
@@ -838,5 +944,32 @@ static void prvWriteMessageListToDisplay()
 	}
 }
 
+/**
+ * @brief	Update the text of the trigger buttons to match the settings
+ * @param	Trigger: The trigger settings
+ * @retval	None
+ */
+static void prvUpdateTriggerButtons(CaptureTriggerSettings* Trigger)
+{
+	switch (Trigger->mode)
+	{
+		case CaptureTriggerMode_CanId:
+			GUIButton_SetTextForRow(GUIButtonId_Can1Trigger, "CAN ID", 1);
+			break;
+		case CaptureTriggerMode_IdleGap:
+			GUIButton_SetTextForRow(GUIButtonId_Can1Trigger, "Idle Gap", 1);
+			break;
+		default:
+			GUIButton_SetTextForRow(GUIButtonId_Can1Trigger, "Off", 1);
+			break;
+	}
+
+	for (uint32_t i = 0; i < NUM_OF_TRIGGER_WINDOWS; i++)
+	{
+		if (Trigger->preTriggerItems == prvTriggerWindows[i][0])
+			GUIButton_SetTextForRow(GUIButtonId_Can1TriggerWindow, (uint8_t*)prvTriggerWindowTexts[i], 1);
+	}
+}
+
 
 /* Interrupt Handlers --------------------------------------------------------*/
@@ -29,13 +29,20 @@
 #include "spi_flash.h"
 
 /* Private defines -----------------------------------------------------------*/
+#define NUM_OF_TRIGGER_WINDOWS	(3)
+
 /* Private typedefs ----------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 static GUITextBox prvTextBox = {0};
 static GUIButton prvButton = {0};
 static GUIContainer prvContainer = {0};
 
+/* Bytes kept before and after a trigger hit */
+static const uint32_t prvTriggerWindows[NUM_OF_TRIGGER_WINDOWS][2] = {{16, 64}, {64, 256}, {256, 1024}};
+static const char* prvTriggerWindowTexts[NUM_OF_TRIGGER_WINDOWS] = {"-16 / +64 B", "-64 / +256 B", "-256 / +1024 B"};
+
 /* Private function prototypes -----------------------------------------------*/
+static void prvUpdateTriggerButtons(CaptureTriggerSettings* Trigger);
 
 /* Functions -----------------------------------------------------------------*/
 /* UART1 GUI Elements ========================================================*/
@@ -242,6 +249,54 @@ void guiUart1DebugButtonCallback(GUITouchEvent Event, uint32_t ButtonId)
 	}
 }
 
+/**
+ * @brief	Callback for the trigger button, steps through the trigger modes
+ * @param	Event: The event that caused the callback
+ * @param	ButtonId: The button ID that the event happened on
+ * @retval	None
+ */
+void guiUart1TriggerButtonCallback(GUITouchEvent Event, uint32_t ButtonId)
+{
+	if (Event == GUITouchEvent_Up)
+	{
+		CaptureTriggerSettings trigger = uart1GetSettings()->trigger;
+		if (trigger.mode == CaptureTriggerMode_Off)
+			trigger.mode = CaptureTriggerMode_Sequence;
+		else if (trigger.mode == CaptureTriggerMode_Sequence)
+			trigger.mode = CaptureTriggerMode_IdleGap;
+		else
+			trigger.mode = CaptureTriggerMode_Off;
+
+		if (uart1SetTrigger(&trigger) == SUCCESS)
+			prvUpdateTriggerButtons(&trigger);
+	}
+}
+
+/**
+ * @brief	Callback for the trigger window button, steps through the window sizes
+ * @param	Event: The event that caused the callback
+ * @param	ButtonId: The button ID that the event happened on
+ * @retval	None
+ */
+void guiUart1TriggerWindowButtonCallback(GUITouchEvent Event, uint32_t ButtonId)
+{
+	if (Event == GUITouchEvent_Up)
+	{
+		CaptureTriggerSettings trigger = uart1GetSettings()->trigger;
+		uint32_t next = 0;
+		for (uint32_t i = 0; i < NUM_OF_TRIGGER_WINDOWS; i++)
+		{
+			if (trigger.preTriggerItems == prvTriggerWindows[i][0])
+				next = (i + 1) % NUM_OF_TRIGGER_WINDOWS;
+		}
+		trigger.preTriggerItems = prvTriggerWindows[next][0];
+		trigger.postTriggerItems = prvTriggerWindows[next][1];
+
+		if (uart1SetTrigger(&trigger) == SUCCESS)
+			prvUpdateTriggerButtons(&trigger);
+	}
+}
+
 /**
  * @brief
  * @param	Event: The event that caused the callback
@@ -544,6 +599,8 @@ void guiUart1UpdateGuiElementsReadFromSettings()
 		default:
 			break;
 	}
+	/* Update the trigger texts to match what is actually set */
+	prvUpdateTriggerButtons(&settings->trigger);
 }
 
 /**
@@ -805,6 +862,54 @@ void guiUart1InitGuiElements()
 	prvButton.textSize[1] = LCDFontEnlarge_1x;
 	GUIButton_Add(&prvButton);
 
+	/* UART1 Trigger Button */
+	prvButton.object.id = GUIButtonId_Uart1Trigger;
+	prvButton.object.xPos = 650;
+	prvButton.object.yPos = 200;
+	prvButton.object.width = 150;
+	prvButton.object.height = 50;
+	prvButton.object.border = GUIBorder_Top | GUIBorder_Bottom | GUIBorder_Left;
+	prvButton.object.borderThickness = 1;
+	prvButton.object.borderColor = GUI_WHITE;
+	prvButton.object.containerPage = GUIContainerPage_2;
+	prvButton.enabledTextColor = GUI_WHITE;
+	prvButton.enabledBackgroundColor = GUI_GREEN;
+	prvButton.disabledTextColor = GUI_WHITE;
+	prvButton.disabledBackgroundColor = GUI_GREEN;
+	prvButton.pressedTextColor = GUI_GREEN;
+	prvButton.pressedBackgroundColor = GUI_WHITE;
+	prvButton.state = GUIButtonState_Disabled;
+	prvButton.touchCallback = guiUart1TriggerButtonCallback;
+	prvButton.text[0] = "Trigger:";
+	prvButton.text[1] = "Off";
+	prvButton.textSize[0] = LCDFontEnlarge_1x;
+	prvButton.textSize[1] = LCDFontEnlarge_1x;
+	GUIButton_Add(&prvButton);
+
+	/* UART1 Trigger Window Button */
+	prvButton.object.id = GUIButtonId_Uart1TriggerWindow;
+	prvButton.object.xPos = 650;
+	prvButton.object.yPos = 250;
+	prvButton.object.width = 150;
+	prvButton.object.height = 50;
+	prvButton.object.border = GUIBorder_Top | GUIBorder_Bottom | GUIBorder_Left;
+	prvButton.object.borderThickness = 1;
+	prvButton.object.borderColor = GUI_WHITE;
+	prvButton.object.containerPage = GUIContainerPage_2;
+	prvButton.enabledTextColor = GUI_WHITE;
+	prvButton.enabledBackgroundColor = GUI_GREEN;
+	prvButton.disabledTextColor = GUI_WHITE;
+	prvButton.disabledBackgroundColor = GUI_GREEN;
+	prvButton.pressedTextColor = GUI_GREEN;
+	prvButton.pressedBackgroundColor = GUI_WHITE;
+	prvButton.state = GUIButtonState_Disabled;
+	prvButton.touchCallback = guiUart1TriggerWindowButtonCallback;
+	prvButton.text[0] = "Trigger Window:";
+	prvButton.text[1] = "-64 / +256 B";
+	prvButton.textSize[0] = LCDFontEnlarge_1x;
+	prvButton.textSize[1] = LCDFontEnlarge_1x;
+	GUIButton_Add(&prvButton);
+
 	/* UART1 Sidebar backwards button */
 	prvButton.object.id = GUIButtonId_Uart1SidebarBackwards;
 	prvButton.object.xPos = 650;
@@ -1113,8 +1218,10 @@ void guiUart1InitGuiElements()
 	prvContainer.buttons[4] = GUIButton_GetFromId(GUIButtonId_Uart1Format);
 	prvContainer.buttons[5] = GUIButton_GetFromId(GUIButtonId_Uart1Clear);
 	prvContainer.buttons[6] = GUIButton_GetFromId(GUIButtonId_Uart1Debug);
-	prvContainer.buttons[7] = GUIButton_GetFromId(GUIButtonId_Uart1SidebarBackwards);
-	prvContainer.buttons[8] = GUIButton_GetFromId(GUIButtonId_Uart1SidebarForwards);
+	prvContainer.buttons[7] = GUIButton_GetFromId(GUIButtonId_Uart1Trigger);
+	prvContainer.buttons[8] = GUIButton_GetFromId(GUIButtonId_Uart1TriggerWindow);
+	prvContainer.buttons[9] = GUIButton_GetFromId(GUIButtonId_Uart1SidebarBackwards);
+	prvContainer.buttons[10] = GUIButton_GetFromId(GUIButtonId_Uart1SidebarForwards);
 	prvContainer.textBoxes[0] = GUITextBox_GetFromId(GUITextBoxId_Uart1Label);
 	GUIContainer_Add(&prvContainer);
 
@@ -1173,4 +1280,32 @@ void guiUart1InitGuiElements()
 	GUIContainer_Add(&prvContainer);
 }
 
+/* Private functions .--------------------------------------------------------*/
+/**
+ * @brief	Update the text of the trigger buttons to match the settings
+ * @param	Trigger: The trigger settings
+ * @retval	None
+ */
+static void prvUpdateTriggerButtons(CaptureTriggerSettings* Trigger)
+{
+	switch (Trigger->mode)
+	{
+		case CaptureTriggerMode_Sequence:
+			GUIButton_SetTextForRow(GUIButtonId_Uart1Trigger, "Sequence", 1);
+			break;
+		case CaptureTriggerMode_IdleGap:
+			GUIButton_SetTextForRow(GUIButtonId_Uart1Trigger, "Idle Gap", 1);
+			break;
+		default:
+			GUIButton_SetTextForRow(GUIButtonId_Uart1Trigger, "Off", 1);
+			break;
+	}
+
+	for (uint32_t i = 0; i < NUM_OF_TRIGGER_WINDOWS; i++)
+	{
+		if (Trigger->preTriggerItems == prvTriggerWindows[i][0])
+			GUIButton_SetTextForRow(GUIButtonId_Uart1TriggerWindow, (uint8_t*)prvTriggerWindowTexts[i], 1);
+	}
+}
+
 /* Interrupt Handlers --------------------------------------------------------*/
@@ -40,8 +40,6 @@
 #define UART_RX_PIN		(GPIO_PIN_1)
 #define UART_PORT		(GPIOA)
 
-#define RX_BUFFER_SIZE	(256)
-
 /* Private typedefs ----------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 static RelayDevice switchRelay = {
@@ -78,17 +76,7 @@ static SemaphoreHandle_t xSettingsSemaphore;
 
 static uint8_t prvReceivedByte;
 
-static uint8_t prvRxBuffer1[RX_BUFFER_SIZE];
-static uint32_t prvRxBuffer1CurrentIndex = 0;
-static uint32_t prvRxBuffer1Count = 0;
-static BUFFERState prvRxBuffer1State = BUFFERState_Writing;
-static TimerHandle_t prvBuffer1ClearTimer;
-
-static uint8_t prvRxBuffer2[RX_BUFFER_SIZE];
-static uint32_t prvRxBuffer2CurrentIndex = 0;
-static uint32_t prvRxBuffer2Count = 0;
-static BUFFERState prvRxBuffer2State = BUFFERState_Writing;
-static TimerHandle_t prvBuffer2ClearTimer;
+static CaptureLog prvLog;
 
 static bool prvDoneInitializing = false;
 static bool prvChannelIsEnabled = false;
@@ -99,8 +87,7 @@ static void prvEnableRs232Interface();
 static void prvDisableRs232Interface();
 static ErrorStatus prvReadSettingsFromSpiFlash();
 
-static void prvBuffer1ClearTimerCallback();
-static void prvBuffer2ClearTimerCallback();
+static void prvLogWritten(uint32_t NumOfBytes, uint32_t NumOfRecords);
 
 /* Functions -----------------------------------------------------------------*/
 /**
@@ -116,9 +103,8 @@ void rs232Task(void *pvParameters)
 	/* Mutex semaphore for accessing the settings for this channel */
 	xSettingsSemaphore = xSemaphoreCreateMutex();
 
-	/* Create software timers */
-	prvBuffer1ClearTimer = xTimerCreate("Buf1ClearRs232", 10, pdFALSE, 0, prvBuffer1ClearTimerCallback);
-	prvBuffer2ClearTimer = xTimerCreate("Buf2ClearRs232", 10, pdFALSE, 0, prvBuffer2ClearTimerCallback);
+	/* Received data is gathered in pages that the log task programs to the SPI FLASH */
+	captureLogInit(&prvLog, FLASH_ADR_RS232_DATA, FLASH_CHANNEL_DATA_SIZE, prvLogWritten);
 
 	/* Initialize hardware */
 	prvHardwareInit();
@@ -267,12 +253,17 @@ ErrorStatus rs232Clear()
 	/* Try to take the settings semaphore */
 	if (xSettingsSemaphore != 0 && xSemaphoreTake(xSettingsSemaphore, 1000) == pdTRUE)
 	{
+		/* Nothing may be programmed while the FLASH is cleared */
+		captureLogStop(&prvLog);
+
 		prvCurrentSettings.writeAddress = FLASH_ADR_RS232_DATA;
 		prvCurrentSettings.amountOfDataSaved = 0;
 
 		/* Clear the FLASH */
 		rs232ClearFlash();
 
+		captureLogStart(&prvLog);
+
 		/* Give back the semaphore now that we are done */
 		xSemaphoreGive(xSettingsSemaphore);
 
@@ -294,6 +285,16 @@ uint32_t rs232GetCurrentWriteAddress()
 	return prvCurrentSettings.writeAddress;
 }
 
+/**
+ * @brief	Get the statistics of the logging to SPI FLASH
+ * @param	None
+ * @retval	A pointer to the statistics
+ */
+CaptureLogStatistics* rs232GetLogStatistics()
+{
+	return &prvLog.statistics;
+}
+
 /**
  * @brief	Transmit data
  * @param	Data: Pointer to the buffer to send
@@ -383,13 +384,6 @@ static void prvDisableRs232Interface()
 	__UART4_CLK_DISABLE();
 	xSemaphoreGive(xSemaphore);
 
-	prvRxBuffer1CurrentIndex = 0;
-	prvRxBuffer1Count = 0;
-	prvRxBuffer1State = BUFFERState_Writing;
-	prvRxBuffer2CurrentIndex = 0;
-	prvRxBuffer2Count = 0;
-	prvRxBuffer2State = BUFFERState_Writing;
-
 	prvChannelIsEnabled = false;
 }
 
@@ -437,59 +431,15 @@ static ErrorStatus prvReadSettingsFromSpiFlash()
 }
 
 /**
- * @brief	Callback for the buffer 1 software timer
- * @param	None
- * @retval	None
- */
-static void prvBuffer1ClearTimerCallback()
-{
-	/* Set the buffer to reading state */
-	prvRxBuffer1State = BUFFERState_Reading;
-
-	/* Write the data to FLASH */
-	for (uint32_t i = 0; i < prvRxBuffer1Count; i++)
-		SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, prvRxBuffer1[i]);
-	/* TODO: Something strange with the FLASH page write so doing one byte at a time now */
-//	/* Write all the data in the buffer to SPI FLASH */
-//	SPI_FLASH_WriteBuffer(prvRxBuffer1, prvCurrentSettings.writeAddress, prvRxBuffer1Count);
-//	/* Update the write address */
-//	prvCurrentSettings.writeAddress += prvRxBuffer1Count;
-
-	/* Save how many bytes we saved */
-	prvCurrentSettings.amountOfDataSaved += prvRxBuffer1Count;
-
-	/* Reset the buffer */
-	prvRxBuffer1CurrentIndex = 0;
-	prvRxBuffer1Count = 0;
-	prvRxBuffer1State = BUFFERState_Writing;
-}
-
-/**
- * @brief	Callback for the buffer 2 software timer
- * @param	None
+ * @brief	Called from the log task when received data has been programmed to the SPI FLASH
+ * @param	NumOfBytes: Number of bytes programmed
+ * @param	NumOfRecords: Number of records programmed, one per byte
  * @retval	None
  */
-static void prvBuffer2ClearTimerCallback()
+static void prvLogWritten(uint32_t NumOfBytes, uint32_t NumOfRecords)
 {
-	/* Set the buffer to reading state */
-	prvRxBuffer2State = BUFFERState_Reading;
-
-	/* Write the data to FLASH */
-	for (uint32_t i = 0; i < prvRxBuffer2Count; i++)
-		SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, prvRxBuffer2[i]);
-	/* TODO: Something strange with the FLASH page write so doing one byte at a time now */
-//	/* Write all the data in the buffer to SPI FLASH */
-//	SPI_FLASH_WriteBuffer(prvRxBuffer2, prvCurrentSettings.writeAddress, prvRxBuffer2Count);
-//	/* Update the write address */
-//	prvCurrentSettings.writeAddress += prvRxBuffer2Count;
-
-	/* Save how many bytes we saved */
-	prvCurrentSettings.amountOfDataSaved += prvRxBuffer2Count;
-
-	/* Reset the buffer */
-	prvRxBuffer2CurrentIndex = 0;
-	prvRxBuffer2Count = 0;
-	prvRxBuffer2State = BUFFERState_Writing;
+	prvCurrentSettings.writeAddress += NumOfBytes;
+	prvCurrentSettings.amountOfDataSaved += NumOfBytes;
 }
 
 /* Interrupt Handlers --------------------------------------------------------*/
@@ -522,27 +472,9 @@ void rs232TxCpltCallback()
   */
 void rs232RxCpltCallback()
 {
-	if (prvRxBuffer1State != BUFFERState_Reading && prvRxBuffer1Count < RX_BUFFER_SIZE)
-	{
-		prvRxBuffer1State = BUFFERState_Writing;
-		prvRxBuffer1[prvRxBuffer1CurrentIndex++] = prvReceivedByte;
-		prvRxBuffer1Count++;
-		/* Start the timer which will clear the buffer if it's not already started */
-		if (xTimerIsTimerActive(prvBuffer1ClearTimer) == pdFALSE)
-			xTimerStartFromISR(prvBuffer1ClearTimer, NULL);
-	}
-	else if (prvRxBuffer2State != BUFFERState_Reading && prvRxBuffer2Count < RX_BUFFER_SIZE)
-	{
-		prvRxBuffer2State = BUFFERState_Writing;
-		prvRxBuffer2[prvRxBuffer2CurrentIndex++] = prvReceivedByte;
-		prvRxBuffer2Count++;
-		/* Start the timer which will clear the buffer if it's not already started */
-		if (xTimerIsTimerActive(prvBuffer2ClearTimer) == pdFALSE)
-			xTimerStartFromISR(prvBuffer2ClearTimer, NULL);
-	}
-	else
+	if (!captureLogAppendFromISR(&prvLog, &prvReceivedByte, 1))
 	{
-		/* No buffer available, something has gone wrong */
+		/* No room in the log, something has gone wrong */
 		HAL_GPIO_TogglePin(GPIOC, GPIO_PIN_3);
 	}
 
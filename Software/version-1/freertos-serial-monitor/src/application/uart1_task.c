@@ -40,7 +40,7 @@
 #define UART_RX_PIN		(GPIO_PIN_10)
 #define UART_PORT		(GPIOA)
 
-#define RX_BUFFER_SIZE	(256)
+#define TRIGGER_RING_SIZE	(256)
 
 /* Private typedefs ----------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
@@ -76,6 +76,12 @@ static UARTSettings prvCurrentSettings = {
 		.textFormat						= GUITextFormat_ASCII,
 		.writeAddress					= FLASH_ADR_UART1_DATA,
 		.amountOfDataSaved				= 0,
+		.trigger.mode					= CaptureTriggerMode_Off,
+		.trigger.sequence				= {'\r', '\n'},
+		.trigger.sequenceLength			= 2,
+		.trigger.idleGapMs				= 100,
+		.trigger.preTriggerItems		= 64,
+		.trigger.postTriggerItems		= 256,
 };
 
 static SemaphoreHandle_t xSemaphore;
@@ -83,17 +89,10 @@ static SemaphoreHandle_t xSettingsSemaphore;
 
 static uint8_t prvReceivedByte;
 
-static uint8_t prvRxBuffer1[RX_BUFFER_SIZE];
-static uint32_t prvRxBuffer1CurrentIndex = 0;
-static uint32_t prvRxBuffer1Count = 0;
-static BUFFERState prvRxBuffer1State = BUFFERState_Writing;
-static TimerHandle_t prvBuffer1ClearTimer;
+static CaptureLog prvLog;
 
-static uint8_t prvRxBuffer2[RX_BUFFER_SIZE];
-static uint32_t prvRxBuffer2CurrentIndex = 0;
-static uint32_t prvRxBuffer2Count = 0;
-static BUFFERState prvRxBuffer2State = BUFFERState_Writing;
-static TimerHandle_t prvBuffer2ClearTimer;
+static CaptureTrigger prvTrigger;
+static uint8_t prvTriggerRing[TRIGGER_RING_SIZE];
 
 static bool prvDoneInitializing = false;
 static bool prvChannelIsEnabled = false;
@@ -104,8 +103,8 @@ static void prvEnableUart1Interface();
 static void prvDisableUart1Interface();
 static ErrorStatus prvReadSettingsFromSpiFlash();
 
-static void prvBuffer1ClearTimerCallback();
-static void prvBuffer2ClearTimerCallback();
+static void prvLogWritten(uint32_t NumOfBytes, uint32_t NumOfRecords);
+static void prvStoreReceivedByte(const void* Item);
 
 /* Functions -----------------------------------------------------------------*/
 /**
@@ -121,9 +120,12 @@ void uart1Task(void *pvParameters)
 	/* Mutex semaphore for accessing the settings for this channel */
 	xSettingsSemaphore = xSemaphoreCreateMutex();
 
-	/* Create software timers */
-	prvBuffer1ClearTimer = xTimerCreate("Buf1ClearUart1", 10, pdFALSE, 0, prvBuffer1ClearTimerCallback);
-	prvBuffer2ClearTimer = xTimerCreate("Buf2ClearUart1", 10, pdFALSE, 0, prvBuffer2ClearTimerCallback);
+	/* Received bytes go through the trigger before they are added to the log */
+	captureTriggerInit(&prvTrigger, &prvCurrentSettings.trigger, prvTriggerRing,
+					   sizeof(uint8_t), TRIGGER_RING_SIZE, prvStoreReceivedByte);
+
+	/* Received data is gathered in pages that the log task programs to the SPI FLASH */
+	captureLogInit(&prvLog, FLASH_ADR_UART1_DATA, FLASH_CHANNEL_DATA_SIZE, prvLogWritten);
 
 	/* Initialize hardware */
 	prvHardwareInit();
@@ -280,6 +282,26 @@ SemaphoreHandle_t* uart1GetSettingsSemaphore()
 	return &xSettingsSemaphore;
 }
 
+/**
+ * @brief	Set new trigger settings, the trigger is restarted
+ * @param	Settings: The new settings
+ * @retval	SUCCESS: Everything went ok
+ * @retval	ERROR: Something went wrong
+ */
+ErrorStatus uart1SetTrigger(CaptureTriggerSettings* Settings)
+{
+	if (!IS_CAPTURE_TRIGGER_SETTINGS(Settings))
+		return ERROR;
+
+	/* The RX interrupt uses the trigger so it's kept out while it's changed */
+	taskENTER_CRITICAL();
+	memcpy(&prvCurrentSettings.trigger, Settings, sizeof(CaptureTriggerSettings));
+	captureTriggerReset(&prvTrigger);
+	taskEXIT_CRITICAL();
+
+	return SUCCESS;
+}
+
 /**
  * @brief	Clear the channel
  * @param	None
@@ -291,12 +313,17 @@ ErrorStatus uart1Clear()
 	/* Try to take the settings semaphore */
 	if (xSettingsSemaphore != 0 && xSemaphoreTake(xSettingsSemaphore, 1000) == pdTRUE)
 	{
+		/* Nothing may be programmed while the FLASH is cleared */
+		captureLogStop(&prvLog);
+
 		prvCurrentSettings.writeAddress = FLASH_ADR_UART1_DATA;
 		prvCurrentSettings.amountOfDataSaved = 0;
 
 		/* Clear the FLASH */
 		uart1ClearFlash();
 
+		captureLogStart(&prvLog);
+
 		/* Give back the semaphore now that we are done */
 		xSemaphoreGive(xSettingsSemaphore);
 
@@ -318,6 +345,16 @@ uint32_t uart1GetCurrentWriteAddress()
 	return prvCurrentSettings.writeAddress;
 }
 
+/**
+ * @brief	Get the statistics of the logging to SPI FLASH
+ * @param	None
+ * @retval	A pointer to the statistics
+ */
+CaptureLogStatistics* uart1GetLogStatistics()
+{
+	return &prvLog.statistics;
+}
+
 /**
  * @brief	Transmit data
  * @param	Data: Pointer to the buffer to send
@@ -408,12 +445,7 @@ static void prvDisableUart1Interface()
 	__USART1_CLK_DISABLE();
 	xSemaphoreGive(xSemaphore);
 
-	prvRxBuffer1CurrentIndex = 0;
-	prvRxBuffer1Count = 0;
-	prvRxBuffer1State = BUFFERState_Writing;
-	prvRxBuffer2CurrentIndex = 0;
-	prvRxBuffer2Count = 0;
-	prvRxBuffer2State = BUFFERState_Writing;
+	captureTriggerReset(&prvTrigger);
 
 	prvChannelIsEnabled = false;
 }
@@ -434,7 +466,8 @@ static ErrorStatus prvReadSettingsFromSpiFlash()
 			IS_UART_BAUDRATE(settings.baudRate) &&
 			IS_UART_POWER(settings.power) &&
 			IS_UART_MODE_APP(settings.mode) &&
-			IS_GUI_TEXT_FORMAT(settings.textFormat))
+			IS_GUI_TEXT_FORMAT(settings.textFormat) &&
+			IS_CAPTURE_TRIGGER_SETTINGS(&settings.trigger))
 		{
 			/* Try to take the settings semaphore */
 			if (xSettingsSemaphore != 0 && xSemaphoreTake(xSettingsSemaphore, 100) == pdTRUE)
@@ -444,6 +477,7 @@ static ErrorStatus prvReadSettingsFromSpiFlash()
 				prvCurrentSettings.power = UARTPower_5V;
 				prvCurrentSettings.mode = UARTMode_TX_RX;
 				uart1UpdateWithNewSettings();
+				captureTriggerReset(&prvTrigger);
 				/* Give back the semaphore now that we are done */
 				xSemaphoreGive(xSettingsSemaphore);
 				return SUCCESS;
@@ -463,59 +497,29 @@ static ErrorStatus prvReadSettingsFromSpiFlash()
 
 
 /**
- * @brief	Callback for the buffer 1 software timer
- * @param	None
+ * @brief	Called from the log task when received data has been programmed to the SPI FLASH
+ * @param	NumOfBytes: Number of bytes programmed
+ * @param	NumOfRecords: Number of records programmed, one per byte
  * @retval	None
  */
-static void prvBuffer1ClearTimerCallback()
+static void prvLogWritten(uint32_t NumOfBytes, uint32_t NumOfRecords)
 {
-	/* Set the buffer to reading state */
-	prvRxBuffer1State = BUFFERState_Reading;
-
-	/* Write the data to FLASH */
-	for (uint32_t i = 0; i < prvRxBuffer1Count; i++)
-		SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, prvRxBuffer1[i]);
-	/* TODO: Something strange with the FLASH page write so doing one byte at a time now */
-//	/* Write all the data in the buffer to SPI FLASH */
-//	SPI_FLASH_WriteBuffer(prvRxBuffer1, prvCurrentSettings.writeAddress, prvRxBuffer1Count);
-//	/* Update the write address */
-//	prvCurrentSettings.writeAddress += prvRxBuffer1Count;
-
-	/* Save how many bytes we saved */
-	prvCurrentSettings.amountOfDataSaved += prvRxBuffer1Count;
-
-	/* Reset the buffer */
-	prvRxBuffer1CurrentIndex = 0;
-	prvRxBuffer1Count = 0;
-	prvRxBuffer1State = BUFFERState_Writing;
+	prvCurrentSettings.writeAddress += NumOfBytes;
+	prvCurrentSettings.amountOfDataSaved += NumOfBytes;
 }
 
 /**
- * @brief	Callback for the buffer 2 software timer
- * @param	None
+ * @brief	Add a received byte to the log, called by the trigger from the RX interrupt
+ * @param	Item: Pointer to the byte
  * @retval	None
  */
-static void prvBuffer2ClearTimerCallback()
+static void prvStoreReceivedByte(const void* Item)
 {
-	/* Set the buffer to reading state */
-	prvRxBuffer2State = BUFFERState_Reading;
-
-	/* Write the data to FLASH */
-	for (uint32_t i = 0; i < prvRxBuffer2Count; i++)
-		SPI_FLASH_WriteByte(prvCurrentSettings.writeAddress++, prvRxBuffer2[i]);
-	/* TODO: Something strange with the FLASH page write so doing one byte at a time now */
-//	/* Write all the data in the buffer to SPI FLASH */
-//	SPI_FLASH_WriteBuffer(prvRxBuffer2, prvCurrentSettings.writeAddress, prvRxBuffer2Count);
-//	/* Update the write address */
-//	prvCurrentSettings.writeAddress += prvRxBuffer2Count;
-
-	/* Save how many bytes we saved */
-	prvCurrentSettings.amountOfDataSaved += prvRxBuffer2Count;
-
-	/* Reset the buffer */
-	prvRxBuffer2CurrentIndex = 0;
-	prvRxBuffer2Count = 0;
-	prvRxBuffer2State = BUFFERState_Writing;
+	if (!captureLogAppendFromISR(&prvLog, Item, 1))
+	{
+		/* No room in the log, something has gone wrong */
+		HAL_GPIO_TogglePin(GPIOC, GPIO_PIN_3);
+	}
 }
 
 /* Interrupt Handlers --------------------------------------------------------*/
@@ -548,29 +552,7 @@ void uart1TxCpltCallback()
   */
 void uart1RxCpltCallback()
 {
-	if (prvRxBuffer1State != BUFFERState_Reading && prvRxBuffer1Count < RX_BUFFER_SIZE)
-	{
-		prvRxBuffer1State = BUFFERState_Writing;
-		prvRxBuffer1[prvRxBuffer1CurrentIndex++] = prvReceivedByte;
-		prvRxBuffer1Count++;
-		/* Start the timer which will clear the buffer if it's not already started */
-		if (xTimerIsTimerActive(prvBuffer1ClearTimer) == pdFALSE)
-			xTimerStartFromISR(prvBuffer1ClearTimer, NULL);
-	}
-	else if (prvRxBuffer2State != BUFFERState_Reading && prvRxBuffer2Count < RX_BUFFER_SIZE)
-	{
-		prvRxBuffer2State = BUFFERState_Writing;
-		prvRxBuffer2[prvRxBuffer2CurrentIndex++] = prvReceivedByte;
-		prvRxBuffer2Count++;
-		/* Start the timer which will clear the buffer if it's not already started */
-		if (xTimerIsTimerActive(prvBuffer2ClearTimer) == pdFALSE)
-			xTimerStartFromISR(prvBuffer2ClearTimer, NULL);
-	}
-	else
-	{
-		/* No buffer available, something has gone wrong */
-		HAL_GPIO_TogglePin(GPIOC, GPIO_PIN_3);
-	}
+	captureTriggerProcessByte(&prvTrigger, prvReceivedByte, xTaskGetTickCountFromISR());
 
 	/* Continue receiving data */
 	HAL_UART_Receive_IT(&UART_Handle, &prvReceivedByte, 1);
@@ -67,6 +67,8 @@
 
 #define SPI_FLASH_SECTOR_CLEAN_CHECK_SIZE		(128)
 
+#define SPI_FLASH_PAGE_SIZE		(256)
+
 /* Private typedefs ----------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 static SPI_HandleTypeDef SPI_Handle = {
@@ -121,6 +123,7 @@ static uint32_t prvDeviceId = 0;
 static SemaphoreHandle_t xSemaphore;
 static bool prvInitialized = false;
 static bool prvDmaTransferIsDone = true;
+static SemaphoreHandle_t xDmaSemaphore;
 static uint8_t prvSectorCheckBuffer[SPI_FLASH_SECTOR_CLEAN_CHECK_SIZE] = {0};
 
 /* Private function prototypes -----------------------------------------------*/
@@ -132,6 +135,7 @@ static void prvSPI_FLASH_WriteDisable();
 static void prvSPI_FLASH_WriteEnable();
 static uint8_t prvSPI_FLASH_SendReceiveByte(uint8_t Byte);
 static void prvSPI_FLASH_WaitForWriteEnd();
+static void prvSPI_FLASH_AbortTxDma();
 
 /* Functions -----------------------------------------------------------------*/
 /**
@@ -147,6 +151,10 @@ ErrorStatus SPI_FLASH_Init()
 		/* Mutex semaphore for mutual exclusion to the SPI Flash device */
 		xSemaphore = xSemaphoreCreateMutex();
 
+		/* Binary semaphore given when a DMA page program is done */
+		vSemaphoreCreateBinary(xDmaSemaphore);
+		xSemaphoreTake(xDmaSemaphore, 0);
+
 		/* Init GPIO */
 		FLASH_GPIO_CLK_ENABLE();
 		GPIO_InitTypeDef GPIO_InitStructure;
@@ -295,6 +303,68 @@ void SPI_FLASH_WriteBuffer(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t Num
 	}
 }
 
+/**
+  * @brief  Program up to one page of the FLASH with the data sent by DMA
+  * @note   Addresses to be written must be in the erased state
+  * @note   The data must not cross a page boundary, the calling task sleeps while the DMA
+  *         sends the data but the program time is polled
+  * @param	pBuffer: pointer to the buffer with data to write, must stay valid until the function returns
+  * @param  WriteAddress: start of FLASH's internal address to write to
+  * @param  NumByteToWrite: number of bytes to write to the FLASH
+  * @param	BlockTime: ticks to wait for the device
+  * @retval SUCCESS: The page was programmed
+  * @retval ERROR: The device was busy or the arguments were wrong
+  */
+ErrorStatus SPI_FLASH_WritePageDMA(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite, TickType_t BlockTime)
+{
+	if (NumByteToWrite == 0 ||
+		(WriteAddress % SPI_FLASH_PAGE_SIZE) + NumByteToWrite > SPI_FLASH_PAGE_SIZE)
+		return ERROR;
+
+	/* Try to take the semaphore in case some other process is using the device */
+	if (xSemaphoreTake(xSemaphore, BlockTime) == pdTRUE)
+	{
+		ErrorStatus status = SUCCESS;
+
+		/* Enable the write access to the FLASH */
+		prvSPI_FLASH_WriteEnable();
+
+		/* Select the FLASH */
+		prvSPI_FLASH_CS_LOW();
+		/* Send "Page Program" instruction */
+		prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_WRITE);
+		/* Send WriteAddress high, medium and low nibble address byte to write to */
+		prvSPI_FLASH_SendReceiveByte((WriteAddress & 0xFF0000) >> 16);
+		prvSPI_FLASH_SendReceiveByte((WriteAddress & 0xFF00) >> 8);
+		prvSPI_FLASH_SendReceiveByte(WriteAddress & 0xFF);
+
+		/* Send the data with DMA and sleep until the TX complete callback, a give left
+		 * by an earlier failed transfer is cleared first */
+		xSemaphoreTake(xDmaSemaphore, 0);
+		if (HAL_SPI_Transmit_DMA(&SPI_Handle, pBuffer, NumByteToWrite) != HAL_OK)
+			status = ERROR;
+		else if (xSemaphoreTake(xDmaSemaphore, 100) != pdTRUE)
+		{
+			/* The flash must not be deselected with the DMA still running */
+			prvSPI_FLASH_AbortTxDma();
+			status = ERROR;
+		}
+
+		/* Deselect the FLASH, this starts the programming */
+		prvSPI_FLASH_CS_HIGH();
+
+		/* Wait till the end of Flash writing */
+		prvSPI_FLASH_WaitForWriteEnd();
+
+		/* Give back the semaphore */
+		xSemaphoreGive(xSemaphore);
+
+		return status;
+	}
+	else
+		return ERROR;
+}
+
 /**
   * @brief  Write one byte to the FLASH.
   * @note   Addresses to be written must be in the erased state
@@ -732,6 +802,33 @@ static void prvSPI_FLASH_WaitForWriteEnd()
 	prvSPI_FLASH_CS_HIGH();
 }
 
+/**
+  * @brief  Stop a TX DMA transfer started with HAL_SPI_Transmit_DMA that
+  *         didn't finish, this HAL has no HAL_SPI_DMAStop
+  * @param  None
+  * @retval None
+  */
+static void prvSPI_FLASH_AbortTxDma()
+{
+	/* Disabling the stream sets its transfer complete flag, the interrupts are
+	 * disabled first so the callback doesn't give the semaphore later */
+	__HAL_DMA_DISABLE_IT(&DMA_HandleTx, DMA_IT_TC | DMA_IT_HT | DMA_IT_TE | DMA_IT_DME | DMA_IT_FE);
+	SPI_Handle.Instance->CR2 &= ~SPI_CR2_TXDMAEN;
+	HAL_DMA_Abort(&DMA_HandleTx);
+	__HAL_DMA_CLEAR_FLAG(&DMA_HandleTx, __HAL_DMA_GET_TC_FLAG_INDEX(&DMA_HandleTx) |
+										__HAL_DMA_GET_HT_FLAG_INDEX(&DMA_HandleTx) |
+										__HAL_DMA_GET_TE_FLAG_INDEX(&DMA_HandleTx) |
+										__HAL_DMA_GET_DME_FLAG_INDEX(&DMA_HandleTx) |
+										__HAL_DMA_GET_FE_FLAG_INDEX(&DMA_HandleTx));
+
+	/* Let the last byte leave the shift register and drop what was received */
+	while (__HAL_SPI_GET_FLAG(&SPI_Handle, SPI_FLAG_BSY));
+	__HAL_SPI_CLEAR_OVRFLAG(&SPI_Handle);
+
+	SPI_Handle.State = HAL_SPI_STATE_READY;
+	xSemaphoreTake(xDmaSemaphore, 0);
+}
+
 /* Interrupt Handlers --------------------------------------------------------*/
 /**
   * @brief  This function handles DMA Tx interrupt request.
@@ -765,6 +862,16 @@ void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
 	prvDmaTransferIsDone = true;
 }
 
+/**
+  * @brief  Tx Transfer completed callback, used by SPI_FLASH_WritePageDMA
+  * @param  hspi: SPI handle.
+  * @retval None
+  */
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+	xSemaphoreGiveFromISR(xDmaSemaphore, NULL);
+}
+
 /**
   * @brief  SPI error callbacks.
   * @param  hspi: SPI handle
@@ -775,5 +882,6 @@ void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
  void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
 {
 	 prvDmaTransferIsDone = true;
+	 xSemaphoreGiveFromISR(xDmaSemaphore, NULL);
 	 /* TODO: Manage errors */
 }
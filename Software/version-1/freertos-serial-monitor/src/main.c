@@ -47,6 +47,7 @@
 #include "gpio0_task.h"
 #include "gpio1_task.h"
 #include "adc_task.h"
+#include "capture_log.h"
 
 /* Priorities at which the tasks are created. */
 #define mainBACKGROUND_TASK_PRIORITY		(tskIDLE_PRIORITY)
@@ -59,6 +60,7 @@
 #define mainGPIO0_TASK_PRIORITY				(tskIDLE_PRIORITY + 2)
 #define mainGPIO1_TASK_PRIORITY				(tskIDLE_PRIORITY + 2)
 #define mainADC_TASK_PRIORITY				(tskIDLE_PRIORITY + 2)
+#define mainCAPTURE_LOG_TASK_PRIORITY		(tskIDLE_PRIORITY + 2)
 
 /* ----- Main -------------------------------------------------------------- */
 int main(int argc, char* argv[])
@@ -150,6 +152,14 @@ int main(int argc, char* argv[])
 				mainADC_TASK_PRIORITY,			/* The priority for the task */
 				NULL);							/* Handle for the created task */
 #endif
+#if 1
+	xTaskCreate(captureLogTask,					/* Pointer to the task entry function */
+				"CaptureLog",					/* Name for the task */
+				configMINIMAL_STACK_SIZE * 2,	/* The size of the stack */
+				NULL,							/* Pointer to parameters for the task */
+				mainCAPTURE_LOG_TASK_PRIORITY,	/* The priority for the task */
+				NULL);							/* Handle for the created task */
+#endif
 
 	/* Start the scheduler */
 	vTaskStartScheduler();
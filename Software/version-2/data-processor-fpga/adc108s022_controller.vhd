@@ -3,7 +3,12 @@
 -- * @author  Hampus Sandberg
 -- * @version 0.1
 -- * @date    2015-08-16
--- * @brief
+-- * @brief   Round-robins the eight ADC channels and keeps the latest value
+-- *          of each. In streaming mode only the selected channels are
+-- *          sampled, as fast as the SPI master allows, and every sample is
+-- *          also written to a FIFO as two bytes, 0 C2 C1 C0 0 0 D9 D8 and
+-- *          D7-D0, optionally decimated and with a timestamp header in front,
+-- *          see timestamp_encoder.vhd.
 -- *******************************************************************************
 --  Copyright (c) 2015 Hampus Sandberg.
 --
@@ -41,6 +46,21 @@ entity adc108s022_controller is
     ch6_value      : out std_logic_vector(9 downto 0);
     ch7_value      : out std_logic_vector(9 downto 0);
     valid_values  : out std_logic;
+
+    -- Stream register interface
+    reg_select  : in  std_logic := '0';
+    reg_address : in  std_logic_vector(7 downto 0) := (others => '0');
+    reg_data    : in  std_logic_vector(7 downto 0) := (others => '0');
+    reg_write   : in  std_logic := '0';
+    status      : out std_logic_vector(7 downto 0);
+
+    -- Stream FIFO interface
+    fifo_data         : out std_logic_vector(7 downto 0);
+    fifo_write        : out std_logic;
+    fifo_almost_full  : in  std_logic := '0';
+
+    -- Shared timestamp counter
+    timestamp   : in  std_logic_vector(39 downto 0) := (others => '0');
     
     -- SPI Interface
     valid_data       : in std_logic;
@@ -51,15 +71,94 @@ entity adc108s022_controller is
 end adc108s022_controller;
 
 architecture behav of adc108s022_controller is
+  -- Register map
+  constant CONTROL_REGISTER       : std_logic_vector(7 downto 0) := x"00";
+  constant CHANNEL_MASK_REGISTER  : std_logic_vector(7 downto 0) := x"01";
+  constant DECIMATION_REGISTER    : std_logic_vector(7 downto 0) := x"02";  -- Keep 1 of N+1 rounds
+
+  -- Control register bits
+  constant CONTROL_STREAM_BIT     : integer := 0;
+  constant CONTROL_TIMESTAMP_BIT  : integer := 1;  -- Write a timestamp before every sample
+  constant CONTROL_CLEAR_BIT      : integer := 7;  -- Write 1 to clear the status flags
+
   signal channel_to_sample_next : integer range 0 to 7 := 0;
+  -- The ADC returns the conversion for the channel sent in the transfer
+  -- before the one that just finished
+  signal channel_sent_last      : integer range 0 to 7 := 0;
+  signal channel_sent_before    : integer range 0 to 7 := 0;
+
+  -- Streaming
+  signal stream_enabled         : std_logic;
+  signal timestamps_enabled     : std_logic;
+  signal channel_mask           : std_logic_vector(7 downto 0);
+  signal decimation             : unsigned(7 downto 0);
+  signal decimation_count       : unsigned(7 downto 0);
+  signal keep_round             : std_logic;
+  signal overrun_error          : std_logic;
+
+  -- Record writer
+  signal record_active          : std_logic;
+  signal record_index           : integer range 0 to 7;
+  signal record_sample          : std_logic_vector(15 downto 0);
+  signal record_timestamp       : std_logic_vector(39 downto 0);
+  signal header_data            : std_logic_vector(47 downto 0);
+  signal header_length          : integer range 1 to 6;
+  signal header_skip            : integer range 0 to 6;
+  signal header_commit          : std_logic;
+  signal header_force_full      : std_logic;
   signal init_sent : std_logic;
   signal new_transfer_started : std_logic;
   signal last_valid_data : std_logic;
   
   type ADC_STATE is (RESET_STATE, INIT_STATE, RUNNING_STATE);
   signal current_state : ADC_STATE;
+
+  -- Next channel to sample, only the selected channels when streaming
+  function next_channel(current : integer range 0 to 7;
+                        mask    : std_logic_vector(7 downto 0);
+                        stream  : std_logic) return integer is
+    variable candidate : integer range 0 to 7;
+  begin
+    if (stream = '1' and mask /= x"00") then
+      candidate := current;
+      for i in 1 to 8 loop
+        candidate := (current + i) mod 8;
+        if (mask(candidate) = '1') then
+          return candidate;
+        end if;
+      end loop;
+      return current;
+    else
+      return (current + 1) mod 8;
+    end if;
+  end function next_channel;
+
+  -- First channel in a round
+  function lowest_channel(mask : std_logic_vector(7 downto 0)) return integer is
+  begin
+    for i in 0 to 7 loop
+      if (mask(i) = '1') then
+        return i;
+      end if;
+    end loop;
+    return 0;
+  end function lowest_channel;
 begin
+  timestamp_encoder_instance : entity work.timestamp_encoder
+  port map (
+    clk           => clk,
+    reset_n       => reset_n,
+    timestamp     => record_timestamp,
+    force_full    => header_force_full,
+    commit        => header_commit,
+    header_data   => header_data,
+    header_length => header_length);
+
+  -- Number of header bytes in front of the sample
+  header_skip <= header_length when timestamps_enabled = '1' else 0;
+
   process(clk, reset_n)
+    variable keep_sample : std_logic;
   begin
     -- Asynchronous reset
     if (reset_n = '0') then
@@ -77,16 +176,58 @@ begin
       valid_values <= '0';
     
       channel_to_sample_next <= 0;
+      channel_sent_last <= 0;
+      channel_sent_before <= 0;
       init_sent <= '0';
       new_transfer_started <= '0';
       last_valid_data <= '0';
       
       current_state <= RESET_STATE;
+
+      stream_enabled <= '0';
+      timestamps_enabled <= '0';
+      channel_mask <= (others => '0');
+      decimation <= (others => '0');
+      decimation_count <= (others => '0');
+      keep_round <= '1';
+      overrun_error <= '0';
+
+      fifo_data <= (others => '0');
+      fifo_write <= '0';
+      record_active <= '0';
+      record_index <= 0;
+      record_sample <= (others => '0');
+      record_timestamp <= (others => '0');
+      header_commit <= '0';
+      header_force_full <= '0';
     
     -- Synchronous part
     elsif rising_edge(clk) then
       last_valid_data <= valid_data;
       data_to_send <= (others => '0');
+      fifo_write <= '0';
+      header_commit <= '0';
+      header_force_full <= '0';
+
+      -- ======================================================================
+      -- Register writes
+      -- ======================================================================
+      if (reg_select = '1' and reg_write = '1') then
+        if (reg_address = CONTROL_REGISTER) then
+          stream_enabled <= reg_data(CONTROL_STREAM_BIT);
+          timestamps_enabled <= reg_data(CONTROL_TIMESTAMP_BIT);
+          -- Start over with a full timestamp and a new decimation round
+          header_force_full <= '1';
+          decimation_count <= (others => '0');
+          if (reg_data(CONTROL_CLEAR_BIT) = '1') then
+            overrun_error <= '0';
+          end if;
+        elsif (reg_address = CHANNEL_MASK_REGISTER) then
+          channel_mask <= reg_data;
+        elsif (reg_address = DECIMATION_REGISTER) then
+          decimation <= unsigned(reg_data);
+        end if;
+      end if;
     
       case current_state is
         -- ====================================================================================
@@ -102,7 +243,8 @@ begin
           if (enable = '1' and busy_transfer = '0' and init_sent <= '0') then
             data_to_send(13 downto 11) <= std_logic_vector(to_unsigned(channel_to_sample_next, 3));
             start_transfer <= '1';
-            channel_to_sample_next <= channel_to_sample_next + 1;
+            channel_sent_last <= channel_to_sample_next;
+            channel_to_sample_next <= next_channel(channel_to_sample_next, channel_mask, stream_enabled);
             init_sent <= '1';
           elsif (busy_transfer = '0' and init_sent <= '1') then
             current_state <= RUNNING_STATE;
@@ -117,34 +259,66 @@ begin
           if (enable = '1' and busy_transfer = '0' and new_transfer_started <= '0') then
             -- If there is a rising edge on the valid_data we should save the data_received to a channel
             if (last_valid_data = '0' and valid_data = '1') then
-              case channel_to_sample_next is 
+              case channel_sent_before is
                 -- Add the new value to the storage
                 -- Data received: | 0 0 0 0 D9 D8 D7 D6 D5 D4 D3 D2 D1 D0 0 0 | 0 0 0 0 D9 D8 ...
-                when 0 => ch6_value <= data_received(11 downto 2);
-                when 1 => ch7_value <= data_received(11 downto 2);
-                when 2 => ch0_value <= data_received(11 downto 2);
-                when 3 => ch1_value <= data_received(11 downto 2);
-                when 4 => ch2_value <= data_received(11 downto 2);
-                when 5 => ch3_value <= data_received(11 downto 2);
-                when 6 => ch4_value <= data_received(11 downto 2);
-                when 7 => ch5_value <= data_received(11 downto 2);
+                when 0 => ch0_value <= data_received(11 downto 2);
+                when 1 => ch1_value <= data_received(11 downto 2);
+                when 2 => ch2_value <= data_received(11 downto 2);
+                when 3 => ch3_value <= data_received(11 downto 2);
+                when 4 => ch4_value <= data_received(11 downto 2);
+                when 5 => ch5_value <= data_received(11 downto 2);
+                when 6 => ch6_value <= data_received(11 downto 2);
+                when 7 => ch7_value <= data_received(11 downto 2);
                 when others => null;
               end case;
+
+              -- Stream the sample if the channel is selected
+              if (stream_enabled = '1' and channel_mask(channel_sent_before) = '1') then
+                -- Decimation is done on whole rounds over the selected channels
+                keep_sample := keep_round;
+                if (channel_sent_before = lowest_channel(channel_mask)) then
+                  if (decimation_count = 0) then
+                    keep_sample := '1';
+                  else
+                    keep_sample := '0';
+                  end if;
+                  keep_round <= keep_sample;
+                  if (decimation_count >= decimation) then
+                    decimation_count <= (others => '0');
+                  else
+                    decimation_count <= decimation_count + 1;
+                  end if;
+                end if;
+
+                if (keep_sample = '1') then
+                  if (fifo_almost_full = '1' or record_active = '1') then
+                    overrun_error <= '1';
+                  else
+                    record_sample <= '0' & std_logic_vector(to_unsigned(channel_sent_before, 3)) &
+                                     "00" & data_received(11 downto 2);
+                    record_timestamp <= timestamp;
+                    record_index <= 0;
+                    record_active <= '1';
+                  end if;
+                end if;
+              end if;
             end if; -- (last_valid_data = '0' and valid_data = '1')
             
             -- Send the command to sample the next channel
             data_to_send(13 downto 11) <= std_logic_vector(to_unsigned(channel_to_sample_next, 3));
             start_transfer <= '1';
             new_transfer_started <= '1';
+            channel_sent_last <= channel_to_sample_next;
+            channel_sent_before <= channel_sent_last;
             
             -- Start from the beginning again when the last channel has been reached
-            if (channel_to_sample_next = 7) then
-              channel_to_sample_next <= 0;
+            if (next_channel(channel_to_sample_next, channel_mask, stream_enabled) <= channel_to_sample_next) then
               valid_values <= '1';
             else
-              channel_to_sample_next <= channel_to_sample_next + 1;
               valid_values <= '0';
-            end if; -- (channel_to_sample_next = 7)
+            end if;
+            channel_to_sample_next <= next_channel(channel_to_sample_next, channel_mask, stream_enabled);
           else
             new_transfer_started <= '0';
             start_transfer <= '0';
@@ -152,7 +326,35 @@ begin
         -- ====================================================================================
         when others => null;
       end case; -- current_state
+
+      -- ======================================================================
+      -- Record writer, timestamp header first and then the sample
+      -- ======================================================================
+      if (record_active = '1') then
+        if (record_index < header_skip) then
+          fifo_data <= header_data(47 - record_index*8 downto 40 - record_index*8);
+        elsif (record_index = header_skip) then
+          fifo_data <= record_sample(15 downto 8);
+        else
+          fifo_data <= record_sample(7 downto 0);
+        end if;
+        fifo_write <= '1';
+        if (record_index = header_skip + 1) then
+          record_active <= '0';
+          header_commit <= timestamps_enabled;
+        else
+          record_index <= record_index + 1;
+        end if;
+      end if;
     end if; -- if (reset_n = '0')
   end process;
 
+  -- Status register
+  status(2 downto 0) <= "000";
+  status(3) <= overrun_error;
+  status(4) <= stream_enabled;
+  status(5) <= record_active;
+  status(6) <= timestamps_enabled;
+  status(7) <= '0';
+
 end architecture behav;
\ No newline at end of file
@@ -0,0 +1,589 @@
+-- *******************************************************************************
+-- * @file    can_receiver.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-09-25
+-- * @brief   Listen only CAN decoder for one channel. Does hard and soft
+-- *          synchronization, bit destuffing, standard and extended
+-- *          identifiers and CRC-15 checking. Every frame is written to the
+-- *          channel FIFO as a record:
+-- *            0: flags (7: extended, 6: remote, 3: no ack, 2: stuff error,
+-- *               1: crc error, 0: form error)
+-- *            1: number of data bytes in the record (7..4) and DLC (3..0)
+-- *            2-5: identifier, MSB first
+-- *            6-13: data bytes
+-- *          With timestamps enabled the record is preceded by a timestamp
+-- *          header, see timestamp_encoder.vhd, with the time of the start
+-- *          of frame.
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Entity
+entity can_receiver is
+  generic(
+    DEFAULT_BIT_TIME      : integer := 100;   -- clk cycles per bit, 100 MHz / 1 Mbit/s
+    DEFAULT_SAMPLE_POINT  : integer := 75;    -- clk cycles from start of bit
+    DEFAULT_SJW           : integer := 10);   -- max clk cycles to adjust per resync
+  port(
+    clk       : in  std_logic;
+    reset_n   : in  std_logic;
+
+    -- Channel register interface
+    reg_select  : in  std_logic;
+    reg_address : in  std_logic_vector(7 downto 0);
+    reg_data    : in  std_logic_vector(7 downto 0);
+    reg_write   : in  std_logic;
+    status      : out std_logic_vector(7 downto 0);
+
+    -- Channel FIFO interface
+    fifo_data         : out std_logic_vector(7 downto 0);
+    fifo_write        : out std_logic;
+    fifo_almost_full  : in  std_logic;
+
+    -- Shared timestamp counter
+    timestamp   : in  std_logic_vector(39 downto 0) := (others => '0');
+
+    -- External hardware interface
+    can_rx      : in  std_logic);
+end can_receiver;
+
+architecture behav of can_receiver is
+  -- Register map
+  constant CONTROL_REGISTER   : std_logic_vector(7 downto 0) := x"00";
+  constant BIT_TIME_HIGH      : std_logic_vector(7 downto 0) := x"01";
+  constant BIT_TIME_LOW       : std_logic_vector(7 downto 0) := x"02";
+  constant SAMPLE_POINT_HIGH  : std_logic_vector(7 downto 0) := x"03";
+  constant SAMPLE_POINT_LOW   : std_logic_vector(7 downto 0) := x"04";
+  constant SJW_REGISTER       : std_logic_vector(7 downto 0) := x"05";
+
+  -- Control register bits
+  constant CONTROL_ENABLE_BIT : integer := 0;
+  constant CONTROL_TIMESTAMP_BIT : integer := 1;  -- Write a timestamp before every record
+  constant CONTROL_CLEAR_BIT  : integer := 7;  -- Write 1 to clear the status flags
+
+  -- Record flag bits
+  constant FLAG_FORM_ERROR    : integer := 0;
+  constant FLAG_CRC_ERROR     : integer := 1;
+  constant FLAG_STUFF_ERROR   : integer := 2;
+  constant FLAG_NO_ACK        : integer := 3;
+
+  constant CRC_POLYNOMIAL     : std_logic_vector(14 downto 0) := "100010110011001";  -- 0x4599
+
+  -- Number of recessive bits before the bus is considered idle
+  constant BUS_IDLE_BITS      : integer := 11;
+
+  -- Configuration
+  signal enabled              : std_logic;
+  signal bit_time             : unsigned(15 downto 0);
+  signal bit_time_high        : std_logic_vector(7 downto 0);
+  signal sample_point         : unsigned(15 downto 0);
+  signal sample_point_high    : std_logic_vector(7 downto 0);
+  signal sjw                  : unsigned(15 downto 0);
+  signal timestamps_enabled   : std_logic;
+
+  -- Status flags, sticky until cleared
+  signal form_error           : std_logic;
+  signal crc_error            : std_logic;
+  signal stuff_error          : std_logic;
+  signal overrun_error        : std_logic;
+  signal ack_error            : std_logic;
+
+  -- Bit timing
+  signal rx_sync              : std_logic_vector(2 downto 0);
+  signal bit_timer            : unsigned(15 downto 0);
+  signal resynced             : std_logic;
+  signal last_sampled_bit     : std_logic;
+
+  -- Frame decoder
+  type state_type is (WAIT_FOR_IDLE, IDLE, ID_A, SRR_RTR, IDE,
+                      ID_B, RTR, R1, R0, DLC, DATA, CRC, CRC_DELIMITER,
+                      ACK_SLOT, ACK_DELIMITER, END_OF_FRAME);
+  signal current_state        : state_type;
+  signal field_bit_count      : integer range 0 to 63;
+  signal idle_bit_count       : integer range 0 to BUS_IDLE_BITS;
+  signal stuff_count          : integer range 0 to 5;
+  signal stuff_last_bit       : std_logic;
+  signal crc_register         : std_logic_vector(14 downto 0);
+
+  -- Frame contents
+  type data_array is array(0 to 7) of std_logic_vector(7 downto 0);
+  signal frame_id             : std_logic_vector(28 downto 0);
+  signal frame_extended       : std_logic;
+  signal frame_remote         : std_logic;
+  signal frame_dlc            : std_logic_vector(3 downto 0);
+  signal frame_data           : data_array;
+  signal frame_data_count     : integer range 0 to 8;
+  signal frame_flags          : std_logic_vector(3 downto 0);
+  signal frame_timestamp      : std_logic_vector(39 downto 0);
+
+  -- Record writer
+  signal record_start         : std_logic;
+  signal record_active        : std_logic;
+  signal record_index         : integer range 0 to 19;
+  signal record_timestamp     : std_logic_vector(39 downto 0);
+  signal header_data          : std_logic_vector(47 downto 0);
+  signal header_length        : integer range 1 to 6;
+  signal header_skip          : integer range 0 to 6;
+  signal header_commit        : std_logic;
+  signal header_force_full    : std_logic;
+begin
+  timestamp_encoder_instance : entity work.timestamp_encoder
+  port map (
+    clk           => clk,
+    reset_n       => reset_n,
+    timestamp     => record_timestamp,
+    force_full    => header_force_full,
+    commit        => header_commit,
+    header_data   => header_data,
+    header_length => header_length);
+
+  -- Number of header bytes in front of the record
+  header_skip <= header_length when timestamps_enabled = '1' else 0;
+
+  process(clk, reset_n)
+    variable rx_bit       : std_logic;
+    variable sample_now   : std_logic;
+    variable process_bit  : std_logic;
+    variable data_length  : integer range 0 to 8;
+    variable record_byte  : std_logic_vector(7 downto 0);
+    variable field_index  : integer range 0 to 19;
+  begin
+    -- Asynchronous reset
+    if (reset_n = '0') then
+      enabled           <= '0';
+      bit_time          <= to_unsigned(DEFAULT_BIT_TIME, 16);
+      bit_time_high     <= (others => '0');
+      sample_point      <= to_unsigned(DEFAULT_SAMPLE_POINT, 16);
+      sample_point_high <= (others => '0');
+      sjw               <= to_unsigned(DEFAULT_SJW, 16);
+      timestamps_enabled <= '0';
+
+      form_error        <= '0';
+      crc_error         <= '0';
+      stuff_error       <= '0';
+      overrun_error     <= '0';
+      ack_error         <= '0';
+
+      fifo_data         <= (others => '0');
+      fifo_write        <= '0';
+
+      rx_sync           <= (others => '1');
+      bit_timer         <= (others => '0');
+      resynced          <= '0';
+      last_sampled_bit  <= '1';
+
+      current_state     <= WAIT_FOR_IDLE;
+      field_bit_count   <= 0;
+      idle_bit_count    <= 0;
+      stuff_count       <= 0;
+      stuff_last_bit    <= '1';
+      crc_register      <= (others => '0');
+
+      frame_id          <= (others => '0');
+      frame_extended    <= '0';
+      frame_remote      <= '0';
+      frame_dlc         <= (others => '0');
+      frame_data        <= (others => (others => '0'));
+      frame_data_count  <= 0;
+      frame_flags       <= (others => '0');
+      frame_timestamp   <= (others => '0');
+
+      record_start      <= '0';
+      record_active     <= '0';
+      record_index      <= 0;
+      record_timestamp  <= (others => '0');
+      header_commit     <= '0';
+      header_force_full <= '0';
+
+    -- Synchronous part
+    elsif rising_edge(clk) then
+      fifo_write   <= '0';
+      record_start <= '0';
+      header_commit <= '0';
+      header_force_full <= '0';
+
+      rx_sync <= rx_sync(1 downto 0) & can_rx;
+      rx_bit  := rx_sync(1);
+
+      -- ======================================================================
+      -- Register writes
+      -- ======================================================================
+      if (reg_select = '1' and reg_write = '1') then
+        if (reg_address = CONTROL_REGISTER) then
+          enabled <= reg_data(CONTROL_ENABLE_BIT);
+          timestamps_enabled <= reg_data(CONTROL_TIMESTAMP_BIT);
+          -- Start over with a full timestamp
+          header_force_full <= '1';
+          if (reg_data(CONTROL_CLEAR_BIT) = '1') then
+            form_error    <= '0';
+            crc_error     <= '0';
+            stuff_error   <= '0';
+            overrun_error <= '0';
+            ack_error     <= '0';
+          end if;
+        elsif (reg_address = BIT_TIME_HIGH) then
+          bit_time_high <= reg_data;
+        -- 16-bit values are updated when the low byte is written
+        elsif (reg_address = BIT_TIME_LOW) then
+          bit_time <= unsigned(bit_time_high & reg_data);
+        elsif (reg_address = SAMPLE_POINT_HIGH) then
+          sample_point_high <= reg_data;
+        elsif (reg_address = SAMPLE_POINT_LOW) then
+          sample_point <= unsigned(sample_point_high & reg_data);
+        elsif (reg_address = SJW_REGISTER) then
+          sjw <= resize(unsigned(reg_data), 16);
+        end if;
+      end if;
+
+      -- ======================================================================
+      -- Bit timing
+      -- ======================================================================
+      sample_now := '0';
+      if (rx_sync(2) = '1' and rx_bit = '0' and
+          (current_state = IDLE or current_state = WAIT_FOR_IDLE)) then
+        -- Hard synchronization on the falling edge of the start of frame
+        bit_timer <= to_unsigned(1, 16);
+        resynced <= '1';
+        -- Time of a possible start of frame
+        frame_timestamp <= timestamp;
+      elsif (rx_sync(2) = '1' and rx_bit = '0' and last_sampled_bit = '1' and
+             resynced = '0' and bit_timer /= 0) then
+        -- Soft resynchronization, limited by the SJW
+        resynced <= '1';
+        if (bit_timer <= sample_point) then
+          -- The edge came late, lengthen the bit
+          if (bit_timer <= sjw) then
+            bit_timer <= (others => '0');
+          else
+            bit_timer <= bit_timer - sjw;
+          end if;
+        else
+          -- The edge came early, shorten the bit
+          if (bit_time - bit_timer <= sjw) then
+            bit_timer <= to_unsigned(1, 16);
+          else
+            bit_timer <= bit_timer + sjw;
+          end if;
+        end if;
+      elsif (bit_timer >= bit_time - 1) then
+        bit_timer <= (others => '0');
+        resynced <= '0';
+      else
+        bit_timer <= bit_timer + 1;
+        if (bit_timer = sample_point) then
+          sample_now := '1';
+          last_sampled_bit <= rx_bit;
+        end if;
+      end if;
+
+      -- ======================================================================
+      -- Frame decoder
+      -- ======================================================================
+      if (enabled = '0') then
+        current_state <= WAIT_FOR_IDLE;
+        idle_bit_count <= 0;
+      elsif (sample_now = '1') then
+        -- Bit destuffing from the start of frame up to the end of the CRC
+        process_bit := '1';
+        if ((current_state = ID_A or current_state = SRR_RTR or current_state = IDE or
+             current_state = ID_B or current_state = RTR or current_state = R1 or
+             current_state = R0 or current_state = DLC or current_state = DATA or
+             current_state = CRC) or
+            (current_state = CRC_DELIMITER and stuff_count = 5)) then
+          if (stuff_count = 5) then
+            process_bit := '0';
+            if (rx_bit = stuff_last_bit) then
+              -- Six equal bits in a row, most likely an error frame
+              frame_flags(FLAG_STUFF_ERROR) <= '1';
+              stuff_error <= '1';
+              record_start <= '1';
+              idle_bit_count <= 0;
+              current_state <= WAIT_FOR_IDLE;
+            end if;
+            stuff_count <= 1;
+          elsif (rx_bit = stuff_last_bit) then
+            stuff_count <= stuff_count + 1;
+          else
+            stuff_count <= 1;
+          end if;
+          stuff_last_bit <= rx_bit;
+
+          -- CRC over everything up to and including the CRC sequence, the
+          -- result is zero when the frame is correct
+          if (process_bit = '1') then
+            if ((rx_bit xor crc_register(14)) = '1') then
+              crc_register <= (crc_register(13 downto 0) & '0') xor CRC_POLYNOMIAL;
+            else
+              crc_register <= crc_register(13 downto 0) & '0';
+            end if;
+          end if;
+        end if;
+
+        if (process_bit = '1') then
+          case current_state is
+            -- Wait for 11 recessive bits before listening for a frame ----------
+            when WAIT_FOR_IDLE =>
+              if (rx_bit = '0') then
+                idle_bit_count <= 0;
+              elsif (idle_bit_count = BUS_IDLE_BITS - 1) then
+                current_state <= IDLE;
+              else
+                idle_bit_count <= idle_bit_count + 1;
+              end if;
+
+            -- Bus idle ----------------------------------------------------------
+            when IDLE =>
+              if (rx_bit = '0') then
+                -- Start of frame, the CRC of a single zero is zero
+                crc_register <= (others => '0');
+                stuff_count <= 1;
+                stuff_last_bit <= '0';
+                frame_id <= (others => '0');
+                frame_extended <= '0';
+                frame_remote <= '0';
+                frame_dlc <= (others => '0');
+                frame_data_count <= 0;
+                frame_flags <= (others => '0');
+                field_bit_count <= 0;
+                current_state <= ID_A;
+              end if;
+
+            -- Base identifier -------------------------------------------------
+            when ID_A =>
+              frame_id <= frame_id(27 downto 0) & rx_bit;
+              if (field_bit_count = 10) then
+                current_state <= SRR_RTR;
+              else
+                field_bit_count <= field_bit_count + 1;
+              end if;
+
+            -- RTR for standard frames, SRR for extended frames ----------------
+            when SRR_RTR =>
+              frame_remote <= rx_bit;
+              current_state <= IDE;
+
+            when IDE =>
+              frame_extended <= rx_bit;
+              field_bit_count <= 0;
+              if (rx_bit = '1') then
+                current_state <= ID_B;
+              else
+                current_state <= R0;
+              end if;
+
+            -- Identifier extension --------------------------------------------
+            when ID_B =>
+              frame_id <= frame_id(27 downto 0) & rx_bit;
+              if (field_bit_count = 17) then
+                current_state <= RTR;
+              else
+                field_bit_count <= field_bit_count + 1;
+              end if;
+
+            when RTR =>
+              frame_remote <= rx_bit;
+              current_state <= R1;
+
+            when R1 =>
+              current_state <= R0;
+
+            when R0 =>
+              field_bit_count <= 0;
+              current_state <= DLC;
+
+            -- Data length code ------------------------------------------------
+            when DLC =>
+              frame_dlc <= frame_dlc(2 downto 0) & rx_bit;
+              if (field_bit_count = 3) then
+                -- A DLC above 8 still means 8 data bytes, remote frames have none
+                if (frame_remote = '1') then
+                  data_length := 0;
+                elsif (frame_dlc(2) = '1') then
+                  data_length := 8;
+                else
+                  data_length := to_integer(unsigned(frame_dlc(2 downto 0) & rx_bit));
+                end if;
+                frame_data_count <= data_length;
+                field_bit_count <= 0;
+                if (data_length = 0) then
+                  current_state <= CRC;
+                else
+                  current_state <= DATA;
+                end if;
+              else
+                field_bit_count <= field_bit_count + 1;
+              end if;
+
+            -- Data bytes, MSB first -------------------------------------------
+            when DATA =>
+              frame_data(field_bit_count / 8) <= frame_data(field_bit_count / 8)(6 downto 0) & rx_bit;
+              if (field_bit_count = frame_data_count * 8 - 1) then
+                field_bit_count <= 0;
+                current_state <= CRC;
+              else
+                field_bit_count <= field_bit_count + 1;
+              end if;
+
+            -- CRC sequence ----------------------------------------------------
+            when CRC =>
+              if (field_bit_count = 14) then
+                current_state <= CRC_DELIMITER;
+              else
+                field_bit_count <= field_bit_count + 1;
+              end if;
+
+            when CRC_DELIMITER =>
+              if (crc_register /= "000000000000000") then
+                frame_flags(FLAG_CRC_ERROR) <= '1';
+                crc_error <= '1';
+              end if;
+              if (rx_bit = '0') then
+                frame_flags(FLAG_FORM_ERROR) <= '1';
+                form_error <= '1';
+              end if;
+              if (crc_register /= "000000000000000" or rx_bit = '0') then
+                -- The other nodes will send an error frame after the ACK
+                record_start <= '1';
+                idle_bit_count <= 0;
+                current_state <= WAIT_FOR_IDLE;
+              else
+                current_state <= ACK_SLOT;
+              end if;
+
+            -- Listen only, some other node has to acknowledge the frame -------
+            when ACK_SLOT =>
+              if (rx_bit = '1') then
+                frame_flags(FLAG_NO_ACK) <= '1';
+                ack_error <= '1';
+              end if;
+              current_state <= ACK_DELIMITER;
+
+            when ACK_DELIMITER =>
+              field_bit_count <= 0;
+              if (rx_bit = '0') then
+                frame_flags(FLAG_FORM_ERROR) <= '1';
+                form_error <= '1';
+                record_start <= '1';
+                idle_bit_count <= 0;
+                current_state <= WAIT_FOR_IDLE;
+              else
+                current_state <= END_OF_FRAME;
+              end if;
+
+            -- Seven recessive bits, a dominant last bit is an overload frame --
+            when END_OF_FRAME =>
+              if (rx_bit = '0' and field_bit_count /= 6) then
+                frame_flags(FLAG_FORM_ERROR) <= '1';
+                form_error <= '1';
+                record_start <= '1';
+                idle_bit_count <= 0;
+                current_state <= WAIT_FOR_IDLE;
+              elsif (field_bit_count = 6) then
+                record_start <= '1';
+                -- ACK delimiter and end of frame count towards bus idle, only
+                -- the intermission is left before the next start of frame
+                idle_bit_count <= 8;
+                current_state <= WAIT_FOR_IDLE;
+              else
+                field_bit_count <= field_bit_count + 1;
+              end if;
+
+            when others =>
+              idle_bit_count <= 0;
+              current_state <= WAIT_FOR_IDLE;
+          end case; -- current_state
+        end if; -- (process_bit = '1')
+      end if; -- (enabled = '0')
+
+      -- ======================================================================
+      -- Record writer, a record is written in a few clock cycles which is much
+      -- less than the three bits before the next frame can start
+      -- ======================================================================
+      if (record_start = '1') then
+        -- Drop the whole record rather than a part of it when there is no room
+        if (fifo_almost_full = '1') then
+          overrun_error <= '1';
+        else
+          record_active <= '1';
+          record_index <= 0;
+          record_timestamp <= frame_timestamp;
+        end if;
+      elsif (record_active = '1') then
+        if (record_index < header_skip) then
+          field_index := 0;
+        else
+          field_index := record_index - header_skip;
+        end if;
+        case field_index is
+          when 0 =>
+            record_byte := frame_extended & frame_remote & "00" & frame_flags;
+          when 1 =>
+            record_byte := std_logic_vector(to_unsigned(frame_data_count, 4)) & frame_dlc;
+          when 2 =>
+            if (frame_extended = '1') then
+              record_byte := "000" & frame_id(28 downto 24);
+            else
+              record_byte := (others => '0');
+            end if;
+          when 3 =>
+            if (frame_extended = '1') then
+              record_byte := frame_id(23 downto 16);
+            else
+              record_byte := (others => '0');
+            end if;
+          when 4 =>
+            if (frame_extended = '1') then
+              record_byte := frame_id(15 downto 8);
+            else
+              record_byte := "00000" & frame_id(10 downto 8);
+            end if;
+          when 5 =>
+            record_byte := frame_id(7 downto 0);
+          when others =>
+            record_byte := frame_data(field_index - 6);
+        end case;
+        if (record_index < header_skip) then
+          fifo_data <= header_data(47 - record_index*8 downto 40 - record_index*8);
+        else
+          fifo_data <= record_byte;
+        end if;
+        fifo_write <= '1';
+        if (record_index = header_skip + 5 + frame_data_count) then
+          record_active <= '0';
+          header_commit <= timestamps_enabled;
+        else
+          record_index <= record_index + 1;
+        end if;
+      end if;
+    end if; -- if (reset_n = '0')
+  end process;
+
+  -- Status register
+  status(0) <= form_error;
+  status(1) <= crc_error;
+  status(2) <= stuff_error;
+  status(3) <= overrun_error;
+  status(4) <= enabled;
+  status(5) <= '0' when (current_state = IDLE or current_state = WAIT_FOR_IDLE) else '1';
+  status(6) <= ack_error;
+  status(7) <= '0';
+
+end architecture behav;
\ No newline at end of file
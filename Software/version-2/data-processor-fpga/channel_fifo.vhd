@@ -0,0 +1,144 @@
+-- *******************************************************************************
+-- * @file    channel_fifo.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-09-18
+-- * @brief   Show-ahead FIFO that buffers decoded channel data until the UI
+-- *          processor reads it over the SPI link
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Entity
+entity channel_fifo is
+  generic(
+    DATA_WIDTH    : integer := 8;
+    ADDRESS_WIDTH : integer := 10;    -- 2^ADDRESS_WIDTH words, 1024 fits in one M9K
+    ALMOST_FULL_MARGIN : integer := 16);  -- Free words left when almost_full is set
+  port(
+    clk       : in  std_logic;
+    reset_n   : in  std_logic;
+    clear     : in  std_logic;
+
+    -- Write interface
+    write_data    : in  std_logic_vector(DATA_WIDTH-1 downto 0);
+    write_enable  : in  std_logic;
+    full          : out std_logic;
+    almost_full   : out std_logic;
+
+    -- Read interface, read_data always shows the oldest word
+    read_data     : out std_logic_vector(DATA_WIDTH-1 downto 0);
+    read_enable   : in  std_logic;
+    empty         : out std_logic;
+
+    -- Number of words in the FIFO, saturated at 255
+    fill_level    : out std_logic_vector(7 downto 0));
+end channel_fifo;
+
+architecture behav of channel_fifo is
+  constant DEPTH : integer := 2**ADDRESS_WIDTH;
+
+  type memory_type is array(0 to DEPTH-1) of std_logic_vector(DATA_WIDTH-1 downto 0);
+  signal memory : memory_type;
+
+  signal write_pointer  : unsigned(ADDRESS_WIDTH-1 downto 0);
+  signal read_pointer   : unsigned(ADDRESS_WIDTH-1 downto 0);
+  signal fetch_address  : unsigned(ADDRESS_WIDTH-1 downto 0);
+  signal count          : unsigned(ADDRESS_WIDTH downto 0);
+  signal head_is_stale  : std_logic;
+  signal do_write       : std_logic;
+  signal do_read        : std_logic;
+  signal full_internal  : std_logic;
+  signal empty_internal : std_logic;
+begin
+  do_write <= write_enable and not full_internal;
+  do_read  <= read_enable and not empty_internal;
+
+  -- The word that will be at the head of the FIFO in the next cycle
+  fetch_address <= read_pointer + 1 when do_read = '1' else read_pointer;
+
+  -- ==========================================================================
+  -- Memory with registered read so that it can be inferred as block RAM
+  -- ==========================================================================
+  memory_process : process(clk)
+  begin
+    if rising_edge(clk) then
+      if (do_write = '1') then
+        memory(to_integer(write_pointer)) <= write_data;
+      end if;
+      read_data <= memory(to_integer(fetch_address));
+    end if;
+  end process memory_process;
+
+  -- ==========================================================================
+  -- Pointers and count
+  -- ==========================================================================
+  process(clk, reset_n)
+  begin
+    -- Asynchronous reset
+    if (reset_n = '0') then
+      write_pointer <= (others => '0');
+      read_pointer  <= (others => '0');
+      count         <= (others => '0');
+      head_is_stale <= '0';
+
+    -- Synchronous part
+    elsif rising_edge(clk) then
+      if (clear = '1') then
+        write_pointer <= (others => '0');
+        read_pointer  <= (others => '0');
+        count         <= (others => '0');
+        head_is_stale <= '0';
+      else
+        if (do_write = '1') then
+          write_pointer <= write_pointer + 1;
+        end if;
+        if (do_read = '1') then
+          read_pointer <= read_pointer + 1;
+        end if;
+
+        if (do_write = '1' and do_read = '0') then
+          count <= count + 1;
+        elsif (do_write = '0' and do_read = '1') then
+          count <= count - 1;
+        end if;
+
+        -- Writing to the word that is being fetched returns the old data, so
+        -- the head has to be fetched once more before it can be used
+        if (do_write = '1' and write_pointer = fetch_address) then
+          head_is_stale <= '1';
+        else
+          head_is_stale <= '0';
+        end if;
+      end if;
+    end if; -- if (reset_n = '0')
+  end process;
+
+  full_internal   <= '1' when count = DEPTH else '0';
+  empty_internal  <= '1' when (count = 0 or head_is_stale = '1') else '0';
+
+  full  <= full_internal;
+  almost_full <= '1' when count >= DEPTH - ALMOST_FULL_MARGIN else '0';
+  empty <= empty_internal;
+
+  fill_level <= (others => '1') when count > 255 else
+                std_logic_vector(resize(count, 8));
+
+end architecture behav;
\ No newline at end of file
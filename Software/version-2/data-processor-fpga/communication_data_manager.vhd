@@ -52,6 +52,42 @@ entity communication_data_manager is
     
     -- Channel termination
     channel_termination : out std_logic_vector(5 downto 0);
+
+    -- Channel register interface, shared by the decoders on all channels
+    channel_reg_select  : out std_logic_vector(5 downto 0);
+    channel_reg_address : out std_logic_vector(7 downto 0);
+    channel_reg_data    : out std_logic_vector(7 downto 0);
+    channel_reg_write   : out std_logic;
+
+    -- Channel status
+    channel_status_1 : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_status_2 : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_status_3 : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_status_4 : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_status_5 : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_status_6 : in std_logic_vector(7 downto 0) := (others => '0');
+
+    -- Channel FIFO interface
+    channel_fifo_level_1 : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_level_2 : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_level_3 : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_level_4 : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_level_5 : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_level_6 : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_data_1  : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_data_2  : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_data_3  : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_data_4  : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_data_5  : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_data_6  : in std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_read    : out std_logic_vector(5 downto 0);
+
+    -- ADC stream interface, shares address and data with the channel registers
+    adc_reg_select  : out std_logic;
+    adc_status      : in  std_logic_vector(7 downto 0) := (others => '0');
+    adc_fifo_level  : in  std_logic_vector(7 downto 0) := (others => '0');
+    adc_fifo_data   : in  std_logic_vector(7 downto 0) := (others => '0');
+    adc_fifo_read   : out std_logic;
     
     -- SPI Slave Interface
     rx_data_ready         : in  std_logic;
@@ -68,7 +104,9 @@ end communication_data_manager;
 
 
 architecture behav of communication_data_manager is
-  type state_type is (COMMAND, DATA, WAIT_FOR_TX_READY, RETURN_BYTE);
+  type state_type is (COMMAND, DATA, WAIT_FOR_TX_READY, RETURN_BYTE,
+                      REGISTER_ADDRESS, REGISTER_DATA,
+                      STREAM_COUNT, WAIT_FOR_STREAM_TX_READY, STREAM_BYTE);
   signal current_state : state_type;
 
   subtype command_type is std_logic_vector(7 downto 0);
@@ -78,6 +116,14 @@ architecture behav of communication_data_manager is
   constant CHANNEL_OUTPUT_COMMAND           : command_type := x"11";
   constant CHANNEL_ID_COMMAND               : command_type := x"12";
   constant CAN_CHANNEL_TERMINATION_COMMAND  : command_type := x"30";
+  constant CHANNEL_REGISTER_WRITE_COMMAND   : command_type := x"40";
+  constant CHANNEL_STATUS_COMMAND           : command_type := x"41";
+  constant CHANNEL_FIFO_LEVEL_COMMAND       : command_type := x"42";
+  constant CHANNEL_FIFO_READ_COMMAND        : command_type := x"43";
+  constant ADC_REGISTER_WRITE_COMMAND       : command_type := x"50";
+  constant ADC_STATUS_COMMAND               : command_type := x"51";
+  constant ADC_FIFO_LEVEL_COMMAND           : command_type := x"52";
+  constant ADC_FIFO_READ_COMMAND            : command_type := x"53";
   constant NO_COMMAND                       : command_type := x"FF";
 
   constant gpio_channel_id    : std_logic_vector(4 downto 0) := "00001";
@@ -91,10 +137,57 @@ architecture behav of communication_data_manager is
   signal channel_pin_c_output_internal  : std_logic_vector(5 downto 0)  := "000000";
   signal channel_termination_internal   : std_logic_vector(5 downto 0)  := "000000";
   
+  signal channel_reg_select_internal   : std_logic_vector(5 downto 0)  := "000000";
+  signal channel_reg_address_internal  : unsigned(7 downto 0)          := (others => '0');
+  signal channel_reg_address_increment : std_logic := '0';
+  signal stream_channel                : std_logic_vector(5 downto 0)  := "000000";
+  signal stream_remaining              : unsigned(7 downto 0)          := (others => '0');
+  signal stream_from_adc               : std_logic := '0';
+  signal stream_fifo_data              : std_logic_vector(7 downto 0);
+  signal adc_reg_select_internal       : std_logic := '0';
+
   signal load_tx_data_ready_synced    : std_logic := '0';
   signal rx_data_ready_last           : std_logic := '0';
   signal transfer_in_progress_synced  : std_logic := '0';
 
+  -- Pick the value belonging to the lowest channel set in a one-hot selection
+  function select_channel_value(
+    selection : std_logic_vector(5 downto 0);
+    value_1   : std_logic_vector(7 downto 0);
+    value_2   : std_logic_vector(7 downto 0);
+    value_3   : std_logic_vector(7 downto 0);
+    value_4   : std_logic_vector(7 downto 0);
+    value_5   : std_logic_vector(7 downto 0);
+    value_6   : std_logic_vector(7 downto 0)) return std_logic_vector is
+  begin
+    if (selection(0) = '1') then
+      return value_1;
+    elsif (selection(1) = '1') then
+      return value_2;
+    elsif (selection(2) = '1') then
+      return value_3;
+    elsif (selection(3) = '1') then
+      return value_4;
+    elsif (selection(4) = '1') then
+      return value_5;
+    elsif (selection(5) = '1') then
+      return value_6;
+    else
+      return x"00";
+    end if;
+  end function select_channel_value;
+
+  -- Only keep the lowest channel set in a selection
+  function lowest_channel(selection : std_logic_vector(5 downto 0)) return std_logic_vector is
+  begin
+    for i in 0 to 5 loop
+      if (selection(i) = '1') then
+        return std_logic_vector(to_unsigned(2**i, 6));
+      end if;
+    end loop;
+    return "000000";
+  end function lowest_channel;
+
 begin
   process(clk, reset_n)
   begin
@@ -115,6 +208,18 @@ begin
       channel_pin_c_output_internal <= "000000";
       channel_termination_internal  <= "000000";
 
+      channel_reg_select_internal   <= "000000";
+      channel_reg_address_internal  <= (others => '0');
+      channel_reg_address_increment <= '0';
+      channel_reg_data              <= (others => '0');
+      channel_reg_write             <= '0';
+      channel_fifo_read             <= "000000";
+      stream_channel                <= "000000";
+      stream_remaining              <= (others => '0');
+      stream_from_adc               <= '0';
+      adc_reg_select_internal       <= '0';
+      adc_fifo_read                 <= '0';
+
       load_tx_data_ready_synced <= '0';
       rx_data_ready_last <= '0';
       transfer_in_progress_synced <= '0';
@@ -126,6 +231,17 @@ begin
       -- Clear the debug leds
       debug_leds <= (others => '0');
 
+      -- Single cycle strobes
+      channel_reg_write <= '0';
+      channel_fifo_read <= "000000";
+      adc_fifo_read <= '0';
+
+      -- Move to the next register after each register write
+      channel_reg_address_increment <= '0';
+      if (channel_reg_address_increment = '1') then
+        channel_reg_address_internal <= channel_reg_address_internal + 1;
+      end if;
+
       -- TODO: Handle these
       status <= "00000001";
       channel_direction_a <= "000000";
@@ -157,6 +273,11 @@ begin
         current_command <= NO_COMMAND;
         tx_data <= (others => '0');
         load_tx_data <= '0';
+        channel_reg_select_internal <= "000000";
+        stream_channel <= "000000";
+        stream_remaining <= (others => '0');
+        stream_from_adc <= '0';
+        adc_reg_select_internal <= '0';
       else
         -- COMMAND State ******************************************************
         if (current_state = COMMAND) then
@@ -280,6 +401,59 @@ begin
                 current_state <= COMMAND;
               end if;
               
+            -- =========== Channel Register Write Command =====================
+            -- Data: channel mask, start address, data bytes...
+            elsif (current_command = CHANNEL_REGISTER_WRITE_COMMAND) then
+              channel_reg_select_internal <= rx_data(5 downto 0);
+              current_state <= REGISTER_ADDRESS;
+
+            -- =========== Channel Status Command =============================
+            elsif (current_command = CHANNEL_STATUS_COMMAND) then
+              tx_data <= select_channel_value(rx_data(5 downto 0),
+                                              channel_status_1, channel_status_2,
+                                              channel_status_3, channel_status_4,
+                                              channel_status_5, channel_status_6);
+              current_state <= WAIT_FOR_TX_READY;
+
+            -- =========== Channel FIFO Level Command =========================
+            elsif (current_command = CHANNEL_FIFO_LEVEL_COMMAND) then
+              tx_data <= select_channel_value(rx_data(5 downto 0),
+                                              channel_fifo_level_1, channel_fifo_level_2,
+                                              channel_fifo_level_3, channel_fifo_level_4,
+                                              channel_fifo_level_5, channel_fifo_level_6);
+              current_state <= WAIT_FOR_TX_READY;
+
+            -- =========== Channel FIFO Read Command ==========================
+            -- Data: channel, byte count. The FIFO bytes are returned starting
+            -- two bytes after the count, read the level first so that the
+            -- count never is larger than what is available
+            elsif (current_command = CHANNEL_FIFO_READ_COMMAND) then
+              stream_channel <= lowest_channel(rx_data(5 downto 0));
+              current_state <= STREAM_COUNT;
+
+            -- =========== ADC Register Write Command =========================
+            -- Data: start address, data bytes...
+            elsif (current_command = ADC_REGISTER_WRITE_COMMAND) then
+              adc_reg_select_internal <= '1';
+              channel_reg_address_internal <= unsigned(rx_data);
+              current_state <= REGISTER_DATA;
+
+            -- =========== ADC Status Command =================================
+            elsif (current_command = ADC_STATUS_COMMAND) then
+              tx_data <= adc_status;
+              current_state <= WAIT_FOR_TX_READY;
+
+            -- =========== ADC FIFO Level Command =============================
+            elsif (current_command = ADC_FIFO_LEVEL_COMMAND) then
+              tx_data <= adc_fifo_level;
+              current_state <= WAIT_FOR_TX_READY;
+
+            -- =========== ADC FIFO Read Command ==============================
+            -- Data: 0x00, byte count. Same timing as the channel FIFO read
+            elsif (current_command = ADC_FIFO_READ_COMMAND) then
+              stream_from_adc <= '1';
+              current_state <= STREAM_COUNT;
+
             -- =========== Unknown command ====================================
             else
               current_state <= COMMAND;
@@ -310,6 +484,64 @@ begin
           -- Stay in this state, a reset or end of transaction will reset the state machine
           current_state <= RETURN_BYTE;
 
+        -- REGISTER_ADDRESS state *********************************************
+        elsif (current_state = REGISTER_ADDRESS) then
+          if (rx_data_ready_last = '0' and rx_data_ready = '1') then
+            channel_reg_address_internal <= unsigned(rx_data);
+            current_state <= REGISTER_DATA;
+          end if;
+
+        -- REGISTER_DATA state ************************************************
+        elsif (current_state = REGISTER_DATA) then
+          -- Write each byte to the current address until the transfer ends
+          if (rx_data_ready_last = '0' and rx_data_ready = '1') then
+            channel_reg_data <= rx_data;
+            channel_reg_write <= '1';
+            channel_reg_address_increment <= '1';
+          end if;
+
+        -- STREAM_COUNT state *************************************************
+        elsif (current_state = STREAM_COUNT) then
+          if (rx_data_ready_last = '0' and rx_data_ready = '1') then
+            stream_remaining <= unsigned(rx_data);
+            if (unsigned(rx_data) /= 0) then
+              tx_data <= stream_fifo_data;
+            else
+              tx_data <= (others => '0');
+            end if;
+            current_state <= WAIT_FOR_STREAM_TX_READY;
+          end if;
+
+        -- WAIT_FOR_STREAM_TX_READY state *************************************
+        elsif (current_state = WAIT_FOR_STREAM_TX_READY) then
+          if (load_tx_data_ready_synced = '1') then
+            load_tx_data <= '1';
+            -- Remove the byte from the FIFO when it is loaded into the SPI slave
+            if (stream_remaining /= 0) then
+              if (stream_from_adc = '1') then
+                adc_fifo_read <= '1';
+              else
+                channel_fifo_read <= stream_channel;
+              end if;
+              stream_remaining <= stream_remaining - 1;
+            end if;
+            current_state <= STREAM_BYTE;
+          end if;
+
+        -- STREAM_BYTE state **************************************************
+        elsif (current_state = STREAM_BYTE) then
+          load_tx_data <= '0';
+          -- Prepare the next FIFO byte for every byte received, zeros are sent
+          -- when all requested bytes have been sent
+          if (rx_data_ready_last = '0' and rx_data_ready = '1') then
+            if (stream_remaining /= 0) then
+              tx_data <= stream_fifo_data;
+            else
+              tx_data <= (others => '0');
+            end if;
+            current_state <= WAIT_FOR_STREAM_TX_READY;
+          end if;
+
         -- Just in case *******************************************************
         else
           current_state <= COMMAND;
@@ -327,6 +559,17 @@ begin
   channel_id_update     <= channel_id_update_internal;
   -- Channel Termination
   channel_termination   <= channel_termination_internal;
+  -- Channel register interface
+  channel_reg_select    <= channel_reg_select_internal;
+  channel_reg_address   <= std_logic_vector(channel_reg_address_internal);
+  adc_reg_select        <= adc_reg_select_internal;
+
+  -- Head of the FIFO that is being streamed
+  stream_fifo_data <= adc_fifo_data when stream_from_adc = '1' else
+                      select_channel_value(stream_channel,
+                                           channel_fifo_data_1, channel_fifo_data_2,
+                                           channel_fifo_data_3, channel_fifo_data_4,
+                                           channel_fifo_data_5, channel_fifo_data_6);
   
   -- -- Channel E pin multiplexing
   -- channel_pin_e(0) <= 
@@ -0,0 +1,321 @@
+-- *******************************************************************************
+-- * @file    logic_analyzer.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-10-09
+-- * @brief   Logic analyzer for up to 8 channel pins. The pins are sampled at
+-- *          a configurable rate and only the transitions are stored, which
+-- *          makes a run-length encoding where the run length is the
+-- *          timestamp delta. Every record is a timestamp header, see
+-- *          timestamp_encoder.vhd, followed by the new pin values:
+-- *            header: time of the sample where the pins changed
+-- *            1 byte: pin values, pins not in the pin mask read as 0
+-- *          The first record of a capture has a full timestamp and holds
+-- *          the pin values when the trigger hit. Transitions are buffered in
+-- *          block RAM so that short bursts faster than the channel FIFO can
+-- *          take them are not lost.
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Entity
+entity logic_analyzer is
+  generic(
+    BUFFER_ADDRESS_WIDTH  : integer := 8);  -- 2^BUFFER_ADDRESS_WIDTH transitions, 256 fits in two M9K
+  port(
+    clk       : in  std_logic;
+    reset_n   : in  std_logic;
+
+    -- Channel register interface
+    reg_select  : in  std_logic;
+    reg_address : in  std_logic_vector(7 downto 0);
+    reg_data    : in  std_logic_vector(7 downto 0);
+    reg_write   : in  std_logic;
+    status      : out std_logic_vector(7 downto 0);
+
+    -- Channel FIFO interface
+    fifo_data         : out std_logic_vector(7 downto 0);
+    fifo_write        : out std_logic;
+    fifo_almost_full  : in  std_logic;
+
+    -- Shared timestamp counter
+    timestamp   : in  std_logic_vector(39 downto 0);
+
+    -- External hardware interface
+    probes      : in  std_logic_vector(7 downto 0));
+end logic_analyzer;
+
+architecture behav of logic_analyzer is
+  -- Register map
+  constant CONTROL_REGISTER       : std_logic_vector(7 downto 0) := x"00";
+  constant PIN_MASK_REGISTER      : std_logic_vector(7 downto 0) := x"01";
+  constant SAMPLE_DIVISOR_HIGH    : std_logic_vector(7 downto 0) := x"02";
+  constant SAMPLE_DIVISOR_LOW     : std_logic_vector(7 downto 0) := x"03";
+  constant TRIGGER_MODE_REGISTER  : std_logic_vector(7 downto 0) := x"04";
+  constant TRIGGER_MASK_REGISTER  : std_logic_vector(7 downto 0) := x"05";
+  constant TRIGGER_VALUE_REGISTER : std_logic_vector(7 downto 0) := x"06";
+
+  -- Control register bits
+  constant CONTROL_ENABLE_BIT     : integer := 0;  -- Arm the trigger, capture until cleared
+  constant CONTROL_CLEAR_BIT      : integer := 7;  -- Write 1 to clear the status flags
+
+  -- Trigger modes
+  constant TRIGGER_NONE     : std_logic_vector(1 downto 0) := "00";  -- Start right away
+  constant TRIGGER_PATTERN  : std_logic_vector(1 downto 0) := "01";  -- Masked pins equal the value
+  constant TRIGGER_EDGE     : std_logic_vector(1 downto 0) := "10";  -- A masked pin changes to its value
+
+  -- Buffer entries are the first record flag, the timestamp and the pins
+  constant BUFFER_WIDTH     : integer := 49;
+  constant FIRST_RECORD_BIT : integer := 48;
+
+  type state_type is (IDLE, ARMED, CAPTURING);
+  signal current_state        : state_type;
+
+  -- Configuration
+  signal pin_mask             : std_logic_vector(7 downto 0);
+  signal sample_divisor       : unsigned(15 downto 0);
+  signal sample_divisor_high  : std_logic_vector(7 downto 0);
+  signal trigger_mode         : std_logic_vector(1 downto 0);
+  signal trigger_mask         : std_logic_vector(7 downto 0);
+  signal trigger_value        : std_logic_vector(7 downto 0);
+
+  -- Status flags, sticky until cleared
+  signal overrun_error        : std_logic;
+
+  -- Sampler
+  signal probes_meta          : std_logic_vector(7 downto 0);
+  signal probes_sync          : std_logic_vector(7 downto 0);
+  signal sample_timer         : unsigned(15 downto 0);
+  signal last_sample          : std_logic_vector(7 downto 0);
+
+  -- Transition buffer
+  signal buffer_write_data    : std_logic_vector(BUFFER_WIDTH-1 downto 0);
+  signal buffer_write         : std_logic;
+  signal buffer_full          : std_logic;
+  signal buffer_read_data     : std_logic_vector(BUFFER_WIDTH-1 downto 0);
+  signal buffer_read          : std_logic;
+  signal buffer_empty         : std_logic;
+
+  -- Record writer
+  signal record_active        : std_logic;
+  signal record_index         : integer range 0 to 6;
+  signal record_byte          : std_logic_vector(7 downto 0);
+  signal record_timestamp     : std_logic_vector(39 downto 0);
+  signal header_data          : std_logic_vector(47 downto 0);
+  signal header_length        : integer range 1 to 6;
+  signal header_commit        : std_logic;
+  signal header_force_full    : std_logic;
+begin
+  transition_buffer : entity work.channel_fifo
+  generic map (
+    DATA_WIDTH    => BUFFER_WIDTH,
+    ADDRESS_WIDTH => BUFFER_ADDRESS_WIDTH)
+  port map (
+    clk           => clk,
+    reset_n       => reset_n,
+    clear         => '0',
+    write_data    => buffer_write_data,
+    write_enable  => buffer_write,
+    full          => buffer_full,
+    almost_full   => open,
+    read_data     => buffer_read_data,
+    read_enable   => buffer_read,
+    empty         => buffer_empty,
+    fill_level    => open);
+
+  timestamp_encoder_instance : entity work.timestamp_encoder
+  port map (
+    clk           => clk,
+    reset_n       => reset_n,
+    timestamp     => record_timestamp,
+    force_full    => header_force_full,
+    commit        => header_commit,
+    header_data   => header_data,
+    header_length => header_length);
+
+  -- The first record of a capture gets a full timestamp. It is forced while
+  -- the record waits at the head of the buffer so that the encoder has it
+  -- when the record is latched.
+  header_force_full <= '1' when (record_active = '0' and buffer_empty = '0' and
+                                 buffer_read_data(FIRST_RECORD_BIT) = '1') else '0';
+
+  process(clk, reset_n)
+    variable sample       : std_logic_vector(7 downto 0);
+    variable sample_tick  : boolean;
+    variable triggered    : boolean;
+    variable store        : boolean;
+  begin
+    -- Asynchronous reset
+    if (reset_n = '0') then
+      current_state       <= IDLE;
+      pin_mask            <= (others => '1');
+      sample_divisor      <= to_unsigned(1, 16);
+      sample_divisor_high <= (others => '0');
+      trigger_mode        <= TRIGGER_NONE;
+      trigger_mask        <= (others => '0');
+      trigger_value       <= (others => '0');
+
+      overrun_error       <= '0';
+
+      fifo_data           <= (others => '0');
+      fifo_write          <= '0';
+
+      probes_meta         <= (others => '0');
+      probes_sync         <= (others => '0');
+      sample_timer        <= (others => '0');
+      last_sample         <= (others => '0');
+
+      buffer_write_data   <= (others => '0');
+      buffer_write        <= '0';
+      buffer_read         <= '0';
+
+      record_active       <= '0';
+      record_index        <= 0;
+      record_byte         <= (others => '0');
+      record_timestamp    <= (others => '0');
+      header_commit       <= '0';
+
+    -- Synchronous part
+    elsif rising_edge(clk) then
+      fifo_write <= '0';
+      header_commit <= '0';
+      buffer_write <= '0';
+      buffer_read <= '0';
+
+      probes_meta <= probes;
+      probes_sync <= probes_meta;
+      sample := probes_sync and pin_mask;
+
+      -- ======================================================================
+      -- Sampler, a divisor of 0 or 1 samples every clk cycle
+      -- ======================================================================
+      sample_tick := false;
+      if (current_state /= IDLE) then
+        if (sample_timer <= 1) then
+          sample_timer <= sample_divisor;
+          sample_tick := true;
+        else
+          sample_timer <= sample_timer - 1;
+        end if;
+      end if;
+
+      triggered := false;
+      store := false;
+      if (sample_tick) then
+        last_sample <= sample;
+        if (current_state = ARMED) then
+          if (trigger_mode = TRIGGER_PATTERN) then
+            triggered := ((sample xor trigger_value) and trigger_mask) = x"00";
+          elsif (trigger_mode = TRIGGER_EDGE) then
+            triggered := ((sample xor last_sample) and not (sample xor trigger_value) and trigger_mask) /= x"00";
+          else
+            triggered := true;
+          end if;
+          if (triggered) then
+            current_state <= CAPTURING;
+            store := true;
+          end if;
+        elsif (current_state = CAPTURING) then
+          store := (sample /= last_sample);
+        end if;
+      end if;
+
+      -- Transitions are dropped and flagged if the buffer is full
+      if (store) then
+        if (buffer_full = '1') then
+          overrun_error <= '1';
+        else
+          if (triggered) then
+            buffer_write_data <= '1' & timestamp & sample;
+          else
+            buffer_write_data <= '0' & timestamp & sample;
+          end if;
+          buffer_write <= '1';
+        end if;
+      end if;
+
+      -- ======================================================================
+      -- Register writes
+      -- ======================================================================
+      if (reg_select = '1' and reg_write = '1') then
+        if (reg_address = CONTROL_REGISTER) then
+          if (reg_data(CONTROL_ENABLE_BIT) = '0') then
+            current_state <= IDLE;
+          elsif (current_state = IDLE) then
+            -- The edge trigger compares against the pins when armed
+            last_sample <= sample;
+            sample_timer <= (others => '0');
+            current_state <= ARMED;
+          end if;
+          if (reg_data(CONTROL_CLEAR_BIT) = '1') then
+            overrun_error <= '0';
+          end if;
+        elsif (reg_address = PIN_MASK_REGISTER) then
+          pin_mask <= reg_data;
+        elsif (reg_address = SAMPLE_DIVISOR_HIGH) then
+          sample_divisor_high <= reg_data;
+        -- The divisor is updated when the low byte is written
+        elsif (reg_address = SAMPLE_DIVISOR_LOW) then
+          sample_divisor <= unsigned(sample_divisor_high & reg_data);
+        elsif (reg_address = TRIGGER_MODE_REGISTER) then
+          trigger_mode <= reg_data(1 downto 0);
+        elsif (reg_address = TRIGGER_MASK_REGISTER) then
+          trigger_mask <= reg_data;
+        elsif (reg_address = TRIGGER_VALUE_REGISTER) then
+          trigger_value <= reg_data;
+        end if;
+      end if;
+
+      -- ======================================================================
+      -- Move records from the buffer to the FIFO, header first
+      -- ======================================================================
+      if (record_active = '0') then
+        if (buffer_empty = '0' and fifo_almost_full = '0') then
+          record_timestamp <= buffer_read_data(47 downto 8);
+          record_byte <= buffer_read_data(7 downto 0);
+          buffer_read <= '1';
+          record_index <= 0;
+          record_active <= '1';
+        end if;
+      else
+        if (record_index = header_length) then
+          fifo_data <= record_byte;
+          header_commit <= '1';
+          record_active <= '0';
+        else
+          fifo_data <= header_data(47 - record_index*8 downto 40 - record_index*8);
+          record_index <= record_index + 1;
+        end if;
+        fifo_write <= '1';
+      end if;
+    end if; -- if (reset_n = '0')
+  end process;
+
+  -- Status register
+  status(0) <= '1' when current_state = ARMED else '0';
+  status(1) <= '1' when current_state = CAPTURING else '0';
+  status(2) <= '0';
+  status(3) <= overrun_error;
+  status(4) <= '0' when current_state = IDLE else '1';
+  status(5) <= record_active or not buffer_empty;
+  status(6) <= '0';
+  status(7) <= '0';
+
+end architecture behav;
\ No newline at end of file
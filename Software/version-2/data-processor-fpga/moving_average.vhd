@@ -92,13 +92,13 @@ begin
       sample_fifo_7 <= (others => to_integer(unsigned(sample_7)));
       
       sum_0 <= NUM_OF_SAMPLES * to_integer(unsigned(sample_0));
-      sum_1 <= NUM_OF_SAMPLES * to_integer(unsigned(sample_0));
-      sum_2 <= NUM_OF_SAMPLES * to_integer(unsigned(sample_0));
-      sum_3 <= NUM_OF_SAMPLES * to_integer(unsigned(sample_0));
-      sum_4 <= NUM_OF_SAMPLES * to_integer(unsigned(sample_0));
-      sum_5 <= NUM_OF_SAMPLES * to_integer(unsigned(sample_0));
-      sum_6 <= NUM_OF_SAMPLES * to_integer(unsigned(sample_0));
-      sum_7 <= NUM_OF_SAMPLES * to_integer(unsigned(sample_0));
+      sum_1 <= NUM_OF_SAMPLES * to_integer(unsigned(sample_1));
+      sum_2 <= NUM_OF_SAMPLES * to_integer(unsigned(sample_2));
+      sum_3 <= NUM_OF_SAMPLES * to_integer(unsigned(sample_3));
+      sum_4 <= NUM_OF_SAMPLES * to_integer(unsigned(sample_4));
+      sum_5 <= NUM_OF_SAMPLES * to_integer(unsigned(sample_5));
+      sum_6 <= NUM_OF_SAMPLES * to_integer(unsigned(sample_6));
+      sum_7 <= NUM_OF_SAMPLES * to_integer(unsigned(sample_7));
     
     -- Synchronous part
     elsif rising_edge(clk) then
@@ -108,13 +108,13 @@ begin
       if (last_new_data = '0' and new_data = '1') then
         -- Add the new sample to the fifo
         sample_fifo_0 <= to_integer(unsigned(sample_0)) & sample_fifo_0(1 to NUM_OF_SAMPLES - 1);
-        sample_fifo_1 <= to_integer(unsigned(sample_0)) & sample_fifo_1(1 to NUM_OF_SAMPLES - 1);
-        sample_fifo_2 <= to_integer(unsigned(sample_0)) & sample_fifo_2(1 to NUM_OF_SAMPLES - 1);
-        sample_fifo_3 <= to_integer(unsigned(sample_0)) & sample_fifo_3(1 to NUM_OF_SAMPLES - 1);
-        sample_fifo_4 <= to_integer(unsigned(sample_0)) & sample_fifo_4(1 to NUM_OF_SAMPLES - 1);
-        sample_fifo_5 <= to_integer(unsigned(sample_0)) & sample_fifo_5(1 to NUM_OF_SAMPLES - 1);
-        sample_fifo_6 <= to_integer(unsigned(sample_0)) & sample_fifo_6(1 to NUM_OF_SAMPLES - 1);
-        sample_fifo_7 <= to_integer(unsigned(sample_0)) & sample_fifo_7(1 to NUM_OF_SAMPLES - 1);
+        sample_fifo_1 <= to_integer(unsigned(sample_1)) & sample_fifo_1(1 to NUM_OF_SAMPLES - 1);
+        sample_fifo_2 <= to_integer(unsigned(sample_2)) & sample_fifo_2(1 to NUM_OF_SAMPLES - 1);
+        sample_fifo_3 <= to_integer(unsigned(sample_3)) & sample_fifo_3(1 to NUM_OF_SAMPLES - 1);
+        sample_fifo_4 <= to_integer(unsigned(sample_4)) & sample_fifo_4(1 to NUM_OF_SAMPLES - 1);
+        sample_fifo_5 <= to_integer(unsigned(sample_5)) & sample_fifo_5(1 to NUM_OF_SAMPLES - 1);
+        sample_fifo_6 <= to_integer(unsigned(sample_6)) & sample_fifo_6(1 to NUM_OF_SAMPLES - 1);
+        sample_fifo_7 <= to_integer(unsigned(sample_7)) & sample_fifo_7(1 to NUM_OF_SAMPLES - 1);
         
         -- Add the new sample to the sum and subtract the oldest sample
         sum_0 <= sum_0 + to_integer(unsigned(sample_0)) - sample_fifo_0(NUM_OF_SAMPLES);
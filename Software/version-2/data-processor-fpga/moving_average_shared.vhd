@@ -0,0 +1,182 @@
+-- *******************************************************************************
+-- * @file    moving_average_shared.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-10-09
+-- * @brief   Moving average for any number of channels with a power of two
+-- *          window. The samples for all channels are stored in one block RAM
+-- *          and a running sum is kept per channel. When new_data goes high
+-- *          the channels are updated one after the other with the same adder,
+-- *          three clk cycles per channel, by adding the newest sample and
+-- *          subtracting the oldest.
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Entity
+entity moving_average_shared is
+  generic(
+    NUM_OF_CHANNELS   : integer := 8;
+    WINDOW_SIZE_LOG2  : integer := 3;     -- 2^WINDOW_SIZE_LOG2 samples
+    SAMPLE_BIT_SIZE   : integer := 10);
+  port(
+    clk       : in  std_logic;
+    reset_n   : in  std_logic;
+
+    -- Channel 0 in the lowest bits
+    samples   : in  std_logic_vector(NUM_OF_CHANNELS*SAMPLE_BIT_SIZE-1 downto 0);
+    averages  : out std_logic_vector(NUM_OF_CHANNELS*SAMPLE_BIT_SIZE-1 downto 0);
+
+    new_data      : in  std_logic;
+    -- Pulsed when all averages have been updated
+    valid_values  : out std_logic);
+end moving_average_shared;
+
+architecture behav of moving_average_shared is
+  constant WINDOW_SIZE  : integer := 2**WINDOW_SIZE_LOG2;
+  constant SUM_BIT_SIZE : integer := SAMPLE_BIT_SIZE + WINDOW_SIZE_LOG2;
+
+  -- Number of bits needed for the channel part of the RAM address
+  function bits_needed(value : integer) return integer is
+    variable bits : integer := 0;
+  begin
+    while (2**bits < value) loop
+      bits := bits + 1;
+    end loop;
+    return bits;
+  end function bits_needed;
+
+  constant CHANNEL_BITS   : integer := bits_needed(NUM_OF_CHANNELS);
+  constant ADDRESS_WIDTH  : integer := CHANNEL_BITS + WINDOW_SIZE_LOG2;
+
+  -- Sample memory, the oldest sample of each channel is where the next
+  -- sample will be written
+  type memory_type is array(0 to 2**ADDRESS_WIDTH-1) of std_logic_vector(SAMPLE_BIT_SIZE-1 downto 0);
+  signal memory         : memory_type;
+  signal memory_address : unsigned(ADDRESS_WIDTH-1 downto 0);
+  signal memory_write   : std_logic;
+  signal memory_data    : std_logic_vector(SAMPLE_BIT_SIZE-1 downto 0);
+  signal oldest_sample  : std_logic_vector(SAMPLE_BIT_SIZE-1 downto 0);
+
+  type sum_array is array(0 to NUM_OF_CHANNELS-1) of unsigned(SUM_BIT_SIZE-1 downto 0);
+  signal sums : sum_array;
+
+  type state_type is (CLEAR_MEMORY, IDLE, READ_OLDEST, UPDATE_SUM, WRITE_AND_READ);
+  signal current_state  : state_type;
+  signal last_new_data  : std_logic;
+  signal sample_latch   : std_logic_vector(NUM_OF_CHANNELS*SAMPLE_BIT_SIZE-1 downto 0);
+  signal channel        : integer range 0 to NUM_OF_CHANNELS-1;
+  signal window_index   : unsigned(WINDOW_SIZE_LOG2-1 downto 0);
+  signal clear_address  : unsigned(ADDRESS_WIDTH-1 downto 0);
+begin
+  -- ==========================================================================
+  -- Memory with registered read so that it can be inferred as block RAM
+  -- ==========================================================================
+  memory_process : process(clk)
+  begin
+    if rising_edge(clk) then
+      if (memory_write = '1') then
+        memory(to_integer(memory_address)) <= memory_data;
+      end if;
+      oldest_sample <= memory(to_integer(memory_address));
+    end if;
+  end process memory_process;
+
+  process(clk, reset_n)
+    variable new_sample : unsigned(SAMPLE_BIT_SIZE-1 downto 0);
+    variable new_sum    : unsigned(SUM_BIT_SIZE-1 downto 0);
+  begin
+    -- Asynchronous reset
+    if (reset_n = '0') then
+      memory_address  <= (others => '0');
+      memory_write    <= '0';
+      memory_data     <= (others => '0');
+      sums            <= (others => (others => '0'));
+      averages        <= (others => '0');
+      valid_values    <= '0';
+
+      current_state   <= CLEAR_MEMORY;
+      last_new_data   <= '0';
+      sample_latch    <= (others => '0');
+      channel         <= 0;
+      window_index    <= (others => '0');
+      clear_address   <= (others => '0');
+
+    -- Synchronous part
+    elsif rising_edge(clk) then
+      last_new_data <= new_data;
+      memory_write <= '0';
+      valid_values <= '0';
+
+      case current_state is
+        -- The block RAM can not be reset, so clear it once after reset ------
+        when CLEAR_MEMORY =>
+          memory_address <= clear_address;
+          memory_data <= (others => '0');
+          memory_write <= '1';
+          clear_address <= clear_address + 1;
+          if (clear_address = 2**ADDRESS_WIDTH-1) then
+            current_state <= IDLE;
+          end if;
+
+        -- Wait for the rising edge of new_data --------------------------------
+        when IDLE =>
+          if (last_new_data = '0' and new_data = '1') then
+            sample_latch <= samples;
+            channel <= 0;
+            memory_address <= to_unsigned(0, CHANNEL_BITS) & window_index;
+            current_state <= READ_OLDEST;
+          end if;
+
+        -- One cycle for the block RAM to return the oldest sample -------------
+        when READ_OLDEST =>
+          current_state <= UPDATE_SUM;
+
+        -- Replace the oldest sample with the new one --------------------------
+        when UPDATE_SUM =>
+          new_sample := unsigned(sample_latch((channel+1)*SAMPLE_BIT_SIZE-1 downto channel*SAMPLE_BIT_SIZE));
+          new_sum := sums(channel) + new_sample - unsigned(oldest_sample);
+          sums(channel) <= new_sum;
+          averages((channel+1)*SAMPLE_BIT_SIZE-1 downto channel*SAMPLE_BIT_SIZE) <=
+            std_logic_vector(new_sum(SUM_BIT_SIZE-1 downto WINDOW_SIZE_LOG2));
+          memory_data <= std_logic_vector(new_sample);
+          memory_write <= '1';
+
+          if (channel = NUM_OF_CHANNELS-1) then
+            window_index <= window_index + 1;
+            valid_values <= '1';
+            current_state <= IDLE;
+          else
+            channel <= channel + 1;
+            current_state <= WRITE_AND_READ;
+          end if;
+
+        -- Write the new sample and read the oldest sample of the next channel
+        when WRITE_AND_READ =>
+          memory_address <= to_unsigned(channel, CHANNEL_BITS) & window_index;
+          current_state <= READ_OLDEST;
+
+        when others =>
+          current_state <= IDLE;
+      end case; -- current_state
+    end if; -- if (reset_n = '0')
+  end process;
+
+end architecture behav;
\ No newline at end of file
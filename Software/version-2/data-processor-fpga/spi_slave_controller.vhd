@@ -1,9 +1,12 @@
 -- *******************************************************************************
 -- * @file    spi_slave_controller.vhd
 -- * @author  Hampus Sandberg
--- * @version 0.1
+-- * @version 0.2
 -- * @date    2015-09-11
--- * @brief
+-- * @brief   SPI slave where the shift registers are clocked by SCLK. Bytes
+-- *          cross to and from the clk domain through two small async FIFOs
+-- *          with gray coded pointers so that SCLK is not limited by how
+-- *          fast clk can sample it.
 -- *******************************************************************************
 --  Copyright (c) 2015 Hampus Sandberg.
 --
@@ -33,7 +36,7 @@ entity spi_slave_controller is
   port(
     clk           : in std_logic;
     reset_n       : in std_logic;
-    
+
     -- Module interface
     transfer_in_progress  : out std_logic;
     load_tx_data_ready    : out std_logic;  -- High indicates new data can be loaded into the register
@@ -41,7 +44,7 @@ entity spi_slave_controller is
     tx_data               : in  std_logic_vector(7 downto 0);
     rx_data_ready         : out std_logic;  -- Indicates when internal data is ready
     rx_data               : out std_logic_vector(7 downto 0);
-    
+
     -- External hardware interface
     spi_mosi  : in  std_logic;
     spi_cs_n  : in  std_logic;
@@ -51,113 +54,266 @@ end spi_slave_controller;
 
 
 architecture behav of spi_slave_controller is
-  signal bit_count                    : natural range 0 to 7 := 0;
-  signal tx_buffer                    : std_logic_vector(7 downto 0);
-  signal tx_next                      : std_logic_vector(7 downto 0);
-  signal rx_buffer                    : std_logic_vector(7 downto 0);
-  signal load_tx_data_ready_internal  : std_logic;
-  signal rx_data_ready_internal       : std_logic;
+  -- Four bytes in each direction. The pointers have one extra bit so that a
+  -- full FIFO can be told apart from an empty one.
+  constant FIFO_ADDRESS_WIDTH : natural := 2;
+  constant FIFO_DEPTH         : natural := 2**FIFO_ADDRESS_WIDTH;
+  subtype pointer_type is unsigned(FIFO_ADDRESS_WIDTH downto 0);
+  type fifo_memory_type is array(0 to FIFO_DEPTH-1) of std_logic_vector(7 downto 0);
+
+  function to_gray(value : pointer_type) return pointer_type is
+  begin
+    return value xor ('0' & value(value'high downto 1));
+  end function to_gray;
+
+  function from_gray(value : pointer_type) return pointer_type is
+    variable result : pointer_type;
+  begin
+    result(result'high) := value(value'high);
+    for i in value'high-1 downto 0 loop
+      result(i) := result(i+1) xor value(i);
+    end loop;
+    return result;
+  end function from_gray;
+
+  function address(value : pointer_type) return natural is
+  begin
+    return to_integer(value(FIFO_ADDRESS_WIDTH-1 downto 0));
+  end function address;
+
+  -- SPI_SCLK domain
+  signal sclk_reset           : std_logic;
+  signal sclk_fifo_reset      : std_logic;
+  signal bit_count            : natural range 0 to 7 := 0;
+  signal rx_shift             : std_logic_vector(6 downto 0);
+  signal rx_write_pointer     : pointer_type;
+  signal rx_write_gray        : pointer_type;
+  signal rx_read_gray_meta    : pointer_type;
+  signal rx_read_gray_sync    : pointer_type;
+  signal rx_fifo_full         : std_logic;
+  signal tx_byte              : std_logic_vector(7 downto 0);
+  signal tx_read_pointer      : pointer_type;
+  signal tx_read_gray         : pointer_type;
+  signal tx_write_gray_meta   : pointer_type;
+  signal tx_write_gray_sync   : pointer_type;
+
+  -- CLK domain
+  signal cs_n_meta            : std_logic;
+  signal cs_n_sync            : std_logic;
+  signal fifo_reset           : std_logic;
+  signal fifo_reset_done      : std_logic;
+  signal rx_read_pointer      : pointer_type;
+  signal rx_read_gray         : pointer_type;
+  signal rx_write_gray_meta   : pointer_type;
+  signal rx_write_gray_sync   : pointer_type;
+  signal rx_data_ready_internal : std_logic;
+  signal tx_write_pointer     : pointer_type;
+  signal tx_write_gray        : pointer_type;
+  signal tx_read_gray_meta    : pointer_type;
+  signal tx_read_gray_sync    : pointer_type;
+  signal tx_fifo_full         : std_logic;
+  signal tx_write             : std_logic;
+  signal load_tx_data_last    : std_logic;
+
+  -- Written in one domain and read in the other, a slot is only read after
+  -- its pointer has been through the synchronizers
+  signal rx_memory            : fifo_memory_type;
+  signal tx_memory            : fifo_memory_type;
 begin
   -- ==========================================================================
-  -- CLK Domain
+  -- SPI_SCLK Domain
   -- ==========================================================================
-  load_rx_process : process(reset_n, clk, spi_cs_n)
+  -- The bit counter and shift registers are held in reset between transfers
+  sclk_reset <= '1' when (reset_n = '0' or spi_cs_n = '1') else '0';
+
+  -- The FIFO pointers are only reset when the clk domain asks for it while
+  -- SCLK is idle, so that both sides of the FIFOs are emptied together
+  sclk_fifo_reset <= '1' when (reset_n = '0' or fifo_reset = '1') else '0';
+
+  rx_fifo_full <= '1' when (rx_write_pointer - from_gray(rx_read_gray_sync) = FIFO_DEPTH) else '0';
+
+  sclk_rising_process : process(sclk_reset, spi_sclk)
   begin
-    -- Async clear
-    if (reset_n = '0' or spi_cs_n = '1') then
-      rx_data <= (others => '0');
-    elsif (reset_n = '0') then
-      rx_data_ready <= '0';
-      
-    -- Rising edge of CLK
-    elsif (rising_edge(clk)) then
-      -- If there is data ready internally we should send it to the rx_data register and notify about it
-      if (rx_data_ready_internal = '1') then
-        rx_data <= rx_buffer;
-        rx_data_ready <= '1';
+    if (sclk_reset = '1') then
+      bit_count <= 0;
+      rx_shift <= (others => '0');
+      tx_byte <= (others => '0');
+
+    elsif rising_edge(spi_sclk) then
+      rx_shift <= rx_shift(5 downto 0) & spi_mosi;
+
+      if (bit_count = 7) then
+        bit_count <= 0;
+
+        -- Load the next byte to send so that it's ready at the next falling
+        -- edge. Zeros are sent if nothing has been loaded in time.
+        if (tx_read_pointer /= from_gray(tx_write_gray_sync)) then
+          tx_byte <= tx_memory(address(tx_read_pointer));
+        else
+          tx_byte <= (others => '0');
+        end if;
       else
-        rx_data <= (others => '0');
-        rx_data_ready <= '0';
+        bit_count <= bit_count + 1;
       end if;
 
-    end if;
-
-  end process load_rx_process;
+    end if; -- if (sclk_reset = '1')
+  end process sclk_rising_process;
 
-  -- ==========================================================================
-  -- SPI_SLCK Domain
-  -- ==========================================================================
-  process(reset_n, spi_sclk, spi_cs_n, load_tx_data, tx_buffer, tx_data, load_tx_data_ready_internal, bit_count, rx_data_ready_internal, rx_buffer)
+  sclk_pointer_process : process(sclk_fifo_reset, spi_sclk)
+    variable rx_next : pointer_type;
+    variable tx_next : pointer_type;
   begin
+    if (sclk_fifo_reset = '1') then
+      rx_write_pointer <= (others => '0');
+      rx_write_gray <= (others => '0');
+      rx_read_gray_meta <= (others => '0');
+      rx_read_gray_sync <= (others => '0');
+      tx_read_pointer <= (others => '0');
+      tx_read_gray <= (others => '0');
+      tx_write_gray_meta <= (others => '0');
+      tx_write_gray_sync <= (others => '0');
 
-    -- TODO: Move tx_next up to the CLK domain instead?
-    -- Next TX
-    if (reset_n = '0' or spi_cs_n = '1') then -- Reset or no transfer
-      tx_next <= (others => '0');
-    -- Clear it when we are not ready to load
-    elsif (load_tx_data_ready_internal = '0') then
-      tx_next <= (others => '0');
-    -- Load it with the value provided by the user when requested to do so
-    elsif (rising_edge(load_tx_data)) then
-      tx_next <= tx_data;
-    end if;
+    elsif rising_edge(spi_sclk) then
+      rx_read_gray_meta <= rx_read_gray;
+      rx_read_gray_sync <= rx_read_gray_meta;
+      tx_write_gray_meta <= tx_write_gray;
+      tx_write_gray_sync <= tx_write_gray_meta;
 
-    -- TX Buffer
-    if (reset_n = '0' or spi_cs_n = '1') then -- Reset or no transfer
-      tx_buffer <= (others => '0');
-    -- Load the buffer at the last rising edge of the spi clock so that it's ready at the next falling edge
-    elsif (bit_count = 7 and rising_edge(spi_sclk)) then
-      tx_buffer <= tx_next;
-    end if;
+      if (sclk_reset = '0' and bit_count = 7) then
+        -- The byte is written to rx_memory below, it is dropped if the clk
+        -- domain has fallen four bytes behind
+        if (rx_fifo_full = '0') then
+          rx_next := rx_write_pointer + 1;
+          rx_write_pointer <= rx_next;
+          rx_write_gray <= to_gray(rx_next);
+        end if;
 
-    -- TX Load Data Ready Internal Register
-    if (bit_count = 0) then
-      load_tx_data_ready_internal <= '0';
-    else
-      load_tx_data_ready_internal <= '1';
+        -- The byte was loaded into tx_byte above
+        if (tx_read_pointer /= from_gray(tx_write_gray_sync)) then
+          tx_next := tx_read_pointer + 1;
+          tx_read_pointer <= tx_next;
+          tx_read_gray <= to_gray(tx_next);
+        end if;
+      end if;
+
+    end if; -- if (sclk_fifo_reset = '1')
+  end process sclk_pointer_process;
+
+  rx_memory_process : process(spi_sclk)
+  begin
+    if rising_edge(spi_sclk) then
+      if (sclk_reset = '0' and bit_count = 7 and rx_fifo_full = '0') then
+        rx_memory(address(rx_write_pointer)) <= rx_shift & spi_mosi;
+      end if;
     end if;
+  end process rx_memory_process;
 
-    -- SPI MISO register
-    if (reset_n = '0' or spi_cs_n = '1') then -- Reset or no transfer
+  -- SPI MISO register, set to the correct bit of the tx byte at the falling edge
+  sclk_falling_process : process(sclk_reset, spi_sclk)
+  begin
+    if (sclk_reset = '1') then
       spi_miso <= '0';
-    -- Set the register to the correct bit in the tx buffer at the falling edge of the spi clock
-    elsif (spi_cs_n = '0' and falling_edge(spi_sclk)) then
-      spi_miso <= tx_buffer(7 - bit_count);
-    end if;
+    elsif falling_edge(spi_sclk) then
+      spi_miso <= tx_byte(7 - bit_count);
+    end if; -- if (sclk_reset = '1')
+  end process sclk_falling_process;
 
-    -- RX buffer register
-    if (reset_n = '0') then
-      rx_buffer <= (others => '0');
-    -- Shift in a new bit when spi transfer is active and there is a rising edge on spi_sclk
-    elsif (spi_cs_n = '0' and rising_edge(spi_sclk)) then
-      rx_buffer <= rx_buffer(6 downto 0) & spi_mosi;
-    end if;
+  -- ==========================================================================
+  -- CLK Domain
+  -- ==========================================================================
+  tx_fifo_full <= '1' when (tx_write_pointer - from_gray(tx_read_gray_sync) = FIFO_DEPTH) else '0';
+  tx_write <= '1' when (load_tx_data = '1' and load_tx_data_last = '0' and tx_fifo_full = '0') else '0';
 
-    -- RX Data Ready Internal Register
+  clk_process : process(reset_n, clk)
+  begin
     if (reset_n = '0') then
+      cs_n_meta <= '1';
+      cs_n_sync <= '1';
+      fifo_reset <= '0';
+      fifo_reset_done <= '0';
+      rx_read_pointer <= (others => '0');
+      rx_read_gray <= (others => '0');
+      rx_write_gray_meta <= (others => '0');
+      rx_write_gray_sync <= (others => '0');
       rx_data_ready_internal <= '0';
-    -- RX Data is not ready any longer at the first rising edge of spi_sclk
-    elsif (bit_count = 0 and rising_edge(spi_sclk)) then
-      rx_data_ready_internal <= '0';
-    -- RX Data is ready when spi transfer is active and we have reached bit 7 and there is a rising edge on the spi_sclk
-    elsif (spi_cs_n = '0' and bit_count = 7 and rising_edge(spi_sclk)) then
-      rx_data_ready_internal <= '1';
-    end if;
+      rx_data <= (others => '0');
+      tx_write_pointer <= (others => '0');
+      tx_write_gray <= (others => '0');
+      tx_read_gray_meta <= (others => '0');
+      tx_read_gray_sync <= (others => '0');
+      load_tx_data_last <= '0';
+
+    elsif rising_edge(clk) then
+      cs_n_meta <= spi_cs_n;
+      cs_n_sync <= cs_n_meta;
+      rx_write_gray_meta <= rx_write_gray;
+      rx_write_gray_sync <= rx_write_gray_meta;
+      tx_read_gray_meta <= tx_read_gray;
+      tx_read_gray_sync <= tx_read_gray_meta;
+      load_tx_data_last <= load_tx_data;
+      fifo_reset <= '0';
+
+      -- No transfer, empty both FIFOs once CS has been high for two cycles.
+      -- fifo_reset holds the SCLK side in reset for one cycle, the pointers
+      -- from it are not sampled here meanwhile since they can change several
+      -- bits at once. CS has to be high for at least four clk cycles between
+      -- transfers so that this is done before SCLK starts again, both sides
+      -- are left as they were if the pulse is too short to be seen.
+      if (cs_n_sync = '1') then
+        rx_data_ready_internal <= '0';
+        if (cs_n_meta = '1' and fifo_reset_done = '0') then
+          fifo_reset <= '1';
+          fifo_reset_done <= '1';
+          rx_read_pointer <= (others => '0');
+          rx_read_gray <= (others => '0');
+          rx_data <= (others => '0');
+          tx_write_pointer <= (others => '0');
+          tx_write_gray <= (others => '0');
+        end if;
+        if ((cs_n_meta = '1' and fifo_reset_done = '0') or fifo_reset = '1') then
+          rx_write_gray_meta <= (others => '0');
+          rx_write_gray_sync <= (others => '0');
+          tx_read_gray_meta <= (others => '0');
+          tx_read_gray_sync <= (others => '0');
+        end if;
 
-    -- Bit count register
-    if (reset_n = '0' or spi_cs_n = '1') then
-      bit_count <= 0;
-    elsif (rising_edge(spi_sclk)) then
-      if (bit_count = 7) then
-        bit_count <= 0;
       else
-        bit_count <= bit_count + 1;
+        fifo_reset_done <= '0';
+
+        -- Hand over one byte at a time with rx_data_ready low for at least
+        -- one cycle in between so that every byte gives a rising edge. No
+        -- new byte is taken once CS is seen going high.
+        if (rx_data_ready_internal = '1') then
+          rx_data_ready_internal <= '0';
+        elsif (cs_n_meta = '0' and rx_read_pointer /= from_gray(rx_write_gray_sync)) then
+          rx_data <= rx_memory(address(rx_read_pointer));
+          rx_data_ready_internal <= '1';
+          rx_read_pointer <= rx_read_pointer + 1;
+          rx_read_gray <= to_gray(rx_read_pointer + 1);
+        end if;
+
+        -- The byte is written to tx_memory below and goes out in the byte
+        -- after the one that is in progress when it reaches the SCLK side
+        if (tx_write = '1') then
+          tx_write_pointer <= tx_write_pointer + 1;
+          tx_write_gray <= to_gray(tx_write_pointer + 1);
+        end if;
       end if;
-    end if;
 
-  end process;
+    end if; -- if (reset_n = '0')
+  end process clk_process;
+
+  tx_memory_process : process(clk)
+  begin
+    if rising_edge(clk) then
+      if (tx_write = '1') then
+        tx_memory(address(tx_write_pointer)) <= tx_data;
+      end if;
+    end if;
+  end process tx_memory_process;
 
   transfer_in_progress <= not spi_cs_n;
-  load_tx_data_ready <= load_tx_data_ready_internal;
+  load_tx_data_ready <= not cs_n_sync and not tx_fifo_full;
+  rx_data_ready <= rx_data_ready_internal;
 
 end architecture behav;
\ No newline at end of file
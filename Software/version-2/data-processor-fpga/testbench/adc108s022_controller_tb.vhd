@@ -0,0 +1,316 @@
+-- *******************************************************************************
+-- * @file    adc108s022_controller_tb.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-10-02
+-- * @brief   Self checking testbench for adc108s022_controller together with
+-- *          spi_master_controller and a model of the ADC108S022. Checks
+-- *          that every channel value ends up in the right place, both in
+-- *          round-robin and streaming mode, and measures the number of clk
+-- *          cycles per conversion and the streamed sample rate.
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+entity adc108s022_controller_tb is
+end adc108s022_controller_tb;
+
+architecture behav of adc108s022_controller_tb is
+  constant CLK_PERIOD     : time := 10 ns;  -- 100 MHz
+  constant CLK_PRESCALER  : integer := 32;  -- Same as in the top level
+  constant STREAM_TIME    : time := 500 us;
+
+  -- Regression limits, 16 SCLK cycles per conversion plus the overhead
+  constant MAX_CLK_PER_CONVERSION : integer := 16*CLK_PRESCALER + 32;
+
+  type value_array is array(0 to 7) of std_logic_vector(9 downto 0);
+
+  signal clk          : std_logic := '0';
+  signal reset_n      : std_logic := '0';
+  signal done         : boolean := false;
+  signal enable       : std_logic := '0';
+
+  signal values       : value_array;
+  signal valid_values : std_logic;
+
+  -- Stream register interface
+  signal reg_select   : std_logic := '0';
+  signal reg_address  : std_logic_vector(7 downto 0) := (others => '0');
+  signal reg_data     : std_logic_vector(7 downto 0) := (others => '0');
+  signal reg_write    : std_logic := '0';
+  signal status       : std_logic_vector(7 downto 0);
+
+  -- Stream FIFO
+  signal fifo_write_data  : std_logic_vector(7 downto 0);
+  signal fifo_write       : std_logic;
+  signal fifo_almost_full : std_logic;
+  signal fifo_read_data   : std_logic_vector(7 downto 0);
+  signal fifo_read        : std_logic := '0';
+  signal fifo_empty       : std_logic;
+
+  -- Between the controller and the SPI master
+  signal valid_data     : std_logic;
+  signal data_received  : std_logic_vector(15 downto 0);
+  signal busy_transfer  : std_logic;
+  signal data_to_send   : std_logic_vector(15 downto 0);
+  signal start_transfer : std_logic;
+
+  -- ADC pins
+  signal adc_cs_n     : std_logic;
+  signal adc_sclk     : std_logic;
+  signal adc_din      : std_logic;
+  signal adc_dout     : std_logic := '0';
+
+  -- Time between two conversions, measured by the ADC model
+  signal clk_per_conversion   : integer := 0;
+begin
+  adc_controller_instance : entity work.adc108s022_controller
+  port map (
+    clk               => clk,
+    reset_n           => reset_n,
+    enable            => enable,
+    ch0_value         => values(0),
+    ch1_value         => values(1),
+    ch2_value         => values(2),
+    ch3_value         => values(3),
+    ch4_value         => values(4),
+    ch5_value         => values(5),
+    ch6_value         => values(6),
+    ch7_value         => values(7),
+    valid_values      => valid_values,
+    reg_select        => reg_select,
+    reg_address       => reg_address,
+    reg_data          => reg_data,
+    reg_write         => reg_write,
+    status            => status,
+    fifo_data         => fifo_write_data,
+    fifo_write        => fifo_write,
+    fifo_almost_full  => fifo_almost_full,
+    valid_data        => valid_data,
+    data_received     => data_received,
+    busy_transfer     => busy_transfer,
+    data_to_send      => data_to_send,
+    start_transfer    => start_transfer);
+
+  spi_master_instance : entity work.spi_master_controller
+  generic map (
+    DATA_WIDTH    => 16,
+    CLK_PRESCALER => CLK_PRESCALER)
+  port map (
+    clk             => clk,
+    reset_n         => reset_n,
+    data_to_send    => data_to_send,
+    start_transfer  => start_transfer,
+    valid_data      => valid_data,
+    data_received   => data_received,
+    busy_transfer   => busy_transfer,
+    spi_data_in     => adc_dout,
+    spi_cs_n        => adc_cs_n,
+    spi_sclk        => adc_sclk,
+    spi_data_out    => adc_din);
+
+  channel_fifo_instance : entity work.channel_fifo
+  port map (
+    clk           => clk,
+    reset_n       => reset_n,
+    clear         => '0',
+    write_data    => fifo_write_data,
+    write_enable  => fifo_write,
+    full          => open,
+    almost_full   => fifo_almost_full,
+    read_data     => fifo_read_data,
+    read_enable   => fifo_read,
+    empty         => fifo_empty,
+    fill_level    => open);
+
+  clock_control : process
+  begin
+    if (done) then
+      wait;
+    end if;
+    clk <= '0';
+    wait for CLK_PERIOD/2;
+    clk <= '1';
+    wait for CLK_PERIOD/2;
+  end process clock_control;
+
+  -- ==========================================================================
+  -- ADC108S022 model. DOUT changes on the falling edge of SCLK and DIN is
+  -- sampled on the rising edge. Each frame returns the conversion of the
+  -- channel that was addressed in the frame before. The value is the
+  -- channel number in the upper three bits and a counter in the rest so
+  -- that a value in the wrong channel is easy to spot.
+  -- ==========================================================================
+  adc_model : process
+    variable address      : std_logic_vector(2 downto 0);
+    variable converting   : integer range 0 to 7 := 0;
+    variable frame        : std_logic_vector(15 downto 0);
+    variable counter      : unsigned(6 downto 0) := (others => '0');
+    variable last_start   : time := 0 ns;
+  begin
+    wait until adc_cs_n = '0';
+    if (last_start /= 0 ns) then
+      clk_per_conversion <= (now - last_start) / CLK_PERIOD;
+    end if;
+    last_start := now;
+
+    frame := "0000" & std_logic_vector(to_unsigned(converting, 3)) &
+             std_logic_vector(counter) & "00";
+    counter := counter + 1;
+    for i in 15 downto 0 loop
+      -- The first falling edge comes together with CS
+      if (adc_sclk /= '0') then
+        wait until falling_edge(adc_sclk);
+      end if;
+      adc_dout <= frame(i);
+      wait until rising_edge(adc_sclk);
+      if (i <= 13 and i >= 11) then
+        address(i - 11) := adc_din;
+      end if;
+    end loop;
+    wait until adc_cs_n = '1';
+    converting := to_integer(unsigned(address));
+  end process adc_model;
+
+  test_control : process
+    variable errors         : integer := 0;
+    variable high_byte      : std_logic_vector(7 downto 0);
+    variable low_byte       : std_logic_vector(7 downto 0);
+    variable channel        : integer;
+    variable samples        : integer;
+    variable other_samples  : integer;
+    variable start_time     : time;
+
+    procedure write_register(address : in integer; data : in std_logic_vector(7 downto 0)) is
+    begin
+      wait until rising_edge(clk);
+      reg_select  <= '1';
+      reg_address <= std_logic_vector(to_unsigned(address, 8));
+      reg_data    <= data;
+      reg_write   <= '1';
+      wait until rising_edge(clk);
+      reg_select  <= '0';
+      reg_write   <= '0';
+    end procedure write_register;
+
+    procedure pop_byte(data : out std_logic_vector(7 downto 0)) is
+    begin
+      while (fifo_empty = '1') loop
+        wait until rising_edge(clk);
+      end loop;
+      data := fifo_read_data;
+      fifo_read <= '1';
+      wait until rising_edge(clk);
+      fifo_read <= '0';
+      wait until rising_edge(clk);
+    end procedure pop_byte;
+  begin
+    reset_n <= '0';
+    wait for 100 ns;
+    reset_n <= '1';
+    wait for 100 ns;
+    enable <= '1';
+
+    -- ========================================================================
+    -- Round-robin, all channels should have their own value after two rounds
+    -- ========================================================================
+    for round in 0 to 2 loop
+      wait until valid_values = '1';
+    end loop;
+    wait until rising_edge(clk);
+    for i in 0 to 7 loop
+      if (to_integer(unsigned(values(i)(9 downto 7))) /= i) then
+        report "Channel " & integer'image(i) & " has the value of channel " &
+               integer'image(to_integer(unsigned(values(i)(9 downto 7)))) severity error;
+        errors := errors + 1;
+      end if;
+    end loop;
+
+    report "PERF adc108s022_controller_tb clk_per_conversion = " &
+           integer'image(clk_per_conversion) & " clk" severity note;
+    report "PERF adc108s022_controller_tb conversion_rate = " &
+           integer'image(1 sec / (clk_per_conversion * CLK_PERIOD)) & " samples/s" severity note;
+    if (clk_per_conversion > MAX_CLK_PER_CONVERSION) then
+      report "Conversion takes " & integer'image(clk_per_conversion) & " clk, limit is " &
+             integer'image(MAX_CLK_PER_CONVERSION) severity error;
+      errors := errors + 1;
+    end if;
+
+    -- ========================================================================
+    -- Stream channel 2 and 5, every record has to match its channel
+    -- ========================================================================
+    write_register(16#01#, "00100100");
+    write_register(16#02#, x"00");
+    write_register(16#00#, x"81");
+    -- Skip the conversions that were started before the mask was applied
+    for i in 0 to 3 loop
+      pop_byte(high_byte);
+      pop_byte(low_byte);
+    end loop;
+
+    samples := 0;
+    other_samples := 0;
+    start_time := now;
+    while (now - start_time < STREAM_TIME) loop
+      pop_byte(high_byte);
+      pop_byte(low_byte);
+      channel := to_integer(unsigned(high_byte(6 downto 4)));
+      if (channel /= 2 and channel /= 5) then
+        other_samples := other_samples + 1;
+      elsif (to_integer(unsigned(high_byte(1 downto 0) & low_byte(7 downto 7))) /= channel) then
+        report "Streamed sample for channel " & integer'image(channel) &
+               " has the value of channel " &
+               integer'image(to_integer(unsigned(high_byte(1 downto 0) & low_byte(7 downto 7)))) severity error;
+        errors := errors + 1;
+      else
+        samples := samples + 1;
+      end if;
+    end loop;
+
+    if (other_samples /= 0) then
+      report integer'image(other_samples) & " samples from channels that are not selected" severity error;
+      errors := errors + 1;
+    end if;
+    if (status(3) = '1') then
+      report "Stream overrun" severity error;
+      errors := errors + 1;
+    end if;
+
+    -- Two channels share the conversions
+    report "PERF adc108s022_controller_tb stream_rate_per_channel = " &
+           integer'image((samples * (1 sec / STREAM_TIME)) / 2) & " samples/s" severity note;
+    if (samples * MAX_CLK_PER_CONVERSION * CLK_PERIOD < STREAM_TIME - 2*MAX_CLK_PER_CONVERSION*CLK_PERIOD) then
+      report "Only " & integer'image(samples) & " samples streamed" severity error;
+      errors := errors + 1;
+    end if;
+
+    write_register(16#00#, x"80");
+
+    -- ========================================================================
+    if (errors = 0) then
+      report "adc108s022_controller_tb: all tests passed" severity note;
+    else
+      report "adc108s022_controller_tb: " & integer'image(errors) & " errors" severity failure;
+    end if;
+    done <= true;
+    wait;
+  end process test_control;
+
+end architecture behav;
\ No newline at end of file
@@ -0,0 +1,369 @@
+-- *******************************************************************************
+-- * @file    can_receiver_tb.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-09-25
+-- * @brief   Self checking testbench for can_receiver. Sends standard,
+-- *          extended and remote frames with a slightly wrong bit rate to
+-- *          exercise the resynchronization, then a frame with a bad CRC and
+-- *          an error frame, and checks the records in the channel FIFO.
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+entity can_receiver_tb is
+end can_receiver_tb;
+
+architecture behav of can_receiver_tb is
+  constant CLK_PERIOD   : time := 10 ns;  -- 100 MHz
+
+  type byte_array is array(natural range <>) of std_logic_vector(7 downto 0);
+
+  signal clk          : std_logic := '0';
+  signal reset_n      : std_logic := '0';
+  signal done         : boolean := false;
+
+  signal reg_select   : std_logic := '0';
+  signal reg_address  : std_logic_vector(7 downto 0) := (others => '0');
+  signal reg_data     : std_logic_vector(7 downto 0) := (others => '0');
+  signal reg_write    : std_logic := '0';
+  signal status       : std_logic_vector(7 downto 0);
+
+  signal fifo_write_data  : std_logic_vector(7 downto 0);
+  signal fifo_write       : std_logic;
+  signal fifo_full        : std_logic;
+  signal fifo_almost_full : std_logic;
+  signal fifo_read_data   : std_logic_vector(7 downto 0);
+  signal fifo_read        : std_logic := '0';
+  signal fifo_empty       : std_logic;
+  signal fifo_level       : std_logic_vector(7 downto 0);
+
+  signal can_rx       : std_logic := '1';
+  signal timestamp    : std_logic_vector(39 downto 0);
+begin
+  timestamp_counter_instance : entity work.timestamp_counter
+  port map (
+    clk       => clk,
+    reset_n   => reset_n,
+    timestamp => timestamp);
+
+  can_receiver_instance : entity work.can_receiver
+  port map (
+    clk               => clk,
+    reset_n           => reset_n,
+    reg_select        => reg_select,
+    reg_address       => reg_address,
+    reg_data          => reg_data,
+    reg_write         => reg_write,
+    status            => status,
+    fifo_data         => fifo_write_data,
+    fifo_write        => fifo_write,
+    fifo_almost_full  => fifo_almost_full,
+    timestamp         => timestamp,
+    can_rx            => can_rx);
+
+  channel_fifo_instance : entity work.channel_fifo
+  port map (
+    clk           => clk,
+    reset_n       => reset_n,
+    clear         => '0',
+    write_data    => fifo_write_data,
+    write_enable  => fifo_write,
+    full          => fifo_full,
+    almost_full   => fifo_almost_full,
+    read_data     => fifo_read_data,
+    read_enable   => fifo_read,
+    empty         => fifo_empty,
+    fill_level    => fifo_level);
+
+  clock_control : process
+  begin
+    if (done) then
+      wait;
+    end if;
+    clk <= '0';
+    wait for CLK_PERIOD/2;
+    clk <= '1';
+    wait for CLK_PERIOD/2;
+  end process clock_control;
+
+  test_control : process
+    variable errors : integer := 0;
+
+    procedure write_register(address : in integer; data : in std_logic_vector(7 downto 0)) is
+    begin
+      wait until rising_edge(clk);
+      reg_select  <= '1';
+      reg_address <= std_logic_vector(to_unsigned(address, 8));
+      reg_data    <= data;
+      reg_write   <= '1';
+      wait until rising_edge(clk);
+      reg_select  <= '0';
+      reg_write   <= '0';
+    end procedure write_register;
+
+    -- Send a complete frame. The ACK slot is driven dominant to act as the
+    -- other nodes on the bus when ack is true.
+    procedure send_frame(bit_time : in time; id : in integer; extended : in boolean;
+                         remote : in boolean; data : in byte_array; ack : in boolean;
+                         corrupt_crc : in boolean) is
+      variable bits       : std_logic_vector(0 to 127);
+      variable bit_count  : integer := 0;
+      variable crc        : std_logic_vector(14 downto 0) := (others => '0');
+      variable id_vector  : std_logic_vector(28 downto 0);
+      variable dlc        : std_logic_vector(3 downto 0);
+      variable same_count : integer;
+      variable last_bit   : std_logic;
+
+      procedure add_bit(value : in std_logic) is
+      begin
+        bits(bit_count) := value;
+        bit_count := bit_count + 1;
+      end procedure add_bit;
+    begin
+      id_vector := std_logic_vector(to_unsigned(id, 29));
+      dlc := std_logic_vector(to_unsigned(data'length, 4));
+
+      -- Unstuffed frame up to the end of the data field
+      add_bit('0');
+      if (extended) then
+        for i in 28 downto 18 loop
+          add_bit(id_vector(i));
+        end loop;
+        add_bit('1');   -- SRR
+        add_bit('1');   -- IDE
+        for i in 17 downto 0 loop
+          add_bit(id_vector(i));
+        end loop;
+        if (remote) then add_bit('1'); else add_bit('0'); end if;
+        add_bit('0');   -- r1
+        add_bit('0');   -- r0
+      else
+        for i in 10 downto 0 loop
+          add_bit(id_vector(i));
+        end loop;
+        if (remote) then add_bit('1'); else add_bit('0'); end if;
+        add_bit('0');   -- IDE
+        add_bit('0');   -- r0
+      end if;
+      for i in 3 downto 0 loop
+        add_bit(dlc(i));
+      end loop;
+      if (not remote) then
+        for b in data'range loop
+          for i in 7 downto 0 loop
+            add_bit(data(b)(i));
+          end loop;
+        end loop;
+      end if;
+
+      -- CRC-15
+      for i in 0 to bit_count-1 loop
+        if ((bits(i) xor crc(14)) = '1') then
+          crc := (crc(13 downto 0) & '0') xor "100010110011001";
+        else
+          crc := crc(13 downto 0) & '0';
+        end if;
+      end loop;
+      if (corrupt_crc) then
+        crc(0) := not crc(0);
+      end if;
+      for i in 14 downto 0 loop
+        add_bit(crc(i));
+      end loop;
+
+      -- Send with bit stuffing
+      same_count := 0;
+      last_bit := 'X';
+      for i in 0 to bit_count-1 loop
+        can_rx <= bits(i);
+        wait for bit_time;
+        if (bits(i) = last_bit) then
+          same_count := same_count + 1;
+        else
+          same_count := 1;
+        end if;
+        last_bit := bits(i);
+        if (same_count = 5) then
+          can_rx <= not last_bit;
+          wait for bit_time;
+          last_bit := not last_bit;
+          same_count := 1;
+        end if;
+      end loop;
+
+      -- CRC delimiter, ACK slot, ACK delimiter, end of frame and intermission
+      can_rx <= '1';
+      wait for bit_time;
+      if (ack) then
+        can_rx <= '0';
+      end if;
+      wait for bit_time;
+      can_rx <= '1';
+      wait for 11 * bit_time;
+    end procedure send_frame;
+
+    procedure expect_record(expected : in byte_array; name : in string) is
+    begin
+      for i in expected'range loop
+        if (fifo_empty = '1') then
+          report name & ": record too short" severity error;
+          errors := errors + 1;
+          return;
+        elsif (fifo_read_data /= expected(i)) then
+          report name & ": byte " & integer'image(i) & " is " &
+                 integer'image(to_integer(unsigned(fifo_read_data))) & " expected " &
+                 integer'image(to_integer(unsigned(expected(i)))) severity error;
+          errors := errors + 1;
+        end if;
+        fifo_read <= '1';
+        wait until rising_edge(clk);
+        fifo_read <= '0';
+        wait until rising_edge(clk);
+        wait until rising_edge(clk);
+      end loop;
+    end procedure expect_record;
+
+    -- Slightly fast, and then slightly slow, bit rate to force resyncs
+    constant FAST_BIT_TIME  : time := 995 ns;
+    constant SLOW_BIT_TIME  : time := 1005 ns;
+  begin
+    reset_n <= '0';
+    wait for 100 ns;
+    reset_n <= '1';
+    wait for 100 ns;
+
+    -- 1 Mbit/s, 75 % sample point, SJW 10 clocks
+    write_register(16#01#, x"00");
+    write_register(16#02#, x"64");
+    write_register(16#03#, x"00");
+    write_register(16#04#, x"4B");
+    write_register(16#05#, x"0A");
+    write_register(16#00#, x"81");
+    wait for 12 us;
+
+    -- ========================================================================
+    -- Standard data frame with stuffing in the data
+    -- ========================================================================
+    send_frame(FAST_BIT_TIME, 16#123#, false, false, (x"00", x"FF", x"00", x"11"), true, false);
+    expect_record((x"00", x"44", x"00", x"00", x"01", x"23", x"00", x"FF", x"00", x"11"), "Standard frame");
+
+    -- ========================================================================
+    -- Extended data frame with 8 bytes
+    -- ========================================================================
+    send_frame(SLOW_BIT_TIME, 16#18DAF110#, true, false,
+               (x"02", x"10", x"03", x"AA", x"AA", x"AA", x"AA", x"AA"), true, false);
+    expect_record((x"80", x"88", x"18", x"DA", x"F1", x"10",
+                   x"02", x"10", x"03", x"AA", x"AA", x"AA", x"AA", x"AA"), "Extended frame");
+
+    -- ========================================================================
+    -- Remote frame, DLC 2 but no data
+    -- ========================================================================
+    send_frame(FAST_BIT_TIME, 16#7FF#, false, true, (x"00", x"00"), true, false);
+    expect_record((x"40", x"02", x"00", x"00", x"07", x"FF"), "Remote frame");
+
+    -- ========================================================================
+    -- No ack
+    -- ========================================================================
+    send_frame(SLOW_BIT_TIME, 16#001#, false, false, (0 => x"5A"), false, false);
+    expect_record((x"08", x"11", x"00", x"00", x"00", x"01", x"5A"), "No ack");
+
+    -- ========================================================================
+    -- CRC error
+    -- ========================================================================
+    send_frame(FAST_BIT_TIME, 16#321#, false, false, (0 => x"A5"), true, true);
+    expect_record((x"02", x"11", x"00", x"00", x"03", x"21", x"A5"), "CRC error");
+    if (status(1) /= '1') then
+      report "CRC error not flagged in status" severity error;
+      errors := errors + 1;
+    end if;
+
+    -- ========================================================================
+    -- Error frame in the middle of the identifier gives a stuff error
+    -- ========================================================================
+    write_register(16#00#, x"81");
+    can_rx <= '0';
+    wait for 7 us;
+    can_rx <= '1';
+    wait for 12 us;
+    if (fifo_empty = '1' or fifo_read_data(2) /= '1') then
+      report "Stuff error not reported" severity error;
+      errors := errors + 1;
+    end if;
+    -- Skip the rest of the record
+    expect_record((0 => x"04"), "Stuff error");
+    for i in 1 to 5 loop
+      fifo_read <= '1';
+      wait until rising_edge(clk);
+      fifo_read <= '0';
+      wait until rising_edge(clk);
+      wait until rising_edge(clk);
+    end loop;
+
+    -- ========================================================================
+    -- The receiver should be back in sync after the error
+    -- ========================================================================
+    send_frame(FAST_BIT_TIME, 16#555#, false, false, (0 => x"3C"), true, false);
+    expect_record((x"00", x"11", x"00", x"00", x"05", x"55", x"3C"), "After error");
+
+    -- ========================================================================
+    -- Timestamps, a full timestamp before the first record and a delta
+    -- before the next one
+    -- ========================================================================
+    write_register(16#00#, x"83");
+    send_frame(FAST_BIT_TIME, 16#100#, false, false, (0 => x"01"), true, false);
+    send_frame(FAST_BIT_TIME, 16#101#, false, false, (0 => x"02"), true, false);
+    if (fifo_read_data /= x"C0") then
+      report "Expected a full timestamp" severity error;
+      errors := errors + 1;
+    end if;
+    for i in 0 to 5 loop
+      fifo_read <= '1';
+      wait until rising_edge(clk);
+      fifo_read <= '0';
+      wait until rising_edge(clk);
+      wait until rising_edge(clk);
+    end loop;
+    expect_record((x"00", x"11", x"00", x"00", x"01", x"00", x"01"), "First timestamped frame");
+    -- The frames are about 80 bits, or 8000 ticks, apart which needs two bytes
+    if (fifo_read_data(7 downto 6) /= "01") then
+      report "Expected a two byte timestamp delta" severity error;
+      errors := errors + 1;
+    end if;
+    for i in 0 to 1 loop
+      fifo_read <= '1';
+      wait until rising_edge(clk);
+      fifo_read <= '0';
+      wait until rising_edge(clk);
+      wait until rising_edge(clk);
+    end loop;
+    expect_record((x"00", x"11", x"00", x"00", x"01", x"01", x"02"), "Second timestamped frame");
+
+    -- ========================================================================
+    if (errors = 0) then
+      report "can_receiver_tb: all tests passed" severity note;
+    else
+      report "can_receiver_tb: " & integer'image(errors) & " errors" severity failure;
+    end if;
+    done <= true;
+    wait;
+  end process test_control;
+
+end architecture behav;
\ No newline at end of file
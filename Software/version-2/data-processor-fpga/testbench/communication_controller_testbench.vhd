@@ -43,6 +43,34 @@ COMPONENT communication_data_manager
     channel_direction_a   : out std_logic_vector(5 downto 0);
     channel_direction_b   : out std_logic_vector(5 downto 0);
     channel_termination   : out std_logic_vector(5 downto 0);
+    channel_reg_select    : out std_logic_vector(5 downto 0);
+    channel_reg_address   : out std_logic_vector(7 downto 0);
+    channel_reg_data      : out std_logic_vector(7 downto 0);
+    channel_reg_write     : out std_logic;
+    channel_status_1      : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_status_2      : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_status_3      : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_status_4      : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_status_5      : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_status_6      : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_level_1  : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_level_2  : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_level_3  : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_level_4  : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_level_5  : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_level_6  : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_data_1   : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_data_2   : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_data_3   : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_data_4   : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_data_5   : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_data_6   : in  std_logic_vector(7 downto 0) := (others => '0');
+    channel_fifo_read     : out std_logic_vector(5 downto 0);
+    adc_reg_select        : out std_logic;
+    adc_status            : in  std_logic_vector(7 downto 0) := (others => '0');
+    adc_fifo_level        : in  std_logic_vector(7 downto 0) := (others => '0');
+    adc_fifo_data         : in  std_logic_vector(7 downto 0) := (others => '0');
+    adc_fifo_read         : out std_logic;
     rx_data_ready         : in  std_logic;
     rx_data               : in  std_logic_vector(7 downto 0);
     load_tx_data_ready    : in  std_logic;
@@ -0,0 +1,186 @@
+-- *******************************************************************************
+-- * @file    i2c_master_tb.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-10-02
+-- * @brief   Self checking testbench for i2c_master. Decodes the bus with
+-- *          pull-ups on SCL and SDA, checks the address and data bytes and
+-- *          measures the SCL period and the length of a transaction.
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+entity i2c_master_tb is
+end i2c_master_tb;
+
+architecture behav of i2c_master_tb is
+  constant CLK_PERIOD       : time := 10 ns;  -- 100 MHz
+  constant CLK_FREQ         : integer := 100000000;
+  constant I2C_BUS_CLK_FREQ : integer := 400000;
+  -- The master runs four steps per SCL period so the period is rounded down
+  constant SCL_PERIOD_CLK   : integer := 4 * ((CLK_FREQ / I2C_BUS_CLK_FREQ) / 4);
+
+  -- Regression limit, start, 2 x 9 bits, stop and some margin
+  constant MAX_TRANSACTION_CLK : integer := 22 * SCL_PERIOD_CLK;
+
+  type byte_array is array(natural range <>) of std_logic_vector(7 downto 0);
+  constant TEST_ADDRESSES : byte_array := (x"40", x"4E", x"A5", x"00");
+  constant TEST_DATA      : byte_array := (x"FF", x"00", x"5A", x"81");
+
+  signal clk        : std_logic := '0';
+  signal reset_n    : std_logic := '0';
+  signal done       : boolean := false;
+
+  signal address    : std_logic_vector(7 downto 0) := (others => '0');
+  signal data       : std_logic_vector(7 downto 0) := (others => '0');
+  signal enable     : std_logic := '0';
+  signal busy       : std_logic;
+  signal slave_ack  : std_logic;
+
+  -- Open drain bus with pull-ups
+  signal i2c_sclk   : std_logic;
+  signal i2c_sdat   : std_logic;
+begin
+  i2c_sclk <= 'H';
+  i2c_sdat <= 'H';
+
+  i2c_master_instance : entity work.i2c_master
+  generic map (
+    clk_freq          => CLK_FREQ,
+    i2c_bus_clk_freq  => I2C_BUS_CLK_FREQ)
+  port map (
+    clk       => clk,
+    reset_n   => reset_n,
+    address   => address,
+    data      => data,
+    i2c_sclk  => i2c_sclk,
+    i2c_sdat  => i2c_sdat,
+    enable    => enable,
+    busy      => busy,
+    slave_ack => slave_ack);
+
+  clock_control : process
+  begin
+    if (done) then
+      wait;
+    end if;
+    clk <= '0';
+    wait for CLK_PERIOD/2;
+    clk <= '1';
+    wait for CLK_PERIOD/2;
+  end process clock_control;
+
+  test_control : process
+    variable errors       : integer := 0;
+    variable bits         : std_logic_vector(17 downto 0);
+    variable start_time   : time;
+    variable rising_time  : time;
+    variable scl_period   : integer := 0;
+    variable transaction  : integer;
+    variable timed_out    : boolean;
+  begin
+    reset_n <= '0';
+    wait for 100 ns;
+    reset_n <= '1';
+    wait for 10 us;
+
+    for t in TEST_ADDRESSES'range loop
+      wait until rising_edge(clk);
+      address <= TEST_ADDRESSES(t);
+      data    <= TEST_DATA(t);
+      enable  <= '1';
+      start_time := now;
+
+      -- Start condition, SDA goes low while SCL is high
+      wait until falling_edge(i2c_sdat) and to_X01(i2c_sclk) = '1' for 20 us;
+      enable <= '0';
+      timed_out := (now - start_time >= 20 us);
+
+      -- Address and data with the acknowledge bit after each
+      rising_time := 0 ns;
+      for i in 17 downto 0 loop
+        if (not timed_out) then
+          wait until rising_edge(i2c_sclk) for 20 us;
+          timed_out := (to_X01(i2c_sclk) /= '1');
+          bits(i) := to_X01(i2c_sdat);
+          if (rising_time /= 0 ns) then
+            scl_period := (now - rising_time) / CLK_PERIOD;
+          end if;
+          rising_time := now;
+        end if;
+      end loop;
+
+      -- Stop condition, SDA goes high while SCL is high
+      if (not timed_out) then
+        wait until rising_edge(i2c_sdat) and to_X01(i2c_sclk) = '1' for 20 us;
+        timed_out := (to_X01(i2c_sdat) /= '1');
+      end if;
+      transaction := (now - start_time) / CLK_PERIOD;
+
+      if (timed_out) then
+        report "Transaction " & integer'image(t) & " timed out" severity error;
+        errors := errors + 1;
+      else
+        if (bits(17 downto 10) /= TEST_ADDRESSES(t)) then
+          report "Wrong address in transaction " & integer'image(t) severity error;
+          errors := errors + 1;
+        end if;
+        if (bits(8 downto 1) /= TEST_DATA(t)) then
+          report "Wrong data in transaction " & integer'image(t) severity error;
+          errors := errors + 1;
+        end if;
+        -- Nobody pulls the acknowledge bits low
+        if (bits(9) /= '1' or bits(0) /= '1') then
+          report "SDA not released for the acknowledge in transaction " & integer'image(t) severity error;
+          errors := errors + 1;
+        end if;
+      end if;
+
+      -- Wait for the master to become ready
+      while (busy = '1') loop
+        wait until rising_edge(clk);
+      end loop;
+      wait for 10 us;
+    end loop;
+
+    report "PERF i2c_master_tb scl_period = " & integer'image(scl_period) & " clk" severity note;
+    report "PERF i2c_master_tb transaction = " & integer'image(transaction) & " clk" severity note;
+    if (scl_period /= SCL_PERIOD_CLK) then
+      report "SCL period is " & integer'image(scl_period) & " clk, expected " &
+             integer'image(SCL_PERIOD_CLK) severity error;
+      errors := errors + 1;
+    end if;
+    if (transaction > MAX_TRANSACTION_CLK) then
+      report "Transaction takes " & integer'image(transaction) & " clk, limit is " &
+             integer'image(MAX_TRANSACTION_CLK) severity error;
+      errors := errors + 1;
+    end if;
+
+    -- ========================================================================
+    if (errors = 0) then
+      report "i2c_master_tb: all tests passed" severity note;
+    else
+      report "i2c_master_tb: " & integer'image(errors) & " errors" severity failure;
+    end if;
+    done <= true;
+    wait;
+  end process test_control;
+
+end architecture behav;
\ No newline at end of file
@@ -0,0 +1,390 @@
+-- *******************************************************************************
+-- * @file    logic_analyzer_tb.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-10-09
+-- * @brief   Self checking testbench for logic_analyzer and channel_fifo.
+-- *          Drives the probes with known transitions, decodes the records
+-- *          from the FIFO and checks the values and the time between them.
+-- *          Also checks the pin mask, the pattern and edge triggers and
+-- *          measures how fast records are written for a burst of
+-- *          transitions on every clk cycle.
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+entity logic_analyzer_tb is
+end logic_analyzer_tb;
+
+architecture behav of logic_analyzer_tb is
+  constant CLK_PERIOD   : time := 10 ns;  -- 100 MHz
+  constant BURST_LENGTH : integer := 200;
+
+  -- Regression limits, a burst record is a one byte header and the pins
+  constant MAX_CLK_PER_RECORD       : integer := 4;
+  constant MAX_BYTES_PER_TRANSITION : integer := 2;
+
+  type byte_array is array(natural range <>) of std_logic_vector(7 downto 0);
+  type integer_array is array(natural range <>) of integer;
+
+  -- Every value differs from the one before, the gaps cover all header sizes
+  constant TEST_VALUES  : byte_array := (x"01", x"03", x"02", x"FF", x"00", x"80", x"81", x"7E");
+  constant TEST_GAPS    : integer_array := (5, 1, 63, 64, 200, 16384, 3, 40000);
+
+  signal clk          : std_logic := '0';
+  signal reset_n      : std_logic := '0';
+  signal done         : boolean := false;
+
+  signal reg_select   : std_logic := '0';
+  signal reg_address  : std_logic_vector(7 downto 0) := (others => '0');
+  signal reg_data     : std_logic_vector(7 downto 0) := (others => '0');
+  signal reg_write    : std_logic := '0';
+  signal status       : std_logic_vector(7 downto 0);
+
+  signal fifo_write_data  : std_logic_vector(7 downto 0);
+  signal fifo_write       : std_logic;
+  signal fifo_almost_full : std_logic;
+  signal fifo_read_data   : std_logic_vector(7 downto 0);
+  signal fifo_read        : std_logic := '0';
+  signal fifo_empty       : std_logic;
+
+  signal probes       : std_logic_vector(7 downto 0) := (others => '0');
+  signal timestamp    : std_logic_vector(39 downto 0);
+begin
+  timestamp_counter_instance : entity work.timestamp_counter
+  port map (
+    clk       => clk,
+    reset_n   => reset_n,
+    timestamp => timestamp);
+
+  logic_analyzer_instance : entity work.logic_analyzer
+  port map (
+    clk               => clk,
+    reset_n           => reset_n,
+    reg_select        => reg_select,
+    reg_address       => reg_address,
+    reg_data          => reg_data,
+    reg_write         => reg_write,
+    status            => status,
+    fifo_data         => fifo_write_data,
+    fifo_write        => fifo_write,
+    fifo_almost_full  => fifo_almost_full,
+    timestamp         => timestamp,
+    probes            => probes);
+
+  channel_fifo_instance : entity work.channel_fifo
+  port map (
+    clk           => clk,
+    reset_n       => reset_n,
+    clear         => '0',
+    write_data    => fifo_write_data,
+    write_enable  => fifo_write,
+    full          => open,
+    almost_full   => fifo_almost_full,
+    read_data     => fifo_read_data,
+    read_enable   => fifo_read,
+    empty         => fifo_empty,
+    fill_level    => open);
+
+  clock_control : process
+  begin
+    if (done) then
+      wait;
+    end if;
+    clk <= '0';
+    wait for CLK_PERIOD/2;
+    clk <= '1';
+    wait for CLK_PERIOD/2;
+  end process clock_control;
+
+  test_control : process
+    variable errors         : integer := 0;
+    variable record_time    : integer := 0;
+    variable previous_time  : integer;
+    variable record_bytes   : integer := 0;
+    variable value          : std_logic_vector(7 downto 0);
+    variable is_full        : boolean;
+    variable start_time     : time;
+    variable clk_per_record : integer;
+
+    procedure write_register(address : in integer; data : in std_logic_vector(7 downto 0)) is
+    begin
+      wait until rising_edge(clk);
+      reg_select  <= '1';
+      reg_address <= std_logic_vector(to_unsigned(address, 8));
+      reg_data    <= data;
+      reg_write   <= '1';
+      wait until rising_edge(clk);
+      reg_select  <= '0';
+      reg_write   <= '0';
+    end procedure write_register;
+
+    procedure wait_clk(count : in integer) is
+    begin
+      for i in 1 to count loop
+        wait until rising_edge(clk);
+      end loop;
+    end procedure wait_clk;
+
+    procedure pop_byte(data : out std_logic_vector(7 downto 0)) is
+      variable timeout : integer := 0;
+    begin
+      while (fifo_empty = '1' and timeout < 100000) loop
+        wait until rising_edge(clk);
+        timeout := timeout + 1;
+      end loop;
+      if (fifo_empty = '1') then
+        report "FIFO empty" severity error;
+        errors := errors + 1;
+      end if;
+      data := fifo_read_data;
+      fifo_read <= '1';
+      wait until rising_edge(clk);
+      fifo_read <= '0';
+      wait until rising_edge(clk);
+      record_bytes := record_bytes + 1;
+    end procedure pop_byte;
+
+    -- Decodes one record, record_time is updated with the timestamp
+    procedure read_record(pins : out std_logic_vector(7 downto 0); full : out boolean) is
+      variable header : std_logic_vector(7 downto 0);
+      variable b      : byte_array(0 to 4);
+    begin
+      pop_byte(header);
+      full := false;
+      case header(7 downto 6) is
+        when "00" =>
+          record_time := record_time + to_integer(unsigned(header(5 downto 0)));
+        when "01" =>
+          pop_byte(b(0));
+          record_time := record_time + to_integer(unsigned(header(5 downto 0) & b(0)));
+        when "10" =>
+          pop_byte(b(0));
+          pop_byte(b(1));
+          record_time := record_time + to_integer(unsigned(header(5 downto 0) & b(0) & b(1)));
+        when others =>
+          for i in 0 to 4 loop
+            pop_byte(b(i));
+          end loop;
+          -- The simulation is far too short to use more than 30 bits
+          record_time := to_integer(unsigned(b(1)(5 downto 0) & b(2) & b(3) & b(4)));
+          full := true;
+      end case;
+      pop_byte(pins);
+    end procedure read_record;
+
+    procedure expect_first(expected : in std_logic_vector(7 downto 0); message : in string) is
+      variable full : boolean;
+    begin
+      read_record(value, full);
+      if (not full) then
+        report message & ": first record has no full timestamp" severity error;
+        errors := errors + 1;
+      end if;
+      if (value /= expected) then
+        report message & ": first record is " & integer'image(to_integer(unsigned(value))) &
+               " expected " & integer'image(to_integer(unsigned(expected))) severity error;
+        errors := errors + 1;
+      end if;
+    end procedure expect_first;
+
+    procedure expect_empty(message : in string) is
+    begin
+      wait_clk(20);
+      if (fifo_empty = '0') then
+        report message severity error;
+        errors := errors + 1;
+      end if;
+    end procedure expect_empty;
+
+    procedure enable(trigger_mode : in std_logic_vector(7 downto 0); pin_mask : in std_logic_vector(7 downto 0);
+                     divisor : in integer) is
+    begin
+      write_register(16#00#, x"00");
+      write_register(16#01#, pin_mask);
+      write_register(16#02#, std_logic_vector(to_unsigned(divisor / 256, 8)));
+      write_register(16#03#, std_logic_vector(to_unsigned(divisor mod 256, 8)));
+      write_register(16#04#, trigger_mode);
+      write_register(16#00#, x"81");
+    end procedure enable;
+  begin
+    reset_n <= '0';
+    wait for 100 ns;
+    reset_n <= '1';
+    wait for 100 ns;
+
+    -- ========================================================================
+    -- Sample every clk cycle, the time between records has to be exact
+    -- ========================================================================
+    enable(x"00", x"FF", 1);
+    expect_first(x"00", "Every clk");
+    for i in TEST_VALUES'range loop
+      wait_clk(TEST_GAPS(i));
+      probes <= TEST_VALUES(i);
+    end loop;
+    record_bytes := 0;
+    for i in TEST_VALUES'range loop
+      previous_time := record_time;
+      read_record(value, is_full);
+      if (value /= TEST_VALUES(i)) then
+        report "Transition " & integer'image(i) & " has value " &
+               integer'image(to_integer(unsigned(value))) severity error;
+        errors := errors + 1;
+      end if;
+      -- The time to the first transition depends on when the trigger hit
+      if (i > 0 and record_time - previous_time /= TEST_GAPS(i)) then
+        report "Transition " & integer'image(i) & " is " & integer'image(record_time - previous_time) &
+               " clk after the one before, expected " & integer'image(TEST_GAPS(i)) severity error;
+        errors := errors + 1;
+      end if;
+    end loop;
+    expect_empty("Records left after the transitions");
+
+    -- ========================================================================
+    -- Sample every 10th clk cycle
+    -- ========================================================================
+    enable(x"00", x"FF", 10);
+    expect_first(TEST_VALUES(TEST_VALUES'high), "Divisor 10");
+    for i in 1 to 3 loop
+      wait_clk(100*i);
+      probes <= std_logic_vector(to_unsigned(i, 8));
+    end loop;
+    for i in 1 to 3 loop
+      previous_time := record_time;
+      read_record(value, is_full);
+      if (value /= std_logic_vector(to_unsigned(i, 8))) then
+        report "Wrong value with divisor 10" severity error;
+        errors := errors + 1;
+      end if;
+      if (i > 1 and abs(record_time - previous_time - 100*i) >= 10) then
+        report "Transition is " & integer'image(record_time - previous_time) &
+               " clk after the one before with divisor 10, expected " & integer'image(100*i) severity error;
+        errors := errors + 1;
+      end if;
+    end loop;
+    expect_empty("Records left with divisor 10");
+
+    -- ========================================================================
+    -- Pins outside the mask are ignored
+    -- ========================================================================
+    probes <= x"00";
+    enable(x"00", x"0F", 1);
+    expect_first(x"00", "Pin mask");
+    probes <= x"F0";
+    expect_empty("Masked pins gave a record");
+    probes <= x"F5";
+    read_record(value, is_full);
+    if (value /= x"05") then
+      report "Masked pins are not zero" severity error;
+      errors := errors + 1;
+    end if;
+
+    -- ========================================================================
+    -- Pattern trigger, the low nibble has to be 0xA
+    -- ========================================================================
+    probes <= x"00";
+    write_register(16#05#, x"0F");
+    write_register(16#06#, x"0A");
+    enable(x"01", x"FF", 1);
+    probes <= x"F5";
+    expect_empty("Pattern trigger hit too early");
+    if (status(0) /= '1') then
+      report "Not armed while waiting for the pattern" severity error;
+      errors := errors + 1;
+    end if;
+    probes <= x"FA";
+    expect_first(x"FA", "Pattern trigger");
+    if (status(1) /= '1') then
+      report "Not capturing after the pattern" severity error;
+      errors := errors + 1;
+    end if;
+
+    -- ========================================================================
+    -- Edge trigger, rising edge on pin 7
+    -- ========================================================================
+    probes <= x"80";
+    write_register(16#05#, x"80");
+    write_register(16#06#, x"80");
+    enable(x"02", x"FF", 1);
+    probes <= x"81";
+    expect_empty("Edge trigger hit on a high level");
+    probes <= x"01";
+    expect_empty("Edge trigger hit on a falling edge");
+    probes <= x"83";
+    expect_first(x"83", "Edge trigger");
+
+    -- ========================================================================
+    -- A transition on every clk cycle, the buffer takes the burst
+    -- ========================================================================
+    probes <= x"00";
+    enable(x"00", x"FF", 1);
+    expect_first(x"00", "Burst");
+    wait until rising_edge(clk);
+    start_time := now;
+    for i in 1 to BURST_LENGTH loop
+      probes <= std_logic_vector(to_unsigned(i mod 2, 8));
+      wait until rising_edge(clk);
+    end loop;
+    -- Everything has been written when the buffer is empty
+    while (status(5) = '1') loop
+      wait until rising_edge(clk);
+    end loop;
+    clk_per_record := (now - start_time) / CLK_PERIOD / BURST_LENGTH;
+    if (status(3) = '1') then
+      report "Buffer overrun during the burst" severity error;
+      errors := errors + 1;
+    end if;
+    record_bytes := 0;
+    for i in 1 to BURST_LENGTH loop
+      previous_time := record_time;
+      read_record(value, is_full);
+      if (value /= std_logic_vector(to_unsigned(i mod 2, 8)) or
+          (i > 1 and record_time - previous_time /= 1)) then
+        report "Wrong burst record " & integer'image(i) severity error;
+        errors := errors + 1;
+      end if;
+    end loop;
+
+    report "PERF logic_analyzer_tb clk_per_record = " & integer'image(clk_per_record) & " clk" severity note;
+    report "PERF logic_analyzer_tb bytes_per_transition = " &
+           integer'image(record_bytes / BURST_LENGTH) & " bytes" severity note;
+    if (clk_per_record > MAX_CLK_PER_RECORD) then
+      report "Records take " & integer'image(clk_per_record) & " clk, limit is " &
+             integer'image(MAX_CLK_PER_RECORD) severity error;
+      errors := errors + 1;
+    end if;
+    if (record_bytes > MAX_BYTES_PER_TRANSITION * BURST_LENGTH) then
+      report integer'image(record_bytes) & " bytes for " & integer'image(BURST_LENGTH) &
+             " transitions" severity error;
+      errors := errors + 1;
+    end if;
+    write_register(16#00#, x"00");
+
+    -- ========================================================================
+    if (errors = 0) then
+      report "logic_analyzer_tb: all tests passed" severity note;
+    else
+      report "logic_analyzer_tb: " & integer'image(errors) & " errors" severity failure;
+    end if;
+    done <= true;
+    wait;
+  end process test_control;
+
+end architecture behav;
\ No newline at end of file
@@ -0,0 +1,196 @@
+-- *******************************************************************************
+-- * @file    moving_average_tb.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-10-09
+-- * @brief   Self checking testbench that compares moving_average_shared
+-- *          against moving_average with pseudo random samples on all eight
+-- *          channels, for a window of 8 and of 32 samples.
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+entity moving_average_tb is
+end moving_average_tb;
+
+architecture behav of moving_average_tb is
+  constant CLK_PERIOD       : time := 10 ns;  -- 100 MHz
+  constant SAMPLE_BIT_SIZE  : integer := 10;
+  constant NUM_OF_UPDATES   : integer := 500;
+
+  -- Regression limit, clk cycles from new_data to valid_values for the
+  -- shared filter, three cycles per channel plus the edge detection
+  constant MAX_SHARED_LATENCY : integer := 3*8 + 4;
+
+  type sample_array is array(0 to 7) of std_logic_vector(SAMPLE_BIT_SIZE-1 downto 0);
+
+  signal clk          : std_logic := '0';
+  signal reset_n      : std_logic := '0';
+  signal done         : boolean := false;
+
+  signal samples      : sample_array := (others => (others => '0'));
+  signal samples_flat : std_logic_vector(8*SAMPLE_BIT_SIZE-1 downto 0);
+  signal new_data     : std_logic := '0';
+
+  signal reference_8    : sample_array;
+  signal reference_32   : sample_array;
+  signal averages_8     : std_logic_vector(8*SAMPLE_BIT_SIZE-1 downto 0);
+  signal averages_32    : std_logic_vector(8*SAMPLE_BIT_SIZE-1 downto 0);
+  signal valid_8        : std_logic;
+  signal valid_32       : std_logic;
+begin
+  flatten : for i in 0 to 7 generate
+    samples_flat((i+1)*SAMPLE_BIT_SIZE-1 downto i*SAMPLE_BIT_SIZE) <= samples(i);
+  end generate flatten;
+
+  -- ==========================================================================
+  -- Window of 8 samples
+  -- ==========================================================================
+  reference_8_instance : entity work.moving_average
+  generic map (
+    NUM_OF_SAMPLES  => 8,
+    SAMPLE_BIT_SIZE => SAMPLE_BIT_SIZE)
+  port map (
+    clk => clk, reset_n => reset_n,
+    sample_0 => samples(0), sample_1 => samples(1), sample_2 => samples(2), sample_3 => samples(3),
+    sample_4 => samples(4), sample_5 => samples(5), sample_6 => samples(6), sample_7 => samples(7),
+    average_0 => reference_8(0), average_1 => reference_8(1), average_2 => reference_8(2), average_3 => reference_8(3),
+    average_4 => reference_8(4), average_5 => reference_8(5), average_6 => reference_8(6), average_7 => reference_8(7),
+    new_data => new_data);
+
+  shared_8_instance : entity work.moving_average_shared
+  generic map (
+    NUM_OF_CHANNELS   => 8,
+    WINDOW_SIZE_LOG2  => 3,
+    SAMPLE_BIT_SIZE   => SAMPLE_BIT_SIZE)
+  port map (
+    clk           => clk,
+    reset_n       => reset_n,
+    samples       => samples_flat,
+    averages      => averages_8,
+    new_data      => new_data,
+    valid_values  => valid_8);
+
+  -- ==========================================================================
+  -- Window of 32 samples
+  -- ==========================================================================
+  reference_32_instance : entity work.moving_average
+  generic map (
+    NUM_OF_SAMPLES  => 32,
+    SAMPLE_BIT_SIZE => SAMPLE_BIT_SIZE)
+  port map (
+    clk => clk, reset_n => reset_n,
+    sample_0 => samples(0), sample_1 => samples(1), sample_2 => samples(2), sample_3 => samples(3),
+    sample_4 => samples(4), sample_5 => samples(5), sample_6 => samples(6), sample_7 => samples(7),
+    average_0 => reference_32(0), average_1 => reference_32(1), average_2 => reference_32(2), average_3 => reference_32(3),
+    average_4 => reference_32(4), average_5 => reference_32(5), average_6 => reference_32(6), average_7 => reference_32(7),
+    new_data => new_data);
+
+  shared_32_instance : entity work.moving_average_shared
+  generic map (
+    NUM_OF_CHANNELS   => 8,
+    WINDOW_SIZE_LOG2  => 5,
+    SAMPLE_BIT_SIZE   => SAMPLE_BIT_SIZE)
+  port map (
+    clk           => clk,
+    reset_n       => reset_n,
+    samples       => samples_flat,
+    averages      => averages_32,
+    new_data      => new_data,
+    valid_values  => valid_32);
+
+  clock_control : process
+  begin
+    if (done) then
+      wait;
+    end if;
+    clk <= '0';
+    wait for CLK_PERIOD/2;
+    clk <= '1';
+    wait for CLK_PERIOD/2;
+  end process clock_control;
+
+  test_control : process
+    variable errors : integer := 0;
+    variable lfsr   : std_logic_vector(15 downto 0) := x"ACE1";
+    variable start_time : time;
+    variable latency    : integer := 0;
+
+    procedure compare(reference : in sample_array; averages : in std_logic_vector;
+                      name : in string; update : in integer) is
+    begin
+      for i in 0 to 7 loop
+        if (averages((i+1)*SAMPLE_BIT_SIZE-1 downto i*SAMPLE_BIT_SIZE) /= reference(i)) then
+          report name & ": channel " & integer'image(i) & " differs at update " &
+                 integer'image(update) severity error;
+          errors := errors + 1;
+        end if;
+      end loop;
+    end procedure compare;
+  begin
+    reset_n <= '0';
+    wait for 100 ns;
+    reset_n <= '1';
+    -- Let the shared filters clear their memory
+    wait for 5 us;
+
+    for update in 1 to NUM_OF_UPDATES loop
+      -- New pseudo random samples for all channels
+      for i in 0 to 7 loop
+        for b in 0 to 9 loop
+          lfsr := lfsr(14 downto 0) & (lfsr(15) xor lfsr(13) xor lfsr(12) xor lfsr(10));
+        end loop;
+        samples(i) <= lfsr(SAMPLE_BIT_SIZE-1 downto 0);
+      end loop;
+      wait until rising_edge(clk);
+      new_data <= '1';
+      start_time := now;
+      wait until rising_edge(clk);
+      wait until rising_edge(clk);
+      new_data <= '0';
+
+      wait until valid_32 = '1';
+      if ((now - start_time) / CLK_PERIOD > latency) then
+        latency := (now - start_time) / CLK_PERIOD;
+      end if;
+      wait until rising_edge(clk);
+      compare(reference_8, averages_8, "Window 8", update);
+      compare(reference_32, averages_32, "Window 32", update);
+    end loop;
+
+    report "PERF moving_average_tb shared_latency = " & integer'image(latency) & " clk" severity note;
+    report "PERF moving_average_tb shared_update_rate = " &
+           integer'image(1 sec / ((latency + 1) * CLK_PERIOD)) & " updates/s" severity note;
+    if (latency > MAX_SHARED_LATENCY) then
+      report "Shared filter takes " & integer'image(latency) & " clk, limit is " &
+             integer'image(MAX_SHARED_LATENCY) severity error;
+      errors := errors + 1;
+    end if;
+
+    if (errors = 0) then
+      report "moving_average_tb: all tests passed" severity note;
+    else
+      report "moving_average_tb: " & integer'image(errors) & " errors" severity failure;
+    end if;
+    done <= true;
+    wait;
+  end process test_control;
+
+end architecture behav;
\ No newline at end of file
@@ -0,0 +1,449 @@
+-- *******************************************************************************
+-- * @file    spi_throughput_tb.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-10-02
+-- * @brief   Self checking testbench for spi_slave_controller and
+-- *          communication_data_manager. Runs the same set of commands at
+-- *          SCLK rates from 1 MHz and up to find the highest rate where all
+-- *          of them still work. The periods are not multiples of clk so the
+-- *          sweep covers SCLK/clk ratios from 1/100 to above 1 and different
+-- *          phases between the two clocks. Also measures the latency in clk
+-- *          cycles of
+-- *          each command. Ends with a failure if any number is worse than
+-- *          the limits below. Results are reported on lines starting with
+-- *          PERF so that testbench/Makefile can collect them.
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+entity spi_throughput_tb is
+end spi_throughput_tb;
+
+architecture behav of spi_throughput_tb is
+  constant CLK_PERIOD           : time := 10 ns;  -- 100 MHz
+  constant LATENCY_SCLK_PERIOD  : time := 100 ns; -- Latencies are measured at 10 MHz
+  constant CS_HOLD_TIME         : time := 50 ns;  -- CS low after the last SCLK edge
+  constant CS_IDLE_TIME         : time := 100 ns; -- CS high between transfers
+  constant FIFO_READ_COUNT      : integer := 64;
+  constant CHANNEL_1_STATUS     : std_logic_vector(7 downto 0) := x"A5";
+
+  -- Regression limits, update these when the design gets faster
+  constant MAX_LOAD_LATENCY     : integer := 3;     -- clk cycles from the load window opening to load_tx_data
+  constant MAX_WRITE_LATENCY    : integer := 3;     -- clk cycles from a received byte to the write it causes
+  constant MAX_SCLK_PERIOD      : time := 11.1 ns;  -- All commands have to work at this SCLK period and slower,
+                                                    -- 90 MHz is twice the 45 MHz SPI5 on the UI runs at
+
+  -- Slowest first, a rate only counts if all slower rates passed as well
+  type period_array is array(natural range <>) of time;
+  constant SCLK_PERIODS : period_array := (
+    1000 ns, 400 ns, 200 ns, 100 ns, 80 ns, 60 ns, 50 ns, 40 ns, 30 ns, 25 ns,
+    22.2 ns, 20 ns, 17 ns, 15 ns, 13 ns, 12 ns, 11.1 ns, 10 ns, 9 ns, 8 ns);
+
+  type byte_array is array(natural range <>) of std_logic_vector(7 downto 0);
+
+  signal clk          : std_logic := '0';
+  signal reset_n      : std_logic := '0';
+  signal done         : boolean := false;
+
+  -- SPI bus
+  signal spi_cs_n     : std_logic := '1';
+  signal spi_sclk     : std_logic := '1';
+  signal spi_mosi     : std_logic := '0';
+  signal spi_miso     : std_logic;
+
+  -- Between the SPI slave and the data manager
+  signal transfer_in_progress : std_logic;
+  signal load_tx_data_ready   : std_logic;
+  signal load_tx_data         : std_logic;
+  signal tx_data              : std_logic_vector(7 downto 0);
+  signal rx_data_ready        : std_logic;
+  signal rx_data              : std_logic_vector(7 downto 0);
+
+  -- Channel side of the data manager
+  signal channel_power        : std_logic_vector(5 downto 0);
+  signal channel_reg_select   : std_logic_vector(5 downto 0);
+  signal channel_reg_address  : std_logic_vector(7 downto 0);
+  signal channel_reg_data     : std_logic_vector(7 downto 0);
+  signal channel_reg_write    : std_logic;
+  signal channel_fifo_read    : std_logic_vector(5 downto 0);
+
+  -- Channel 1 FIFO, filled by the testbench
+  signal fifo_clear       : std_logic := '0';
+  signal fifo_write_data  : std_logic_vector(7 downto 0) := (others => '0');
+  signal fifo_write       : std_logic := '0';
+  signal fifo_read_data   : std_logic_vector(7 downto 0);
+  signal fifo_level       : std_logic_vector(7 downto 0);
+
+  -- Register writes seen on channel 1
+  signal register_file        : byte_array(0 to 255) := (others => (others => '0'));
+  signal register_write_count : integer := 0;
+
+  -- Latest measured latencies in clk cycles
+  signal load_latency     : integer := 0;
+  signal request_latency  : integer := 0;
+  signal write_latency    : integer := 0;
+  signal power_latency    : integer := 0;
+begin
+  spi_slave_instance : entity work.spi_slave_controller
+  port map (
+    clk                   => clk,
+    reset_n               => reset_n,
+    transfer_in_progress  => transfer_in_progress,
+    load_tx_data_ready    => load_tx_data_ready,
+    load_tx_data          => load_tx_data,
+    tx_data               => tx_data,
+    rx_data_ready         => rx_data_ready,
+    rx_data               => rx_data,
+    spi_mosi              => spi_mosi,
+    spi_cs_n              => spi_cs_n,
+    spi_sclk              => spi_sclk,
+    spi_miso              => spi_miso);
+
+  comm_data_manager_instance : entity work.communication_data_manager
+  port map (
+    clk                   => clk,
+    reset_n               => reset_n,
+    channel_id_1          => "00001",
+    channel_id_2          => "00010",
+    channel_id_3          => "00011",
+    channel_id_4          => "00100",
+    channel_id_5          => "00101",
+    channel_id_6          => "00110",
+    channel_id_update     => open,
+    channel_power         => channel_power,
+    channel_pin_c_output  => open,
+    channel_direction_a   => open,
+    channel_direction_b   => open,
+    channel_termination   => open,
+    channel_reg_select    => channel_reg_select,
+    channel_reg_address   => channel_reg_address,
+    channel_reg_data      => channel_reg_data,
+    channel_reg_write     => channel_reg_write,
+    channel_status_1      => CHANNEL_1_STATUS,
+    channel_fifo_level_1  => fifo_level,
+    channel_fifo_data_1   => fifo_read_data,
+    channel_fifo_read     => channel_fifo_read,
+    adc_reg_select        => open,
+    adc_fifo_read         => open,
+    rx_data_ready         => rx_data_ready,
+    rx_data               => rx_data,
+    load_tx_data_ready    => load_tx_data_ready,
+    load_tx_data          => load_tx_data,
+    tx_data               => tx_data,
+    transfer_in_progress  => transfer_in_progress,
+    debug_leds            => open);
+
+  channel_fifo_instance : entity work.channel_fifo
+  port map (
+    clk           => clk,
+    reset_n       => reset_n,
+    clear         => fifo_clear,
+    write_data    => fifo_write_data,
+    write_enable  => fifo_write,
+    full          => open,
+    almost_full   => open,
+    read_data     => fifo_read_data,
+    read_enable   => channel_fifo_read(0),
+    empty         => open,
+    fill_level    => fifo_level);
+
+  clock_control : process
+  begin
+    if (done) then
+      wait;
+    end if;
+    clk <= '0';
+    wait for CLK_PERIOD/2;
+    clk <= '1';
+    wait for CLK_PERIOD/2;
+  end process clock_control;
+
+  -- ==========================================================================
+  -- Keep track of what the data manager writes to channel 1
+  -- ==========================================================================
+  register_monitor : process(clk)
+  begin
+    if rising_edge(clk) then
+      if (channel_reg_write = '1' and channel_reg_select(0) = '1') then
+        register_file(to_integer(unsigned(channel_reg_address))) <= channel_reg_data;
+        register_write_count <= register_write_count + 1;
+      end if;
+    end if;
+  end process register_monitor;
+
+  -- ==========================================================================
+  -- Time from the SPI slave handshakes to the data manager responses
+  -- ==========================================================================
+  latency_monitor : process(rx_data_ready, load_tx_data_ready, load_tx_data,
+                            channel_reg_write, channel_power)
+    variable rx_time    : time := 0 ns;
+    variable ready_time : time := 0 ns;
+  begin
+    if rising_edge(rx_data_ready) then
+      rx_time := now;
+    end if;
+    if rising_edge(load_tx_data_ready) then
+      ready_time := now;
+    end if;
+    -- The load window is open from the request byte until the TX FIFO in
+    -- the SPI slave is full, so count from whichever came last
+    if rising_edge(load_tx_data) then
+      if (ready_time > rx_time) then
+        load_latency <= (now - ready_time) / CLK_PERIOD;
+      else
+        load_latency <= (now - rx_time) / CLK_PERIOD;
+      end if;
+      request_latency <= (now - rx_time) / CLK_PERIOD;
+    end if;
+    if rising_edge(channel_reg_write) then
+      write_latency <= (now - rx_time) / CLK_PERIOD;
+    end if;
+    if channel_power'event then
+      power_latency <= (now - rx_time) / CLK_PERIOD;
+    end if;
+  end process latency_monitor;
+
+  test_control : process
+    variable errors         : integer := 0;
+    variable rate_errors    : integer := 0;
+    variable tx_bytes       : byte_array(0 to 255);
+    variable rx_bytes       : byte_array(0 to 255);
+    variable writes_before  : integer;
+    variable fastest_period : time := 0 ns;
+    variable sustained      : boolean := true;
+    variable transfer_time  : time;
+
+    -- CPOL = 1, CPHA = 1, MOSI changes on the falling edge and both sides
+    -- sample on the rising edge. There is no gap between the bytes.
+    procedure spi_transfer(count : in integer; period : in time) is
+    begin
+      spi_cs_n <= '0';
+      wait for period;
+      for i in 0 to count-1 loop
+        for b in 7 downto 0 loop
+          spi_sclk <= '0';
+          spi_mosi <= tx_bytes(i)(b);
+          wait for period/2;
+          spi_sclk <= '1';
+          rx_bytes(i)(b) := spi_miso;
+          wait for period - period/2;
+        end loop;
+      end loop;
+      wait for CS_HOLD_TIME;
+      spi_cs_n <= '1';
+      wait for CS_IDLE_TIME;
+    end procedure spi_transfer;
+
+    procedure expect(actual : in std_logic_vector(7 downto 0);
+                     expected : in std_logic_vector(7 downto 0);
+                     message : in string; period : in time) is
+    begin
+      if (actual /= expected) then
+        -- Failures are expected at the highest rates, only count them here
+        if (rate_errors = 0) then
+          report message & " failed at SCLK period " & integer'image(period / 1 ps) & " ps" &
+                 ", got " & integer'image(to_integer(unsigned(actual))) &
+                 " expected " & integer'image(to_integer(unsigned(expected))) severity note;
+        end if;
+        rate_errors := rate_errors + 1;
+      end if;
+    end procedure expect;
+
+    procedure expect_latency(latency : in integer; limit : in integer; name : in string) is
+    begin
+      report "PERF spi_throughput_tb " & name & " = " & integer'image(latency) & " clk" severity note;
+      if (latency > limit) then
+        report name & " is " & integer'image(latency) & " clk, limit is " &
+               integer'image(limit) severity error;
+        errors := errors + 1;
+      end if;
+    end procedure expect_latency;
+
+    procedure fill_fifo(count : in integer; seed : in integer) is
+    begin
+      wait until rising_edge(clk);
+      fifo_clear <= '1';
+      wait until rising_edge(clk);
+      fifo_clear <= '0';
+      for i in 0 to count-1 loop
+        fifo_write_data <= std_logic_vector(to_unsigned((i*7 + seed) mod 256, 8));
+        fifo_write <= '1';
+        wait until rising_edge(clk);
+      end loop;
+      fifo_write <= '0';
+      -- Let the show-ahead head settle
+      for i in 0 to 3 loop
+        wait until rising_edge(clk);
+      end loop;
+    end procedure fill_fifo;
+
+    -- All commands once, the seed makes every run write different values
+    procedure run_commands(period : in time; seed : in integer) is
+    begin
+      rate_errors := 0;
+
+      -- Status
+      tx_bytes(0 to 2) := (x"00", x"00", x"00");
+      spi_transfer(3, period);
+      expect(rx_bytes(2), x"01", "Status", period);
+
+      -- Enable power on channel 1 and 3, read it back and disable all
+      tx_bytes(0 to 1) := (x"10", x"45");
+      spi_transfer(2, period);
+      tx_bytes(0 to 2) := (x"10", x"00", x"00");
+      spi_transfer(3, period);
+      expect(rx_bytes(2), x"05", "Channel power", period);
+      tx_bytes(0 to 1) := (x"10", x"BF");
+      spi_transfer(2, period);
+
+      -- Channel status
+      tx_bytes(0 to 2) := (x"41", x"01", x"00");
+      spi_transfer(3, period);
+      expect(rx_bytes(2), CHANNEL_1_STATUS, "Channel status", period);
+
+      -- Register write burst to address 0x10 and up
+      writes_before := register_write_count;
+      tx_bytes(0 to 2) := (x"40", x"01", x"10");
+      for i in 0 to 3 loop
+        tx_bytes(3 + i) := std_logic_vector(to_unsigned((seed + 31*i) mod 256, 8));
+      end loop;
+      spi_transfer(7, period);
+      wait until rising_edge(clk);
+      expect(std_logic_vector(to_unsigned(register_write_count - writes_before, 8)), x"04",
+             "Register write count", period);
+      for i in 0 to 3 loop
+        expect(register_file(16#10# + i), tx_bytes(3 + i), "Register write data", period);
+      end loop;
+
+      -- FIFO level, read all of it and check that it is empty afterwards
+      fill_fifo(FIFO_READ_COUNT, seed);
+      tx_bytes(0 to 2) := (x"42", x"01", x"00");
+      spi_transfer(3, period);
+      expect(rx_bytes(2), std_logic_vector(to_unsigned(FIFO_READ_COUNT, 8)), "FIFO level", period);
+
+      tx_bytes(0 to 2) := (x"43", x"01", std_logic_vector(to_unsigned(FIFO_READ_COUNT, 8)));
+      for i in 3 to FIFO_READ_COUNT + 3 loop
+        tx_bytes(i) := x"00";
+      end loop;
+      spi_transfer(FIFO_READ_COUNT + 4, period);
+      for i in 0 to FIFO_READ_COUNT-1 loop
+        expect(rx_bytes(4 + i), std_logic_vector(to_unsigned((i*7 + seed) mod 256, 8)),
+               "FIFO data", period);
+      end loop;
+
+      tx_bytes(0 to 2) := (x"42", x"01", x"00");
+      spi_transfer(3, period);
+      expect(rx_bytes(2), x"00", "FIFO level after read", period);
+    end procedure run_commands;
+  begin
+    reset_n <= '0';
+    wait for 100 ns;
+    reset_n <= '1';
+    -- Keep the SPI edges away from the clk edges
+    wait for 102 ns;
+
+    -- ========================================================================
+    -- Sweep the SCLK rate
+    -- ========================================================================
+    for p in SCLK_PERIODS'range loop
+      run_commands(SCLK_PERIODS(p), p*13 + 1);
+      if (rate_errors = 0) then
+        report "Passed SCLK period " & integer'image(SCLK_PERIODS(p) / 1 ps) & " ps" severity note;
+        if (sustained) then
+          fastest_period := SCLK_PERIODS(p);
+        end if;
+      else
+        report "Failed SCLK period " & integer'image(SCLK_PERIODS(p) / 1 ps) & " ps" & " with " &
+               integer'image(rate_errors) & " errors" severity note;
+        sustained := false;
+      end if;
+    end loop;
+
+    if (fastest_period = 0 ns) then
+      report "No SCLK rate passed" severity error;
+      errors := errors + 1;
+    else
+      report "PERF spi_throughput_tb max_sclk = " &
+             integer'image(1 us / fastest_period) & " MHz" severity note;
+      report "PERF spi_throughput_tb max_byte_rate = " &
+             integer'image(1 sec / (8 * fastest_period)) & " bytes/s" severity note;
+      report "PERF spi_throughput_tb sclk_per_clk = " &
+             integer'image((100 * CLK_PERIOD) / fastest_period) & " %" severity note;
+      report "PERF spi_throughput_tb clk_per_byte = " &
+             integer'image((8 * fastest_period) / CLK_PERIOD) & " clk" severity note;
+      -- Payload rate of back to back FIFO reads including command and CS overhead
+      transfer_time := (8 * (FIFO_READ_COUNT + 4) + 1) * fastest_period + CS_HOLD_TIME + CS_IDLE_TIME;
+      report "PERF spi_throughput_tb fifo_read_payload_rate = " &
+             integer'image((FIFO_READ_COUNT * 1 sec) / transfer_time) & " bytes/s" severity note;
+      if (fastest_period > MAX_SCLK_PERIOD) then
+        report "Highest working SCLK period is " & integer'image(fastest_period / 1 ps) & " ps" &
+               ", limit is " & integer'image(MAX_SCLK_PERIOD / 1 ps) & " ps" severity error;
+        errors := errors + 1;
+      end if;
+    end if;
+
+    -- ========================================================================
+    -- Latency of each command at a fixed rate
+    -- ========================================================================
+    -- Get commands, the response is loaded during the byte after the request
+    tx_bytes(0 to 2) := (x"00", x"00", x"00");
+    spi_transfer(3, LATENCY_SCLK_PERIOD);
+    expect_latency(load_latency, MAX_LOAD_LATENCY, "status_load_latency");
+    report "PERF spi_throughput_tb status_request_latency = " &
+           integer'image(request_latency) & " clk" severity note;
+
+    tx_bytes(0 to 2) := (x"10", x"00", x"00");
+    spi_transfer(3, LATENCY_SCLK_PERIOD);
+    expect_latency(load_latency, MAX_LOAD_LATENCY, "power_get_load_latency");
+
+    tx_bytes(0 to 2) := (x"41", x"01", x"00");
+    spi_transfer(3, LATENCY_SCLK_PERIOD);
+    expect_latency(load_latency, MAX_LOAD_LATENCY, "channel_status_load_latency");
+
+    tx_bytes(0 to 2) := (x"42", x"01", x"00");
+    spi_transfer(3, LATENCY_SCLK_PERIOD);
+    expect_latency(load_latency, MAX_LOAD_LATENCY, "fifo_level_load_latency");
+
+    fill_fifo(4, 0);
+    tx_bytes(0 to 7) := (x"43", x"01", x"04", x"00", x"00", x"00", x"00", x"00");
+    spi_transfer(8, LATENCY_SCLK_PERIOD);
+    expect_latency(load_latency, MAX_LOAD_LATENCY, "fifo_read_load_latency");
+
+    -- Set commands
+    tx_bytes(0 to 1) := (x"10", x"41");
+    spi_transfer(2, LATENCY_SCLK_PERIOD);
+    expect_latency(power_latency, MAX_WRITE_LATENCY, "power_set_latency");
+
+    tx_bytes(0 to 3) := (x"40", x"01", x"20", x"5A");
+    spi_transfer(4, LATENCY_SCLK_PERIOD);
+    expect_latency(write_latency, MAX_WRITE_LATENCY, "register_write_latency");
+
+    -- ========================================================================
+    if (errors = 0) then
+      report "spi_throughput_tb: all tests passed" severity note;
+    else
+      report "spi_throughput_tb: " & integer'image(errors) & " errors" severity failure;
+    end if;
+    done <= true;
+    wait;
+  end process test_control;
+
+end architecture behav;
\ No newline at end of file
@@ -0,0 +1,338 @@
+-- *******************************************************************************
+-- * @file    uart_receiver_tb.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-09-18
+-- * @brief   Self checking testbench for uart_receiver and channel_fifo. Sends
+-- *          frames from 4.8 kbaud up to 3 Mbaud with all parity and stop bit
+-- *          settings and checks what ends up in the FIFO.
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+entity uart_receiver_tb is
+end uart_receiver_tb;
+
+architecture behav of uart_receiver_tb is
+  constant CLK_PERIOD   : time := 10 ns;  -- 100 MHz
+  constant CLK_FREQ     : integer := 100000000;
+
+  type baud_rate_array is array(natural range <>) of integer;
+  constant BAUD_RATES : baud_rate_array := (
+    4800, 9600, 19200, 38400, 57600, 115200, 230400,
+    460800, 921600, 1000000, 2000000, 3000000);
+
+  type byte_array is array(natural range <>) of std_logic_vector(7 downto 0);
+  constant TEST_BYTES : byte_array := (x"55", x"00", x"FF", x"A5", x"01", x"80");
+
+  signal clk          : std_logic := '0';
+  signal reset_n      : std_logic := '0';
+  signal done         : boolean := false;
+
+  signal reg_select   : std_logic := '0';
+  signal reg_address  : std_logic_vector(7 downto 0) := (others => '0');
+  signal reg_data     : std_logic_vector(7 downto 0) := (others => '0');
+  signal reg_write    : std_logic := '0';
+  signal status       : std_logic_vector(7 downto 0);
+
+  signal fifo_write_data  : std_logic_vector(7 downto 0);
+  signal fifo_write       : std_logic;
+  signal fifo_full        : std_logic;
+  signal fifo_almost_full : std_logic;
+  signal fifo_read_data   : std_logic_vector(7 downto 0);
+  signal fifo_read        : std_logic := '0';
+  signal fifo_empty       : std_logic;
+  signal fifo_level       : std_logic_vector(7 downto 0);
+
+  signal uart_rx      : std_logic := '1';
+  signal timestamp    : std_logic_vector(39 downto 0);
+begin
+  timestamp_counter_instance : entity work.timestamp_counter
+  port map (
+    clk       => clk,
+    reset_n   => reset_n,
+    timestamp => timestamp);
+
+  uart_receiver_instance : entity work.uart_receiver
+  port map (
+    clk               => clk,
+    reset_n           => reset_n,
+    reg_select        => reg_select,
+    reg_address       => reg_address,
+    reg_data          => reg_data,
+    reg_write         => reg_write,
+    status            => status,
+    fifo_data         => fifo_write_data,
+    fifo_write        => fifo_write,
+    fifo_almost_full  => fifo_almost_full,
+    timestamp         => timestamp,
+    uart_rx           => uart_rx);
+
+  channel_fifo_instance : entity work.channel_fifo
+  port map (
+    clk           => clk,
+    reset_n       => reset_n,
+    clear         => '0',
+    write_data    => fifo_write_data,
+    write_enable  => fifo_write,
+    full          => fifo_full,
+    almost_full   => fifo_almost_full,
+    read_data     => fifo_read_data,
+    read_enable   => fifo_read,
+    empty         => fifo_empty,
+    fill_level    => fifo_level);
+
+  clock_control : process
+  begin
+    if (done) then
+      wait;
+    end if;
+    clk <= '0';
+    wait for CLK_PERIOD/2;
+    clk <= '1';
+    wait for CLK_PERIOD/2;
+  end process clock_control;
+
+  test_control : process
+    variable errors : integer := 0;
+
+    procedure write_register(address : in integer; data : in std_logic_vector(7 downto 0)) is
+    begin
+      wait until rising_edge(clk);
+      reg_select  <= '1';
+      reg_address <= std_logic_vector(to_unsigned(address, 8));
+      reg_data    <= data;
+      reg_write   <= '1';
+      wait until rising_edge(clk);
+      reg_select  <= '0';
+      reg_write   <= '0';
+    end procedure write_register;
+
+    procedure configure(baud : in integer; parity : in std_logic_vector(1 downto 0); two_stop : in std_logic) is
+      variable divisor : integer;
+    begin
+      divisor := (CLK_FREQ + baud/2) / baud;
+      write_register(16#01#, std_logic_vector(to_unsigned(divisor / 256, 8)));
+      write_register(16#02#, std_logic_vector(to_unsigned(divisor mod 256, 8)));
+      -- Enable, parity, stop bits and clear status
+      write_register(16#00#, "1000" & two_stop & parity & '1');
+    end procedure configure;
+
+    procedure send_frame(baud : in integer; data : in std_logic_vector(7 downto 0);
+                         parity : in std_logic_vector(1 downto 0); two_stop : in std_logic;
+                         corrupt_parity : in boolean; corrupt_stop : in boolean) is
+      constant BIT_TIME : time := 1 sec / baud;
+      variable parity_bit : std_logic := '0';
+    begin
+      uart_rx <= '0';
+      wait for BIT_TIME;
+      for i in 0 to 7 loop
+        uart_rx <= data(i);
+        parity_bit := parity_bit xor data(i);
+        wait for BIT_TIME;
+      end loop;
+      if (parity /= "00") then
+        if (parity = "10") then
+          parity_bit := not parity_bit;
+        end if;
+        if (corrupt_parity) then
+          parity_bit := not parity_bit;
+        end if;
+        uart_rx <= parity_bit;
+        wait for BIT_TIME;
+      end if;
+      if (corrupt_stop) then
+        uart_rx <= '0';
+      else
+        uart_rx <= '1';
+      end if;
+      wait for BIT_TIME;
+      uart_rx <= '1';
+      if (two_stop = '1') then
+        wait for BIT_TIME;
+      end if;
+    end procedure send_frame;
+
+    procedure expect_byte(data : in std_logic_vector(7 downto 0); baud : in integer) is
+    begin
+      -- Give the receiver some clock cycles to hand over the byte
+      for i in 0 to 3 loop
+        wait until rising_edge(clk);
+      end loop;
+      if (fifo_empty = '1') then
+        report "Byte missing at " & integer'image(baud) & " baud" severity error;
+        errors := errors + 1;
+      elsif (fifo_read_data /= data) then
+        report "Wrong byte at " & integer'image(baud) & " baud, got " &
+               integer'image(to_integer(unsigned(fifo_read_data))) & " expected " &
+               integer'image(to_integer(unsigned(data))) severity error;
+        errors := errors + 1;
+      else
+        fifo_read <= '1';
+        wait until rising_edge(clk);
+        fifo_read <= '0';
+      end if;
+    end procedure expect_byte;
+
+    procedure expect_empty(message : in string) is
+    begin
+      for i in 0 to 3 loop
+        wait until rising_edge(clk);
+      end loop;
+      if (fifo_empty = '0') then
+        report message severity error;
+        errors := errors + 1;
+      end if;
+    end procedure expect_empty;
+
+    procedure pop_byte(data : out std_logic_vector(7 downto 0)) is
+    begin
+      for i in 0 to 3 loop
+        wait until rising_edge(clk);
+      end loop;
+      if (fifo_empty = '1') then
+        report "FIFO empty" severity error;
+        errors := errors + 1;
+      end if;
+      data := fifo_read_data;
+      fifo_read <= '1';
+      wait until rising_edge(clk);
+      fifo_read <= '0';
+    end procedure pop_byte;
+
+    variable parity : std_logic_vector(1 downto 0);
+    variable header : std_logic_vector(7 downto 0);
+    variable delta  : std_logic_vector(7 downto 0);
+  begin
+    reset_n <= '0';
+    wait for 100 ns;
+    reset_n <= '1';
+    wait for 100 ns;
+
+    -- ========================================================================
+    -- Every baud rate, parity setting and stop bit setting
+    -- ========================================================================
+    for b in BAUD_RATES'range loop
+      for p in 0 to 2 loop
+        parity := std_logic_vector(to_unsigned(p, 2));
+        for s in 0 to 1 loop
+          if (s = 0) then
+            configure(BAUD_RATES(b), parity, '0');
+          else
+            configure(BAUD_RATES(b), parity, '1');
+          end if;
+          -- Back to back frames
+          for i in TEST_BYTES'range loop
+            if (s = 0) then
+              send_frame(BAUD_RATES(b), TEST_BYTES(i), parity, '0', false, false);
+            else
+              send_frame(BAUD_RATES(b), TEST_BYTES(i), parity, '1', false, false);
+            end if;
+          end loop;
+          for i in TEST_BYTES'range loop
+            expect_byte(TEST_BYTES(i), BAUD_RATES(b));
+          end loop;
+          if (status(3 downto 0) /= "0000") then
+            report "Unexpected error flags at " & integer'image(BAUD_RATES(b)) & " baud" severity error;
+            errors := errors + 1;
+          end if;
+        end loop;
+      end loop;
+      report "Passed " & integer'image(BAUD_RATES(b)) & " baud" severity note;
+    end loop;
+
+    -- ========================================================================
+    -- Parity error, the byte should be dropped and flagged
+    -- ========================================================================
+    configure(115200, "01", '0');
+    send_frame(115200, x"3C", "01", '0', true, false);
+    expect_empty("Byte with parity error was not dropped");
+    if (status(1) /= '1') then
+      report "Parity error not flagged" severity error;
+      errors := errors + 1;
+    end if;
+
+    -- ========================================================================
+    -- Framing error
+    -- ========================================================================
+    configure(115200, "00", '0');
+    send_frame(115200, x"C3", "00", '0', false, true);
+    wait for 20 us;
+    expect_empty("Byte with framing error was not dropped");
+    if (status(0) /= '1') then
+      report "Framing error not flagged" severity error;
+      errors := errors + 1;
+    end if;
+
+    -- ========================================================================
+    -- Break, the line is held low for longer than a frame
+    -- ========================================================================
+    configure(115200, "00", '0');
+    uart_rx <= '0';
+    wait for 200 us;
+    uart_rx <= '1';
+    wait for 20 us;
+    expect_empty("Break was written to the FIFO");
+    if (status(2) /= '1') then
+      report "Break not detected" severity error;
+      errors := errors + 1;
+    end if;
+
+    -- The receiver should recover after the break
+    send_frame(115200, x"42", "00", '0', false, false);
+    expect_byte(x"42", 115200);
+
+    -- ========================================================================
+    -- Timestamps, a full timestamp first and then the delta to the next byte
+    -- ========================================================================
+    write_register(16#00#, x"91");
+    send_frame(1000000, x"11", "00", '0', false, false);
+    send_frame(1000000, x"22", "00", '0', false, false);
+    pop_byte(header);
+    if (header /= x"C0") then
+      report "Expected a full timestamp" severity error;
+      errors := errors + 1;
+    end if;
+    for i in 1 to 5 loop
+      pop_byte(delta);
+    end loop;
+    expect_byte(x"11", 1000000);
+    -- Two back to back frames at 1 Mbaud are 10 us, or 1000 ticks, apart
+    pop_byte(header);
+    pop_byte(delta);
+    if (header(7 downto 6) /= "01" or
+        unsigned(header(5 downto 0) & delta) < 990 or
+        unsigned(header(5 downto 0) & delta) > 1010) then
+      report "Wrong timestamp delta" severity error;
+      errors := errors + 1;
+    end if;
+    expect_byte(x"22", 1000000);
+
+    -- ========================================================================
+    if (errors = 0) then
+      report "uart_receiver_tb: all tests passed" severity note;
+    else
+      report "uart_receiver_tb: " & integer'image(errors) & " errors" severity failure;
+    end if;
+    done <= true;
+    wait;
+  end process test_control;
+
+end architecture behav;
\ No newline at end of file
@@ -0,0 +1,419 @@
+-- *******************************************************************************
+-- * @file    uart_replay_tb.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-10-10
+-- * @brief   Self checking testbench for uart_replay. Record streams in the
+-- *          uart_receiver format are fed through the register interface
+-- *          with the same flow control as the UI processor, the TX line is
+-- *          decoded and every start bit is compared against the recorded
+-- *          time scaled by the speed factor. Measures the timing error and
+-- *          the throughput with back-to-back frames.
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+entity uart_replay_tb is
+end uart_replay_tb;
+
+architecture behav of uart_replay_tb is
+  constant CLK_PERIOD         : time := 10 ns;  -- 100 MHz, one timestamp tick per cycle
+  constant TIMING_DIVISOR     : integer := 100; -- 1 Mbaud for the timing tests
+  constant THROUGHPUT_DIVISOR : integer := 10;  -- 10 Mbaud for the throughput test
+  constant THROUGHPUT_RECORDS : integer := 2000;
+
+  -- Regression limits, a start bit may come one cycle late when the scaled
+  -- time is not a whole number of cycles
+  constant MAX_JITTER_CLK     : integer := 1;
+  constant MIN_THROUGHPUT_PERCENT : integer := 99;
+
+  type byte_array is array(natural range <>) of std_logic_vector(7 downto 0);
+  type integer_array is array(natural range <>) of integer;
+
+  signal clk          : std_logic := '0';
+  signal reset_n      : std_logic := '0';
+  signal done         : boolean := false;
+
+  signal reg_select   : std_logic := '0';
+  signal reg_address  : std_logic_vector(7 downto 0) := (others => '0');
+  signal reg_data     : std_logic_vector(7 downto 0) := (others => '0');
+  signal reg_write    : std_logic := '0';
+  signal status       : std_logic_vector(7 downto 0);
+  signal uart_tx      : std_logic;
+
+  -- Record stream for the feeder, the register interface is driven by the
+  -- test process while configuring and by the feeder while feeding
+  signal stream       : byte_array(0 to 8191);
+  signal stream_length  : integer := 0;
+  signal feed_start   : boolean := false;
+  signal feed_done    : boolean := true;
+  signal feeder_select  : std_logic := '0';
+  signal feeder_address : std_logic_vector(7 downto 0) := (others => '0');
+  signal feeder_data    : std_logic_vector(7 downto 0) := (others => '0');
+  signal feeder_write   : std_logic := '0';
+  signal test_select    : std_logic := '0';
+  signal test_address   : std_logic_vector(7 downto 0) := (others => '0');
+  signal test_data      : std_logic_vector(7 downto 0) := (others => '0');
+  signal test_write     : std_logic := '0';
+begin
+  uart_replay_instance : entity work.uart_replay
+  port map (
+    clk         => clk,
+    reset_n     => reset_n,
+    reg_select  => reg_select,
+    reg_address => reg_address,
+    reg_data    => reg_data,
+    reg_write   => reg_write,
+    status      => status,
+    uart_tx     => uart_tx);
+
+  reg_select  <= feeder_select  when not feed_done else test_select;
+  reg_address <= feeder_address when not feed_done else test_address;
+  reg_data    <= feeder_data    when not feed_done else test_data;
+  reg_write   <= feeder_write   when not feed_done else test_write;
+
+  clock_control : process
+  begin
+    if (done) then
+      wait;
+    end if;
+    clk <= '0';
+    wait for CLK_PERIOD/2;
+    clk <= '1';
+    wait for CLK_PERIOD/2;
+  end process clock_control;
+
+  -- ==========================================================================
+  -- Feeder, writes the stream 128 bytes at a time when there is room, like
+  -- a register write transfer from the UI processor
+  -- ==========================================================================
+  feeder : process
+    variable index : integer;
+  begin
+    feed_done <= true;
+    wait until feed_start;
+    feed_done <= false;
+    index := 0;
+    while (index < stream_length) loop
+      wait until rising_edge(clk);
+      if (status(6) = '1') then
+        for i in 0 to 127 loop
+          if (index < stream_length) then
+            feeder_select  <= '1';
+            feeder_address <= std_logic_vector(to_unsigned(16#80# + i, 8));
+            feeder_data    <= stream(index);
+            feeder_write   <= '1';
+            wait until rising_edge(clk);
+            feeder_write   <= '0';
+            wait until rising_edge(clk);
+            index := index + 1;
+          end if;
+        end loop;
+        feeder_select <= '0';
+        -- Let the status catch up with the last write
+        for i in 0 to 3 loop
+          wait until rising_edge(clk);
+        end loop;
+      end if;
+    end loop;
+  end process feeder;
+
+  test_control : process
+    variable errors       : integer := 0;
+    variable bytes        : byte_array(0 to 8191);
+    variable length       : integer;
+    variable capture_time : unsigned(39 downto 0);
+    variable records      : integer;
+    variable offsets      : integer_array(0 to 4095);
+    variable values       : byte_array(0 to 4095);
+    variable first_start  : time;
+    variable last_start   : time;
+    variable expected     : time;
+    variable jitter       : integer;
+    variable max_jitter   : integer := 0;
+    variable received     : std_logic_vector(7 downto 0);
+    variable timed_out    : boolean;
+    variable throughput   : integer;
+    variable cycles       : integer;
+
+    procedure write_register(address : in integer; data : in std_logic_vector(7 downto 0)) is
+    begin
+      wait until rising_edge(clk);
+      test_select  <= '1';
+      test_address <= std_logic_vector(to_unsigned(address, 8));
+      test_data    <= data;
+      test_write   <= '1';
+      wait until rising_edge(clk);
+      test_select  <= '0';
+      test_write   <= '0';
+    end procedure write_register;
+
+    procedure configure(divisor : in integer; speed : in integer) is
+    begin
+      write_register(16#20#, x"00");
+      write_register(16#21#, std_logic_vector(to_unsigned(divisor / 256, 8)));
+      write_register(16#22#, std_logic_vector(to_unsigned(divisor mod 256, 8)));
+      write_register(16#23#, std_logic_vector(to_unsigned(speed / 256, 8)));
+      write_register(16#24#, std_logic_vector(to_unsigned(speed mod 256, 8)));
+      write_register(16#20#, x"81");
+    end procedure configure;
+
+    procedure new_stream(start_time : in integer) is
+    begin
+      length := 0;
+      records := 0;
+      capture_time := to_unsigned(start_time, 40);
+    end procedure new_stream;
+
+    procedure add_byte(data : in std_logic_vector(7 downto 0)) is
+    begin
+      bytes(length) := data;
+      length := length + 1;
+    end procedure add_byte;
+
+    -- Same header format as timestamp_encoder, with a full timestamp for
+    -- the first record and every 256th record
+    procedure add_record(delta : in integer; data : in std_logic_vector(7 downto 0)) is
+      variable value : unsigned(39 downto 0);
+    begin
+      capture_time := capture_time + to_unsigned(delta, 40);
+      value := to_unsigned(delta, 40);
+      if (records mod 256 = 0 or delta >= 4194304) then
+        add_byte(x"C0");
+        for i in 4 downto 0 loop
+          add_byte(std_logic_vector(capture_time(i*8+7 downto i*8)));
+        end loop;
+      elsif (delta < 64) then
+        add_byte("00" & std_logic_vector(value(5 downto 0)));
+      elsif (delta < 16384) then
+        add_byte("01" & std_logic_vector(value(13 downto 8)));
+        add_byte(std_logic_vector(value(7 downto 0)));
+      else
+        add_byte("10" & std_logic_vector(value(21 downto 16)));
+        add_byte(std_logic_vector(value(15 downto 8)));
+        add_byte(std_logic_vector(value(7 downto 0)));
+      end if;
+      add_byte(data);
+      if (records = 0) then
+        offsets(0) := 0;
+      else
+        offsets(records) := offsets(records-1) + delta;
+      end if;
+      values(records) := data;
+      records := records + 1;
+    end procedure add_record;
+
+    procedure start_feed is
+    begin
+      stream(0 to length-1) <= bytes(0 to length-1);
+      stream_length <= length;
+      feed_start <= true;
+      wait until not feed_done;
+      feed_start <= false;
+    end procedure start_feed;
+
+    -- Decode one 8N1 frame, start_time is the falling edge of the start bit
+    procedure receive_byte(divisor : in integer; data : out std_logic_vector(7 downto 0);
+                           start_time : out time; timeout : out boolean) is
+    begin
+      wait until falling_edge(uart_tx) for 100 ms;
+      timeout := (uart_tx /= '0');
+      start_time := now;
+      wait for (divisor * CLK_PERIOD) / 2;
+      for i in 0 to 7 loop
+        wait for divisor * CLK_PERIOD;
+        data(i) := uart_tx;
+      end loop;
+      wait for divisor * CLK_PERIOD;
+      if (uart_tx /= '1') then
+        report "Missing stop bit" severity error;
+        errors := errors + 1;
+      end if;
+    end procedure receive_byte;
+
+    -- Receive all records and compare every start bit with the recorded
+    -- time scaled by the speed factor, relative to the first start bit
+    procedure check_timing(name : in string; divisor : in integer; speed : in integer) is
+    begin
+      for i in 0 to records-1 loop
+        receive_byte(divisor, received, last_start, timed_out);
+        if (timed_out) then
+          report name & ": record " & integer'image(i) & " not sent" severity error;
+          errors := errors + 1;
+          exit;
+        end if;
+        if (i = 0) then
+          first_start := last_start;
+        end if;
+        if (received /= values(i)) then
+          report name & ": wrong byte in record " & integer'image(i) severity error;
+          errors := errors + 1;
+        end if;
+        -- Offsets are in ticks, one tick per clk cycle
+        expected := first_start + ((offsets(i) * 256 + speed - 1) / speed) * CLK_PERIOD;
+        if (last_start >= expected) then
+          jitter := (last_start - expected) / CLK_PERIOD;
+        else
+          jitter := (expected - last_start) / CLK_PERIOD;
+        end if;
+        if (jitter > max_jitter) then
+          max_jitter := jitter;
+        end if;
+        if (jitter > MAX_JITTER_CLK) then
+          report name & ": record " & integer'image(i) & " is off by " &
+                 integer'image(jitter) & " clk" severity error;
+          errors := errors + 1;
+        end if;
+      end loop;
+    end procedure check_timing;
+  begin
+    reset_n <= '0';
+    wait for 100 ns;
+    reset_n <= '1';
+    wait for 100 ns;
+
+    -- ========================================================================
+    -- Original speed with every header size, including a delta that needs
+    -- a full timestamp
+    -- ========================================================================
+    configure(TIMING_DIVISOR, 16#0100#);
+    new_stream(123456789);
+    add_record(0, x"55");
+    add_record(1000, x"01");
+    add_record(1500, x"02");
+    add_record(16383, x"03");
+    add_record(16384, x"04");
+    add_record(250000, x"05");
+    add_record(1001, x"06");
+    add_record(5000000, x"07");
+    add_record(1234, x"08");
+    for i in 9 to 299 loop
+      add_record(1000 + (i mod 7) * 333, std_logic_vector(to_unsigned(i, 8)));
+    end loop;
+    start_feed;
+    check_timing("original speed", TIMING_DIVISOR, 16#0100#);
+    if (status(0) = '1' or status(3) = '1') then
+      report "original speed: late or overrun flag set" severity error;
+      errors := errors + 1;
+    end if;
+
+    -- ========================================================================
+    -- Twice as fast, half the speed and 1.5 times faster
+    -- ========================================================================
+    configure(TIMING_DIVISOR, 16#0200#);
+    new_stream(0);
+    for i in 0 to 99 loop
+      add_record(2200 + (i mod 5) * 1000, std_logic_vector(to_unsigned(255 - i, 8)));
+    end loop;
+    start_feed;
+    check_timing("double speed", TIMING_DIVISOR, 16#0200#);
+
+    configure(TIMING_DIVISOR, 16#0080#);
+    new_stream(1000);
+    for i in 0 to 49 loop
+      add_record(1000 + (i mod 3) * 777, std_logic_vector(to_unsigned(i * 3, 8)));
+    end loop;
+    start_feed;
+    check_timing("half speed", TIMING_DIVISOR, 16#0080#);
+
+    configure(TIMING_DIVISOR, 16#0180#);
+    new_stream(77);
+    for i in 0 to 99 loop
+      add_record(1600 + (i mod 11) * 101, std_logic_vector(to_unsigned(i + 7, 8)));
+    end loop;
+    start_feed;
+    check_timing("1.5 times speed", TIMING_DIVISOR, 16#0180#);
+    if (status(0) = '1') then
+      report "Late flag set when the frames fit" severity error;
+      errors := errors + 1;
+    end if;
+
+    report "PERF uart_replay_tb max_jitter = " &
+           integer'image(max_jitter * CLK_PERIOD / 1 ns) & " ns" severity note;
+
+    -- ========================================================================
+    -- Records closer than a frame are sent back-to-back and flagged as late
+    -- ========================================================================
+    configure(TIMING_DIVISOR, 16#0100#);
+    new_stream(0);
+    for i in 0 to 19 loop
+      add_record(10, std_logic_vector(to_unsigned(i + 100, 8)));
+    end loop;
+    start_feed;
+    for i in 0 to 19 loop
+      receive_byte(TIMING_DIVISOR, received, last_start, timed_out);
+      if (timed_out or received /= values(i)) then
+        report "Late record " & integer'image(i) & " missing or wrong" severity error;
+        errors := errors + 1;
+        exit;
+      end if;
+      if (i = 0) then
+        first_start := last_start;
+      end if;
+    end loop;
+    if ((last_start - first_start) / CLK_PERIOD /= 19 * 10 * TIMING_DIVISOR) then
+      report "Late records are not sent back-to-back" severity error;
+      errors := errors + 1;
+    end if;
+    if (status(0) /= '1') then
+      report "Late flag not set" severity error;
+      errors := errors + 1;
+    end if;
+
+    -- ========================================================================
+    -- Throughput, records spaced exactly one frame apart at 10 Mbaud
+    -- ========================================================================
+    configure(THROUGHPUT_DIVISOR, 16#0100#);
+    new_stream(0);
+    for i in 0 to THROUGHPUT_RECORDS-1 loop
+      add_record(10 * THROUGHPUT_DIVISOR, std_logic_vector(to_unsigned(i mod 256, 8)));
+    end loop;
+    start_feed;
+    check_timing("throughput", THROUGHPUT_DIVISOR, 16#0100#);
+    if (status(0) = '1' or status(3) = '1') then
+      report "throughput: late or overrun flag set" severity error;
+      errors := errors + 1;
+    end if;
+
+    -- Bytes per second including the last frame
+    cycles := (last_start - first_start) / CLK_PERIOD + 10 * THROUGHPUT_DIVISOR;
+    throughput := integer(real(THROUGHPUT_RECORDS) * real(1 sec / CLK_PERIOD) / real(cycles));
+    report "PERF uart_replay_tb throughput = " & integer'image(throughput) & " bytes/s" severity note;
+    report "PERF uart_replay_tb line_rate = " &
+           integer'image((1 sec / CLK_PERIOD) / (10 * THROUGHPUT_DIVISOR)) & " bytes/s" severity note;
+    if (throughput * 100 < MIN_THROUGHPUT_PERCENT * ((1 sec / CLK_PERIOD) / (10 * THROUGHPUT_DIVISOR))) then
+      report "Throughput is " & integer'image(throughput) & " bytes/s, limit is " &
+             integer'image(MIN_THROUGHPUT_PERCENT) & " % of the line rate" severity error;
+      errors := errors + 1;
+    end if;
+
+    write_register(16#20#, x"80");
+
+    -- ========================================================================
+    if (errors = 0) then
+      report "uart_replay_tb: all tests passed" severity note;
+    else
+      report "uart_replay_tb: " & integer'image(errors) & " errors" severity failure;
+    end if;
+    done <= true;
+    wait;
+  end process test_control;
+
+end architecture behav;
\ No newline at end of file
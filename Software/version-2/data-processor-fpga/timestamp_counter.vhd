@@ -0,0 +1,55 @@
+-- *******************************************************************************
+-- * @file    timestamp_counter.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-10-02
+-- * @brief   Free running timestamp counter shared by all channel decoders.
+-- *          One tick per clk cycle, 10 ns at 100 MHz, and 40 bits wraps
+-- *          after a little more than three hours.
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Entity
+entity timestamp_counter is
+  port(
+    clk       : in  std_logic;
+    reset_n   : in  std_logic;
+    timestamp : out std_logic_vector(39 downto 0));
+end timestamp_counter;
+
+architecture behav of timestamp_counter is
+  signal counter : unsigned(39 downto 0);
+begin
+  process(clk, reset_n)
+  begin
+    -- Asynchronous reset
+    if (reset_n = '0') then
+      counter <= (others => '0');
+
+    -- Synchronous part
+    elsif rising_edge(clk) then
+      counter <= counter + 1;
+    end if;
+  end process;
+
+  timestamp <= std_logic_vector(counter);
+
+end architecture behav;
\ No newline at end of file
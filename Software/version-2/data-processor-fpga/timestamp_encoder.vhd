@@ -0,0 +1,105 @@
+-- *******************************************************************************
+-- * @file    timestamp_encoder.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-10-02
+-- * @brief   Builds the timestamp header that is written in front of every
+-- *          record in a channel FIFO. The timestamp is encoded as the delta
+-- *          to the previous record:
+-- *            00dddddd                    delta < 64 ticks
+-- *            01dddddd dddddddd           delta < 16384 ticks
+-- *            10dddddd dddddddd dddddddd  delta < 4194304 ticks
+-- *            11000000 + 5 bytes          full 40-bit timestamp
+-- *          A full timestamp is used for the first record, when the delta
+-- *          is too large and for every 256th record so that a reader can
+-- *          resynchronize in the middle of a stream.
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Entity
+entity timestamp_encoder is
+  port(
+    clk           : in  std_logic;
+    reset_n       : in  std_logic;
+
+    -- Timestamp of the record to encode, must be stable until commit
+    timestamp     : in  std_logic_vector(39 downto 0);
+    -- Use a full timestamp for the next record
+    force_full    : in  std_logic;
+    -- The header has been written to the FIFO
+    commit        : in  std_logic;
+
+    -- Header bytes, the first byte in bits 47..40
+    header_data   : out std_logic_vector(47 downto 0);
+    header_length : out integer range 1 to 6);
+end timestamp_encoder;
+
+architecture behav of timestamp_encoder is
+  signal previous_timestamp : unsigned(39 downto 0);
+  signal records_since_full : unsigned(7 downto 0);
+  signal full_pending       : std_logic;
+  signal delta              : unsigned(39 downto 0);
+  signal use_full           : std_logic;
+begin
+  delta <= unsigned(timestamp) - previous_timestamp;
+
+  use_full <= '1' when (full_pending = '1' or records_since_full = 255 or
+                        delta(39 downto 22) /= 0) else '0';
+
+  header_data <=
+    "11000000" & timestamp                                    when use_full = '1' else
+    "00" & std_logic_vector(delta(5 downto 0)) & x"0000000000" when delta(21 downto 6) = 0 else
+    "01" & std_logic_vector(delta(13 downto 0)) & x"00000000"  when delta(21 downto 14) = 0 else
+    "10" & std_logic_vector(delta(21 downto 0)) & x"000000";
+
+  header_length <=
+    6 when use_full = '1' else
+    1 when delta(21 downto 6) = 0 else
+    2 when delta(21 downto 14) = 0 else
+    3;
+
+  process(clk, reset_n)
+  begin
+    -- Asynchronous reset
+    if (reset_n = '0') then
+      previous_timestamp <= (others => '0');
+      records_since_full <= (others => '0');
+      full_pending       <= '1';
+
+    -- Synchronous part
+    elsif rising_edge(clk) then
+      if (commit = '1') then
+        previous_timestamp <= unsigned(timestamp);
+        if (use_full = '1') then
+          records_since_full <= (others => '0');
+          full_pending <= '0';
+        else
+          records_since_full <= records_since_full + 1;
+        end if;
+      end if;
+      -- A forced full timestamp is kept until it has been written
+      if (force_full = '1') then
+        full_pending <= '1';
+      end if;
+    end if; -- if (reset_n = '0')
+  end process;
+
+end architecture behav;
\ No newline at end of file
@@ -0,0 +1,338 @@
+-- *******************************************************************************
+-- * @file    uart_receiver.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-09-18
+-- * @brief   UART frame decoder for one channel. Baud rate, parity and number
+-- *          of stop bits are set at runtime through the channel register
+-- *          interface. Only correctly received bytes are written to the
+-- *          channel FIFO, errors are flagged in the status register. With
+-- *          timestamps enabled every byte gets a timestamp header, see
+-- *          timestamp_encoder.vhd, with the time of the start bit.
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Entity
+entity uart_receiver is
+  generic(
+    DEFAULT_BAUD_DIVISOR : integer := 868);  -- clk cycles per bit, 100 MHz / 115200
+  port(
+    clk       : in  std_logic;
+    reset_n   : in  std_logic;
+
+    -- Channel register interface
+    reg_select  : in  std_logic;
+    reg_address : in  std_logic_vector(7 downto 0);
+    reg_data    : in  std_logic_vector(7 downto 0);
+    reg_write   : in  std_logic;
+    status      : out std_logic_vector(7 downto 0);
+
+    -- Channel FIFO interface
+    fifo_data         : out std_logic_vector(7 downto 0);
+    fifo_write        : out std_logic;
+    fifo_almost_full  : in  std_logic;
+
+    -- Shared timestamp counter
+    timestamp   : in  std_logic_vector(39 downto 0) := (others => '0');
+
+    -- External hardware interface
+    uart_rx     : in  std_logic);
+end uart_receiver;
+
+architecture behav of uart_receiver is
+  -- Register map
+  constant CONTROL_REGISTER       : std_logic_vector(7 downto 0) := x"00";
+  constant BAUD_DIVISOR_HIGH      : std_logic_vector(7 downto 0) := x"01";
+  constant BAUD_DIVISOR_LOW       : std_logic_vector(7 downto 0) := x"02";
+
+  -- Control register bits
+  constant CONTROL_ENABLE_BIT     : integer := 0;
+  constant CONTROL_STOP_BITS_BIT  : integer := 3;  -- 0 = 1 stop bit, 1 = 2 stop bits
+  constant CONTROL_TIMESTAMP_BIT  : integer := 4;  -- Write a timestamp before every byte
+  constant CONTROL_CLEAR_BIT      : integer := 7;  -- Write 1 to clear the status flags
+
+  constant PARITY_NONE : std_logic_vector(1 downto 0) := "00";
+  constant PARITY_EVEN : std_logic_vector(1 downto 0) := "01";
+  constant PARITY_ODD  : std_logic_vector(1 downto 0) := "10";
+
+  -- Configuration
+  signal enabled              : std_logic;
+  signal parity_mode          : std_logic_vector(1 downto 0);
+  signal two_stop_bits        : std_logic;
+  signal timestamps_enabled   : std_logic;
+  signal baud_divisor         : unsigned(15 downto 0);
+  signal baud_divisor_high    : std_logic_vector(7 downto 0);
+
+  -- Status flags, sticky until cleared
+  signal framing_error        : std_logic;
+  signal parity_error         : std_logic;
+  signal break_detected       : std_logic;
+  signal overrun_error        : std_logic;
+
+  -- Receiver
+  type state_type is (IDLE, START_BIT, DATA_BITS, PARITY_BIT, STOP_BIT_1, STOP_BIT_2, WAIT_FOR_IDLE);
+  signal current_state        : state_type;
+  signal rx_sync              : std_logic_vector(4 downto 0);
+  signal rx_sample            : std_logic;
+  signal bit_timer            : unsigned(15 downto 0);
+  signal bit_count            : integer range 0 to 7;
+  signal shift_register       : std_logic_vector(7 downto 0);
+  signal parity_calculated    : std_logic;
+  signal parity_ok            : std_logic;
+  signal start_timestamp      : std_logic_vector(39 downto 0);
+
+  -- Record writer
+  signal record_active        : std_logic;
+  signal record_index         : integer range 0 to 6;
+  signal record_byte          : std_logic_vector(7 downto 0);
+  signal record_timestamp     : std_logic_vector(39 downto 0);
+  signal header_data          : std_logic_vector(47 downto 0);
+  signal header_length        : integer range 1 to 6;
+  signal header_commit        : std_logic;
+  signal header_force_full    : std_logic;
+begin
+  timestamp_encoder_instance : entity work.timestamp_encoder
+  port map (
+    clk           => clk,
+    reset_n       => reset_n,
+    timestamp     => record_timestamp,
+    force_full    => header_force_full,
+    commit        => header_commit,
+    header_data   => header_data,
+    header_length => header_length);
+
+  -- Majority vote of the last three synchronized samples to reject glitches
+  rx_sample <= (rx_sync(2) and rx_sync(3)) or
+               (rx_sync(2) and rx_sync(4)) or
+               (rx_sync(3) and rx_sync(4));
+
+  process(clk, reset_n)
+    variable frame_valid : boolean;
+  begin
+    -- Asynchronous reset
+    if (reset_n = '0') then
+      enabled           <= '0';
+      parity_mode       <= PARITY_NONE;
+      two_stop_bits     <= '0';
+      timestamps_enabled <= '0';
+      baud_divisor      <= to_unsigned(DEFAULT_BAUD_DIVISOR, 16);
+      baud_divisor_high <= (others => '0');
+
+      framing_error     <= '0';
+      parity_error      <= '0';
+      break_detected    <= '0';
+      overrun_error     <= '0';
+
+      fifo_data         <= (others => '0');
+      fifo_write        <= '0';
+
+      current_state     <= IDLE;
+      rx_sync           <= (others => '1');
+      bit_timer         <= (others => '0');
+      bit_count         <= 0;
+      shift_register    <= (others => '0');
+      parity_calculated <= '0';
+      parity_ok         <= '1';
+      start_timestamp   <= (others => '0');
+
+      record_active     <= '0';
+      record_index      <= 0;
+      record_byte       <= (others => '0');
+      record_timestamp  <= (others => '0');
+      header_commit     <= '0';
+      header_force_full <= '0';
+
+    -- Synchronous part
+    elsif rising_edge(clk) then
+      fifo_write <= '0';
+      header_commit <= '0';
+      header_force_full <= '0';
+      frame_valid := false;
+
+      -- Synchronize the input and keep a short history for the majority vote
+      rx_sync <= rx_sync(3 downto 0) & uart_rx;
+
+      -- ======================================================================
+      -- Register writes
+      -- ======================================================================
+      if (reg_select = '1' and reg_write = '1') then
+        if (reg_address = CONTROL_REGISTER) then
+          enabled       <= reg_data(CONTROL_ENABLE_BIT);
+          parity_mode   <= reg_data(2 downto 1);
+          two_stop_bits <= reg_data(CONTROL_STOP_BITS_BIT);
+          timestamps_enabled <= reg_data(CONTROL_TIMESTAMP_BIT);
+          -- Start over with a full timestamp
+          header_force_full <= '1';
+          if (reg_data(CONTROL_CLEAR_BIT) = '1') then
+            framing_error  <= '0';
+            parity_error   <= '0';
+            break_detected <= '0';
+            overrun_error  <= '0';
+          end if;
+        elsif (reg_address = BAUD_DIVISOR_HIGH) then
+          baud_divisor_high <= reg_data;
+        -- The divisor is updated when the low byte is written
+        elsif (reg_address = BAUD_DIVISOR_LOW) then
+          baud_divisor <= unsigned(baud_divisor_high & reg_data);
+        end if;
+      end if;
+
+      -- ======================================================================
+      -- Receiver state machine
+      -- ======================================================================
+      if (enabled = '0') then
+        current_state <= IDLE;
+      elsif (current_state /= IDLE and bit_timer /= 0) then
+        bit_timer <= bit_timer - 1;
+      else
+        case current_state is
+          -- Wait for the falling edge of the start bit ----------------------
+          when IDLE =>
+            if (rx_sample = '0') then
+              -- Sample in the middle of the start bit
+              bit_timer <= '0' & baud_divisor(15 downto 1);
+              start_timestamp <= timestamp;
+              current_state <= START_BIT;
+            end if;
+
+          -- Make sure it was not a glitch -----------------------------------
+          when START_BIT =>
+            if (rx_sample = '0') then
+              bit_timer <= baud_divisor - 1;
+              bit_count <= 0;
+              parity_calculated <= '0';
+              parity_ok <= '1';
+              current_state <= DATA_BITS;
+            else
+              current_state <= IDLE;
+            end if;
+
+          -- Data bits, LSB first --------------------------------------------
+          when DATA_BITS =>
+            bit_timer <= baud_divisor - 1;
+            shift_register <= rx_sample & shift_register(7 downto 1);
+            parity_calculated <= parity_calculated xor rx_sample;
+            if (bit_count = 7) then
+              if (parity_mode = PARITY_NONE) then
+                current_state <= STOP_BIT_1;
+              else
+                current_state <= PARITY_BIT;
+              end if;
+            else
+              bit_count <= bit_count + 1;
+            end if;
+
+          -- Parity bit ------------------------------------------------------
+          when PARITY_BIT =>
+            bit_timer <= baud_divisor - 1;
+            if ((parity_mode = PARITY_EVEN and (parity_calculated xor rx_sample) /= '0') or
+                (parity_mode = PARITY_ODD and (parity_calculated xor rx_sample) /= '1')) then
+              parity_ok <= '0';
+            end if;
+            current_state <= STOP_BIT_1;
+
+          -- First stop bit, the frame is done after this unless two are used -
+          when STOP_BIT_1 =>
+            if (rx_sample = '0') then
+              -- All zeros including the stop bit is a break condition
+              if (shift_register = x"00") then
+                break_detected <= '1';
+              else
+                framing_error <= '1';
+              end if;
+              current_state <= WAIT_FOR_IDLE;
+            elsif (two_stop_bits = '1') then
+              bit_timer <= baud_divisor - 1;
+              current_state <= STOP_BIT_2;
+            elsif (parity_ok = '0') then
+              parity_error <= '1';
+              current_state <= IDLE;
+            else
+              frame_valid := true;
+              current_state <= IDLE;
+            end if;
+
+          -- Second stop bit -------------------------------------------------
+          when STOP_BIT_2 =>
+            if (rx_sample = '0') then
+              framing_error <= '1';
+              current_state <= WAIT_FOR_IDLE;
+            elsif (parity_ok = '0') then
+              parity_error <= '1';
+              current_state <= IDLE;
+            else
+              frame_valid := true;
+              current_state <= IDLE;
+            end if;
+
+          -- After an error the line has to go idle before a new start bit ---
+          when WAIT_FOR_IDLE =>
+            if (rx_sample = '1') then
+              current_state <= IDLE;
+            end if;
+
+          when others =>
+            current_state <= IDLE;
+        end case; -- current_state
+      end if; -- (enabled = '0')
+
+      -- ======================================================================
+      -- Hand valid bytes over to the FIFO
+      -- ======================================================================
+      if (frame_valid) then
+        if (fifo_almost_full = '1') then
+          overrun_error <= '1';
+        elsif (timestamps_enabled = '1') then
+          -- Timestamp header first, the byte is written last
+          record_byte <= shift_register;
+          record_timestamp <= start_timestamp;
+          record_index <= 0;
+          record_active <= '1';
+        else
+          fifo_data <= shift_register;
+          fifo_write <= '1';
+        end if;
+      elsif (record_active = '1') then
+        -- The record is written long before the next byte can be received
+        if (record_index = header_length) then
+          fifo_data <= record_byte;
+          header_commit <= '1';
+          record_active <= '0';
+        else
+          fifo_data <= header_data(47 - record_index*8 downto 40 - record_index*8);
+          record_index <= record_index + 1;
+        end if;
+        fifo_write <= '1';
+      end if;
+    end if; -- if (reset_n = '0')
+  end process;
+
+  -- Status register
+  status(0) <= framing_error;
+  status(1) <= parity_error;
+  status(2) <= break_detected;
+  status(3) <= overrun_error;
+  status(4) <= enabled;
+  status(5) <= '0' when current_state = IDLE else '1';
+  status(6) <= timestamps_enabled;
+  status(7) <= '0';
+
+end architecture behav;
\ No newline at end of file
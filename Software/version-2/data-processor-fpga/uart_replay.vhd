@@ -0,0 +1,358 @@
+-- *******************************************************************************
+-- * @file    uart_replay.vhd
+-- * @author  Hampus Sandberg
+-- * @version 0.1
+-- * @date    2016-10-10
+-- * @brief   Replays a stored UART capture on a channel's TX pin with the
+-- *          original timing. The UI processor writes the records exactly as
+-- *          uart_receiver put them in the channel FIFO, a timestamp header,
+-- *          see timestamp_encoder.vhd, followed by the byte. Each byte is
+-- *          sent when a replay clock reaches the record's time relative to
+-- *          the first record. The replay clock advances by the speed factor
+-- *          every clk cycle, 8.8 fixed point so 0x0100 is the original
+-- *          speed, 0x0200 twice as fast and 0x0080 half the speed. Records
+-- *          are decoded ahead so a byte starts on the clk cycle it is due
+-- *          unless the previous byte is still being sent, which is flagged
+-- *          as late in the status register.
+-- *******************************************************************************
+--  Copyright (c) 2016 Hampus Sandberg.
+--
+--  This program is free software: you can redistribute it and/or modify
+--  it under the terms of the GNU General Public License as published by
+--  the Free Software Foundation, either version 3 of the License, or
+--  any later version.
+--
+--  This program is distributed in the hope that it will be useful,
+--  but WITHOUT ANY WARRANTY; without even the implied warranty of
+--  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+--  GNU General Public License for more details.
+--
+--  You should have received a copy of the GNU General Public License
+--  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+-- *******************************************************************************
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+-- Entity
+entity uart_replay is
+  generic(
+    DEFAULT_BAUD_DIVISOR  : integer := 868;   -- clk cycles per bit, 100 MHz / 115200
+    BUFFER_ADDRESS_WIDTH  : integer := 10);   -- 2^BUFFER_ADDRESS_WIDTH bytes of records
+  port(
+    clk       : in  std_logic;
+    reset_n   : in  std_logic;
+
+    -- Channel register interface, shared with the receiver on the channel
+    reg_select  : in  std_logic;
+    reg_address : in  std_logic_vector(7 downto 0);
+    reg_data    : in  std_logic_vector(7 downto 0);
+    reg_write   : in  std_logic;
+    status      : out std_logic_vector(7 downto 0);
+
+    -- External hardware interface
+    uart_tx     : out std_logic);
+end uart_replay;
+
+architecture behav of uart_replay is
+  -- Register map, above the receiver registers so both can share a channel.
+  -- Every address from 0x80 and up writes to the record buffer so that a
+  -- register write transfer, which increments the address, can carry up to
+  -- 128 record bytes.
+  constant CONTROL_REGISTER       : std_logic_vector(7 downto 0) := x"20";
+  constant BAUD_DIVISOR_HIGH      : std_logic_vector(7 downto 0) := x"21";
+  constant BAUD_DIVISOR_LOW       : std_logic_vector(7 downto 0) := x"22";
+  constant SPEED_HIGH             : std_logic_vector(7 downto 0) := x"23";
+  constant SPEED_LOW              : std_logic_vector(7 downto 0) := x"24";
+  constant DATA_REGISTER_BIT      : integer := 7;
+
+  -- Control register bits
+  constant CONTROL_ENABLE_BIT     : integer := 0;  -- Clearing it stops the replay and empties the buffer
+  constant CONTROL_STOP_BITS_BIT  : integer := 3;  -- 0 = 1 stop bit, 1 = 2 stop bits
+  constant CONTROL_CLEAR_BIT      : integer := 7;  -- Write 1 to clear the status flags
+
+  constant PARITY_NONE : std_logic_vector(1 downto 0) := "00";
+  constant PARITY_EVEN : std_logic_vector(1 downto 0) := "01";
+  constant PARITY_ODD  : std_logic_vector(1 downto 0) := "10";
+
+  -- Configuration
+  signal enabled              : std_logic;
+  signal parity_mode          : std_logic_vector(1 downto 0);
+  signal two_stop_bits        : std_logic;
+  signal baud_divisor         : unsigned(15 downto 0);
+  signal baud_divisor_high    : std_logic_vector(7 downto 0);
+  signal speed                : unsigned(15 downto 0);
+  signal speed_high           : std_logic_vector(7 downto 0);
+
+  -- Status flags, sticky until cleared
+  signal late_error           : std_logic;
+  signal overrun_error        : std_logic;
+
+  -- Record buffer
+  signal buffer_clear         : std_logic;
+  signal buffer_write_data    : std_logic_vector(7 downto 0);
+  signal buffer_write         : std_logic;
+  signal buffer_full          : std_logic;
+  signal buffer_almost_full   : std_logic;
+  signal buffer_read_data     : std_logic_vector(7 downto 0);
+  signal buffer_read          : std_logic;
+  signal buffer_empty         : std_logic;
+
+  -- Record decoder
+  type decode_state_type is (HEADER, TIMESTAMP_BYTES, DATA_BYTE, WAIT_FOR_TIME);
+  signal decode_state         : decode_state_type;
+  signal bytes_left           : integer range 0 to 5;
+  signal decode_value         : unsigned(39 downto 0);
+  signal header_is_full       : std_logic;
+  signal capture_time         : unsigned(39 downto 0);
+  signal first_time           : unsigned(39 downto 0);
+  signal first_record         : std_logic;
+  signal record_offset        : unsigned(39 downto 0);
+  signal record_byte          : std_logic_vector(7 downto 0);
+
+  -- Replay clock in ticks with 8 fractional bits
+  signal replay_running       : std_logic;
+  signal replay_time          : unsigned(47 downto 0);
+
+  -- Transmitter
+  signal tx_active            : std_logic;
+  signal tx_timer             : unsigned(15 downto 0);
+  signal tx_bits_left         : integer range 0 to 11;
+  signal tx_frame             : std_logic_vector(10 downto 0);
+begin
+  record_buffer : entity work.channel_fifo
+  generic map (
+    ADDRESS_WIDTH       => BUFFER_ADDRESS_WIDTH,
+    ALMOST_FULL_MARGIN  => 128)
+  port map (
+    clk           => clk,
+    reset_n       => reset_n,
+    clear         => buffer_clear,
+    write_data    => buffer_write_data,
+    write_enable  => buffer_write,
+    full          => buffer_full,
+    almost_full   => buffer_almost_full,
+    read_data     => buffer_read_data,
+    read_enable   => buffer_read,
+    empty         => buffer_empty,
+    fill_level    => open);
+
+  process(clk, reset_n)
+    variable tx_ready   : boolean;
+    variable byte       : std_logic_vector(7 downto 0);
+    variable time_value : unsigned(39 downto 0);
+  begin
+    -- Asynchronous reset
+    if (reset_n = '0') then
+      enabled           <= '0';
+      parity_mode       <= PARITY_NONE;
+      two_stop_bits     <= '0';
+      baud_divisor      <= to_unsigned(DEFAULT_BAUD_DIVISOR, 16);
+      baud_divisor_high <= (others => '0');
+      speed             <= x"0100";
+      speed_high        <= (others => '0');
+
+      late_error        <= '0';
+      overrun_error     <= '0';
+
+      buffer_clear      <= '1';
+      buffer_write_data <= (others => '0');
+      buffer_write      <= '0';
+      buffer_read       <= '0';
+
+      decode_state      <= HEADER;
+      bytes_left        <= 0;
+      decode_value      <= (others => '0');
+      header_is_full    <= '0';
+      capture_time      <= (others => '0');
+      first_time        <= (others => '0');
+      first_record      <= '1';
+      record_offset     <= (others => '0');
+      record_byte       <= (others => '0');
+
+      replay_running    <= '0';
+      replay_time       <= (others => '0');
+
+      tx_active         <= '0';
+      tx_timer          <= (others => '0');
+      tx_bits_left      <= 0;
+      tx_frame          <= (others => '1');
+      uart_tx           <= '1';
+
+    -- Synchronous part
+    elsif rising_edge(clk) then
+      buffer_write <= '0';
+      buffer_read <= '0';
+      buffer_clear <= '0';
+
+      -- ======================================================================
+      -- Register writes
+      -- ======================================================================
+      if (reg_select = '1' and reg_write = '1') then
+        if (reg_address(DATA_REGISTER_BIT) = '1') then
+          if (buffer_full = '1') then
+            overrun_error <= '1';
+          else
+            buffer_write_data <= reg_data;
+            buffer_write <= '1';
+          end if;
+        elsif (reg_address = CONTROL_REGISTER) then
+          enabled       <= reg_data(CONTROL_ENABLE_BIT);
+          parity_mode   <= reg_data(2 downto 1);
+          two_stop_bits <= reg_data(CONTROL_STOP_BITS_BIT);
+          if (reg_data(CONTROL_CLEAR_BIT) = '1') then
+            late_error    <= '0';
+            overrun_error <= '0';
+          end if;
+        elsif (reg_address = BAUD_DIVISOR_HIGH) then
+          baud_divisor_high <= reg_data;
+        -- The divisor is updated when the low byte is written
+        elsif (reg_address = BAUD_DIVISOR_LOW) then
+          baud_divisor <= unsigned(baud_divisor_high & reg_data);
+        elsif (reg_address = SPEED_HIGH) then
+          speed_high <= reg_data;
+        -- The speed is updated when the low byte is written, 0 pauses the replay
+        elsif (reg_address = SPEED_LOW) then
+          speed <= unsigned(speed_high & reg_data);
+        end if;
+      end if;
+
+      -- ======================================================================
+      -- Transmitter, a new frame can start in the cycle the last one ends
+      -- ======================================================================
+      tx_ready := (tx_active = '0');
+      if (tx_active = '1') then
+        if (tx_timer /= 0) then
+          tx_timer <= tx_timer - 1;
+        elsif (tx_bits_left = 0) then
+          tx_active <= '0';
+          tx_ready := true;
+        else
+          uart_tx <= tx_frame(0);
+          tx_frame <= '1' & tx_frame(10 downto 1);
+          tx_bits_left <= tx_bits_left - 1;
+          tx_timer <= baud_divisor - 1;
+        end if;
+      end if;
+
+      if (replay_running = '1') then
+        replay_time <= replay_time + speed;
+      end if;
+
+      -- ======================================================================
+      -- Record decoder, one buffer byte every other cycle since the head of
+      -- the buffer is updated the cycle after it is read
+      -- ======================================================================
+      if (enabled = '0') then
+        buffer_clear <= '1';
+        decode_state <= HEADER;
+        first_record <= '1';
+        replay_running <= '0';
+        replay_time <= (others => '0');
+        tx_active <= '0';
+        uart_tx <= '1';
+
+      elsif (decode_state = WAIT_FOR_TIME) then
+        if (replay_time(47 downto 8) >= record_offset) then
+          if (tx_ready) then
+            -- Start bit now, then the data LSB first, parity and stop bits
+            byte := record_byte;
+            uart_tx <= '0';
+            if (parity_mode = PARITY_NONE) then
+              tx_frame <= "111" & byte;
+              if (two_stop_bits = '1') then
+                tx_bits_left <= 10;
+              else
+                tx_bits_left <= 9;
+              end if;
+            else
+              if (parity_mode = PARITY_EVEN) then
+                tx_frame <= "11" & (byte(0) xor byte(1) xor byte(2) xor byte(3) xor
+                                    byte(4) xor byte(5) xor byte(6) xor byte(7)) & byte;
+              else
+                tx_frame <= "11" & not (byte(0) xor byte(1) xor byte(2) xor byte(3) xor
+                                        byte(4) xor byte(5) xor byte(6) xor byte(7)) & byte;
+              end if;
+              if (two_stop_bits = '1') then
+                tx_bits_left <= 11;
+              else
+                tx_bits_left <= 10;
+              end if;
+            end if;
+            tx_timer <= baud_divisor - 1;
+            tx_active <= '1';
+            decode_state <= HEADER;
+          else
+            -- Due while the previous byte is still being sent
+            late_error <= '1';
+          end if;
+        end if;
+
+      elsif (buffer_empty = '0' and buffer_read = '0') then
+        byte := buffer_read_data;
+        buffer_read <= '1';
+        case decode_state is
+          when HEADER =>
+            if (byte(7 downto 6) = "11") then
+              header_is_full <= '1';
+              decode_value <= (others => '0');
+              bytes_left <= 5;
+              decode_state <= TIMESTAMP_BYTES;
+            else
+              header_is_full <= '0';
+              decode_value <= resize(unsigned(byte(5 downto 0)), 40);
+              if (byte(7 downto 6) = "00") then
+                decode_state <= DATA_BYTE;
+              elsif (byte(7 downto 6) = "01") then
+                bytes_left <= 1;
+                decode_state <= TIMESTAMP_BYTES;
+              else
+                bytes_left <= 2;
+                decode_state <= TIMESTAMP_BYTES;
+              end if;
+            end if;
+
+          when TIMESTAMP_BYTES =>
+            decode_value <= decode_value(31 downto 0) & unsigned(byte);
+            bytes_left <= bytes_left - 1;
+            if (bytes_left = 1) then
+              decode_state <= DATA_BYTE;
+            end if;
+
+          when others =>
+            if (header_is_full = '1') then
+              time_value := decode_value;
+            else
+              time_value := capture_time + decode_value;
+            end if;
+            capture_time <= time_value;
+            record_byte <= byte;
+
+            -- The first record is sent right away and starts the replay clock
+            if (first_record = '1') then
+              first_record <= '0';
+              first_time <= time_value;
+              record_offset <= (others => '0');
+              replay_time <= (others => '0');
+              replay_running <= '1';
+            else
+              record_offset <= time_value - first_time;
+            end if;
+            decode_state <= WAIT_FOR_TIME;
+        end case; -- decode_state
+      end if; -- (enabled = '0')
+    end if; -- if (reset_n = '0')
+  end process;
+
+  -- Status register
+  status(0) <= late_error;
+  status(1) <= '0';
+  status(2) <= '0';
+  status(3) <= overrun_error;
+  status(4) <= enabled;
+  status(5) <= '1' when (tx_active = '1' or decode_state /= HEADER or buffer_empty = '0') else '0';
+  status(6) <= not buffer_almost_full;  -- Room for at least 128 more record bytes
+  status(7) <= '0';
+
+end architecture behav;
\ No newline at end of file
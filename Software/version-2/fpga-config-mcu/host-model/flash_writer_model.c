@@ -0,0 +1,514 @@
+/**
+ *******************************************************************************
+ * @file    flash_writer_model.c
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief   Host model of a windowed bitfile upload to measure how many pages
+ *          per second the config MCU can write to the SPI FLASH.
+ *
+ *          The real uart_comm.c is run against a UART, SPI FLASH and upload
+ *          tool that advance a simulated clock instead of doing anything. The
+ *          main loop is the same as in main.c, received bytes become visible
+ *          as the DMA writes them and the CPU sleeps until the idle line, a
+ *          half/full DMA buffer or the next SysTick.
+ *
+ *          Every upload is run twice, once with the FLASH waiting for the end
+ *          of each page program like before and once with it overlapped with
+ *          the reception. The written FLASH is compared with what was sent.
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Includes -----------------------------------------------------------------*/
+#include "uart_comm.h"
+#include "uart1.h"
+#include "spi_flash.h"
+#include "fpga_config.h"
+#include "led.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Private defines ----------------------------------------------------------*/
+/* One byte at register level, 0.25 us at 32 MHz SCK and the polling loop */
+#define MODEL_SPI_BYTE_NS           (500.0)
+/* uart_comm.c parsing, copying and the CRC32 per received byte */
+#define MODEL_PARSE_BYTE_NS         (300.0)
+/* One pass through the main loop without any data */
+#define MODEL_LOOP_NS               (1000.0)
+/* From the last response byte on the wire until the tool has sent more */
+#define MODEL_HOST_LATENCY_NS       (2000000.0)
+#define MODEL_SYSTICK_NS            (1000000.0)
+/* Something is wrong if an upload takes longer than this */
+#define MODEL_MAX_UPLOAD_NS         (600e9)
+
+#define MODEL_FLASH_SIZE            (0x200000)
+#define MODEL_RX_BUFFER_SIZE        (2048)
+#define MODEL_BITFILE_SIZE          (368011)
+#define MODEL_BITFILE_DATA_ADDRESS  (393216 + 256)
+#define MODEL_PAGE_SIZE             (256)
+#define MODEL_NUM_OF_FRAMES         ((MODEL_BITFILE_SIZE + MODEL_PAGE_SIZE - 1) / MODEL_PAGE_SIZE)
+#define MODEL_FRAME_SIZE            (6 + 2 + 4 + MODEL_PAGE_SIZE + 4 + 1)
+#define MODEL_MAX_RX_BYTES          (MODEL_NUM_OF_FRAMES * MODEL_FRAME_SIZE)
+
+#define MODEL_WINDOW_ACK            (0xDA)
+
+/** Private typedefs ---------------------------------------------------------*/
+typedef struct
+{
+  double time;
+  uint16_t nextSequenceNumber;
+} ModelAck;
+
+typedef struct
+{
+  uint32_t baudRate;
+  double pageProgramNs;
+  bool overlapped;
+} ModelSetup;
+
+typedef struct
+{
+  double seconds;
+  uint32_t maxRxBufferUsed;
+  bool flashCorrect;
+} ModelResult;
+
+/** Private variables --------------------------------------------------------*/
+static double prvNow;
+static ModelSetup prvSetup;
+static double prvByteNs;
+
+static uint8_t prvFlash[MODEL_FLASH_SIZE];
+static bool prvFlashPending;
+static double prvFlashBusyUntil;
+
+static uint8_t prvBitfile[MODEL_BITFILE_SIZE];
+
+/* Everything the tool has put on the wire and when each byte is received */
+static uint8_t prvRxData[MODEL_MAX_RX_BYTES];
+static double prvRxTime[MODEL_MAX_RX_BYTES];
+static uint32_t prvRxWritten;
+static uint32_t prvRxRead;
+static double prvLineFreeAt;
+
+/* Responses on their way back to the tool */
+static ModelAck prvAcks[MODEL_NUM_OF_FRAMES * 2];
+static uint32_t prvAcksWritten;
+static uint32_t prvAcksRead;
+static bool prvIgnoreResponses;
+static bool prvGotNack;
+
+static uint32_t prvHostBase;
+static uint32_t prvHostNextFrame;
+static uint32_t prvHostWindow;
+
+/** Private function prototypes ----------------------------------------------*/
+static ModelResult prvRunUpload(ModelSetup Setup);
+static void prvHostSendFrames(double Time);
+static void prvHostProcessAcks(double UntilTime);
+static uint32_t prvBytesArrived();
+static double prvNextWakeUp();
+static void prvSendSetupCommand();
+static uint32_t prvCrc32(const uint8_t* pData, uint32_t DataCount);
+
+/** Functions ----------------------------------------------------------------*/
+int main()
+{
+  const uint32_t baudRates[] = {115200, 921600, 2000000};
+  const double pageProgramTimes[] = {700000.0, 3000000.0};
+  bool allCorrect = true;
+
+  srand(1);
+  for (uint32_t i = 0; i < MODEL_BITFILE_SIZE; i++)
+    prvBitfile[i] = rand() & 0xFF;
+
+  printf("%u byte bitfile, %u pages, window of %u pages\n",
+         MODEL_BITFILE_SIZE, MODEL_NUM_OF_FRAMES, 4);
+  printf("%8s %6s | %21s | %21s | %s\n", "", "",
+         "blocking", "overlapped", "");
+  printf("%8s %6s | %8s %12s | %8s %12s | %s\n", "baud", "tPP",
+         "time", "pages/s", "time", "pages/s", "max RX buffer");
+
+  for (uint32_t b = 0; b < sizeof(baudRates) / sizeof(baudRates[0]); b++)
+  {
+    for (uint32_t p = 0; p < sizeof(pageProgramTimes) / sizeof(pageProgramTimes[0]); p++)
+    {
+      ModelSetup setup = {baudRates[b], pageProgramTimes[p], false};
+      ModelResult blocking = prvRunUpload(setup);
+      setup.overlapped = true;
+      ModelResult overlapped = prvRunUpload(setup);
+
+      printf("%8u %4.1fms | %7.2fs %12.1f | %7.2fs %12.1f | %u/%u bytes\n",
+             baudRates[b], pageProgramTimes[p] / 1e6,
+             blocking.seconds, MODEL_NUM_OF_FRAMES / blocking.seconds,
+             overlapped.seconds, MODEL_NUM_OF_FRAMES / overlapped.seconds,
+             overlapped.maxRxBufferUsed > blocking.maxRxBufferUsed ?
+                 overlapped.maxRxBufferUsed : blocking.maxRxBufferUsed,
+             MODEL_RX_BUFFER_SIZE);
+
+      if (!blocking.flashCorrect || !overlapped.flashCorrect)
+      {
+        printf("  FLASH content does not match the bitfile\n");
+        allCorrect = false;
+      }
+      if (blocking.maxRxBufferUsed > MODEL_RX_BUFFER_SIZE ||
+          overlapped.maxRxBufferUsed > MODEL_RX_BUFFER_SIZE)
+      {
+        printf("  RX buffer overflow\n");
+        allCorrect = false;
+      }
+    }
+  }
+
+  return allCorrect ? 0 : 1;
+}
+
+/** Model of the firmware modules --------------------------------------------*/
+uint32_t HAL_GetTick(void)
+{
+  return (uint32_t)(prvNow / 1e6);
+}
+
+void LED_SetBlinkPeriod(uint32_t Period) {}
+ErrorStatus FPGA_CONFIG_EraseBitFile(uint8_t BitFileNumber) { return SUCCESS; }
+ErrorStatus FPGA_CONFIG_Start(uint8_t BitFileNumber) { return SUCCESS; }
+ErrorStatus FPGA_CONFIG_StartFromSdCard(const char* pFileName) { return SUCCESS; }
+ErrorStatus FPGA_CONFIG_CopyFromSdCard(const char* pFileName, uint8_t BitFileNumber) { return SUCCESS; }
+uint32_t FPGA_CONFIG_LastConfDoneTick() { return 0; }
+uint32_t FPGA_CONFIG_LastTransferTime() { return 0; }
+ErrorStatus FPGA_CONFIG_ReadHeader(uint8_t BitFileNumber, uint8_t* pHeader) { return SUCCESS; }
+FPGA_CONFIG_BitFileStatus FPGA_CONFIG_VerifyBitFile(uint8_t BitFileNumber) { return FPGA_CONFIG_BitFileStatus_Empty; }
+bool UART1_BaudRateSupported(uint32_t BaudRate) { return true; }
+ErrorStatus UART1_SetBaudRate(uint32_t BaudRate) { return SUCCESS; }
+void UART1_SendByte(uint8_t Byte) {}
+void UART1_SendBufferDma(uint8_t* pData, uint16_t Size) {}
+bool UART1_TxBusy() { return false; }
+
+/**
+ * @brief   The response is sent by the interrupt, it reaches the tool after
+ *          it has been shifted out and through the USB serial converter
+ */
+void UART1_SendBuffer(uint8_t* pData, uint16_t Size)
+{
+  if (prvIgnoreResponses)
+    return;
+
+  if (Size == 3 && pData[0] == MODEL_WINDOW_ACK)
+  {
+    prvAcks[prvAcksWritten].time = prvNow + Size * prvByteNs + MODEL_HOST_LATENCY_NS;
+    prvAcks[prvAcksWritten].nextSequenceNumber = ((uint16_t)pData[1] << 8) | pData[2];
+    prvAcksWritten++;
+  }
+  else
+    prvGotNack = true;
+}
+
+ErrorStatus SPI_FLASH_StartPageProgram(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite)
+{
+  if (NumByteToWrite == 0 || WriteAddress + NumByteToWrite > MODEL_FLASH_SIZE ||
+      (WriteAddress % MODEL_PAGE_SIZE) + NumByteToWrite > MODEL_PAGE_SIZE)
+    return ERROR;
+
+  /* Polls the status register until the last program is done */
+  if (prvFlashPending && prvNow < prvFlashBusyUntil)
+    prvNow = prvFlashBusyUntil + 2 * MODEL_SPI_BYTE_NS;
+
+  /* WREN, command, address and data */
+  prvNow += (1 + 4 + NumByteToWrite) * MODEL_SPI_BYTE_NS;
+  for (uint32_t i = 0; i < NumByteToWrite; i++)
+    prvFlash[WriteAddress + i] &= pBuffer[i];
+  prvFlashBusyUntil = prvNow + prvSetup.pageProgramNs;
+  prvFlashPending = true;
+
+  /* Like SPI_FLASH_WriteBuffer did before */
+  if (!prvSetup.overlapped)
+  {
+    prvNow = prvFlashBusyUntil + 2 * MODEL_SPI_BYTE_NS;
+    prvFlashPending = false;
+  }
+  return SUCCESS;
+}
+
+bool SPI_FLASH_PageProgramInProgress()
+{
+  if (!prvFlashPending)
+    return false;
+
+  /* One status register read */
+  prvNow += 2 * MODEL_SPI_BYTE_NS;
+  if (prvNow < prvFlashBusyUntil)
+    return true;
+  prvFlashPending = false;
+  return false;
+}
+
+static void prvWaitForFlash()
+{
+  if (prvFlashPending && prvNow < prvFlashBusyUntil)
+    prvNow = prvFlashBusyUntil;
+  prvFlashPending = false;
+}
+
+void SPI_FLASH_WriteBuffer(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite)
+{
+  prvWaitForFlash();
+  for (uint32_t i = 0; i < NumByteToWrite && WriteAddress + i < MODEL_FLASH_SIZE; i++)
+    prvFlash[WriteAddress + i] &= pBuffer[i];
+}
+
+void SPI_FLASH_ReadBuffer(uint8_t* pBuffer, uint32_t ReadAddress, uint32_t NumByteToRead)
+{
+  prvWaitForFlash();
+  memcpy(pBuffer, &prvFlash[ReadAddress], NumByteToRead);
+}
+
+ErrorStatus SPI_FLASH_StartReadStream(uint32_t ReadAddress)
+{
+  prvWaitForFlash();
+  return SUCCESS;
+}
+
+void SPI_FLASH_ReadStreamDma(uint8_t* pBuffer, uint32_t NumByteToRead) {}
+bool SPI_FLASH_ReadStreamDmaBusy() { return false; }
+void SPI_FLASH_EndReadStream() {}
+
+ErrorStatus SPI_FLASH_EraseSector(uint32_t SectorAddress)
+{
+  prvWaitForFlash();
+  return SUCCESS;
+}
+
+void SPI_FLASH_EraseChip()
+{
+  prvWaitForFlash();
+}
+
+/** Private functions .-------------------------------------------------------*/
+/**
+ * @brief   Upload the bitfile with the windowed write command
+ * @param   Setup: Baud rate, page program time and FLASH mode to use
+ * @retval  The time it took and if the FLASH ended up right
+ */
+static ModelResult prvRunUpload(ModelSetup Setup)
+{
+  ModelResult result = {0};
+
+  prvSetup = Setup;
+  prvByteNs = 10e9 / Setup.baudRate;
+  prvNow = 0;
+  memset(prvFlash, 0xFF, sizeof(prvFlash));
+  prvFlashPending = false;
+  prvFlashBusyUntil = 0;
+  prvRxWritten = 0;
+  prvRxRead = 0;
+  prvLineFreeAt = 0;
+  prvAcksWritten = 0;
+  prvAcksRead = 0;
+  prvGotNack = false;
+  prvHostBase = 0;
+  prvHostNextFrame = 0;
+  prvHostWindow = 4;
+
+  prvSendSetupCommand();
+  prvHostSendFrames(0);
+
+  while (prvHostBase < MODEL_NUM_OF_FRAMES || UART_COMM_Process())
+  {
+    prvHostProcessAcks(prvNow);
+
+    /* Same as the main loop in main.c, a span ends where the DMA buffer wraps */
+    uint32_t available = prvBytesArrived() - prvRxRead;
+    if (available > result.maxRxBufferUsed)
+      result.maxRxBufferUsed = available;
+    uint32_t count = MODEL_RX_BUFFER_SIZE - (prvRxRead % MODEL_RX_BUFFER_SIZE);
+    if (count > available)
+      count = available;
+    if (count != 0)
+    {
+      prvNow += count * MODEL_PARSE_BYTE_NS;
+      UART_COMM_HandleReceivedData(&prvRxData[prvRxRead], count);
+      prvRxRead += count;
+    }
+
+    bool busy = UART_COMM_Process();
+    prvNow += MODEL_LOOP_NS;
+    if (!busy && prvBytesArrived() == prvRxRead)
+      prvNow = prvNextWakeUp();
+
+    if (prvGotNack || prvNow > MODEL_MAX_UPLOAD_NS)
+    {
+      printf("  upload stopped, %s\n", prvGotNack ? "unexpected NACK" : "timeout");
+      break;
+    }
+  }
+
+  result.seconds = prvNow / 1e9;
+  result.flashCorrect =
+      (memcmp(&prvFlash[MODEL_BITFILE_DATA_ADDRESS], prvBitfile, MODEL_BITFILE_SIZE) == 0);
+  return result;
+}
+
+/**
+ * @brief   Put frames on the wire while there is room in the window
+ * @param   Time: When the tool got to send them
+ * @retval  None
+ */
+static void prvHostSendFrames(double Time)
+{
+  double start = (Time > prvLineFreeAt) ? Time : prvLineFreeAt;
+
+  while (prvHostNextFrame < MODEL_NUM_OF_FRAMES &&
+         prvHostNextFrame < prvHostBase + prvHostWindow)
+  {
+    uint32_t offset = prvHostNextFrame * MODEL_PAGE_SIZE;
+    uint32_t count = MODEL_BITFILE_SIZE - offset;
+    if (count > MODEL_PAGE_SIZE)
+      count = MODEL_PAGE_SIZE;
+    uint32_t address = MODEL_BITFILE_DATA_ADDRESS + offset;
+
+    uint8_t data[2 + 4 + MODEL_PAGE_SIZE + 4];
+    uint32_t dataCount = 0;
+    data[dataCount++] = (prvHostNextFrame >> 8) & 0xFF;
+    data[dataCount++] = prvHostNextFrame & 0xFF;
+    data[dataCount++] = (address >> 24) & 0xFF;
+    data[dataCount++] = (address >> 16) & 0xFF;
+    data[dataCount++] = (address >> 8) & 0xFF;
+    data[dataCount++] = address & 0xFF;
+    memcpy(&data[dataCount], &prvBitfile[offset], count);
+    dataCount += count;
+    uint32_t crc = prvCrc32(data, dataCount);
+    data[dataCount++] = (crc >> 24) & 0xFF;
+    data[dataCount++] = (crc >> 16) & 0xFF;
+    data[dataCount++] = (crc >> 8) & 0xFF;
+    data[dataCount++] = crc & 0xFF;
+
+    uint8_t frame[MODEL_FRAME_SIZE];
+    uint32_t frameCount = 0;
+    frame[frameCount++] = 0xAA;
+    frame[frameCount++] = 0xBB;
+    frame[frameCount++] = 0xCC;
+    frame[frameCount++] = 0x31;
+    frame[frameCount++] = (dataCount >> 8) & 0xFF;
+    frame[frameCount++] = dataCount & 0xFF;
+    memcpy(&frame[frameCount], data, dataCount);
+    frameCount += dataCount;
+    uint8_t checksum = 0;
+    for (uint32_t i = 0; i < frameCount; i++)
+      checksum ^= frame[i];
+    frame[frameCount++] = checksum;
+
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+      start += prvByteNs;
+      prvRxData[prvRxWritten] = frame[i];
+      prvRxTime[prvRxWritten] = start;
+      prvRxWritten++;
+    }
+    prvLineFreeAt = start;
+    prvHostNextFrame++;
+  }
+}
+
+/**
+ * @brief   Let the tool handle the responses that have reached it
+ * @param   UntilTime: Handle the responses that arrived before this
+ * @retval  None
+ */
+static void prvHostProcessAcks(double UntilTime)
+{
+  while (prvAcksRead < prvAcksWritten && prvAcks[prvAcksRead].time <= UntilTime)
+  {
+    if (prvAcks[prvAcksRead].nextSequenceNumber > prvHostBase)
+      prvHostBase = prvAcks[prvAcksRead].nextSequenceNumber;
+    prvHostSendFrames(prvAcks[prvAcksRead].time);
+    prvAcksRead++;
+  }
+}
+
+/**
+ * @brief   Number of bytes the DMA has written so far
+ */
+static uint32_t prvBytesArrived()
+{
+  uint32_t count = prvRxRead;
+  while (count < prvRxWritten && prvRxTime[count] <= prvNow)
+    count++;
+  return count;
+}
+
+/**
+ * @brief   When __WFI returns: the next SysTick, the idle line after a frame
+ *          or the DMA half/full transfer interrupt, whichever comes first
+ */
+static double prvNextWakeUp()
+{
+  double wakeUp = (uint64_t)(prvNow / MODEL_SYSTICK_NS + 1) * MODEL_SYSTICK_NS;
+
+  /* The tool may send more while we sleep, or may already have done so
+   * while the CPU was busy */
+  prvHostProcessAcks(wakeUp);
+  if (prvBytesArrived() != prvRxRead)
+    return prvNow;
+
+  for (uint32_t i = prvRxRead; i < prvRxWritten && prvRxTime[i] < wakeUp; i++)
+  {
+    bool dmaInterrupt = ((i + 1) % (MODEL_RX_BUFFER_SIZE / 2) == 0);
+    bool idleLine = (i + 1 == prvRxWritten || prvRxTime[i + 1] > prvRxTime[i] + prvByteNs);
+    double time = dmaInterrupt ? prvRxTime[i] : prvRxTime[i] + prvByteNs;
+    if ((dmaInterrupt || idleLine) && time < wakeUp)
+    {
+      wakeUp = time;
+      break;
+    }
+  }
+  return wakeUp;
+}
+
+/**
+ * @brief   Start the windowed write, the time for this is not counted
+ */
+static void prvSendSetupCommand()
+{
+  uint8_t command[] = {0xAA, 0xBB, 0xCC, 0x32, 0x00};
+  for (uint32_t i = 0; i < sizeof(command) - 1; i++)
+    command[sizeof(command) - 1] ^= command[i];
+
+  prvIgnoreResponses = true;
+  UART_COMM_ResetParser();
+  UART_COMM_HandleReceivedData(command, sizeof(command));
+  while (UART_COMM_Process());
+  prvIgnoreResponses = false;
+  prvNow = 0;
+}
+
+/**
+ * @brief   Calculate the CRC32 of a buffer, same as zlib
+ */
+static uint32_t prvCrc32(const uint8_t* pData, uint32_t DataCount)
+{
+  uint32_t crc = 0xFFFFFFFF;
+  for (uint32_t i = 0; i < DataCount; i++)
+  {
+    crc ^= pData[i];
+    for (uint32_t bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
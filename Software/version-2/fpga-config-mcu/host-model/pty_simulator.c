@@ -0,0 +1,585 @@
+/**
+ *******************************************************************************
+ * @file    pty_simulator.c
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief   Linux build of the config MCU command handling on a pseudo-terminal
+ *          so fpga-config-over-uart.py can be run against it without a board.
+ *
+ *          The real uart_comm.c, fpga_config.c, md5.c, bitfile_lz.c,
+ *          sd_card.c and fat.c are run against a 2 MB SPI FLASH in RAM, an
+ *          FPGA that accepts everything it gets and an empty SD card slot.
+ *          The path of the terminal is printed at start, give it to the tool
+ *          with -p:
+ *            ./pty_simulator -l /tmp/ttyConfigMcu
+ *            python fpga-config-over-uart.py -p /tmp/ttyConfigMcu --store -n 1 -b test.rbf
+ *
+ *          A session is everything from the first received byte until the
+ *          line has been quiet for a second. For each session it prints the
+ *          number of frames and frames per second, the CPU cycles uart_comm.c
+ *          and the commands it runs spend per received byte without the time
+ *          in the models and the time from the first received to the last
+ *          sent byte. The terminal has no baud rate so the time is what the
+ *          protocol costs on top of the wire, which is what protocol changes
+ *          should make smaller.
+ *
+ *          Options:
+ *            -l path : Make a symbolic link to the terminal at path
+ *            -n num  : Exit after num sessions, for scripts and CI
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Includes -----------------------------------------------------------------*/
+/* For posix_openpt, cfmakeraw and the others */
+#define _GNU_SOURCE
+
+#include "uart_comm.h"
+#include "uart1.h"
+#include "spi_flash.h"
+#include "spi2.h"
+#include "fpga_config.h"
+#include "led.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/** Private defines ----------------------------------------------------------*/
+#define MODEL_FLASH_SIZE            (0x200000)
+#define MODEL_READ_SIZE             (4096)
+/* A session ends when nothing has been received for this long */
+#define MODEL_SESSION_IDLE_MS       (1000)
+/* How long to sleep in poll when uart_comm.c has nothing to do */
+#define MODEL_IDLE_POLL_MS          (10)
+
+#define MODEL_MIN_BAUD_RATE         (9600)
+#define MODEL_MAX_BAUD_RATE         (64000000 / 16)
+
+#define MODEL_CONF_DONE_PIN         (GPIO_PIN_10)
+#define MODEL_NSTATUS_PIN           (GPIO_PIN_11)
+#define MODEL_NCONFIG_PIN           (GPIO_PIN_8)
+
+#define MODEL_HEADER_1              (0xAA)
+#define MODEL_HEADER_2              (0xBB)
+#define MODEL_HEADER_3              (0xCC)
+
+/** Private typedefs ---------------------------------------------------------*/
+typedef enum
+{
+  ModelFrameState_Header1,
+  ModelFrameState_Header2,
+  ModelFrameState_Header3,
+  ModelFrameState_Command,
+  ModelFrameState_Count1,
+  ModelFrameState_Count2,
+  ModelFrameState_Data,
+  ModelFrameState_Checksum,
+} ModelFrameState;
+
+typedef struct
+{
+  bool active;
+  double firstRxMs;
+  double lastRxMs;
+  double lastTxMs;
+  uint64_t rxBytes;
+  uint64_t txBytes;
+  uint64_t frames;
+  uint64_t parserCycles;
+} ModelSession;
+
+/** Private variables --------------------------------------------------------*/
+static int prvMaster = -1;
+static int prvSlave = -1;
+static volatile sig_atomic_t prvStop = 0;
+
+static ModelSession prvSession;
+static uint32_t prvNumOfSessions;
+
+/* Cycles spent in the models while uart_comm.c was running, they are not
+ * counted as parser cycles */
+static uint64_t prvModelCycles;
+
+static ModelFrameState prvFrameState = ModelFrameState_Header1;
+static uint16_t prvFrameBytesLeft;
+
+static uint8_t prvFlash[MODEL_FLASH_SIZE];
+static uint32_t prvStreamAddress;
+static uint32_t prvFpgaCount;
+static uint32_t prvBaudRate = 115200;
+static double prvResetMs;
+
+/** Private function prototypes ----------------------------------------------*/
+static ErrorStatus prvOpenTerminal(const char* pLink);
+static void prvHandleReceived(uint8_t* pData, uint32_t DataCount);
+static void prvCountFrames(uint8_t* pData, uint32_t DataCount);
+static void prvSend(uint8_t* pData, uint32_t DataCount);
+static void prvEndSession();
+static double prvNowMs();
+static uint64_t prvCycles();
+static void prvSignalHandler(int Signal);
+
+/** Functions ----------------------------------------------------------------*/
+int main(int argc, char** argv)
+{
+  const char* pLink = NULL;
+  uint32_t maxNumOfSessions = 0;
+  int option;
+  while ((option = getopt(argc, argv, "l:n:")) != -1)
+  {
+    if (option == 'l')
+      pLink = optarg;
+    else if (option == 'n')
+      maxNumOfSessions = strtoul(optarg, NULL, 0);
+    else
+    {
+      fprintf(stderr, "usage: %s [-l link] [-n sessions]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  prvResetMs = prvNowMs();
+  memset(prvFlash, 0xFF, sizeof(prvFlash));
+  if (prvOpenTerminal(pLink) != SUCCESS)
+    return 1;
+
+  signal(SIGINT, prvSignalHandler);
+  signal(SIGTERM, prvSignalHandler);
+
+  /* The same as the main loop in main.c but the received bytes come from the
+   * terminal instead of the DMA buffer */
+  FPGA_CONFIG_Init();
+  while (!prvStop)
+  {
+    bool busy = UART_COMM_Process();
+
+    struct pollfd pollFd = { .fd = prvMaster, .events = POLLIN };
+    int ready = poll(&pollFd, 1, busy ? 0 : MODEL_IDLE_POLL_MS);
+    if (ready < 0 && errno != EINTR)
+    {
+      perror("poll");
+      break;
+    }
+
+    if (ready > 0 && (pollFd.revents & POLLIN))
+    {
+      uint8_t data[MODEL_READ_SIZE];
+      ssize_t count = read(prvMaster, data, sizeof(data));
+      if (count > 0)
+        prvHandleReceived(data, count);
+    }
+
+    if (prvSession.active && prvNowMs() - prvSession.lastRxMs > MODEL_SESSION_IDLE_MS)
+    {
+      prvEndSession();
+      if (maxNumOfSessions != 0 && prvNumOfSessions >= maxNumOfSessions)
+        break;
+    }
+  }
+
+  if (prvSession.active)
+    prvEndSession();
+  if (pLink != NULL)
+    unlink(pLink);
+  close(prvSlave);
+  close(prvMaster);
+  return 0;
+}
+
+/** Model of the firmware modules --------------------------------------------*/
+uint32_t HAL_GetTick(void)
+{
+  return (uint32_t)(prvNowMs() - prvResetMs);
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+  usleep(Delay * 1000);
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_Init) {}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+  /* nCONFIG low restarts the config */
+  if (GPIOx == GPIOA && GPIO_Pin == MODEL_NCONFIG_PIN && PinState == GPIO_PIN_RESET)
+    prvFpgaCount = 0;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
+{
+  /* The FPGA is done as soon as it has got something */
+  if (GPIOx == GPIOB && GPIO_Pin == MODEL_CONF_DONE_PIN)
+    return (prvFpgaCount != 0) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+  else if (GPIOx == GPIOB && GPIO_Pin == MODEL_NSTATUS_PIN)
+    return GPIO_PIN_SET;
+  return GPIO_PIN_RESET;
+}
+
+void LED_SetBlinkPeriod(uint32_t Period) {}
+
+ErrorStatus UART1_SetBaudRate(uint32_t BaudRate)
+{
+  /* The terminal has no baud rate, it's only remembered for the report */
+  prvBaudRate = BaudRate;
+  return SUCCESS;
+}
+
+bool UART1_BaudRateSupported(uint32_t BaudRate)
+{
+  /* The same limits as uart1.c with the 64 MHz APB2 clock */
+  return (BaudRate >= MODEL_MIN_BAUD_RATE && BaudRate <= MODEL_MAX_BAUD_RATE);
+}
+
+void UART1_SendByte(uint8_t Byte)
+{
+  prvSend(&Byte, 1);
+}
+
+void UART1_SendBuffer(uint8_t* pData, uint16_t Size)
+{
+  prvSend(pData, Size);
+}
+
+void UART1_SendBufferDma(uint8_t* pData, uint16_t Size)
+{
+  prvSend(pData, Size);
+}
+
+bool UART1_TxBusy()
+{
+  return false;
+}
+
+/* There is no SD card in the slot, it never answers */
+ErrorStatus SPI2_InitForFpgaConfig() { return SUCCESS; }
+ErrorStatus SPI2_InitForSdCard(bool IdentificationClock) { return SUCCESS; }
+ErrorStatus SPI2_DeInit() { return SUCCESS; }
+uint8_t SPI2_TransferByte(uint8_t Byte) { return 0xFF; }
+void SPI2_SelectDevice(SPI2_Device Device) {}
+void SPI2_DeselectDevice(SPI2_Device Device) {}
+void SPI2_WaitForWriteEnd() {}
+
+void SPI2_ReadBuffer(uint8_t* pBuffer, uint32_t NumByteToRead)
+{
+  memset(pBuffer, 0xFF, NumByteToRead);
+}
+
+void SPI2_WriteByte(uint8_t Byte)
+{
+  prvFpgaCount++;
+}
+
+void SPI2_WriteBuffer(uint8_t* pBuffer, uint32_t NumByteToWrite)
+{
+  prvFpgaCount += NumByteToWrite;
+}
+
+ErrorStatus SPI_FLASH_EraseSector(uint32_t SectorAddress)
+{
+  uint64_t start = prvCycles();
+  memset(&prvFlash[SectorAddress & (MODEL_FLASH_SIZE - SPI_FLASH_BYTES_IN_SECTOR)], 0xFF,
+         SPI_FLASH_BYTES_IN_SECTOR);
+  prvModelCycles += prvCycles() - start;
+  return SUCCESS;
+}
+
+ErrorStatus SPI_FLASH_EraseBlock(uint32_t BlockAddress)
+{
+  uint64_t start = prvCycles();
+  memset(&prvFlash[BlockAddress & (MODEL_FLASH_SIZE - SPI_FLASH_BYTES_IN_BLOCK)], 0xFF,
+         SPI_FLASH_BYTES_IN_BLOCK);
+  prvModelCycles += prvCycles() - start;
+  return SUCCESS;
+}
+
+void SPI_FLASH_EraseChip()
+{
+  uint64_t start = prvCycles();
+  memset(prvFlash, 0xFF, sizeof(prvFlash));
+  prvModelCycles += prvCycles() - start;
+}
+
+ErrorStatus SPI_FLASH_StartPageProgram(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite)
+{
+  /* Like the real FLASH the address wraps within the page */
+  uint64_t start = prvCycles();
+  uint32_t page = WriteAddress & (MODEL_FLASH_SIZE - SPI_FLASH_BYTES_IN_PAGE);
+  for (uint32_t i = 0; i < NumByteToWrite; i++)
+    prvFlash[page + ((WriteAddress + i) % SPI_FLASH_BYTES_IN_PAGE)] &= pBuffer[i];
+  prvModelCycles += prvCycles() - start;
+  return SUCCESS;
+}
+
+bool SPI_FLASH_PageProgramInProgress()
+{
+  return false;
+}
+
+void SPI_FLASH_WriteBuffer(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite)
+{
+  uint64_t start = prvCycles();
+  for (uint32_t i = 0; i < NumByteToWrite; i++)
+    prvFlash[(WriteAddress + i) % MODEL_FLASH_SIZE] &= pBuffer[i];
+  prvModelCycles += prvCycles() - start;
+}
+
+void SPI_FLASH_ReadBuffer(uint8_t* pBuffer, uint32_t ReadAddress, uint32_t NumByteToRead)
+{
+  uint64_t start = prvCycles();
+  for (uint32_t i = 0; i < NumByteToRead; i++)
+    pBuffer[i] = prvFlash[(ReadAddress + i) % MODEL_FLASH_SIZE];
+  prvModelCycles += prvCycles() - start;
+}
+
+ErrorStatus SPI_FLASH_StartReadStream(uint32_t ReadAddress)
+{
+  prvStreamAddress = ReadAddress;
+  return SUCCESS;
+}
+
+void SPI_FLASH_ReadStreamDma(uint8_t* pBuffer, uint32_t NumByteToRead)
+{
+  SPI_FLASH_ReadBuffer(pBuffer, prvStreamAddress, NumByteToRead);
+  prvStreamAddress += NumByteToRead;
+}
+
+bool SPI_FLASH_ReadStreamDmaBusy() { return false; }
+void SPI_FLASH_EndReadStream() {}
+
+/** Private functions .-------------------------------------------------------*/
+/**
+ * @brief   Open the pseudo-terminal and print the path of it
+ * @param   pLink: Path of a symbolic link to make to the terminal, can be NULL
+ * @retval  SUCCESS: The terminal is open
+ * @retval  ERROR: It could not be opened
+ */
+static ErrorStatus prvOpenTerminal(const char* pLink)
+{
+  prvMaster = posix_openpt(O_RDWR | O_NOCTTY);
+  if (prvMaster < 0 || grantpt(prvMaster) != 0 || unlockpt(prvMaster) != 0)
+  {
+    perror("posix_openpt");
+    return ERROR;
+  }
+  const char* pSlaveName = ptsname(prvMaster);
+
+  /* The slave is kept open so reads from the master don't fail with EIO while
+   * the tool isn't connected, it's set to raw in case the tool doesn't */
+  prvSlave = open(pSlaveName, O_RDWR | O_NOCTTY);
+  if (prvSlave < 0)
+  {
+    perror(pSlaveName);
+    return ERROR;
+  }
+  struct termios settings;
+  tcgetattr(prvSlave, &settings);
+  cfmakeraw(&settings);
+  tcsetattr(prvSlave, TCSANOW, &settings);
+
+  if (pLink != NULL)
+  {
+    unlink(pLink);
+    if (symlink(pSlaveName, pLink) != 0)
+    {
+      perror(pLink);
+      return ERROR;
+    }
+  }
+
+  printf("%s\n", (pLink != NULL) ? pLink : pSlaveName);
+  fflush(stdout);
+  return SUCCESS;
+}
+
+/**
+ * @brief   Give received bytes to uart_comm.c and time it
+ * @param   pData: The bytes
+ * @param   DataCount: Number of bytes
+ * @retval  None
+ */
+static void prvHandleReceived(uint8_t* pData, uint32_t DataCount)
+{
+  double now = prvNowMs();
+  if (!prvSession.active)
+  {
+    memset(&prvSession, 0, sizeof(prvSession));
+    prvSession.active = true;
+    prvSession.firstRxMs = now;
+    prvSession.lastTxMs = now;
+  }
+  prvSession.lastRxMs = now;
+  prvSession.rxBytes += DataCount;
+  prvCountFrames(pData, DataCount);
+
+  prvModelCycles = 0;
+  uint64_t start = prvCycles();
+  UART_COMM_HandleReceivedData(pData, DataCount);
+  prvSession.parserCycles += prvCycles() - start - prvModelCycles;
+}
+
+/**
+ * @brief   Count the frames in the received bytes, separate from uart_comm.c
+ *          so a broken parser can't make the numbers look better
+ * @param   pData: The bytes
+ * @param   DataCount: Number of bytes
+ * @retval  None
+ */
+static void prvCountFrames(uint8_t* pData, uint32_t DataCount)
+{
+  static const uint8_t commandsWithoutCount[] = { 0x11, 0x20, 0x32, 0x42, 0x51 };
+  for (uint32_t i = 0; i < DataCount; i++)
+  {
+    uint8_t byte = pData[i];
+    switch (prvFrameState)
+    {
+      case ModelFrameState_Header1:
+        if (byte == MODEL_HEADER_1)
+          prvFrameState = ModelFrameState_Header2;
+        break;
+      case ModelFrameState_Header2:
+        prvFrameState = (byte == MODEL_HEADER_2) ? ModelFrameState_Header3 : ModelFrameState_Header1;
+        break;
+      case ModelFrameState_Header3:
+        prvFrameState = (byte == MODEL_HEADER_3) ? ModelFrameState_Command : ModelFrameState_Header1;
+        break;
+      case ModelFrameState_Command:
+        prvFrameState = memchr(commandsWithoutCount, byte, sizeof(commandsWithoutCount)) ?
+                        ModelFrameState_Checksum : ModelFrameState_Count1;
+        break;
+      case ModelFrameState_Count1:
+        prvFrameBytesLeft = (uint16_t)byte << 8;
+        prvFrameState = ModelFrameState_Count2;
+        break;
+      case ModelFrameState_Count2:
+        prvFrameBytesLeft |= byte;
+        prvFrameState = (prvFrameBytesLeft != 0) ? ModelFrameState_Data : ModelFrameState_Checksum;
+        break;
+      case ModelFrameState_Data:
+        if (--prvFrameBytesLeft == 0)
+          prvFrameState = ModelFrameState_Checksum;
+        break;
+      case ModelFrameState_Checksum:
+        prvSession.frames++;
+        prvFrameState = ModelFrameState_Header1;
+        break;
+    }
+  }
+}
+
+/**
+ * @brief   Write bytes from the "UART" to the terminal
+ * @param   pData: The bytes
+ * @param   DataCount: Number of bytes
+ * @retval  None
+ */
+static void prvSend(uint8_t* pData, uint32_t DataCount)
+{
+  uint64_t start = prvCycles();
+  while (DataCount != 0)
+  {
+    ssize_t count = write(prvMaster, pData, DataCount);
+    if (count < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      perror("write");
+      break;
+    }
+    pData += count;
+    DataCount -= count;
+    prvSession.txBytes += count;
+  }
+  prvSession.lastTxMs = prvNowMs();
+  prvModelCycles += prvCycles() - start;
+}
+
+/**
+ * @brief   Print the statistics of the session that just ended
+ * @param   None
+ * @retval  None
+ */
+static void prvEndSession()
+{
+  double ms = prvSession.lastTxMs - prvSession.firstRxMs;
+  if (ms < 1.0)
+    ms = 1.0;
+
+  prvNumOfSessions++;
+  printf("Session %u: %llu frames, %llu bytes in, %llu bytes out, %u baud\n",
+         prvNumOfSessions, (unsigned long long)prvSession.frames,
+         (unsigned long long)prvSession.rxBytes, (unsigned long long)prvSession.txBytes,
+         prvBaudRate);
+  printf("  %.0f frames/s, %.1f parser %s/byte, %.3f s from first byte in to last byte out\n",
+         prvSession.frames * 1000.0 / ms,
+         prvSession.rxBytes ? (double)prvSession.parserCycles / prvSession.rxBytes : 0.0,
+#if defined(__x86_64__) || defined(__i386__)
+         "cycles",
+#else
+         "ns",
+#endif
+         ms / 1000.0);
+  fflush(stdout);
+  prvSession.active = false;
+}
+
+/**
+ * @brief   Milliseconds since some time in the past
+ * @param   None
+ * @retval  The time
+ */
+static double prvNowMs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+/**
+ * @brief   The CPU cycle counter, nanoseconds where there isn't one
+ * @param   None
+ * @retval  The count
+ */
+static uint64_t prvCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+static void prvSignalHandler(int Signal)
+{
+  prvStop = 1;
+}
+
+/** Interrupt Handlers -------------------------------------------------------*/
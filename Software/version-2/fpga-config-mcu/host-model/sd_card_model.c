@@ -0,0 +1,974 @@
+/**
+ *******************************************************************************
+ * @file    sd_card_model.c
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief   Host test of configuring the FPGA from an SD card and of copying a
+ *          bitfile from the card to the SPI FLASH.
+ *
+ *          The real fpga_config.c, sd_card.c, fat.c, md5.c and bitfile_lz.c
+ *          are run against a model of SPI2 with an SD card in SPI mode, the
+ *          FPGA and the SPI FLASH. The card reads its blocks from a disk image
+ *          in RAM. The images are made here, a FAT16 superfloppy on an SDSC
+ *          card and a FAT32 partition on an SDHC card, both with FPGA.RBF
+ *          fragmented over the disk.
+ *
+ *          An image of a real card can be tested too:
+ *            ./sd_card_model disk.img expected.rbf
+ *          where expected.rbf is a copy of the FPGA.RBF on the card.
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Includes -----------------------------------------------------------------*/
+#include "fpga_config.h"
+#include "spi_flash.h"
+#include "spi2.h"
+#include "md5.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Private defines ----------------------------------------------------------*/
+/* One byte at register level with 16 MHz SCK and the polling loop */
+#define MODEL_SPI_BYTE_NS           (500.0)
+/* From a read command until the card sends the data, it varies a lot between
+ * cards, this is a typical class 4 card */
+#define MODEL_SD_READ_LATENCY_NS    (250000.0)
+/* 0xFF bytes the model sends before each data block */
+#define MODEL_SD_READ_LATENCY_BYTES (3)
+
+#define MODEL_BLOCK_SIZE            (512)
+#define MODEL_FLASH_SIZE            (0x200000)
+#define MODEL_BITFILE_SIZE          (368011)
+#define MODEL_BITFILE_OFFSET        (393216)
+#define MODEL_BITFILE_DATA_OFFSET   (256)
+#define MODEL_FPGA_BUFFER_SIZE      (MODEL_BITFILE_SIZE + 16)
+#define MODEL_SD_QUEUE_SIZE         (2048)
+
+#define MODEL_CONF_DONE_PIN         (GPIO_PIN_10)
+#define MODEL_NSTATUS_PIN           (GPIO_PIN_11)
+#define MODEL_NCONFIG_PIN           (GPIO_PIN_8)
+
+/* 2016-10-19 12:34:56 as in a FAT directory entry */
+#define MODEL_FILE_DATE             (((2016 - 1980) << 9) | (10 << 5) | 19)
+#define MODEL_FILE_TIME             ((12 << 11) | (34 << 5) | (56 / 2))
+
+#define MODEL_FAT16_END_OF_CHAIN    (0xFFFF)
+#define MODEL_FAT32_END_OF_CHAIN    (0x0FFFFFFF)
+
+/** Private typedefs ---------------------------------------------------------*/
+typedef enum
+{
+  ModelSpiMode_Off,
+  ModelSpiMode_SdCardSlow,
+  ModelSpiMode_SdCard,
+  ModelSpiMode_Fpga,
+} ModelSpiMode;
+
+typedef struct
+{
+  bool present;
+  bool highCapacity;
+  bool spiMode;
+  bool idle;
+  bool appCommand;
+  uint32_t opCondTries;
+  uint32_t bytesBeforeReset;  /* Bytes clocked with CS high before CMD0 */
+  uint8_t command[6];
+  uint32_t commandLength;
+  bool multipleRead;
+  uint32_t nextBlock;
+  uint8_t queue[MODEL_SD_QUEUE_SIZE];
+  uint32_t queueHead;
+  uint32_t queueTail;
+} ModelSdCard;
+
+typedef struct
+{
+  bool fat32;
+  uint32_t volumeStart;
+  uint32_t blocksPerCluster;
+  uint32_t fatStart;
+  uint32_t fatBlocks;
+  uint32_t rootDirStart;      /* FAT16 */
+  uint32_t rootDirBlocks;     /* FAT16 */
+  uint32_t lastRootCluster;   /* FAT32 */
+  uint32_t dataStart;
+  uint32_t nextFreeCluster;
+  uint32_t numOfRootEntries;
+} ModelVolume;
+
+/** Private variables --------------------------------------------------------*/
+static uint8_t* prvDisk;
+static uint32_t prvDiskBlocks;
+static ModelSdCard prvCard;
+
+static ModelSpiMode prvSpiMode;
+static bool prvSdCardSelected;
+static bool prvFpgaSelected;
+static uint32_t prvErrors;
+
+/* What the FPGA has received since nCONFIG */
+static uint8_t prvFpgaData[MODEL_FPGA_BUFFER_SIZE];
+static uint32_t prvFpgaCount;
+
+/* Statistics of the last operation */
+static uint32_t prvSpiBytes;
+static uint32_t prvSdReadCommands;
+
+static uint8_t prvFlash[MODEL_FLASH_SIZE];
+static uint32_t prvStreamAddress;
+
+static uint32_t prvTick;
+
+/* What FPGA.RBF contains */
+static uint8_t prvBitfile[MODEL_BITFILE_SIZE];
+static uint32_t prvBitfileSize;
+/* The date of the file on an image of a real card is not known */
+static bool prvImageFromFile = false;
+
+/** Private function prototypes ----------------------------------------------*/
+static bool prvTestCard(const char* pName, bool HighCapacity, const char* pFileName);
+static bool prvTestErrors();
+static void prvResetStatistics();
+static double prvTransferMs();
+static bool prvCheckSlot(uint8_t BitFileNumber, const char* pFileName);
+static bool prvFpgaConfigured();
+static void prvModelError(const char* pMessage);
+static uint8_t prvSdCardExchange(uint8_t Byte);
+static void prvSdCardCommand();
+static void prvSdCardQueue(uint8_t Byte);
+static void prvSdCardQueueBlock(uint32_t Block);
+static void prvFormat(ModelVolume* pVolume, uint32_t DiskBlocks, uint32_t VolumeStart,
+                      bool Fat32, uint32_t BlocksPerCluster);
+static void prvSetFat(ModelVolume* pVolume, uint32_t Cluster, uint32_t Value);
+static uint8_t* prvClusterData(ModelVolume* pVolume, uint32_t Cluster);
+static uint32_t prvWriteFile(ModelVolume* pVolume, const uint8_t* pData, uint32_t Size,
+                             bool Fragmented);
+static void prvAddDirEntry(ModelVolume* pVolume, const char* pName, uint8_t Attributes,
+                           uint32_t Cluster, uint32_t Size);
+static uint32_t prvGetFat(ModelVolume* pVolume, uint32_t Cluster);
+static void prvPutLe16(uint8_t* pData, uint16_t Value);
+static void prvPutLe32(uint8_t* pData, uint32_t Value);
+
+/** Functions ----------------------------------------------------------------*/
+int main(int argc, char** argv)
+{
+  bool allCorrect = true;
+
+  srand(1);
+  for (uint32_t i = 0; i < MODEL_BITFILE_SIZE; i++)
+    prvBitfile[i] = rand() & 0xFF;
+  prvBitfileSize = MODEL_BITFILE_SIZE;
+
+  if (argc == 3)
+  {
+    /* Image of a real card */
+    FILE* pImage = fopen(argv[1], "rb");
+    FILE* pExpected = fopen(argv[2], "rb");
+    if (pImage == NULL || pExpected == NULL)
+    {
+      printf("Could not open %s or %s\n", argv[1], argv[2]);
+      return 1;
+    }
+    fseek(pImage, 0, SEEK_END);
+    prvDiskBlocks = ftell(pImage) / MODEL_BLOCK_SIZE;
+    fseek(pImage, 0, SEEK_SET);
+    prvDisk = malloc((size_t)prvDiskBlocks * MODEL_BLOCK_SIZE);
+    prvBitfileSize = fread(prvBitfile, 1, MODEL_BITFILE_SIZE, pExpected);
+    if (fread(prvDisk, MODEL_BLOCK_SIZE, prvDiskBlocks, pImage) != prvDiskBlocks)
+      return 1;
+    fclose(pImage);
+    fclose(pExpected);
+
+    prvImageFromFile = true;
+    allCorrect = prvTestCard(argv[1], true, FPGA_CONFIG_SD_CARD_BIT_FILE);
+    free(prvDisk);
+    return allCorrect ? 0 : 1;
+  }
+
+  printf("%u byte bitfile, %.1f us per SPI2 byte, %.0f us per SD card read\n",
+         MODEL_BITFILE_SIZE, MODEL_SPI_BYTE_NS / 1e3, MODEL_SD_READ_LATENCY_NS / 1e3);
+  printf("%-28s %-10s %10s %8s %10s  %s\n",
+         "", "", "SPI2 bytes", "reads", "time", "");
+
+  /* FAT16 without partition table, 2 kB clusters, on an SDSC card */
+  ModelVolume volume;
+  prvFormat(&volume, 32768, 0, false, 4);
+  prvAddDirEntry(&volume, "HEXCONNECT ", 0x08, 0, 0);
+  prvAddDirEntry(&volume, "README  TXT", 0x20, prvWriteFile(&volume, (const uint8_t*)"Hello", 5, false), 5);
+  /* Long name entry, a directory and a deleted file that must be skipped */
+  prvAddDirEntry(&volume, "Bf\0p\0g\0a\0.\0", 0x0F, 0, 0);
+  prvAddDirEntry(&volume, "FPGA    RBF", 0x10, prvWriteFile(&volume, prvBitfile, MODEL_BLOCK_SIZE, false), 0);
+  prvAddDirEntry(&volume, "\xE5PGA    RBF", 0x20, 0, 1234);
+  prvAddDirEntry(&volume, "FPGA    RBF", 0x20,
+                 prvWriteFile(&volume, prvBitfile, MODEL_BITFILE_SIZE, true), MODEL_BITFILE_SIZE);
+  allCorrect &= prvTestCard("FAT16, SDSC card", false, "fpga.rbf");
+  free(prvDisk);
+
+  /* FAT32 partition, 512 byte clusters and a root directory over several
+   * clusters, on an SDHC card */
+  prvFormat(&volume, 2048 + 73728, 2048, true, 1);
+  for (uint32_t i = 0; i < 20; i++)
+  {
+    char name[12];
+    snprintf(name, sizeof(name), "FILL%02u  TXT", i);
+    prvAddDirEntry(&volume, name, 0x20, 0, 0);
+  }
+  prvAddDirEntry(&volume, "FPGA    RBF", 0x20,
+                 prvWriteFile(&volume, prvBitfile, MODEL_BITFILE_SIZE, true), MODEL_BITFILE_SIZE);
+  allCorrect &= prvTestCard("FAT32 partition, SDHC card", true, "FPGA.RBF");
+
+  allCorrect &= prvTestErrors();
+  free(prvDisk);
+
+  return allCorrect ? 0 : 1;
+}
+
+/** Model of the firmware modules --------------------------------------------*/
+uint32_t HAL_GetTick(void)
+{
+  /* Every poll of the time takes a millisecond so timeouts end quickly */
+  return prvTick++;
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+  prvTick += Delay;
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_Init) {}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+  /* nCONFIG low restarts the config */
+  if (GPIOx == GPIOA && GPIO_Pin == MODEL_NCONFIG_PIN && PinState == GPIO_PIN_RESET)
+    prvFpgaCount = 0;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
+{
+  if (GPIOx == GPIOB && GPIO_Pin == MODEL_CONF_DONE_PIN)
+  {
+    if (prvFpgaCount == prvBitfileSize && memcmp(prvFpgaData, prvBitfile, prvBitfileSize) == 0)
+      return GPIO_PIN_SET;
+    return GPIO_PIN_RESET;
+  }
+  else if (GPIOx == GPIOB && GPIO_Pin == MODEL_NSTATUS_PIN)
+    return GPIO_PIN_SET;
+  return GPIO_PIN_RESET;
+}
+
+ErrorStatus SPI2_InitForFpgaConfig()
+{
+  prvSpiMode = ModelSpiMode_Fpga;
+  return SUCCESS;
+}
+
+ErrorStatus SPI2_InitForSdCard(bool IdentificationClock)
+{
+  prvSpiMode = IdentificationClock ? ModelSpiMode_SdCardSlow : ModelSpiMode_SdCard;
+  return SUCCESS;
+}
+
+ErrorStatus SPI2_DeInit()
+{
+  prvSpiMode = ModelSpiMode_Off;
+  return SUCCESS;
+}
+
+uint8_t SPI2_TransferByte(uint8_t Byte)
+{
+  prvSpiBytes++;
+  if (prvSpiMode != ModelSpiMode_SdCard && prvSpiMode != ModelSpiMode_SdCardSlow)
+  {
+    prvModelError("SPI2 is not set up for the SD card");
+    return 0xFF;
+  }
+  if (prvFpgaSelected)
+    prvModelError("SD card traffic with the FPGA selected");
+  if (!prvSdCardSelected)
+  {
+    if (!prvCard.spiMode)
+      prvCard.bytesBeforeReset++;
+    return 0xFF;
+  }
+  return prvSdCardExchange(Byte);
+}
+
+void SPI2_ReadBuffer(uint8_t* pBuffer, uint32_t NumByteToRead)
+{
+  while (NumByteToRead--)
+    *pBuffer++ = SPI2_TransferByte(0xFF);
+}
+
+void SPI2_WriteByte(uint8_t Byte)
+{
+  prvSpiBytes++;
+  if (prvSpiMode != ModelSpiMode_Fpga || !prvFpgaSelected)
+  {
+    prvModelError("FPGA data without SPI2 set up for the FPGA");
+    return;
+  }
+  if (prvFpgaCount < MODEL_FPGA_BUFFER_SIZE)
+    prvFpgaData[prvFpgaCount] = Byte;
+  prvFpgaCount++;
+}
+
+void SPI2_WaitForWriteEnd() {}
+
+void SPI2_WriteBuffer(uint8_t* pBuffer, uint32_t NumByteToWrite)
+{
+  while (NumByteToWrite--)
+    SPI2_WriteByte(*pBuffer++);
+}
+
+void SPI2_SelectDevice(SPI2_Device Device)
+{
+  if (prvSdCardSelected || prvFpgaSelected)
+  {
+    prvModelError("Two devices selected on SPI2");
+    return;
+  }
+  if (Device == SPI2_Device_SdCard)
+    prvSdCardSelected = true;
+  else
+    prvFpgaSelected = true;
+}
+
+void SPI2_DeselectDevice(SPI2_Device Device)
+{
+  if (Device == SPI2_Device_SdCard)
+    prvSdCardSelected = false;
+  else
+    prvFpgaSelected = false;
+}
+
+ErrorStatus SPI_FLASH_EraseBlock(uint32_t BlockAddress)
+{
+  memset(&prvFlash[BlockAddress & ~(SPI_FLASH_BYTES_IN_BLOCK - 1)], 0xFF, SPI_FLASH_BYTES_IN_BLOCK);
+  return SUCCESS;
+}
+
+ErrorStatus SPI_FLASH_StartPageProgram(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite)
+{
+  if ((WriteAddress % SPI_FLASH_BYTES_IN_PAGE) + NumByteToWrite > SPI_FLASH_BYTES_IN_PAGE)
+    prvModelError("Page program crosses a page");
+  for (uint32_t i = 0; i < NumByteToWrite; i++)
+  {
+    if (prvFlash[WriteAddress + i] != 0xFF)
+      prvModelError("Page program of bytes that are not erased");
+    prvFlash[WriteAddress + i] &= pBuffer[i];
+  }
+  return SUCCESS;
+}
+
+void SPI_FLASH_WriteBuffer(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite)
+{
+  for (uint32_t i = 0; i < NumByteToWrite; i++)
+    prvFlash[WriteAddress + i] &= pBuffer[i];
+}
+
+void SPI_FLASH_ReadBuffer(uint8_t* pBuffer, uint32_t ReadAddress, uint32_t NumByteToRead)
+{
+  memcpy(pBuffer, &prvFlash[ReadAddress], NumByteToRead);
+}
+
+ErrorStatus SPI_FLASH_StartReadStream(uint32_t ReadAddress)
+{
+  prvStreamAddress = ReadAddress;
+  return SUCCESS;
+}
+
+void SPI_FLASH_ReadStreamDma(uint8_t* pBuffer, uint32_t NumByteToRead)
+{
+  memcpy(pBuffer, &prvFlash[prvStreamAddress], NumByteToRead);
+  prvStreamAddress += NumByteToRead;
+}
+
+bool SPI_FLASH_ReadStreamDmaBusy() { return false; }
+void SPI_FLASH_EndReadStream() {}
+
+/** Private functions .-------------------------------------------------------*/
+/**
+ * @brief   Configure the FPGA from a card with prvDisk on it, copy the file
+ *          to the FLASH and configure from there
+ * @param   pName: Name of the test
+ * @param   HighCapacity: SDHC card with block addresses
+ * @param   pFileName: Name given to fpga_config.c
+ * @retval  true if everything was right
+ */
+static bool prvTestCard(const char* pName, bool HighCapacity, const char* pFileName)
+{
+  bool correct = true;
+  memset(&prvCard, 0, sizeof(prvCard));
+  prvCard.present = true;
+  prvCard.highCapacity = HighCapacity;
+
+  /* Straight from the card */
+  prvResetStatistics();
+  bool configured = (FPGA_CONFIG_StartFromSdCard(pFileName) == SUCCESS && prvFpgaConfigured());
+  printf("%-28s %-10s %10u %8u %8.0fms  %s\n", pName, "config", prvSpiBytes,
+         prvSdReadCommands, prvTransferMs(), configured ? "OK" : "FAILED");
+  correct &= configured;
+
+  /* Copied to bitfile 2 and checked the same way as a bitfile from the tool */
+  memset(prvFlash, 0xFF, sizeof(prvFlash));
+  prvResetStatistics();
+  bool copied = (FPGA_CONFIG_CopyFromSdCard(pFileName, 2) == SUCCESS && prvCheckSlot(2, pFileName));
+  printf("%-28s %-10s %10u %8u %8.0fms  %s\n", "", "copy", prvSpiBytes,
+         prvSdReadCommands, prvTransferMs(), copied ? "OK" : "FAILED");
+  correct &= copied;
+
+  prvResetStatistics();
+  configured = (FPGA_CONFIG_Start(2) == SUCCESS && prvFpgaConfigured());
+  printf("%-28s %-10s %10u %8s %10s  %s\n", "", "from flash", prvSpiBytes, "", "",
+         configured ? "OK" : "FAILED");
+  correct &= configured;
+
+  if (prvErrors != 0)
+    correct = false;
+  return correct;
+}
+
+/**
+ * @brief   Missing file, no card and a broken cluster chain, uses the FAT32
+ *          image from the last prvTestCard
+ * @param   None
+ * @retval  true if all of them failed the right way
+ */
+static bool prvTestErrors()
+{
+  bool correct = true;
+
+  prvResetStatistics();
+  bool missing = (FPGA_CONFIG_StartFromSdCard("MISSING.RBF") == ERROR && prvFpgaCount == 0 &&
+                  FPGA_CONFIG_StartFromSdCard("TOOLONGNAME.RBF") == ERROR);
+  printf("%-28s %-10s %10s %8s %10s  %s\n", "Missing file", "config", "", "", "",
+         missing ? "OK" : "FAILED");
+  correct &= missing;
+
+  prvCard.present = false;
+  prvResetStatistics();
+  bool noCard = (FPGA_CONFIG_StartFromSdCard("FPGA.RBF") == ERROR && prvFpgaCount == 0);
+  printf("%-28s %-10s %10u %8s %10s  %s\n", "No card", "config", prvSpiBytes, "", "",
+         noCard ? "OK" : "FAILED");
+  correct &= noCard;
+  prvCard.present = true;
+
+  /* End the chain of FPGA.RBF in the middle */
+  ModelVolume volume;
+  prvFormat(&volume, 2048 + 73728, 2048, true, 1);
+  uint32_t firstCluster = prvWriteFile(&volume, prvBitfile, MODEL_BITFILE_SIZE, true);
+  prvAddDirEntry(&volume, "FPGA    RBF", 0x20, firstCluster, MODEL_BITFILE_SIZE);
+  uint32_t cluster = firstCluster;
+  for (uint32_t i = 0; i < 100; i++)
+    cluster = prvGetFat(&volume, cluster);
+  prvSetFat(&volume, cluster, MODEL_FAT32_END_OF_CHAIN);
+
+  prvResetStatistics();
+  bool broken = (FPGA_CONFIG_StartFromSdCard("FPGA.RBF") == ERROR &&
+                 FPGA_CONFIG_LastConfDoneTick() == 0);
+  memset(prvFlash, 0xFF, sizeof(prvFlash));
+  broken &= (FPGA_CONFIG_CopyFromSdCard("FPGA.RBF", 3) == ERROR &&
+             FPGA_CONFIG_VerifyBitFile(3) == FPGA_CONFIG_BitFileStatus_Empty);
+  printf("%-28s %-10s %10s %8s %10s  %s\n", "Broken cluster chain", "both", "", "", "",
+         broken ? "OK" : "FAILED");
+  correct &= broken;
+
+  if (prvErrors != 0)
+    correct = false;
+  return correct;
+}
+
+/**
+ * @brief   Reset the statistics and the FPGA before an operation
+ * @param   None
+ * @retval  None
+ */
+static void prvResetStatistics()
+{
+  prvSpiBytes = 0;
+  prvSdReadCommands = 0;
+  prvFpgaCount = 0;
+}
+
+/**
+ * @brief   Estimate the time on SPI2 of the last operation
+ * @param   None
+ * @retval  Milliseconds
+ */
+static double prvTransferMs()
+{
+  return (prvSpiBytes * MODEL_SPI_BYTE_NS + prvSdReadCommands * MODEL_SD_READ_LATENCY_NS) / 1e6;
+}
+
+/**
+ * @brief   Check a bitfile copied from the card, header and data
+ * @param   BitFileNumber: The bitfile
+ * @param   pFileName: The name that should be in the header
+ * @retval  true if it's right
+ */
+static bool prvCheckSlot(uint8_t BitFileNumber, const char* pFileName)
+{
+  uint8_t* pHeader = &prvFlash[BitFileNumber * MODEL_BITFILE_OFFSET];
+  const uint8_t size[4] = {prvBitfileSize >> 24, prvBitfileSize >> 16, prvBitfileSize >> 8, prvBitfileSize};
+  uint8_t name[64];
+  memset(name, ' ', sizeof(name));
+  memcpy(name, pFileName, strlen(pFileName));
+  const uint8_t date[6] = {16, 10, 19, 12, 34, 56};
+
+  MD5_Context context;
+  uint8_t digest[MD5_DIGEST_SIZE];
+  MD5_Init(&context);
+  MD5_Update(&context, prvBitfile, prvBitfileSize);
+  MD5_Final(&context, digest);
+
+  bool correct = (memcmp(pHeader, size, 4) == 0 &&
+                  memcmp(&pHeader[4], name, 64) == 0 &&
+                  memcmp(&pHeader[4 + 64 + 6], digest, MD5_DIGEST_SIZE) == 0 &&
+                  pHeader[4 + 64 + 6 + 16] == 0xFF &&
+                  memcmp(&pHeader[MODEL_BITFILE_DATA_OFFSET], prvBitfile, prvBitfileSize) == 0 &&
+                  FPGA_CONFIG_VerifyBitFile(BitFileNumber) == FPGA_CONFIG_BitFileStatus_Valid);
+  if (!prvImageFromFile && memcmp(&pHeader[4 + 64], date, 6) != 0)
+    correct = false;
+  return correct;
+}
+
+/**
+ * @brief   Check that the FPGA got the whole bitfile and the extra clocks
+ *          after CONF_DONE
+ * @param   None
+ * @retval  true if it did
+ */
+static bool prvFpgaConfigured()
+{
+  return prvFpgaCount == prvBitfileSize + 1 &&
+         memcmp(prvFpgaData, prvBitfile, prvBitfileSize) == 0 &&
+         FPGA_CONFIG_LastConfDoneTick() != 0;
+}
+
+/**
+ * @brief   Count and print an error in how the firmware uses the hardware
+ * @param   pMessage: What was wrong
+ * @retval  None
+ */
+static void prvModelError(const char* pMessage)
+{
+  if (prvErrors < 10)
+    printf("  %s\n", pMessage);
+  prvErrors++;
+}
+
+/**
+ * @brief   One byte to and from the SD card while it's selected
+ * @param   Byte: The byte from the MCU
+ * @retval  The byte from the card
+ */
+static uint8_t prvSdCardExchange(uint8_t Byte)
+{
+  if (!prvCard.present)
+    return 0xFF;
+
+  /* The card keeps sending blocks until CMD12 */
+  if (prvCard.queueHead == prvCard.queueTail && prvCard.multipleRead)
+    prvSdCardQueueBlock(prvCard.nextBlock++);
+
+  uint8_t response = 0xFF;
+  if (prvCard.queueHead != prvCard.queueTail)
+    response = prvCard.queue[prvCard.queueTail++ % MODEL_SD_QUEUE_SIZE];
+
+  /* Commands start with 01 and are 6 bytes */
+  if (prvCard.commandLength != 0 || (Byte & 0xC0) == 0x40)
+  {
+    prvCard.command[prvCard.commandLength++] = Byte;
+    if (prvCard.commandLength == sizeof(prvCard.command))
+    {
+      prvSdCardCommand();
+      prvCard.commandLength = 0;
+    }
+  }
+  return response;
+}
+
+/**
+ * @brief   Handle a command the SD card has received and queue the response
+ * @param   None
+ * @retval  None
+ */
+static void prvSdCardCommand()
+{
+  uint8_t index = prvCard.command[0] & 0x3F;
+  uint32_t argument = ((uint32_t)prvCard.command[1] << 24) | (prvCard.command[2] << 16) |
+                      (prvCard.command[3] << 8) | prvCard.command[4];
+  uint8_t crc = prvCard.command[5];
+  bool appCommand = prvCard.appCommand;
+  prvCard.appCommand = false;
+
+  /* Only CMD0 with at least 74 clocks before it puts the card in SPI mode */
+  if (!prvCard.spiMode)
+  {
+    if (index != 0 || crc != 0x95 || prvCard.bytesBeforeReset < 10)
+      return;
+    prvCard.spiMode = true;
+  }
+  if (prvSpiMode == ModelSpiMode_SdCard && prvCard.idle)
+    prvModelError("Full speed clock before the card is identified");
+
+  uint8_t r1 = 0x00;
+  if ((index == 0 && crc != 0x95) || (index == 8 && crc != 0x87))
+    r1 = 0x08;
+  else if (index == 0)
+  {
+    prvCard.idle = true;
+    prvCard.multipleRead = false;
+    prvCard.opCondTries = 0;
+  }
+  else if (index == 8)
+  {
+    prvSdCardQueue(0xFF);
+    prvSdCardQueue(prvCard.idle ? 0x01 : 0x00);
+    prvSdCardQueue(0x00);
+    prvSdCardQueue(0x00);
+    prvSdCardQueue((argument >> 8) & 0x0F);
+    prvSdCardQueue(argument & 0xFF);
+    return;
+  }
+  else if (index == 55)
+    prvCard.appCommand = true;
+  else if (index == 41 && appCommand)
+  {
+    /* An SDHC card stays idle for hosts that do not know about them */
+    if (++prvCard.opCondTries >= 3 && (!prvCard.highCapacity || (argument & 0x40000000) != 0))
+      prvCard.idle = false;
+  }
+  else if (index == 58)
+  {
+    prvSdCardQueue(0xFF);
+    prvSdCardQueue(prvCard.idle ? 0x01 : 0x00);
+    prvSdCardQueue(prvCard.idle ? 0x00 : (0x80 | (prvCard.highCapacity ? 0x40 : 0x00)));
+    prvSdCardQueue(0xFF);
+    prvSdCardQueue(0x80);
+    prvSdCardQueue(0x00);
+    return;
+  }
+  else if (index == 16)
+  {
+    if (prvCard.idle || prvCard.highCapacity || argument != MODEL_BLOCK_SIZE)
+      r1 = 0x40;
+  }
+  else if ((index == 17 || index == 18) && !prvCard.idle)
+  {
+    uint32_t block = argument;
+    if (!prvCard.highCapacity)
+      block = argument / MODEL_BLOCK_SIZE;
+    if ((!prvCard.highCapacity && argument % MODEL_BLOCK_SIZE != 0) || block >= prvDiskBlocks)
+      r1 = 0x20;
+    else
+    {
+      prvSdReadCommands++;
+      prvSdCardQueue(0xFF);
+      prvSdCardQueue(0x00);
+      if (index == 17)
+        prvSdCardQueueBlock(block);
+      else
+      {
+        prvCard.multipleRead = true;
+        prvCard.nextBlock = block;
+      }
+      return;
+    }
+  }
+  else if (index == 12 && prvCard.multipleRead)
+  {
+    /* A stuff byte, R1 and busy */
+    prvCard.multipleRead = false;
+    prvCard.queueTail = prvCard.queueHead;
+    prvSdCardQueue(0xFF);
+    prvSdCardQueue(0x00);
+    for (uint32_t i = 0; i < 4; i++)
+      prvSdCardQueue(0x00);
+    return;
+  }
+  else
+    r1 = 0x04;
+
+  if (prvCard.idle)
+    r1 |= 0x01;
+  prvSdCardQueue(0xFF);
+  prvSdCardQueue(r1);
+}
+
+/**
+ * @brief   Add a byte for the SD card to send
+ * @param   Byte: The byte
+ * @retval  None
+ */
+static void prvSdCardQueue(uint8_t Byte)
+{
+  prvCard.queue[prvCard.queueHead++ % MODEL_SD_QUEUE_SIZE] = Byte;
+}
+
+/**
+ * @brief   Add a data block for the SD card to send, the start token, data and
+ *          CRC after some busy bytes
+ * @param   Block: The block on the disk
+ * @retval  None
+ */
+static void prvSdCardQueueBlock(uint32_t Block)
+{
+  for (uint32_t i = 0; i < MODEL_SD_READ_LATENCY_BYTES; i++)
+    prvSdCardQueue(0xFF);
+  if (Block >= prvDiskBlocks)
+  {
+    /* Out of range error token */
+    prvSdCardQueue(0x08);
+    prvCard.multipleRead = false;
+    return;
+  }
+  prvSdCardQueue(0xFE);
+  for (uint32_t i = 0; i < MODEL_BLOCK_SIZE; i++)
+    prvSdCardQueue(prvDisk[(size_t)Block * MODEL_BLOCK_SIZE + i]);
+  prvSdCardQueue(0x00);
+  prvSdCardQueue(0x00);
+}
+
+/**
+ * @brief   Make an empty disk with one FAT volume, the same layout as
+ *          mkfs.fat would use
+ * @param   pVolume: Filled in
+ * @param   DiskBlocks: Size of the disk
+ * @param   VolumeStart: First block of the volume, 0 for no partition table
+ * @param   Fat32: FAT32 or FAT16
+ * @param   BlocksPerCluster: Cluster size
+ * @retval  None
+ */
+static void prvFormat(ModelVolume* pVolume, uint32_t DiskBlocks, uint32_t VolumeStart,
+                      bool Fat32, uint32_t BlocksPerCluster)
+{
+  prvDiskBlocks = DiskBlocks;
+  prvDisk = calloc(DiskBlocks, MODEL_BLOCK_SIZE);
+
+  uint32_t totalBlocks = DiskBlocks - VolumeStart;
+  uint32_t reservedBlocks = Fat32 ? 32 : 1;
+  uint32_t rootEntries = Fat32 ? 0 : 512;
+
+  memset(pVolume, 0, sizeof(*pVolume));
+  pVolume->fat32 = Fat32;
+  pVolume->volumeStart = VolumeStart;
+  pVolume->blocksPerCluster = BlocksPerCluster;
+  pVolume->fatBlocks = ((totalBlocks / BlocksPerCluster) + 2) * (Fat32 ? 4 : 2) / MODEL_BLOCK_SIZE + 1;
+  pVolume->fatStart = VolumeStart + reservedBlocks;
+  pVolume->rootDirStart = pVolume->fatStart + 2 * pVolume->fatBlocks;
+  pVolume->rootDirBlocks = rootEntries * 32 / MODEL_BLOCK_SIZE;
+  pVolume->dataStart = pVolume->rootDirStart + pVolume->rootDirBlocks;
+  pVolume->nextFreeCluster = 2;
+
+  if (VolumeStart != 0)
+  {
+    /* MBR with one partition */
+    uint8_t* pMbr = prvDisk;
+    pMbr[0] = 0xFA;
+    pMbr[446 + 4] = Fat32 ? 0x0C : 0x06;
+    prvPutLe32(&pMbr[446 + 8], VolumeStart);
+    prvPutLe32(&pMbr[446 + 12], totalBlocks);
+    pMbr[510] = 0x55;
+    pMbr[511] = 0xAA;
+  }
+
+  uint8_t* pBoot = &prvDisk[(size_t)VolumeStart * MODEL_BLOCK_SIZE];
+  memcpy(pBoot, "\xEB\x3C\x90MSWIN4.1", 11);
+  prvPutLe16(&pBoot[11], MODEL_BLOCK_SIZE);
+  pBoot[13] = BlocksPerCluster;
+  prvPutLe16(&pBoot[14], reservedBlocks);
+  pBoot[16] = 2;
+  prvPutLe16(&pBoot[17], rootEntries);
+  pBoot[21] = 0xF8;
+  if (totalBlocks < 0x10000)
+    prvPutLe16(&pBoot[19], totalBlocks);
+  else
+    prvPutLe32(&pBoot[32], totalBlocks);
+  if (Fat32)
+  {
+    prvPutLe32(&pBoot[36], pVolume->fatBlocks);
+    prvPutLe32(&pBoot[44], 2);
+  }
+  else
+    prvPutLe16(&pBoot[22], pVolume->fatBlocks);
+  pBoot[510] = 0x55;
+  pBoot[511] = 0xAA;
+
+  prvSetFat(pVolume, 0, Fat32 ? 0x0FFFFFF8 : 0xFFF8);
+  prvSetFat(pVolume, 1, Fat32 ? MODEL_FAT32_END_OF_CHAIN : MODEL_FAT16_END_OF_CHAIN);
+  if (Fat32)
+  {
+    /* The root directory starts in cluster 2 */
+    prvSetFat(pVolume, 2, MODEL_FAT32_END_OF_CHAIN);
+    pVolume->lastRootCluster = 2;
+    pVolume->nextFreeCluster = 3;
+  }
+}
+
+/**
+ * @brief   Set an entry in both FATs
+ * @param   pVolume: The volume
+ * @param   Cluster: The entry
+ * @param   Value: The next cluster or end of chain
+ * @retval  None
+ */
+static void prvSetFat(ModelVolume* pVolume, uint32_t Cluster, uint32_t Value)
+{
+  for (uint32_t fat = 0; fat < 2; fat++)
+  {
+    uint8_t* pFat = &prvDisk[(size_t)(pVolume->fatStart + fat * pVolume->fatBlocks) * MODEL_BLOCK_SIZE];
+    if (pVolume->fat32)
+      prvPutLe32(&pFat[Cluster * 4], Value);
+    else
+      prvPutLe16(&pFat[Cluster * 2], Value);
+  }
+}
+
+/**
+ * @brief   Get the data of a cluster
+ * @param   pVolume: The volume
+ * @param   Cluster: The cluster
+ * @retval  Pointer into prvDisk
+ */
+static uint8_t* prvClusterData(ModelVolume* pVolume, uint32_t Cluster)
+{
+  uint32_t block = pVolume->dataStart + (Cluster - 2) * pVolume->blocksPerCluster;
+  return &prvDisk[(size_t)block * MODEL_BLOCK_SIZE];
+}
+
+/**
+ * @brief   Store a file in free clusters. A fragmented file uses every other
+ *          cluster and the clusters of every pair in the opposite order.
+ * @param   pVolume: The volume
+ * @param   pData: The file
+ * @param   Size: Size of the file
+ * @param   Fragmented: Spread the file as described above
+ * @retval  The first cluster, 0 for an empty file
+ */
+static uint32_t prvWriteFile(ModelVolume* pVolume, const uint8_t* pData, uint32_t Size,
+                             bool Fragmented)
+{
+  uint32_t clusterSize = pVolume->blocksPerCluster * MODEL_BLOCK_SIZE;
+  uint32_t numOfClusters = (Size + clusterSize - 1) / clusterSize;
+  if (numOfClusters == 0)
+    return 0;
+
+  uint32_t start = pVolume->nextFreeCluster;
+  uint32_t endOfChain = pVolume->fat32 ? MODEL_FAT32_END_OF_CHAIN : MODEL_FAT16_END_OF_CHAIN;
+  for (uint32_t i = 0; i < numOfClusters; i++)
+  {
+    uint32_t cluster = start + i;
+    uint32_t nextCluster = start + i + 1;
+    if (Fragmented)
+    {
+      uint32_t next = ((i + 1) ^ 1) < numOfClusters ? ((i + 1) ^ 1) : i + 1;
+      cluster = start + 2 * ((i ^ 1) < numOfClusters ? (i ^ 1) : i);
+      nextCluster = start + 2 * next;
+    }
+    uint32_t count = Size - i * clusterSize;
+    if (count > clusterSize)
+      count = clusterSize;
+    memcpy(prvClusterData(pVolume, cluster), &pData[i * clusterSize], count);
+    prvSetFat(pVolume, cluster, (i + 1 == numOfClusters) ? endOfChain : nextCluster);
+  }
+  pVolume->nextFreeCluster = start + (Fragmented ? 2 : 1) * numOfClusters;
+
+  if (Fragmented && numOfClusters > 1)
+    return start + 2;
+  return start;
+}
+
+/**
+ * @brief   Add an entry to the root directory, a FAT32 root directory gets a
+ *          new cluster after the last file when it's full
+ * @param   pVolume: The volume
+ * @param   pName: The 11 characters of the name
+ * @param   Attributes: The attributes
+ * @param   Cluster: First cluster
+ * @param   Size: Size of the file
+ * @retval  None
+ */
+static void prvAddDirEntry(ModelVolume* pVolume, const char* pName, uint8_t Attributes,
+                           uint32_t Cluster, uint32_t Size)
+{
+  uint32_t index = pVolume->numOfRootEntries++;
+  uint8_t* pEntry;
+  if (!pVolume->fat32)
+    pEntry = &prvDisk[(size_t)pVolume->rootDirStart * MODEL_BLOCK_SIZE + index * 32];
+  else
+  {
+    uint32_t entriesPerCluster = pVolume->blocksPerCluster * MODEL_BLOCK_SIZE / 32;
+    if (index != 0 && index % entriesPerCluster == 0)
+    {
+      /* Leave a gap so the directory is not contiguous either */
+      uint32_t newCluster = pVolume->nextFreeCluster + 1;
+      pVolume->nextFreeCluster += 2;
+      prvSetFat(pVolume, pVolume->lastRootCluster, newCluster);
+      prvSetFat(pVolume, newCluster, MODEL_FAT32_END_OF_CHAIN);
+      pVolume->lastRootCluster = newCluster;
+    }
+    pEntry = prvClusterData(pVolume, pVolume->lastRootCluster) + (index % entriesPerCluster) * 32;
+  }
+
+  memcpy(pEntry, pName, 11);
+  pEntry[11] = Attributes;
+  prvPutLe16(&pEntry[20], Cluster >> 16);
+  prvPutLe16(&pEntry[22], MODEL_FILE_TIME);
+  prvPutLe16(&pEntry[24], MODEL_FILE_DATE);
+  prvPutLe16(&pEntry[26], Cluster & 0xFFFF);
+  prvPutLe32(&pEntry[28], Size);
+}
+
+/**
+ * @brief   Get an entry in the first FAT
+ * @param   pVolume: The volume
+ * @param   Cluster: The entry
+ * @retval  The next cluster or end of chain
+ */
+static uint32_t prvGetFat(ModelVolume* pVolume, uint32_t Cluster)
+{
+  uint8_t* pFat = &prvDisk[(size_t)pVolume->fatStart * MODEL_BLOCK_SIZE];
+  if (pVolume->fat32)
+    return pFat[Cluster * 4] | (pFat[Cluster * 4 + 1] << 8) |
+           (pFat[Cluster * 4 + 2] << 16) | ((uint32_t)pFat[Cluster * 4 + 3] << 24);
+  return pFat[Cluster * 2] | (pFat[Cluster * 2 + 1] << 8);
+}
+
+/**
+ * @brief   Little endian helpers for the FAT structures
+ */
+static void prvPutLe16(uint8_t* pData, uint16_t Value)
+{
+  pData[0] = Value & 0xFF;
+  pData[1] = Value >> 8;
+}
+
+static void prvPutLe32(uint8_t* pData, uint32_t Value)
+{
+  prvPutLe16(pData, Value & 0xFFFF);
+  prvPutLe16(&pData[2], Value >> 16);
+}
+
+/** Interrupt Handlers -------------------------------------------------------*/
@@ -0,0 +1,102 @@
+/**
+ *******************************************************************************
+ * @file    stm32f1xx_hal.h
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief   The parts of the HAL that uart_comm.c and fpga_config.c need so
+ *          they can be built for the host models
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Define to prevent recursive inclusion ------------------------------------*/
+#ifndef STM32F1XX_HAL_H_
+#define STM32F1XX_HAL_H_
+
+/** Includes -----------------------------------------------------------------*/
+#include <stdint.h>
+
+/** Defines ------------------------------------------------------------------*/
+#define GPIOA                 ((GPIO_TypeDef*)1)
+#define GPIOB                 ((GPIO_TypeDef*)2)
+
+#define GPIO_PIN_0            (0x0001)
+#define GPIO_PIN_1            (0x0002)
+#define GPIO_PIN_8            (0x0100)
+#define GPIO_PIN_10           (0x0400)
+#define GPIO_PIN_11           (0x0800)
+
+#define GPIO_MODE_INPUT       (0)
+#define GPIO_MODE_OUTPUT_PP   (1)
+#define GPIO_NOPULL           (0)
+#define GPIO_SPEED_LOW        (0)
+
+#define __HAL_RCC_GPIOA_CLK_ENABLE()
+#define __HAL_RCC_GPIOB_CLK_ENABLE()
+
+/** Typedefs -----------------------------------------------------------------*/
+typedef enum
+{
+  SUCCESS = 0,
+  ERROR = !SUCCESS,
+} ErrorStatus;
+
+typedef enum
+{
+  HAL_UART_STATE_READY,
+  HAL_UART_STATE_BUSY_TX,
+  HAL_UART_STATE_BUSY_TX_RX,
+} HAL_UART_StateTypeDef;
+
+typedef struct
+{
+  HAL_UART_StateTypeDef State;
+} UART_HandleTypeDef;
+
+typedef struct
+{
+  uint32_t Dummy;
+} TIM_HandleTypeDef;
+
+typedef struct
+{
+  uint32_t Dummy;
+} GPIO_TypeDef;
+
+typedef struct
+{
+  uint32_t Pin;
+  uint32_t Mode;
+  uint32_t Pull;
+  uint32_t Speed;
+} GPIO_InitTypeDef;
+
+typedef enum
+{
+  GPIO_PIN_RESET = 0,
+  GPIO_PIN_SET,
+} GPIO_PinState;
+
+/** Function prototypes ------------------------------------------------------*/
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_Init);
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+
+#endif /* STM32F1XX_HAL_H_ */
@@ -0,0 +1,49 @@
+/**
+ *******************************************************************************
+ * @file    bitfile_lz.h
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Define to prevent recursive inclusion ------------------------------------*/
+#ifndef BITFILE_LZ_H_
+#define BITFILE_LZ_H_
+
+/** Includes -----------------------------------------------------------------*/
+#include "stm32f1xx_hal.h"
+#include <stdbool.h>
+
+/** Defines ------------------------------------------------------------------*/
+/* Must match the compressor in fpga-config-over-uart.py */
+#define BITFILE_LZ_WINDOW_SIZE    (1024)
+#define BITFILE_LZ_MIN_MATCH      (3)
+
+/** Typedefs -----------------------------------------------------------------*/
+/* Returns false when there is no more input */
+typedef bool (*BITFILE_LZ_ReadByteFunction)(uint8_t* pByte);
+typedef void (*BITFILE_LZ_WriteByteFunction)(uint8_t Byte);
+
+/** Function prototypes ------------------------------------------------------*/
+ErrorStatus BITFILE_LZ_Decode(uint32_t OutputSize,
+                              BITFILE_LZ_ReadByteFunction ReadByte,
+                              BITFILE_LZ_WriteByteFunction WriteByte);
+
+#endif /* BITFILE_LZ_H_ */
@@ -0,0 +1,57 @@
+/**
+ *******************************************************************************
+ * @file    fat.h
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Define to prevent recursive inclusion ------------------------------------*/
+#ifndef FAT_H_
+#define FAT_H_
+
+/** Includes -----------------------------------------------------------------*/
+#include "stm32f1xx_hal.h"
+
+/** Defines ------------------------------------------------------------------*/
+#define FAT_BLOCK_SIZE    (512)
+
+/** Typedefs -----------------------------------------------------------------*/
+/* Reads whole blocks of FAT_BLOCK_SIZE bytes from the disk, SD_CARD_ReadBlocks
+ * on the board */
+typedef ErrorStatus (*FAT_ReadBlocksFunction)(uint32_t BlockAddress, uint8_t* pBuffer,
+                                              uint32_t NumOfBlocks);
+
+typedef struct
+{
+  uint32_t size;
+  uint32_t bytesLeft;       /* Bytes that FAT_Read has not returned yet */
+  uint32_t cluster;         /* Cluster that is being read */
+  uint32_t blockInCluster;  /* Next block to read in that cluster */
+  uint16_t writeTime;       /* Hour, minute and second / 2 as in the directory */
+  uint16_t writeDate;       /* Year - 1980, month and day as in the directory */
+} FAT_File;
+
+/** Function prototypes ------------------------------------------------------*/
+ErrorStatus FAT_Mount(FAT_ReadBlocksFunction ReadBlocks);
+ErrorStatus FAT_Open(const char* pFileName, FAT_File* pFile);
+uint32_t FAT_Read(FAT_File* pFile, uint8_t* pBuffer, uint32_t MaxNumOfBlocks);
+
+#endif /* FAT_H_ */
@@ -31,11 +31,30 @@
 #include "stm32f1xx_hal.h"
 
 /** Defines ------------------------------------------------------------------*/
+#define FPGA_CONFIG_NUM_OF_BIT_FILES  (5)
+/* Size, name, date, md5, format and compressed size */
+#define FPGA_CONFIG_HEADER_SIZE       (4 + 64 + 6 + 16 + 1 + 4)
+/* Used at power-on when there is no valid bitfile in the first slot */
+#define FPGA_CONFIG_SD_CARD_BIT_FILE  ("FPGA.RBF")
+
 /** Typedefs -----------------------------------------------------------------*/
+typedef enum
+{
+  FPGA_CONFIG_BitFileStatus_Empty = 0,
+  FPGA_CONFIG_BitFileStatus_Valid = 1,
+  FPGA_CONFIG_BitFileStatus_Corrupt = 2,
+} FPGA_CONFIG_BitFileStatus;
+
 /** Function prototypes ------------------------------------------------------*/
 void FPGA_CONFIG_Init();
 uint32_t FPGA_CONFIG_SizeOfBitFile(uint8_t BitFileNumber);
 ErrorStatus FPGA_CONFIG_EraseBitFile(uint8_t BitFileNumber);
 ErrorStatus FPGA_CONFIG_Start(uint8_t BitFileNumber);
+ErrorStatus FPGA_CONFIG_StartFromSdCard(const char* pFileName);
+ErrorStatus FPGA_CONFIG_CopyFromSdCard(const char* pFileName, uint8_t BitFileNumber);
+ErrorStatus FPGA_CONFIG_ReadHeader(uint8_t BitFileNumber, uint8_t* pHeader);
+FPGA_CONFIG_BitFileStatus FPGA_CONFIG_VerifyBitFile(uint8_t BitFileNumber);
+uint32_t FPGA_CONFIG_LastConfDoneTick();
+uint32_t FPGA_CONFIG_LastTransferTime();
 
 #endif /* FPGA_CONFIG_H_ */
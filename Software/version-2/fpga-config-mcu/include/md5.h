@@ -0,0 +1,49 @@
+/**
+ *******************************************************************************
+ * @file    md5.h
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Define to prevent recursive inclusion ------------------------------------*/
+#ifndef MD5_H_
+#define MD5_H_
+
+/** Includes -----------------------------------------------------------------*/
+#include <stdint.h>
+
+/** Defines ------------------------------------------------------------------*/
+#define MD5_DIGEST_SIZE   (16)
+
+/** Typedefs -----------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t state[4];
+  uint32_t count;       /* Number of bytes so far, bitfiles are less than 4 GB */
+  uint8_t block[64];
+} MD5_Context;
+
+/** Function prototypes ------------------------------------------------------*/
+void MD5_Init(MD5_Context* pContext);
+void MD5_Update(MD5_Context* pContext, const uint8_t* pData, uint32_t DataCount);
+void MD5_Final(MD5_Context* pContext, uint8_t* pDigest);
+
+#endif /* MD5_H_ */
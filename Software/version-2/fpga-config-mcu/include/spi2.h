@@ -42,10 +42,14 @@ typedef enum
 /** Function prototypes ------------------------------------------------------*/
 ErrorStatus SPI2_InitGpio();
 ErrorStatus SPI2_InitForFpgaConfig();
-ErrorStatus SPI2_InitForSdCard();
+ErrorStatus SPI2_InitForSdCard(bool IdentificationClock);
 ErrorStatus SPI2_DeInit();
 
 void SPI2_WriteBuffer(uint8_t* pBuffer, uint32_t NumByteToWrite);
+void SPI2_WriteByte(uint8_t Byte);
+void SPI2_WaitForWriteEnd();
+uint8_t SPI2_TransferByte(uint8_t Byte);
+void SPI2_ReadBuffer(uint8_t* pBuffer, uint32_t NumByteToRead);
 void SPI2_SelectDevice(SPI2_Device Device);
 void SPI2_DeselectDevice(SPI2_Device Device);
 
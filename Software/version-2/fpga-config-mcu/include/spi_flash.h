@@ -35,6 +35,7 @@
 #define SPI_FLASH_BYTES_IN_BLOCK    (64*1024)
 #define SPI_FLASH_BYTES_IN_SECTOR   (4*1024)
 #define SPI_FLASH_BYTES_IN_PAGE     (256)
+#define SPI_FLASH_SIZE_BYTES        (0x200000)  /* 16Mbit = 2MByte*/
 
 /** Typedefs -----------------------------------------------------------------*/
 /** Function prototypes ------------------------------------------------------*/
@@ -43,9 +44,15 @@ uint32_t SPI_FLASH_ReadID();
 void SPI_FLASH_WriteBuffer(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite);
 void SPI_FLASH_WriteByte(uint32_t WriteAddress, uint8_t Byte);
 void SPI_FLASH_ReadBuffer(uint8_t* pBuffer, uint32_t ReadAddress, uint32_t NumByteToRead);
+ErrorStatus SPI_FLASH_StartReadStream(uint32_t ReadAddress);
+void SPI_FLASH_ReadStreamDma(uint8_t* pBuffer, uint32_t NumByteToRead);
+bool SPI_FLASH_ReadStreamDmaBusy();
+void SPI_FLASH_EndReadStream();
 ErrorStatus SPI_FLASH_EraseSector(uint32_t SectorAddress);
 ErrorStatus SPI_FLASH_EraseBlock(uint32_t BlockAddress);
 void SPI_FLASH_EraseChip();
+ErrorStatus SPI_FLASH_StartPageProgram(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite);
+bool SPI_FLASH_PageProgramInProgress();
 bool SPI_FLASH_Initialized();
 
 #endif /* SPI_FLASH_H_ */
@@ -38,11 +38,20 @@ UART_HandleTypeDef UART_Handle;
 /** Typedefs -----------------------------------------------------------------*/
 /** Function prototypes ------------------------------------------------------*/
 ErrorStatus UART1_Init();
+ErrorStatus UART1_SetBaudRate(uint32_t BaudRate);
+bool UART1_BaudRateSupported(uint32_t BaudRate);
 uint32_t UART1_BytesAvailable();
+uint32_t UART1_GetRxSpan(uint8_t** ppData);
+void UART1_ConsumeRxSpan(uint32_t Count);
+bool UART1_RxOverflowed();
 void UART1_GetDataFromBuffer(uint8_t* pStorage, uint32_t Size);
 uint8_t UART1_GetByteFromBuffer();
 void UART1_SendByte(uint8_t Byte);
 void UART1_SendBuffer(uint8_t* pData, uint16_t Size);
-void UART1_DataReceivedHandler();
+void UART1_SendBufferDma(uint8_t* pData, uint16_t Size);
+bool UART1_TxBusy();
+void UART1_IdleLineHandler();
+void UART1_ErrorHandler();
+void UART1_RxDmaHandler();
 
 #endif /* UART1_H_ */
@@ -29,11 +29,15 @@
 
 /** Includes -----------------------------------------------------------------*/
 #include "stm32f1xx_hal.h"
+#include <stdbool.h>
 
 /** Global variables ---------------------------------------------------------*/
 /** Defines ------------------------------------------------------------------*/
 /** Typedefs -----------------------------------------------------------------*/
 /** Function prototypes ------------------------------------------------------*/
 void UART_COMM_HandleReceivedByte(uint8_t Byte);
+void UART_COMM_HandleReceivedData(uint8_t* pData, uint32_t DataCount);
+void UART_COMM_ResetParser();
+bool UART_COMM_Process();
 
 #endif /* UART_COMM_H_ */
@@ -0,0 +1,127 @@
+/**
+ *******************************************************************************
+ * @file    bitfile_lz.c
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief   Decoder for the compressed bitfiles made by fpga-config-over-uart.py
+ *
+ *          The data is a sequence of tokens:
+ *            0LLLLLLL                   : L+1 literal bytes follow
+ *            1LLLLLOO OOOOOOOO [E ...]  : copy L+3 bytes from O+1 bytes back,
+ *                                         when L is 31 extra bytes are added
+ *                                         to the length until one is not 255
+ *          Only the last 1024 bytes are needed to decode so the output can be
+ *          streamed without keeping the whole bitfile in RAM.
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Includes -----------------------------------------------------------------*/
+#include "bitfile_lz.h"
+
+/** Private defines ----------------------------------------------------------*/
+#define WINDOW_MASK         (BITFILE_LZ_WINDOW_SIZE - 1)
+#define TOKEN_MATCH_FLAG    (0x80)
+#define LENGTH_EXTENDED     (31)
+
+/** Private typedefs ---------------------------------------------------------*/
+/** Private variables --------------------------------------------------------*/
+/* The last decoded bytes that a match can copy from */
+static uint8_t prvWindow[BITFILE_LZ_WINDOW_SIZE];
+
+/** Private function prototypes ----------------------------------------------*/
+/** Functions ----------------------------------------------------------------*/
+/**
+ * @brief   Decode a compressed bitfile
+ * @param   OutputSize: Size of the decoded bitfile
+ * @param   ReadByte: Called for every compressed byte
+ * @param   WriteByte: Called for every decoded byte
+ * @retval  SUCCESS: OutputSize bytes were decoded
+ * @retval  ERROR: The compressed data is corrupt or ended too early
+ */
+ErrorStatus BITFILE_LZ_Decode(uint32_t OutputSize,
+                              BITFILE_LZ_ReadByteFunction ReadByte,
+                              BITFILE_LZ_WriteByteFunction WriteByte)
+{
+  uint32_t bytesWritten = 0;
+  uint32_t windowIndex = 0;
+  uint8_t token;
+  uint8_t byte;
+
+  while (bytesWritten < OutputSize)
+  {
+    if (!ReadByte(&token))
+      return ERROR;
+
+    if ((token & TOKEN_MATCH_FLAG) == 0)
+    {
+      /* Literal run */
+      uint32_t count = (uint32_t)token + 1;
+      if (count > OutputSize - bytesWritten)
+        return ERROR;
+
+      while (count--)
+      {
+        if (!ReadByte(&byte))
+          return ERROR;
+        prvWindow[windowIndex] = byte;
+        windowIndex = (windowIndex + 1) & WINDOW_MASK;
+        WriteByte(byte);
+      }
+      bytesWritten += (uint32_t)token + 1;
+    }
+    else
+    {
+      /* Match */
+      uint32_t lengthCode = (token >> 2) & 0x1F;
+      uint32_t length = lengthCode + BITFILE_LZ_MIN_MATCH;
+      if (!ReadByte(&byte))
+        return ERROR;
+      uint32_t offset = (((uint32_t)(token & 0x03) << 8) | byte) + 1;
+
+      if (lengthCode == LENGTH_EXTENDED)
+      {
+        do
+        {
+          if (!ReadByte(&byte))
+            return ERROR;
+          length += byte;
+        } while (byte == 255);
+      }
+
+      if (offset > bytesWritten || length > OutputSize - bytesWritten)
+        return ERROR;
+
+      uint32_t sourceIndex = (windowIndex - offset) & WINDOW_MASK;
+      bytesWritten += length;
+      while (length--)
+      {
+        byte = prvWindow[sourceIndex];
+        sourceIndex = (sourceIndex + 1) & WINDOW_MASK;
+        prvWindow[windowIndex] = byte;
+        windowIndex = (windowIndex + 1) & WINDOW_MASK;
+        WriteByte(byte);
+      }
+    }
+  }
+
+  return SUCCESS;
+}
+
+/** Private functions .-------------------------------------------------------*/
+/** Interrupt Handlers -------------------------------------------------------*/
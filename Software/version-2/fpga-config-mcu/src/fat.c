@@ -0,0 +1,425 @@
+/**
+ *******************************************************************************
+ * @file    fat.c
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief   Read only FAT16 and FAT32. Files are found by their 8.3 name in
+ *          the root directory, long file names are skipped. The disk can be
+ *          a superfloppy or have a partition table, then the first FAT
+ *          partition is used.
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Includes -----------------------------------------------------------------*/
+#include "fat.h"
+#include <stdbool.h>
+#include <string.h>
+
+/** Private defines ----------------------------------------------------------*/
+#define FAT_NO_BLOCK                  (0xFFFFFFFF)
+#define FAT_SIGNATURE_OFFSET          (510)
+
+/* Partition table in the MBR */
+#define FAT_PARTITION_TABLE_OFFSET    (446)
+#define FAT_PARTITION_ENTRY_SIZE      (16)
+#define FAT_PARTITION_TYPE_OFFSET     (4)
+#define FAT_PARTITION_START_OFFSET    (8)
+
+/* BIOS parameter block in the boot sector */
+#define FAT_BPB_BYTES_PER_SECTOR      (11)
+#define FAT_BPB_SECTORS_PER_CLUSTER   (13)
+#define FAT_BPB_RESERVED_SECTORS      (14)
+#define FAT_BPB_NUM_OF_FATS           (16)
+#define FAT_BPB_ROOT_ENTRIES          (17)
+#define FAT_BPB_TOTAL_SECTORS_16      (19)
+#define FAT_BPB_FAT_SIZE_16           (22)
+#define FAT_BPB_TOTAL_SECTORS_32      (32)
+#define FAT_BPB_FAT_SIZE_32           (36)
+#define FAT_BPB_ROOT_CLUSTER          (44)
+
+/* Fewer clusters than this is FAT12, which is not supported */
+#define FAT_MIN_FAT16_CLUSTERS        (4085)
+#define FAT_MIN_FAT32_CLUSTERS        (65525)
+
+#define FAT_DIR_ENTRY_SIZE            (32)
+#define FAT_DIR_NAME_SIZE             (11)
+#define FAT_DIR_ATTRIBUTES            (11)
+#define FAT_DIR_CLUSTER_HIGH          (20)
+#define FAT_DIR_WRITE_TIME            (22)
+#define FAT_DIR_WRITE_DATE            (24)
+#define FAT_DIR_CLUSTER_LOW           (26)
+#define FAT_DIR_FILE_SIZE             (28)
+#define FAT_DIR_END                   (0x00)
+#define FAT_DIR_DELETED               (0xE5)
+/* Long file name entries have the volume id bit set */
+#define FAT_ATTRIBUTE_VOLUME_ID       (0x08)
+#define FAT_ATTRIBUTE_DIRECTORY       (0x10)
+
+#define FAT_FIRST_CLUSTER             (2)
+#define FAT_END_OF_CHAIN              (0xFFFFFFFF)
+
+#define LE16(P)   ((uint16_t)((P)[0] | ((P)[1] << 8)))
+#define LE32(P)   ((uint32_t)(P)[0] | ((uint32_t)(P)[1] << 8) | \
+                   ((uint32_t)(P)[2] << 16) | ((uint32_t)(P)[3] << 24))
+
+/** Private typedefs ---------------------------------------------------------*/
+typedef enum
+{
+  FAT_Type_Fat16,
+  FAT_Type_Fat32,
+} FAT_Type;
+
+typedef enum
+{
+  FAT_DirSearch_Continue,
+  FAT_DirSearch_Found,
+  FAT_DirSearch_End,
+} FAT_DirSearch;
+
+/** Private variables --------------------------------------------------------*/
+static FAT_ReadBlocksFunction prvReadBlocks;
+static bool prvMounted = false;
+static FAT_Type prvType;
+static uint32_t prvBlocksPerCluster;
+static uint32_t prvNumOfClusters;
+static uint32_t prvFatStart;            /* First block of the first FAT */
+static uint32_t prvRootDirStart;        /* FAT16, first block of the root directory */
+static uint32_t prvRootDirBlocks;       /* FAT16 */
+static uint32_t prvRootCluster;         /* FAT32 */
+static uint32_t prvDataStart;           /* First block of cluster 2 */
+
+/* Boot sector, FAT and directory blocks, the file data is read straight into
+ * the buffer given to FAT_Read */
+static uint8_t prvBlockBuffer[FAT_BLOCK_SIZE];
+static uint32_t prvBufferedBlock = FAT_NO_BLOCK;
+
+/** Private function prototypes ----------------------------------------------*/
+static uint8_t* prvReadBlock(uint32_t BlockAddress);
+static bool prvIsBootSector(uint8_t* pBlock);
+static bool prvValidCluster(uint32_t Cluster);
+static uint32_t prvClusterToBlock(uint32_t Cluster);
+static uint32_t prvNextCluster(uint32_t Cluster);
+static ErrorStatus prvMakeDirName(const char* pFileName, uint8_t* pDirName);
+static FAT_DirSearch prvSearchDirBlock(uint32_t BlockAddress, uint8_t* pDirName, FAT_File* pFile);
+
+/** Functions ----------------------------------------------------------------*/
+/**
+ * @brief   Find the FAT volume on a disk
+ * @param   ReadBlocks: Function that reads the disk
+ * @retval  ERROR if there is no FAT16 or FAT32 volume
+ */
+ErrorStatus FAT_Mount(FAT_ReadBlocksFunction ReadBlocks)
+{
+  prvMounted = false;
+  prvReadBlocks = ReadBlocks;
+  prvBufferedBlock = FAT_NO_BLOCK;
+
+  uint32_t volumeStart = 0;
+  uint8_t* pBlock = prvReadBlock(0);
+  if (pBlock == 0)
+    return ERROR;
+
+  /* No boot sector first on the disk, look for a FAT partition in the MBR */
+  if (!prvIsBootSector(pBlock))
+  {
+    if (pBlock[FAT_SIGNATURE_OFFSET] != 0x55 || pBlock[FAT_SIGNATURE_OFFSET + 1] != 0xAA)
+      return ERROR;
+
+    for (uint32_t i = 0; i < 4 && volumeStart == 0; i++)
+    {
+      uint8_t* pEntry = &pBlock[FAT_PARTITION_TABLE_OFFSET + i * FAT_PARTITION_ENTRY_SIZE];
+      uint8_t type = pEntry[FAT_PARTITION_TYPE_OFFSET];
+      if (type == 0x04 || type == 0x06 || type == 0x0E ||   /* FAT16 */
+          type == 0x0B || type == 0x0C)                      /* FAT32 */
+        volumeStart = LE32(&pEntry[FAT_PARTITION_START_OFFSET]);
+    }
+    if (volumeStart == 0)
+      return ERROR;
+
+    pBlock = prvReadBlock(volumeStart);
+    if (pBlock == 0 || !prvIsBootSector(pBlock))
+      return ERROR;
+  }
+
+  uint32_t reservedBlocks = LE16(&pBlock[FAT_BPB_RESERVED_SECTORS]);
+  uint32_t numOfFats = pBlock[FAT_BPB_NUM_OF_FATS];
+  uint32_t rootEntries = LE16(&pBlock[FAT_BPB_ROOT_ENTRIES]);
+  uint32_t totalBlocks = LE16(&pBlock[FAT_BPB_TOTAL_SECTORS_16]);
+  if (totalBlocks == 0)
+    totalBlocks = LE32(&pBlock[FAT_BPB_TOTAL_SECTORS_32]);
+  uint32_t fatBlocks = LE16(&pBlock[FAT_BPB_FAT_SIZE_16]);
+  if (fatBlocks == 0)
+    fatBlocks = LE32(&pBlock[FAT_BPB_FAT_SIZE_32]);
+
+  prvBlocksPerCluster = pBlock[FAT_BPB_SECTORS_PER_CLUSTER];
+  prvRootDirBlocks = (rootEntries * FAT_DIR_ENTRY_SIZE + FAT_BLOCK_SIZE - 1) / FAT_BLOCK_SIZE;
+  prvFatStart = volumeStart + reservedBlocks;
+  prvRootDirStart = prvFatStart + numOfFats * fatBlocks;
+  prvDataStart = prvRootDirStart + prvRootDirBlocks;
+
+  uint32_t systemBlocks = reservedBlocks + numOfFats * fatBlocks + prvRootDirBlocks;
+  if (fatBlocks == 0 || totalBlocks <= systemBlocks)
+    return ERROR;
+  prvNumOfClusters = (totalBlocks - systemBlocks) / prvBlocksPerCluster;
+
+  /* The type is decided by the number of clusters and nothing else */
+  if (prvNumOfClusters < FAT_MIN_FAT16_CLUSTERS)
+    return ERROR;
+  else if (prvNumOfClusters < FAT_MIN_FAT32_CLUSTERS)
+    prvType = FAT_Type_Fat16;
+  else
+  {
+    prvType = FAT_Type_Fat32;
+    prvRootCluster = LE32(&pBlock[FAT_BPB_ROOT_CLUSTER]);
+    if (!prvValidCluster(prvRootCluster))
+      return ERROR;
+  }
+
+  prvMounted = true;
+  return SUCCESS;
+}
+
+/**
+ * @brief   Find a file in the root directory
+ * @param   pFileName: 8.3 name of the file, for example "FPGA.RBF", the case
+ *          does not matter
+ * @param   pFile: Set up to read the file from the start
+ * @retval  ERROR if the file was not found or the disk is not mounted
+ */
+ErrorStatus FAT_Open(const char* pFileName, FAT_File* pFile)
+{
+  uint8_t dirName[FAT_DIR_NAME_SIZE];
+  if (!prvMounted || prvMakeDirName(pFileName, dirName) != SUCCESS)
+    return ERROR;
+
+  FAT_DirSearch search = FAT_DirSearch_Continue;
+  if (prvType == FAT_Type_Fat16)
+  {
+    for (uint32_t i = 0; i < prvRootDirBlocks && search == FAT_DirSearch_Continue; i++)
+      search = prvSearchDirBlock(prvRootDirStart + i, dirName, pFile);
+  }
+  else
+  {
+    /* Limit the number of clusters in case the chain loops */
+    uint32_t cluster = prvRootCluster;
+    for (uint32_t n = 0; n < prvNumOfClusters && prvValidCluster(cluster) &&
+                         search == FAT_DirSearch_Continue; n++)
+    {
+      for (uint32_t i = 0; i < prvBlocksPerCluster && search == FAT_DirSearch_Continue; i++)
+        search = prvSearchDirBlock(prvClusterToBlock(cluster) + i, dirName, pFile);
+      if (search == FAT_DirSearch_Continue)
+        cluster = prvNextCluster(cluster);
+    }
+  }
+
+  if (search != FAT_DirSearch_Found)
+    return ERROR;
+  if (pFile->size != 0 && !prvValidCluster(pFile->cluster))
+    return ERROR;
+  return SUCCESS;
+}
+
+/**
+ * @brief   Read the next blocks of a file, at most to the end of the current
+ *          cluster so that it's one read from the disk
+ * @param   pFile: The file
+ * @param   pBuffer: Where to put MaxNumOfBlocks * FAT_BLOCK_SIZE bytes
+ * @param   MaxNumOfBlocks: Size of the buffer in blocks
+ * @retval  Number of bytes of the file that were read, 0 at the end of the
+ *          file or if the read failed which is when pFile->bytesLeft is not 0
+ */
+uint32_t FAT_Read(FAT_File* pFile, uint8_t* pBuffer, uint32_t MaxNumOfBlocks)
+{
+  if (!prvMounted || pFile->bytesLeft == 0 || MaxNumOfBlocks == 0)
+    return 0;
+
+  /* Follow the chain when the last cluster has been read */
+  if (pFile->blockInCluster == prvBlocksPerCluster)
+  {
+    uint32_t nextCluster = prvNextCluster(pFile->cluster);
+    if (!prvValidCluster(nextCluster))
+      return 0;
+    pFile->cluster = nextCluster;
+    pFile->blockInCluster = 0;
+  }
+
+  uint32_t numOfBlocks = MaxNumOfBlocks;
+  if (numOfBlocks > prvBlocksPerCluster - pFile->blockInCluster)
+    numOfBlocks = prvBlocksPerCluster - pFile->blockInCluster;
+  uint32_t blocksLeft = (pFile->bytesLeft + FAT_BLOCK_SIZE - 1) / FAT_BLOCK_SIZE;
+  if (numOfBlocks > blocksLeft)
+    numOfBlocks = blocksLeft;
+
+  uint32_t blockAddress = prvClusterToBlock(pFile->cluster) + pFile->blockInCluster;
+  if (prvReadBlocks(blockAddress, pBuffer, numOfBlocks) != SUCCESS)
+    return 0;
+
+  uint32_t count = numOfBlocks * FAT_BLOCK_SIZE;
+  if (count > pFile->bytesLeft)
+    count = pFile->bytesLeft;
+  pFile->blockInCluster += numOfBlocks;
+  pFile->bytesLeft -= count;
+  return count;
+}
+
+/** Private functions .-------------------------------------------------------*/
+/**
+ * @brief   Read a block into prvBlockBuffer unless it's already there
+ * @param   BlockAddress: The block
+ * @retval  prvBlockBuffer, 0 if the read failed
+ */
+static uint8_t* prvReadBlock(uint32_t BlockAddress)
+{
+  if (BlockAddress != prvBufferedBlock)
+  {
+    prvBufferedBlock = FAT_NO_BLOCK;
+    if (prvReadBlocks(BlockAddress, prvBlockBuffer, 1) != SUCCESS)
+      return 0;
+    prvBufferedBlock = BlockAddress;
+  }
+  return prvBlockBuffer;
+}
+
+/**
+ * @brief   Check if a block is a FAT boot sector with 512 byte sectors
+ * @param   pBlock: The block
+ * @retval  true if it is
+ */
+static bool prvIsBootSector(uint8_t* pBlock)
+{
+  uint8_t sectorsPerCluster = pBlock[FAT_BPB_SECTORS_PER_CLUSTER];
+  return (pBlock[0] == 0xEB || pBlock[0] == 0xE9) &&
+         LE16(&pBlock[FAT_BPB_BYTES_PER_SECTOR]) == FAT_BLOCK_SIZE &&
+         sectorsPerCluster != 0 && (sectorsPerCluster & (sectorsPerCluster - 1)) == 0 &&
+         LE16(&pBlock[FAT_BPB_RESERVED_SECTORS]) != 0 &&
+         pBlock[FAT_BPB_NUM_OF_FATS] != 0;
+}
+
+/**
+ * @brief   Check that a cluster number points to the data area
+ * @param   Cluster: The cluster
+ * @retval  true if it does
+ */
+static bool prvValidCluster(uint32_t Cluster)
+{
+  return Cluster >= FAT_FIRST_CLUSTER && Cluster < prvNumOfClusters + FAT_FIRST_CLUSTER;
+}
+
+/**
+ * @brief   Get the first block of a cluster
+ * @param   Cluster: The cluster
+ * @retval  The block address
+ */
+static uint32_t prvClusterToBlock(uint32_t Cluster)
+{
+  return prvDataStart + (Cluster - FAT_FIRST_CLUSTER) * prvBlocksPerCluster;
+}
+
+/**
+ * @brief   Look up the cluster after a cluster in the first FAT
+ * @param   Cluster: The cluster
+ * @retval  The next cluster, FAT_END_OF_CHAIN at the end or if the read failed
+ */
+static uint32_t prvNextCluster(uint32_t Cluster)
+{
+  uint32_t entrySize = 2;
+  if (prvType == FAT_Type_Fat32)
+    entrySize = 4;
+
+  uint32_t offset = Cluster * entrySize;
+  uint8_t* pBlock = prvReadBlock(prvFatStart + offset / FAT_BLOCK_SIZE);
+  if (pBlock == 0)
+    return FAT_END_OF_CHAIN;
+
+  pBlock += offset % FAT_BLOCK_SIZE;
+  if (prvType == FAT_Type_Fat32)
+    return LE32(pBlock) & 0x0FFFFFFF;
+  else
+    return LE16(pBlock);
+}
+
+/**
+ * @brief   Make the name used in the directory entries, 8 + 3 characters
+ *          padded with spaces
+ * @param   pFileName: The name, for example "FPGA.RBF"
+ * @param   pDirName: Where to put the FAT_DIR_NAME_SIZE characters
+ * @retval  ERROR if the name does not fit
+ */
+static ErrorStatus prvMakeDirName(const char* pFileName, uint8_t* pDirName)
+{
+  memset(pDirName, ' ', FAT_DIR_NAME_SIZE);
+  uint32_t index = 0;
+  uint32_t end = 8;
+  for (; *pFileName != '\0'; pFileName++)
+  {
+    char c = *pFileName;
+    if (c == '.' && end == 8 && index != 0)
+    {
+      index = 8;
+      end = FAT_DIR_NAME_SIZE;
+      continue;
+    }
+    if (index == end || c == '.' || c == ' ')
+      return ERROR;
+    if (c >= 'a' && c <= 'z')
+      c -= 'a' - 'A';
+    pDirName[index++] = c;
+  }
+  return (index != 0) ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief   Look for a file in a block of a directory
+ * @param   BlockAddress: The block
+ * @param   pDirName: The name from prvMakeDirName
+ * @param   pFile: Set up for reading when the file is found
+ * @retval  FAT_DirSearch_Found: The file was found
+ * @retval  FAT_DirSearch_End: The last entry of the directory was found or
+ *          the read failed
+ * @retval  FAT_DirSearch_Continue: Look in the next block
+ */
+static FAT_DirSearch prvSearchDirBlock(uint32_t BlockAddress, uint8_t* pDirName, FAT_File* pFile)
+{
+  uint8_t* pBlock = prvReadBlock(BlockAddress);
+  if (pBlock == 0)
+    return FAT_DirSearch_End;
+
+  for (uint8_t* pEntry = pBlock; pEntry < pBlock + FAT_BLOCK_SIZE; pEntry += FAT_DIR_ENTRY_SIZE)
+  {
+    if (pEntry[0] == FAT_DIR_END)
+      return FAT_DirSearch_End;
+    if (pEntry[0] == FAT_DIR_DELETED ||
+        (pEntry[FAT_DIR_ATTRIBUTES] & (FAT_ATTRIBUTE_VOLUME_ID | FAT_ATTRIBUTE_DIRECTORY)) != 0 ||
+        memcmp(pEntry, pDirName, FAT_DIR_NAME_SIZE) != 0)
+      continue;
+
+    pFile->cluster = LE16(&pEntry[FAT_DIR_CLUSTER_LOW]);
+    if (prvType == FAT_Type_Fat32)
+      pFile->cluster |= (uint32_t)LE16(&pEntry[FAT_DIR_CLUSTER_HIGH]) << 16;
+    pFile->size = LE32(&pEntry[FAT_DIR_FILE_SIZE]);
+    pFile->bytesLeft = pFile->size;
+    pFile->blockInCluster = 0;
+    pFile->writeTime = LE16(&pEntry[FAT_DIR_WRITE_TIME]);
+    pFile->writeDate = LE16(&pEntry[FAT_DIR_WRITE_DATE]);
+    return FAT_DirSearch_Found;
+  }
+  return FAT_DirSearch_Continue;
+}
+
+/** Interrupt Handlers -------------------------------------------------------*/
@@ -27,6 +27,11 @@
 #include "fpga_config.h"
 #include "spi_flash.h"
 #include "spi2.h"
+#include "bitfile_lz.h"
+#include "md5.h"
+#include "sd_card.h"
+#include "fat.h"
+#include <string.h>
 
 /** Private defines ----------------------------------------------------------*/
 #define CONF_DONE_PORT  (GPIOB)
@@ -45,11 +50,56 @@
 #define FPGA_CONFIG_BIT_FILE_OFFSET           (0x00060000)  /* 393216 */
 #define FPGA_CONFIG_BIT_FILE_NUM_OF_BLOCKS    (6)
 #define FPGA_CONFIG_BIT_FILE_MAX_SIZE         (368011)
+#define FPGA_CONFIG_BIT_FILE_DATA_OFFSET      (256)
 
-#define VALID_BITFILE_NUMBER(X) (X > 0 || X <= 5)
+#define FPGA_CONFIG_HEADER_NAME_OFFSET        (4)
+#define FPGA_CONFIG_HEADER_NAME_SIZE          (64)
+#define FPGA_CONFIG_HEADER_DATE_OFFSET        (4 + 64)
+#define FPGA_CONFIG_HEADER_MD5_OFFSET         (4 + 64 + 6)
+/* After size, name, date and md5. Erased (0xFF) for an uncompressed bitfile */
+#define FPGA_CONFIG_HEADER_FORMAT_OFFSET      (90)
+#define FPGA_CONFIG_HEADER_COMPRESSED_OFFSET  (91)
+#define FPGA_CONFIG_HEADER_FORMAT_LZ          (0x01)
+
+/* Two buffers, one is written to the FPGA while the next is read from flash */
+#define FPGA_CONFIG_CHUNK_SIZE                (512)
+/* nSTATUS goes high within a few hundred us after nCONFIG */
+#define FPGA_CONFIG_NSTATUS_TIMEOUT_MS        (100)
+
+#define VALID_BITFILE_NUMBER(X) ((X) > 0 && (X) <= FPGA_CONFIG_NUM_OF_BIT_FILES)
 
 /** Private variables --------------------------------------------------------*/
+static uint8_t prvChunkBuffer[2][FPGA_CONFIG_CHUNK_SIZE];
+
+/* Timing of the last config, see FPGA_CONFIG_LastConfDoneTick */
+static uint32_t prvLastConfDoneTick = 0;
+static uint32_t prvLastTransferTime = 0;
+static uint32_t prvTransferStartTick;
+
+/* State of the data read from flash, see prvNextDataChunk */
+static uint32_t prvDataBytesLeft;
+static uint32_t prvPendingBuffer;
+static uint32_t prvPendingCount;
+static uint8_t* prvReadBuffer;
+static uint32_t prvReadIndex;
+static uint32_t prvReadCount;
+
+static MD5_Context prvMd5Context;
+
 /** Private functions --------------------------------------------------------*/
+static ErrorStatus prvGetDataSize(uint8_t* pHeader, uint32_t* pBitFileSize, uint32_t* pCompressedSize);
+static void prvTransferBitFile(uint32_t DataAddress, uint32_t BitFileSize);
+static ErrorStatus prvTransferCompressedBitFile(uint32_t DataAddress, uint32_t CompressedSize,
+                                                uint32_t BitFileSize);
+static void prvStartDataRead(uint32_t DataAddress, uint32_t DataSize);
+static uint32_t prvNextDataChunk(uint8_t** ppChunk);
+static bool prvReadCompressedByte(uint8_t* pByte);
+static void prvAddByteToMd5(uint8_t Byte);
+static ErrorStatus prvBeginConfig();
+static ErrorStatus prvEndConfig(ErrorStatus TransferStatus);
+static ErrorStatus prvOpenSdCardFile(const char* pFileName, FAT_File* pFile);
+static void prvMakeSdCardHeader(const char* pFileName, FAT_File* pFile, uint8_t* pHeader);
+
 /** Functions ----------------------------------------------------------------*/
 /**
  * @brief   Initializes the FPGA Config
@@ -145,72 +195,25 @@ ErrorStatus FPGA_CONFIG_Start(uint8_t BitFileNumber)
   if (VALID_BITFILE_NUMBER(BitFileNumber))
   {
     uint32_t headerAddress = BitFileNumber * FPGA_CONFIG_BIT_FILE_OFFSET;
-    uint32_t bitFileSize = FPGA_CONFIG_SizeOfBitFile(BitFileNumber);
+    uint8_t header[FPGA_CONFIG_HEADER_SIZE];
+    uint32_t bitFileSize;
+    uint32_t compressedSize;
+    FPGA_CONFIG_ReadHeader(BitFileNumber, header);
 
-    if (bitFileSize != 0 && bitFileSize <= FPGA_CONFIG_BIT_FILE_MAX_SIZE)
+    if (prvGetDataSize(header, &bitFileSize, &compressedSize) == SUCCESS)
     {
-      /**
-       * To begin the configuration, the external host device must generate a
-       * low-to-high transition on the nCONFIG pin
-       */
-      HAL_GPIO_WritePin(NCONFIG_PORT, NCONFIG_PIN, GPIO_PIN_RESET);
-      HAL_Delay(10);
-      HAL_GPIO_WritePin(NCONFIG_PORT, NCONFIG_PIN, GPIO_PIN_SET);
-
-      /**
-       * When nSTATUS is pulled high, the external host device must place the
-       * configuration data one bit at a time on DATA[0]
-       */
-      while (HAL_GPIO_ReadPin(NSTATUS_PORT, NSTATUS_PIN) != GPIO_PIN_SET)
-      {
-        HAL_Delay(10);
-      }
-
-      /** DeInit and init the SPI2 */
-      SPI2_DeInit();
-      SPI2_InitForFpgaConfig();
-      SPI2_SelectDevice(SPI2_Device_Fpga);
-
-      /** Start transferring data from SPI Flash to FPGA */
-      uint8_t dataBuffer[256] = {0};
-      uint32_t bytesLeftToTransfer = bitFileSize;
-      uint32_t currentReadAddress = headerAddress + 256;
-      while (bytesLeftToTransfer)
-      {
-        if (bytesLeftToTransfer >= 256)
-        {
-          /* Get the data from flash */
-          SPI_FLASH_ReadBuffer(dataBuffer, currentReadAddress, 256);
-          currentReadAddress += 256;
-          /* Write the data to the fpga */
-          SPI2_WriteBuffer(dataBuffer, 256);
-          bytesLeftToTransfer -= 256;
-        }
-        else
-        {
-          /* Get the data from flash */
-          SPI_FLASH_ReadBuffer(dataBuffer, currentReadAddress, bytesLeftToTransfer);
-          /* Write the data to the fpga */
-          SPI2_WriteBuffer(dataBuffer, bytesLeftToTransfer);
-          bytesLeftToTransfer = 0;
-        }
-      }
-
-      if (HAL_GPIO_ReadPin(CONF_DONE_PORT, CONF_DONE_PIN) != GPIO_PIN_SET)
-      {
-        /* TODO: ERROR */
-      }
-      else
-      {
-        /* Two DCLK falling edges are required after CONF_DONE goes high to begin the initialization of the device */
-        dataBuffer[0] = 0;
-        SPI2_WriteBuffer(dataBuffer, 1);
-      }
+      if (prvBeginConfig() != SUCCESS)
+        return ERROR;
 
-      SPI2_DeselectDevice(SPI2_Device_Fpga);
-      SPI2_DeInit();
+      /* Start transferring data from SPI Flash to FPGA */
+      ErrorStatus status = SUCCESS;
+      if (compressedSize != 0)
+        status = prvTransferCompressedBitFile(headerAddress + FPGA_CONFIG_BIT_FILE_DATA_OFFSET,
+                                              compressedSize, bitFileSize);
+      else
+        prvTransferBitFile(headerAddress + FPGA_CONFIG_BIT_FILE_DATA_OFFSET, bitFileSize);
 
-      return SUCCESS;
+      return prvEndConfig(status);
     }
     else
       return ERROR;
@@ -219,4 +222,452 @@ ErrorStatus FPGA_CONFIG_Start(uint8_t BitFileNumber)
     return ERROR;
 }
 
+/**
+ * @brief   Configure the FPGA with a bitfile on the SD card
+ * @param   pFileName: 8.3 name of the uncompressed .rbf in the root directory
+ * @retval  ERROR if there is no card or file, or the file could not be read
+ */
+ErrorStatus FPGA_CONFIG_StartFromSdCard(const char* pFileName)
+{
+  FAT_File file;
+  if (prvOpenSdCardFile(pFileName, &file) != SUCCESS)
+  {
+    SPI2_DeInit();
+    return ERROR;
+  }
+  if (prvBeginConfig() != SUCCESS)
+    return ERROR;
+
+  /**
+   * The SD card and the FPGA share SPI2 but not the bit order, so every chunk
+   * is read with the SD card selected and then written with the FPGA
+   * selected. DCLK can be paused at any time during a passive serial config.
+   */
+  ErrorStatus status = SUCCESS;
+  uint8_t* pChunk = prvChunkBuffer[0];
+  while (file.bytesLeft != 0)
+  {
+    SPI2_DeselectDevice(SPI2_Device_Fpga);
+    SPI2_InitForSdCard(false);
+    uint32_t count = FAT_Read(&file, pChunk, sizeof(prvChunkBuffer) / FAT_BLOCK_SIZE);
+    SPI2_InitForFpgaConfig();
+    SPI2_SelectDevice(SPI2_Device_Fpga);
+
+    if (count == 0)
+    {
+      status = ERROR;
+      break;
+    }
+    SPI2_WriteBuffer(pChunk, count);
+  }
+
+  return prvEndConfig(status);
+}
+
+/**
+ * @brief   Copy a bitfile on the SD card to the flash. The header is written
+ *          last so the slot reads as empty if the copy stops half way.
+ * @param   pFileName: 8.3 name of the uncompressed .rbf in the root directory
+ * @param   BitFileNumber: The bitfile to replace
+ * @retval  ERROR if the bitfile number is not valid, there is no card or file,
+ *          or the file could not be read
+ */
+ErrorStatus FPGA_CONFIG_CopyFromSdCard(const char* pFileName, uint8_t BitFileNumber)
+{
+  FAT_File file;
+  if (!VALID_BITFILE_NUMBER(BitFileNumber) || prvOpenSdCardFile(pFileName, &file) != SUCCESS)
+  {
+    SPI2_DeInit();
+    return ERROR;
+  }
+  FPGA_CONFIG_EraseBitFile(BitFileNumber);
+
+  uint32_t headerAddress = BitFileNumber * FPGA_CONFIG_BIT_FILE_OFFSET;
+  uint32_t writeAddress = headerAddress + FPGA_CONFIG_BIT_FILE_DATA_OFFSET;
+  uint8_t* pChunk = prvChunkBuffer[0];
+  ErrorStatus status = SUCCESS;
+  MD5_Init(&prvMd5Context);
+  while (file.bytesLeft != 0)
+  {
+    /* The flash programs the last page of a chunk while the next is read */
+    uint32_t count = FAT_Read(&file, pChunk, sizeof(prvChunkBuffer) / FAT_BLOCK_SIZE);
+    if (count == 0)
+    {
+      status = ERROR;
+      break;
+    }
+    MD5_Update(&prvMd5Context, pChunk, count);
+
+    for (uint32_t offset = 0; offset < count; offset += SPI_FLASH_BYTES_IN_PAGE)
+    {
+      uint32_t pageCount = count - offset;
+      if (pageCount > SPI_FLASH_BYTES_IN_PAGE)
+        pageCount = SPI_FLASH_BYTES_IN_PAGE;
+      SPI_FLASH_StartPageProgram(&pChunk[offset], writeAddress + offset, pageCount);
+    }
+    writeAddress += count;
+  }
+  SPI2_DeInit();
+
+  if (status == SUCCESS)
+  {
+    /* The format and compressed size are left erased, it's not compressed */
+    uint8_t header[FPGA_CONFIG_HEADER_FORMAT_OFFSET];
+    prvMakeSdCardHeader(pFileName, &file, header);
+    MD5_Final(&prvMd5Context, &header[FPGA_CONFIG_HEADER_MD5_OFFSET]);
+    SPI_FLASH_WriteBuffer(header, headerAddress, sizeof(header));
+  }
+  return status;
+}
+
+/**
+ * @brief   Read the header of a bitfile, size, name, date, md5, format and
+ *          compressed size
+ * @param   BitFileNumber: The bitfile
+ * @param   pHeader: Where to put the FPGA_CONFIG_HEADER_SIZE bytes
+ * @retval  ERROR if the bitfile number is not valid
+ */
+ErrorStatus FPGA_CONFIG_ReadHeader(uint8_t BitFileNumber, uint8_t* pHeader)
+{
+  if (!VALID_BITFILE_NUMBER(BitFileNumber))
+    return ERROR;
+
+  SPI_FLASH_ReadBuffer(pHeader, BitFileNumber * FPGA_CONFIG_BIT_FILE_OFFSET, FPGA_CONFIG_HEADER_SIZE);
+  return SUCCESS;
+}
+
+/**
+ * @brief   Check a stored bitfile against the MD5 in its header. A compressed
+ *          bitfile is decompressed so the MD5 is of the same data that is
+ *          written to the FPGA.
+ * @param   BitFileNumber: The bitfile
+ * @retval  FPGA_CONFIG_BitFileStatus_Empty: The slot is erased or not valid
+ * @retval  FPGA_CONFIG_BitFileStatus_Valid: The MD5 matches
+ * @retval  FPGA_CONFIG_BitFileStatus_Corrupt: The header or data is damaged
+ */
+FPGA_CONFIG_BitFileStatus FPGA_CONFIG_VerifyBitFile(uint8_t BitFileNumber)
+{
+  uint8_t header[FPGA_CONFIG_HEADER_SIZE];
+  uint32_t bitFileSize;
+  uint32_t compressedSize;
+  if (FPGA_CONFIG_ReadHeader(BitFileNumber, header) != SUCCESS)
+    return FPGA_CONFIG_BitFileStatus_Empty;
+  if (header[0] == 0xFF && header[1] == 0xFF && header[2] == 0xFF && header[3] == 0xFF)
+    return FPGA_CONFIG_BitFileStatus_Empty;
+  if (prvGetDataSize(header, &bitFileSize, &compressedSize) != SUCCESS)
+    return FPGA_CONFIG_BitFileStatus_Corrupt;
+
+  uint32_t dataAddress = BitFileNumber * FPGA_CONFIG_BIT_FILE_OFFSET + FPGA_CONFIG_BIT_FILE_DATA_OFFSET;
+  ErrorStatus status = SUCCESS;
+  MD5_Init(&prvMd5Context);
+  if (compressedSize != 0)
+  {
+    prvStartDataRead(dataAddress, compressedSize);
+    status = BITFILE_LZ_Decode(bitFileSize, prvReadCompressedByte, prvAddByteToMd5);
+  }
+  else
+  {
+    uint8_t* pChunk;
+    uint32_t count;
+    prvStartDataRead(dataAddress, bitFileSize);
+    while ((count = prvNextDataChunk(&pChunk)) != 0)
+      MD5_Update(&prvMd5Context, pChunk, count);
+  }
+  SPI_FLASH_EndReadStream();
+
+  uint8_t digest[MD5_DIGEST_SIZE];
+  MD5_Final(&prvMd5Context, digest);
+  if (status != SUCCESS || memcmp(digest, &header[FPGA_CONFIG_HEADER_MD5_OFFSET], MD5_DIGEST_SIZE) != 0)
+    return FPGA_CONFIG_BitFileStatus_Corrupt;
+  else
+    return FPGA_CONFIG_BitFileStatus_Valid;
+}
+
+/**
+ * @brief   Get when CONF_DONE went high during the last config
+ * @param   None
+ * @retval  Milliseconds since reset, 0 if CONF_DONE did not go high
+ */
+uint32_t FPGA_CONFIG_LastConfDoneTick()
+{
+  return prvLastConfDoneTick;
+}
+
+/**
+ * @brief   Get how long the bitfile transfer took during the last config
+ * @param   None
+ * @retval  Milliseconds from the first byte read from flash to the last byte
+ *          written to the FPGA
+ */
+uint32_t FPGA_CONFIG_LastTransferTime()
+{
+  return prvLastTransferTime;
+}
+
+/** Private functions .-------------------------------------------------------*/
+/**
+ * @brief   Get the size of the bitfile and of the compressed data from a header
+ * @param   pHeader: The header
+ * @param   pBitFileSize: Where to put the size of the bitfile
+ * @param   pCompressedSize: Where to put the compressed size, 0 if the bitfile
+ *          is not compressed
+ * @retval  ERROR if the sizes are not valid
+ */
+static ErrorStatus prvGetDataSize(uint8_t* pHeader, uint32_t* pBitFileSize, uint32_t* pCompressedSize)
+{
+  uint8_t* pCompressed = &pHeader[FPGA_CONFIG_HEADER_COMPRESSED_OFFSET];
+  *pBitFileSize = (pHeader[0] << 24) | (pHeader[1] << 16) | (pHeader[2] << 8) | (pHeader[3]);
+  *pCompressedSize = 0;
+  if (*pBitFileSize == 0 || *pBitFileSize > FPGA_CONFIG_BIT_FILE_MAX_SIZE)
+    return ERROR;
+
+  if (pHeader[FPGA_CONFIG_HEADER_FORMAT_OFFSET] == FPGA_CONFIG_HEADER_FORMAT_LZ)
+  {
+    *pCompressedSize = (pCompressed[0] << 24) | (pCompressed[1] << 16) |
+                       (pCompressed[2] << 8) | (pCompressed[3]);
+    if (*pCompressedSize == 0 ||
+        *pCompressedSize > FPGA_CONFIG_BIT_FILE_OFFSET - FPGA_CONFIG_BIT_FILE_DATA_OFFSET)
+      return ERROR;
+  }
+  return SUCCESS;
+}
+
+/**
+ * @brief   Write an uncompressed bitfile to the FPGA
+ * @param   DataAddress: Address of the bitfile in the flash
+ * @param   BitFileSize: Size of the bitfile
+ * @retval  None
+ */
+static void prvTransferBitFile(uint32_t DataAddress, uint32_t BitFileSize)
+{
+  uint8_t* pChunk;
+  uint32_t count;
+
+  prvStartDataRead(DataAddress, BitFileSize);
+  while ((count = prvNextDataChunk(&pChunk)) != 0)
+    SPI2_WriteBuffer(pChunk, count);
+  SPI_FLASH_EndReadStream();
+}
+
+/**
+ * @brief   Decompress a bitfile while it's written to the FPGA
+ * @param   DataAddress: Address of the compressed data in the flash
+ * @param   CompressedSize: Size of the compressed data
+ * @param   BitFileSize: Size of the bitfile after decompression
+ * @retval  SUCCESS: The whole bitfile was written
+ * @retval  ERROR: The compressed data is corrupt
+ */
+static ErrorStatus prvTransferCompressedBitFile(uint32_t DataAddress, uint32_t CompressedSize,
+                                                uint32_t BitFileSize)
+{
+  prvStartDataRead(DataAddress, CompressedSize);
+  ErrorStatus status = BITFILE_LZ_Decode(BitFileSize, prvReadCompressedByte, SPI2_WriteByte);
+  SPI2_WaitForWriteEnd();
+
+  SPI_FLASH_EndReadStream();
+  return status;
+}
+
+/**
+ * @brief   Start reading data from the flash. It's read as one continuous
+ *          stream with DMA into one buffer while the other one is used, end
+ *          with SPI_FLASH_EndReadStream.
+ * @param   DataAddress: Address of the data
+ * @param   DataSize: Number of bytes to read
+ * @retval  None
+ */
+static void prvStartDataRead(uint32_t DataAddress, uint32_t DataSize)
+{
+  prvDataBytesLeft = DataSize;
+  prvPendingBuffer = 0;
+  prvPendingCount = prvDataBytesLeft;
+  if (prvPendingCount > FPGA_CONFIG_CHUNK_SIZE)
+    prvPendingCount = FPGA_CONFIG_CHUNK_SIZE;
+  prvDataBytesLeft -= prvPendingCount;
+  prvReadIndex = 0;
+  prvReadCount = 0;
+
+  SPI_FLASH_StartReadStream(DataAddress);
+  SPI_FLASH_ReadStreamDma(prvChunkBuffer[prvPendingBuffer], prvPendingCount);
+}
+
+/**
+ * @brief   Get the next chunk of data, starts reading the one after it from
+ *          the flash before returning. The chunk is valid until the next call.
+ * @param   ppChunk: Where to put a pointer to the chunk
+ * @retval  Number of bytes in the chunk, 0 if all data has been read
+ */
+static uint32_t prvNextDataChunk(uint8_t** ppChunk)
+{
+  uint32_t count = prvPendingCount;
+  if (count == 0)
+    return 0;
+
+  /* Wait for the pending buffer to be filled and start on the next one */
+  while (SPI_FLASH_ReadStreamDmaBusy());
+  *ppChunk = prvChunkBuffer[prvPendingBuffer];
+
+  prvPendingBuffer ^= 1;
+  prvPendingCount = prvDataBytesLeft;
+  if (prvPendingCount > FPGA_CONFIG_CHUNK_SIZE)
+    prvPendingCount = FPGA_CONFIG_CHUNK_SIZE;
+  prvDataBytesLeft -= prvPendingCount;
+  if (prvPendingCount != 0)
+    SPI_FLASH_ReadStreamDma(prvChunkBuffer[prvPendingBuffer], prvPendingCount);
+
+  return count;
+}
+
+/**
+ * @brief   Get the next compressed byte
+ * @param   pByte: Where to put the byte
+ * @retval  false if all compressed data has been read
+ */
+static bool prvReadCompressedByte(uint8_t* pByte)
+{
+  if (prvReadIndex == prvReadCount)
+  {
+    prvReadCount = prvNextDataChunk(&prvReadBuffer);
+    prvReadIndex = 0;
+    if (prvReadCount == 0)
+      return false;
+  }
+
+  *pByte = prvReadBuffer[prvReadIndex++];
+  return true;
+}
+
+/**
+ * @brief   Add a decompressed byte to the MD5 of FPGA_CONFIG_VerifyBitFile
+ * @param   Byte: The byte
+ * @retval  None
+ */
+static void prvAddByteToMd5(uint8_t Byte)
+{
+  MD5_Update(&prvMd5Context, &Byte, 1);
+}
+
+/**
+ * @brief   Start a config, pulse nCONFIG and wait for the FPGA to be ready
+ *          for data. Leaves SPI2 set up with the FPGA selected.
+ * @param   None
+ * @retval  ERROR if nSTATUS did not go high
+ */
+static ErrorStatus prvBeginConfig()
+{
+  prvLastConfDoneTick = 0;
+  prvLastTransferTime = 0;
+
+  /**
+   * To begin the configuration, the external host device must generate a
+   * low-to-high transition on the nCONFIG pin
+   */
+  HAL_GPIO_WritePin(NCONFIG_PORT, NCONFIG_PIN, GPIO_PIN_RESET);
+  HAL_Delay(1);
+  HAL_GPIO_WritePin(NCONFIG_PORT, NCONFIG_PIN, GPIO_PIN_SET);
+
+  /**
+   * When nSTATUS is pulled high, the external host device must place the
+   * configuration data one bit at a time on DATA[0]
+   */
+  uint32_t startTick = HAL_GetTick();
+  while (HAL_GPIO_ReadPin(NSTATUS_PORT, NSTATUS_PIN) != GPIO_PIN_SET)
+  {
+    if (HAL_GetTick() - startTick > FPGA_CONFIG_NSTATUS_TIMEOUT_MS)
+      return ERROR;
+  }
+
+  /** DeInit and init the SPI2 */
+  SPI2_DeInit();
+  SPI2_InitForFpgaConfig();
+  SPI2_SelectDevice(SPI2_Device_Fpga);
+
+  prvTransferStartTick = HAL_GetTick();
+  return SUCCESS;
+}
+
+/**
+ * @brief   Finish a config started with prvBeginConfig when all data has been
+ *          written, the FPGA must still be selected
+ * @param   TransferStatus: ERROR if the bitfile could not be read
+ * @retval  TransferStatus
+ */
+static ErrorStatus prvEndConfig(ErrorStatus TransferStatus)
+{
+  prvLastTransferTime = HAL_GetTick() - prvTransferStartTick;
+
+  if (TransferStatus != SUCCESS)
+  {
+    /* Corrupt or unreadable data, the FPGA will not finish the config */
+  }
+  else if (HAL_GPIO_ReadPin(CONF_DONE_PORT, CONF_DONE_PIN) != GPIO_PIN_SET)
+  {
+    /* TODO: ERROR */
+  }
+  else
+  {
+    /* SysTick starts in HAL_Init so this is close to the time since power-on for the first config */
+    prvLastConfDoneTick = HAL_GetTick();
+
+    /* Two DCLK falling edges are required after CONF_DONE goes high to begin the initialization of the device */
+    prvChunkBuffer[0][0] = 0;
+    SPI2_WriteBuffer(prvChunkBuffer[0], 1);
+  }
+
+  SPI2_DeselectDevice(SPI2_Device_Fpga);
+  SPI2_DeInit();
+
+  return TransferStatus;
+}
+
+/**
+ * @brief   Initialize the SD card and open a bitfile on it, SPI2 is left set
+ *          up for the SD card
+ * @param   pFileName: 8.3 name of the file in the root directory
+ * @param   pFile: The opened file
+ * @retval  ERROR if there is no card or file or the size is not valid
+ */
+static ErrorStatus prvOpenSdCardFile(const char* pFileName, FAT_File* pFile)
+{
+  if (SD_CARD_Init() != SUCCESS ||
+      FAT_Mount(SD_CARD_ReadBlocks) != SUCCESS ||
+      FAT_Open(pFileName, pFile) != SUCCESS)
+    return ERROR;
+
+  if (pFile->size == 0 || pFile->size > FPGA_CONFIG_BIT_FILE_MAX_SIZE)
+    return ERROR;
+  return SUCCESS;
+}
+
+/**
+ * @brief   Fill in the size, name and date of the header for a bitfile copied
+ *          from the SD card, the same as fpga-config-over-uart.py does
+ * @param   pFileName: Name of the file
+ * @param   pFile: The file, for the size and date
+ * @param   pHeader: Where to put the first FPGA_CONFIG_HEADER_MD5_OFFSET bytes
+ * @retval  None
+ */
+static void prvMakeSdCardHeader(const char* pFileName, FAT_File* pFile, uint8_t* pHeader)
+{
+  pHeader[0] = (pFile->size >> 24) & 0xFF;
+  pHeader[1] = (pFile->size >> 16) & 0xFF;
+  pHeader[2] = (pFile->size >> 8) & 0xFF;
+  pHeader[3] = (pFile->size) & 0xFF;
+
+  /* Filled with spaces */
+  uint8_t* pName = &pHeader[FPGA_CONFIG_HEADER_NAME_OFFSET];
+  memset(pName, ' ', FPGA_CONFIG_HEADER_NAME_SIZE);
+  for (uint32_t i = 0; i < FPGA_CONFIG_HEADER_NAME_SIZE && pFileName[i] != '\0'; i++)
+    pName[i] = pFileName[i];
+
+  /* YYMMDDHHMMSS, FAT years start at 1980 */
+  uint8_t* pDate = &pHeader[FPGA_CONFIG_HEADER_DATE_OFFSET];
+  pDate[0] = ((pFile->writeDate >> 9) + 1980) % 100;
+  pDate[1] = (pFile->writeDate >> 5) & 0x0F;
+  pDate[2] = pFile->writeDate & 0x1F;
+  pDate[3] = pFile->writeTime >> 11;
+  pDate[4] = (pFile->writeTime >> 5) & 0x3F;
+  pDate[5] = (pFile->writeTime & 0x1F) * 2;
+}
+
 /** Interrupt Handlers -------------------------------------------------------*/
@@ -53,7 +53,8 @@ int main()
   /* Try to configure the FPGA with the first bit file */
   if (FPGA_CONFIG_Start(1) != SUCCESS)
   {
-    /* No valid bit file at first position */
+    /* No valid bit file at first position, try the SD card */
+    FPGA_CONFIG_StartFromSdCard(FPGA_CONFIG_SD_CARD_BIT_FILE);
   }
 
   LED_SetBlinkPeriod(1000);
@@ -61,10 +62,26 @@ int main()
   /* Main loop */
   while (1)
   {
-    /* If there is data available we should handle it */
-    while (UART1_BytesAvailable())
+    /* Bytes were overwritten before they were parsed */
+    if (UART1_RxOverflowed())
+      UART_COMM_ResetParser();
+
+    /* If there is data available we should handle it, one span at a time so
+     * the flash gets the next page as soon as it is done with the last one */
+    uint8_t* pData;
+    uint32_t count = UART1_GetRxSpan(&pData);
+    if (count != 0)
     {
-      UART_COMM_HandleReceivedByte(UART1_GetByteFromBuffer());
+      UART_COMM_HandleReceivedData(pData, count);
+      UART1_ConsumeRxSpan(count);
     }
+
+    /* Start programming queued pages while receiving, sleep until the next
+     * DMA, idle line or SysTick interrupt when there is nothing to do */
+    bool busy = UART_COMM_Process();
+    __disable_irq();
+    if (!busy && UART1_BytesAvailable() == 0)
+      __WFI();
+    __enable_irq();
   }
 }
@@ -0,0 +1,198 @@
+/**
+ *******************************************************************************
+ * @file    md5.c
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief   MD5 (RFC 1321), used to check a stored bitfile against the
+ *          checksum in its header
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Includes -----------------------------------------------------------------*/
+#include "md5.h"
+#include <string.h>
+
+/** Private defines ----------------------------------------------------------*/
+#define ROTATE_LEFT(X, N)   (((X) << (N)) | ((X) >> (32 - (N))))
+
+/** Private typedefs ---------------------------------------------------------*/
+/** Private variables --------------------------------------------------------*/
+static const uint32_t prvK[64] = {
+  0xD76AA478, 0xE8C7B756, 0x242070DB, 0xC1BDCEEE, 0xF57C0FAF, 0x4787C62A, 0xA8304613, 0xFD469501,
+  0x698098D8, 0x8B44F7AF, 0xFFFF5BB1, 0x895CD7BE, 0x6B901122, 0xFD987193, 0xA679438E, 0x49B40821,
+  0xF61E2562, 0xC040B340, 0x265E5A51, 0xE9B6C7AA, 0xD62F105D, 0x02441453, 0xD8A1E681, 0xE7D3FBC8,
+  0x21E1CDE6, 0xC33707D6, 0xF4D50D87, 0x455A14ED, 0xA9E3E905, 0xFCEFA3F8, 0x676F02D9, 0x8D2A4C8A,
+  0xFFFA3942, 0x8771F681, 0x6D9D6122, 0xFDE5380C, 0xA4BEEA44, 0x4BDECFA9, 0xF6BB4B60, 0xBEBFBC70,
+  0x289B7EC6, 0xEAA127FA, 0xD4EF3085, 0x04881D05, 0xD9D4D039, 0xE6DB99E5, 0x1FA27CF8, 0xC4AC5665,
+  0xF4292244, 0x432AFF97, 0xAB9423A7, 0xFC93A039, 0x655B59C3, 0x8F0CCC92, 0xFFEFF47D, 0x85845DD1,
+  0x6FA87E4F, 0xFE2CE6E0, 0xA3014314, 0x4E0811A1, 0xF7537E82, 0xBD3AF235, 0x2AD7D2BB, 0xEB86D391,
+};
+
+/* Rotation for each round, the same four are used for every step in it */
+static const uint8_t prvShift[4][4] = {
+  {7, 12, 17, 22}, {5, 9, 14, 20}, {4, 11, 16, 23}, {6, 10, 15, 21},
+};
+
+/** Private function prototypes ----------------------------------------------*/
+static void prvMD5_Transform(uint32_t* pState, const uint8_t* pBlock);
+
+/** Functions ----------------------------------------------------------------*/
+/**
+ * @brief   Start a new MD5 calculation
+ * @param   pContext: The context to initialize
+ * @retval  None
+ */
+void MD5_Init(MD5_Context* pContext)
+{
+  pContext->state[0] = 0x67452301;
+  pContext->state[1] = 0xEFCDAB89;
+  pContext->state[2] = 0x98BADCFE;
+  pContext->state[3] = 0x10325476;
+  pContext->count = 0;
+}
+
+/**
+ * @brief   Add data to the MD5 calculation
+ * @param   pContext: The context
+ * @param   pData: The data
+ * @param   DataCount: Number of bytes
+ * @retval  None
+ */
+void MD5_Update(MD5_Context* pContext, const uint8_t* pData, uint32_t DataCount)
+{
+  uint32_t blockIndex = pContext->count & 0x3F;
+  pContext->count += DataCount;
+
+  /* Fill a started block first */
+  if (blockIndex != 0)
+  {
+    uint32_t count = 64 - blockIndex;
+    if (count > DataCount)
+      count = DataCount;
+    memcpy(&pContext->block[blockIndex], pData, count);
+    pData += count;
+    DataCount -= count;
+    blockIndex += count;
+    if (blockIndex < 64)
+      return;
+    prvMD5_Transform(pContext->state, pContext->block);
+  }
+
+  /* Whole blocks directly from the data */
+  while (DataCount >= 64)
+  {
+    prvMD5_Transform(pContext->state, pData);
+    pData += 64;
+    DataCount -= 64;
+  }
+
+  memcpy(pContext->block, pData, DataCount);
+}
+
+/**
+ * @brief   Finish the MD5 calculation
+ * @param   pContext: The context, has to be initialized again to be reused
+ * @param   pDigest: Where to put the MD5_DIGEST_SIZE bytes of the digest
+ * @retval  None
+ */
+void MD5_Final(MD5_Context* pContext, uint8_t* pDigest)
+{
+  uint32_t bitCount = pContext->count << 3;
+  uint32_t highBitCount = pContext->count >> 29;
+  uint32_t blockIndex = pContext->count & 0x3F;
+
+  /* Pad with 0x80 and zeros so that the length fits in the end of a block */
+  pContext->block[blockIndex++] = 0x80;
+  if (blockIndex > 56)
+  {
+    memset(&pContext->block[blockIndex], 0, 64 - blockIndex);
+    prvMD5_Transform(pContext->state, pContext->block);
+    blockIndex = 0;
+  }
+  memset(&pContext->block[blockIndex], 0, 56 - blockIndex);
+  for (uint32_t i = 0; i < 4; i++)
+  {
+    pContext->block[56 + i] = (bitCount >> (i * 8)) & 0xFF;
+    pContext->block[60 + i] = (highBitCount >> (i * 8)) & 0xFF;
+  }
+  prvMD5_Transform(pContext->state, pContext->block);
+
+  for (uint32_t i = 0; i < 16; i++)
+    pDigest[i] = (pContext->state[i / 4] >> ((i % 4) * 8)) & 0xFF;
+}
+
+/** Private functions .-------------------------------------------------------*/
+/**
+ * @brief   Process one 64 byte block
+ * @param   pState: The MD5 state
+ * @param   pBlock: The block
+ * @retval  None
+ */
+static void prvMD5_Transform(uint32_t* pState, const uint8_t* pBlock)
+{
+  uint32_t m[16];
+  for (uint32_t i = 0; i < 16; i++)
+    m[i] = (uint32_t)pBlock[i*4] | ((uint32_t)pBlock[i*4 + 1] << 8) |
+           ((uint32_t)pBlock[i*4 + 2] << 16) | ((uint32_t)pBlock[i*4 + 3] << 24);
+
+  uint32_t a = pState[0];
+  uint32_t b = pState[1];
+  uint32_t c = pState[2];
+  uint32_t d = pState[3];
+
+  for (uint32_t i = 0; i < 64; i++)
+  {
+    uint32_t f;
+    uint32_t g;
+    if (i < 16)
+    {
+      f = (b & c) | (~b & d);
+      g = i;
+    }
+    else if (i < 32)
+    {
+      f = (d & b) | (~d & c);
+      g = (5*i + 1) & 0x0F;
+    }
+    else if (i < 48)
+    {
+      f = b ^ c ^ d;
+      g = (3*i + 5) & 0x0F;
+    }
+    else
+    {
+      f = c ^ (b | ~d);
+      g = (7*i) & 0x0F;
+    }
+
+    uint32_t temp = d;
+    d = c;
+    c = b;
+    f += a + prvK[i] + m[g];
+    b += ROTATE_LEFT(f, prvShift[i / 16][i % 4]);
+    a = temp;
+  }
+
+  pState[0] += a;
+  pState[1] += b;
+  pState[2] += c;
+  pState[3] += d;
+}
+
+/** Interrupt Handlers -------------------------------------------------------*/
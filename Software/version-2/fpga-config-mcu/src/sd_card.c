@@ -0,0 +1,322 @@
+/**
+ *******************************************************************************
+ * @file    sd_card.c
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief   Read only access to an SD card in SPI mode on SPI2. Handles SDSC
+ *          cards with byte addresses and SDHC/SDXC cards with block
+ *          addresses, the block size is always SD_CARD_BLOCK_SIZE.
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Includes -----------------------------------------------------------------*/
+#include "sd_card.h"
+#include "spi2.h"
+#include <stdbool.h>
+
+/** Private defines ----------------------------------------------------------*/
+#define SD_CARD_CMD_GO_IDLE_STATE         (0)
+#define SD_CARD_CMD_SEND_IF_COND          (8)
+#define SD_CARD_CMD_STOP_TRANSMISSION     (12)
+#define SD_CARD_CMD_SET_BLOCKLEN          (16)
+#define SD_CARD_CMD_READ_SINGLE_BLOCK     (17)
+#define SD_CARD_CMD_READ_MULTIPLE_BLOCK   (18)
+#define SD_CARD_CMD_APP_CMD               (55)
+#define SD_CARD_CMD_READ_OCR              (58)
+#define SD_CARD_ACMD_SD_SEND_OP_COND      (41)
+
+/* CMD0 and CMD8 are the only commands that need a valid CRC in SPI mode */
+#define SD_CARD_CMD0_CRC                  (0x95)
+#define SD_CARD_CMD8_CRC                  (0x87)
+#define SD_CARD_DUMMY_CRC                 (0x01)
+
+/* 2.7-3.6 V and check pattern 0xAA */
+#define SD_CARD_CMD8_ARGUMENT             (0x000001AA)
+#define SD_CARD_ACMD41_HCS                (0x40000000)
+#define SD_CARD_OCR_CCS                   (0x40)
+
+#define SD_CARD_R1_READY                  (0x00)
+#define SD_CARD_R1_IDLE                   (0x01)
+#define SD_CARD_R1_ILLEGAL_COMMAND        (0x04)
+#define SD_CARD_R1_START_BIT              (0x80)
+/* The response comes within 8 bytes after the command */
+#define SD_CARD_R1_MAX_WAIT_BYTES         (10)
+
+#define SD_CARD_DATA_START_TOKEN          (0xFE)
+
+#define SD_CARD_INIT_TIMEOUT_MS           (1000)
+#define SD_CARD_READ_TIMEOUT_MS           (100)
+#define SD_CARD_BUSY_TIMEOUT_MS           (250)
+
+/** Private typedefs ---------------------------------------------------------*/
+/** Private variables --------------------------------------------------------*/
+static bool prvInitialized = false;
+/* SDHC and SDXC cards are addressed in blocks, SDSC cards in bytes */
+static bool prvBlockAddressing = false;
+
+/** Private function prototypes ----------------------------------------------*/
+static ErrorStatus prvIdentifyCard();
+static uint8_t prvSendCommand(uint8_t Command, uint32_t Argument);
+static uint8_t prvSendAppCommand(uint8_t Command, uint32_t Argument);
+static ErrorStatus prvReadDataBlock(uint8_t* pBuffer);
+static ErrorStatus prvWaitWhileBusy();
+static void prvEndTransfer();
+
+/** Functions ----------------------------------------------------------------*/
+/**
+ * @brief   Initializes the SD Card, leaves SPI2 at full speed
+ * @param   None
+ * @retval  ERROR if there is no card or it could not be identified
+ */
+ErrorStatus SD_CARD_Init()
+{
+  prvInitialized = false;
+  SPI2_DeInit();
+  SPI2_InitForSdCard(true);
+
+  /* At least 74 clocks with CS high before the first command */
+  SPI2_DeselectDevice(SPI2_Device_SdCard);
+  for (uint32_t i = 0; i < 10; i++)
+    SPI2_TransferByte(0xFF);
+
+  SPI2_SelectDevice(SPI2_Device_SdCard);
+  ErrorStatus status = prvIdentifyCard();
+  prvEndTransfer();
+
+  SPI2_InitForSdCard(false);
+  prvInitialized = (status == SUCCESS);
+  return status;
+}
+
+/**
+ * @brief   Read blocks from the SD Card. SPI2 must be initialized with
+ *          SPI2_InitForSdCard.
+ * @param   BlockAddress: The first block to read
+ * @param   pBuffer: Where to put NumOfBlocks * SD_CARD_BLOCK_SIZE bytes
+ * @param   NumOfBlocks: Number of blocks to read
+ * @retval  ERROR if the card is not initialized or the read failed
+ */
+ErrorStatus SD_CARD_ReadBlocks(uint32_t BlockAddress, uint8_t* pBuffer, uint32_t NumOfBlocks)
+{
+  if (!prvInitialized)
+    return ERROR;
+  if (NumOfBlocks == 0)
+    return SUCCESS;
+
+  uint32_t argument = BlockAddress;
+  if (!prvBlockAddressing)
+    argument *= SD_CARD_BLOCK_SIZE;
+
+  bool multipleBlocks = (NumOfBlocks > 1);
+  uint8_t command = SD_CARD_CMD_READ_SINGLE_BLOCK;
+  if (multipleBlocks)
+    command = SD_CARD_CMD_READ_MULTIPLE_BLOCK;
+
+  SPI2_SelectDevice(SPI2_Device_SdCard);
+  ErrorStatus status = ERROR;
+  if (prvSendCommand(command, argument) == SD_CARD_R1_READY)
+  {
+    status = SUCCESS;
+    while (status == SUCCESS && NumOfBlocks != 0)
+    {
+      status = prvReadDataBlock(pBuffer);
+      pBuffer += SD_CARD_BLOCK_SIZE;
+      NumOfBlocks--;
+    }
+
+    /* The card keeps sending blocks until it's told to stop */
+    if (multipleBlocks)
+    {
+      prvSendCommand(SD_CARD_CMD_STOP_TRANSMISSION, 0);
+      if (prvWaitWhileBusy() != SUCCESS)
+        status = ERROR;
+    }
+  }
+  prvEndTransfer();
+
+  return status;
+}
+
+/** Private functions .-------------------------------------------------------*/
+/**
+ * @brief   Go through the identification of the card, the card must be
+ *          selected
+ * @param   None
+ * @retval  ERROR if the card did not answer or is not an SD card
+ */
+static ErrorStatus prvIdentifyCard()
+{
+  /* Reset, the card enters SPI mode because CS is low */
+  uint8_t response = SD_CARD_R1_START_BIT;
+  for (uint32_t i = 0; i < 10 && response != SD_CARD_R1_IDLE; i++)
+    response = prvSendCommand(SD_CARD_CMD_GO_IDLE_STATE, 0);
+  if (response != SD_CARD_R1_IDLE)
+    return ERROR;
+
+  /* Version 2.00 cards answer CMD8, older cards do not know it */
+  bool version2 = false;
+  response = prvSendCommand(SD_CARD_CMD_SEND_IF_COND, SD_CARD_CMD8_ARGUMENT);
+  if (response == SD_CARD_R1_IDLE)
+  {
+    uint8_t r7[4];
+    SPI2_ReadBuffer(r7, 4);
+    if ((r7[2] & 0x0F) != 0x01 || r7[3] != 0xAA)
+      return ERROR;
+    version2 = true;
+  }
+  else if ((response & SD_CARD_R1_ILLEGAL_COMMAND) == 0)
+    return ERROR;
+
+  /* Wait for the card to leave the idle state, tell it that we handle high
+   * capacity cards */
+  uint32_t argument = 0;
+  if (version2)
+    argument = SD_CARD_ACMD41_HCS;
+  uint32_t startTick = HAL_GetTick();
+  do
+  {
+    if (HAL_GetTick() - startTick > SD_CARD_INIT_TIMEOUT_MS)
+      return ERROR;
+    response = prvSendAppCommand(SD_CARD_ACMD_SD_SEND_OP_COND, argument);
+  } while (response == SD_CARD_R1_IDLE);
+  if (response != SD_CARD_R1_READY)
+    return ERROR;
+
+  /* The CCS bit in the OCR tells if the card uses block addresses */
+  prvBlockAddressing = false;
+  if (version2)
+  {
+    uint8_t ocr[4];
+    if (prvSendCommand(SD_CARD_CMD_READ_OCR, 0) != SD_CARD_R1_READY)
+      return ERROR;
+    SPI2_ReadBuffer(ocr, 4);
+    prvBlockAddressing = ((ocr[0] & SD_CARD_OCR_CCS) != 0);
+  }
+
+  if (!prvBlockAddressing &&
+      prvSendCommand(SD_CARD_CMD_SET_BLOCKLEN, SD_CARD_BLOCK_SIZE) != SD_CARD_R1_READY)
+    return ERROR;
+
+  return SUCCESS;
+}
+
+/**
+ * @brief   Send a command and wait for the R1 response
+ * @param   Command: The command index
+ * @param   Argument: The 32 bit argument
+ * @retval  The R1 response, 0xFF if the card did not answer
+ */
+static uint8_t prvSendCommand(uint8_t Command, uint32_t Argument)
+{
+  uint8_t crc = SD_CARD_DUMMY_CRC;
+  if (Command == SD_CARD_CMD_GO_IDLE_STATE)
+    crc = SD_CARD_CMD0_CRC;
+  else if (Command == SD_CARD_CMD_SEND_IF_COND)
+    crc = SD_CARD_CMD8_CRC;
+
+  /* Give the card 8 clocks before the command */
+  SPI2_TransferByte(0xFF);
+  SPI2_TransferByte(0x40 | Command);
+  SPI2_TransferByte((Argument >> 24) & 0xFF);
+  SPI2_TransferByte((Argument >> 16) & 0xFF);
+  SPI2_TransferByte((Argument >> 8) & 0xFF);
+  SPI2_TransferByte(Argument & 0xFF);
+  SPI2_TransferByte(crc);
+
+  /* The byte after CMD12 is part of the data that was being sent */
+  if (Command == SD_CARD_CMD_STOP_TRANSMISSION)
+    SPI2_TransferByte(0xFF);
+
+  uint8_t response = 0xFF;
+  for (uint32_t i = 0; i < SD_CARD_R1_MAX_WAIT_BYTES; i++)
+  {
+    response = SPI2_TransferByte(0xFF);
+    if ((response & SD_CARD_R1_START_BIT) == 0)
+      break;
+  }
+  return response;
+}
+
+/**
+ * @brief   Send an application specific command, CMD55 followed by the command
+ * @param   Command: The command index
+ * @param   Argument: The 32 bit argument
+ * @retval  The R1 response
+ */
+static uint8_t prvSendAppCommand(uint8_t Command, uint32_t Argument)
+{
+  uint8_t response = prvSendCommand(SD_CARD_CMD_APP_CMD, 0);
+  if (response != SD_CARD_R1_READY && response != SD_CARD_R1_IDLE)
+    return response;
+  return prvSendCommand(Command, Argument);
+}
+
+/**
+ * @brief   Wait for the start token of a data block and read it, the CRC is
+ *          not checked
+ * @param   pBuffer: Where to put SD_CARD_BLOCK_SIZE bytes
+ * @retval  ERROR if the card sent an error token or timed out
+ */
+static ErrorStatus prvReadDataBlock(uint8_t* pBuffer)
+{
+  uint8_t token;
+  uint32_t startTick = HAL_GetTick();
+  while ((token = SPI2_TransferByte(0xFF)) == 0xFF)
+  {
+    if (HAL_GetTick() - startTick > SD_CARD_READ_TIMEOUT_MS)
+      return ERROR;
+  }
+  if (token != SD_CARD_DATA_START_TOKEN)
+    return ERROR;
+
+  SPI2_ReadBuffer(pBuffer, SD_CARD_BLOCK_SIZE);
+  /* CRC16 */
+  SPI2_TransferByte(0xFF);
+  SPI2_TransferByte(0xFF);
+  return SUCCESS;
+}
+
+/**
+ * @brief   Wait for the card to release the busy signal, MISO held low
+ * @param   None
+ * @retval  ERROR if it's still busy after SD_CARD_BUSY_TIMEOUT_MS
+ */
+static ErrorStatus prvWaitWhileBusy()
+{
+  uint32_t startTick = HAL_GetTick();
+  while (SPI2_TransferByte(0xFF) != 0xFF)
+  {
+    if (HAL_GetTick() - startTick > SD_CARD_BUSY_TIMEOUT_MS)
+      return ERROR;
+  }
+  return SUCCESS;
+}
+
+/**
+ * @brief   Deselect the card, it releases MISO after one more byte
+ * @param   None
+ * @retval  None
+ */
+static void prvEndTransfer()
+{
+  SPI2_DeselectDevice(SPI2_Device_SdCard);
+  SPI2_TransferByte(0xFF);
+}
+
+/** Interrupt Handlers -------------------------------------------------------*/
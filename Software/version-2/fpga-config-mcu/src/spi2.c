@@ -37,6 +37,10 @@
 #define SPI_SD_CARD_CS_PIN      (GPIO_PIN_12)
 #define SPI_FPGA_CONFIG_CS_PIN  (GPIO_PIN_0)
 
+/* APB1 is 32 MHz, SD cards need 100-400 kHz until they are identified */
+#define SPI_SD_CARD_IDENTIFICATION_PRESCALER  (SPI_BAUDRATEPRESCALER_128)
+#define SPI_DEFAULT_PRESCALER                 (SPI_BAUDRATEPRESCALER_2)
+
 
 /** Private typedefs ---------------------------------------------------------*/
 /** Private variables --------------------------------------------------------*/
@@ -48,7 +52,7 @@ static SPI_HandleTypeDef SPI_Handle = {
   .Init.CLKPolarity         = SPI_POLARITY_LOW,
   .Init.CLKPhase            = SPI_PHASE_1EDGE,
   .Init.NSS                 = SPI_NSS_SOFT,
-  .Init.BaudRatePrescaler   = SPI_BAUDRATEPRESCALER_2,
+  .Init.BaudRatePrescaler   = SPI_DEFAULT_PRESCALER,
   .Init.FirstBit            = SPI_FIRSTBIT_MSB,
   .Init.TIMode              = SPI_TIMODE_DISABLED,
   .Init.CRCCalculation      = SPI_CRCCALCULATION_DISABLED,
@@ -99,23 +103,31 @@ ErrorStatus SPI2_InitForFpgaConfig()
 {
   /* Init SPI */
   SPI_Handle.Init.FirstBit = SPI_FIRSTBIT_LSB;
+  SPI_Handle.Init.BaudRatePrescaler = SPI_DEFAULT_PRESCALER;
   SPI_CLK_ENABLE();
   HAL_SPI_Init(&SPI_Handle);
+  __HAL_SPI_ENABLE(&SPI_Handle);
 
   return SUCCESS;
 }
 
 /**
  * @brief   Initializes the SPI2 for use with SD Card
- * @param   None
+ * @param   IdentificationClock: true for the slow clock used before the card
+ *          has been identified, false for full speed
  * @retval  None
  */
-ErrorStatus SPI2_InitForSdCard()
+ErrorStatus SPI2_InitForSdCard(bool IdentificationClock)
 {
   /* Init SPI */
   SPI_Handle.Init.FirstBit = SPI_FIRSTBIT_MSB;
+  if (IdentificationClock)
+    SPI_Handle.Init.BaudRatePrescaler = SPI_SD_CARD_IDENTIFICATION_PRESCALER;
+  else
+    SPI_Handle.Init.BaudRatePrescaler = SPI_DEFAULT_PRESCALER;
   SPI_CLK_ENABLE();
   HAL_SPI_Init(&SPI_Handle);
+  __HAL_SPI_ENABLE(&SPI_Handle);
 
   return SUCCESS;
 }
@@ -134,13 +146,74 @@ ErrorStatus SPI2_DeInit()
 }
 
 /**
- * @brief
- * @param   None
+ * @brief   Write a buffer, returns when the last bit has been shifted out.
+ *          Done at register level so that the bytes are sent back to back,
+ *          the CPU is free for 8 SCK periods per byte which leaves time for
+ *          DMA transfers on the other SPI.
+ * @param   pBuffer: The data to write
+ * @param   NumByteToWrite: Number of bytes to write
  * @retval  None
  */
 void SPI2_WriteBuffer(uint8_t* pBuffer, uint32_t NumByteToWrite)
 {
-  HAL_SPI_Transmit(&SPI_Handle, pBuffer, NumByteToWrite, 100);  /* TODO: Check timeout */
+  while (NumByteToWrite--)
+    SPI2_WriteByte(*pBuffer++);
+
+  SPI2_WaitForWriteEnd();
+}
+
+/**
+ * @brief   Write a byte as soon as the transmit buffer is empty, does not wait
+ *          for it to be shifted out. Call SPI2_WaitForWriteEnd after the last
+ *          byte of a stream.
+ * @param   Byte: The byte to write
+ * @retval  None
+ */
+void SPI2_WriteByte(uint8_t Byte)
+{
+  while ((SPI_INSTANCE->SR & SPI_SR_TXE) == 0);
+  SPI_INSTANCE->DR = Byte;
+}
+
+/**
+ * @brief   Wait for the last byte written to be shifted out
+ * @param   None
+ * @retval  None
+ */
+void SPI2_WaitForWriteEnd()
+{
+  while ((SPI_INSTANCE->SR & SPI_SR_TXE) == 0);
+  while ((SPI_INSTANCE->SR & SPI_SR_BSY) != 0);
+
+  /* Nothing is read back so the receiver has overrun */
+  __HAL_SPI_CLEAR_OVRFLAG(&SPI_Handle);
+}
+
+/**
+ * @brief   Write a byte and return the byte read at the same time
+ * @param   Byte: The byte to write
+ * @retval  The byte read
+ */
+uint8_t SPI2_TransferByte(uint8_t Byte)
+{
+  while ((SPI_INSTANCE->SR & SPI_SR_TXE) == 0);
+  SPI_INSTANCE->DR = Byte;
+  while ((SPI_INSTANCE->SR & SPI_SR_RXNE) == 0);
+  return SPI_INSTANCE->DR;
+}
+
+/**
+ * @brief   Read a buffer while writing 0xFF. One byte at a time so that an
+ *          interrupt can not make the receiver overrun, the DMA channels of
+ *          SPI2 are used by USART1.
+ * @param   pBuffer: Where to put the data
+ * @param   NumByteToRead: Number of bytes to read
+ * @retval  None
+ */
+void SPI2_ReadBuffer(uint8_t* pBuffer, uint32_t NumByteToRead)
+{
+  while (NumByteToRead--)
+    *pBuffer++ = SPI2_TransferByte(0xFF);
 }
 
 /**
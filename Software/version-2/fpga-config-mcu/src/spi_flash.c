@@ -55,12 +55,14 @@
 
 
 #define SPI_FLASH_S25FL116K0XMFI011_ID  (0x014015)  /* Device ID for the S25FL116K0XMFI011 */
-#define SPI_FLASH_SIZE_BYTES            (0x200000)  /* 16Mbit = 2MByte*/
 #define SPI_FLASH_LAST_ADDRESS          (SPI_FLASH_SIZE_BYTES-1)
 
 #define SPI_FLASH_SECTOR_CLEAN_CHECK_SIZE    (128)
 #define SPI_FLASH_PAGE_SIZE   (256)
 
+/* Max bytes in one DMA transfer, CNDTR is 16 bits */
+#define SPI_FLASH_DMA_MAX_COUNT (0xFFFF)
+
 /** Private typedefs ---------------------------------------------------------*/
 /** Private variables --------------------------------------------------------*/
 static SPI_HandleTypeDef SPI_Handle = {
@@ -78,8 +80,18 @@ static SPI_HandleTypeDef SPI_Handle = {
   .Init.CRCPolynomial       = 1,
 };
 
+/* SPI1 RX is DMA1 channel 2 and SPI1 TX is DMA1 channel 3 */
+static DMA_HandleTypeDef prvRxDmaHandle;
+static DMA_HandleTypeDef prvTxDmaHandle;
+/* Clocked out by the TX DMA during reads */
+static uint8_t prvDummyByte = SPI_FLASH_DUMMY_BYTE;
+static bool prvReadDmaActive = false;
+
 static uint32_t prvDeviceId = 0;
 static bool prvInitialized = false;
+/* Set when a page program has been started with SPI_FLASH_StartPageProgram
+ * and the FLASH has not yet been seen idle */
+static bool prvPageProgramPending = false;
 
 /** Private function prototypes ----------------------------------------------*/
 static inline void prvSPI_FLASH_CS_LOW();
@@ -91,6 +103,11 @@ static void prvSPI_FLASH_WriteDisable();
 static void prvSPI_FLASH_WriteEnable();
 static uint8_t prvSPI_FLASH_SendReceiveByte(uint8_t Byte);
 static void prvSPI_FLASH_WaitForWriteEnd();
+static uint8_t prvSPI_FLASH_ReadStatus();
+static void prvSPI_FLASH_SendPageProgram(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite);
+static void prvSPI_FLASH_WaitForPendingPageProgram();
+static void prvSPI_FLASH_InitDma();
+static void prvSPI_FLASH_StopReadDma();
 
 /** Functions ----------------------------------------------------------------*/
 /**
@@ -121,6 +138,9 @@ ErrorStatus SPI_FLASH_Init()
     /* Init SPI */
     FLASH_SPI_CLK_ENABLE();
     HAL_SPI_Init(&SPI_Handle);
+    /* The bytes are sent at register level so the SPI is always enabled */
+    __HAL_SPI_ENABLE(&SPI_Handle);
+    prvSPI_FLASH_InitDma();
 
     /* Read FLASH identification */
     prvDeviceId = SPI_FLASH_ReadID();
@@ -190,6 +210,7 @@ void SPI_FLASH_WriteBuffer(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t Num
   /* Check address */
   if (WriteAddress <= SPI_FLASH_LAST_ADDRESS)
   {
+    prvSPI_FLASH_WaitForPendingPageProgram();
     prvSPI_FLASH_WriteBytes(pBuffer, WriteAddress, NumByteToWrite);
   }
 }
@@ -206,6 +227,7 @@ void SPI_FLASH_WriteByte(uint32_t WriteAddress, uint8_t Byte)
   /* Check address */
   if (WriteAddress <= SPI_FLASH_LAST_ADDRESS)
   {
+    prvSPI_FLASH_WaitForPendingPageProgram();
     prvSPI_FLASH_WriteByte(WriteAddress, Byte);
   }
 }
@@ -222,34 +244,107 @@ void SPI_FLASH_ReadBuffer(uint8_t* pBuffer, uint32_t ReadAddress, uint32_t NumBy
   /* Sanity check and check address */
   if (NumByteToRead != 0 && ReadAddress + NumByteToRead - 1 <= SPI_FLASH_LAST_ADDRESS)
   {
-    if (NumByteToRead != 0)
+    SPI_FLASH_StartReadStream(ReadAddress);
+
+    /* The data is read with DMA, in parts if it's more than one transfer */
+    while (NumByteToRead)
     {
-      /* Select the FLASH */
-      prvSPI_FLASH_CS_LOW();
+      uint32_t count = NumByteToRead;
+      if (count > SPI_FLASH_DMA_MAX_COUNT)
+        count = SPI_FLASH_DMA_MAX_COUNT;
+      SPI_FLASH_ReadStreamDma(pBuffer, count);
+      while (SPI_FLASH_ReadStreamDmaBusy());
+      pBuffer += count;
+      NumByteToRead -= count;
+    }
 
-      /* Send "Read from Memory " instruction */
-      prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_READ);
-
-      /* Send ReadAddr high nibble address byte to read from */
-      prvSPI_FLASH_SendReceiveByte((ReadAddress & 0xFF0000) >> 16);
-      /* Send ReadAddr medium nibble address byte to read from */
-      prvSPI_FLASH_SendReceiveByte((ReadAddress& 0xFF00) >> 8);
-      /* Send ReadAddr low nibble address byte to read from */
-      prvSPI_FLASH_SendReceiveByte(ReadAddress & 0xFF);
-
-      /* While there is data to be read */
-      while (NumByteToRead)
-      {
-        /* Read a byte from the FLASH and point to the next location */
-        *pBuffer++ = prvSPI_FLASH_SendReceiveByte(SPI_FLASH_DUMMY_BYTE);
-        /* Decrement NumByteToRead */
-        NumByteToRead--;
-      }
+    SPI_FLASH_EndReadStream();
+  }
+}
 
-      /* Deselect the FLASH */
-      prvSPI_FLASH_CS_HIGH();
-    }
+/**
+  * @brief  Start a read that continues for as long as the FLASH is clocked.
+  *         The data is then read with SPI_FLASH_ReadStreamDma, as many times
+  *         as needed, and the read is ended with SPI_FLASH_EndReadStream.
+  * @note   No other FLASH function can be used until the read has ended
+  * @param  ReadAddress: FLASH's internal address to start reading from
+  * @retval SUCCESS: The read was started
+  * @retval ERROR: Invalid address
+  */
+ErrorStatus SPI_FLASH_StartReadStream(uint32_t ReadAddress)
+{
+  if (ReadAddress > SPI_FLASH_LAST_ADDRESS)
+    return ERROR;
+
+  prvSPI_FLASH_WaitForPendingPageProgram();
+
+  /* Select the FLASH */
+  prvSPI_FLASH_CS_LOW();
+
+  /* Send "Read from Memory " instruction */
+  prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_READ);
+
+  /* Send ReadAddr high nibble address byte to read from */
+  prvSPI_FLASH_SendReceiveByte((ReadAddress & 0xFF0000) >> 16);
+  /* Send ReadAddr medium nibble address byte to read from */
+  prvSPI_FLASH_SendReceiveByte((ReadAddress& 0xFF00) >> 8);
+  /* Send ReadAddr low nibble address byte to read from */
+  prvSPI_FLASH_SendReceiveByte(ReadAddress & 0xFF);
+
+  return SUCCESS;
+}
+
+/**
+  * @brief  Start reading the next bytes of a read stream with DMA, returns
+  *         right away. Use SPI_FLASH_ReadStreamDmaBusy to know when it's done.
+  * @param  pBuffer: pointer to the buffer that receives the data
+  * @param  NumByteToRead: number of bytes to read, 1 to 65535
+  * @retval None
+  */
+void SPI_FLASH_ReadStreamDma(uint8_t* pBuffer, uint32_t NumByteToRead)
+{
+  if (NumByteToRead == 0 || NumByteToRead > SPI_FLASH_DMA_MAX_COUNT)
+    return;
+
+  /* Wait for the last part */
+  while (SPI_FLASH_ReadStreamDmaBusy());
+
+  /* RX has to be ready before TX starts clocking out the dummy bytes */
+  HAL_DMA_Start(&prvRxDmaHandle, (uint32_t)&FLASH_SPI->DR, (uint32_t)pBuffer, NumByteToRead);
+  HAL_DMA_Start(&prvTxDmaHandle, (uint32_t)&prvDummyByte, (uint32_t)&FLASH_SPI->DR, NumByteToRead);
+  prvReadDmaActive = true;
+  SET_BIT(FLASH_SPI->CR2, SPI_CR2_RXDMAEN);
+  SET_BIT(FLASH_SPI->CR2, SPI_CR2_TXDMAEN);
+}
+
+/**
+  * @brief  Check if the DMA started by SPI_FLASH_ReadStreamDma is still running
+  * @param  None
+  * @retval true: The DMA is still reading
+  * @retval false: All bytes are in the buffer
+  */
+bool SPI_FLASH_ReadStreamDmaBusy()
+{
+  if (prvReadDmaActive)
+  {
+    if (__HAL_DMA_GET_FLAG(&prvRxDmaHandle, __HAL_DMA_GET_TC_FLAG_INDEX(&prvRxDmaHandle)) == RESET)
+      return true;
+    prvSPI_FLASH_StopReadDma();
   }
+  return false;
+}
+
+/**
+  * @brief  End a read started with SPI_FLASH_StartReadStream
+  * @param  None
+  * @retval None
+  */
+void SPI_FLASH_EndReadStream()
+{
+  while (SPI_FLASH_ReadStreamDmaBusy());
+
+  /* Deselect the FLASH */
+  prvSPI_FLASH_CS_HIGH();
 }
 
 /**
@@ -262,6 +357,8 @@ ErrorStatus SPI_FLASH_EraseSector(uint32_t SectorAddress)
   /* Check address */
   if (SectorAddress <= SPI_FLASH_LAST_ADDRESS)
   {
+    prvSPI_FLASH_WaitForPendingPageProgram();
+
     /* Enable the write access to the FLASH */
     prvSPI_FLASH_WriteEnable();
 
@@ -300,6 +397,8 @@ ErrorStatus SPI_FLASH_EraseBlock(uint32_t BlockAddress)
   /* Check address */
   if (BlockAddress <= SPI_FLASH_LAST_ADDRESS)
   {
+    prvSPI_FLASH_WaitForPendingPageProgram();
+
     /* Enable the write access to the FLASH */
     prvSPI_FLASH_WriteEnable();
 
@@ -335,6 +434,8 @@ ErrorStatus SPI_FLASH_EraseBlock(uint32_t BlockAddress)
   */
 void SPI_FLASH_EraseChip()
 {
+  prvSPI_FLASH_WaitForPendingPageProgram();
+
   /* Enable the write access to the FLASH */
   prvSPI_FLASH_WriteEnable();
 
@@ -350,6 +451,54 @@ void SPI_FLASH_EraseChip()
   prvSPI_FLASH_WaitForWriteEnd();
 }
 
+/**
+  * @brief  Start programming up to one page without waiting for it to finish
+  * @note   Addresses to be written must be in the erased state and the data
+  *         must not cross a page boundary. The data has been transferred to
+  *         the FLASH's page buffer when this returns so pBuffer can be reused.
+  *         Use SPI_FLASH_PageProgramInProgress to know when the FLASH is done.
+  * @param  pBuffer: pointer to the buffer with data to write
+  * @param  WriteAddress: FLASH's internal address to write to
+  * @param  NumByteToWrite: number of bytes to write, 1 to SPI_FLASH_BYTES_IN_PAGE
+  * @retval SUCCESS: The page program was started
+  * @retval ERROR: Invalid address or count
+  */
+ErrorStatus SPI_FLASH_StartPageProgram(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite)
+{
+  if (NumByteToWrite == 0 ||
+      WriteAddress + NumByteToWrite - 1 > SPI_FLASH_LAST_ADDRESS ||
+      (WriteAddress % SPI_FLASH_PAGE_SIZE) + NumByteToWrite > SPI_FLASH_PAGE_SIZE)
+    return ERROR;
+
+  /* Only one program can be ongoing in the FLASH */
+  prvSPI_FLASH_WaitForPendingPageProgram();
+
+  prvSPI_FLASH_SendPageProgram(pBuffer, WriteAddress, NumByteToWrite);
+  prvPageProgramPending = true;
+
+  return SUCCESS;
+}
+
+/**
+  * @brief  Check if a page program started with SPI_FLASH_StartPageProgram is
+  *         still running. Reads the status register once, does not block.
+  * @param  None
+  * @retval true: The FLASH is still programming
+  * @retval false: The FLASH is ready for a new command
+  */
+bool SPI_FLASH_PageProgramInProgress()
+{
+  if (prvPageProgramPending)
+  {
+    if ((prvSPI_FLASH_ReadStatus() & SPI_FLASH_WIP_FLAG) != 0)
+      return true;
+
+    /* WEL is cleared by the FLASH when the program is done */
+    prvPageProgramPending = false;
+  }
+  return false;
+}
+
 /**
   * @brief  Return the status of if the SPI FLASH is intialized or not
   * @param  None
@@ -450,33 +599,47 @@ static void prvSPI_FLASH_WriteUpToOnePage(uint8_t* pBuffer, uint32_t WriteAddres
 {
   if (NumByteToWrite <= SPI_FLASH_PAGE_SIZE)
   {
-    /* Enable the write access to the FLASH */
-    prvSPI_FLASH_WriteEnable();
+    prvSPI_FLASH_SendPageProgram(pBuffer, WriteAddress, NumByteToWrite);
+    /* Wait till the end of Flash writing */
+    prvSPI_FLASH_WaitForWriteEnd();
+  }
+}
 
-    /* Select the FLASH */
-    prvSPI_FLASH_CS_LOW();
+/**
+  * @brief  Send the write enable and page program commands with the data.
+  *         The FLASH starts programming when CS goes high, this does not wait
+  *         for it to finish.
+  * @param  pBuffer: pointer to the buffer containing the data to be written
+  * @param  WriteAddress: FLASH's internal address to write to
+  * @param  NumByteToWrite: number of bytes to write, must not cross a page
+  * @retval None
+  */
+static void prvSPI_FLASH_SendPageProgram(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite)
+{
+  /* Enable the write access to the FLASH */
+  prvSPI_FLASH_WriteEnable();
 
-    /* Send write command */
-    prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_WRITE);
-    /* Send WriteAddress high, medium and low nibble address byte to write to */
-    prvSPI_FLASH_SendReceiveByte((WriteAddress & 0xFF0000) >> 16);
-    prvSPI_FLASH_SendReceiveByte((WriteAddress & 0xFF00) >> 8);
-    prvSPI_FLASH_SendReceiveByte(WriteAddress & 0xFF);
+  /* Select the FLASH */
+  prvSPI_FLASH_CS_LOW();
 
-    /* While there is data to be written to the FLASH */
-    while (NumByteToWrite)
-    {
-      /* Send one byte */
-      prvSPI_FLASH_SendReceiveByte(*pBuffer++);
-      /* Update NumByteToWrite */
-      NumByteToWrite--;
-    }
+  /* Send write command */
+  prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_WRITE);
+  /* Send WriteAddress high, medium and low nibble address byte to write to */
+  prvSPI_FLASH_SendReceiveByte((WriteAddress & 0xFF0000) >> 16);
+  prvSPI_FLASH_SendReceiveByte((WriteAddress & 0xFF00) >> 8);
+  prvSPI_FLASH_SendReceiveByte(WriteAddress & 0xFF);
 
-    /* Deselect the FLASH */
-    prvSPI_FLASH_CS_HIGH();
-    /* Wait till the end of Flash writing */
-    prvSPI_FLASH_WaitForWriteEnd();
+  /* While there is data to be written to the FLASH */
+  while (NumByteToWrite)
+  {
+    /* Send one byte */
+    prvSPI_FLASH_SendReceiveByte(*pBuffer++);
+    /* Update NumByteToWrite */
+    NumByteToWrite--;
   }
+
+  /* Deselect the FLASH */
+  prvSPI_FLASH_CS_HIGH();
 }
 
 /**
@@ -514,16 +677,18 @@ static void prvSPI_FLASH_WriteEnable()
 }
 
 /**
-  * @brief  Send one byte to the SPI FLASH and return the byte received back
+  * @brief  Send one byte to the SPI FLASH and return the byte received back.
+  *         Done at register level as HAL_SPI_TransmitReceive takes several
+  *         times longer than the byte itself.
   * @param  Byte: The byte to send
   * @retval The byte received from the SPI FLASH
   */
 static uint8_t prvSPI_FLASH_SendReceiveByte(uint8_t Byte)
 {
-  /* TODO: Do this RAW instead of using HAL??? A lot of overhead in HAL */
-  uint8_t rxByte;
-  HAL_SPI_TransmitReceive(&SPI_Handle, &Byte, &rxByte, 1, 10);  /* TODO: Check timeout */
-  return rxByte;
+  while ((FLASH_SPI->SR & SPI_SR_TXE) == 0);
+  FLASH_SPI->DR = Byte;
+  while ((FLASH_SPI->SR & SPI_SR_RXNE) == 0);
+  return (uint8_t)FLASH_SPI->DR;
 }
 
 /**
@@ -555,4 +720,85 @@ static void prvSPI_FLASH_WaitForWriteEnd()
   prvSPI_FLASH_CS_HIGH();
 }
 
+/**
+  * @brief  Read the status register once
+  * @param  None
+  * @retval The status register
+  */
+static uint8_t prvSPI_FLASH_ReadStatus()
+{
+  /* Select the FLASH */
+  prvSPI_FLASH_CS_LOW();
+
+  /* Send "Read Status Register" instruction and read it back */
+  prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_RDSR);
+  uint8_t flashStatus = prvSPI_FLASH_SendReceiveByte(SPI_FLASH_DUMMY_BYTE);
+
+  /* Deselect the FLASH */
+  prvSPI_FLASH_CS_HIGH();
+
+  return flashStatus;
+}
+
+/**
+  * @brief  Wait for a page program started with SPI_FLASH_StartPageProgram to
+  *         finish so that a new command can be sent to the FLASH
+  * @param  None
+  * @retval None
+  */
+static void prvSPI_FLASH_WaitForPendingPageProgram()
+{
+  if (prvPageProgramPending)
+  {
+    prvSPI_FLASH_WaitForWriteEnd();
+    prvPageProgramPending = false;
+  }
+}
+
+/**
+  * @brief  Initializes the DMA channels used for reads. They are polled so no
+  *         interrupts are used.
+  * @param  None
+  * @retval None
+  */
+static void prvSPI_FLASH_InitDma()
+{
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  /* RX has the higher priority so that a received byte is never overwritten */
+  prvRxDmaHandle.Instance                 = DMA1_Channel2;
+  prvRxDmaHandle.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+  prvRxDmaHandle.Init.PeriphInc           = DMA_PINC_DISABLE;
+  prvRxDmaHandle.Init.MemInc              = DMA_MINC_ENABLE;
+  prvRxDmaHandle.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  prvRxDmaHandle.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+  prvRxDmaHandle.Init.Mode                = DMA_NORMAL;
+  prvRxDmaHandle.Init.Priority            = DMA_PRIORITY_VERY_HIGH;
+  HAL_DMA_Init(&prvRxDmaHandle);
+
+  prvTxDmaHandle.Instance                 = DMA1_Channel3;
+  prvTxDmaHandle.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+  prvTxDmaHandle.Init.PeriphInc           = DMA_PINC_DISABLE;
+  prvTxDmaHandle.Init.MemInc              = DMA_MINC_DISABLE;
+  prvTxDmaHandle.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  prvTxDmaHandle.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+  prvTxDmaHandle.Init.Mode                = DMA_NORMAL;
+  prvTxDmaHandle.Init.Priority            = DMA_PRIORITY_MEDIUM;
+  HAL_DMA_Init(&prvTxDmaHandle);
+}
+
+/**
+  * @brief  Stop the read DMA when the last byte has been received
+  * @param  None
+  * @retval None
+  */
+static void prvSPI_FLASH_StopReadDma()
+{
+  CLEAR_BIT(FLASH_SPI->CR2, SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN);
+  /* Both are done, this clears the flags and makes the handles ready again */
+  HAL_DMA_PollForTransfer(&prvTxDmaHandle, HAL_DMA_FULL_TRANSFER, HAL_MAX_DELAY);
+  HAL_DMA_PollForTransfer(&prvRxDmaHandle, HAL_DMA_FULL_TRANSFER, HAL_MAX_DELAY);
+  prvReadDmaActive = false;
+}
+
 /** Interrupt Handlers -------------------------------------------------------*/
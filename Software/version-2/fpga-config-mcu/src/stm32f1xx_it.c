@@ -56,17 +56,27 @@ void SysTick_Handler(void)
   */
 void USART1_IRQHandler(void)
 {
-  /* Check if it's a RX interrupt */
+  /* Check if it's an idle line interrupt, RX and TX are done by DMA */
   uint32_t tmp_flag = 0, tmp_it_source = 0;
-  tmp_flag = __HAL_UART_GET_FLAG(&UART_Handle, UART_FLAG_RXNE);
-  tmp_it_source = __HAL_UART_GET_IT_SOURCE(&UART_Handle, UART_IT_RXNE);
+  tmp_flag = __HAL_UART_GET_FLAG(&UART_Handle, UART_FLAG_IDLE);
+  tmp_it_source = __HAL_UART_GET_IT_SOURCE(&UART_Handle, UART_IT_IDLE);
   if ((tmp_flag != RESET) && (tmp_it_source != RESET))
   {
-    UART1_DataReceivedHandler();
+    UART1_IdleLineHandler();
   }
-  /* Otherwise call the HAL IRQ handler */
-  else
-    HAL_UART_IRQHandler(&UART_Handle);
+  /* The HAL IRQ handler isn't used as it reads DR to clear errors and that
+   * takes a byte away from the RX DMA */
+  UART1_ErrorHandler();
+}
+
+/**
+  * @brief  This function handles the UART RX DMA interrupt request.
+  * @param  None
+  * @retval None
+  */
+void DMA1_Channel5_IRQHandler(void)
+{
+  UART1_RxDmaHandler();
 }
 
 /**
@@ -34,18 +34,32 @@
 #define UART_TX_PIN             (GPIO_PIN_9)
 #define UART_RX_PIN             (GPIO_PIN_10)
 
-#define UART_RX_BUFFER_SIZE     (128)
+#define UART_DEFAULT_BAUD_RATE  (115200)
+#define UART_MIN_BAUD_RATE      (9600)
+
+/* Filled by circular DMA, must be able to hold the frame being parsed and a
+ * full window of windowed write frames behind it, 5 * 273 bytes */
+#define UART_RX_BUFFER_SIZE     (2048)
 
 /** Private typedefs ---------------------------------------------------------*/
 /** Private variables --------------------------------------------------------*/
 static uint8_t prvRxBuffer[UART_RX_BUFFER_SIZE] = {0};
-static uint8_t* prvRxBufferIn;
-static uint8_t* prvRxBufferOut;
-static uint32_t prvRxBufferCount;
+static DMA_HandleTypeDef prvRxDmaHandle;
+static DMA_HandleTypeDef prvTxDmaHandle;
+static bool prvTxDmaActive = false;
+
+/* Running byte counts, the difference is the number of unread bytes */
+static volatile uint32_t prvRxBytesReceived = 0;
+static uint32_t prvRxBytesRead = 0;
+static uint32_t prvRxDmaIndex = 0;
+static volatile bool prvRxOverflow = false;
 
 static bool prvInitialized = false;
 
 /** Private function prototypes ----------------------------------------------*/
+static void prvUpdateRxBytesReceived();
+static bool prvTxDmaBusy();
+
 /** Functions ----------------------------------------------------------------*/
 /**
  * @brief   Initializes the UART
@@ -70,17 +84,12 @@ ErrorStatus UART1_Init()
     GPIO_InitStructure.Mode       = GPIO_MODE_AF_INPUT;
     HAL_GPIO_Init(UART_PORT, &GPIO_InitStructure);
 
-    /* Init the RX Buffer */
-    prvRxBufferIn = &prvRxBuffer[0];
-    prvRxBufferOut = &prvRxBuffer[0];
-    prvRxBufferCount = 0;
-
     /* Enable UART clock */
     __HAL_RCC_USART1_CLK_ENABLE();
 
     /* Init the UART */
     UART_Handle.Instance           = USART1;
-    UART_Handle.Init.BaudRate      = 115200;
+    UART_Handle.Init.BaudRate      = UART_DEFAULT_BAUD_RATE;
     UART_Handle.Init.WordLength    = UART_WORDLENGTH_8B;
     UART_Handle.Init.StopBits      = UART_STOPBITS_1;
     UART_Handle.Init.Parity        = UART_PARITY_NONE;
@@ -89,12 +98,46 @@ ErrorStatus UART1_Init()
     if (HAL_UART_Init(&UART_Handle) != HAL_OK)
       return ERROR;
 
-    /* Enable the UART Data Register not empty Interrupt */
-    __HAL_UART_ENABLE_IT(&UART_Handle, UART_IT_RXNE);
+    /* RX goes to the buffer with circular DMA, USART1 RX is DMA1 channel 5 */
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    prvRxDmaHandle.Instance                 = DMA1_Channel5;
+    prvRxDmaHandle.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+    prvRxDmaHandle.Init.PeriphInc           = DMA_PINC_DISABLE;
+    prvRxDmaHandle.Init.MemInc              = DMA_MINC_ENABLE;
+    prvRxDmaHandle.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    prvRxDmaHandle.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+    prvRxDmaHandle.Init.Mode                = DMA_CIRCULAR;
+    prvRxDmaHandle.Init.Priority            = DMA_PRIORITY_HIGH;
+    if (HAL_DMA_Init(&prvRxDmaHandle) != HAL_OK)
+      return ERROR;
+    HAL_DMA_Start(&prvRxDmaHandle, (uint32_t)&UART_Handle.Instance->DR, (uint32_t)prvRxBuffer, UART_RX_BUFFER_SIZE);
+    SET_BIT(UART_Handle.Instance->CR3, USART_CR3_DMAR);
+
+    /*
+     * The half and full transfer interrupts make sure the received count is
+     * updated at least twice per lap so a lap is never missed, the idle line
+     * interrupt wakes the main loop at the end of a burst shorter than that
+     */
+    __HAL_DMA_ENABLE_IT(&prvRxDmaHandle, DMA_IT_HT | DMA_IT_TC);
+    __HAL_UART_ENABLE_IT(&UART_Handle, UART_IT_IDLE);
 
-    /* NVIC for USART */
+    /* Large amounts of data are sent with DMA, USART1 TX is DMA1 channel 4 */
+    prvTxDmaHandle.Instance                 = DMA1_Channel4;
+    prvTxDmaHandle.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+    prvTxDmaHandle.Init.PeriphInc           = DMA_PINC_DISABLE;
+    prvTxDmaHandle.Init.MemInc              = DMA_MINC_ENABLE;
+    prvTxDmaHandle.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    prvTxDmaHandle.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+    prvTxDmaHandle.Init.Mode                = DMA_NORMAL;
+    prvTxDmaHandle.Init.Priority            = DMA_PRIORITY_MEDIUM;
+    if (HAL_DMA_Init(&prvTxDmaHandle) != HAL_OK)
+      return ERROR;
+
+    /* NVIC for USART and DMA */
     HAL_NVIC_SetPriority(USART1_IRQn, 0, 1);
     HAL_NVIC_EnableIRQ(USART1_IRQn);
+    HAL_NVIC_SetPriority(DMA1_Channel5_IRQn, 0, 1);
+    HAL_NVIC_EnableIRQ(DMA1_Channel5_IRQn);
 
     prvInitialized = true;
 
@@ -103,6 +146,36 @@ ErrorStatus UART1_Init()
   return ERROR;
 }
 
+/**
+ * @brief   Change the baud rate, any ongoing transmission is finished first
+ * @param   BaudRate: The new baud rate
+ * @retval  SUCCESS or ERROR if the baud rate is out of range
+ */
+ErrorStatus UART1_SetBaudRate(uint32_t BaudRate)
+{
+  if (!UART1_BaudRateSupported(BaudRate))
+    return ERROR;
+
+  /* Let the last byte, normally the ACK for this change, leave the shift register */
+  while (UART1_TxBusy());
+  while (__HAL_UART_GET_FLAG(&UART_Handle, UART_FLAG_TC) == RESET);
+
+  /* Writing BRR directly keeps the DMA and interrupt settings */
+  UART_Handle.Init.BaudRate = BaudRate;
+  UART_Handle.Instance->BRR = UART_BRR_SAMPLING16(HAL_RCC_GetPCLK2Freq(), BaudRate);
+  return SUCCESS;
+}
+
+/**
+ * @brief   Check if a baud rate can be used, the max is the peripheral clock / 16
+ * @param   BaudRate: The baud rate
+ * @retval  true if it can be used
+ */
+bool UART1_BaudRateSupported(uint32_t BaudRate)
+{
+  return (BaudRate >= UART_MIN_BAUD_RATE && BaudRate <= HAL_RCC_GetPCLK2Freq() / 16);
+}
+
 /**
  * @brief   Get the number of bytes available in the RX buffer
  * @param   None
@@ -110,7 +183,52 @@ ErrorStatus UART1_Init()
  */
 uint32_t UART1_BytesAvailable()
 {
-  return prvRxBufferCount;
+  prvUpdateRxBytesReceived();
+  return prvRxBytesReceived - prvRxBytesRead;
+}
+
+/**
+ * @brief   Get the longest contiguous span of unread bytes in the RX buffer
+ * @param   ppData: Set to point at the first unread byte
+ * @retval  Number of bytes in the span, 0 if there is nothing to read
+ */
+uint32_t UART1_GetRxSpan(uint8_t** ppData)
+{
+  uint32_t available = UART1_BytesAvailable();
+  uint32_t readIndex = prvRxBytesRead % UART_RX_BUFFER_SIZE;
+
+  /* Stop at the end of the buffer, the rest is in the next span */
+  if (available > UART_RX_BUFFER_SIZE - readIndex)
+    available = UART_RX_BUFFER_SIZE - readIndex;
+  *ppData = &prvRxBuffer[readIndex];
+  return available;
+}
+
+/**
+ * @brief   Mark bytes from the start of the span as read
+ * @param   Count: Number of bytes, at most the size of the last span
+ * @retval  None
+ */
+void UART1_ConsumeRxSpan(uint32_t Count)
+{
+  prvRxBytesRead += Count;
+}
+
+/**
+ * @brief   Check and clear the overflow flag
+ * @param   None
+ * @retval  true if unread bytes were overwritten since the last call
+ */
+bool UART1_RxOverflowed()
+{
+  bool overflow = prvRxOverflow;
+  if (overflow)
+  {
+    /* Everything in the buffer may be mixed up, drop it */
+    prvRxOverflow = false;
+    prvRxBytesRead = prvRxBytesReceived;
+  }
+  return overflow;
 }
 
 /**
@@ -122,17 +240,13 @@ uint32_t UART1_BytesAvailable()
 void UART1_GetDataFromBuffer(uint8_t* pStorage, uint32_t Size)
 {
   /* Sanity check */
-  if (Size <= prvRxBufferCount)
+  if (Size <= UART1_BytesAvailable())
   {
     while (Size != 0)
     {
-      *pStorage = *prvRxBufferOut;
-      pStorage++;
-      /* Check for overflow */
-      if (++prvRxBufferOut == &prvRxBuffer[UART_RX_BUFFER_SIZE])
-        prvRxBufferOut = prvRxBuffer;
+      *pStorage++ = prvRxBuffer[prvRxBytesRead % UART_RX_BUFFER_SIZE];
+      prvRxBytesRead++;
       Size--;
-      prvRxBufferCount--;
     }
   }
 }
@@ -145,15 +259,8 @@ void UART1_GetDataFromBuffer(uint8_t* pStorage, uint32_t Size)
  */
 uint8_t UART1_GetByteFromBuffer()
 {
-  if (prvRxBufferCount != 0)
-  {
-    uint8_t temp = *prvRxBufferOut;
-    /* Check for overflow */
-    if (++prvRxBufferOut == &prvRxBuffer[UART_RX_BUFFER_SIZE])
-      prvRxBufferOut = prvRxBuffer;
-    prvRxBufferCount--;
-    return temp;
-  }
+  if (UART1_BytesAvailable() != 0)
+    return prvRxBuffer[prvRxBytesRead++ % UART_RX_BUFFER_SIZE];
   else
     return 0;
 }
@@ -166,13 +273,13 @@ uint8_t UART1_GetByteFromBuffer()
 void UART1_SendByte(uint8_t Byte)
 {
   /*
-   * We need to save the Byte to send in a variable here as the HAL_UART saves
-   * a pointer to the variable. If we had used Byte directly it would save a
-   * pointer to the register where Byte is stored temporarily.
+   * We need to save the Byte to send in a variable here as the DMA reads it
+   * after we have returned. It's only changed when the last byte is sent.
    */
   static uint8_t temp = 0;
+  while (UART1_TxBusy());
   temp = Byte;
-  HAL_UART_Transmit_IT(&UART_Handle, &temp, 1);
+  UART1_SendBufferDma(&temp, 1);
 }
 
 /**
@@ -182,31 +289,119 @@ void UART1_SendByte(uint8_t Byte)
  */
 void UART1_SendBuffer(uint8_t* pData, uint16_t Size)
 {
-  HAL_UART_Transmit_IT(&UART_Handle, pData, Size);
+  /* TX is always done with DMA so the HAL IRQ handler isn't needed, see UART1_ErrorHandler */
+  UART1_SendBufferDma(pData, Size);
+}
+
+/**
+ * @brief   Send a buffer with DMA, returns right away. The buffer must not be
+ *          changed until UART1_TxBusy returns false.
+ * @param   pData: The data
+ * @param   Size: Number of bytes
+ * @retval  None
+ */
+void UART1_SendBufferDma(uint8_t* pData, uint16_t Size)
+{
+  /* Wait for anything sent before */
+  while (UART1_TxBusy());
+
+  HAL_DMA_Start(&prvTxDmaHandle, (uint32_t)pData, (uint32_t)&UART_Handle.Instance->DR, Size);
+  prvTxDmaActive = true;
+  SET_BIT(UART_Handle.Instance->CR3, USART_CR3_DMAT);
+}
+
+/**
+ * @brief   Check if something is being sent
+ * @param   None
+ * @retval  true until the last byte has been written to the UART
+ */
+bool UART1_TxBusy()
+{
+  return prvTxDmaBusy();
 }
 
 /** Private functions .-------------------------------------------------------*/
-/** Interrupt Handlers -------------------------------------------------------*/
 /**
- * @brief
+ * @brief   Add the bytes the DMA has written since the last update to the
+ *          received count. Interrupts are disabled so the main loop and the
+ *          interrupts can both call it.
  * @param   None
  * @retval  None
  */
-void UART1_DataReceivedHandler()
+static void prvUpdateRxBytesReceived()
 {
-  uint8_t temp = (uint8_t)(UART_Handle.Instance->DR & (uint8_t)0x00FF);
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  uint32_t dmaIndex = UART_RX_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(&prvRxDmaHandle);
+  if (dmaIndex == UART_RX_BUFFER_SIZE)
+    dmaIndex = 0;
+  prvRxBytesReceived += (dmaIndex + UART_RX_BUFFER_SIZE - prvRxDmaIndex) % UART_RX_BUFFER_SIZE;
+  prvRxDmaIndex = dmaIndex;
+  if (prvRxBytesReceived - prvRxBytesRead > UART_RX_BUFFER_SIZE)
+    prvRxOverflow = true;
+
+  __set_PRIMASK(primask);
+}
 
-  /* Only save to the buffer if there's room for it */
-  if (prvRxBufferCount < UART_RX_BUFFER_SIZE)
+/**
+ * @brief   Check if the TX DMA is busy, stops it when it's done
+ * @param   None
+ * @retval  true if it's busy
+ */
+static bool prvTxDmaBusy()
+{
+  if (prvTxDmaActive)
   {
-    *prvRxBufferIn = temp;
-    /* Check for overflow */
-    if (++prvRxBufferIn == &prvRxBuffer[UART_RX_BUFFER_SIZE])
-      prvRxBufferIn = prvRxBuffer;
-    /* Increment the count */
-    prvRxBufferCount++;
+    if (__HAL_DMA_GET_FLAG(&prvTxDmaHandle, __HAL_DMA_GET_TC_FLAG_INDEX(&prvTxDmaHandle)) == RESET)
+      return true;
+    CLEAR_BIT(UART_Handle.Instance->CR3, USART_CR3_DMAT);
+    /* Clears the flags and makes the handle ready again */
+    HAL_DMA_PollForTransfer(&prvTxDmaHandle, HAL_DMA_FULL_TRANSFER, HAL_MAX_DELAY);
+    prvTxDmaActive = false;
   }
-  /* TODO: Handle fault when buffer is full */
+  return false;
+}
+
+/** Interrupt Handlers -------------------------------------------------------*/
+/**
+ * @brief   Idle line interrupt, called from USART1_IRQHandler
+ * @param   None
+ * @retval  None
+ */
+void UART1_IdleLineHandler()
+{
+  __HAL_UART_CLEAR_IDLEFLAG(&UART_Handle);
+  prvUpdateRxBytesReceived();
+}
+
+/**
+ * @brief   Clear the UART error flags, called from USART1_IRQHandler instead
+ *          of the HAL IRQ handler. The HAL clears them by reading DR which
+ *          takes a byte away from the circular RX DMA.
+ * @param   None
+ * @retval  None
+ */
+void UART1_ErrorHandler()
+{
+  /* ORE, NE, FE and PE are cleared by reading SR and then DR. When the RX
+   * DMA runs it reads DR itself, the byte is only read here when it doesn't */
+  uint32_t status = UART_Handle.Instance->SR;
+  if ((status & USART_SR_ORE) && !(prvRxDmaHandle.Instance->CCR & DMA_CCR_EN))
+    (void)UART_Handle.Instance->DR;
+}
+
+/**
+ * @brief   Half and full transfer interrupt for the RX DMA, called from
+ *          DMA1_Channel5_IRQHandler
+ * @param   None
+ * @retval  None
+ */
+void UART1_RxDmaHandler()
+{
+  __HAL_DMA_CLEAR_FLAG(&prvRxDmaHandle, __HAL_DMA_GET_HT_FLAG_INDEX(&prvRxDmaHandle) |
+                                        __HAL_DMA_GET_TC_FLAG_INDEX(&prvRxDmaHandle));
+  prvUpdateRxBytesReceived();
 }
 
 /**
@@ -30,6 +30,7 @@
  * Set write address to 0x00000000: AA BB CC 10 00 04 00 00 00 00 C9
  * Set write address to 0x11223344: AA BB CC 10 00 04 11 22 33 44 8D
  * Get current write address: AA BB CC 11 CC
+ * Set baud rate to 921600 after the ACK: AA BB CC 12 00 04 00 0E 10 00 D5
  * Erase full flash: AA BB CC 20 FD
  * Erase first sector at 0x00000000: AA BB CC 21 00 04 00 00 00 00 F8
  * Write "Hello World" to flash: AA BB CC 30 00 0B 48 65 6C 6C 6F 20 57 6F 72 6C 64 C6
@@ -39,8 +40,24 @@
  * Read 256 bytes from flash at address 0x00000100: AA BB CC 40 00 05 00 00 01 00 FF 66
  * Read 128 bytes from flash at address 0x00000180: AA BB CC 40 00 05 00 00 01 80 80 99
  * Read 128 bytes from flash at address 0x00008480: AA BB CC 40 00 05 00 00 84 80 80 1C
+ * CRC32 of the first 64 sectors of bitfile 1: AA BB CC 41 00 05 00 06 00 00 40 DF
+ * Get all bitfile headers and if they are valid: AA BB CC 42 9F
+ * Stream the first 64 kB of flash: AA BB CC 43 00 08 00 00 00 00 00 01 00 00 97
  *
  * Start FPGA config: AA BB CC 50 00 01 01 8D
+ * Get the timing of the last FPGA config: AA BB CC 51 8C
+ * Start FPGA config with FPGA.RBF on the SD card: AA BB CC 52 00 08 46 50 47 41 2E 52 42 46 EF
+ * Copy FPGA.RBF on the SD card to bitfile 2: AA BB CC 33 00 09 02 46 50 47 41 2E 52 42 46 8D
+ *
+ * Windowed upload:
+ * Start a windowed write, returns the window size + ACK: AA BB CC 32 EF
+ * Then send frames with command 0x31 without waiting for each ACK, see
+ * UART_COMM_COMMAND_WRITE_WINDOWED_DATA. Every frame is answered with
+ * DA (2 byte next sequence number) when it has been queued, or with
+ * EA (2 byte next sequence number) when it is rejected. The answer is
+ * cumulative, all frames before the next sequence number are queued, so
+ * the host can keep up to window size frames in flight and go back to
+ * the next sequence number if a frame is rejected or lost.
  */
 
 /** Includes -----------------------------------------------------------------*/
@@ -50,6 +67,8 @@
 #include "fpga_config.h"
 #include "led.h"
 
+#include <string.h>
+
 /** Private defines ----------------------------------------------------------*/
 #define UART_COMM_HEADER_1      (0xAA)
 #define UART_COMM_HEADER_2      (0xBB)
@@ -57,7 +76,33 @@
 #define UART_COMM_ACK           (0xDD)
 #define UART_COMM_NACK          (0xEE)
 #define UART_COMM_UNKNOWN_COMMAND (0xDE)
+#define UART_COMM_WINDOW_ACK    (0xDA)
+#define UART_COMM_WINDOW_NACK   (0xEA)
 #define UART_COMM_BUFFER_SIZE   (512)
+/* A command that stops half way is dropped after this time, for example
+ * when the host tries a baud rate the board is not using */
+#define UART_COMM_TIMEOUT_MS    (100)
+
+/* Pages that can be queued for programming, this is the window size */
+#define UART_COMM_PAGE_QUEUE_SIZE         (4)
+#define UART_COMM_PAGE_SIZE               (256)
+/* Sequence number, flash address, data and CRC32 */
+#define UART_COMM_WINDOW_FRAME_OVERHEAD   (2 + 4 + 4)
+
+/* The CRCs fill the first half of the data buffer and the flash is read into
+ * the second half */
+#define UART_COMM_SECTOR_CRC_MAX_SECTORS  (64)
+#define UART_COMM_SECTOR_CRC_READ_SIZE    (UART_COMM_BUFFER_SIZE / 2)
+
+/* Streamed read chunk: DB, 4 bytes address, 2 bytes count, data and CRC32 of
+ * everything before it, all MSByte first */
+#define UART_COMM_STREAM_CHUNK_START      (0xDB)
+#define UART_COMM_STREAM_CHUNK_SIZE       (512)
+#define UART_COMM_STREAM_DATA_OFFSET      (1 + 4 + 2)
+#define UART_COMM_STREAM_CHUNK_OVERHEAD   (UART_COMM_STREAM_DATA_OFFSET + 4)
+
+/* 8.3 file names on the SD card */
+#define UART_COMM_MAX_FILE_NAME_LENGTH    (12)
 
 /**
  * The commands are structured like this:
@@ -67,6 +112,8 @@
 #define UART_COMM_COMMAND_SET_FLASH_WRITE_ADDRESS   (0x10)
 /* Data = None, returns the 4 byte write address MSByte first */
 #define UART_COMM_COMMAND_GET_FLASH_WRITE_ADDRESS   (0x11)
+/* Data = 4 bytes baud rate MSByte first, used from after the ACK until reset */
+#define UART_COMM_COMMAND_SET_BAUD_RATE             (0x12)
 /* Data = None */
 #define UART_COMM_COMMAND_ERASE_FULL_FLASH          (0x20)
 /* Data = 4 bytes address for sector to erase */
@@ -77,8 +124,30 @@
 #define UART_COMM_COMMAND_WRITE_DATA_TO_FLASH       (0x30)
 /* Data = 4 bytes read address, 1 byte num of bytes to read, returns the data read */
 #define UART_COMM_COMMAND_READ_DATA_FROM_FLASH      (0x40)
+/* 4 bytes address and 1 byte number of sectors, answers with the CRC32 of
+ * each sector MSByte first followed by an ACK */
+#define UART_COMM_COMMAND_GET_SECTOR_CRC            (0x41)
+/* Answers with the header and the FPGA_CONFIG_BitFileStatus of every bitfile
+ * followed by an ACK. The bitfiles are checked against their MD5 first. */
+#define UART_COMM_COMMAND_GET_BIT_FILE_DIRECTORY    (0x42)
+/* 4 bytes address and 4 bytes length, answers with an ACK followed by chunks
+ * of data that are sent without waiting for the host, see prvServiceStream.
+ * Any new command stops the stream. */
+#define UART_COMM_COMMAND_STREAM_READ_FROM_FLASH    (0x43)
+/* Data = 2 bytes sequence number, 4 bytes flash address, 1 to 256 bytes to
+ * write and 4 bytes CRC32 of everything before it, all MSByte first */
+#define UART_COMM_COMMAND_WRITE_WINDOWED_DATA       (0x31)
+/* Data = None, resets the sequence number and returns the 1 byte window size */
+#define UART_COMM_COMMAND_START_WINDOWED_WRITE      (0x32)
+/* Data = 1 byte number of the bit file and the file name on the SD card */
+#define UART_COMM_COMMAND_COPY_SD_CARD_BIT_FILE     (0x33)
 /* Data = 1 byte number of the bit file to config with */
 #define UART_COMM_COMMAND_START_FPGA_CONFIG         (0x50)
+/* Data = None, returns the 4 byte time from reset to CONF_DONE and the 4 byte
+ * bitfile transfer time of the last config in ms, MSByte first */
+#define UART_COMM_COMMAND_GET_FPGA_CONFIG_TIME      (0x51)
+/* Data = Name of the bit file on the SD card */
+#define UART_COMM_COMMAND_START_FPGA_CONFIG_SD_CARD (0x52)
 
 /** Private typedefs ---------------------------------------------------------*/
 typedef enum
@@ -93,6 +162,22 @@ typedef enum
   UART_CommStateChecksum,  //!< UART_CommStateChecksum
 } UART_CommState;
 
+typedef struct
+{
+  uint32_t address;
+  uint16_t count;
+  uint16_t programmed;  /* Bytes already sent to the flash */
+  uint8_t data[UART_COMM_PAGE_SIZE];
+} UART_CommPage;
+
+typedef enum
+{
+  UART_CommStreamBufferFree,
+  UART_CommStreamBufferReading,
+  UART_CommStreamBufferReady,
+  UART_CommStreamBufferSending,
+} UART_CommStreamBufferState;
+
 /** Private variables --------------------------------------------------------*/
 UART_CommState prvCurrentState = UART_CommStateHeader1;
 uint8_t prvChecksum = 0;
@@ -101,8 +186,38 @@ uint8_t prvDataBuffer[UART_COMM_BUFFER_SIZE] = {0};
 uint32_t prvDataBytesRead = 0;
 uint8_t prvCurrentCommand = 0;
 uint32_t prvCurrentFlashWriteAddress = 0;
+uint32_t prvLastByteTick = 0;
+
+/* Pages that have been ACKed but not sent to the flash yet. A slot is free
+ * as soon as its data is in the flash's page buffer so the next page can be
+ * received while the flash programs */
+static UART_CommPage prvPageQueue[UART_COMM_PAGE_QUEUE_SIZE];
+static uint32_t prvPageQueueHead = 0;
+static uint32_t prvPageQueueCount = 0;
+static uint16_t prvNextSequenceNumber = 0;
+static uint8_t prvWindowResponse[3];
+
+/* Streamed read, one chunk is read from the flash while the other is sent */
+static uint8_t prvStreamChunk[2][UART_COMM_STREAM_CHUNK_OVERHEAD + UART_COMM_STREAM_CHUNK_SIZE];
+static UART_CommStreamBufferState prvStreamBufferState[2];
+static bool prvStreamActive = false;
+static uint32_t prvStreamAddress = 0;
+static uint32_t prvStreamBytesLeft = 0;
+static uint32_t prvStreamNextToRead = 0;
+static uint32_t prvStreamNextToSend = 0;
 
 /** Private function prototypes ----------------------------------------------*/
+static void prvHandleWindowedFrame();
+static void prvSendWindowResponse(uint8_t Response);
+static void prvServicePageQueue();
+static void prvFlushPageQueue();
+static void prvSendSectorCrcs(uint32_t SectorAddress, uint8_t NumOfSectors);
+static ErrorStatus prvStartStream(uint32_t Address, uint32_t Length);
+static void prvServiceStream();
+static void prvStopStream();
+static ErrorStatus prvGetFileName(uint8_t* pData, uint32_t DataCount, char* pFileName);
+static uint32_t prvCrc32(uint8_t* pData, uint32_t DataCount);
+static uint32_t prvCrc32Update(uint32_t Crc, uint8_t* pData, uint32_t DataCount);
 /** Functions ----------------------------------------------------------------*/
 /**
  * @brief
@@ -148,17 +263,26 @@ void UART_COMM_HandleReceivedByte(uint8_t Byte)
   else if (prvCurrentState == UART_CommStateCommand)
   {
     if (Byte == UART_COMM_COMMAND_SET_FLASH_WRITE_ADDRESS ||
+        Byte == UART_COMM_COMMAND_SET_BAUD_RATE ||
         Byte == UART_COMM_COMMAND_ERASE_SECTOR_IN_FLASH ||
         Byte == UART_COMM_COMMAND_WRITE_DATA_TO_FLASH ||
+        Byte == UART_COMM_COMMAND_WRITE_WINDOWED_DATA ||
         Byte == UART_COMM_COMMAND_READ_DATA_FROM_FLASH ||
+        Byte == UART_COMM_COMMAND_GET_SECTOR_CRC ||
+        Byte == UART_COMM_COMMAND_STREAM_READ_FROM_FLASH ||
         Byte == UART_COMM_COMMAND_START_FPGA_CONFIG ||
+        Byte == UART_COMM_COMMAND_START_FPGA_CONFIG_SD_CARD ||
+        Byte == UART_COMM_COMMAND_COPY_SD_CARD_BIT_FILE ||
         Byte == UART_COMM_COMMAND_ERASE_FPGA_BIT_FILE)
     {
       prvCurrentState = UART_CommStateDataCount1;
       LED_SetBlinkPeriod(100);
     }
     else if (Byte == UART_COMM_COMMAND_ERASE_FULL_FLASH ||
-             Byte == UART_COMM_COMMAND_GET_FLASH_WRITE_ADDRESS)
+             Byte == UART_COMM_COMMAND_GET_FLASH_WRITE_ADDRESS ||
+             Byte == UART_COMM_COMMAND_START_WINDOWED_WRITE ||
+             Byte == UART_COMM_COMMAND_GET_FPGA_CONFIG_TIME ||
+             Byte == UART_COMM_COMMAND_GET_BIT_FILE_DIRECTORY)
     {
       prvCurrentState = UART_CommStateChecksum;
       LED_SetBlinkPeriod(100);
@@ -187,10 +311,19 @@ void UART_COMM_HandleReceivedByte(uint8_t Byte)
   else if (prvCurrentState == UART_CommStateDataCount2)
   {
     prvDataBytesToRead |= (uint16_t)Byte;
-    prvCurrentState = UART_CommStateData;
     prvDataBytesRead = 0;
     /* Calculate the checksum */
     prvChecksum ^= Byte;
+    /* A corrupted count must not overflow the buffer */
+    if (prvDataBytesToRead > UART_COMM_BUFFER_SIZE)
+    {
+      prvCurrentState = UART_CommStateHeader1;
+      LED_SetBlinkPeriod(1000);
+    }
+    else if (prvDataBytesToRead == 0)
+      prvCurrentState = UART_CommStateChecksum;
+    else
+      prvCurrentState = UART_CommStateData;
   }
   /* Data =================================================================== */
   else if (prvCurrentState == UART_CommStateData)
@@ -211,6 +344,14 @@ void UART_COMM_HandleReceivedByte(uint8_t Byte)
   /* Checksum =============================================================== */
   else if (prvCurrentState == UART_CommStateChecksum)
   {
+    /* A streamed read is stopped by any new command */
+    if (Byte == prvChecksum)
+      prvStopStream();
+
+    /* Queued pages are programmed first so that other commands see them */
+    if (Byte == prvChecksum && prvCurrentCommand != UART_COMM_COMMAND_WRITE_WINDOWED_DATA)
+      prvFlushPageQueue();
+
     if (Byte == prvChecksum)
     {
       /* Full FLASH erase command */
@@ -227,6 +368,23 @@ void UART_COMM_HandleReceivedByte(uint8_t Byte)
             ((uint32_t)prvDataBuffer[2] << 8) |
             (uint32_t)prvDataBuffer[3];
       }
+      /* Set baud rate, the ACK is sent with the old one */
+      else if (prvCurrentCommand == UART_COMM_COMMAND_SET_BAUD_RATE)
+      {
+        uint32_t baudRate =
+            ((uint32_t)prvDataBuffer[0] << 24) |
+            ((uint32_t)prvDataBuffer[1] << 16) |
+            ((uint32_t)prvDataBuffer[2] << 8) |
+            (uint32_t)prvDataBuffer[3];
+        if (UART1_BaudRateSupported(baudRate))
+        {
+          UART1_SendByte(UART_COMM_ACK);
+          UART1_SetBaudRate(baudRate);
+        }
+        else
+          UART1_SendByte(UART_COMM_NACK);
+        goto change_state;
+      }
       /* Get current write address */
       else if (prvCurrentCommand == UART_COMM_COMMAND_GET_FLASH_WRITE_ADDRESS)
       {
@@ -265,6 +423,21 @@ void UART_COMM_HandleReceivedByte(uint8_t Byte)
         /* Auto-increment the write address */
         prvCurrentFlashWriteAddress += prvDataBytesRead;
       }
+      /* Windowed write to flash */
+      else if (prvCurrentCommand == UART_COMM_COMMAND_WRITE_WINDOWED_DATA)
+      {
+        prvHandleWindowedFrame();
+        goto change_state;
+      }
+      /* Start a windowed write */
+      else if (prvCurrentCommand == UART_COMM_COMMAND_START_WINDOWED_WRITE)
+      {
+        prvNextSequenceNumber = 0;
+        prvDataBuffer[0] = UART_COMM_PAGE_QUEUE_SIZE;
+        prvDataBuffer[1] = UART_COMM_ACK;
+        UART1_SendBuffer(prvDataBuffer, 2);
+        goto change_state;
+      }
       /* Read from flash */
       else if (prvCurrentCommand == UART_COMM_COMMAND_READ_DATA_FROM_FLASH)
       {
@@ -282,6 +455,57 @@ void UART_COMM_HandleReceivedByte(uint8_t Byte)
         UART1_SendBuffer(prvDataBuffer, dataSize + 1);
         goto change_state;
       }
+      /* CRC32 of flash sectors */
+      else if (prvCurrentCommand == UART_COMM_COMMAND_GET_SECTOR_CRC)
+      {
+        uint32_t sectorAddress =
+            ((uint32_t)prvDataBuffer[0] << 24) |
+            ((uint32_t)prvDataBuffer[1] << 16) |
+            ((uint32_t)prvDataBuffer[2] << 8) |
+            (uint32_t)prvDataBuffer[3];
+        uint8_t numOfSectors = prvDataBuffer[4];
+        if (numOfSectors == 0 || numOfSectors > UART_COMM_SECTOR_CRC_MAX_SECTORS ||
+            (sectorAddress % SPI_FLASH_BYTES_IN_SECTOR) != 0)
+        {
+          UART1_SendByte(UART_COMM_NACK);
+          goto change_state;
+        }
+        prvSendSectorCrcs(sectorAddress, numOfSectors);
+        goto change_state;
+      }
+      /* Streamed read from flash */
+      else if (prvCurrentCommand == UART_COMM_COMMAND_STREAM_READ_FROM_FLASH)
+      {
+        uint32_t readAddress =
+            ((uint32_t)prvDataBuffer[0] << 24) |
+            ((uint32_t)prvDataBuffer[1] << 16) |
+            ((uint32_t)prvDataBuffer[2] << 8) |
+            (uint32_t)prvDataBuffer[3];
+        uint32_t length =
+            ((uint32_t)prvDataBuffer[4] << 24) |
+            ((uint32_t)prvDataBuffer[5] << 16) |
+            ((uint32_t)prvDataBuffer[6] << 8) |
+            (uint32_t)prvDataBuffer[7];
+        if (prvStartStream(readAddress, length) != SUCCESS)
+        {
+          UART1_SendByte(UART_COMM_NACK);
+          goto change_state;
+        }
+      }
+      /* Headers and status of all bitfiles */
+      else if (prvCurrentCommand == UART_COMM_COMMAND_GET_BIT_FILE_DIRECTORY)
+      {
+        uint8_t* pEntry = prvDataBuffer;
+        for (uint8_t bitFile = 1; bitFile <= FPGA_CONFIG_NUM_OF_BIT_FILES; bitFile++)
+        {
+          FPGA_CONFIG_ReadHeader(bitFile, pEntry);
+          pEntry[FPGA_CONFIG_HEADER_SIZE] = FPGA_CONFIG_VerifyBitFile(bitFile);
+          pEntry += FPGA_CONFIG_HEADER_SIZE + 1;
+        }
+        *pEntry++ = UART_COMM_ACK;
+        UART1_SendBuffer(prvDataBuffer, pEntry - prvDataBuffer);
+        goto change_state;
+      }
       /* Start FPGA Config */
       else if (prvCurrentCommand == UART_COMM_COMMAND_START_FPGA_CONFIG)
       {
@@ -292,6 +516,46 @@ void UART_COMM_HandleReceivedByte(uint8_t Byte)
           goto change_state;
         }
       }
+      /* Start FPGA Config from the SD card */
+      else if (prvCurrentCommand == UART_COMM_COMMAND_START_FPGA_CONFIG_SD_CARD)
+      {
+        char fileName[UART_COMM_MAX_FILE_NAME_LENGTH + 1];
+        if (prvGetFileName(prvDataBuffer, prvDataBytesRead, fileName) != SUCCESS ||
+            FPGA_CONFIG_StartFromSdCard(fileName) != SUCCESS)
+        {
+          UART1_SendByte(UART_COMM_NACK);
+          goto change_state;
+        }
+      }
+      /* Copy a bit file from the SD card to the flash */
+      else if (prvCurrentCommand == UART_COMM_COMMAND_COPY_SD_CARD_BIT_FILE)
+      {
+        char fileName[UART_COMM_MAX_FILE_NAME_LENGTH + 1];
+        if (prvDataBytesRead < 2 ||
+            prvGetFileName(&prvDataBuffer[1], prvDataBytesRead - 1, fileName) != SUCCESS ||
+            FPGA_CONFIG_CopyFromSdCard(fileName, prvDataBuffer[0]) != SUCCESS)
+        {
+          UART1_SendByte(UART_COMM_NACK);
+          goto change_state;
+        }
+      }
+      /* Get the timing of the last FPGA config */
+      else if (prvCurrentCommand == UART_COMM_COMMAND_GET_FPGA_CONFIG_TIME)
+      {
+        uint32_t confDoneTick = FPGA_CONFIG_LastConfDoneTick();
+        uint32_t transferTime = FPGA_CONFIG_LastTransferTime();
+        prvDataBuffer[0] = (confDoneTick >> 24) & 0xFF;
+        prvDataBuffer[1] = (confDoneTick >> 16) & 0xFF;
+        prvDataBuffer[2] = (confDoneTick >> 8) & 0xFF;
+        prvDataBuffer[3] = (confDoneTick) & 0xFF;
+        prvDataBuffer[4] = (transferTime >> 24) & 0xFF;
+        prvDataBuffer[5] = (transferTime >> 16) & 0xFF;
+        prvDataBuffer[6] = (transferTime >> 8) & 0xFF;
+        prvDataBuffer[7] = (transferTime) & 0xFF;
+        prvDataBuffer[8] = UART_COMM_ACK;
+        UART1_SendBuffer(prvDataBuffer, 9);
+        goto change_state;
+      }
       else
       {
         /* Command not recognized */
@@ -301,6 +565,11 @@ void UART_COMM_HandleReceivedByte(uint8_t Byte)
       /* Checksum OK */
       UART1_SendByte(UART_COMM_ACK);
     }
+    /* Checksum wrong, tell the host where to restart a windowed write */
+    else if (prvCurrentCommand == UART_COMM_COMMAND_WRITE_WINDOWED_DATA)
+    {
+      prvSendWindowResponse(UART_COMM_WINDOW_NACK);
+    }
     else
     {
       /* Checksum wrong */
@@ -318,5 +587,402 @@ change_state:
   }
 }
 
+/**
+ * @brief   Handle a span of received bytes, the data part of a command is
+ *          copied in one go
+ * @param   pData: The bytes
+ * @param   DataCount: Number of bytes
+ * @retval  None
+ */
+void UART_COMM_HandleReceivedData(uint8_t* pData, uint32_t DataCount)
+{
+  prvLastByteTick = HAL_GetTick();
+  while (DataCount != 0)
+  {
+    if (prvCurrentState == UART_CommStateData)
+    {
+      uint32_t count = prvDataBytesToRead;
+      if (count > DataCount)
+        count = DataCount;
+      memcpy(&prvDataBuffer[prvDataBytesRead], pData, count);
+      for (uint32_t i = 0; i < count; i++)
+        prvChecksum ^= pData[i];
+      prvDataBytesRead += count;
+      prvDataBytesToRead -= count;
+      if (prvDataBytesToRead == 0)
+        prvCurrentState = UART_CommStateChecksum;
+      pData += count;
+      DataCount -= count;
+    }
+    else
+    {
+      UART_COMM_HandleReceivedByte(*pData++);
+      DataCount--;
+    }
+  }
+}
+
+/**
+ * @brief   Drop a partly received command, for example when bytes were lost
+ * @param   None
+ * @retval  None
+ */
+void UART_COMM_ResetParser()
+{
+  prvCurrentState = UART_CommStateHeader1;
+  LED_SetBlinkPeriod(1000);
+}
+
+/**
+ * @brief   Start programming the next queued page if the flash is done with
+ *          the last one and drop a stalled command, should be called from the
+ *          main loop between the received bytes. It never waits for the flash.
+ * @param   None
+ * @retval  true if there is more to do, false if it's idle
+ */
+bool UART_COMM_Process()
+{
+  if (prvCurrentState != UART_CommStateHeader1 &&
+      HAL_GetTick() - prvLastByteTick > UART_COMM_TIMEOUT_MS)
+    UART_COMM_ResetParser();
+
+  prvServicePageQueue();
+  prvServiceStream();
+  return (prvPageQueueCount != 0 || SPI_FLASH_PageProgramInProgress() || prvStreamActive);
+}
+
 /** Private functions .-------------------------------------------------------*/
+/**
+ * @brief   Check and queue a received windowed write frame
+ * @param   None
+ * @retval  None
+ */
+static void prvHandleWindowedFrame()
+{
+  if (prvDataBytesRead <= UART_COMM_WINDOW_FRAME_OVERHEAD ||
+      prvDataBytesRead > UART_COMM_WINDOW_FRAME_OVERHEAD + UART_COMM_PAGE_SIZE)
+  {
+    prvSendWindowResponse(UART_COMM_WINDOW_NACK);
+    return;
+  }
+
+  uint32_t crcOffset = prvDataBytesRead - 4;
+  uint32_t crc =
+      ((uint32_t)prvDataBuffer[crcOffset] << 24) |
+      ((uint32_t)prvDataBuffer[crcOffset + 1] << 16) |
+      ((uint32_t)prvDataBuffer[crcOffset + 2] << 8) |
+      (uint32_t)prvDataBuffer[crcOffset + 3];
+  uint16_t sequenceNumber = ((uint16_t)prvDataBuffer[0] << 8) | prvDataBuffer[1];
+  uint32_t address =
+      ((uint32_t)prvDataBuffer[2] << 24) |
+      ((uint32_t)prvDataBuffer[3] << 16) |
+      ((uint32_t)prvDataBuffer[4] << 8) |
+      (uint32_t)prvDataBuffer[5];
+
+  if (crc != prvCrc32(prvDataBuffer, crcOffset))
+  {
+    prvSendWindowResponse(UART_COMM_WINDOW_NACK);
+    return;
+  }
+
+  /* Frames behind the next sequence number were resent because an ACK got
+   * lost and are already queued, frames ahead of it come after a lost frame */
+  if (sequenceNumber != prvNextSequenceNumber)
+  {
+    if ((uint16_t)(prvNextSequenceNumber - sequenceNumber) < 0x8000)
+      prvSendWindowResponse(UART_COMM_WINDOW_ACK);
+    else
+      prvSendWindowResponse(UART_COMM_WINDOW_NACK);
+    return;
+  }
+
+  /* A queued page can't be rejected later as it has been ACKed by then */
+  uint32_t count = crcOffset - 6;
+  if (address >= SPI_FLASH_SIZE_BYTES || count > SPI_FLASH_SIZE_BYTES - address)
+  {
+    prvSendWindowResponse(UART_COMM_WINDOW_NACK);
+    return;
+  }
+
+  /* Wait for the flash to take the oldest page, the RX buffer takes the
+   * bytes that arrive meanwhile */
+  while (prvPageQueueCount == UART_COMM_PAGE_QUEUE_SIZE)
+    prvServicePageQueue();
+
+  UART_CommPage* page = &prvPageQueue[(prvPageQueueHead + prvPageQueueCount) % UART_COMM_PAGE_QUEUE_SIZE];
+  page->address = address;
+  page->count = count;
+  page->programmed = 0;
+  memcpy(page->data, &prvDataBuffer[6], page->count);
+  prvPageQueueCount++;
+
+  prvNextSequenceNumber++;
+  prvSendWindowResponse(UART_COMM_WINDOW_ACK);
+
+  /* Keep the flash busy if it is idle */
+  prvServicePageQueue();
+}
+
+/**
+ * @brief   Send an ACK or NACK with the next sequence number expected
+ * @param   Response: UART_COMM_WINDOW_ACK or UART_COMM_WINDOW_NACK
+ * @retval  None
+ */
+static void prvSendWindowResponse(uint8_t Response)
+{
+  /* The buffer is read by the TX DMA, wait for the last response */
+  while (UART1_TxBusy());
+
+  prvWindowResponse[0] = Response;
+  prvWindowResponse[1] = (prvNextSequenceNumber >> 8) & 0xFF;
+  prvWindowResponse[2] = prvNextSequenceNumber & 0xFF;
+  UART1_SendBuffer(prvWindowResponse, 3);
+}
+
+/**
+ * @brief   Start programming the oldest page in the queue if the flash is not
+ *          busy. A page that crosses a flash page boundary is programmed in
+ *          two parts. Checks the flash status once, does not wait.
+ * @param   None
+ * @retval  None
+ */
+static void prvServicePageQueue()
+{
+  if (prvPageQueueCount == 0 || SPI_FLASH_PageProgramInProgress())
+    return;
+
+  UART_CommPage* page = &prvPageQueue[prvPageQueueHead];
+  uint32_t address = page->address + page->programmed;
+  uint32_t count = page->count - page->programmed;
+  uint32_t bytesLeftInPage = SPI_FLASH_BYTES_IN_PAGE - (address % SPI_FLASH_BYTES_IN_PAGE);
+  if (count > bytesLeftInPage)
+    count = bytesLeftInPage;
+
+  /* The range was checked when the frame was queued, this can't fail but a
+   * failing page must not block the queue */
+  if (SPI_FLASH_StartPageProgram(&page->data[page->programmed], address, count) == SUCCESS)
+    page->programmed += count;
+  else
+    page->programmed = page->count;
+
+  if (page->programmed == page->count)
+  {
+    prvPageQueueHead = (prvPageQueueHead + 1) % UART_COMM_PAGE_QUEUE_SIZE;
+    prvPageQueueCount--;
+  }
+}
+
+/**
+ * @brief   Program all queued pages, the other flash functions wait for the
+ *          last one to finish
+ * @param   None
+ * @retval  None
+ */
+static void prvFlushPageQueue()
+{
+  while (prvPageQueueCount != 0)
+    prvServicePageQueue();
+}
+
+/**
+ * @brief   Send the CRC32 of a number of sectors followed by an ACK, used by
+ *          the host to find out which sectors of a bitfile have changed
+ * @param   SectorAddress: Address of the first sector
+ * @param   NumOfSectors: Number of sectors, max UART_COMM_SECTOR_CRC_MAX_SECTORS
+ * @retval  None
+ */
+static void prvSendSectorCrcs(uint32_t SectorAddress, uint8_t NumOfSectors)
+{
+  uint8_t* pReadBuffer = &prvDataBuffer[UART_COMM_SECTOR_CRC_READ_SIZE];
+
+  for (uint32_t sector = 0; sector < NumOfSectors; sector++)
+  {
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint32_t offset = 0; offset < SPI_FLASH_BYTES_IN_SECTOR; offset += UART_COMM_SECTOR_CRC_READ_SIZE)
+    {
+      SPI_FLASH_ReadBuffer(pReadBuffer, SectorAddress + offset, UART_COMM_SECTOR_CRC_READ_SIZE);
+      crc = prvCrc32Update(crc, pReadBuffer, UART_COMM_SECTOR_CRC_READ_SIZE);
+    }
+    crc = ~crc;
+    prvDataBuffer[sector*4] = (crc >> 24) & 0xFF;
+    prvDataBuffer[sector*4 + 1] = (crc >> 16) & 0xFF;
+    prvDataBuffer[sector*4 + 2] = (crc >> 8) & 0xFF;
+    prvDataBuffer[sector*4 + 3] = (crc) & 0xFF;
+    SectorAddress += SPI_FLASH_BYTES_IN_SECTOR;
+  }
+
+  prvDataBuffer[NumOfSectors*4] = UART_COMM_ACK;
+  UART1_SendBuffer(prvDataBuffer, NumOfSectors*4 + 1);
+}
+
+/**
+ * @brief   Start a streamed read, the chunks are sent from prvServiceStream
+ *          after the ACK
+ * @param   Address: Address of the first byte
+ * @param   Length: Number of bytes
+ * @retval  ERROR if it's outside the flash
+ */
+static ErrorStatus prvStartStream(uint32_t Address, uint32_t Length)
+{
+  if (Length == 0 || Address >= SPI_FLASH_SIZE_BYTES || Length > SPI_FLASH_SIZE_BYTES - Address)
+    return ERROR;
+
+  if (SPI_FLASH_StartReadStream(Address) != SUCCESS)
+    return ERROR;
+  prvStreamAddress = Address;
+  prvStreamBytesLeft = Length;
+  prvStreamNextToRead = 0;
+  prvStreamNextToSend = 0;
+  prvStreamBufferState[0] = UART_CommStreamBufferFree;
+  prvStreamBufferState[1] = UART_CommStreamBufferFree;
+  prvStreamActive = true;
+  return SUCCESS;
+}
+
+/**
+ * @brief   Move a streamed read forward without waiting. A chunk is read with
+ *          DMA into one buffer while the other one is sent with DMA.
+ * @param   None
+ * @retval  None
+ */
+static void prvServiceStream()
+{
+  if (!prvStreamActive)
+    return;
+
+  /* The chunk being sent is done, checked once so that it's always freed
+   * before the next one is sent */
+  bool txBusy = UART1_TxBusy();
+  uint32_t sent = prvStreamNextToSend ^ 1;
+  if (prvStreamBufferState[sent] == UART_CommStreamBufferSending && !txBusy)
+    prvStreamBufferState[sent] = UART_CommStreamBufferFree;
+
+  /* The chunk being read is done, add the CRC */
+  uint32_t reading = prvStreamNextToRead ^ 1;
+  if (prvStreamBufferState[reading] == UART_CommStreamBufferReading && !SPI_FLASH_ReadStreamDmaBusy())
+  {
+    uint8_t* pChunk = prvStreamChunk[reading];
+    uint32_t crcOffset = UART_COMM_STREAM_DATA_OFFSET + ((pChunk[5] << 8) | pChunk[6]);
+    uint32_t crc = prvCrc32(pChunk, crcOffset);
+    pChunk[crcOffset] = (crc >> 24) & 0xFF;
+    pChunk[crcOffset + 1] = (crc >> 16) & 0xFF;
+    pChunk[crcOffset + 2] = (crc >> 8) & 0xFF;
+    pChunk[crcOffset + 3] = (crc) & 0xFF;
+    prvStreamBufferState[reading] = UART_CommStreamBufferReady;
+    if (prvStreamBytesLeft == 0)
+      SPI_FLASH_EndReadStream();
+  }
+
+  /* Send the next chunk when the UART is free, the ACK goes first */
+  uint8_t* pChunk = prvStreamChunk[prvStreamNextToSend];
+  if (prvStreamBufferState[prvStreamNextToSend] == UART_CommStreamBufferReady && !txBusy)
+  {
+    uint32_t count = (pChunk[5] << 8) | pChunk[6];
+    UART1_SendBufferDma(pChunk, UART_COMM_STREAM_CHUNK_OVERHEAD + count);
+    prvStreamBufferState[prvStreamNextToSend] = UART_CommStreamBufferSending;
+    prvStreamNextToSend ^= 1;
+  }
+
+  /* Read the next chunk into a free buffer when the last read is done */
+  pChunk = prvStreamChunk[prvStreamNextToRead];
+  if (prvStreamBytesLeft != 0 &&
+      prvStreamBufferState[prvStreamNextToRead] == UART_CommStreamBufferFree &&
+      prvStreamBufferState[prvStreamNextToRead ^ 1] != UART_CommStreamBufferReading)
+  {
+    uint32_t count = prvStreamBytesLeft;
+    if (count > UART_COMM_STREAM_CHUNK_SIZE)
+      count = UART_COMM_STREAM_CHUNK_SIZE;
+    pChunk[0] = UART_COMM_STREAM_CHUNK_START;
+    pChunk[1] = (prvStreamAddress >> 24) & 0xFF;
+    pChunk[2] = (prvStreamAddress >> 16) & 0xFF;
+    pChunk[3] = (prvStreamAddress >> 8) & 0xFF;
+    pChunk[4] = (prvStreamAddress) & 0xFF;
+    pChunk[5] = (count >> 8) & 0xFF;
+    pChunk[6] = (count) & 0xFF;
+    SPI_FLASH_ReadStreamDma(&pChunk[UART_COMM_STREAM_DATA_OFFSET], count);
+    prvStreamBufferState[prvStreamNextToRead] = UART_CommStreamBufferReading;
+    prvStreamNextToRead ^= 1;
+    prvStreamAddress += count;
+    prvStreamBytesLeft -= count;
+  }
+
+  /* Everything has been read and sent */
+  if (prvStreamBytesLeft == 0 &&
+      prvStreamBufferState[0] == UART_CommStreamBufferFree &&
+      prvStreamBufferState[1] == UART_CommStreamBufferFree)
+    prvStreamActive = false;
+}
+
+/**
+ * @brief   Stop a streamed read, a chunk that is being sent is finished
+ * @param   None
+ * @retval  None
+ */
+static void prvStopStream()
+{
+  if (!prvStreamActive)
+    return;
+
+  /* The flash is still selected until the last chunk has been read */
+  if (prvStreamBytesLeft != 0 ||
+      prvStreamBufferState[0] == UART_CommStreamBufferReading ||
+      prvStreamBufferState[1] == UART_CommStreamBufferReading)
+    SPI_FLASH_EndReadStream();
+  prvStreamActive = false;
+}
+
+/**
+ * @brief   Copy a file name from the data of a command and terminate it
+ * @param   pData: The name, not terminated
+ * @param   DataCount: Length of the name
+ * @param   pFileName: Where to put UART_COMM_MAX_FILE_NAME_LENGTH + 1 bytes
+ * @retval  ERROR if the name is empty or too long
+ */
+static ErrorStatus prvGetFileName(uint8_t* pData, uint32_t DataCount, char* pFileName)
+{
+  if (DataCount == 0 || DataCount > UART_COMM_MAX_FILE_NAME_LENGTH)
+    return ERROR;
+
+  memcpy(pFileName, pData, DataCount);
+  pFileName[DataCount] = '\0';
+  return SUCCESS;
+}
+
+/**
+ * @brief   Calculate the CRC32 of a buffer, same as zlib and binascii.crc32
+ * @param   pData: The data
+ * @param   DataCount: Number of bytes
+ * @retval  The CRC32
+ */
+static uint32_t prvCrc32(uint8_t* pData, uint32_t DataCount)
+{
+  return ~prvCrc32Update(0xFFFFFFFF, pData, DataCount);
+}
+
+/**
+ * @brief   Add data to a CRC32 that is calculated in parts
+ * @param   Crc: The CRC so far, start with 0xFFFFFFFF and invert the result
+ * @param   pData: The data
+ * @param   DataCount: Number of bytes
+ * @retval  The CRC so far
+ */
+static uint32_t prvCrc32Update(uint32_t Crc, uint8_t* pData, uint32_t DataCount)
+{
+  /* Half-byte table to keep the flash usage down */
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+  };
+
+  while (DataCount--)
+  {
+    Crc ^= *pData++;
+    Crc = (Crc >> 4) ^ table[Crc & 0x0F];
+    Crc = (Crc >> 4) ^ table[Crc & 0x0F];
+  }
+  return Crc;
+}
+
 /** Interrupt Handlers -------------------------------------------------------*/
@@ -44,18 +44,62 @@ init()
 verboseMode = 0
 activeSerialPort = 0
 
+# The board starts at the default baud rate and can be switched to a higher one
+DEFAULT_BAUD_RATE = 115200
+baudRate = DEFAULT_BAUD_RATE
+
+# Frames in flight for the windowed upload, 0 uses the stop-and-wait upload
+DEFAULT_WINDOW_SIZE = 4
+# Seconds without progress before the unacked frames are sent again
+WINDOW_TIMEOUT = 1.0
+WINDOW_MAX_RETRIES = 10
+
+# Compressed bitfiles, must match bitfile_lz.c in the firmware
+HEADER_FORMAT_LZ = 0x01
+LZ_WINDOW_SIZE = 1024
+LZ_MIN_MATCH = 3
+LZ_MAX_MATCH = 4096
+LZ_MAX_LITERALS = 128
+LZ_MAX_CHAIN = 32
+
+# Differential update, must match UART_COMM_SECTOR_CRC_MAX_SECTORS
+SECTOR_SIZE = 4096
+SECTORS_IN_BIT_FILE = 393216 / SECTOR_SIZE
+SECTOR_CRC_MAX_SECTORS = 64
+
+# Bitfile directory, must match FPGA_CONFIG_HEADER_SIZE and FPGA_CONFIG_BitFileStatus
+HEADER_SIZE = 4 + 64 + 6 + 16 + 1 + 4
+NUM_OF_BIT_FILES = 5
+BIT_FILE_STATUS_VALID = 1
+BIT_FILE_STATUS_CORRUPT = 2
+
+# Streamed read, must match uart_comm.c
+FLASH_SIZE = 0x200000
+STREAM_CHUNK_START = 0xDB
+STREAM_CHUNK_HEADER_SIZE = 1 + 4 + 2
+STREAM_MAX_RETRIES = 5
+
+# Bitfiles on the SD card, must match UART_COMM_MAX_FILE_NAME_LENGTH
+SD_CARD_MAX_FILE_NAME_LENGTH = 12
+
 def main(argv):
   serialPort = ''
   bitFileNumber = ''
   binaryFile = ''
+  sdCardFile = ''
+  windowSize = DEFAULT_WINDOW_SIZE
+  compress = 0
 
   shouldStoreBitfile = 0
+  shouldUpdateBitfile = 0
   shouldDeleteBitfile = 0
   shouldConfigBitfile = 0
   shouldReadHeaders = 0
+  shouldReadTiming = 0
+  shouldDump = 0
 
   try:
-    opts, args = getopt.getopt(argv, "hlp:n:b:", ["help", "store", "delete", "config", "read", "verbose"])
+    opts, args = getopt.getopt(argv, "hlp:n:b:s:w:r:c", ["help", "store", "update", "delete", "config", "read", "timing", "dump", "verbose"])
   except getopt.GetoptError as err:
     print Fore.RED + "ERROR: " + str(err) + Fore.RESET
     showUsage(sys.argv[0])
@@ -88,10 +132,31 @@ def main(argv):
     elif opt in "-b":
       binaryFile = arg
     # --------------------------------------------------------------------------
+    # Name of a bitfile on the SD card in the board
+    elif opt in "-s":
+      sdCardFile = arg
+    # --------------------------------------------------------------------------
+    # Window size for the upload
+    elif opt in "-w":
+      windowSize = int(arg)
+    # --------------------------------------------------------------------------
+    # Baud rate to switch to
+    elif opt in "-r":
+      global baudRate
+      baudRate = int(arg)
+    # --------------------------------------------------------------------------
+    # Compress the bitfile when storing
+    elif opt in "-c":
+      compress = 1
+    # --------------------------------------------------------------------------
     # Store bitfile at position
     elif opt in "--store":
       shouldStoreBitfile = 1
     # --------------------------------------------------------------------------
+    # Update bitfile at position, only the changed sectors are written
+    elif opt in "--update":
+      shouldUpdateBitfile = 1
+    # --------------------------------------------------------------------------
     # Delete bitfile at position
     elif opt in "--delete":
       shouldDeleteBitfile = 1
@@ -104,6 +169,14 @@ def main(argv):
     elif opt in "--read":
       shouldReadHeaders = 1
     # --------------------------------------------------------------------------
+    # Read the timing of the last FPGA config
+    elif opt in "--timing":
+      shouldReadTiming = 1
+    # --------------------------------------------------------------------------
+    # Dump the flash to a file
+    elif opt in "--dump":
+      shouldDump = 1
+    # --------------------------------------------------------------------------
     # Verbose mode
     elif opt in "--verbose":
       global verboseMode
@@ -123,22 +196,65 @@ def main(argv):
     readHeaders(serialPort)
     sys.exit(0)
 
+  # ----------------------------------------------------------------------------
+  # Read the timing of the last FPGA config
+  if (shouldReadTiming == 1):
+    openSerialPort(serialPort)
+    readConfigTiming(activeSerialPort)
+    sys.exit(0)
+
+  # ----------------------------------------------------------------------------
+  # Dump the flash, a bitfile slot if a bitfile number was defined
+  if (shouldDump == 1):
+    if (binaryFile == ''):
+      print Fore.RED + "ERROR: No output path defined, (use -b)" + Fore.RESET
+      sys.exit(1)
+    dumpFlash(serialPort, bitFileNumber, binaryFile)
+    sys.exit(0)
+
+  # ----------------------------------------------------------------------------
+  # Start the configuration with a bitfile on the SD card
+  if (shouldConfigBitfile == 1 and sdCardFile != ''):
+    startConfigFromSdCard(serialPort, sdCardFile)
+    sys.exit(0)
+
   # ****************************************************************************
   # Check if a bitfile number was defined
   if (bitFileNumber == ''):
     print Fore.RED + "ERROR: No bitfile number defined, (use -n)" + Fore.RESET
     sys.exit(1)
 
+  # ----------------------------------------------------------------------------
+  # Copy a bitfile from the SD card
+  if (shouldStoreBitfile == 1 and sdCardFile != ''):
+    copyFromSdCard(serialPort, bitFileNumber, sdCardFile)
+    sys.exit(0)
+
   # ----------------------------------------------------------------------------
   # Store the bitfile
   if (shouldStoreBitfile == 1 and binaryFile != ''):
-    storeBitfile(serialPort, bitFileNumber, binaryFile)
+    if (compress == 1 and windowSize == 0):
+      print Fore.RED + "ERROR: Compression needs the windowed upload, don't use -w 0 with -c" + Fore.RESET
+      sys.exit(1)
+    storeBitfile(serialPort, bitFileNumber, binaryFile, windowSize, compress)
     sys.exit(0)
   elif (shouldStoreBitfile == 1):
     print binaryFile
     print Fore.RED + "ERROR: No bitfile path defined, (use -b)" + Fore.RESET
     sys.exit(1)
 
+  # ----------------------------------------------------------------------------
+  # Update the bitfile
+  if (shouldUpdateBitfile == 1 and binaryFile != ''):
+    if (windowSize == 0):
+      print Fore.RED + "ERROR: Update needs the windowed upload, don't use -w 0 with --update" + Fore.RESET
+      sys.exit(1)
+    updateBitfile(serialPort, bitFileNumber, binaryFile, windowSize, compress)
+    sys.exit(0)
+  elif (shouldUpdateBitfile == 1):
+    print Fore.RED + "ERROR: No bitfile path defined, (use -b)" + Fore.RESET
+    sys.exit(1)
+
   # ----------------------------------------------------------------------------
   # Delete the bitfile
   if (shouldDeleteBitfile == 1):
@@ -163,17 +279,24 @@ def main(argv):
 # ==============================================================================
 def showUsage(name):
   print Fore.CYAN + "usage:"
-  print "  python " + name + " [-h, --help] [-l] [-p] [-n] [-b] [--store] [--delete] [--config] [--read] [-v]"
+  print "  python " + name + " [-h, --help] [-l] [-p] [-n] [-b] [-s] [-w] [-r] [-c] [--store] [--update] [--delete] [--config] [--read] [--timing] [--dump] [-v]"
   print "options:"
   print "  -h, --help : Display this help"
   print "  -l         : List the available serial ports"
   print "  -p arg     : Specifiy the serial port to use"
   print "  -n arg     : Specifiy the bitfile number"
   print "  -b arg     : Path to the bitfile"
+  print "  -s arg     : Name of a bitfile on the SD card in the board, used instead of -b with --store and of -n with --config"
+  print "  -r arg     : Baud rate to switch the board to, default " + str(DEFAULT_BAUD_RATE) + ", e.g. 921600"
+  print "  -w arg     : Frames in flight when storing, default " + str(DEFAULT_WINDOW_SIZE) + ", 0 waits for every ACK"
+  print "  -c         : Compress the bitfile when storing, it's decompressed by the board during config"
   print "  --store    : Store the specified bitfile"
+  print "  --update   : Store the specified bitfile over the old one, only the changed sectors are written"
   print "  --delete   : Delete the specified bitfile"
   print "  --config   : Start config of the specified bitfile"
-  print "  --read     : Read the bitfile headers stored in flash"
+  print "  --read     : Read the bitfile headers stored in flash and check the bitfiles against their MD5"
+  print "  --timing   : Show how long the last FPGA config took, the one at power-on if --config has not been used since"
+  print "  --dump     : Save the flash to the file given with -b, only the bitfile slot if -n is used"
   print "  --verbose  : Verbose mode, i.e. display all information"
   print ""
   print "examples:"
@@ -183,6 +306,22 @@ def showUsage(name):
   print "    python " + name + " -p /dev/ttyS0 --read"
   print "  Store a bitfile named example.rbf at position 2:"
   print "    python " + name + " -p /dev/ttyS0 --store -n 2 -b /path/to/example.rbf"
+  print "  Store it at 921600 baud:"
+  print "    python " + name + " -p /dev/ttyS0 --store -n 2 -b /path/to/example.rbf -r 921600"
+  print "  Store it compressed:"
+  print "    python " + name + " -p /dev/ttyS0 --store -n 2 -b /path/to/example.rbf -c"
+  print "  Store it with the old stop-and-wait upload to compare the time:"
+  print "    python " + name + " -p /dev/ttyS0 --store -n 2 -b /path/to/example.rbf -w 0"
+  print "  Copy FPGA.RBF from the SD card in the board to position 2:"
+  print "    python " + name + " -p /dev/ttyS0 --store -n 2 -s FPGA.RBF"
+  print "  Configure the FPGA straight from the SD card:"
+  print "    python " + name + " -p /dev/ttyS0 --config -s FPGA.RBF"
+  print "  Store a new version of it after a small change:"
+  print "    python " + name + " -p /dev/ttyS0 --update -n 2 -b /path/to/example.rbf"
+  print "  Show the time from power-on to CONF_DONE:"
+  print "    python " + name + " -p /dev/ttyS0 --timing"
+  print "  Back up the whole flash:"
+  print "    python " + name + " -p /dev/ttyS0 --dump -b /path/to/backup.bin -r 921600"
   print "  Delete the bitfile at position 4:"
   print "    python " + name + " -p /dev/ttyS0 --delete -n 4"
   print Fore.RESET
@@ -223,7 +362,7 @@ def openSerialPort(serialPort):
   # Try to open the serial port
   global activeSerialPort
   try:
-    activeSerialPort = serial.Serial(serialPort, 115200, timeout=10)
+    activeSerialPort = serial.Serial(serialPort, DEFAULT_BAUD_RATE, timeout=10)
   except:
     print Fore.RED + "ERROR: Invalid serial port. Is it connected?" + Fore.RESET
     sys.exit(1)
@@ -234,6 +373,49 @@ def openSerialPort(serialPort):
   else:
     print Fore.CYAN + "INFO: Serial port is open" + Fore.RESET
 
+  if (baudRate != DEFAULT_BAUD_RATE):
+    switchBaudRate(baudRate)
+
+# ==============================================================================
+# Function to check if the board answers at the current baud rate
+# ==============================================================================
+def pingDevice(serialPort):
+  serialPort.flushInput()
+  msg = extendMessageWithChecksum(bytearray([0xAA, 0xBB, 0xCC, 0x11]))
+  serialPort.write(msg)
+  oldTimeout = serialPort.timeout
+  serialPort.timeout = 0.5
+  response = serialPort.read(5)
+  serialPort.timeout = oldTimeout
+  return (len(response) == 5 and ord(response[4]) == 0xDD)
+
+# ==============================================================================
+# Function to switch the board and the serial port to a new baud rate
+# The board keeps the baud rate until it's reset so it's tried first
+# ==============================================================================
+def switchBaudRate(newBaudRate):
+  global activeSerialPort
+  activeSerialPort.baudrate = newBaudRate
+  if (pingDevice(activeSerialPort)):
+    return
+
+  # Let the board drop the garbage it got at the wrong baud rate
+  time.sleep(0.2)
+  activeSerialPort.baudrate = DEFAULT_BAUD_RATE
+  msg = bytearray([0xAA, 0xBB, 0xCC, 0x12, 0x00, 0x04])
+  msg.extend(bytearray(convertIntToHexString(newBaudRate)))
+  msg = extendMessageWithChecksum(msg)
+  activeSerialPort.flushInput()
+  activeSerialPort.write(msg)
+  waitForAck(activeSerialPort)
+
+  activeSerialPort.baudrate = newBaudRate
+  if (not pingDevice(activeSerialPort)):
+    print Fore.RED + "ERROR: No answer at " + str(newBaudRate) + " baud" + Fore.RESET
+    sys.exit(1)
+  if (verboseMode == 1):
+    print "INFO: Switched to " + str(newBaudRate) + " baud"
+
 # ==============================================================================
 # Function to convert integer to hex string
 # ==============================================================================
@@ -280,9 +462,328 @@ def waitForAck(serialPort):
 
 
 # ==============================================================================
-# Function to store the bitfile
+# Function to build the bitfile header, size, name, modified time and md5
+# A compressed bitfile adds the format and the compressed size
+# ==============================================================================
+def buildBitfileHeader(binaryFile, compressedSize=0):
+  header = bytearray(convertIntToHexString(os.path.getsize(binaryFile)))
+  fileName = os.path.basename(binaryFile)
+  # Cut or fill the name with spaces to 64 characters
+  header.extend(bytearray(fileName[:64].ljust(64)))
+  # Format: YYMMDDHHMMSS
+  modTime = datetime.datetime.fromtimestamp(os.path.getmtime(binaryFile))
+  header.extend(bytearray([modTime.year-2000, modTime.month, modTime.day, modTime.hour, modTime.minute, modTime.second]))
+  header.extend(bytearray(md5Checksum(binaryFile).decode("hex")))
+  if (compressedSize != 0):
+    header.append(HEADER_FORMAT_LZ)
+    header.extend(bytearray(convertIntToHexString(compressedSize)))
+  return header
+
+# ==============================================================================
+# Function to compress a bitfile for the board
+# Tokens, see bitfile_lz.c in the firmware:
+#   0LLLLLLL                   : L+1 literal bytes follow
+#   1LLLLLOO OOOOOOOO [E ...]  : copy L+3 bytes from O+1 bytes back, when L is
+#                                31 extra bytes are added to the length until
+#                                one is not 255
+# ==============================================================================
+def compressBitfile(data):
+  data = bytearray(data)
+  length = len(data)
+  output = bytearray()
+  literals = bytearray()
+  # Recent positions for every 3 byte sequence
+  positions = {}
+
+  def addPosition(position):
+    key = (data[position] << 16) | (data[position+1] << 8) | data[position+2]
+    chain = positions.setdefault(key, [])
+    chain.append(position)
+    if (len(chain) > LZ_MAX_CHAIN):
+      del chain[0]
+
+  def flushLiterals():
+    start = 0
+    while (start < len(literals)):
+      count = min(LZ_MAX_LITERALS, len(literals) - start)
+      output.append(count - 1)
+      output.extend(literals[start:start+count])
+      start += count
+    del literals[:]
+
+  i = 0
+  while (i < length):
+    bestLength = 0
+    bestOffset = 0
+    if (i + LZ_MIN_MATCH <= length):
+      key = (data[i] << 16) | (data[i+1] << 8) | data[i+2]
+      maxLength = min(LZ_MAX_MATCH, length - i)
+      for j in reversed(positions.get(key, [])):
+        if (i - j > LZ_WINDOW_SIZE):
+          break
+        matchLength = LZ_MIN_MATCH
+        while (matchLength < maxLength and data[j + matchLength] == data[i + matchLength]):
+          matchLength += 1
+        if (matchLength > bestLength):
+          bestLength = matchLength
+          bestOffset = i - j
+          if (matchLength == maxLength):
+            break
+
+    if (bestLength >= LZ_MIN_MATCH):
+      flushLiterals()
+      lengthCode = min(bestLength - LZ_MIN_MATCH, 31)
+      output.append(0x80 | (lengthCode << 2) | ((bestOffset - 1) >> 8))
+      output.append((bestOffset - 1) & 0xFF)
+      if (lengthCode == 31):
+        extra = bestLength - LZ_MIN_MATCH - 31
+        while (extra >= 255):
+          output.append(255)
+          extra -= 255
+        output.append(extra)
+      # Only the start of a match is remembered to keep it fast
+      addPosition(i)
+      i += bestLength
+    else:
+      literals.append(data[i])
+      if (i + LZ_MIN_MATCH <= length):
+        addPosition(i)
+      i += 1
+  flushLiterals()
+  return output
+
+# ==============================================================================
+# Function to build a windowed write frame
+# [seq (2), address (4), data (1-256), crc32 (4)] all MSByte first
+# ==============================================================================
+def buildWindowedFrame(sequenceNumber, address, data):
+  payload = bytearray([(sequenceNumber >> 8) & 0xFF, sequenceNumber & 0xFF])
+  payload.extend(bytearray(convertIntToHexString(address)))
+  payload.extend(data)
+  payload.extend(bytearray(convertIntToHexString(binascii.crc32(str(payload)) & 0xFFFFFFFF)))
+  msg = bytearray([0xAA, 0xBB, 0xCC, 0x31, (len(payload) >> 8) & 0xFF, len(payload) & 0xFF])
+  msg.extend(payload)
+  return extendMessageWithChecksum(msg)
+
+# ==============================================================================
+# Function to read one windowed write response
+# Returns (ack, next sequence number) or None if nothing valid was received
+# ==============================================================================
+def readWindowResponse(serialPort):
+  response = serialPort.read(1)
+  if (not response or ord(response) not in (0xDA, 0xEA)):
+    return None
+  sequence = serialPort.read(2)
+  if (len(sequence) != 2):
+    return None
+  return (ord(response) == 0xDA, (ord(sequence[0]) << 8) | ord(sequence[1]))
+
+# ==============================================================================
+# Function to send frames with a sliding window
+# frames is a list of (address, data). Up to windowSize frames are sent
+# before waiting for an ACK. The ACKs are cumulative so a lost ACK is covered
+# by the next one, a NACK or a timeout goes back to the first unacked frame.
+# ==============================================================================
+def sendFramesWindowed(serialPort, frames, windowSize, pbar):
+  base = 0
+  nextToSend = 0
+  rewoundTo = -1
+  retries = 0
+  lastProgress = time.time()
+  oldTimeout = serialPort.timeout
+  serialPort.timeout = 0.05
+
+  while (base < len(frames)):
+    while (nextToSend < len(frames) and nextToSend < base + windowSize):
+      address, data = frames[nextToSend]
+      serialPort.write(buildWindowedFrame(nextToSend & 0xFFFF, address, data))
+      nextToSend += 1
+
+    response = readWindowResponse(serialPort)
+    if (response == None):
+      if (time.time() - lastProgress > WINDOW_TIMEOUT):
+        retries += 1
+        if (retries > WINDOW_MAX_RETRIES):
+          print Fore.RED + "\nERROR: ****** No ACK for frame " + str(base) + " ******" + Fore.RESET
+          sys.exit(1)
+        if (verboseMode == 1):
+          print Fore.YELLOW + "INFO: Timeout, resending from frame " + str(base) + Fore.RESET
+        nextToSend = base
+        lastProgress = time.time()
+      continue
+
+    ack, sequence = response
+    # The 16 bit sequence number is within the window from base
+    nextExpected = base + ((sequence - base) & 0xFFFF)
+    if (nextExpected > nextToSend):
+      continue
+    if (nextExpected > base):
+      base = nextExpected
+      retries = 0
+      lastProgress = time.time()
+      if (verboseMode == 0):
+        pbar.update(min(base * 256, pbar.maxval))
+    if (not ack and rewoundTo != base):
+      # Frames already in flight are NACKed too, only go back once for them
+      if (verboseMode == 1):
+        print Fore.YELLOW + "INFO: NACK, resending from frame " + str(base) + Fore.RESET
+      nextToSend = base
+      rewoundTo = base
+
+  serialPort.timeout = oldTimeout
+
+# ==============================================================================
+# Function to start a windowed upload, returns the window size to use
+# ==============================================================================
+def startWindowedWrite(serialPort, windowSize):
+  msg = extendMessageWithChecksum(bytearray([0xAA, 0xBB, 0xCC, 0x32]))
+  serialPort.write(msg)
+  response = serialPort.read(2)
+  if (len(response) != 2 or ord(response[1]) != 0xDD):
+    print Fore.RED + "ERROR: Windowed upload not supported by the firmware, use -w 0" + Fore.RESET
+    sys.exit(1)
+  if (ord(response[0]) < windowSize):
+    windowSize = ord(response[0])
+  if (verboseMode == 1):
+    print "INFO: Window size is " + str(windowSize) + " frames"
+  return windowSize
+
+# ==============================================================================
+# Function to read the bitfile data to store, compressed if asked for
+# Returns the data and the compressed size, 0 if it's not compressed
+# ==============================================================================
+def loadBitfileData(binaryFile, compress):
+  with open(binaryFile, "rb") as f:
+    data = bytearray(f.read())
+  compressedSize = 0
+  if (compress == 1):
+    data = compressBitfile(data)
+    compressedSize = len(data)
+    if (compressedSize > 393216 - 256):
+      print Fore.RED + "ERROR: The compressed bitfile does not fit in the slot" + Fore.RESET
+      sys.exit(1)
+    print Fore.CYAN + "INFO: Compressed " + str(os.path.getsize(binaryFile)) + " bytes to " \
+          + str(compressedSize) + " bytes" + Fore.RESET
+  return (data, compressedSize)
+
+# ==============================================================================
+# Function to send frames with a progress bar, returns the number of bytes
+# ==============================================================================
+def sendFramesWithProgress(frames, windowSize):
+  byteCount = sum(len(data) for address, data in frames)
+  pbar = ProgressBar(widgets=[Percentage(), Bar()], maxval=byteCount).start()
+  if (verboseMode == 0):
+    print Fore.CYAN + "INFO: Sending data:"
+  sendFramesWindowed(activeSerialPort, frames, windowSize, pbar)
+  if (verboseMode == 0):
+    pbar.finish()
+  return byteCount
+
+# ==============================================================================
+# Function to store the bitfile with the windowed upload
+# The header is written last so an interrupted upload leaves the slot erased
+# ==============================================================================
+def storeBitfileWindowed(startAddress, binaryFile, windowSize, compress):
+  global activeSerialPort
+  windowSize = startWindowedWrite(activeSerialPort, windowSize)
+  data, compressedSize = loadBitfileData(binaryFile, compress)
+
+  frames = []
+  address = startAddress + 256
+  for offset in range(0, len(data), 256):
+    frames.append((address + offset, data[offset:offset+256]))
+  frames.append((startAddress, buildBitfileHeader(binaryFile, compressedSize)))
+
+  return sendFramesWithProgress(frames, windowSize)
+
+# ==============================================================================
+# Function to read the CRC32 of sectors in the flash
+# ==============================================================================
+def readSectorCrcs(serialPort, startAddress, numOfSectors):
+  crcs = []
+  while (len(crcs) < numOfSectors):
+    count = min(numOfSectors - len(crcs), SECTOR_CRC_MAX_SECTORS)
+    msg = bytearray([0xAA, 0xBB, 0xCC, 0x41, 0x00, 0x05])
+    msg.extend(bytearray(convertIntToHexString(startAddress + len(crcs) * SECTOR_SIZE)))
+    msg.append(count)
+    serialPort.write(extendMessageWithChecksum(msg))
+    response = serialPort.read(count * 4 + 1)
+    if (len(response) != count * 4 + 1 or ord(response[-1]) != 0xDD):
+      print Fore.RED + "ERROR: Could not read the sector CRCs, is the firmware up to date?" + Fore.RESET
+      sys.exit(1)
+    for i in range(count):
+      crcs.append(int(response[i*4:i*4+4].encode('hex'), 16))
+  return crcs
+
+# ==============================================================================
+# Function to erase a sector
+# ==============================================================================
+def eraseSector(serialPort, sectorAddress):
+  msg = bytearray([0xAA, 0xBB, 0xCC, 0x21, 0x00, 0x04])
+  msg.extend(bytearray(convertIntToHexString(sectorAddress)))
+  serialPort.write(extendMessageWithChecksum(msg))
+  waitForAck(serialPort)
+
+# ==============================================================================
+# Function to update a stored bitfile, only the sectors that differ from the
+# new bitfile are erased and written. The first sector is erased before
+# anything else and its header is written last, so the slot is never left with
+# a valid header and a mix of old and new data.
 # ==============================================================================
-def storeBitfile(serialPort, bitFileNumber, binaryFile):
+def updateBitfile(serialPort, bitFileNumber, binaryFile, windowSize, compress):
+  print Fore.CYAN + "INFO: Update bitfile function" + Fore.RESET
+
+  # Make sure the bit file number is valid
+  if (bitFileNumber == 0 or bitFileNumber > 5):
+    print Fore.RED + "ERROR: Bit file number can only be 1 to 5" + Fore.RESET
+    sys.exit(1)
+  startAddress = bitFileNumber * 393216
+
+  data, compressedSize = loadBitfileData(binaryFile, compress)
+  # The slot as it should look after the update, erased bytes are 0xFF
+  image = bytearray([0xFF] * 256) + data
+  numOfSectors = (len(image) + SECTOR_SIZE - 1) / SECTOR_SIZE
+  image.extend(bytearray([0xFF] * (numOfSectors * SECTOR_SIZE - len(image))))
+
+  # Try to open the serial port
+  openSerialPort(serialPort)
+  global activeSerialPort
+  raw_input(Fore.YELLOW + "ACTION: Press Enter to start sending data..." + Fore.RESET)
+
+  startTime = time.time()
+  crcs = readSectorCrcs(activeSerialPort, startAddress, numOfSectors)
+  # The header is always rewritten so the first sector is always changed
+  changedSectors = [0]
+  for sector in range(1, numOfSectors):
+    sectorData = image[sector*SECTOR_SIZE:(sector+1)*SECTOR_SIZE]
+    if ((binascii.crc32(str(sectorData)) & 0xFFFFFFFF) != crcs[sector]):
+      changedSectors.append(sector)
+  print Fore.CYAN + "INFO: " + str(len(changedSectors)) + " of " + str(numOfSectors) \
+        + " sectors have changed" + Fore.RESET
+
+  # ----------------------------------------------------------------------------
+  # Erase the changed sectors, the header first
+  if (verboseMode == 1):
+    print "INFO: Erasing " + str(len(changedSectors)) + " sectors"
+  for sector in changedSectors:
+    eraseSector(activeSerialPort, startAddress + sector * SECTOR_SIZE)
+
+  # ----------------------------------------------------------------------------
+  # Write the changed sectors, then the rest of the first sector and the header
+  windowSize = startWindowedWrite(activeSerialPort, windowSize)
+  frames = []
+  for sector in changedSectors[1:] + [0]:
+    for offset in range(sector * SECTOR_SIZE, (sector + 1) * SECTOR_SIZE, 256):
+      if (offset == 0 or offset >= len(data) + 256):
+        continue
+      frames.append((startAddress + offset, image[offset:offset+256]))
+  frames.append((startAddress, buildBitfileHeader(binaryFile, compressedSize)))
+
+  byteCount = sendFramesWithProgress(frames, windowSize)
+  printUploadTime(startTime, byteCount)
+
+# ==============================================================================
+def storeBitfile(serialPort, bitFileNumber, binaryFile, windowSize, compress):
   print Fore.CYAN + "INFO: Store bitfile function" + Fore.RESET
 
   # Make sure the bit file number is valid
@@ -312,6 +813,12 @@ def storeBitfile(serialPort, bitFileNumber, binaryFile):
   # Wait for ack
   waitForAck(activeSerialPort)
 
+  startTime = time.time()
+  if (windowSize > 0):
+    byteCount = storeBitfileWindowed(startAddress, binaryFile, windowSize, compress)
+    printUploadTime(startTime, byteCount)
+    return
+
   # ----------------------------------------------------------------------------
   # Set the flash write address to the start address
   if (verboseMode == 1):
@@ -483,6 +990,115 @@ def storeBitfile(serialPort, bitFileNumber, binaryFile):
     if (verboseMode == 0):
       pbar.finish()
     print "INFO: Done sending " + str(byteCount) + " bytes of data" + Fore.RESET
+  printUploadTime(startTime, byteCount)
+
+# ==============================================================================
+# Function to print the time an upload took, the erase is not included
+# ==============================================================================
+def printUploadTime(startTime, byteCount, name="Upload"):
+  elapsed = time.time() - startTime
+  print Fore.CYAN + "INFO: " + name + " took " + ("%.1f" % elapsed) + " s, " \
+        + str(int(byteCount / elapsed)) + " bytes/s" + Fore.RESET
+
+# ==============================================================================
+# Function to read one chunk of a streamed read
+# [0xDB, address (4), count (2), data, crc32 (4)] all MSByte first
+# Returns (address, data) or None if nothing valid was received
+# ==============================================================================
+def readStreamChunk(serialPort):
+  header = serialPort.read(STREAM_CHUNK_HEADER_SIZE)
+  if (len(header) != STREAM_CHUNK_HEADER_SIZE or ord(header[0]) != STREAM_CHUNK_START):
+    return None
+  count = (ord(header[5]) << 8) | ord(header[6])
+  rest = serialPort.read(count + 4)
+  if (len(rest) != count + 4):
+    return None
+  crc = int(rest[count:].encode('hex'), 16)
+  if (crc != binascii.crc32(header + rest[:count]) & 0xFFFFFFFF):
+    return None
+  return (int(header[1:5].encode('hex'), 16), bytearray(rest[:count]))
+
+# ==============================================================================
+# Function to stop a streamed read and throw away what is still on the way
+# ==============================================================================
+def stopStreamRead(serialPort):
+  # Any command stops the stream
+  serialPort.write(extendMessageWithChecksum(bytearray([0xAA, 0xBB, 0xCC, 0x11])))
+  oldTimeout = serialPort.timeout
+  serialPort.timeout = 0.1
+  while (serialPort.read(4096)):
+    pass
+  serialPort.timeout = oldTimeout
+
+# ==============================================================================
+# Function to read from the flash with the streamed read command
+# The board sends the chunks without waiting for the host, a bad chunk stops
+# the stream and it's started again from that chunk
+# ==============================================================================
+def streamRead(serialPort, address, length, pbar):
+  data = bytearray()
+  retries = 0
+  while (len(data) < length):
+    msg = bytearray([0xAA, 0xBB, 0xCC, 0x43, 0x00, 0x08])
+    msg.extend(bytearray(convertIntToHexString(address + len(data))))
+    msg.extend(bytearray(convertIntToHexString(length - len(data))))
+    serialPort.write(extendMessageWithChecksum(msg))
+    response = serialPort.read(1)
+    if (response and ord(response) == 0xEE):
+      print Fore.RED + "\nERROR: The board refused to read from " + hex(address + len(data)) + Fore.RESET
+      sys.exit(1)
+
+    if (response and ord(response) == 0xDD):
+      while (len(data) < length):
+        chunk = readStreamChunk(serialPort)
+        if (chunk == None or chunk[0] != address + len(data)):
+          break
+        data.extend(chunk[1])
+        retries = 0
+        if (verboseMode == 0):
+          pbar.update(len(data))
+
+    if (len(data) < length):
+      retries += 1
+      if (retries > STREAM_MAX_RETRIES):
+        print Fore.RED + "\nERROR: ****** Could not read from " + hex(address + len(data)) + " ******" + Fore.RESET
+        sys.exit(1)
+      if (verboseMode == 1):
+        print Fore.YELLOW + "INFO: Bad chunk, reading again from " + hex(address + len(data)) + Fore.RESET
+      stopStreamRead(serialPort)
+  return data
+
+# ==============================================================================
+# Function to save the flash to a file
+# ==============================================================================
+def dumpFlash(serialPort, bitFileNumber, outputFile):
+  print Fore.CYAN + "INFO: Dump function" + Fore.RESET
+
+  if (bitFileNumber == ''):
+    address = 0
+    length = FLASH_SIZE
+  elif (bitFileNumber == 0 or bitFileNumber > 5):
+    print Fore.RED + "ERROR: Bit file number can only be 1 to 5" + Fore.RESET
+    sys.exit(1)
+  else:
+    address = bitFileNumber * 393216
+    length = 393216
+
+  # Try to open the serial port
+  openSerialPort(serialPort)
+  global activeSerialPort
+
+  startTime = time.time()
+  pbar = ProgressBar(widgets=[Percentage(), Bar()], maxval=length).start()
+  if (verboseMode == 0):
+    print Fore.CYAN + "INFO: Reading " + str(length) + " bytes from " + hex(address) + ":" + Fore.RESET
+  data = streamRead(activeSerialPort, address, length, pbar)
+  if (verboseMode == 0):
+    pbar.finish()
+
+  with open(outputFile, "wb") as f:
+    f.write(data)
+  printUploadTime(startTime, length, "Dump")
 
 # ==============================================================================
 # Function to deleta the bitfile
@@ -537,6 +1153,83 @@ def startConfig(serialPort, bitFileNumber):
   # Wait for ack
   waitForAck(activeSerialPort)
   print Fore.CYAN + "INFO: Done configuring bit file" + Fore.RESET
+  readConfigTiming(activeSerialPort)
+
+# ==============================================================================
+# Function to check the name of a bitfile on the SD card, 8.3 in the root
+# directory
+# ==============================================================================
+def checkSdCardFileName(sdCardFile):
+  if (len(sdCardFile) == 0 or len(sdCardFile) > SD_CARD_MAX_FILE_NAME_LENGTH or "/" in sdCardFile):
+    print Fore.RED + "ERROR: The SD card file must be an 8.3 name in the root directory, e.g. FPGA.RBF" + Fore.RESET
+    sys.exit(1)
+
+# ==============================================================================
+# Function to start the config with a bitfile on the SD card
+# ==============================================================================
+def startConfigFromSdCard(serialPort, sdCardFile):
+  print Fore.CYAN + "INFO: Start configuration from SD card function" + Fore.RESET
+  checkSdCardFileName(sdCardFile)
+
+  # Try to open the serial port
+  openSerialPort(serialPort)
+  global activeSerialPort
+  raw_input(Fore.YELLOW + "Press Enter to start FPGA config..." + Fore.RESET)
+
+  print Fore.CYAN + "INFO: Sending start config of " + sdCardFile + " on the SD card..." + Fore.RESET
+  msg = bytearray([0xAA, 0xBB, 0xCC, 0x52, 0x00, len(sdCardFile)])
+  msg.extend(bytearray(sdCardFile))
+  msg = extendMessageWithChecksum(msg)
+  activeSerialPort.write(msg)
+  # Wait for ack, NACK if there is no card or file
+  waitForAck(activeSerialPort)
+  print Fore.CYAN + "INFO: Done configuring bit file" + Fore.RESET
+  readConfigTiming(activeSerialPort)
+
+# ==============================================================================
+# Function to copy a bitfile on the SD card to a bitfile in the flash
+# ==============================================================================
+def copyFromSdCard(serialPort, bitFileNumber, sdCardFile):
+  print Fore.CYAN + "INFO: Copy from SD card function" + Fore.RESET
+  checkSdCardFileName(sdCardFile)
+
+  # Make sure the bit file number is valid
+  if (bitFileNumber == 0 or bitFileNumber > NUM_OF_BIT_FILES):
+    print Fore.RED + "ERROR: Bit file number can only be 1 to 5" + Fore.RESET
+    sys.exit(1)
+
+  # Try to open the serial port
+  openSerialPort(serialPort)
+  global activeSerialPort
+  raw_input(Fore.YELLOW + "ACTION: Press Enter to copy " + sdCardFile + " to bitfile number " + str(bitFileNumber) + "..." + Fore.RESET)
+
+  startTime = time.time()
+  msg = bytearray([0xAA, 0xBB, 0xCC, 0x33, 0x00, len(sdCardFile) + 1, bitFileNumber])
+  msg.extend(bytearray(sdCardFile))
+  msg = extendMessageWithChecksum(msg)
+  activeSerialPort.write(msg)
+  # The slot is erased and written by the board, wait for ack
+  waitForAck(activeSerialPort)
+  print Fore.CYAN + "INFO: Done copying in " + "%.1f" % (time.time() - startTime) + " s" + Fore.RESET
+
+# ==============================================================================
+# Function to read the timing of the last FPGA config
+# ==============================================================================
+def readConfigTiming(serialPort):
+  msg = extendMessageWithChecksum(bytearray([0xAA, 0xBB, 0xCC, 0x51]))
+  serialPort.write(msg)
+  response = serialPort.read(9)
+  if (len(response) != 9 or ord(response[8]) != 0xDD):
+    print Fore.RED + "ERROR: Could not read the config timing" + Fore.RESET
+    sys.exit(1)
+
+  confDoneTick = int(binascii.hexlify(response[0:4]), 16)
+  transferTime = int(binascii.hexlify(response[4:8]), 16)
+  if (confDoneTick == 0):
+    print Fore.YELLOW + "WARNING: CONF_DONE did not go high during the last config" + Fore.RESET
+  else:
+    print Fore.CYAN + "INFO: CONF_DONE at " + str(confDoneTick) + " ms after reset" + Fore.RESET
+  print Fore.CYAN + "INFO: Bitfile transfer took " + str(transferTime) + " ms" + Fore.RESET
 
 # ==============================================================================
 # Function to read the bit file headers in the flash
@@ -551,46 +1244,37 @@ def readHeaders(serialPort):
   print Fore.CYAN + "-------------------- Format --------------------"
   print "Date and time: YY/MM/DD - HH:MM:SS"
 
-  # Read all bitfile headers
-  for currentBitFileNum in range(1, 6): 
-    # Construct the message
-    readHeaderCommand = bytearray([0xAA, 0xBB, 0xCC, 0x40, 0x00, 0x05, 0x00, currentBitFileNum*6, 0x00, 0x00, 90])
-    readHeaderCommand = extendMessageWithChecksum(readHeaderCommand)
-    activeSerialPort.write(readHeaderCommand)
-    
-    # Wait for the data to arrive, (4+64+6+16=90) data + 1 checksum
-    while (activeSerialPort.inWaiting() < 91):
-      time.sleep(0.1)
+  # Read all bitfile headers and their status in one go, the board checks
+  # every bitfile against its MD5 first so it can take a second
+  msg = extendMessageWithChecksum(bytearray([0xAA, 0xBB, 0xCC, 0x42]))
+  activeSerialPort.write(msg)
+  entrySize = HEADER_SIZE + 1
+  response = activeSerialPort.read(NUM_OF_BIT_FILES * entrySize + 1)
+  if (len(response) != NUM_OF_BIT_FILES * entrySize + 1 or ord(response[-1]) != 0xDD):
+    print Fore.RED + "ERROR: Could not read the bitfile headers, is the firmware up to date?" + Fore.RESET
+    sys.exit(1)
+
+  for currentBitFileNum in range(1, NUM_OF_BIT_FILES + 1):
+    entry = response[(currentBitFileNum - 1) * entrySize:currentBitFileNum * entrySize]
 
     # Bitfile size
-    size1 = activeSerialPort.read(1);
-    size2 = activeSerialPort.read(1);
-    size3 = activeSerialPort.read(1);
-    size4 = activeSerialPort.read(1);
-    sizeOfBitFile1 = size1 + size2 + size3 + size4;
-    sizeOfBitFile1 = int(sizeOfBitFile1.encode('hex'), 16)
+    sizeOfBitFile1 = int(entry[0:4].encode('hex'), 16)
 
     # Bitfilename
-    fileName = ''
-    for n in range(0, 64):
-      fileName = fileName + activeSerialPort.read(1);
+    fileName = entry[4:68]
 
     # Date and time
-    year    = int(activeSerialPort.read(1).encode('hex'), 16)
-    month   = int(activeSerialPort.read(1).encode('hex'), 16)
-    day     = int(activeSerialPort.read(1).encode('hex'), 16)
-    hour    = int(activeSerialPort.read(1).encode('hex'), 16)
-    minute  = int(activeSerialPort.read(1).encode('hex'), 16)
-    second  = int(activeSerialPort.read(1).encode('hex'), 16)
+    year, month, day, hour, minute, second = [ord(c) for c in entry[68:74]]
 
     # Checksum for the bitfile
-    fileChecksum = ''
-    for n in range(0, 16):
-      fileChecksum = fileChecksum + activeSerialPort.read(1);
-    fileChecksum = fileChecksum.encode("hex")
+    fileChecksum = entry[74:90].encode("hex")
+
+    # Format and compressed size
+    fileFormat = ord(entry[90])
+    compressedSize = int(entry[91:95].encode('hex'), 16)
 
-    # Checksum for the message
-    checksum = activeSerialPort.read(1);
+    # Result of the check on the board
+    status = ord(entry[95])
 
     # Printout
     print Fore.CYAN + "--------------- Bitfile number " + str(currentBitFileNum) + " ---------------"
@@ -599,11 +1283,17 @@ def readHeaders(serialPort):
     else:
       print Fore.CYAN + "Filename:      " + Fore.GREEN + fileName + Fore.RESET
       print Fore.CYAN + "Size:          " + Fore.GREEN + str(sizeOfBitFile1) + " bytes" + Fore.RESET
+      if (fileFormat == HEADER_FORMAT_LZ):
+        print Fore.CYAN + "Compressed:    " + Fore.GREEN + str(compressedSize) + " bytes" + Fore.RESET
       print Fore.CYAN + "Date and time: " + Fore.GREEN + str(year).zfill(2) + "/"  \
             + str(month).zfill(2) + "/" + str(day).zfill(2) + " - "         \
             + str(hour).zfill(2) + ":" + str(minute).zfill(2) + ":"         \
             + str(second).zfill(2) + Fore.RESET
       print Fore.CYAN + "MD5 Checksum:  " + Fore.GREEN + fileChecksum + Fore.RESET
+      if (status == BIT_FILE_STATUS_VALID):
+        print Fore.CYAN + "Status:        " + Fore.GREEN + "VALID" + Fore.RESET
+      elif (status == BIT_FILE_STATUS_CORRUPT):
+        print Fore.CYAN + "Status:        " + Fore.RED + "CORRUPT" + Fore.RESET
 
   # End with a line
   print Fore.CYAN + "------------------------------------------------" + Fore.RESET
@@ -0,0 +1,554 @@
+# ******************************************************************************
+# * @file    ui-asset-upload.py
+# * @author  Hampus Sandberg
+# * @version 0.1
+# * @date    2016-10-19
+# * @brief   Stores fonts, images, splash screens and CLUTs by name in the SPI
+# *          FLASH of the UI processor
+# ******************************************************************************
+#  Copyright (c) 2016 Hampus Sandberg.
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# ******************************************************************************
+
+import serial
+from serial import SerialException
+import sys
+import os
+import glob
+import time
+import getopt
+import binascii
+from progressbar import ProgressBar, Bar, Percentage
+
+# Colorama used for colored terminal text
+# Fore: BLACK, RED, GREEN, YELLOW, BLUE, MAGENTA, CYAN, WHITE, RESET.
+# Back: BLACK, RED, GREEN, YELLOW, BLUE, MAGENTA, CYAN, WHITE, RESET.
+# Style: DIM, NORMAL, BRIGHT, RESET_ALL
+from colorama import init
+from colorama import Fore, Back, Style
+init()
+
+verboseMode = 0
+activeSerialPort = 0
+
+# The board starts at the default baud rate and can be switched to a higher one
+DEFAULT_BAUD_RATE = 115200
+baudRate = DEFAULT_BAUD_RATE
+
+# Frames in flight, the board answers with the most it can take
+DEFAULT_WINDOW_SIZE = 3
+# Seconds without progress before the unacked frames are sent again
+WINDOW_TIMEOUT = 1.0
+WINDOW_MAX_RETRIES = 10
+
+# Must match uart_comm.c and asset_table.h in the UI processor
+FRAME_DATA_SIZE = 1024
+NAME_LENGTH = 16
+ASSET_RECORD_SIZE = NAME_LENGTH + 1 + 4 + 4 + 4
+ASSET_TYPES = ["raw", "font", "image", "splash", "clut"]
+# Verifying a large asset reads all of it back from the flash
+FINISH_TIMEOUT = 30
+
+def main(argv):
+  serialPort = ''
+  assetName = ''
+  assetFile = ''
+  assetType = 'raw'
+  windowSize = DEFAULT_WINDOW_SIZE
+
+  shouldStoreAsset = 0
+  shouldListAssets = 0
+  shouldDeleteAsset = 0
+
+  try:
+    opts, args = getopt.getopt(argv, "hlp:a:f:t:w:r:", ["help", "store", "list", "delete", "verbose"])
+  except getopt.GetoptError as err:
+    print Fore.RED + "ERROR: " + str(err) + Fore.RESET
+    showUsage(sys.argv[0])
+    sys.exit(1)
+
+  # Loop through all arguments
+  for opt, arg in opts:
+    # --------------------------------------------------------------------------
+    # Help
+    if opt in ("-h", "--help"):
+      showUsage(sys.argv[0])
+      sys.exit(0)
+    # --------------------------------------------------------------------------
+    # List serial ports
+    elif opt in "-l":
+      print Fore.CYAN + "INFO: Here are the available serial ports:" + Fore.GREEN
+      print(serial_ports())
+      print Fore.RESET
+      sys.exit(1)
+    # --------------------------------------------------------------------------
+    # Set the serial port to use
+    elif opt in "-p":
+      serialPort = arg
+    # --------------------------------------------------------------------------
+    # Name of the asset
+    elif opt in "-a":
+      assetName = arg
+    # --------------------------------------------------------------------------
+    # Path to the file to store
+    elif opt in "-f":
+      assetFile = arg
+    # --------------------------------------------------------------------------
+    # Type of the asset
+    elif opt in "-t":
+      assetType = arg
+    # --------------------------------------------------------------------------
+    # Window size for the upload
+    elif opt in "-w":
+      windowSize = int(arg)
+    # --------------------------------------------------------------------------
+    # Baud rate to switch to
+    elif opt in "-r":
+      global baudRate
+      baudRate = int(arg)
+    # --------------------------------------------------------------------------
+    # Store the file as an asset
+    elif opt in "--store":
+      shouldStoreAsset = 1
+    # --------------------------------------------------------------------------
+    # List the assets
+    elif opt in "--list":
+      shouldListAssets = 1
+    # --------------------------------------------------------------------------
+    # Delete an asset
+    elif opt in "--delete":
+      shouldDeleteAsset = 1
+    # --------------------------------------------------------------------------
+    # Verbose mode
+    elif opt in "--verbose":
+      global verboseMode
+      verboseMode = 1
+    # --------------------------------------------------------------------------
+
+
+  # ****************************************************************************
+  # Check if a serial port was defined
+  if (serialPort == ''):
+    print Fore.RED + "ERROR: No serial port defined, (use -p)" + Fore.RESET
+    sys.exit(1)
+
+  # ----------------------------------------------------------------------------
+  # List the assets
+  if (shouldListAssets == 1):
+    openSerialPort(serialPort)
+    listAssets(activeSerialPort)
+    sys.exit(0)
+
+  # ****************************************************************************
+  # Check if an asset name was defined
+  if (assetName == ''):
+    print Fore.RED + "ERROR: No asset name defined, (use -a)" + Fore.RESET
+    sys.exit(1)
+  if (len(assetName) >= NAME_LENGTH):
+    print Fore.RED + "ERROR: The asset name can be at most " + str(NAME_LENGTH - 1) + " characters" + Fore.RESET
+    sys.exit(1)
+
+  # ----------------------------------------------------------------------------
+  # Store the asset
+  if (shouldStoreAsset == 1 and assetFile != ''):
+    if (assetType not in ASSET_TYPES):
+      print Fore.RED + "ERROR: The type must be one of " + ", ".join(ASSET_TYPES) + Fore.RESET
+      sys.exit(1)
+    if (windowSize < 1):
+      print Fore.RED + "ERROR: The window size must be at least 1" + Fore.RESET
+      sys.exit(1)
+    storeAsset(serialPort, assetName, assetFile, ASSET_TYPES.index(assetType), windowSize)
+    sys.exit(0)
+  elif (shouldStoreAsset == 1):
+    print Fore.RED + "ERROR: No file path defined, (use -f)" + Fore.RESET
+    sys.exit(1)
+
+  # ----------------------------------------------------------------------------
+  # Delete the asset
+  if (shouldDeleteAsset == 1):
+    deleteAsset(serialPort, assetName)
+    sys.exit(0)
+
+  # ****************************************************************************
+  print Fore.RED + "ERROR: Something went wrong, check the arguments" + Fore.RESET
+  showUsage(sys.argv[0])
+  sys.exit(1)
+  # ****************************************************************************
+
+
+# ==============================================================================
+# Function to show how to use the software
+# ==============================================================================
+def showUsage(name):
+  print Fore.CYAN + "usage:"
+  print "  python " + name + " [-h, --help] [-l] [-p] [-a] [-f] [-t] [-w] [-r] [--store] [--list] [--delete] [--verbose]"
+  print "options:"
+  print "  -h, --help : Display this help"
+  print "  -l         : List the available serial ports"
+  print "  -p arg     : Specifiy the serial port to use"
+  print "  -a arg     : Name of the asset, at most " + str(NAME_LENGTH - 1) + " characters"
+  print "  -f arg     : Path to the file to store"
+  print "  -t arg     : Type of the asset, " + ", ".join(ASSET_TYPES) + ", default raw"
+  print "  -r arg     : Baud rate to switch the board to, default " + str(DEFAULT_BAUD_RATE) + ", e.g. 921600"
+  print "  -w arg     : Frames in flight when storing, default " + str(DEFAULT_WINDOW_SIZE)
+  print "  --store    : Store the file as the named asset, an old asset with the name is replaced"
+  print "  --list     : List the stored assets"
+  print "  --delete   : Delete the named asset"
+  print "  --verbose  : Verbose mode, i.e. display all information"
+  print ""
+  print "examples:"
+  print "  List all available serial ports:"
+  print "    python " + name + " -l"
+  print "  List the stored assets:"
+  print "    python " + name + " -p /dev/ttyS0 --list"
+  print "  Store the splash screen shown at power-on, 800x480 RGB565:"
+  print "    python " + name + " -p /dev/ttyS0 --store -a splash -t splash -f /path/to/splash.bin -r 921600"
+  print "  Store a font:"
+  print "    python " + name + " -p /dev/ttyS0 --store -a mono12 -t font -f /path/to/mono12.bin"
+  print "  Delete the font:"
+  print "    python " + name + " -p /dev/ttyS0 --delete -a mono12"
+  print Fore.RESET
+
+# ==============================================================================
+# Function to get the available serial ports
+# ==============================================================================
+def serial_ports():
+  if sys.platform.startswith('win'):
+    ports = ['COM%s' % (i + 1) for i in range(256)]
+  elif sys.platform.startswith('linux') or sys.platform.startswith('cygwin'):
+    # this excludes your current terminal "/dev/tty"
+    ports = glob.glob('/dev/tty[A-Za-z]*')
+  elif sys.platform.startswith('darwin'):
+    ports = glob.glob('/dev/tty.*')
+  else:
+    raise EnvironmentError('Unsupported platform')
+
+  result = []
+  for port in ports:
+    try:
+      s = serial.Serial(port)
+      s.close()
+      result.append(port)
+    except (OSError, serial.SerialException):
+      pass
+  return result
+
+# ==============================================================================
+# Function to open a serial port
+# ==============================================================================
+def openSerialPort(serialPort):
+  # Try to open the serial port
+  global activeSerialPort
+  try:
+    activeSerialPort = serial.Serial(serialPort, DEFAULT_BAUD_RATE, timeout=10)
+  except:
+    print Fore.RED + "ERROR: Invalid serial port. Is it connected?" + Fore.RESET
+    sys.exit(1)
+
+  if (not activeSerialPort.isOpen()):
+    print Fore.RED + "ERROR: Serial port not open" + Fore.RESET
+    sys.exit(1)
+  else:
+    print Fore.CYAN + "INFO: Serial port is open" + Fore.RESET
+
+  if (baudRate != DEFAULT_BAUD_RATE):
+    switchBaudRate(baudRate)
+
+# ==============================================================================
+# Function to check if the board answers at the current baud rate
+# ==============================================================================
+def pingDevice(serialPort):
+  serialPort.flushInput()
+  msg = extendMessageWithChecksum(bytearray([0xAA, 0xBB, 0xCC, 0x11]))
+  serialPort.write(msg)
+  oldTimeout = serialPort.timeout
+  serialPort.timeout = 0.5
+  response = serialPort.read(5)
+  serialPort.timeout = oldTimeout
+  return (len(response) == 5 and ord(response[4]) == 0xDD)
+
+# ==============================================================================
+# Function to switch the board and the serial port to a new baud rate
+# The board keeps the baud rate until it's reset so it's tried first
+# ==============================================================================
+def switchBaudRate(newBaudRate):
+  global activeSerialPort
+  activeSerialPort.baudrate = newBaudRate
+  if (pingDevice(activeSerialPort)):
+    return
+
+  # Let the board drop the garbage it got at the wrong baud rate
+  time.sleep(0.2)
+  activeSerialPort.baudrate = DEFAULT_BAUD_RATE
+  msg = bytearray([0xAA, 0xBB, 0xCC, 0x12, 0x00, 0x04])
+  msg.extend(bytearray(convertIntToHexString(newBaudRate)))
+  msg = extendMessageWithChecksum(msg)
+  activeSerialPort.flushInput()
+  activeSerialPort.write(msg)
+  waitForAck(activeSerialPort)
+
+  activeSerialPort.baudrate = newBaudRate
+  if (not pingDevice(activeSerialPort)):
+    print Fore.RED + "ERROR: No answer at " + str(newBaudRate) + " baud" + Fore.RESET
+    sys.exit(1)
+  if (verboseMode == 1):
+    print "INFO: Switched to " + str(newBaudRate) + " baud"
+
+# ==============================================================================
+# Function to convert integer to hex string
+# ==============================================================================
+def convertIntToHexString(int_value):
+  encoded = format(int_value, 'x')
+  encoded = encoded.zfill(8)
+  return encoded.decode('hex')
+
+# ==============================================================================
+# Function to extend a message with the checksum
+# ==============================================================================
+def extendMessageWithChecksum(message):
+  checksum = 0
+  for n in message:
+    checksum = checksum ^ n
+  message.extend(chr(checksum))
+  return message
+
+# ==============================================================================
+# Function to wait for ack
+# ==============================================================================
+def waitForAck(serialPort):
+  response = serialPort.read(1)
+  if (response and ord(response) == int(0xDD)):
+    if (verboseMode == 1):
+      print Fore.GREEN + "INFO: ACK received!" + Fore.RESET
+  else:
+    print Fore.RED + "\nERROR: ****** ACK not received!!! ******" + Fore.RESET
+    sys.exit(1)
+
+# ==============================================================================
+# Function to build a windowed write frame
+# [seq (2), address (4), data, crc32 (4)] all MSByte first
+# ==============================================================================
+def buildWindowedFrame(sequenceNumber, address, data):
+  payload = bytearray([(sequenceNumber >> 8) & 0xFF, sequenceNumber & 0xFF])
+  payload.extend(bytearray(convertIntToHexString(address)))
+  payload.extend(data)
+  payload.extend(bytearray(convertIntToHexString(binascii.crc32(str(payload)) & 0xFFFFFFFF)))
+  msg = bytearray([0xAA, 0xBB, 0xCC, 0x31, (len(payload) >> 8) & 0xFF, len(payload) & 0xFF])
+  msg.extend(payload)
+  return extendMessageWithChecksum(msg)
+
+# ==============================================================================
+# Function to read one windowed write response
+# Returns (ack, next sequence number) or None if nothing valid was received
+# ==============================================================================
+def readWindowResponse(serialPort):
+  response = serialPort.read(1)
+  if (not response or ord(response) not in (0xDA, 0xEA)):
+    return None
+  sequence = serialPort.read(2)
+  if (len(sequence) != 2):
+    return None
+  return (ord(response) == 0xDA, (ord(sequence[0]) << 8) | ord(sequence[1]))
+
+# ==============================================================================
+# Function to send frames with a sliding window
+# frames is a list of (address, data). Up to windowSize frames are sent
+# before waiting for an ACK. The ACKs are cumulative so a lost ACK is covered
+# by the next one, a NACK or a timeout goes back to the first unacked frame.
+# The board erases a sector when the data first reaches it so the ACKs for
+# the first frame in each sector take longer.
+# ==============================================================================
+def sendFramesWindowed(serialPort, frames, windowSize, pbar):
+  base = 0
+  nextToSend = 0
+  rewoundTo = -1
+  retries = 0
+  lastProgress = time.time()
+  oldTimeout = serialPort.timeout
+  serialPort.timeout = 0.05
+
+  while (base < len(frames)):
+    while (nextToSend < len(frames) and nextToSend < base + windowSize):
+      address, data = frames[nextToSend]
+      serialPort.write(buildWindowedFrame(nextToSend & 0xFFFF, address, data))
+      nextToSend += 1
+
+    response = readWindowResponse(serialPort)
+    if (response == None):
+      if (time.time() - lastProgress > WINDOW_TIMEOUT):
+        retries += 1
+        if (retries > WINDOW_MAX_RETRIES):
+          print Fore.RED + "\nERROR: ****** No ACK for frame " + str(base) + " ******" + Fore.RESET
+          sys.exit(1)
+        if (verboseMode == 1):
+          print Fore.YELLOW + "INFO: Timeout, resending from frame " + str(base) + Fore.RESET
+        nextToSend = base
+        lastProgress = time.time()
+      continue
+
+    ack, sequence = response
+    # The 16 bit sequence number is within the window from base
+    nextExpected = base + ((sequence - base) & 0xFFFF)
+    if (nextExpected > nextToSend):
+      continue
+    if (nextExpected > base):
+      base = nextExpected
+      retries = 0
+      lastProgress = time.time()
+      if (verboseMode == 0):
+        pbar.update(min(base * FRAME_DATA_SIZE, pbar.maxval))
+    if (not ack and rewoundTo != base):
+      # A frame the board can't write at all is NACKed every time
+      retries += 1
+      if (retries > WINDOW_MAX_RETRIES):
+        print Fore.RED + "\nERROR: ****** Frame " + str(base) + " was not accepted ******" + Fore.RESET
+        sys.exit(1)
+      # Frames already in flight are NACKed too, only go back once for them
+      if (verboseMode == 1):
+        print Fore.YELLOW + "INFO: NACK, resending from frame " + str(base) + Fore.RESET
+      nextToSend = base
+      rewoundTo = base
+
+  serialPort.timeout = oldTimeout
+
+# ==============================================================================
+# Function to print how long an upload took
+# ==============================================================================
+def printUploadTime(startTime, byteCount, name="Upload"):
+  elapsed = time.time() - startTime
+  print Fore.CYAN + "INFO: " + name + " took " + ("%.1f" % elapsed) + " s, " \
+        + str(int(byteCount / elapsed)) + " bytes/s" + Fore.RESET
+
+# ==============================================================================
+# Function to start an asset upload
+# Returns the flash address to write to and the window size to use
+# ==============================================================================
+def startAssetUpload(serialPort, assetName, assetType, data, windowSize):
+  msg = bytearray([0xAA, 0xBB, 0xCC, 0x60, 0x00, 9 + len(assetName), assetType])
+  msg.extend(bytearray(convertIntToHexString(len(data))))
+  msg.extend(bytearray(convertIntToHexString(binascii.crc32(str(data)) & 0xFFFFFFFF)))
+  msg.extend(bytearray(assetName))
+  serialPort.write(extendMessageWithChecksum(msg))
+  response = serialPort.read(6)
+  if (len(response) != 6 or ord(response[5]) != 0xDD):
+    print Fore.RED + "ERROR: There is no room for the asset or the asset table is full" + Fore.RESET
+    sys.exit(1)
+  address = int(response[0:4].encode('hex'), 16)
+  if (ord(response[4]) < windowSize):
+    windowSize = ord(response[4])
+  if (verboseMode == 1):
+    print "INFO: Writing to " + hex(address) + ", window size is " + str(windowSize) + " frames"
+  return (address, windowSize)
+
+# ==============================================================================
+# Function to store a file as an asset
+# The board only adds the asset to the table after checking the CRC32 of what
+# is in the flash, an interrupted upload leaves the old asset with the name
+# ==============================================================================
+def storeAsset(serialPort, assetName, assetFile, assetType, windowSize):
+  print Fore.CYAN + "INFO: Store asset function" + Fore.RESET
+
+  with open(assetFile, "rb") as f:
+    data = bytearray(f.read())
+  if (len(data) == 0):
+    print Fore.RED + "ERROR: The file is empty" + Fore.RESET
+    sys.exit(1)
+
+  # Try to open the serial port
+  openSerialPort(serialPort)
+  global activeSerialPort
+
+  startTime = time.time()
+  address, windowSize = startAssetUpload(activeSerialPort, assetName, assetType, data, windowSize)
+
+  frames = []
+  for offset in range(0, len(data), FRAME_DATA_SIZE):
+    frames.append((address + offset, data[offset:offset+FRAME_DATA_SIZE]))
+
+  pbar = ProgressBar(widgets=[Percentage(), Bar()], maxval=len(data)).start()
+  if (verboseMode == 0):
+    print Fore.CYAN + "INFO: Sending data:"
+  sendFramesWindowed(activeSerialPort, frames, windowSize, pbar)
+  if (verboseMode == 0):
+    pbar.finish()
+
+  # ----------------------------------------------------------------------------
+  # Let the board check the data and add it to the asset table
+  if (verboseMode == 1):
+    print "INFO: Checking the asset",
+  activeSerialPort.timeout = FINISH_TIMEOUT
+  activeSerialPort.write(extendMessageWithChecksum(bytearray([0xAA, 0xBB, 0xCC, 0x61])))
+  waitForAck(activeSerialPort)
+  print Fore.CYAN + "INFO: Stored " + assetName + " at " + hex(address) + Fore.RESET
+  printUploadTime(startTime, len(data))
+
+# ==============================================================================
+# Function to list the assets in the asset table
+# ==============================================================================
+def listAssets(serialPort):
+  msg = extendMessageWithChecksum(bytearray([0xAA, 0xBB, 0xCC, 0x62]))
+  serialPort.write(msg)
+  count = serialPort.read(1)
+  if (len(count) != 1):
+    print Fore.RED + "ERROR: Could not read the asset table, is the firmware up to date?" + Fore.RESET
+    sys.exit(1)
+  count = ord(count)
+  response = serialPort.read(count * ASSET_RECORD_SIZE + 1)
+  if (len(response) != count * ASSET_RECORD_SIZE + 1 or ord(response[-1]) != 0xDD):
+    print Fore.RED + "ERROR: Could not read the asset table" + Fore.RESET
+    sys.exit(1)
+
+  print Fore.CYAN + "-------------------- Assets --------------------"
+  for i in range(count):
+    record = response[i * ASSET_RECORD_SIZE:(i + 1) * ASSET_RECORD_SIZE]
+    name = record[0:NAME_LENGTH].split('\0')[0]
+    assetType = ord(record[NAME_LENGTH])
+    address = int(record[NAME_LENGTH+1:NAME_LENGTH+5].encode('hex'), 16)
+    size = int(record[NAME_LENGTH+5:NAME_LENGTH+9].encode('hex'), 16)
+    crc = record[NAME_LENGTH+9:NAME_LENGTH+13].encode('hex')
+    if (assetType < len(ASSET_TYPES)):
+      typeName = ASSET_TYPES[assetType]
+    else:
+      typeName = str(assetType)
+    print Fore.CYAN + name.ljust(NAME_LENGTH) + Fore.GREEN + typeName.ljust(8) \
+          + hex(address).ljust(10) + str(size).rjust(9) + " bytes  crc32 " + crc + Fore.RESET
+  if (count == 0):
+    print Fore.CYAN + "No assets stored" + Fore.RESET
+
+  # End with a line
+  print Fore.CYAN + "------------------------------------------------" + Fore.RESET
+
+# ==============================================================================
+# Function to delete an asset, its flash is reused by the next upload
+# ==============================================================================
+def deleteAsset(serialPort, assetName):
+  print Fore.CYAN + "INFO: Delete asset function" + Fore.RESET
+
+  # Try to open the serial port
+  openSerialPort(serialPort)
+  global activeSerialPort
+
+  msg = bytearray([0xAA, 0xBB, 0xCC, 0x63, 0x00, len(assetName)])
+  msg.extend(bytearray(assetName))
+  activeSerialPort.write(extendMessageWithChecksum(msg))
+  # NACK if there is no asset with the name
+  waitForAck(activeSerialPort)
+  print Fore.CYAN + "INFO: Deleted " + assetName + Fore.RESET
+
+# ==============================================================================
+# Main function call
+# ==============================================================================
+if __name__ == "__main__":
+  main(sys.argv[1:])
@@ -0,0 +1,43 @@
+/**
+ *******************************************************************************
+ * @file    FreeRTOS.h
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief   Stands in for FreeRTOS.h when the drivers are built for the host
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Define to prevent recursive inclusion ------------------------------------*/
+#ifndef FREERTOS_H_
+#define FREERTOS_H_
+
+/** Includes -----------------------------------------------------------------*/
+#include <stdint.h>
+
+/** Defines ------------------------------------------------------------------*/
+#define pdFALSE               (0)
+#define pdTRUE                (1)
+#define portMAX_DELAY         ((TickType_t)0xFFFFFFFF)
+#define portYIELD_FROM_ISR(x) ((void)(x))
+
+/** Typedefs -----------------------------------------------------------------*/
+typedef long BaseType_t;
+typedef uint32_t TickType_t;
+
+#endif /* FREERTOS_H_ */
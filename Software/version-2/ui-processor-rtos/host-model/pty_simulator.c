@@ -0,0 +1,508 @@
+/**
+ *******************************************************************************
+ * @file    pty_simulator.c
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief   Linux build of the UI processor flash command handling on a
+ *          pseudo-terminal so the flash can be written and read without a
+ *          board.
+ *
+ *          The real uart_comm.c gets the received bytes as a span like from
+ *          the USART1 RX DMA buffer and the flash task handles them right
+ *          away, the FLASH is 2 MB in RAM. Baud rate changes are accepted
+ *          from 9600 to 11.25 Mbaud but don't change anything. The path of
+ *          the terminal is printed at start. The UI processor only
+ *          has the set/get write address, erase, write, read and asset
+ *          commands, so fpga-config-over-uart.py finds it with its ping at a
+ *          new baud rate but gets the unknown command answer for the bitfile
+ *          commands. The asset table starts out empty, ui-asset-upload.py can
+ *          store, list and delete assets in it.
+ *
+ *          A session is everything from the first received byte until the
+ *          line has been quiet for a second. For each session it prints the
+ *          number of frames and frames per second, the CPU cycles uart_comm.c
+ *          and the commands it runs spend per received byte without the time
+ *          in the FLASH model and the time from the first received to the
+ *          last sent byte. The terminal has no baud rate so the time is what
+ *          the protocol costs on top of the wire.
+ *
+ *          Options:
+ *            -l path : Make a symbolic link to the terminal at path
+ *            -n num  : Exit after num sessions, for scripts and CI
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Includes -----------------------------------------------------------------*/
+/* For posix_openpt, cfmakeraw and the others */
+#define _GNU_SOURCE
+
+#include "uart_comm.h"
+#include "uart1.h"
+#include "spi_flash.h"
+#include "asset_table.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/** Private defines ----------------------------------------------------------*/
+#define MODEL_FLASH_SIZE            (0x200000)
+#define MODEL_READ_SIZE             (4096)
+/* A session ends when nothing has been received for this long */
+#define MODEL_SESSION_IDLE_MS       (1000)
+/* How long to sleep in poll when uart_comm.c has nothing to do */
+#define MODEL_IDLE_POLL_MS          (10)
+
+#define MODEL_BYTES_IN_SECTOR       (4*1024)
+/* The USART1 clock and the min baud rate in uart1.c */
+#define MODEL_PCLK2                 (90000000)
+#define MODEL_MIN_BAUD_RATE         (9600)
+
+#define MODEL_HEADER_1              (0xAA)
+#define MODEL_HEADER_2              (0xBB)
+#define MODEL_HEADER_3              (0xCC)
+
+/** Private typedefs ---------------------------------------------------------*/
+typedef enum
+{
+  ModelFrameState_Header1,
+  ModelFrameState_Header2,
+  ModelFrameState_Header3,
+  ModelFrameState_Command,
+  ModelFrameState_Count1,
+  ModelFrameState_Count2,
+  ModelFrameState_Data,
+  ModelFrameState_Checksum,
+} ModelFrameState;
+
+typedef struct
+{
+  bool active;
+  double firstRxMs;
+  double lastRxMs;
+  double lastTxMs;
+  uint64_t rxBytes;
+  uint64_t txBytes;
+  uint64_t frames;
+  uint64_t parserCycles;
+} ModelSession;
+
+/** Private variables --------------------------------------------------------*/
+static int prvMaster = -1;
+static int prvSlave = -1;
+static volatile sig_atomic_t prvStop = 0;
+
+static ModelSession prvSession;
+static uint32_t prvNumOfSessions;
+
+/* Cycles spent in the models while uart_comm.c was running, they are not
+ * counted as parser cycles */
+static uint64_t prvModelCycles;
+
+static ModelFrameState prvFrameState = ModelFrameState_Header1;
+static uint16_t prvFrameBytesLeft;
+
+static uint8_t prvFlash[MODEL_FLASH_SIZE];
+
+/* The bytes from the last read stand in for the RX DMA buffer */
+static uint8_t* prvRxData;
+static uint32_t prvRxCount;
+
+/** Private function prototypes ----------------------------------------------*/
+static ErrorStatus prvOpenTerminal(const char* pLink);
+static void prvHandleReceived(uint8_t* pData, uint32_t DataCount);
+static void prvCountFrames(uint8_t* pData, uint32_t DataCount);
+static void prvSend(uint8_t* pData, uint32_t DataCount);
+static void prvEndSession();
+static double prvNowMs();
+static uint64_t prvCycles();
+static void prvSignalHandler(int Signal);
+
+/** Functions ----------------------------------------------------------------*/
+int main(int argc, char** argv)
+{
+  const char* pLink = NULL;
+  uint32_t maxNumOfSessions = 0;
+  int option;
+  while ((option = getopt(argc, argv, "l:n:")) != -1)
+  {
+    if (option == 'l')
+      pLink = optarg;
+    else if (option == 'n')
+      maxNumOfSessions = strtoul(optarg, NULL, 0);
+    else
+    {
+      fprintf(stderr, "usage: %s [-l link] [-n sessions]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  memset(prvFlash, 0xFF, sizeof(prvFlash));
+  if (ASSET_TABLE_Init() != SUCCESS)
+    return 1;
+  if (prvOpenTerminal(pLink) != SUCCESS)
+    return 1;
+
+  signal(SIGINT, prvSignalHandler);
+  signal(SIGTERM, prvSignalHandler);
+
+  while (!prvStop)
+  {
+    struct pollfd pollFd = { .fd = prvMaster, .events = POLLIN };
+    int ready = poll(&pollFd, 1, MODEL_IDLE_POLL_MS);
+    if (ready < 0 && errno != EINTR)
+    {
+      perror("poll");
+      break;
+    }
+
+    if (ready > 0 && (pollFd.revents & POLLIN))
+    {
+      uint8_t data[MODEL_READ_SIZE];
+      ssize_t count = read(prvMaster, data, sizeof(data));
+      if (count > 0)
+        prvHandleReceived(data, count);
+    }
+
+    if (prvSession.active && prvNowMs() - prvSession.lastRxMs > MODEL_SESSION_IDLE_MS)
+    {
+      prvEndSession();
+      if (maxNumOfSessions != 0 && prvNumOfSessions >= maxNumOfSessions)
+        break;
+    }
+  }
+
+  if (prvSession.active)
+    prvEndSession();
+  if (pLink != NULL)
+    unlink(pLink);
+  close(prvSlave);
+  close(prvMaster);
+  return 0;
+}
+
+/** Model of the firmware modules --------------------------------------------*/
+void UART1_SendByte(uint8_t Byte)
+{
+  prvSend(&Byte, 1);
+}
+
+void UART1_SendBuffer(uint8_t* pData, uint16_t Size)
+{
+  prvSend(pData, Size);
+}
+
+ErrorStatus UART1_SendBuffers(const UART1_Buffer* pBuffers, uint32_t NumOfBuffers, TickType_t TicksToWait)
+{
+  for (uint32_t i = 0; i < NumOfBuffers; i++)
+    prvSend((uint8_t*)pBuffers[i].pData, pBuffers[i].size);
+  return SUCCESS;
+}
+
+ErrorStatus UART1_SetBaudRate(uint32_t BaudRate)
+{
+  return UART1_BaudRateSupported(BaudRate) ? SUCCESS : ERROR;
+}
+
+bool UART1_BaudRateSupported(uint32_t BaudRate)
+{
+  return (BaudRate >= MODEL_MIN_BAUD_RATE && BaudRate <= MODEL_PCLK2 / 8);
+}
+
+bool UART1_WaitForRxData(TickType_t TicksToWait)
+{
+  /* Nothing else can fill it while waiting */
+  return (prvRxCount != 0);
+}
+
+uint32_t UART1_GetRxSpan(uint8_t** ppData)
+{
+  *ppData = prvRxData;
+  return prvRxCount;
+}
+
+void UART1_ConsumeRxSpan(uint32_t Count)
+{
+  prvRxData += Count;
+  prvRxCount -= Count;
+}
+
+bool UART1_RxOverflowed()
+{
+  return false;
+}
+
+ErrorStatus SPI_FLASH_WriteBuffer(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite)
+{
+  uint64_t start = prvCycles();
+  for (uint32_t i = 0; i < NumByteToWrite; i++)
+    prvFlash[(WriteAddress + i) % MODEL_FLASH_SIZE] &= pBuffer[i];
+  prvModelCycles += prvCycles() - start;
+  return SUCCESS;
+}
+
+ErrorStatus SPI_FLASH_ReadBuffer(uint8_t* pBuffer, uint32_t ReadAddress, uint32_t NumByteToRead)
+{
+  uint64_t start = prvCycles();
+  for (uint32_t i = 0; i < NumByteToRead; i++)
+    pBuffer[i] = prvFlash[(ReadAddress + i) % MODEL_FLASH_SIZE];
+  prvModelCycles += prvCycles() - start;
+  return SUCCESS;
+}
+
+ErrorStatus SPI_FLASH_EraseSector(uint32_t SectorAddress)
+{
+  uint64_t start = prvCycles();
+  memset(&prvFlash[SectorAddress & (MODEL_FLASH_SIZE - MODEL_BYTES_IN_SECTOR)], 0xFF,
+         MODEL_BYTES_IN_SECTOR);
+  prvModelCycles += prvCycles() - start;
+  return SUCCESS;
+}
+
+ErrorStatus SPI_FLASH_EraseChip()
+{
+  uint64_t start = prvCycles();
+  memset(prvFlash, 0xFF, sizeof(prvFlash));
+  prvModelCycles += prvCycles() - start;
+  return SUCCESS;
+}
+
+/** Private functions .-------------------------------------------------------*/
+/**
+ * @brief   Open the pseudo-terminal and print the path of it
+ * @param   pLink: Path of a symbolic link to make to the terminal, can be NULL
+ * @retval  SUCCESS: The terminal is open
+ * @retval  ERROR: It could not be opened
+ */
+static ErrorStatus prvOpenTerminal(const char* pLink)
+{
+  prvMaster = posix_openpt(O_RDWR | O_NOCTTY);
+  if (prvMaster < 0 || grantpt(prvMaster) != 0 || unlockpt(prvMaster) != 0)
+  {
+    perror("posix_openpt");
+    return ERROR;
+  }
+  const char* pSlaveName = ptsname(prvMaster);
+
+  /* The slave is kept open so reads from the master don't fail with EIO while
+   * the tool isn't connected, it's set to raw in case the tool doesn't */
+  prvSlave = open(pSlaveName, O_RDWR | O_NOCTTY);
+  if (prvSlave < 0)
+  {
+    perror(pSlaveName);
+    return ERROR;
+  }
+  struct termios settings;
+  tcgetattr(prvSlave, &settings);
+  cfmakeraw(&settings);
+  tcsetattr(prvSlave, TCSANOW, &settings);
+
+  if (pLink != NULL)
+  {
+    unlink(pLink);
+    if (symlink(pSlaveName, pLink) != 0)
+    {
+      perror(pLink);
+      return ERROR;
+    }
+  }
+
+  printf("%s\n", (pLink != NULL) ? pLink : pSlaveName);
+  fflush(stdout);
+  return SUCCESS;
+}
+
+/**
+ * @brief   Give received bytes to uart_comm.c and time it
+ * @param   pData: The bytes
+ * @param   DataCount: Number of bytes
+ * @retval  None
+ */
+static void prvHandleReceived(uint8_t* pData, uint32_t DataCount)
+{
+  double now = prvNowMs();
+  if (!prvSession.active)
+  {
+    memset(&prvSession, 0, sizeof(prvSession));
+    prvSession.active = true;
+    prvSession.firstRxMs = now;
+    prvSession.lastTxMs = now;
+  }
+  prvSession.lastRxMs = now;
+  prvSession.rxBytes += DataCount;
+  prvCountFrames(pData, DataCount);
+
+  /* Everything that was read is one span like after an idle line interrupt,
+   * the flash task always keeps up as it does nothing else */
+  prvRxData = pData;
+  prvRxCount = DataCount;
+  prvModelCycles = 0;
+  uint64_t start = prvCycles();
+  UART_COMM_ProcessReceivedBytes(0);
+  prvSession.parserCycles += prvCycles() - start - prvModelCycles;
+}
+
+/**
+ * @brief   Count the frames in the received bytes, separate from uart_comm.c
+ *          so a broken parser can't make the numbers look better
+ * @param   pData: The bytes
+ * @param   DataCount: Number of bytes
+ * @retval  None
+ */
+static void prvCountFrames(uint8_t* pData, uint32_t DataCount)
+{
+  static const uint8_t commandsWithoutCount[] = { 0x11, 0x20, 0x61, 0x62 };
+  for (uint32_t i = 0; i < DataCount; i++)
+  {
+    uint8_t byte = pData[i];
+    switch (prvFrameState)
+    {
+      case ModelFrameState_Header1:
+        if (byte == MODEL_HEADER_1)
+          prvFrameState = ModelFrameState_Header2;
+        break;
+      case ModelFrameState_Header2:
+        prvFrameState = (byte == MODEL_HEADER_2) ? ModelFrameState_Header3 : ModelFrameState_Header1;
+        break;
+      case ModelFrameState_Header3:
+        prvFrameState = (byte == MODEL_HEADER_3) ? ModelFrameState_Command : ModelFrameState_Header1;
+        break;
+      case ModelFrameState_Command:
+        prvFrameState = memchr(commandsWithoutCount, byte, sizeof(commandsWithoutCount)) ?
+                        ModelFrameState_Checksum : ModelFrameState_Count1;
+        break;
+      case ModelFrameState_Count1:
+        prvFrameBytesLeft = (uint16_t)byte << 8;
+        prvFrameState = ModelFrameState_Count2;
+        break;
+      case ModelFrameState_Count2:
+        prvFrameBytesLeft |= byte;
+        prvFrameState = (prvFrameBytesLeft != 0) ? ModelFrameState_Data : ModelFrameState_Checksum;
+        break;
+      case ModelFrameState_Data:
+        if (--prvFrameBytesLeft == 0)
+          prvFrameState = ModelFrameState_Checksum;
+        break;
+      case ModelFrameState_Checksum:
+        prvSession.frames++;
+        prvFrameState = ModelFrameState_Header1;
+        break;
+    }
+  }
+}
+
+/**
+ * @brief   Write bytes from the "UART" to the terminal
+ * @param   pData: The bytes
+ * @param   DataCount: Number of bytes
+ * @retval  None
+ */
+static void prvSend(uint8_t* pData, uint32_t DataCount)
+{
+  uint64_t start = prvCycles();
+  while (DataCount != 0)
+  {
+    ssize_t count = write(prvMaster, pData, DataCount);
+    if (count < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      perror("write");
+      break;
+    }
+    pData += count;
+    DataCount -= count;
+    prvSession.txBytes += count;
+  }
+  prvSession.lastTxMs = prvNowMs();
+  prvModelCycles += prvCycles() - start;
+}
+
+/**
+ * @brief   Print the statistics of the session that just ended
+ * @param   None
+ * @retval  None
+ */
+static void prvEndSession()
+{
+  double ms = prvSession.lastTxMs - prvSession.firstRxMs;
+  if (ms < 1.0)
+    ms = 1.0;
+
+  prvNumOfSessions++;
+  printf("Session %u: %llu frames, %llu bytes in, %llu bytes out\n",
+         prvNumOfSessions, (unsigned long long)prvSession.frames,
+         (unsigned long long)prvSession.rxBytes, (unsigned long long)prvSession.txBytes);
+  printf("  %.0f frames/s, %.1f parser %s/byte, %.3f s from first byte in to last byte out\n",
+         prvSession.frames * 1000.0 / ms,
+         prvSession.rxBytes ? (double)prvSession.parserCycles / prvSession.rxBytes : 0.0,
+#if defined(__x86_64__) || defined(__i386__)
+         "cycles",
+#else
+         "ns",
+#endif
+         ms / 1000.0);
+  fflush(stdout);
+  prvSession.active = false;
+}
+
+/**
+ * @brief   Milliseconds since some time in the past
+ * @param   None
+ * @retval  The time
+ */
+static double prvNowMs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+/**
+ * @brief   The CPU cycle counter, nanoseconds where there isn't one
+ * @param   None
+ * @retval  The count
+ */
+static uint64_t prvCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+static void prvSignalHandler(int Signal)
+{
+  prvStop = 1;
+}
+
+/** Interrupt Handlers -------------------------------------------------------*/
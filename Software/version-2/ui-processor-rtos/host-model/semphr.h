@@ -0,0 +1,53 @@
+/**
+ *******************************************************************************
+ * @file    semphr.h
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief   Stands in for semphr.h when the drivers are built for the host
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Define to prevent recursive inclusion ------------------------------------*/
+#ifndef SEMPHR_H_
+#define SEMPHR_H_
+
+/** Includes -----------------------------------------------------------------*/
+#include "FreeRTOS.h"
+
+/** Typedefs -----------------------------------------------------------------*/
+typedef void* SemaphoreHandle_t;
+
+/** Functions ----------------------------------------------------------------*/
+/* There is only one task on the host so the mutexes never block */
+static inline SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  return (SemaphoreHandle_t)1;
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t Semaphore, TickType_t TicksToWait)
+{
+  return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t Semaphore)
+{
+  return pdTRUE;
+}
+
+#endif /* SEMPHR_H_ */
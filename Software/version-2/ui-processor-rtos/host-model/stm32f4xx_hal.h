@@ -0,0 +1,47 @@
+/**
+ *******************************************************************************
+ * @file    stm32f4xx_hal.h
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief   The parts of the HAL that uart_comm.c and the driver headers it
+ *          includes need so it can be built for the host
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Define to prevent recursive inclusion ------------------------------------*/
+#ifndef STM32F4XX_HAL_H_
+#define STM32F4XX_HAL_H_
+
+/** Includes -----------------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+
+/** Typedefs -----------------------------------------------------------------*/
+typedef enum
+{
+  SUCCESS = 0,
+  ERROR = !SUCCESS,
+} ErrorStatus;
+
+typedef struct
+{
+  uint32_t Dummy;
+} UART_HandleTypeDef;
+
+#endif /* STM32F4XX_HAL_H_ */
@@ -0,0 +1,75 @@
+/**
+ *******************************************************************************
+ * @file    asset_table.h
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Define to prevent recursive inclusion ------------------------------------*/
+#ifndef ASSET_TABLE_H_
+#define ASSET_TABLE_H_
+
+/** Includes -----------------------------------------------------------------*/
+#include "stm32f4xx_hal.h"
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include <stdbool.h>
+
+/** Defines ------------------------------------------------------------------*/
+/* Including the terminating 0 */
+#define ASSET_TABLE_NAME_LENGTH   (16)
+#define ASSET_TABLE_MAX_ASSETS    (48)
+
+/** Typedefs -----------------------------------------------------------------*/
+typedef enum
+{
+  ASSET_TABLE_Type_Raw = 0,
+  ASSET_TABLE_Type_Font = 1,
+  ASSET_TABLE_Type_Image = 2,
+  ASSET_TABLE_Type_SplashScreen = 3,
+  ASSET_TABLE_Type_Clut = 4,
+} ASSET_TABLE_Type;
+
+/* Stored as it is in the table in flash, 32 bytes */
+typedef struct
+{
+  char name[ASSET_TABLE_NAME_LENGTH];
+  uint32_t address;
+  uint32_t size;
+  uint32_t crc;       /* CRC32 of the data */
+  uint8_t type;       /* ASSET_TABLE_Type */
+  uint8_t used;
+  uint8_t reserved[2];
+} ASSET_TABLE_Entry;
+
+/** Function prototypes ------------------------------------------------------*/
+ErrorStatus ASSET_TABLE_Init();
+bool ASSET_TABLE_Initialized();
+ErrorStatus ASSET_TABLE_Find(const char* pName, ASSET_TABLE_Entry* pEntry);
+ErrorStatus ASSET_TABLE_Read(const ASSET_TABLE_Entry* pEntry, uint32_t Offset, uint8_t* pBuffer, uint32_t NumByteToRead);
+uint32_t ASSET_TABLE_GetEntries(ASSET_TABLE_Entry* pEntries, uint32_t MaxNumOfEntries);
+ErrorStatus ASSET_TABLE_Allocate(uint32_t Size, uint32_t* pAddress);
+ErrorStatus ASSET_TABLE_Add(const ASSET_TABLE_Entry* pEntry);
+ErrorStatus ASSET_TABLE_Remove(const char* pName);
+bool ASSET_TABLE_RangeIsFree(uint32_t Address, uint32_t Size);
+ErrorStatus ASSET_TABLE_Reset();
+
+#endif /* ASSET_TABLE_H_ */
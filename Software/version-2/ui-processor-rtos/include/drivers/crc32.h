@@ -0,0 +1,42 @@
+/**
+ *******************************************************************************
+ * @file    crc32.h
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Define to prevent recursive inclusion ------------------------------------*/
+#ifndef CRC32_H_
+#define CRC32_H_
+
+/** Includes -----------------------------------------------------------------*/
+#include <stdint.h>
+
+/** Defines ------------------------------------------------------------------*/
+/* Start value for CRC32_Update, the result is inverted when done */
+#define CRC32_INITIAL_VALUE   (0xFFFFFFFF)
+
+/** Typedefs -----------------------------------------------------------------*/
+/** Function prototypes ------------------------------------------------------*/
+uint32_t CRC32_Calculate(const uint8_t* pData, uint32_t DataCount);
+uint32_t CRC32_Update(uint32_t Crc, const uint8_t* pData, uint32_t DataCount);
+
+#endif /* CRC32_H_ */
@@ -41,6 +41,112 @@
 #define SPI_COMM_COMMAND_CHANNEL_ID               (0x12)
 #define SPI_COMM_COMMAND_CHANNEL_DIRECTION        (0x13)
 #define SPI_COMM_COMMAND_CAN_CHANNEL_TERMINATION  (0x30)
+#define SPI_COMM_COMMAND_CHANNEL_REGISTER_WRITE   (0x40)
+#define SPI_COMM_COMMAND_CHANNEL_STATUS           (0x41)
+#define SPI_COMM_COMMAND_CHANNEL_FIFO_LEVEL       (0x42)
+#define SPI_COMM_COMMAND_CHANNEL_FIFO_READ        (0x43)
+#define SPI_COMM_COMMAND_ADC_REGISTER_WRITE       (0x50)
+#define SPI_COMM_COMMAND_ADC_STATUS               (0x51)
+#define SPI_COMM_COMMAND_ADC_FIFO_LEVEL           (0x52)
+#define SPI_COMM_COMMAND_ADC_FIFO_READ            (0x53)
+
+/* Channel UART registers */
+#define SPI_COMM_UART_REGISTER_CONTROL            (0x00)
+#define SPI_COMM_UART_REGISTER_DIVISOR_HIGH       (0x01)
+#define SPI_COMM_UART_REGISTER_DIVISOR_LOW        (0x02)
+#define SPI_COMM_UART_CONTROL_ENABLE              (0x01)
+#define SPI_COMM_UART_CONTROL_TWO_STOP_BITS       (0x08)
+#define SPI_COMM_UART_CONTROL_TIMESTAMP           (0x10)
+#define SPI_COMM_UART_CONTROL_CLEAR_STATUS        (0x80)
+
+/* Channel UART status bits */
+#define SPI_COMM_UART_STATUS_FRAMING_ERROR        (0x01)
+#define SPI_COMM_UART_STATUS_PARITY_ERROR         (0x02)
+#define SPI_COMM_UART_STATUS_BREAK                (0x04)
+#define SPI_COMM_UART_STATUS_OVERRUN              (0x08)
+#define SPI_COMM_UART_STATUS_ENABLED              (0x10)
+#define SPI_COMM_UART_STATUS_BUSY                 (0x20)
+#define SPI_COMM_UART_STATUS_TIMESTAMP            (0x40)
+
+/* Channel UART replay registers, above the UART registers. Every address
+ * from 0x80 and up writes to the record buffer */
+#define SPI_COMM_REPLAY_REGISTER_CONTROL          (0x20)
+#define SPI_COMM_REPLAY_REGISTER_DIVISOR_HIGH     (0x21)
+#define SPI_COMM_REPLAY_REGISTER_DIVISOR_LOW      (0x22)
+#define SPI_COMM_REPLAY_REGISTER_SPEED_HIGH       (0x23)
+#define SPI_COMM_REPLAY_REGISTER_SPEED_LOW        (0x24)
+#define SPI_COMM_REPLAY_REGISTER_DATA             (0x80)
+#define SPI_COMM_REPLAY_CONTROL_ENABLE            (0x01)
+#define SPI_COMM_REPLAY_CONTROL_TWO_STOP_BITS     (0x08)
+#define SPI_COMM_REPLAY_CONTROL_CLEAR_STATUS      (0x80)
+#define SPI_COMM_REPLAY_CHUNK_SIZE                (128)
+#define SPI_COMM_REPLAY_SPEED_ORIGINAL            (0x0100)  /* 8.8 fixed point, 0 pauses */
+
+/* Channel UART replay status bits, reported while the replay is enabled */
+#define SPI_COMM_REPLAY_STATUS_LATE               (0x01)
+#define SPI_COMM_REPLAY_STATUS_OVERRUN            (0x08)
+#define SPI_COMM_REPLAY_STATUS_ENABLED            (0x10)
+#define SPI_COMM_REPLAY_STATUS_ACTIVE             (0x20)
+#define SPI_COMM_REPLAY_STATUS_ROOM               (0x40)  /* Room for a chunk */
+
+/* Channel CAN registers */
+#define SPI_COMM_CAN_REGISTER_CONTROL             (0x00)
+#define SPI_COMM_CAN_REGISTER_BIT_TIME_HIGH       (0x01)
+#define SPI_COMM_CAN_REGISTER_BIT_TIME_LOW        (0x02)
+#define SPI_COMM_CAN_REGISTER_SAMPLE_POINT_HIGH   (0x03)
+#define SPI_COMM_CAN_REGISTER_SAMPLE_POINT_LOW    (0x04)
+#define SPI_COMM_CAN_REGISTER_SJW                 (0x05)
+#define SPI_COMM_CAN_CONTROL_ENABLE               (0x01)
+#define SPI_COMM_CAN_CONTROL_TIMESTAMP            (0x02)
+#define SPI_COMM_CAN_CONTROL_CLEAR_STATUS         (0x80)
+
+/* Channel CAN status bits */
+#define SPI_COMM_CAN_STATUS_FORM_ERROR            (0x01)
+#define SPI_COMM_CAN_STATUS_CRC_ERROR             (0x02)
+#define SPI_COMM_CAN_STATUS_STUFF_ERROR           (0x04)
+#define SPI_COMM_CAN_STATUS_OVERRUN               (0x08)
+#define SPI_COMM_CAN_STATUS_ENABLED               (0x10)
+#define SPI_COMM_CAN_STATUS_BUSY                  (0x20)
+#define SPI_COMM_CAN_STATUS_NO_ACK                (0x40)
+
+/* CAN frame records in the channel FIFO */
+#define SPI_COMM_CAN_RECORD_HEADER_SIZE           (6)
+#define SPI_COMM_CAN_RECORD_FLAG_FORM_ERROR       (0x01)
+#define SPI_COMM_CAN_RECORD_FLAG_CRC_ERROR        (0x02)
+#define SPI_COMM_CAN_RECORD_FLAG_STUFF_ERROR      (0x04)
+#define SPI_COMM_CAN_RECORD_FLAG_NO_ACK           (0x08)
+#define SPI_COMM_CAN_RECORD_FLAG_REMOTE           (0x40)
+#define SPI_COMM_CAN_RECORD_FLAG_EXTENDED         (0x80)
+
+/* ADC stream registers */
+#define SPI_COMM_ADC_REGISTER_CONTROL             (0x00)
+#define SPI_COMM_ADC_REGISTER_CHANNEL_MASK        (0x01)
+#define SPI_COMM_ADC_REGISTER_DECIMATION          (0x02)
+#define SPI_COMM_ADC_CONTROL_STREAM               (0x01)
+#define SPI_COMM_ADC_CONTROL_TIMESTAMP            (0x02)
+#define SPI_COMM_ADC_CONTROL_CLEAR_STATUS         (0x80)
+
+/* ADC stream status bits */
+#define SPI_COMM_ADC_STATUS_OVERRUN               (0x08)
+#define SPI_COMM_ADC_STATUS_STREAM                (0x10)
+#define SPI_COMM_ADC_STATUS_TIMESTAMP             (0x40)
+
+/* ADC sample records, 3 bits of channel followed by 10 bits of sample */
+#define SPI_COMM_ADC_RECORD_SIZE                  (2)
+#define SPI_COMM_ADC_RECORD_CHANNEL(HIGH)         (((HIGH) >> 4) & 0x07)
+#define SPI_COMM_ADC_RECORD_VALUE(HIGH, LOW)      ((((uint16_t)(HIGH) & 0x03) << 8) | (LOW))
+
+/* Timestamp headers in the channel FIFO, one tick is one FPGA clock cycle */
+#define SPI_COMM_TIMESTAMP_TYPE_MASK              (0xC0)
+#define SPI_COMM_TIMESTAMP_TYPE_DELTA_1           (0x00)
+#define SPI_COMM_TIMESTAMP_TYPE_DELTA_2           (0x40)
+#define SPI_COMM_TIMESTAMP_TYPE_DELTA_3           (0x80)
+#define SPI_COMM_TIMESTAMP_TYPE_FULL              (0xC0)
+#define SPI_COMM_TIMESTAMP_FULL_SIZE              (6)
+#define SPI_COMM_TIMESTAMP_NS_PER_TICK            (10)
+
+#define SPI_COMM_FPGA_CLOCK_FREQUENCY             (100000000)
+#define SPI_COMM_FIFO_READ_MAX_COUNT              (255)
 
 /** Typedefs -----------------------------------------------------------------*/
 typedef enum
@@ -54,6 +160,29 @@ typedef enum
   SPI_COMM_Channel_All = 7,
 } SPI_COMM_Channel;
 
+typedef enum
+{
+  SPI_COMM_UartParity_None = 0x00,
+  SPI_COMM_UartParity_Even = 0x02,
+  SPI_COMM_UartParity_Odd = 0x04,
+} SPI_COMM_UartParity;
+
+/* Running timestamp for a channel, see SPI_COMM_ParseTimestamp */
+typedef struct
+{
+  uint64_t ticks;
+  bool valid;
+} SPI_COMM_Timestamp;
+
+typedef struct
+{
+  uint32_t id;
+  uint8_t flags;
+  uint8_t dlc;
+  uint8_t dataCount;
+  uint8_t data[8];
+} SPI_COMM_CanFrame;
+
 /** Function prototypes ------------------------------------------------------*/
 ErrorStatus SPI_COMM_Init();
 bool SPI_COMM_Initialized();
@@ -80,4 +209,25 @@ ErrorStatus SPI_COMM_GetTerminationForAllChannels(uint8_t* pCurrentTermination);
 void SPI_COMM_EnableTerminationForChannel(SPI_COMM_Channel Channel);
 void SPI_COMM_DisableTerminationForChannel(SPI_COMM_Channel Channel);
 
+void SPI_COMM_WriteRegistersForChannel(SPI_COMM_Channel Channel, uint8_t Address, uint8_t* pData, uint32_t DataCount);
+ErrorStatus SPI_COMM_SetUartConfigForChannel(SPI_COMM_Channel Channel, uint32_t BaudRate, SPI_COMM_UartParity Parity, bool TwoStopBits, bool Timestamps);
+void SPI_COMM_DisableUartForChannel(SPI_COMM_Channel Channel);
+ErrorStatus SPI_COMM_SetUartReplayForChannel(SPI_COMM_Channel Channel, uint32_t BaudRate, SPI_COMM_UartParity Parity, bool TwoStopBits, uint16_t Speed);
+uint32_t SPI_COMM_WriteUartReplayDataForChannel(SPI_COMM_Channel Channel, uint8_t* pData, uint32_t DataCount);
+void SPI_COMM_DisableUartReplayForChannel(SPI_COMM_Channel Channel);
+ErrorStatus SPI_COMM_SetCanConfigForChannel(SPI_COMM_Channel Channel, uint32_t BitRate, uint8_t SamplePointPercent, bool Timestamps);
+void SPI_COMM_DisableCanForChannel(SPI_COMM_Channel Channel);
+uint32_t SPI_COMM_ParseTimestamp(uint8_t* pData, uint32_t DataCount, SPI_COMM_Timestamp* pTimestamp);
+uint64_t SPI_COMM_TimestampToNanoseconds(SPI_COMM_Timestamp* pTimestamp);
+uint32_t SPI_COMM_ParseCanRecord(uint8_t* pData, uint32_t DataCount, SPI_COMM_CanFrame* pFrame);
+ErrorStatus SPI_COMM_GetStatusForChannel(SPI_COMM_Channel Channel, uint8_t* pStatus);
+ErrorStatus SPI_COMM_GetFifoLevelForChannel(SPI_COMM_Channel Channel, uint8_t* pLevel);
+uint32_t SPI_COMM_ReadFifoForChannel(SPI_COMM_Channel Channel, uint8_t* pBuffer, uint32_t BufferSize);
+
+void SPI_COMM_SetAdcStream(uint8_t ChannelMask, uint8_t Decimation, bool Timestamps);
+void SPI_COMM_DisableAdcStream();
+uint8_t SPI_COMM_GetAdcStatus();
+uint8_t SPI_COMM_GetAdcFifoLevel();
+uint32_t SPI_COMM_ReadAdcFifo(uint8_t* pBuffer, uint32_t BufferSize);
+
 #endif /* SPI_COMM_H_ */
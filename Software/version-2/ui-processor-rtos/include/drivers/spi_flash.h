@@ -36,19 +36,55 @@
 
 /** Defines ------------------------------------------------------------------*/
 /** Typedefs -----------------------------------------------------------------*/
+typedef enum
+{
+  SPI_FLASH_Operation_Read,
+  SPI_FLASH_Operation_Program,
+  SPI_FLASH_Operation_EraseSector,
+  SPI_FLASH_Operation_EraseChip,
+} SPI_FLASH_Operation;
+
+/* Higher priority requests run first, a read can also run while a sector
+ * erase is suspended */
+typedef enum
+{
+  SPI_FLASH_Priority_Low,
+  SPI_FLASH_Priority_Normal,
+  SPI_FLASH_Priority_High,
+} SPI_FLASH_Priority;
+
+/* Filled in by the caller and owned by the driver from SPI_FLASH_Submit until
+ * done is set, so it must not be on a stack that goes away before that */
+typedef struct SPI_FLASH_Request
+{
+  SPI_FLASH_Operation operation;
+  SPI_FLASH_Priority priority;
+  uint8_t* pBuffer;
+  uint32_t address;
+  uint32_t count;
+  /* Gets a task notification when the request is done, can be NULL */
+  TaskHandle_t task;
+
+  volatile bool done;
+  volatile ErrorStatus status;
+
+  /* Used by the driver */
+  uint32_t progress;
+  struct SPI_FLASH_Request* pNext;
+} SPI_FLASH_Request;
+
 /** Function prototypes ------------------------------------------------------*/
 ErrorStatus SPI_FLASH_Init();
 uint32_t SPI_FLASH_ReadID();
-void SPI_FLASH_WriteBuffer(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite);
-void SPI_FLASH_WriteBufferFromISR(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite);
-void SPI_FLASH_WriteByte(uint32_t WriteAddress, uint8_t Byte);
-void SPI_FLASH_WriteByteFromISR(uint32_t WriteAddress, uint8_t Byte);
-void SPI_FLASH_ReadBuffer(uint8_t* pBuffer, uint32_t ReadAddress, uint32_t NumByteToRead);
-void SPI_FLASH_ReadBufferFromISR(uint8_t* pBuffer, uint32_t ReadAddress, uint32_t NumByteToRead);
+ErrorStatus SPI_FLASH_Submit(SPI_FLASH_Request* pRequest);
+ErrorStatus SPI_FLASH_WaitForRequest(SPI_FLASH_Request* pRequest);
+ErrorStatus SPI_FLASH_WriteBuffer(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite);
+ErrorStatus SPI_FLASH_WriteByte(uint32_t WriteAddress, uint8_t Byte);
+ErrorStatus SPI_FLASH_ReadBuffer(uint8_t* pBuffer, uint32_t ReadAddress, uint32_t NumByteToRead);
 ErrorStatus SPI_FLASH_EraseSector(uint32_t SectorAddress);
-ErrorStatus SPI_FLASH_EraseSectorFromISR(uint32_t SectorAddress);
-void SPI_FLASH_EraseChip();
-void SPI_FLASH_EraseChipFromISR();
+ErrorStatus SPI_FLASH_EraseChip();
 bool SPI_FLASH_Initialized();
 
+void SPI_FLASH_RxDmaHandler();
+
 #endif /* SPI_FLASH_H_ */
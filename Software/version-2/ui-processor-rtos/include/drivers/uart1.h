@@ -30,6 +30,8 @@
 /** Includes -----------------------------------------------------------------*/
 #include "stm32f4xx_hal.h"
 #include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
 #include <stdbool.h>
 
 /** Global variables ---------------------------------------------------------*/
@@ -37,13 +39,29 @@ UART_HandleTypeDef UART_Handle;
 
 /** Defines ------------------------------------------------------------------*/
 /** Typedefs -----------------------------------------------------------------*/
+typedef struct
+{
+  const uint8_t* pData;
+  uint16_t size;
+} UART1_Buffer;
+
 /** Function prototypes ------------------------------------------------------*/
 ErrorStatus UART1_Init();
+ErrorStatus UART1_SetBaudRate(uint32_t BaudRate);
+bool UART1_BaudRateSupported(uint32_t BaudRate);
 uint32_t UART1_BytesAvailable();
+bool UART1_WaitForRxData(TickType_t TicksToWait);
+uint32_t UART1_GetRxSpan(uint8_t** ppData);
+void UART1_ConsumeRxSpan(uint32_t Count);
+bool UART1_RxOverflowed();
 void UART1_GetDataFromBuffer(uint8_t* pStorage, uint32_t Size);
 uint8_t UART1_GetByteFromBuffer();
 void UART1_SendByte(uint8_t Byte);
 void UART1_SendBuffer(uint8_t* pData, uint16_t Size);
-void UART1_DataReceivedHandler();
+ErrorStatus UART1_SendBuffers(const UART1_Buffer* pBuffers, uint32_t NumOfBuffers, TickType_t TicksToWait);
+bool UART1_TxBusy();
+void UART1_IdleLineHandler();
+void UART1_RxDmaHandler();
+void UART1_TxDmaHandler();
 
 #endif /* UART1_H_ */
@@ -35,6 +35,8 @@
 /** Defines ------------------------------------------------------------------*/
 /** Typedefs -----------------------------------------------------------------*/
 /** Function prototypes ------------------------------------------------------*/
+void UART_COMM_ProcessReceivedBytes(TickType_t TicksToWait);
+void UART_COMM_HandleReceivedData(uint8_t* pData, uint32_t DataCount);
 void UART_COMM_HandleReceivedByte(uint8_t Byte);
 
 #endif /* UART_COMM_H_ */
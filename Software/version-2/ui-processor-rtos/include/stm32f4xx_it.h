@@ -38,5 +38,8 @@ void EXTI1_IRQHandler(void);
 void DMA2D_IRQHandler(void);
 void LTDC_IRQHandler(void);
 void USART1_IRQHandler(void);
+void DMA2_Stream2_IRQHandler(void);
+void DMA2_Stream7_IRQHandler(void);
+void DMA2_Stream0_IRQHandler(void);
 
 #endif /* STM32F4XX_IT_H */
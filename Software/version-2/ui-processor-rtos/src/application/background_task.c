@@ -30,8 +30,6 @@
 
 #include "buzzer.h"
 #include "i2c_eeprom.h"
-#include "uart1.h"
-#include "uart_comm.h"
 
 /** Private defines ----------------------------------------------------------*/
 /** Private typedefs ---------------------------------------------------------*/
@@ -64,8 +62,6 @@ void backgroundTask(void *pvParameters)
   if (prvBlinkTimer != NULL)
     xTimerStart(prvBlinkTimer, portMAX_DELAY);
 
-  UART1_Init();
-
   vTaskDelayUntil(&xNextWakeTime, 1000 / portTICK_PERIOD_MS);
 
   I2C_EEPROM_Init();
@@ -0,0 +1,62 @@
+/**
+ *******************************************************************************
+ * @file    flash_task.c
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief   Handles the SPI FLASH and asset upload commands received on
+ *          USART1. The DMA fills the RX buffer, the commands are parsed and
+ *          the erase, write and read are done here.
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Includes -----------------------------------------------------------------*/
+#include "flash_task.h"
+
+#include "asset_table.h"
+#include "uart1.h"
+#include "uart_comm.h"
+
+/** Private defines ----------------------------------------------------------*/
+/** Private typedefs ---------------------------------------------------------*/
+/** Private variables --------------------------------------------------------*/
+/** Private function prototypes ----------------------------------------------*/
+/** Functions ----------------------------------------------------------------*/
+/**
+ * @brief   The flash task, waits for the asset table and then handles the
+ *          received commands forever
+ * @param   pvParameters: Not used
+ * @retval  None
+ */
+void flashTask(void *pvParameters)
+{
+  /* Start receiving to the RX buffer, the UART is only used from here */
+  UART1_Init();
+
+  /* The SPI FLASH and the asset table are initialized by the LCD task */
+  while (!ASSET_TABLE_Initialized())
+    vTaskDelay(10 / portTICK_PERIOD_MS);
+
+  while (1)
+  {
+    UART_COMM_ProcessReceivedBytes(portMAX_DELAY);
+  }
+}
+
+/** Private functions .-------------------------------------------------------*/
+/** Interrupt Handlers -------------------------------------------------------*/
@@ -34,6 +34,7 @@
 #include "ft5206.h"
 #include "simple_gui.h"
 #include "spi_flash.h"
+#include "asset_table.h"
 #include "sdram.h"
 #include "images.h"
 
@@ -41,6 +42,9 @@
 #define DISPLAY_ENABLE_PIN  GPIO_PIN_4
 #define BACKLIGHT_ADJ_PIN   GPIO_PIN_7
 
+/* RGB565 image of the full display */
+#define LCD_SPLASH_SCREEN_SIZE  (800*480*2)
+
 /** Private typedefs ---------------------------------------------------------*/
 /** Private variables --------------------------------------------------------*/
 static xTimerHandle prvRefreshTimer;
@@ -198,6 +202,16 @@ static void prvHardwareInit()
 static void prvSplashScreen()
 {
   SPI_FLASH_Init();
+  ASSET_TABLE_Init();
+
+  /* Show the splash screen uploaded with ui-asset-upload if it is there */
+  ASSET_TABLE_Entry splash;
+  if (ASSET_TABLE_Find("splash", &splash) == SUCCESS &&
+      splash.type == ASSET_TABLE_Type_SplashScreen &&
+      splash.size == LCD_SPLASH_SCREEN_SIZE)
+  {
+    ASSET_TABLE_Read(&splash, 0, (uint8_t*)SDRAM_BANK_ADDR, splash.size);
+  }
 //  SPI_FLASH_EraseChip();
 //  uint8_t* dataPointer = (uint8_t*)splash_screen.DataTable;
 //  SPI_FLASH_WriteBuffer(dataPointer, 0, 800*480*2);
@@ -0,0 +1,469 @@
+/**
+ *******************************************************************************
+ * @file    asset_table.c
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief   Directory of the named assets in the SPI FLASH, fonts, images,
+ *          splash screens and CLUTs uploaded over USART1.
+ *
+ *          The table is a hash table on the name with linear probing, it is
+ *          kept in RAM so a lookup is a hash and normally one compare. Every
+ *          change writes the whole table to the one of the two table sectors
+ *          that doesn't hold the current one, with a higher sequence number,
+ *          so the old table is still there if the power is lost meanwhile.
+ *          The assets are sector aligned after the table sectors.
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Includes -----------------------------------------------------------------*/
+#include "asset_table.h"
+
+#include "spi_flash.h"
+#include "crc32.h"
+
+#include <string.h>
+
+/** Private defines ----------------------------------------------------------*/
+#define ASSET_TABLE_MAGIC             (0x54455341)  /* "ASET" */
+#define ASSET_TABLE_SECTOR_SIZE       (4*1024)
+#define ASSET_TABLE_FLASH_SIZE        (0x200000)
+#define ASSET_TABLE_ADDRESS_0         (0x000000)
+#define ASSET_TABLE_ADDRESS_1         (0x001000)
+#define ASSET_TABLE_FIRST_ASSET       (0x002000)
+
+/* Power of two above the max number of assets so the probes stay short */
+#define ASSET_TABLE_NUM_OF_SLOTS      (64)
+
+/** Private typedefs ---------------------------------------------------------*/
+typedef struct
+{
+  uint32_t magic;
+  uint32_t sequence;
+  uint32_t crc;       /* CRC32 of the slots */
+  uint32_t reserved;
+} ASSET_TABLE_Header;
+
+typedef struct
+{
+  ASSET_TABLE_Header header;
+  ASSET_TABLE_Entry slots[ASSET_TABLE_NUM_OF_SLOTS];
+} ASSET_TABLE_Table;
+
+/** Private variables --------------------------------------------------------*/
+static ASSET_TABLE_Table prvTable;
+/* Where the current table is, the next one goes to the other sector */
+static uint32_t prvTableAddress = ASSET_TABLE_ADDRESS_1;
+static uint32_t prvNumOfAssets = 0;
+static SemaphoreHandle_t prvMutex = NULL;
+static bool prvInitialized = false;
+
+/** Private function prototypes ----------------------------------------------*/
+static bool prvReadTable(uint32_t Address, ASSET_TABLE_Table* pTable);
+static ErrorStatus prvWriteTable();
+static int32_t prvFindSlot(const char* pName);
+static void prvInsert(ASSET_TABLE_Entry* pSlots, const ASSET_TABLE_Entry* pEntry);
+static void prvRehash();
+static uint32_t prvHash(const char* pName);
+static bool prvValidName(const char* pName);
+
+/** Functions ----------------------------------------------------------------*/
+/**
+ * @brief   Load the newest valid table from the SPI FLASH, an empty table is
+ *          used if there is none. The SPI FLASH must be initialized first.
+ * @param   None
+ * @retval  SUCCESS or ERROR if the mutex could not be created
+ */
+ErrorStatus ASSET_TABLE_Init()
+{
+  /* Make sure we only initialize it once */
+  if (prvInitialized)
+    return SUCCESS;
+
+  prvMutex = xSemaphoreCreateMutex();
+  if (prvMutex == NULL)
+    return ERROR;
+
+  /* The copy with the highest sequence number is the current one, the other
+   * one is older or was being written when the power was lost */
+  static ASSET_TABLE_Table other;
+  bool valid0 = prvReadTable(ASSET_TABLE_ADDRESS_0, &other);
+  bool valid1 = prvReadTable(ASSET_TABLE_ADDRESS_1, &prvTable);
+  if (valid0 && (!valid1 || (int32_t)(other.header.sequence - prvTable.header.sequence) > 0))
+  {
+    memcpy(&prvTable, &other, sizeof(prvTable));
+    prvTableAddress = ASSET_TABLE_ADDRESS_0;
+  }
+  else if (valid1)
+    prvTableAddress = ASSET_TABLE_ADDRESS_1;
+  else
+  {
+    memset(&prvTable, 0, sizeof(prvTable));
+    prvTableAddress = ASSET_TABLE_ADDRESS_1;
+  }
+
+  prvNumOfAssets = 0;
+  for (uint32_t i = 0; i < ASSET_TABLE_NUM_OF_SLOTS; i++)
+  {
+    if (prvTable.slots[i].used)
+      prvNumOfAssets++;
+  }
+
+  prvInitialized = true;
+  return SUCCESS;
+}
+
+/**
+ * @brief   Check if the table has been loaded
+ * @param   None
+ * @retval  true if it has
+ */
+bool ASSET_TABLE_Initialized()
+{
+  return prvInitialized;
+}
+
+/**
+ * @brief   Look up an asset by name
+ * @param   pName: The name
+ * @param   pEntry: Where to put a copy of the entry
+ * @retval  SUCCESS or ERROR if there is no asset with the name
+ */
+ErrorStatus ASSET_TABLE_Find(const char* pName, ASSET_TABLE_Entry* pEntry)
+{
+  if (!prvInitialized || !prvValidName(pName))
+    return ERROR;
+
+  xSemaphoreTake(prvMutex, portMAX_DELAY);
+  int32_t slot = prvFindSlot(pName);
+  if (slot >= 0)
+    memcpy(pEntry, &prvTable.slots[slot], sizeof(ASSET_TABLE_Entry));
+  xSemaphoreGive(prvMutex);
+
+  return (slot >= 0) ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief   Read part of an asset
+ * @param   pEntry: The asset from ASSET_TABLE_Find
+ * @param   Offset: Where to start in the asset
+ * @param   pBuffer: Where to put the data
+ * @param   NumByteToRead: Number of bytes
+ * @retval  SUCCESS or ERROR if it's outside the asset
+ */
+ErrorStatus ASSET_TABLE_Read(const ASSET_TABLE_Entry* pEntry, uint32_t Offset, uint8_t* pBuffer, uint32_t NumByteToRead)
+{
+  if (Offset > pEntry->size || NumByteToRead > pEntry->size - Offset)
+    return ERROR;
+  return SPI_FLASH_ReadBuffer(pBuffer, pEntry->address + Offset, NumByteToRead);
+}
+
+/**
+ * @brief   Copy all entries, in slot order
+ * @param   pEntries: Where to put them
+ * @param   MaxNumOfEntries: Room in pEntries
+ * @retval  The number of entries copied
+ */
+uint32_t ASSET_TABLE_GetEntries(ASSET_TABLE_Entry* pEntries, uint32_t MaxNumOfEntries)
+{
+  uint32_t count = 0;
+  if (!prvInitialized)
+    return 0;
+
+  xSemaphoreTake(prvMutex, portMAX_DELAY);
+  for (uint32_t i = 0; i < ASSET_TABLE_NUM_OF_SLOTS && count < MaxNumOfEntries; i++)
+  {
+    if (prvTable.slots[i].used)
+      memcpy(&pEntries[count++], &prvTable.slots[i], sizeof(ASSET_TABLE_Entry));
+  }
+  xSemaphoreGive(prvMutex);
+  return count;
+}
+
+/**
+ * @brief   Find room for an asset, the lowest sector aligned gap between the
+ *          assets in the table that is large enough. An asset that replaces
+ *          one with the same name gets new room, the old one is used until
+ *          the new one has been added.
+ * @param   Size: Size of the asset
+ * @param   pAddress: Set to the address of the room
+ * @retval  SUCCESS or ERROR if it doesn't fit
+ */
+ErrorStatus ASSET_TABLE_Allocate(uint32_t Size, uint32_t* pAddress)
+{
+  if (!prvInitialized || Size == 0)
+    return ERROR;
+
+  xSemaphoreTake(prvMutex, portMAX_DELAY);
+  uint32_t candidate = ASSET_TABLE_FIRST_ASSET;
+  bool moved = true;
+  /* Move past every asset that overlaps until nothing does, the number of
+   * assets is small so this is fast enough */
+  while (moved && candidate + Size <= ASSET_TABLE_FLASH_SIZE)
+  {
+    moved = false;
+    for (uint32_t i = 0; i < ASSET_TABLE_NUM_OF_SLOTS; i++)
+    {
+      ASSET_TABLE_Entry* pSlot = &prvTable.slots[i];
+      if (pSlot->used &&
+          pSlot->address < candidate + Size &&
+          candidate < pSlot->address + pSlot->size)
+      {
+        uint32_t end = pSlot->address + pSlot->size;
+        candidate = (end + ASSET_TABLE_SECTOR_SIZE - 1) & ~(ASSET_TABLE_SECTOR_SIZE - 1);
+        moved = true;
+      }
+    }
+  }
+  xSemaphoreGive(prvMutex);
+
+  if (candidate + Size > ASSET_TABLE_FLASH_SIZE || candidate + Size < candidate)
+    return ERROR;
+  *pAddress = candidate;
+  return SUCCESS;
+}
+
+/**
+ * @brief   Add an asset that has been written to the SPI FLASH and save the
+ *          table, an asset with the same name is replaced
+ * @param   pEntry: The asset
+ * @retval  SUCCESS or ERROR if the name is invalid, the table is full or it
+ *          could not be saved
+ */
+ErrorStatus ASSET_TABLE_Add(const ASSET_TABLE_Entry* pEntry)
+{
+  if (!prvInitialized || !prvValidName(pEntry->name))
+    return ERROR;
+
+  xSemaphoreTake(prvMutex, portMAX_DELAY);
+  int32_t slot = prvFindSlot(pEntry->name);
+  if (slot < 0 && prvNumOfAssets >= ASSET_TABLE_MAX_ASSETS)
+  {
+    xSemaphoreGive(prvMutex);
+    return ERROR;
+  }
+
+  ASSET_TABLE_Entry entry;
+  memcpy(&entry, pEntry, sizeof(entry));
+  /* Fill the rest of the name with 0 so the table is the same every time */
+  size_t length = strlen(entry.name);
+  memset(&entry.name[length], 0, ASSET_TABLE_NAME_LENGTH - length);
+  entry.used = 1;
+  entry.reserved[0] = entry.reserved[1] = 0;
+
+  if (slot >= 0)
+    memcpy(&prvTable.slots[slot], &entry, sizeof(entry));
+  else
+  {
+    prvInsert(prvTable.slots, &entry);
+    prvNumOfAssets++;
+  }
+  ErrorStatus status = prvWriteTable();
+  xSemaphoreGive(prvMutex);
+  return status;
+}
+
+/**
+ * @brief   Remove an asset and save the table, the data is left in the FLASH
+ *          until the room is allocated again
+ * @param   pName: The name
+ * @retval  SUCCESS or ERROR if there is no asset with the name or the table
+ *          could not be saved
+ */
+ErrorStatus ASSET_TABLE_Remove(const char* pName)
+{
+  if (!prvInitialized || !prvValidName(pName))
+    return ERROR;
+
+  xSemaphoreTake(prvMutex, portMAX_DELAY);
+  int32_t slot = prvFindSlot(pName);
+  if (slot < 0)
+  {
+    xSemaphoreGive(prvMutex);
+    return ERROR;
+  }
+  memset(&prvTable.slots[slot], 0, sizeof(ASSET_TABLE_Entry));
+  prvNumOfAssets--;
+  /* An empty slot in the middle would end the probe for the ones after it */
+  prvRehash();
+  ErrorStatus status = prvWriteTable();
+  xSemaphoreGive(prvMutex);
+  return status;
+}
+
+/**
+ * @brief   Check that a range of the SPI FLASH is not used by the table or an
+ *          asset, so it can be written or erased without breaking them
+ * @param   Address: Start of the range
+ * @param   Size: Size of the range
+ * @retval  true if it's free
+ */
+bool ASSET_TABLE_RangeIsFree(uint32_t Address, uint32_t Size)
+{
+  if (!prvInitialized || Address < ASSET_TABLE_FIRST_ASSET ||
+      Address > ASSET_TABLE_FLASH_SIZE || Size > ASSET_TABLE_FLASH_SIZE - Address)
+    return false;
+
+  bool free = true;
+  xSemaphoreTake(prvMutex, portMAX_DELAY);
+  for (uint32_t i = 0; i < ASSET_TABLE_NUM_OF_SLOTS && free; i++)
+  {
+    ASSET_TABLE_Entry* pSlot = &prvTable.slots[i];
+    if (pSlot->used &&
+        pSlot->address < Address + Size &&
+        Address < pSlot->address + pSlot->size)
+      free = false;
+  }
+  xSemaphoreGive(prvMutex);
+  return free;
+}
+
+/**
+ * @brief   Empty the table after the whole SPI FLASH has been erased, it is
+ *          saved with the next change
+ * @param   None
+ * @retval  SUCCESS or ERROR if the table has not been loaded
+ */
+ErrorStatus ASSET_TABLE_Reset()
+{
+  if (!prvInitialized)
+    return ERROR;
+
+  xSemaphoreTake(prvMutex, portMAX_DELAY);
+  memset(prvTable.slots, 0, sizeof(prvTable.slots));
+  prvNumOfAssets = 0;
+  xSemaphoreGive(prvMutex);
+  return SUCCESS;
+}
+
+/** Private functions .-------------------------------------------------------*/
+/**
+ * @brief   Read a table from the SPI FLASH and check it
+ * @param   Address: Address of the table sector
+ * @param   pTable: Where to put it
+ * @retval  true if it is a valid table
+ */
+static bool prvReadTable(uint32_t Address, ASSET_TABLE_Table* pTable)
+{
+  if (SPI_FLASH_ReadBuffer((uint8_t*)pTable, Address, sizeof(ASSET_TABLE_Table)) != SUCCESS)
+    return false;
+  return (pTable->header.magic == ASSET_TABLE_MAGIC &&
+          pTable->header.crc == CRC32_Calculate((uint8_t*)pTable->slots, sizeof(pTable->slots)));
+}
+
+/**
+ * @brief   Write the table in RAM to the other table sector, the current one
+ *          is left as it is
+ * @param   None
+ * @retval  SUCCESS or ERROR if the SPI FLASH failed
+ */
+static ErrorStatus prvWriteTable()
+{
+  uint32_t address = (prvTableAddress == ASSET_TABLE_ADDRESS_0) ? ASSET_TABLE_ADDRESS_1 : ASSET_TABLE_ADDRESS_0;
+
+  prvTable.header.magic = ASSET_TABLE_MAGIC;
+  prvTable.header.sequence++;
+  prvTable.header.crc = CRC32_Calculate((uint8_t*)prvTable.slots, sizeof(prvTable.slots));
+  prvTable.header.reserved = 0;
+
+  if (SPI_FLASH_EraseSector(address) != SUCCESS ||
+      SPI_FLASH_WriteBuffer((uint8_t*)&prvTable, address, sizeof(prvTable)) != SUCCESS)
+    return ERROR;
+  prvTableAddress = address;
+  return SUCCESS;
+}
+
+/**
+ * @brief   Find the slot of an asset
+ * @param   pName: The name
+ * @retval  The slot or -1 if it's not in the table
+ */
+static int32_t prvFindSlot(const char* pName)
+{
+  uint32_t slot = prvHash(pName);
+  for (uint32_t i = 0; i < ASSET_TABLE_NUM_OF_SLOTS; i++)
+  {
+    ASSET_TABLE_Entry* pSlot = &prvTable.slots[slot];
+    if (!pSlot->used)
+      return -1;
+    if (strncmp(pSlot->name, pName, ASSET_TABLE_NAME_LENGTH) == 0)
+      return slot;
+    slot = (slot + 1) % ASSET_TABLE_NUM_OF_SLOTS;
+  }
+  return -1;
+}
+
+/**
+ * @brief   Put an entry in the first free slot from its hash
+ * @param   pSlots: The slots
+ * @param   pEntry: The entry, must not be in the table already
+ * @retval  None
+ */
+static void prvInsert(ASSET_TABLE_Entry* pSlots, const ASSET_TABLE_Entry* pEntry)
+{
+  uint32_t slot = prvHash(pEntry->name);
+  while (pSlots[slot].used)
+    slot = (slot + 1) % ASSET_TABLE_NUM_OF_SLOTS;
+  memcpy(&pSlots[slot], pEntry, sizeof(ASSET_TABLE_Entry));
+}
+
+/**
+ * @brief   Insert all entries again after one has been removed
+ * @param   None
+ * @retval  None
+ */
+static void prvRehash()
+{
+  static ASSET_TABLE_Entry slots[ASSET_TABLE_NUM_OF_SLOTS];
+  memset(slots, 0, sizeof(slots));
+  for (uint32_t i = 0; i < ASSET_TABLE_NUM_OF_SLOTS; i++)
+  {
+    if (prvTable.slots[i].used)
+      prvInsert(slots, &prvTable.slots[i]);
+  }
+  memcpy(prvTable.slots, slots, sizeof(slots));
+}
+
+/**
+ * @brief   FNV-1a hash of a name, gives the first slot to try
+ * @param   pName: The name
+ * @retval  The slot
+ */
+static uint32_t prvHash(const char* pName)
+{
+  uint32_t hash = 2166136261UL;
+  for (uint32_t i = 0; i < ASSET_TABLE_NAME_LENGTH && pName[i] != '\0'; i++)
+  {
+    hash ^= (uint8_t)pName[i];
+    hash *= 16777619UL;
+  }
+  return hash % ASSET_TABLE_NUM_OF_SLOTS;
+}
+
+/**
+ * @brief   Check that a name is not empty and fits with its terminating 0
+ * @param   pName: The name
+ * @retval  true if it's valid
+ */
+static bool prvValidName(const char* pName)
+{
+  const char* pEnd = memchr(pName, '\0', ASSET_TABLE_NAME_LENGTH);
+  return (pEnd != NULL && pEnd != pName);
+}
+
+/** Interrupt Handlers -------------------------------------------------------*/
@@ -0,0 +1,94 @@
+/**
+ *******************************************************************************
+ * @file    crc32.c
+ * @author  Hampus Sandberg
+ * @version 0.1
+ * @date    2016-10-19
+ * @brief   CRC32 that is the same as zlib and binascii.crc32 in the host tools.
+ *          The CRC unit in the STM32 uses another bit order so it is done
+ *          in software.
+ *******************************************************************************
+  Copyright (c) 2016 Hampus Sandberg.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************
+ */
+
+/** Includes -----------------------------------------------------------------*/
+#include "crc32.h"
+
+#include <stdbool.h>
+
+/** Private defines ----------------------------------------------------------*/
+#define CRC32_POLYNOMIAL      (0xEDB88320)
+
+/** Private typedefs ---------------------------------------------------------*/
+/** Private variables --------------------------------------------------------*/
+/* One entry per byte value, built the first time it's needed */
+static uint32_t prvTable[256];
+static bool prvTableBuilt = false;
+
+/** Private function prototypes ----------------------------------------------*/
+static void prvBuildTable();
+
+/** Functions ----------------------------------------------------------------*/
+/**
+ * @brief   Calculate the CRC32 of a buffer
+ * @param   pData: The data
+ * @param   DataCount: Number of bytes
+ * @retval  The CRC32
+ */
+uint32_t CRC32_Calculate(const uint8_t* pData, uint32_t DataCount)
+{
+  return ~CRC32_Update(CRC32_INITIAL_VALUE, pData, DataCount);
+}
+
+/**
+ * @brief   Add data to a CRC32 that is calculated in parts
+ * @param   Crc: The CRC so far, start with CRC32_INITIAL_VALUE and invert the
+ *          result
+ * @param   pData: The data
+ * @param   DataCount: Number of bytes
+ * @retval  The CRC so far
+ */
+uint32_t CRC32_Update(uint32_t Crc, const uint8_t* pData, uint32_t DataCount)
+{
+  if (!prvTableBuilt)
+    prvBuildTable();
+
+  while (DataCount--)
+    Crc = (Crc >> 8) ^ prvTable[(Crc ^ *pData++) & 0xFF];
+  return Crc;
+}
+
+/** Private functions .-------------------------------------------------------*/
+/**
+ * @brief   Build the byte table, it is the same every time so two tasks
+ *          building it at once is not a problem
+ * @param   None
+ * @retval  None
+ */
+static void prvBuildTable()
+{
+  for (uint32_t i = 0; i < 256; i++)
+  {
+    uint32_t crc = i;
+    for (uint32_t bit = 0; bit < 8; bit++)
+      crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLYNOMIAL : (crc >> 1);
+    prvTable[i] = crc;
+  }
+  prvTableBuilt = true;
+}
+
+/** Interrupt Handlers -------------------------------------------------------*/
@@ -26,6 +26,8 @@
 /** Includes -----------------------------------------------------------------*/
 #include "spi_comm.h"
 
+#include <string.h>
+
 /** Private defines ----------------------------------------------------------*/
 #define COMM_SPI               (SPI5)
 #define COMM_SPI_CLK_ENABLE()  __SPI5_CLK_ENABLE()
@@ -64,6 +66,7 @@ static bool prvInitialized = false;
 /** Private function prototypes ----------------------------------------------*/
 static inline void prvSPI_COMM_CS_LOW();
 static inline void prvSPI_COMM_CS_HIGH();
+static uint8_t prvSPI_COMM_ChannelMask(SPI_COMM_Channel Channel);
 
 /** Functions ----------------------------------------------------------------*/
 /**
@@ -475,6 +478,460 @@ void SPI_COMM_DisableTerminationForChannel(SPI_COMM_Channel Channel)
   }
 }
 
+/**
+ * @brief   Write to the decoder registers of a channel. The address is
+ *          incremented by the FPGA after each byte.
+ * @param   Channel: The channel to use
+ * @param   Address: Address of the first register
+ * @param   pData: Data to write
+ * @param   DataCount: Number of registers to write, max 16
+ * @retval  None
+ */
+void SPI_COMM_WriteRegistersForChannel(SPI_COMM_Channel Channel, uint8_t Address, uint8_t* pData, uint32_t DataCount)
+{
+  uint8_t mask = prvSPI_COMM_ChannelMask(Channel);
+  if (mask != 0 && DataCount != 0 && DataCount <= 16)
+  {
+    uint8_t data[18];
+    data[0] = mask;
+    data[1] = Address;
+    memcpy(&data[2], pData, DataCount);
+    SPI_COMM_SendCommand(SPI_COMM_COMMAND_CHANNEL_REGISTER_WRITE, data, DataCount + 2);
+  }
+}
+
+/**
+ * @brief   Configure and enable the UART decoder for a channel
+ * @param   Channel: The channel to use
+ * @param   BaudRate: The baud rate to use
+ * @param   Parity: The parity to use
+ * @param   TwoStopBits: true for two stop bits, false for one
+ * @param   Timestamps: true to get a timestamp header before every byte
+ * @retval  SUCCESS: The baud rate could be set
+ * @retval  ERROR: The baud rate is out of range or the channel is invalid
+ */
+ErrorStatus SPI_COMM_SetUartConfigForChannel(SPI_COMM_Channel Channel, uint32_t BaudRate, SPI_COMM_UartParity Parity, bool TwoStopBits, bool Timestamps)
+{
+  if (prvSPI_COMM_ChannelMask(Channel) == 0 || BaudRate == 0)
+    return ERROR;
+
+  /* Number of FPGA clock cycles per bit, rounded to the nearest */
+  uint32_t divisor = (SPI_COMM_FPGA_CLOCK_FREQUENCY + BaudRate/2) / BaudRate;
+  if (divisor < 16 || divisor > 0xFFFF)
+    return ERROR;
+
+  uint8_t data[3];
+  /* The divisor is applied when the low byte is written */
+  data[0] = (divisor >> 8) & 0xFF;
+  data[1] = divisor & 0xFF;
+  SPI_COMM_WriteRegistersForChannel(Channel, SPI_COMM_UART_REGISTER_DIVISOR_HIGH, data, 2);
+
+  data[0] = SPI_COMM_UART_CONTROL_ENABLE | SPI_COMM_UART_CONTROL_CLEAR_STATUS | Parity;
+  if (TwoStopBits)
+    data[0] |= SPI_COMM_UART_CONTROL_TWO_STOP_BITS;
+  if (Timestamps)
+    data[0] |= SPI_COMM_UART_CONTROL_TIMESTAMP;
+  SPI_COMM_WriteRegistersForChannel(Channel, SPI_COMM_UART_REGISTER_CONTROL, data, 1);
+
+  return SUCCESS;
+}
+
+/**
+ * @brief   Disable the UART decoder for a channel
+ * @param   Channel: The channel to use
+ * @retval  None
+ */
+void SPI_COMM_DisableUartForChannel(SPI_COMM_Channel Channel)
+{
+  uint8_t data = SPI_COMM_UART_CONTROL_CLEAR_STATUS;
+  SPI_COMM_WriteRegistersForChannel(Channel, SPI_COMM_UART_REGISTER_CONTROL, &data, 1);
+}
+
+/**
+ * @brief   Configure and enable the UART replay for a channel. The record
+ *          buffer is emptied so the next record written is the first one.
+ * @param   Channel: The channel to use
+ * @param   BaudRate: The baud rate to use
+ * @param   Parity: The parity to use
+ * @param   TwoStopBits: true for two stop bits, false for one
+ * @param   Speed: Replay speed in 8.8 fixed point, SPI_COMM_REPLAY_SPEED_ORIGINAL
+ *          keeps the captured timing, 0 pauses the replay
+ * @retval  SUCCESS: The baud rate could be set
+ * @retval  ERROR: The baud rate is out of range or the channel is invalid
+ */
+ErrorStatus SPI_COMM_SetUartReplayForChannel(SPI_COMM_Channel Channel, uint32_t BaudRate, SPI_COMM_UartParity Parity, bool TwoStopBits, uint16_t Speed)
+{
+  if (prvSPI_COMM_ChannelMask(Channel) == 0 || BaudRate == 0)
+    return ERROR;
+
+  uint32_t divisor = (SPI_COMM_FPGA_CLOCK_FREQUENCY + BaudRate/2) / BaudRate;
+  if (divisor < 16 || divisor > 0xFFFF)
+    return ERROR;
+
+  /* Disable first to empty the buffer and restart the replay clock */
+  uint8_t data[5];
+  data[0] = SPI_COMM_REPLAY_CONTROL_CLEAR_STATUS;
+  SPI_COMM_WriteRegistersForChannel(Channel, SPI_COMM_REPLAY_REGISTER_CONTROL, data, 1);
+
+  /* The divisor and the speed are applied when their low bytes are written */
+  data[0] = (divisor >> 8) & 0xFF;
+  data[1] = divisor & 0xFF;
+  data[2] = (Speed >> 8) & 0xFF;
+  data[3] = Speed & 0xFF;
+  SPI_COMM_WriteRegistersForChannel(Channel, SPI_COMM_REPLAY_REGISTER_DIVISOR_HIGH, data, 4);
+
+  data[0] = SPI_COMM_REPLAY_CONTROL_ENABLE | SPI_COMM_REPLAY_CONTROL_CLEAR_STATUS | Parity;
+  if (TwoStopBits)
+    data[0] |= SPI_COMM_REPLAY_CONTROL_TWO_STOP_BITS;
+  SPI_COMM_WriteRegistersForChannel(Channel, SPI_COMM_REPLAY_REGISTER_CONTROL, data, 1);
+
+  return SUCCESS;
+}
+
+/**
+ * @brief   Write captured records to the UART replay buffer of a channel.
+ *          The records are in the same format as they were read from the
+ *          channel FIFO with timestamps enabled, so a capture can be
+ *          streamed straight from SPI FLASH or SDRAM. Only as many whole
+ *          chunks as there is room for are written, call it again with the
+ *          rest when the replay has made room.
+ * @param   Channel: The channel to use
+ * @param   pData: The records
+ * @param   DataCount: Number of bytes
+ * @retval  Number of bytes written
+ */
+uint32_t SPI_COMM_WriteUartReplayDataForChannel(SPI_COMM_Channel Channel, uint8_t* pData, uint32_t DataCount)
+{
+  uint8_t mask = prvSPI_COMM_ChannelMask(Channel);
+  if (mask == 0)
+    return 0;
+
+  uint32_t written = 0;
+  uint8_t data[SPI_COMM_REPLAY_CHUNK_SIZE + 2];
+  data[0] = mask;
+  data[1] = SPI_COMM_REPLAY_REGISTER_DATA;
+  while (written < DataCount)
+  {
+    uint8_t status = 0;
+    if (SPI_COMM_GetStatusForChannel(Channel, &status) != SUCCESS ||
+        (status & SPI_COMM_REPLAY_STATUS_ROOM) == 0)
+      break;
+
+    /* The address stays within the data registers for a whole chunk */
+    uint32_t count = DataCount - written;
+    if (count > SPI_COMM_REPLAY_CHUNK_SIZE)
+      count = SPI_COMM_REPLAY_CHUNK_SIZE;
+    memcpy(&data[2], &pData[written], count);
+    SPI_COMM_SendCommand(SPI_COMM_COMMAND_CHANNEL_REGISTER_WRITE, data, count + 2);
+    written += count;
+  }
+
+  return written;
+}
+
+/**
+ * @brief   Stop the UART replay for a channel and empty its buffer
+ * @param   Channel: The channel to use
+ * @retval  None
+ */
+void SPI_COMM_DisableUartReplayForChannel(SPI_COMM_Channel Channel)
+{
+  uint8_t data = SPI_COMM_REPLAY_CONTROL_CLEAR_STATUS;
+  SPI_COMM_WriteRegistersForChannel(Channel, SPI_COMM_REPLAY_REGISTER_CONTROL, &data, 1);
+}
+
+/**
+ * @brief   Configure and enable the CAN decoder for a channel
+ * @param   Channel: The channel to use
+ * @param   BitRate: The bit rate to use
+ * @param   SamplePointPercent: Sample point in percent of the bit time
+ * @param   Timestamps: true to get a timestamp header before every record
+ * @retval  SUCCESS: The bit rate could be set
+ * @retval  ERROR: The bit rate is out of range or the channel is invalid
+ */
+ErrorStatus SPI_COMM_SetCanConfigForChannel(SPI_COMM_Channel Channel, uint32_t BitRate, uint8_t SamplePointPercent, bool Timestamps)
+{
+  if (prvSPI_COMM_ChannelMask(Channel) == 0 || BitRate == 0 || SamplePointPercent >= 100)
+    return ERROR;
+
+  /* Number of FPGA clock cycles per bit, rounded to the nearest */
+  uint32_t bitTime = (SPI_COMM_FPGA_CLOCK_FREQUENCY + BitRate/2) / BitRate;
+  if (bitTime < 20 || bitTime > 0xFFFF)
+    return ERROR;
+  uint32_t samplePoint = (bitTime * SamplePointPercent) / 100;
+  /* Allow resynchronization of up to 10 % of the bit time */
+  uint32_t sjw = bitTime / 10;
+  if (sjw > 0xFF)
+    sjw = 0xFF;
+
+  uint8_t data[5];
+  /* The 16-bit values are applied when the low byte is written */
+  data[0] = (bitTime >> 8) & 0xFF;
+  data[1] = bitTime & 0xFF;
+  data[2] = (samplePoint >> 8) & 0xFF;
+  data[3] = samplePoint & 0xFF;
+  data[4] = sjw;
+  SPI_COMM_WriteRegistersForChannel(Channel, SPI_COMM_CAN_REGISTER_BIT_TIME_HIGH, data, 5);
+
+  data[0] = SPI_COMM_CAN_CONTROL_ENABLE | SPI_COMM_CAN_CONTROL_CLEAR_STATUS;
+  if (Timestamps)
+    data[0] |= SPI_COMM_CAN_CONTROL_TIMESTAMP;
+  SPI_COMM_WriteRegistersForChannel(Channel, SPI_COMM_CAN_REGISTER_CONTROL, data, 1);
+
+  return SUCCESS;
+}
+
+/**
+ * @brief   Disable the CAN decoder for a channel
+ * @param   Channel: The channel to use
+ * @retval  None
+ */
+void SPI_COMM_DisableCanForChannel(SPI_COMM_Channel Channel)
+{
+  uint8_t data = SPI_COMM_CAN_CONTROL_CLEAR_STATUS;
+  SPI_COMM_WriteRegistersForChannel(Channel, SPI_COMM_CAN_REGISTER_CONTROL, &data, 1);
+}
+
+/**
+ * @brief   Parse a timestamp header read from a channel FIFO and update the
+ *          running timestamp for the channel. The timestamp is not valid until
+ *          the first full timestamp has been seen, which the FPGA sends after
+ *          the channel has been configured and then regularly.
+ * @param   pData: The data read from the FIFO
+ * @param   DataCount: Number of bytes in pData
+ * @param   pTimestamp: The running timestamp for the channel
+ * @retval  Number of bytes used by the header, 0 if pData does not hold a complete header
+ */
+uint32_t SPI_COMM_ParseTimestamp(uint8_t* pData, uint32_t DataCount, SPI_COMM_Timestamp* pTimestamp)
+{
+  if (DataCount == 0)
+    return 0;
+
+  uint32_t delta;
+  switch (pData[0] & SPI_COMM_TIMESTAMP_TYPE_MASK)
+  {
+    case SPI_COMM_TIMESTAMP_TYPE_DELTA_1:
+      delta = pData[0] & 0x3F;
+      pTimestamp->ticks += delta;
+      return 1;
+
+    case SPI_COMM_TIMESTAMP_TYPE_DELTA_2:
+      if (DataCount < 2)
+        return 0;
+      delta = ((pData[0] & 0x3F) << 8) | pData[1];
+      pTimestamp->ticks += delta;
+      return 2;
+
+    case SPI_COMM_TIMESTAMP_TYPE_DELTA_3:
+      if (DataCount < 3)
+        return 0;
+      delta = ((pData[0] & 0x3F) << 16) | (pData[1] << 8) | pData[2];
+      pTimestamp->ticks += delta;
+      return 3;
+
+    default:
+    {
+      if (DataCount < SPI_COMM_TIMESTAMP_FULL_SIZE)
+        return 0;
+      uint64_t full = ((uint64_t)pData[1] << 32) | ((uint64_t)pData[2] << 24) |
+                      ((uint64_t)pData[3] << 16) | ((uint64_t)pData[4] << 8) | pData[5];
+      /* The FPGA counter is 40 bits, keep counting past the wrap */
+      uint64_t ticks = (pTimestamp->ticks & ~0xFFFFFFFFFFULL) | full;
+      if (pTimestamp->valid && ticks < pTimestamp->ticks)
+        ticks += 0x10000000000ULL;
+      pTimestamp->ticks = ticks;
+      pTimestamp->valid = true;
+      return SPI_COMM_TIMESTAMP_FULL_SIZE;
+    }
+  }
+}
+
+/**
+ * @brief   Convert a timestamp to nanoseconds since the FPGA was started
+ * @param   pTimestamp: The timestamp to convert
+ * @retval  The time in nanoseconds
+ */
+uint64_t SPI_COMM_TimestampToNanoseconds(SPI_COMM_Timestamp* pTimestamp)
+{
+  return pTimestamp->ticks * SPI_COMM_TIMESTAMP_NS_PER_TICK;
+}
+
+/**
+ * @brief   Parse a CAN frame record read from a channel FIFO
+ * @param   pData: The data read from the FIFO
+ * @param   DataCount: Number of bytes in pData
+ * @param   pFrame: Where the frame should be stored
+ * @retval  Number of bytes used by the record, 0 if pData does not hold a complete record
+ */
+uint32_t SPI_COMM_ParseCanRecord(uint8_t* pData, uint32_t DataCount, SPI_COMM_CanFrame* pFrame)
+{
+  if (DataCount < SPI_COMM_CAN_RECORD_HEADER_SIZE)
+    return 0;
+
+  uint8_t dataCount = pData[1] >> 4;
+  if (dataCount > 8 || DataCount < SPI_COMM_CAN_RECORD_HEADER_SIZE + dataCount)
+    return 0;
+
+  pFrame->flags = pData[0];
+  pFrame->dlc = pData[1] & 0x0F;
+  pFrame->dataCount = dataCount;
+  pFrame->id = (pData[2] << 24) | (pData[3] << 16) | (pData[4] << 8) | pData[5];
+  memcpy(pFrame->data, &pData[SPI_COMM_CAN_RECORD_HEADER_SIZE], dataCount);
+
+  return SPI_COMM_CAN_RECORD_HEADER_SIZE + dataCount;
+}
+
+/**
+ * @brief   Get the decoder status for a channel
+ * @param   Channel: The channel to use, 1-6
+ * @param   pStatus: Pointer to where the status should be stored
+ * @retval  SUCCESS or ERROR
+ */
+ErrorStatus SPI_COMM_GetStatusForChannel(SPI_COMM_Channel Channel, uint8_t* pStatus)
+{
+  if (Channel > 0 && Channel <= 6)
+  {
+    uint8_t dataToSend[3] = {1 << (Channel-1), 0x00, 0x00};
+    uint8_t dataReceived[3] = {0};
+    SPI_COMM_SendGetCommand(SPI_COMM_COMMAND_CHANNEL_STATUS, dataToSend, dataReceived, 3);
+    *pStatus = dataReceived[2];
+    return SUCCESS;
+  }
+  else
+    return ERROR;
+}
+
+/**
+ * @brief   Get the number of bytes waiting in the FIFO for a channel
+ * @param   Channel: The channel to use, 1-6
+ * @param   pLevel: Pointer to where the level should be stored, saturated at 255
+ * @retval  SUCCESS or ERROR
+ */
+ErrorStatus SPI_COMM_GetFifoLevelForChannel(SPI_COMM_Channel Channel, uint8_t* pLevel)
+{
+  if (Channel > 0 && Channel <= 6)
+  {
+    uint8_t dataToSend[3] = {1 << (Channel-1), 0x00, 0x00};
+    uint8_t dataReceived[3] = {0};
+    SPI_COMM_SendGetCommand(SPI_COMM_COMMAND_CHANNEL_FIFO_LEVEL, dataToSend, dataReceived, 3);
+    *pLevel = dataReceived[2];
+    return SUCCESS;
+  }
+  else
+    return ERROR;
+}
+
+/**
+ * @brief   Read the bytes waiting in the FIFO for a channel
+ * @param   Channel: The channel to use, 1-6
+ * @param   pBuffer: Buffer to store the bytes in
+ * @param   BufferSize: Size of the buffer
+ * @retval  Number of bytes read
+ */
+uint32_t SPI_COMM_ReadFifoForChannel(SPI_COMM_Channel Channel, uint8_t* pBuffer, uint32_t BufferSize)
+{
+  uint8_t level = 0;
+  if (SPI_COMM_GetFifoLevelForChannel(Channel, &level) != SUCCESS || level == 0)
+    return 0;
+
+  uint32_t count = level;
+  if (count > BufferSize)
+    count = BufferSize;
+
+  /* Channel, count and one byte of latency before the FIFO data */
+  uint8_t dataToSend[SPI_COMM_FIFO_READ_MAX_COUNT + 3] = {0};
+  uint8_t dataReceived[SPI_COMM_FIFO_READ_MAX_COUNT + 3];
+  dataToSend[0] = 1 << (Channel-1);
+  dataToSend[1] = count;
+  SPI_COMM_SendGetCommand(SPI_COMM_COMMAND_CHANNEL_FIFO_READ, dataToSend, dataReceived, count + 3);
+  memcpy(pBuffer, &dataReceived[3], count);
+
+  return count;
+}
+
+/**
+ * @brief   Start streaming ADC samples to the ADC FIFO
+ * @param   ChannelMask: Bit N set streams ADC channel N
+ * @param   Decimation: Keep one of every Decimation+1 conversion rounds
+ * @param   Timestamps: true to get a timestamp header before every sample
+ * @retval  None
+ */
+void SPI_COMM_SetAdcStream(uint8_t ChannelMask, uint8_t Decimation, bool Timestamps)
+{
+  uint8_t data[4];
+  data[0] = SPI_COMM_ADC_REGISTER_CHANNEL_MASK;
+  data[1] = ChannelMask;
+  data[2] = Decimation;
+  SPI_COMM_SendCommand(SPI_COMM_COMMAND_ADC_REGISTER_WRITE, data, 3);
+
+  data[0] = SPI_COMM_ADC_REGISTER_CONTROL;
+  data[1] = SPI_COMM_ADC_CONTROL_STREAM | SPI_COMM_ADC_CONTROL_CLEAR_STATUS;
+  if (Timestamps)
+    data[1] |= SPI_COMM_ADC_CONTROL_TIMESTAMP;
+  SPI_COMM_SendCommand(SPI_COMM_COMMAND_ADC_REGISTER_WRITE, data, 2);
+}
+
+/**
+ * @brief   Stop streaming ADC samples, the ADC keeps updating the channel values
+ * @param   None
+ * @retval  None
+ */
+void SPI_COMM_DisableAdcStream()
+{
+  uint8_t data[2] = {SPI_COMM_ADC_REGISTER_CONTROL, SPI_COMM_ADC_CONTROL_CLEAR_STATUS};
+  SPI_COMM_SendCommand(SPI_COMM_COMMAND_ADC_REGISTER_WRITE, data, 2);
+}
+
+/**
+ * @brief   Get the status of the ADC stream
+ * @param   None
+ * @retval  The status byte
+ */
+uint8_t SPI_COMM_GetAdcStatus()
+{
+  uint8_t dataToSend[3] = {0};
+  uint8_t dataReceived[3] = {0};
+  SPI_COMM_SendGetCommand(SPI_COMM_COMMAND_ADC_STATUS, dataToSend, dataReceived, 3);
+  return dataReceived[2];
+}
+
+/**
+ * @brief   Get the number of bytes waiting in the ADC FIFO
+ * @param   None
+ * @retval  The level, saturated at 255
+ */
+uint8_t SPI_COMM_GetAdcFifoLevel()
+{
+  uint8_t dataToSend[3] = {0};
+  uint8_t dataReceived[3] = {0};
+  SPI_COMM_SendGetCommand(SPI_COMM_COMMAND_ADC_FIFO_LEVEL, dataToSend, dataReceived, 3);
+  return dataReceived[2];
+}
+
+/**
+ * @brief   Read the bytes waiting in the ADC FIFO
+ * @param   pBuffer: Buffer to store the bytes in
+ * @param   BufferSize: Size of the buffer
+ * @retval  Number of bytes read
+ */
+uint32_t SPI_COMM_ReadAdcFifo(uint8_t* pBuffer, uint32_t BufferSize)
+{
+  uint32_t count = SPI_COMM_GetAdcFifoLevel();
+  if (count > BufferSize)
+    count = BufferSize;
+  if (count == 0)
+    return 0;
+
+  /* Same layout as the channel FIFO read but the first byte is unused */
+  uint8_t dataToSend[SPI_COMM_FIFO_READ_MAX_COUNT + 3] = {0};
+  uint8_t dataReceived[SPI_COMM_FIFO_READ_MAX_COUNT + 3];
+  dataToSend[1] = count;
+  SPI_COMM_SendGetCommand(SPI_COMM_COMMAND_ADC_FIFO_READ, dataToSend, dataReceived, count + 3);
+  memcpy(pBuffer, &dataReceived[3], count);
+
+  return count;
+}
+
 
 /** Private functions .-------------------------------------------------------*/
 /**
@@ -497,6 +954,21 @@ static inline void prvSPI_COMM_CS_HIGH()
   HAL_GPIO_WritePin(COMM_PORT, COMM_CS_PIN, GPIO_PIN_SET);
 }
 
+/**
+ * @brief   Get the channel mask used by the FPGA for a channel
+ * @param   Channel: The channel to use
+ * @retval  The mask, 0 if the channel is invalid
+ */
+static uint8_t prvSPI_COMM_ChannelMask(SPI_COMM_Channel Channel)
+{
+  if (Channel != 0 && Channel <= 6)
+    return 1 << (Channel-1);
+  else if (Channel == SPI_COMM_Channel_All)
+    return 0x3F;
+  else
+    return 0;
+}
+
 /** Interrupt Handlers -------------------------------------------------------*/
 /**
   * @brief  TxRx Transfer completed callback.
@@ -4,7 +4,14 @@
  * @author  Hampus Sandberg
  * @version 0.1
  * @date    2015-08-15
- * @brief   Driver for a S25FL116K0XMFI011 16Mbit SPI FLASH
+ * @brief   Driver for a S25FL116K0XMFI011 16Mbit SPI FLASH.
+ *
+ *          Reads, programs and erases are requests that are put in a list
+ *          sorted on priority and run one at a time by the driver task. The
+ *          data is moved with DMA and the task sleeps until the DMA is done,
+ *          the busy period of a program or an erase is polled by a timer. A
+ *          read can suspend a sector erase and run before it is done, large
+ *          reads and writes are split so other requests can get in between.
  *******************************************************************************
   Copyright (c) 2015 Hampus Sandberg.
 
@@ -25,6 +32,7 @@
 
 /** Includes -----------------------------------------------------------------*/
 #include "spi_flash.h"
+#include "timers.h"
 
 #include <string.h>
 
@@ -38,8 +46,15 @@
 #define FLASH_MISO_PIN          (GPIO_PIN_5)
 #define FLASH_MOSI_PIN          (GPIO_PIN_6)
 
+/* SPI4 RX is DMA2 stream 0 channel 4 and TX is DMA2 stream 1 channel 4 */
+#define FLASH_RX_DMA_STREAM     (DMA2_Stream0)
+#define FLASH_RX_DMA_IRQ        (DMA2_Stream0_IRQn)
+#define FLASH_TX_DMA_STREAM     (DMA2_Stream1)
+#define FLASH_DMA_CHANNEL       (DMA_CHANNEL_4)
+
 /** SPI FLASH Commands */
 #define SPI_FLASH_CMD_RDSR      (0x05)  /* Read Status Register */
+#define SPI_FLASH_CMD_RDSR2     (0x35)  /* Read Status Register 2 */
 #define SPI_FLASH_CMD_WRSR      (0x01)  /* Write Status Register */
 #define SPI_FLASH_CMD_EWSR      (0x50)  /* Write Enable Status */
 
@@ -50,20 +65,55 @@
 #define SPI_FLASH_CMD_SECTOR_ERASE  (0x20)  /* 4 KB Sector Erase instruction */
 #define SPI_FLASH_CMD_BLOCK_ERASE   (0xD8)  /* 64 KB Block Erase instruction */
 #define SPI_FLASH_CMD_CHIP_ERASE    (0xC7)  /* Chip Erase instruction */
+#define SPI_FLASH_CMD_SUSPEND   (0x75)  /* Erase / Program Suspend */
+#define SPI_FLASH_CMD_RESUME    (0x7A)  /* Erase / Program Resume */
 #define SPI_FLASH_CMD_RDID      (0x9F)  /* JEDEC ID Read */
 
 #define SPI_FLASH_DUMMY_BYTE    (0xFF)
 #define SPI_FLASH_WIP_FLAG      (0x01)  /* Write In Progress (WIP) flag */
+#define SPI_FLASH_SUS_FLAG      (0x80)  /* Suspend (SUS) flag in status register 2 */
 
 
 #define SPI_FLASH_S25FL116K0XMFI011_ID  (0x014015)  /* Device ID for the S25FL116K0XMFI011 */
 #define SPI_FLASH_SIZE_BYTES            (0x200000)  /* 16Mbit = 2MByte*/
 #define SPI_FLASH_LAST_ADDRESS          (SPI_FLASH_SIZE_BYTES-1)
 
-#define SPI_FLASH_SECTOR_CLEAN_CHECK_SIZE    (128)
-#define SPI_FLASH_PAGE_SIZE   (256)
+#define SPI_FLASH_PAGE_SIZE     (256)
+#define SPI_FLASH_SECTOR_SIZE   (4*1024)
+/* Reads are split in chunks this big so another read doesn't have to wait
+ * for all of a large one */
+#define SPI_FLASH_READ_CHUNK_SIZE (4*1024)
+
+/* A page program takes 0.7 ms and an erase 50 ms (sector) to 25 s (chip), the
+ * status is polled this often by the timer */
+#define SPI_FLASH_PROGRAM_POLL_TICKS  (1)
+#define SPI_FLASH_ERASE_POLL_TICKS    (2)
+/* An erase runs for at least this long between two suspends so it gets done
+ * even when there are reads all the time */
+#define SPI_FLASH_RESUME_TICKS        (2)
+/* Status reads before giving up on a suspend, it takes at most 20 us */
+#define SPI_FLASH_SUSPEND_POLLS       (100)
+
+#define SPI_FLASH_TIMEOUT             (10)
+#define SPI_FLASH_DMA_TIMEOUT_TICKS   (100)
+
+#define SPI_FLASH_TASK_PRIORITY       (tskIDLE_PRIORITY + 3)
+
+/* Task notification bits for the driver task */
+#define SPI_FLASH_EVENT_REQUEST       (1 << 0)
+#define SPI_FLASH_EVENT_DMA_DONE      (1 << 1)
+#define SPI_FLASH_EVENT_POLL          (1 << 2)
+#define SPI_FLASH_EVENT_ALL           (0xFFFFFFFF)
 
 /** Private typedefs ---------------------------------------------------------*/
+typedef enum
+{
+  SPI_FLASH_ChipState_Idle,
+  SPI_FLASH_ChipState_Program,
+  SPI_FLASH_ChipState_Erase,
+  SPI_FLASH_ChipState_EraseSuspended,
+} SPI_FLASH_ChipState;
+
 /** Private variables --------------------------------------------------------*/
 static SPI_HandleTypeDef SPI_Handle = {
   .Instance                 = FLASH_SPI,
@@ -79,36 +129,63 @@ static SPI_HandleTypeDef SPI_Handle = {
   .Init.CRCCalculation      = SPI_CRCCALCULATION_DISABLED,
   .Init.CRCPolynomial       = 1,
 };
+static DMA_HandleTypeDef prvRxDmaHandle;
+static DMA_HandleTypeDef prvTxDmaHandle;
 
 static uint32_t prvDeviceId = 0;
-static SemaphoreHandle_t xSemaphore;
 static bool prvInitialized = false;
+static TaskHandle_t prvTaskHandle = NULL;
+static TimerHandle_t prvPollTimer = NULL;
+
+/* Requests that are not done, highest priority first and in the order they
+ * were submitted for the same priority */
+static SPI_FLASH_Request* prvRequests = NULL;
+
+/* The program or erase going on in the chip */
+static SPI_FLASH_ChipState prvChipState = SPI_FLASH_ChipState_Idle;
+static SPI_FLASH_Request* prvChipRequest = NULL;
+static uint32_t prvChipCount = 0;
+static TickType_t prvEraseRunningSince = 0;
+
+/* Sent while reading and where the bytes received while writing go */
+static uint8_t prvDummyByte = SPI_FLASH_DUMMY_BYTE;
+static uint8_t prvDiscardByte;
 
 /** Private function prototypes ----------------------------------------------*/
 static inline void prvSPI_FLASH_CS_LOW();
 static inline void prvSPI_FLASH_CS_HIGH();
-static void prvSPI_FLASH_WriteByte(uint32_t WriteAddress, uint8_t Byte);
-static void prvSPI_FLASH_WriteBytes(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite);
-static void prvSPI_FLASH_WriteUpToOnePage(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite);
-static void prvSPI_FLASH_WriteDisable();
-static void prvSPI_FLASH_WriteEnable();
-static uint8_t prvSPI_FLASH_SendReceiveByte(uint8_t Byte);
-static void prvSPI_FLASH_WaitForWriteEnd();
+static void prvSpiFlashTask(void *pvParameters);
+static void prvPollTimerCallback(TimerHandle_t Timer);
+static ErrorStatus prvRunAndWait(SPI_FLASH_Operation Operation, SPI_FLASH_Priority Priority,
+                                 uint8_t* pBuffer, uint32_t Address, uint32_t Count);
+static SPI_FLASH_Request* prvNextRequest();
+static void prvRunRequests();
+static void prvRunStep(SPI_FLASH_Request* pRequest);
+static void prvComplete(SPI_FLASH_Request* pRequest, ErrorStatus Status);
+static void prvCheckChipDone();
+static void prvStartBusyPeriod(SPI_FLASH_ChipState State, SPI_FLASH_Request* pRequest, TickType_t PollTicks);
+static bool prvCanOvertake(SPI_FLASH_Request* pRequest);
+static void prvSuspendErase();
+static void prvResumeErase();
+static void prvSendCommand(uint8_t Command);
+static void prvSendHeader(uint8_t Command, uint32_t Address);
+static uint8_t prvReadStatus(uint8_t Command);
+static void prvTransfer(uint8_t* pTxData, uint8_t* pRxData, uint16_t Count);
+static ErrorStatus prvDmaTransfer(uint8_t* pTxData, bool TxIncrement, uint8_t* pRxData, bool RxIncrement, uint16_t Count);
+static void prvStartDmaStream(DMA_HandleTypeDef* pHandle, uint8_t* pMemory, bool Increment, uint16_t Count);
 
 /** Functions ----------------------------------------------------------------*/
 /**
- * @brief  Initializes the SPI FLASH
+ * @brief  Initializes the SPI FLASH and starts the driver task
  * @param  None
- * @retval  None
+ * @retval  SUCCESS: The FLASH was found
+ * @retval  ERROR: It was not found or is already initialized
  */
 ErrorStatus SPI_FLASH_Init()
 {
   /* Make sure we only initialize it once */
   if (!prvInitialized)
   {
-    /* Mutex semaphore for mutual exclusion to the SPI Flash device */
-    xSemaphore = xSemaphoreCreateMutex();
-
     /* Init GPIO */
     FLASH_GPIO_CLK_ENABLE();
     GPIO_InitTypeDef GPIO_InitStructure;
@@ -128,28 +205,69 @@ ErrorStatus SPI_FLASH_Init()
     /* Init SPI */
     FLASH_SPI_CLK_ENABLE();
     HAL_SPI_Init(&SPI_Handle);
+    __HAL_SPI_ENABLE(&SPI_Handle);
+
+    /* The streams are set up here and only the address, count and memory
+     * increment are changed for each transfer */
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    prvRxDmaHandle.Instance                 = FLASH_RX_DMA_STREAM;
+    prvRxDmaHandle.Init.Channel             = FLASH_DMA_CHANNEL;
+    prvRxDmaHandle.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+    prvRxDmaHandle.Init.PeriphInc           = DMA_PINC_DISABLE;
+    prvRxDmaHandle.Init.MemInc              = DMA_MINC_ENABLE;
+    prvRxDmaHandle.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    prvRxDmaHandle.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+    prvRxDmaHandle.Init.Mode                = DMA_NORMAL;
+    prvRxDmaHandle.Init.Priority            = DMA_PRIORITY_VERY_HIGH;
+    prvRxDmaHandle.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+    prvRxDmaHandle.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
+    prvRxDmaHandle.Init.MemBurst            = DMA_MBURST_SINGLE;
+    prvRxDmaHandle.Init.PeriphBurst         = DMA_PBURST_SINGLE;
+    if (HAL_DMA_Init(&prvRxDmaHandle) != HAL_OK)
+      return ERROR;
+    prvRxDmaHandle.Instance->PAR = (uint32_t)&FLASH_SPI->DR;
+    /* Everything sent has also been received when the RX stream is done, so
+     * only it has an interrupt */
+    __HAL_DMA_ENABLE_IT(&prvRxDmaHandle, DMA_IT_TC);
+
+    prvTxDmaHandle.Instance                 = FLASH_TX_DMA_STREAM;
+    prvTxDmaHandle.Init                     = prvRxDmaHandle.Init;
+    prvTxDmaHandle.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+    prvTxDmaHandle.Init.Priority            = DMA_PRIORITY_HIGH;
+    if (HAL_DMA_Init(&prvTxDmaHandle) != HAL_OK)
+      return ERROR;
+    prvTxDmaHandle.Instance->PAR = (uint32_t)&FLASH_SPI->DR;
 
-    /* Read FLASH identification */
-    prvDeviceId = SPI_FLASH_ReadID();
+    /* The interrupt uses the FreeRTOS API so it can't be above the max
+     * syscall priority */
+    HAL_NVIC_SetPriority(FLASH_RX_DMA_IRQ, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(FLASH_RX_DMA_IRQ);
+
+    /* Read FLASH identification, nothing else uses the SPI yet */
+    uint8_t data[4] = {SPI_FLASH_CMD_RDID, SPI_FLASH_DUMMY_BYTE, SPI_FLASH_DUMMY_BYTE, SPI_FLASH_DUMMY_BYTE};
+    prvSPI_FLASH_CS_LOW();
+    prvTransfer(data, data, 4);
+    prvSPI_FLASH_CS_HIGH();
+    prvDeviceId = (data[1] << 16) | (data[2] << 8) | data[3];
 
     if (prvDeviceId == SPI_FLASH_S25FL116K0XMFI011_ID)
     {
-      /* Select the FLASH */
-      prvSPI_FLASH_CS_LOW();
       /* Send "Write Enable Status" instruction */
-      prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_EWSR);
-      /* Deselect the FLASH */
-      prvSPI_FLASH_CS_HIGH();
+      prvSendCommand(SPI_FLASH_CMD_EWSR);
 
-      /* Select the FLASH */
-      prvSPI_FLASH_CS_LOW();
       /* Send "Write Status Register" instruction and set all bits to 0 */
-      prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_WRSR);
-      prvSPI_FLASH_SendReceiveByte(0x00);
-      prvSPI_FLASH_SendReceiveByte(0x00);
-      /* Deselect the FLASH */
+      uint8_t status[3] = {SPI_FLASH_CMD_WRSR, 0x00, 0x00};
+      prvSPI_FLASH_CS_LOW();
+      prvTransfer(status, status, 3);
       prvSPI_FLASH_CS_HIGH();
 
+      prvPollTimer = xTimerCreate("SpiFlashPoll", SPI_FLASH_ERASE_POLL_TICKS, pdTRUE, 0, prvPollTimerCallback);
+      if (prvPollTimer == NULL)
+        return ERROR;
+      if (xTaskCreate(prvSpiFlashTask, "SpiFlash", configMINIMAL_STACK_SIZE*2, NULL,
+                      SPI_FLASH_TASK_PRIORITY, &prvTaskHandle) != pdPASS)
+        return ERROR;
+
       prvInitialized = true;
 
       return SUCCESS;
@@ -159,578 +277,643 @@ ErrorStatus SPI_FLASH_Init()
 }
 
 /**
-  * @brief  Reads FLASH identification
+  * @brief  Get the FLASH identification read by SPI_FLASH_Init
   * @param  None
   * @retval FLASH identification
   */
 uint32_t SPI_FLASH_ReadID()
 {
-  uint8_t byte[3];
-
-  /* Try to take the semaphore in case some other process is using the device */
-  if (xSemaphoreTake(xSemaphore, 100) == pdTRUE)
-  {
-    /* Select the FLASH */
-    prvSPI_FLASH_CS_LOW();
-
-    /* Send "JEDEC ID Read" instruction */
-    prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_RDID);
-
-    /* Read three bytes from the FLASH */
-    byte[0] = prvSPI_FLASH_SendReceiveByte(SPI_FLASH_DUMMY_BYTE);
-    byte[1] = prvSPI_FLASH_SendReceiveByte(SPI_FLASH_DUMMY_BYTE);
-    byte[2] = prvSPI_FLASH_SendReceiveByte(SPI_FLASH_DUMMY_BYTE);
-
-    /* Deselect the FLASH */
-    prvSPI_FLASH_CS_HIGH();
-
-    /* Give back the semaphore */
-    xSemaphoreGive(xSemaphore);
-  }
-  return (byte[0] << 16) | (byte[1] << 8) | byte[2];
+  return prvDeviceId;
 }
 
 /**
-  * @brief  Write a buffer to the FLASH
-  * @note   Addresses to be written must be in the erased state
-  * @param  pBuff: pointer to the buffer with data to write
-  * @param  WriteAddress: start of FLASH's internal address to write to
-  * @param  NumByteToWrite: number of bytes to write to the FLASH
-  * @retval None
+  * @brief  Queue a request, the caller fills in the operation, priority,
+  *         buffer, address, count and task. It can't be changed until done is
+  *         set, the task is notified with xTaskNotifyGive then.
+  * @param  pRequest: The request
+  * @retval SUCCESS: The request was queued
+  * @retval ERROR: Invalid request or the FLASH is not initialized
   */
-void SPI_FLASH_WriteBuffer(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite)
+ErrorStatus SPI_FLASH_Submit(SPI_FLASH_Request* pRequest)
 {
+  if (!prvInitialized)
+    return ERROR;
+
   /* Check address */
-  if (WriteAddress <= SPI_FLASH_LAST_ADDRESS)
+  if (pRequest->operation == SPI_FLASH_Operation_Read ||
+      pRequest->operation == SPI_FLASH_Operation_Program)
   {
-    /* Try to take the semaphore in case some other process is using the device */
-    if (xSemaphoreTake(xSemaphore, 100) == pdTRUE)
-    {
-      prvSPI_FLASH_WriteBytes(pBuffer, WriteAddress, NumByteToWrite);
-
-      /* Give back the semaphore */
-      xSemaphoreGive(xSemaphore);
-    }
+    if (pRequest->count == 0 || pRequest->address > SPI_FLASH_LAST_ADDRESS ||
+        pRequest->count > SPI_FLASH_SIZE_BYTES - pRequest->address)
+      return ERROR;
   }
+  else if (pRequest->operation == SPI_FLASH_Operation_EraseSector)
+  {
+    if (pRequest->address > SPI_FLASH_LAST_ADDRESS)
+      return ERROR;
+  }
+  else if (pRequest->operation != SPI_FLASH_Operation_EraseChip)
+    return ERROR;
+
+  pRequest->done = false;
+  pRequest->status = ERROR;
+  pRequest->progress = 0;
+  pRequest->pNext = NULL;
+
+  /* After the last one with the same or a higher priority */
+  taskENTER_CRITICAL();
+  SPI_FLASH_Request** ppNext = &prvRequests;
+  while (*ppNext != NULL && (*ppNext)->priority >= pRequest->priority)
+    ppNext = &(*ppNext)->pNext;
+  pRequest->pNext = *ppNext;
+  *ppNext = pRequest;
+  taskEXIT_CRITICAL();
+
+  xTaskNotify(prvTaskHandle, SPI_FLASH_EVENT_REQUEST, eSetBits);
+  return SUCCESS;
 }
 
 /**
-  * @brief  Write a buffer to the FLASH
-  * @note   Addresses to be written must be in the erased state
-  * @param  pBuff: pointer to the buffer with data to write
-  * @param  WriteAddress: start of FLASH's internal address to write to
-  * @param  NumByteToWrite: number of bytes to write to the FLASH
-  * @retval None
+  * @brief  Wait for a request submitted by the calling task to be done
+  * @note   There is no timeout, the driver owns the request and may be
+  *         transferring to its buffer until it is done
+  * @param  pRequest: The request
+  * @retval SUCCESS: The request was done without errors
+  * @retval ERROR: It failed
   */
-void SPI_FLASH_WriteBufferFromISR(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite)
+ErrorStatus SPI_FLASH_WaitForRequest(SPI_FLASH_Request* pRequest)
 {
-  /* Check address */
-  if (WriteAddress <= SPI_FLASH_LAST_ADDRESS)
-  {
-    /* Try to take the semaphore in case some other process is using the device */
-    if (xSemaphoreTakeFromISR(xSemaphore, NULL) == pdTRUE)
-    {
-      prvSPI_FLASH_WriteBytes(pBuffer, WriteAddress, NumByteToWrite);
-
-      /* Give back the semaphore */
-      xSemaphoreGiveFromISR(xSemaphore, NULL);
-    }
-  }
+  /* The notifications are counted so the ones for other requests of this
+   * task are only taken one at a time */
+  while (!pRequest->done)
+    ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+  return pRequest->status;
 }
 
 /**
-  * @brief  Write one byte to the FLASH.
+  * @brief  Write a buffer to the FLASH and wait for it to be done
   * @note   Addresses to be written must be in the erased state
-  * @param  WriteAddress: FLASH's internal address to write to.
-  * @param  Byte: the data to be written.
-  * @retval None
+  * @param  pBuff: pointer to the buffer with data to write
+  * @param  WriteAddress: start of FLASH's internal address to write to
+  * @param  NumByteToWrite: number of bytes to write to the FLASH
+  * @retval SUCCESS: The data was written
+  * @retval ERROR: Invalid address or the device is not initialized
   */
-void SPI_FLASH_WriteByte(uint32_t WriteAddress, uint8_t Byte)
+ErrorStatus SPI_FLASH_WriteBuffer(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite)
 {
-  /* Check address */
-  if (WriteAddress <= SPI_FLASH_LAST_ADDRESS)
-  {
-    /* Try to take the semaphore in case some other process is using the device */
-    if (xSemaphoreTake(xSemaphore, 100) == pdTRUE)
-    {
-      prvSPI_FLASH_WriteByte(WriteAddress, Byte);
-
-      /* Give back the semaphore */
-      xSemaphoreGive(xSemaphore);
-    }
-  }
+  return prvRunAndWait(SPI_FLASH_Operation_Program, SPI_FLASH_Priority_Normal,
+                       pBuffer, WriteAddress, NumByteToWrite);
 }
 
 /**
-  * @brief  Write one byte to the FLASH. Can be called from an ISR
+  * @brief  Write one byte to the FLASH and wait for it to be done
   * @note   Addresses to be written must be in the erased state
   * @param  WriteAddress: FLASH's internal address to write to.
   * @param  Byte: the data to be written.
-  * @retval None
+  * @retval SUCCESS: The byte was written
+  * @retval ERROR: Invalid address or the device is not initialized
   */
-void SPI_FLASH_WriteByteFromISR(uint32_t WriteAddress, uint8_t Byte)
+ErrorStatus SPI_FLASH_WriteByte(uint32_t WriteAddress, uint8_t Byte)
 {
-  /* Check address */
-  if (WriteAddress <= SPI_FLASH_LAST_ADDRESS)
-  {
-    /* Try to take the semaphore in case some other process is using the device */
-    if (xSemaphoreTakeFromISR(xSemaphore, NULL) == pdTRUE)
-    {
-      prvSPI_FLASH_WriteByte(WriteAddress, Byte);
-
-      /* Give back the semaphore */
-      xSemaphoreGiveFromISR(xSemaphore, NULL);
-    }
-  }
+  return SPI_FLASH_WriteBuffer(&Byte, WriteAddress, 1);
 }
 
 /**
-  * @brief  Reads a block of data from the FLASH.
+  * @brief  Reads a block of data from the FLASH and waits for it. Reads have
+  *         the highest priority and can run while a sector erase is going on.
   * @param  pBuff: pointer to the buffer that receives the data read from the FLASH.
   * @param  ReadAddress: FLASH's internal address to read from.
   * @param  NumByteToRead: number of bytes to read from the FLASH.
-  * @retval None
+  * @retval SUCCESS: The data was read
+  * @retval ERROR: Invalid address, no data or the device is not initialized
   */
-void SPI_FLASH_ReadBuffer(uint8_t* pBuffer, uint32_t ReadAddress, uint32_t NumByteToRead)
+ErrorStatus SPI_FLASH_ReadBuffer(uint8_t* pBuffer, uint32_t ReadAddress, uint32_t NumByteToRead)
 {
-  /* Check address */
-  if (ReadAddress + NumByteToRead - 1 <= SPI_FLASH_LAST_ADDRESS)
-  {
-    /* Try to take the semaphore in case some other process is using the device */
-    if (NumByteToRead != 0 && xSemaphoreTake(xSemaphore, 100) == pdTRUE)
-    {
-      /* Select the FLASH */
-      prvSPI_FLASH_CS_LOW();
-
-      /* Send "Read from Memory " instruction */
-      prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_READ);
-
-      /* Send ReadAddr high nibble address byte to read from */
-      prvSPI_FLASH_SendReceiveByte((ReadAddress & 0xFF0000) >> 16);
-      /* Send ReadAddr medium nibble address byte to read from */
-      prvSPI_FLASH_SendReceiveByte((ReadAddress& 0xFF00) >> 8);
-      /* Send ReadAddr low nibble address byte to read from */
-      prvSPI_FLASH_SendReceiveByte(ReadAddress & 0xFF);
-
-      /* While there is data to be read */
-      while (NumByteToRead)
-      {
-        /* Read a byte from the FLASH and point to the next location */
-        *pBuffer++ = prvSPI_FLASH_SendReceiveByte(SPI_FLASH_DUMMY_BYTE);
-        /* Decrement NumByteToRead */
-        NumByteToRead--;
-      }
+  return prvRunAndWait(SPI_FLASH_Operation_Read, SPI_FLASH_Priority_High,
+                       pBuffer, ReadAddress, NumByteToRead);
+}
 
-      /* Deselect the FLASH */
-      prvSPI_FLASH_CS_HIGH();
+/**
+  * @brief  Erases the specified FLASH sector and waits for it, other tasks
+  *         can run meanwhile
+  * @param  SectorAddr: address of the sector to erase
+  * @retval SUCCESS: The sector was erased
+  * @retval ERROR: Invalid address or the device is not initialized
+  */
+ErrorStatus SPI_FLASH_EraseSector(uint32_t SectorAddress)
+{
+  return prvRunAndWait(SPI_FLASH_Operation_EraseSector, SPI_FLASH_Priority_Low,
+                       NULL, SectorAddress, 0);
+}
 
-      /* Give back the semaphore */
-      xSemaphoreGive(xSemaphore);
-    }
-  }
+/**
+  * @brief  Erases the entire FLASH and waits for it, other tasks can run
+  *         meanwhile but reads have to wait as a chip erase can't be suspended
+  * @param  None
+  * @retval SUCCESS: The FLASH was erased
+  * @retval ERROR: The device is not initialized
+  */
+ErrorStatus SPI_FLASH_EraseChip()
+{
+  return prvRunAndWait(SPI_FLASH_Operation_EraseChip, SPI_FLASH_Priority_Low,
+                       NULL, 0, 0);
 }
 
 /**
-  * @brief  Reads a block of data from the FLASH.
-  * @param  pBuff: pointer to the buffer that receives the data read from the FLASH.
-  * @param  ReadAddress: FLASH's internal address to read from.
-  * @param  NumByteToRead: number of bytes to read from the FLASH.
-  * @retval None
+  * @brief  Return the status of if the SPI FLASH is intialized or not
+  * @param  None
+  * @retval true: The device is initialized
+  * @retval false: The device is not initialized
   */
-void SPI_FLASH_ReadBufferFromISR(uint8_t* pBuffer, uint32_t ReadAddress, uint32_t NumByteToRead)
+bool SPI_FLASH_Initialized()
 {
-  /* Check address */
-  if (ReadAddress + NumByteToRead - 1 <= SPI_FLASH_LAST_ADDRESS)
-  {
-    /* Try to take the semaphore in case some other process is using the device */
-    if (NumByteToRead != 0 && xSemaphoreTakeFromISR(xSemaphore, NULL) == pdTRUE)
-    {
-      /* Select the FLASH */
-      prvSPI_FLASH_CS_LOW();
+  return prvInitialized;
+}
+
+/** Private functions .-------------------------------------------------------*/
+/**
+ * @brief  Pull the CS pin LOW
+ * @param  None
+ * @retval  None
+ */
+static inline void prvSPI_FLASH_CS_LOW()
+{
+  HAL_GPIO_WritePin(FLASH_PORT, FLASH_CS_PIN, GPIO_PIN_RESET);
+}
 
-      /* Send "Read from Memory " instruction */
-      prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_READ);
+/**
+ * @brief  Pull the CS pin HIGH
+ * @param  None
+ * @retval  None
+ */
+static inline void prvSPI_FLASH_CS_HIGH()
+{
+  HAL_GPIO_WritePin(FLASH_PORT, FLASH_CS_PIN, GPIO_PIN_SET);
+}
 
-      /* Send ReadAddr high nibble address byte to read from */
-      prvSPI_FLASH_SendReceiveByte((ReadAddress & 0xFF0000) >> 16);
-      /* Send ReadAddr medium nibble address byte to read from */
-      prvSPI_FLASH_SendReceiveByte((ReadAddress& 0xFF00) >> 8);
-      /* Send ReadAddr low nibble address byte to read from */
-      prvSPI_FLASH_SendReceiveByte(ReadAddress & 0xFF);
+/**
+ * @brief  The driver task, runs the requests and is woken by new requests,
+ *         the RX DMA and the poll timer
+ * @param  pvParameters: Not used
+ * @retval  None
+ */
+static void prvSpiFlashTask(void *pvParameters)
+{
+  uint32_t events;
 
-      /* While there is data to be read */
-      while (NumByteToRead)
-      {
-        /* Read a byte from the FLASH and point to the next location */
-        *pBuffer++ = prvSPI_FLASH_SendReceiveByte(SPI_FLASH_DUMMY_BYTE);
-        /* Decrement NumByteToRead */
-        NumByteToRead--;
-      }
+  while (1)
+  {
+    xTaskNotifyWait(0, SPI_FLASH_EVENT_ALL, &events, portMAX_DELAY);
 
-      /* Deselect the FLASH */
-      prvSPI_FLASH_CS_HIGH();
+    if ((events & SPI_FLASH_EVENT_POLL) &&
+        (prvChipState == SPI_FLASH_ChipState_Program || prvChipState == SPI_FLASH_ChipState_Erase))
+      prvCheckChipDone();
 
-      /* Give back the semaphore */
-      xSemaphoreGiveFromISR(xSemaphore, NULL);
-    }
+    prvRunRequests();
   }
 }
 
 /**
-  * @brief  Erases the specified FLASH sector
-  * @param  SectorAddr: address of the sector to erase
-  * @retval None
-  */
-ErrorStatus SPI_FLASH_EraseSector(uint32_t SectorAddress)
+ * @brief  Wakes the driver task to check if the program or erase is done
+ * @param  Timer: Not used
+ * @retval  None
+ */
+static void prvPollTimerCallback(TimerHandle_t Timer)
 {
-  /* Check address */
-  if (SectorAddress <= SPI_FLASH_LAST_ADDRESS)
-  {
-    /* Try to take the semaphore in case some other process is using the device */
-    if (xSemaphoreTake(xSemaphore, 10000) == pdTRUE)
-    {
-      /* Enable the write access to the FLASH */
-      prvSPI_FLASH_WriteEnable();
-
-      /* Sector Erase */
-      /* Select the FLASH: Chip Select low */
-      prvSPI_FLASH_CS_LOW();
+  xTaskNotify(prvTaskHandle, SPI_FLASH_EVENT_POLL, eSetBits);
+}
 
-      /* Send Sector Erase instruction */
-      prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_SECTOR_ERASE);
+/**
+ * @brief  Submit a request from the calling task and wait for it
+ * @param  Operation: The operation
+ * @param  Priority: The priority
+ * @param  pBuffer: The data, NULL for erases
+ * @param  Address: FLASH address
+ * @param  Count: Number of bytes, 0 for erases
+ * @retval  SUCCESS or ERROR
+ */
+static ErrorStatus prvRunAndWait(SPI_FLASH_Operation Operation, SPI_FLASH_Priority Priority,
+                                 uint8_t* pBuffer, uint32_t Address, uint32_t Count)
+{
+  SPI_FLASH_Request request = {
+    .operation = Operation,
+    .priority = Priority,
+    .pBuffer = pBuffer,
+    .address = Address,
+    .count = Count,
+    .task = xTaskGetCurrentTaskHandle(),
+  };
+
+  if (SPI_FLASH_Submit(&request) != SUCCESS)
+    return ERROR;
+  return SPI_FLASH_WaitForRequest(&request);
+}
 
-      /* Send SectorAddr high nibble address byte */
-      prvSPI_FLASH_SendReceiveByte((SectorAddress & 0xFF0000) >> 16);
-      /* Send SectorAddr medium nibble address byte */
-      prvSPI_FLASH_SendReceiveByte((SectorAddress & 0xFF00) >> 8);
-      /* Send SectorAddr low nibble address byte */
-      prvSPI_FLASH_SendReceiveByte(SectorAddress & 0xFF);
-      /* Deselect the FLASH: Chip Select high */
-      prvSPI_FLASH_CS_HIGH();
+/**
+ * @brief  Get the request with the highest priority that the chip is not
+ *         already busy with
+ * @param  None
+ * @retval  The request or NULL if there is none
+ */
+static SPI_FLASH_Request* prvNextRequest()
+{
+  taskENTER_CRITICAL();
+  SPI_FLASH_Request* pRequest = prvRequests;
+  if (pRequest != NULL && pRequest == prvChipRequest)
+    pRequest = pRequest->pNext;
+  taskEXIT_CRITICAL();
+  return pRequest;
+}
 
-      /* Wait till the end of Flash writing */
-      prvSPI_FLASH_WaitForWriteEnd();
+/**
+ * @brief  Run steps of the queued requests until the chip is busy or there
+ *         is nothing more to do
+ * @param  None
+ * @retval  None
+ */
+static void prvRunRequests()
+{
+  while (1)
+  {
+    SPI_FLASH_Request* pRequest = prvNextRequest();
 
-      /* Give back the semaphore */
-      xSemaphoreGive(xSemaphore);
+    if (prvChipState == SPI_FLASH_ChipState_Program || prvChipState == SPI_FLASH_ChipState_Erase)
+    {
+      /* Only a read can get in before the chip is done, by suspending an erase */
+      if (pRequest == NULL || !prvCanOvertake(pRequest))
+        return;
+      prvSuspendErase();
+      if (prvChipState == SPI_FLASH_ChipState_Erase)
+        return;
+      continue;
+    }
 
-      return SUCCESS;
+    if (prvChipState == SPI_FLASH_ChipState_EraseSuspended &&
+        (pRequest == NULL || pRequest->operation != SPI_FLASH_Operation_Read ||
+         !prvCanOvertake(pRequest)))
+    {
+      prvResumeErase();
+      return;
     }
-    else
-      return ERROR;
+
+    if (pRequest == NULL)
+      return;
+    prvRunStep(pRequest);
   }
-  else
-    return ERROR;
 }
 
 /**
-  * @brief  Erases the specified FLASH sector
-  * @param  SectorAddr: address of the sector to erase
-  * @retval None
-  */
-ErrorStatus SPI_FLASH_EraseSectorFromISR(uint32_t SectorAddress)
+ * @brief  Run the next part of a request, a read chunk is done when this
+ *         returns, a page program or an erase leaves the chip busy
+ * @param  pRequest: The request
+ * @retval  None
+ */
+static void prvRunStep(SPI_FLASH_Request* pRequest)
 {
-  /* Check address */
-  if (SectorAddress <= SPI_FLASH_LAST_ADDRESS)
+  uint32_t address = pRequest->address + pRequest->progress;
+  uint32_t count = pRequest->count - pRequest->progress;
+
+  switch (pRequest->operation)
   {
-    /* Try to take the semaphore in case some other process is using the device */
-    if (xSemaphoreTakeFromISR(xSemaphore, NULL) == pdTRUE)
+    case SPI_FLASH_Operation_Read:
     {
-      /* Enable the write access to the FLASH */
-      prvSPI_FLASH_WriteEnable();
-
-      /* Sector Erase */
-      /* Select the FLASH: Chip Select low */
+      if (count > SPI_FLASH_READ_CHUNK_SIZE)
+        count = SPI_FLASH_READ_CHUNK_SIZE;
       prvSPI_FLASH_CS_LOW();
-
-      /* Send Sector Erase instruction */
-      prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_SECTOR_ERASE);
-
-      /* Send SectorAddr high nibble address byte */
-      prvSPI_FLASH_SendReceiveByte((SectorAddress & 0xFF0000) >> 16);
-      /* Send SectorAddr medium nibble address byte */
-      prvSPI_FLASH_SendReceiveByte((SectorAddress & 0xFF00) >> 8);
-      /* Send SectorAddr low nibble address byte */
-      prvSPI_FLASH_SendReceiveByte(SectorAddress & 0xFF);
-      /* Deselect the FLASH: Chip Select high */
+      prvSendHeader(SPI_FLASH_CMD_READ, address);
+      ErrorStatus status = prvDmaTransfer(&prvDummyByte, false, &pRequest->pBuffer[pRequest->progress], true, count);
       prvSPI_FLASH_CS_HIGH();
+      pRequest->progress += count;
+      if (status != SUCCESS || pRequest->progress == pRequest->count)
+        prvComplete(pRequest, status);
+      break;
+    }
 
-      /* Wait till the end of Flash writing */
-      prvSPI_FLASH_WaitForWriteEnd();
-
-      /* Give back the semaphore */
-      xSemaphoreGiveFromISR(xSemaphore, NULL);
+    case SPI_FLASH_Operation_Program:
+      /* Up to the end of the page, the FLASH wraps around within a page */
+      if (count > SPI_FLASH_PAGE_SIZE - (address % SPI_FLASH_PAGE_SIZE))
+        count = SPI_FLASH_PAGE_SIZE - (address % SPI_FLASH_PAGE_SIZE);
+      prvSendCommand(SPI_FLASH_CMD_WREN);
+      prvSPI_FLASH_CS_LOW();
+      prvSendHeader(SPI_FLASH_CMD_WRITE, address);
+      if (prvDmaTransfer(&pRequest->pBuffer[pRequest->progress], true, &prvDiscardByte, false, count) != SUCCESS)
+      {
+        prvSPI_FLASH_CS_HIGH();
+        prvSendCommand(SPI_FLASH_CMD_WRDI);
+        prvComplete(pRequest, ERROR);
+        break;
+      }
+      prvSPI_FLASH_CS_HIGH();
+      prvChipCount = count;
+      prvStartBusyPeriod(SPI_FLASH_ChipState_Program, pRequest, SPI_FLASH_PROGRAM_POLL_TICKS);
+      break;
 
-      return SUCCESS;
-    }
-    else
-      return ERROR;
+    case SPI_FLASH_Operation_EraseSector:
+      prvSendCommand(SPI_FLASH_CMD_WREN);
+      prvSPI_FLASH_CS_LOW();
+      prvSendHeader(SPI_FLASH_CMD_SECTOR_ERASE, pRequest->address);
+      prvSPI_FLASH_CS_HIGH();
+      prvEraseRunningSince = xTaskGetTickCount();
+      prvStartBusyPeriod(SPI_FLASH_ChipState_Erase, pRequest, SPI_FLASH_ERASE_POLL_TICKS);
+      break;
+
+    case SPI_FLASH_Operation_EraseChip:
+      prvSendCommand(SPI_FLASH_CMD_WREN);
+      prvSendCommand(SPI_FLASH_CMD_CHIP_ERASE);
+      prvEraseRunningSince = xTaskGetTickCount();
+      prvStartBusyPeriod(SPI_FLASH_ChipState_Erase, pRequest, SPI_FLASH_ERASE_POLL_TICKS);
+      break;
   }
-  else
-    return ERROR;
 }
 
 /**
-  * @brief  Erases the entire FLASH
-  * @param  None
-  * @retval None
-  */
-void SPI_FLASH_EraseChip()
+ * @brief  Remove a request from the queue and tell the task that submitted it
+ * @param  pRequest: The request, it's not touched after done is set
+ * @param  Status: SUCCESS or ERROR
+ * @retval  None
+ */
+static void prvComplete(SPI_FLASH_Request* pRequest, ErrorStatus Status)
 {
-  /* Try to take the semaphore in case some other process is using the device */
-  if (xSemaphoreTake(xSemaphore, 100) == pdTRUE)
-  {
-    /* Enable the write access to the FLASH */
-    prvSPI_FLASH_WriteEnable();
-
-    /* Bulk Erase */
-    /* Select the FLASH */
-    prvSPI_FLASH_CS_LOW();
-    /* Send Bulk Erase instruction  */
-    prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_CHIP_ERASE);
-    /* Deselect the FLASH */
-    prvSPI_FLASH_CS_HIGH();
-
-    /* Wait till the end of Flash writing */
-    prvSPI_FLASH_WaitForWriteEnd();
-
-    /* Give back the semaphore */
-    xSemaphoreGive(xSemaphore);
-  }
+  taskENTER_CRITICAL();
+  SPI_FLASH_Request** ppNext = &prvRequests;
+  while (*ppNext != NULL && *ppNext != pRequest)
+    ppNext = &(*ppNext)->pNext;
+  if (*ppNext != NULL)
+    *ppNext = pRequest->pNext;
+  taskEXIT_CRITICAL();
+
+  TaskHandle_t task = pRequest->task;
+  pRequest->status = Status;
+  pRequest->done = true;
+  if (task != NULL)
+    xTaskNotifyGive(task);
 }
 
 /**
-  * @brief  Erases the entire FLASH
-  * @param  None
-  * @retval None
-  */
-void SPI_FLASH_EraseChipFromISR()
+ * @brief  Check if the program or erase in the chip is done and finish the
+ *         request if it is, a program with pages left stays in the queue
+ * @param  None
+ * @retval  None
+ */
+static void prvCheckChipDone()
 {
-  /* Try to take the semaphore in case some other process is using the device */
-  if (xSemaphoreTakeFromISR(xSemaphore, NULL) == pdTRUE)
-  {
-    /* Enable the write access to the FLASH */
-    prvSPI_FLASH_WriteEnable();
+  if (prvReadStatus(SPI_FLASH_CMD_RDSR) & SPI_FLASH_WIP_FLAG)
+    return;
 
-    /* Bulk Erase */
-    /* Select the FLASH */
-    prvSPI_FLASH_CS_LOW();
-    /* Send Bulk Erase instruction  */
-    prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_CHIP_ERASE);
-    /* Deselect the FLASH */
-    prvSPI_FLASH_CS_HIGH();
+  xTimerStop(prvPollTimer, portMAX_DELAY);
 
-    /* Wait till the end of Flash writing */
-    prvSPI_FLASH_WaitForWriteEnd();
+  /* A suspend that took longer than prvSuspendErase waited for */
+  if (prvChipState == SPI_FLASH_ChipState_Erase &&
+      (prvReadStatus(SPI_FLASH_CMD_RDSR2) & SPI_FLASH_SUS_FLAG))
+  {
+    prvChipState = SPI_FLASH_ChipState_EraseSuspended;
+    return;
+  }
 
-    /* Give back the semaphore */
-    xSemaphoreGiveFromISR(xSemaphore, NULL);
+  SPI_FLASH_Request* pRequest = prvChipRequest;
+  SPI_FLASH_ChipState state = prvChipState;
+  prvChipState = SPI_FLASH_ChipState_Idle;
+  prvChipRequest = NULL;
+
+  if (state == SPI_FLASH_ChipState_Program)
+  {
+    pRequest->progress += prvChipCount;
+    if (pRequest->progress == pRequest->count)
+      prvComplete(pRequest, SUCCESS);
   }
+  else
+    prvComplete(pRequest, SUCCESS);
 }
 
 /**
-  * @brief  Return the status of if the SPI FLASH is intialized or not
-  * @param  None
-  * @retval true: The device is initialized
-  * @retval false: The device is not initialized
-  */
-bool SPI_FLASH_Initialized()
+ * @brief  Start polling the status of a program or an erase
+ * @param  State: SPI_FLASH_ChipState_Program or SPI_FLASH_ChipState_Erase
+ * @param  pRequest: The request the chip is busy with
+ * @param  PollTicks: Ticks between the polls
+ * @retval  None
+ */
+static void prvStartBusyPeriod(SPI_FLASH_ChipState State, SPI_FLASH_Request* pRequest, TickType_t PollTicks)
 {
-  return prvInitialized;
+  prvChipState = State;
+  prvChipRequest = pRequest;
+  /* Also starts the timer */
+  xTimerChangePeriod(prvPollTimer, PollTicks, portMAX_DELAY);
 }
 
-/** Private functions .-------------------------------------------------------*/
 /**
- * @brief  Pull the CS pin LOW
+ * @brief  Check if a request can run while the chip is busy with an erase,
+ *         only reads outside of a sector that is being erased can
+ * @param  pRequest: The request
+ * @retval  true if it can
+ */
+static bool prvCanOvertake(SPI_FLASH_Request* pRequest)
+{
+  if (pRequest->operation != SPI_FLASH_Operation_Read ||
+      prvChipRequest == NULL || prvChipRequest->operation != SPI_FLASH_Operation_EraseSector)
+    return false;
+
+  uint32_t sector = prvChipRequest->address & ~(SPI_FLASH_SECTOR_SIZE - 1);
+  uint32_t address = pRequest->address + pRequest->progress;
+  uint32_t end = pRequest->address + pRequest->count;
+  if (address < sector + SPI_FLASH_SECTOR_SIZE && end > sector)
+    return false;
+
+  /* Reads can keep going once the erase is suspended */
+  if (prvChipState == SPI_FLASH_ChipState_EraseSuspended)
+    return true;
+  return (xTaskGetTickCount() - prvEraseRunningSince >= SPI_FLASH_RESUME_TICKS);
+}
+
+/**
+ * @brief  Suspend the sector erase so the chip can be read, if the erase
+ *         finished in the meantime it's completed instead
  * @param  None
  * @retval  None
  */
-static inline void prvSPI_FLASH_CS_LOW()
+static void prvSuspendErase()
 {
-  HAL_GPIO_WritePin(FLASH_PORT, FLASH_CS_PIN, GPIO_PIN_RESET);
+  prvSendCommand(SPI_FLASH_CMD_SUSPEND);
+
+  /* Takes at most 20 us so this is not worth a timer */
+  uint32_t polls = 0;
+  while ((prvReadStatus(SPI_FLASH_CMD_RDSR) & SPI_FLASH_WIP_FLAG) && polls < SPI_FLASH_SUSPEND_POLLS)
+    polls++;
+  if (polls == SPI_FLASH_SUSPEND_POLLS)
+    return;
+
+
+  /* Suspended or finished in the meantime */
+  prvCheckChipDone();
 }
 
 /**
- * @brief  Pull the CS pin HIGH
+ * @brief  Resume the suspended sector erase
  * @param  None
  * @retval  None
  */
-static inline void prvSPI_FLASH_CS_HIGH()
+static void prvResumeErase()
 {
-  HAL_GPIO_WritePin(FLASH_PORT, FLASH_CS_PIN, GPIO_PIN_SET);
+  prvSendCommand(SPI_FLASH_CMD_RESUME);
+  prvEraseRunningSince = xTaskGetTickCount();
+  prvStartBusyPeriod(SPI_FLASH_ChipState_Erase, prvChipRequest, SPI_FLASH_ERASE_POLL_TICKS);
 }
 
 /**
-  * @brief  Write one byte to the FLASH.
-  * @note   Addresses to be written must be in the erased state
-  * @param  WriteAddress: FLASH's internal address to write to.
-  * @param  Byte: the data to be written.
+  * @brief  Send an instruction without any data
+  * @param  Command: The instruction
   * @retval None
   */
-static void prvSPI_FLASH_WriteByte(uint32_t WriteAddress, uint8_t Byte)
+static void prvSendCommand(uint8_t Command)
 {
-  /* Enable the write access to the FLASH */
-  prvSPI_FLASH_WriteEnable();
-
-  /* Select the FLASH */
   prvSPI_FLASH_CS_LOW();
-  /* Send "Byte Program" instruction */
-  prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_WRITE);
-  /* Send WriteAddress high, medium and low nibble address byte to write to */
-  prvSPI_FLASH_SendReceiveByte((WriteAddress & 0xFF0000) >> 16);
-  prvSPI_FLASH_SendReceiveByte((WriteAddress & 0xFF00) >> 8);
-  prvSPI_FLASH_SendReceiveByte(WriteAddress & 0xFF);
-  /* Send the byte */
-  prvSPI_FLASH_SendReceiveByte(Byte);
-  /* Deselect the FLASH */
+  prvTransfer(&Command, &Command, 1);
   prvSPI_FLASH_CS_HIGH();
-  /* Wait till the end of Flash writing */
-  prvSPI_FLASH_WaitForWriteEnd();
 }
 
 /**
-  * @brief  Writes more than one byte to the FLASH.
-  * @note   The address must be even and the number of bytes must be a multiple
-  *         of two.
-  * @note   Addresses to be written must be in the erased state
-  * @param  pBuffer: pointer to the buffer containing the data to be written
-  *         to the FLASH.
-  * @param  WriteAddress: FLASH's internal address to write to, must be even.
-  * @param  NumByteToWrite: number of bytes to write to the FLASH, must be even.
+  * @brief  Send an instruction and a 3 byte address, CS must be low
+  * @param  Command: The instruction
+  * @param  Address: The address
   * @retval None
   */
-static void prvSPI_FLASH_WriteBytes(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite)
+static void prvSendHeader(uint8_t Command, uint32_t Address)
 {
-  uint32_t numOfWholePages = NumByteToWrite / SPI_FLASH_PAGE_SIZE;
-  uint32_t bytesLeft = NumByteToWrite % SPI_FLASH_PAGE_SIZE;
-
-  while (numOfWholePages)
-  {
-    prvSPI_FLASH_WriteUpToOnePage(pBuffer, WriteAddress, SPI_FLASH_PAGE_SIZE);
-    numOfWholePages--;
-    pBuffer += SPI_FLASH_PAGE_SIZE;
-    WriteAddress += SPI_FLASH_PAGE_SIZE;
-  }
-
-  if (bytesLeft)
-    prvSPI_FLASH_WriteUpToOnePage(pBuffer, WriteAddress, bytesLeft);
-
-  /* Disable the write access to the FLASH */
-  prvSPI_FLASH_WriteDisable();
+  uint8_t header[4];
+  header[0] = Command;
+  header[1] = (Address & 0xFF0000) >> 16;
+  header[2] = (Address & 0xFF00) >> 8;
+  header[3] = Address & 0xFF;
+  prvTransfer(header, header, 4);
 }
 
 /**
-  * @brief
-  * @param  None
-  * @retval None
+  * @brief  Read a status register
+  * @param  Command: SPI_FLASH_CMD_RDSR or SPI_FLASH_CMD_RDSR2
+  * @retval The value
   */
-static void prvSPI_FLASH_WriteUpToOnePage(uint8_t* pBuffer, uint32_t WriteAddress, uint32_t NumByteToWrite)
+static uint8_t prvReadStatus(uint8_t Command)
 {
-  if (NumByteToWrite <= SPI_FLASH_PAGE_SIZE)
-  {
-    /* Enable the write access to the FLASH */
-    prvSPI_FLASH_WriteEnable();
-
-    /* Select the FLASH */
-    prvSPI_FLASH_CS_LOW();
-
-    /* Send write command */
-    prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_WRITE);
-    /* Send WriteAddress high, medium and low nibble address byte to write to */
-    prvSPI_FLASH_SendReceiveByte((WriteAddress & 0xFF0000) >> 16);
-    prvSPI_FLASH_SendReceiveByte((WriteAddress & 0xFF00) >> 8);
-    prvSPI_FLASH_SendReceiveByte(WriteAddress & 0xFF);
-
-    /* While there is data to be written to the FLASH */
-    while (NumByteToWrite)
-    {
-      /* Send one byte */
-      prvSPI_FLASH_SendReceiveByte(*pBuffer++);
-      /* Update NumByteToWrite */
-      NumByteToWrite--;
-    }
-
-    /* Deselect the FLASH */
-    prvSPI_FLASH_CS_HIGH();
-    /* Wait till the end of Flash writing */
-    prvSPI_FLASH_WaitForWriteEnd();
-  }
+  uint8_t data[2] = {Command, SPI_FLASH_DUMMY_BYTE};
+  prvSPI_FLASH_CS_LOW();
+  prvTransfer(data, data, 2);
+  prvSPI_FLASH_CS_HIGH();
+  return data[1];
 }
 
 /**
-  * @brief  Disables the write access to the FLASH
-  * @param  None
+  * @brief  Send and receive a few bytes without DMA, for instructions and
+  *         addresses
+  * @param  pTxData: The bytes to send
+  * @param  pRxData: Where the received bytes go, can be the same as pTxData
+  * @param  Count: Number of bytes
   * @retval None
   */
-static void prvSPI_FLASH_WriteDisable()
+static void prvTransfer(uint8_t* pTxData, uint8_t* pRxData, uint16_t Count)
 {
-  /* Select the FLASH */
-  prvSPI_FLASH_CS_LOW();
-
-  /* Send "Write Disable" instruction */
-  prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_WRDI);
-
-  /* Deselect the FLASH */
-  prvSPI_FLASH_CS_HIGH();
+  HAL_SPI_TransmitReceive(&SPI_Handle, pTxData, pRxData, Count, SPI_FLASH_TIMEOUT);
 }
 
 /**
-  * @brief  Enables the write access to the FLASH
-  * @param  None
-  * @retval None
+  * @brief  Send and receive bytes with DMA and sleep until it's done, must be
+  *         called from the driver task
+  * @param  pTxData: The bytes to send
+  * @param  TxIncrement: false to send the same byte all the time
+  * @param  pRxData: Where the received bytes go
+  * @param  RxIncrement: false to put all bytes in the same place
+  * @param  Count: Number of bytes
+  * @retval SUCCESS: All bytes were sent and received
+  * @retval ERROR: The DMA didn't finish in time
   */
-static void prvSPI_FLASH_WriteEnable()
+static ErrorStatus prvDmaTransfer(uint8_t* pTxData, bool TxIncrement, uint8_t* pRxData, bool RxIncrement, uint16_t Count)
 {
-  /* Select the FLASH */
-  prvSPI_FLASH_CS_LOW();
+  /* The RX stream is started first so no received byte is missed */
+  prvStartDmaStream(&prvRxDmaHandle, pRxData, RxIncrement, Count);
+  prvStartDmaStream(&prvTxDmaHandle, pTxData, TxIncrement, Count);
+  SET_BIT(FLASH_SPI->CR2, SPI_CR2_RXDMAEN);
+  SET_BIT(FLASH_SPI->CR2, SPI_CR2_TXDMAEN);
+
+  uint32_t events = 0;
+  uint32_t otherEvents = 0;
+  ErrorStatus status = SUCCESS;
+  while (!(events & SPI_FLASH_EVENT_DMA_DONE))
+  {
+    if (xTaskNotifyWait(0, SPI_FLASH_EVENT_DMA_DONE, &events, SPI_FLASH_DMA_TIMEOUT_TICKS) != pdTRUE)
+    {
+      status = ERROR;
+      break;
+    }
+    otherEvents |= events & ~SPI_FLASH_EVENT_DMA_DONE;
+  }
 
-  /* Send "Write Enable" instruction */
-  prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_WREN);
+  CLEAR_BIT(FLASH_SPI->CR2, SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN);
+  __HAL_DMA_DISABLE(&prvTxDmaHandle);
+  __HAL_DMA_DISABLE(&prvRxDmaHandle);
 
-  /* Deselect the FLASH */
-  prvSPI_FLASH_CS_HIGH();
+  if (status != SUCCESS)
+  {
+    /* Stopping the RX stream sets its transfer complete flag, drop that and
+     * any DMA_DONE it already gave so the next transfer doesn't end early */
+    while ((prvTxDmaHandle.Instance->CR & DMA_SxCR_EN) ||
+           (prvRxDmaHandle.Instance->CR & DMA_SxCR_EN)) {}
+    __HAL_DMA_CLEAR_FLAG(&prvTxDmaHandle, __HAL_DMA_GET_TC_FLAG_INDEX(&prvTxDmaHandle));
+    __HAL_DMA_CLEAR_FLAG(&prvRxDmaHandle, __HAL_DMA_GET_TC_FLAG_INDEX(&prvRxDmaHandle));
+    if (xTaskNotifyWait(SPI_FLASH_EVENT_DMA_DONE, SPI_FLASH_EVENT_DMA_DONE, &events, 0) == pdTRUE)
+      otherEvents |= events & ~SPI_FLASH_EVENT_DMA_DONE;
+  }
+
+  /* Waiting took the pending state, give the other events back to the main
+   * loop of the task */
+  if (otherEvents != 0)
+    xTaskNotify(prvTaskHandle, otherEvents, eSetBits);
+  return status;
 }
 
 /**
-  * @brief  Send one byte to the SPI FLASH and return the byte received back
-  * @param  Byte: The byte to send
-  * @retval The byte received from the SPI FLASH
+  * @brief  Set up a DMA stream for a transfer and enable it
+  * @param  pHandle: prvRxDmaHandle or prvTxDmaHandle
+  * @param  pMemory: The memory address
+  * @param  Increment: true to increment the memory address
+  * @param  Count: Number of bytes
+  * @retval None
   */
-static uint8_t prvSPI_FLASH_SendReceiveByte(uint8_t Byte)
+static void prvStartDmaStream(DMA_HandleTypeDef* pHandle, uint8_t* pMemory, bool Increment, uint16_t Count)
 {
-  /* TODO: Do this RAW instead of using HAL??? A lot of overhead in HAL */
-  uint8_t rxByte;
-  HAL_SPI_TransmitReceive(&SPI_Handle, &Byte, &rxByte, 1, 10);  /* TODO: Check timeout */
-  return rxByte;
+  DMA_Stream_TypeDef* pStream = pHandle->Instance;
+  __HAL_DMA_DISABLE(pHandle);
+  while (pStream->CR & DMA_SxCR_EN) {}
+
+  /* The flags of the last transfer must be cleared before it can be enabled */
+  __HAL_DMA_CLEAR_FLAG(pHandle, __HAL_DMA_GET_TC_FLAG_INDEX(pHandle) |
+                                __HAL_DMA_GET_HT_FLAG_INDEX(pHandle) |
+                                __HAL_DMA_GET_TE_FLAG_INDEX(pHandle) |
+                                __HAL_DMA_GET_DME_FLAG_INDEX(pHandle) |
+                                __HAL_DMA_GET_FE_FLAG_INDEX(pHandle));
+  pStream->M0AR = (uint32_t)pMemory;
+  pStream->NDTR = Count;
+  if (Increment)
+    pStream->CR |= DMA_SxCR_MINC;
+  else
+    pStream->CR &= ~DMA_SxCR_MINC;
+  __HAL_DMA_ENABLE(pHandle);
 }
 
+/** Interrupt Handlers -------------------------------------------------------*/
 /**
-  * @brief  Polls the status of the Write In Progress (WIP) flag in the FLASH's
-  *         status register and loop until write operation has completed.
-  * @param  None
-  * @retval None
-  */
-static void prvSPI_FLASH_WaitForWriteEnd()
+ * @brief   Transfer complete interrupt for the RX DMA, called from
+ *          DMA2_Stream0_IRQHandler
+ * @param   None
+ * @retval  None
+ */
+void SPI_FLASH_RxDmaHandler()
 {
-  uint8_t flashStatus = 0;
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
 
-  /* Select the FLASH */
-  prvSPI_FLASH_CS_LOW();
+  /* The flag is already cleared if the task stopped a transfer that timed out */
+  if (!__HAL_DMA_GET_FLAG(&prvRxDmaHandle, __HAL_DMA_GET_TC_FLAG_INDEX(&prvRxDmaHandle)))
+    return;
 
-  /* Send "Read Status Register" instruction */
-  prvSPI_FLASH_SendReceiveByte(SPI_FLASH_CMD_RDSR);
-
-  /* Loop as long as the memory is busy with a write cycle */
-  do
-  {
-    /* TODO: Handle blocking */
-    /* Send a dummy byte to generate the clock needed by the FLASH
-    and put the value of the status register in FLASH_Status variable */
-    flashStatus = prvSPI_FLASH_SendReceiveByte(SPI_FLASH_DUMMY_BYTE);
-  } while ((flashStatus & SPI_FLASH_WIP_FLAG) == SET); /* Write in progress */
-
-  /* Deselect the FLASH */
-  prvSPI_FLASH_CS_HIGH();
+  __HAL_DMA_CLEAR_FLAG(&prvRxDmaHandle, __HAL_DMA_GET_TC_FLAG_INDEX(&prvRxDmaHandle));
+  if (prvTaskHandle != NULL)
+    xTaskNotifyFromISR(prvTaskHandle, SPI_FLASH_EVENT_DMA_DONE, eSetBits, &higherPriorityTaskWoken);
+  portYIELD_FROM_ISR(higherPriorityTaskWoken);
 }
-
-/** Interrupt Handlers -------------------------------------------------------*/
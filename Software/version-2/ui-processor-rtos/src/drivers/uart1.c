@@ -26,24 +26,55 @@
 /** Includes -----------------------------------------------------------------*/
 #include "uart1.h"
 
+#include <string.h>
+
 /** Private defines ----------------------------------------------------------*/
 #define UART_PORT               (GPIOA)
 #define UART_GPIO_CLK_ENABLE()  __HAL_RCC_GPIOA_CLK_ENABLE()
 #define UART_TX_PIN             (GPIO_PIN_9)
 #define UART_RX_PIN             (GPIO_PIN_10)
 
-#define UART_RX_BUFFER_SIZE     (128)
+#define UART_DEFAULT_BAUD_RATE  (115200)
+#define UART_MIN_BAUD_RATE      (9600)
+
+/* Filled by circular DMA, must hold everything that arrives while the flash
+ * task is busy with a command, at 10 Mbaud that is 4 ms, and a full window
+ * of asset upload frames from uart_comm.c */
+#define UART_RX_BUFFER_SIZE     (4096)
+/* Data to send is copied here so the callers can reuse their buffers */
+#define UART_TX_BUFFER_SIZE     (1024)
 
 /** Private typedefs ---------------------------------------------------------*/
 /** Private variables --------------------------------------------------------*/
 static uint8_t prvRxBuffer[UART_RX_BUFFER_SIZE] = {0};
-static uint8_t* prvRxBufferIn;
-static uint8_t* prvRxBufferOut;
-static uint32_t prvRxBufferCount;
+static DMA_HandleTypeDef prvRxDmaHandle;
+static SemaphoreHandle_t prvRxSemaphore = NULL;
+
+/* Running byte counts, the difference is the number of unread bytes */
+static volatile uint32_t prvRxBytesReceived = 0;
+static uint32_t prvRxBytesRead = 0;
+static uint32_t prvRxDmaIndex = 0;
+static volatile bool prvRxOverflow = false;
+
+static uint8_t prvTxBuffer[UART_TX_BUFFER_SIZE] = {0};
+static DMA_HandleTypeDef prvTxDmaHandle;
+static SemaphoreHandle_t prvTxMutex = NULL;
+static SemaphoreHandle_t prvTxDoneSemaphore = NULL;
+
+/* Running byte counts, the difference is the number of bytes left to send */
+static volatile uint32_t prvTxBytesQueued = 0;
+static volatile uint32_t prvTxBytesSent = 0;
+/* Size of the transfer the DMA is working on, 0 when it's stopped */
+static volatile uint32_t prvTxDmaCount = 0;
 
 static bool prvInitialized = false;
 
 /** Private function prototypes ----------------------------------------------*/
+static void prvUpdateRxBytesReceived();
+static void prvStartTxDma();
+static void prvTxDmaComplete(DMA_HandleTypeDef* hdma);
+static uint32_t prvCalculateBrr(uint32_t Clock, uint32_t BaudRate, bool Oversampling8);
+
 /** Functions ----------------------------------------------------------------*/
 /**
  * @brief   Initializes the UART
@@ -65,31 +96,81 @@ ErrorStatus UART1_Init()
     GPIO_InitStructure.Speed      = GPIO_SPEED_HIGH;
     HAL_GPIO_Init(UART_PORT, &GPIO_InitStructure);
 
-    /* Init the RX Buffer */
-    prvRxBufferIn = &prvRxBuffer[0];
-    prvRxBufferOut = &prvRxBuffer[0];
-    prvRxBufferCount = 0;
+    prvRxSemaphore = xSemaphoreCreateBinary();
+    prvTxDoneSemaphore = xSemaphoreCreateBinary();
+    prvTxMutex = xSemaphoreCreateMutex();
+    if (prvRxSemaphore == NULL || prvTxDoneSemaphore == NULL || prvTxMutex == NULL)
+      return ERROR;
 
     /* Enable UART clock */
     __HAL_RCC_USART1_CLK_ENABLE();
 
     /* Init the UART */
     UART_Handle.Instance           = USART1;
-    UART_Handle.Init.BaudRate      = 115200;
+    UART_Handle.Init.BaudRate      = UART_DEFAULT_BAUD_RATE;
     UART_Handle.Init.WordLength    = UART_WORDLENGTH_8B;
     UART_Handle.Init.StopBits      = UART_STOPBITS_1;
     UART_Handle.Init.Parity        = UART_PARITY_NONE;
     UART_Handle.Init.Mode          = UART_MODE_TX_RX;
     UART_Handle.Init.HwFlowCtl     = UART_HWCONTROL_NONE;
+    UART_Handle.Init.OverSampling  = UART_OVERSAMPLING_16;
     if (HAL_UART_Init(&UART_Handle) != HAL_OK)
       return ERROR;
 
-    /* Enable the UART Data Register not empty Interrupt */
-    __HAL_UART_ENABLE_IT(&UART_Handle, UART_IT_RXNE);
+    /* RX goes to the buffer with circular DMA, USART1 RX is DMA2 stream 2 channel 4 */
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    prvRxDmaHandle.Instance                 = DMA2_Stream2;
+    prvRxDmaHandle.Init.Channel             = DMA_CHANNEL_4;
+    prvRxDmaHandle.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+    prvRxDmaHandle.Init.PeriphInc           = DMA_PINC_DISABLE;
+    prvRxDmaHandle.Init.MemInc              = DMA_MINC_ENABLE;
+    prvRxDmaHandle.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    prvRxDmaHandle.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+    prvRxDmaHandle.Init.Mode                = DMA_CIRCULAR;
+    prvRxDmaHandle.Init.Priority            = DMA_PRIORITY_HIGH;
+    prvRxDmaHandle.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+    prvRxDmaHandle.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
+    prvRxDmaHandle.Init.MemBurst            = DMA_MBURST_SINGLE;
+    prvRxDmaHandle.Init.PeriphBurst         = DMA_PBURST_SINGLE;
+    if (HAL_DMA_Init(&prvRxDmaHandle) != HAL_OK)
+      return ERROR;
+    HAL_DMA_Start(&prvRxDmaHandle, (uint32_t)&UART_Handle.Instance->DR, (uint32_t)prvRxBuffer, UART_RX_BUFFER_SIZE);
+    SET_BIT(UART_Handle.Instance->CR3, USART_CR3_DMAR);
+
+    /*
+     * The half and full transfer interrupts make sure the received count is
+     * updated at least twice per lap so a lap is never missed, the idle line
+     * interrupt wakes the task at the end of a burst shorter than that
+     */
+    __HAL_DMA_ENABLE_IT(&prvRxDmaHandle, DMA_IT_HT | DMA_IT_TC);
+    __HAL_UART_ENABLE_IT(&UART_Handle, UART_IT_IDLE);
 
-    /* NVIC for USART */
-    HAL_NVIC_SetPriority(USART1_IRQn, configLIBRARY_LOWEST_INTERRUPT_PRIORITY, 0);
+    /* TX is sent from the TX buffer with DMA, USART1 TX is DMA2 stream 7 channel 4 */
+    prvTxDmaHandle.Instance                 = DMA2_Stream7;
+    prvTxDmaHandle.Init.Channel             = DMA_CHANNEL_4;
+    prvTxDmaHandle.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+    prvTxDmaHandle.Init.PeriphInc           = DMA_PINC_DISABLE;
+    prvTxDmaHandle.Init.MemInc              = DMA_MINC_ENABLE;
+    prvTxDmaHandle.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    prvTxDmaHandle.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+    prvTxDmaHandle.Init.Mode                = DMA_NORMAL;
+    prvTxDmaHandle.Init.Priority            = DMA_PRIORITY_MEDIUM;
+    prvTxDmaHandle.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+    prvTxDmaHandle.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
+    prvTxDmaHandle.Init.MemBurst            = DMA_MBURST_SINGLE;
+    prvTxDmaHandle.Init.PeriphBurst         = DMA_PBURST_SINGLE;
+    if (HAL_DMA_Init(&prvTxDmaHandle) != HAL_OK)
+      return ERROR;
+    prvTxDmaHandle.XferCpltCallback = prvTxDmaComplete;
+
+    /* NVIC for USART and DMA, they use the FreeRTOS API so they can't be above
+     * the max syscall priority */
+    HAL_NVIC_SetPriority(USART1_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, 0);
     HAL_NVIC_EnableIRQ(USART1_IRQn);
+    HAL_NVIC_SetPriority(DMA2_Stream2_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream2_IRQn);
+    HAL_NVIC_SetPriority(DMA2_Stream7_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream7_IRQn);
 
     prvInitialized = true;
 
@@ -98,6 +179,57 @@ ErrorStatus UART1_Init()
   return ERROR;
 }
 
+/**
+ * @brief   Change the baud rate, any ongoing transmission is finished first.
+ *          Must be called from a task.
+ * @param   BaudRate: The new baud rate
+ * @retval  SUCCESS or ERROR if the baud rate is out of range
+ */
+ErrorStatus UART1_SetBaudRate(uint32_t BaudRate)
+{
+  if (!UART1_BaudRateSupported(BaudRate))
+    return ERROR;
+
+  /* Let the last byte, normally the ACK for this change, leave the shift register */
+  xSemaphoreTake(prvTxMutex, portMAX_DELAY);
+  while (UART1_TxBusy())
+    vTaskDelay(1);
+  while (__HAL_UART_GET_FLAG(&UART_Handle, UART_FLAG_TC) == RESET);
+
+  /* Oversampling by 8 doubles the max baud rate, it is less tolerant to noise
+   * so it's only used when 16 can't reach the baud rate. Writing the registers
+   * directly keeps the DMA and interrupt settings. */
+  uint32_t clock = HAL_RCC_GetPCLK2Freq();
+  bool oversampling8 = (BaudRate > clock / 16);
+  __HAL_UART_DISABLE(&UART_Handle);
+  if (oversampling8)
+  {
+    UART_Handle.Init.OverSampling = UART_OVERSAMPLING_8;
+    SET_BIT(UART_Handle.Instance->CR1, USART_CR1_OVER8);
+  }
+  else
+  {
+    UART_Handle.Init.OverSampling = UART_OVERSAMPLING_16;
+    CLEAR_BIT(UART_Handle.Instance->CR1, USART_CR1_OVER8);
+  }
+  UART_Handle.Init.BaudRate = BaudRate;
+  UART_Handle.Instance->BRR = prvCalculateBrr(clock, BaudRate, oversampling8);
+  __HAL_UART_ENABLE(&UART_Handle);
+
+  xSemaphoreGive(prvTxMutex);
+  return SUCCESS;
+}
+
+/**
+ * @brief   Check if a baud rate can be used, the max is the peripheral clock / 8
+ * @param   BaudRate: The baud rate
+ * @retval  true if it can be used
+ */
+bool UART1_BaudRateSupported(uint32_t BaudRate)
+{
+  return (BaudRate >= UART_MIN_BAUD_RATE && BaudRate <= HAL_RCC_GetPCLK2Freq() / 8);
+}
+
 /**
  * @brief   Get the number of bytes available in the RX buffer
  * @param   None
@@ -105,7 +237,66 @@ ErrorStatus UART1_Init()
  */
 uint32_t UART1_BytesAvailable()
 {
-  return prvRxBufferCount;
+  prvUpdateRxBytesReceived();
+  return prvRxBytesReceived - prvRxBytesRead;
+}
+
+/**
+ * @brief   Wait until there are bytes in the RX buffer, the DMA and idle line
+ *          interrupts wake the task
+ * @param   TicksToWait: Max time to wait
+ * @retval  true if there are bytes available
+ */
+bool UART1_WaitForRxData(TickType_t TicksToWait)
+{
+  if (UART1_BytesAvailable() != 0)
+    return true;
+  xSemaphoreTake(prvRxSemaphore, TicksToWait);
+  return (UART1_BytesAvailable() != 0);
+}
+
+/**
+ * @brief   Get the longest contiguous span of unread bytes in the RX buffer
+ * @param   ppData: Set to point at the first unread byte
+ * @retval  Number of bytes in the span, 0 if there is nothing to read
+ */
+uint32_t UART1_GetRxSpan(uint8_t** ppData)
+{
+  uint32_t available = UART1_BytesAvailable();
+  uint32_t readIndex = prvRxBytesRead % UART_RX_BUFFER_SIZE;
+
+  /* Stop at the end of the buffer, the rest is in the next span */
+  if (available > UART_RX_BUFFER_SIZE - readIndex)
+    available = UART_RX_BUFFER_SIZE - readIndex;
+  *ppData = &prvRxBuffer[readIndex];
+  return available;
+}
+
+/**
+ * @brief   Mark bytes from the start of the span as read
+ * @param   Count: Number of bytes, at most the size of the last span
+ * @retval  None
+ */
+void UART1_ConsumeRxSpan(uint32_t Count)
+{
+  prvRxBytesRead += Count;
+}
+
+/**
+ * @brief   Check and clear the overflow flag
+ * @param   None
+ * @retval  true if unread bytes were overwritten since the last call
+ */
+bool UART1_RxOverflowed()
+{
+  bool overflow = prvRxOverflow;
+  if (overflow)
+  {
+    /* Everything in the buffer may be mixed up, drop it */
+    prvRxOverflow = false;
+    prvRxBytesRead = prvRxBytesReceived;
+  }
+  return overflow;
 }
 
 /**
@@ -117,17 +308,13 @@ uint32_t UART1_BytesAvailable()
 void UART1_GetDataFromBuffer(uint8_t* pStorage, uint32_t Size)
 {
   /* Sanity check */
-  if (Size <= prvRxBufferCount)
+  if (Size <= UART1_BytesAvailable())
   {
     while (Size != 0)
     {
-      *pStorage = *prvRxBufferOut;
-      pStorage++;
-      /* Check for overflow */
-      if (++prvRxBufferOut == &prvRxBuffer[UART_RX_BUFFER_SIZE])
-        prvRxBufferOut = prvRxBuffer;
+      *pStorage++ = prvRxBuffer[prvRxBytesRead % UART_RX_BUFFER_SIZE];
+      prvRxBytesRead++;
       Size--;
-      prvRxBufferCount--;
     }
   }
 }
@@ -140,68 +327,231 @@ void UART1_GetDataFromBuffer(uint8_t* pStorage, uint32_t Size)
  */
 uint8_t UART1_GetByteFromBuffer()
 {
-  if (prvRxBufferCount != 0)
-  {
-    uint8_t temp = *prvRxBufferOut;
-    /* Check for overflow */
-    if (++prvRxBufferOut == &prvRxBuffer[UART_RX_BUFFER_SIZE])
-      prvRxBufferOut = prvRxBuffer;
-    prvRxBufferCount--;
-    return temp;
-  }
+  if (UART1_BytesAvailable() != 0)
+    return prvRxBuffer[prvRxBytesRead++ % UART_RX_BUFFER_SIZE];
   else
     return 0;
 }
 
 /**
- * @brief
- * @param   None
+ * @brief   Send one byte
+ * @param   Byte: The byte to send
  * @retval  None
  */
 void UART1_SendByte(uint8_t Byte)
 {
-  /*
-   * We need to save the Byte to send in a variable here as the HAL_UART saves
-   * a pointer to the variable. If we had used Byte directly it would save a
-   * pointer to the register where Byte is stored temporarily.
-   */
-  static uint8_t temp = 0;
-  temp = Byte;
-  HAL_UART_Transmit_IT(&UART_Handle, &temp, 1);
+  UART1_Buffer buffer = {&Byte, 1};
+  UART1_SendBuffers(&buffer, 1, portMAX_DELAY);
 }
 
 /**
- * @brief
- * @param   None
+ * @brief   Send a buffer, it can be reused as soon as this returns
+ * @param   pData: The data
+ * @param   Size: Number of bytes
  * @retval  None
  */
 void UART1_SendBuffer(uint8_t* pData, uint16_t Size)
 {
-  HAL_UART_Transmit_IT(&UART_Handle, pData, Size);
+  UART1_Buffer buffer = {pData, Size};
+  UART1_SendBuffers(&buffer, 1, portMAX_DELAY);
+}
+
+/**
+ * @brief   Send several buffers after each other, for example a header, the
+ *          payload and a checksum. The data is copied to the TX buffer and sent
+ *          with DMA in the background so the buffers can be reused as soon as
+ *          this returns. Must be called from a task.
+ * @param   pBuffers: The buffers
+ * @param   NumOfBuffers: Number of buffers
+ * @param   TicksToWait: Max time to wait for room in the TX buffer
+ * @retval  SUCCESS: Everything was queued
+ * @retval  ERROR: Timed out, the data that fit is still sent
+ */
+ErrorStatus UART1_SendBuffers(const UART1_Buffer* pBuffers, uint32_t NumOfBuffers, TickType_t TicksToWait)
+{
+  ErrorStatus status = SUCCESS;
+  if (xSemaphoreTake(prvTxMutex, TicksToWait) != pdTRUE)
+    return ERROR;
+
+  for (uint32_t i = 0; i < NumOfBuffers && status == SUCCESS; i++)
+  {
+    const uint8_t* pData = pBuffers[i].pData;
+    uint32_t size = pBuffers[i].size;
+    while (size != 0)
+    {
+      uint32_t free = UART_TX_BUFFER_SIZE - (prvTxBytesQueued - prvTxBytesSent);
+      if (free == 0)
+      {
+        /* Send what is there and wait for it to be done */
+        taskENTER_CRITICAL();
+        prvStartTxDma();
+        taskEXIT_CRITICAL();
+        if (xSemaphoreTake(prvTxDoneSemaphore, TicksToWait) != pdTRUE)
+        {
+          status = ERROR;
+          break;
+        }
+        continue;
+      }
+
+      /* Copy up to the end of the buffer, the rest goes in the next lap */
+      uint32_t writeIndex = prvTxBytesQueued % UART_TX_BUFFER_SIZE;
+      uint32_t count = UART_TX_BUFFER_SIZE - writeIndex;
+      if (count > free)
+        count = free;
+      if (count > size)
+        count = size;
+      memcpy(&prvTxBuffer[writeIndex], pData, count);
+      prvTxBytesQueued += count;
+      pData += count;
+      size -= count;
+    }
+  }
+
+  taskENTER_CRITICAL();
+  prvStartTxDma();
+  taskEXIT_CRITICAL();
+
+  xSemaphoreGive(prvTxMutex);
+  return status;
+}
+
+/**
+ * @brief   Check if something is being sent
+ * @param   None
+ * @retval  true until the last byte has been written to the UART
+ */
+bool UART1_TxBusy()
+{
+  return (prvTxBytesQueued != prvTxBytesSent);
 }
 
 /** Private functions .-------------------------------------------------------*/
+/**
+ * @brief   Add the bytes the DMA has written since the last update to the
+ *          received count. Interrupts are masked so the task and the
+ *          interrupts can both call it.
+ * @param   None
+ * @retval  None
+ */
+static void prvUpdateRxBytesReceived()
+{
+  UBaseType_t savedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+
+  uint32_t dmaIndex = UART_RX_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(&prvRxDmaHandle);
+  if (dmaIndex == UART_RX_BUFFER_SIZE)
+    dmaIndex = 0;
+  prvRxBytesReceived += (dmaIndex + UART_RX_BUFFER_SIZE - prvRxDmaIndex) % UART_RX_BUFFER_SIZE;
+  prvRxDmaIndex = dmaIndex;
+  if (prvRxBytesReceived - prvRxBytesRead > UART_RX_BUFFER_SIZE)
+    prvRxOverflow = true;
+
+  taskEXIT_CRITICAL_FROM_ISR(savedInterruptStatus);
+}
+
+/**
+ * @brief   Start the TX DMA on the queued bytes if it's stopped, up to the end
+ *          of the TX buffer. Called with the DMA interrupt masked.
+ * @param   None
+ * @retval  None
+ */
+static void prvStartTxDma()
+{
+  uint32_t queued = prvTxBytesQueued - prvTxBytesSent;
+  if (prvTxDmaCount != 0 || queued == 0)
+    return;
+
+  uint32_t readIndex = prvTxBytesSent % UART_TX_BUFFER_SIZE;
+  if (queued > UART_TX_BUFFER_SIZE - readIndex)
+    queued = UART_TX_BUFFER_SIZE - readIndex;
+  prvTxDmaCount = queued;
+
+  __HAL_UART_CLEAR_FLAG(&UART_Handle, UART_FLAG_TC);
+  HAL_DMA_Start_IT(&prvTxDmaHandle, (uint32_t)&prvTxBuffer[readIndex], (uint32_t)&UART_Handle.Instance->DR, queued);
+  /* Only the transfer complete interrupt is needed */
+  __HAL_DMA_DISABLE_IT(&prvTxDmaHandle, DMA_IT_HT);
+  SET_BIT(UART_Handle.Instance->CR3, USART_CR3_DMAT);
+}
+
+/**
+ * @brief   TX DMA transfer complete, frees the bytes and continues with the
+ *          next ones. Called from HAL_DMA_IRQHandler.
+ * @param   hdma: The TX DMA handle
+ * @retval  None
+ */
+static void prvTxDmaComplete(DMA_HandleTypeDef* hdma)
+{
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+  prvTxBytesSent += prvTxDmaCount;
+  prvTxDmaCount = 0;
+  prvStartTxDma();
+
+  xSemaphoreGiveFromISR(prvTxDoneSemaphore, &higherPriorityTaskWoken);
+  portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+/**
+ * @brief   Calculate the BRR value, the HAL macro for oversampling by 8 puts
+ *          the fraction in the wrong bits
+ * @param   Clock: The USART clock
+ * @param   BaudRate: The baud rate
+ * @param   Oversampling8: true if oversampling by 8 is used
+ * @retval  The BRR value
+ */
+static uint32_t prvCalculateBrr(uint32_t Clock, uint32_t BaudRate, bool Oversampling8)
+{
+  /* USARTDIV in 1/16 or 1/8 steps, rounded */
+  uint32_t div = (Clock + BaudRate / 2) / BaudRate;
+  if (!Oversampling8)
+    return div;
+  /* The 3 bit fraction stays in bit 0-2, bit 3 must be 0 */
+  return ((div & ~0x7UL) << 1) | (div & 0x7UL);
+}
+
 /** Interrupt Handlers -------------------------------------------------------*/
 /**
- * @brief
+ * @brief   Idle line interrupt, called from USART1_IRQHandler
  * @param   None
  * @retval  None
  */
-void UART1_DataReceivedHandler()
+void UART1_IdleLineHandler()
 {
-  uint8_t temp = (uint8_t)(UART_Handle.Instance->DR & (uint8_t)0x00FF);
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
 
-  /* Only save to the buffer if there's room for it */
-  if (prvRxBufferCount < UART_RX_BUFFER_SIZE)
-  {
-    *prvRxBufferIn = temp;
-    /* Check for overflow */
-    if (++prvRxBufferIn == &prvRxBuffer[UART_RX_BUFFER_SIZE])
-      prvRxBufferIn = prvRxBuffer;
-    /* Increment the count */
-    prvRxBufferCount++;
-  }
-  /* TODO: Handle fault when buffer is full */
+  __HAL_UART_CLEAR_IDLEFLAG(&UART_Handle);
+  prvUpdateRxBytesReceived();
+
+  xSemaphoreGiveFromISR(prvRxSemaphore, &higherPriorityTaskWoken);
+  portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+/**
+ * @brief   Half and full transfer interrupt for the RX DMA, called from
+ *          DMA2_Stream2_IRQHandler
+ * @param   None
+ * @retval  None
+ */
+void UART1_RxDmaHandler()
+{
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+  __HAL_DMA_CLEAR_FLAG(&prvRxDmaHandle, __HAL_DMA_GET_HT_FLAG_INDEX(&prvRxDmaHandle) |
+                                        __HAL_DMA_GET_TC_FLAG_INDEX(&prvRxDmaHandle));
+  prvUpdateRxBytesReceived();
+
+  xSemaphoreGiveFromISR(prvRxSemaphore, &higherPriorityTaskWoken);
+  portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+/**
+ * @brief   Interrupt for the TX DMA, called from DMA2_Stream7_IRQHandler
+ * @param   None
+ * @retval  None
+ */
+void UART1_TxDmaHandler()
+{
+  HAL_DMA_IRQHandler(&prvTxDmaHandle);
 }
 
 /**
@@ -30,6 +30,7 @@
  * Set write address to 0x00000000: AA BB CC 10 00 04 00 00 00 00 C9
  * Set write address to 0x11223344: AA BB CC 10 00 04 11 22 33 44 8D
  * Get current write address: AA BB CC 11 CC
+ * Set baud rate to 921600 after the ACK: AA BB CC 12 00 04 00 0E 10 00 D5
  * Erase full flash: AA BB CC 20 FD
  * Erase first sector at 0x00000000: AA BB CC 21 00 04 00 00 00 00 F8
  * Write "Hello World" to flash: AA BB CC 30 00 0B 48 65 6C 6C 6F 20 57 6F 72 6C 64 C6
@@ -39,12 +40,29 @@
  * Read 256 bytes from flash at address 0x00000100: AA BB CC 40 00 05 00 00 01 00 FF 66
  * Read 128 bytes from flash at address 0x00000180: AA BB CC 40 00 05 00 00 01 80 80 99
  * Read 128 bytes from flash at address 0x00008480: AA BB CC 40 00 05 00 00 84 80 80 1C
+ *
+ * Asset upload:
+ * Start uploading a 16 byte font named "f", the CRC32 of the data is
+ * 0x12345678, returns the flash address, the window size and an ACK:
+ * AA BB CC 60 00 0A 01 00 00 00 10 12 34 56 78 66 C8
+ * Then send the data with command 0x31 from the returned address and on,
+ * see UART_COMM_COMMAND_WRITE_WINDOWED_DATA. Every frame is answered with
+ * DA (2 byte next sequence number) when it has been written, or with
+ * EA (2 byte next sequence number) when it is rejected. The answer is
+ * cumulative so the host can keep up to window size frames in flight.
+ * Check the data and add it to the asset table: AA BB CC 61 BC
+ * Get the asset table: AA BB CC 62 BF
+ * Delete the asset named "f": AA BB CC 63 00 01 66 D9
  */
 
 /** Includes -----------------------------------------------------------------*/
 #include "uart_comm.h"
 #include "uart1.h"
 #include "spi_flash.h"
+#include "asset_table.h"
+#include "crc32.h"
+
+#include <string.h>
 
 /** Private defines ----------------------------------------------------------*/
 #define UART_COMM_HEADER_1      (0xAA)
@@ -53,7 +71,22 @@
 #define UART_COMM_ACK           (0xDD)
 #define UART_COMM_NACK          (0xEE)
 #define UART_COMM_UNKNOWN_COMMAND (0xDE)
-#define UART_COMM_BUFFER_SIZE   (512)
+#define UART_COMM_WINDOW_ACK    (0xDA)
+#define UART_COMM_WINDOW_NACK   (0xEA)
+
+/* Frames in flight for the windowed write, they must all fit in the RX
+ * buffer in uart1.c while the flash task erases and writes */
+#define UART_COMM_WINDOW_SIZE             (3)
+#define UART_COMM_WINDOW_MAX_DATA         (1024)
+/* Sequence number, flash address, data and CRC32 */
+#define UART_COMM_WINDOW_FRAME_OVERHEAD   (2 + 4 + 4)
+#define UART_COMM_BUFFER_SIZE   (UART_COMM_WINDOW_FRAME_OVERHEAD + UART_COMM_WINDOW_MAX_DATA)
+
+/* Type, size and CRC32 before the name */
+#define UART_COMM_ASSET_INFO_SIZE         (1 + 4 + 4)
+/* Type, address, size and CRC32 after the name in the asset table answer */
+#define UART_COMM_ASSET_RECORD_SIZE       (1 + 4 + 4 + 4)
+#define UART_COMM_SECTOR_SIZE             (4*1024)
 
 /**
  * The commands are structured like this:
@@ -63,6 +96,8 @@
 #define UART_COMM_COMMAND_SET_FLASH_WRITE_ADDRESS   (0x10)
 /* Data = None, returns the 4 byte write address MSByte first */
 #define UART_COMM_COMMAND_GET_FLASH_WRITE_ADDRESS   (0x11)
+/* Data = 4 bytes baud rate MSByte first, used from after the ACK until reset */
+#define UART_COMM_COMMAND_SET_BAUD_RATE             (0x12)
 /* Data = None */
 #define UART_COMM_COMMAND_ERASE_FULL_FLASH          (0x20)
 /* Data = 4 bytes address for sector to erase */
@@ -71,6 +106,23 @@
 #define UART_COMM_COMMAND_WRITE_DATA_TO_FLASH       (0x30)
 /* Data = 4 bytes read address, 1 byte num of bytes to read, returns the data read */
 #define UART_COMM_COMMAND_READ_DATA_FROM_FLASH      (0x40)
+/* Data = 2 bytes sequence number, 4 bytes flash address, 1 to 1024 bytes to
+ * write and 4 bytes CRC32 of everything before it, all MSByte first. Only
+ * accepted inside the asset that is being uploaded. */
+#define UART_COMM_COMMAND_WRITE_WINDOWED_DATA       (0x31)
+/* Data = 1 byte ASSET_TABLE_Type, 4 bytes size, 4 bytes CRC32 of the data and
+ * the name, 1 to 15 characters. Returns the 4 byte flash address to write the
+ * data to and the 1 byte window size followed by an ACK. */
+#define UART_COMM_COMMAND_START_ASSET_UPLOAD        (0x60)
+/* Data = None, checks the CRC32 of the uploaded data and adds it to the asset
+ * table, an asset with the same name is replaced */
+#define UART_COMM_COMMAND_FINISH_ASSET_UPLOAD       (0x61)
+/* Data = None, returns the 1 byte number of assets and then the 16 byte name,
+ * 1 byte type, 4 bytes address, 4 bytes size and 4 bytes CRC32 of each,
+ * followed by an ACK */
+#define UART_COMM_COMMAND_GET_ASSET_TABLE           (0x62)
+/* Data = The name */
+#define UART_COMM_COMMAND_DELETE_ASSET              (0x63)
 
 /** Private typedefs ---------------------------------------------------------*/
 typedef enum
@@ -94,11 +146,88 @@ uint32_t prvDataBytesRead = 0;
 uint8_t prvCurrentCommand = 0;
 uint32_t prvCurrentFlashWriteAddress = 0;
 
+/* The asset that is being uploaded, its sectors are erased as the data
+ * reaches them */
+static ASSET_TABLE_Entry prvAssetUpload;
+static bool prvAssetUploadActive = false;
+static uint32_t prvAssetErasedEnd = 0;
+static uint16_t prvNextSequenceNumber = 0;
+static ASSET_TABLE_Entry prvAssetEntries[ASSET_TABLE_MAX_ASSETS];
+
 /** Private function prototypes ----------------------------------------------*/
+static void prvCheckRxOverflow();
+static void prvHandleWindowedFrame();
+static void prvSendWindowResponse(uint8_t Response);
+static ErrorStatus prvStartAssetUpload();
+static ErrorStatus prvFinishAssetUpload();
+static void prvSendAssetTable();
+static uint32_t prvGetUint32(uint8_t* pData);
+
 /** Functions ----------------------------------------------------------------*/
 /**
- * @brief
- * @param   None
+ * @brief   Wait for received bytes and handle all that are in the RX buffer,
+ *          the FLASH commands are run here and answered with ACK or NACK when
+ *          done. Should be called in a loop from the flash task.
+ * @param   TicksToWait: How long to wait for the first byte
+ * @retval  None
+ */
+void UART_COMM_ProcessReceivedBytes(TickType_t TicksToWait)
+{
+  prvCheckRxOverflow();
+
+  if (!UART1_WaitForRxData(TicksToWait))
+    return;
+
+  /* Handle the bytes where the DMA put them, one span at a time */
+  uint8_t* pData;
+  uint32_t count;
+  while ((count = UART1_GetRxSpan(&pData)) != 0)
+  {
+    UART_COMM_HandleReceivedData(pData, count);
+    UART1_ConsumeRxSpan(count);
+    /* The DMA can lap the span while it's being handled */
+    prvCheckRxOverflow();
+  }
+}
+
+/**
+ * @brief   Handle a span of received bytes, the data part of a command is
+ *          copied in one go
+ * @param   pData: The bytes
+ * @param   DataCount: Number of bytes
+ * @retval  None
+ */
+void UART_COMM_HandleReceivedData(uint8_t* pData, uint32_t DataCount)
+{
+  while (DataCount != 0)
+  {
+    if (prvCurrentState == UART_CommStateData)
+    {
+      uint32_t count = prvDataBytesToRead;
+      if (count > DataCount)
+        count = DataCount;
+      memcpy(&prvDataBuffer[prvDataBytesRead], pData, count);
+      for (uint32_t i = 0; i < count; i++)
+        prvChecksum ^= pData[i];
+      prvDataBytesRead += count;
+      prvDataBytesToRead -= count;
+      if (prvDataBytesToRead == 0)
+        prvCurrentState = UART_CommStateChecksum;
+      pData += count;
+      DataCount -= count;
+    }
+    else
+    {
+      UART_COMM_HandleReceivedByte(*pData++);
+      DataCount--;
+    }
+  }
+}
+
+/**
+ * @brief   Run the command parser on one byte, must be called from a task
+ *          as the FLASH commands wait for the FLASH
+ * @param   Byte: The received byte
  * @retval  None
  */
 void UART_COMM_HandleReceivedByte(uint8_t Byte)
@@ -140,14 +269,20 @@ void UART_COMM_HandleReceivedByte(uint8_t Byte)
   else if (prvCurrentState == UART_CommStateCommand)
   {
     if (Byte == UART_COMM_COMMAND_SET_FLASH_WRITE_ADDRESS ||
+        Byte == UART_COMM_COMMAND_SET_BAUD_RATE ||
         Byte == UART_COMM_COMMAND_ERASE_SECTOR_IN_FLASH ||
         Byte == UART_COMM_COMMAND_WRITE_DATA_TO_FLASH ||
-        Byte == UART_COMM_COMMAND_READ_DATA_FROM_FLASH)
+        Byte == UART_COMM_COMMAND_READ_DATA_FROM_FLASH ||
+        Byte == UART_COMM_COMMAND_WRITE_WINDOWED_DATA ||
+        Byte == UART_COMM_COMMAND_START_ASSET_UPLOAD ||
+        Byte == UART_COMM_COMMAND_DELETE_ASSET)
     {
       prvCurrentState = UART_CommStateDataCount1;
     }
     else if (Byte == UART_COMM_COMMAND_ERASE_FULL_FLASH ||
-             Byte == UART_COMM_COMMAND_GET_FLASH_WRITE_ADDRESS)
+             Byte == UART_COMM_COMMAND_GET_FLASH_WRITE_ADDRESS ||
+             Byte == UART_COMM_COMMAND_FINISH_ASSET_UPLOAD ||
+             Byte == UART_COMM_COMMAND_GET_ASSET_TABLE)
     {
       prvCurrentState = UART_CommStateChecksum;
     }
@@ -175,10 +310,17 @@ void UART_COMM_HandleReceivedByte(uint8_t Byte)
   else if (prvCurrentState == UART_CommStateDataCount2)
   {
     prvDataBytesToRead |= (uint16_t)Byte;
-    prvCurrentState = UART_CommStateData;
     prvDataBytesRead = 0;
     /* Calculate the checksum */
     prvChecksum ^= Byte;
+    /* A corrupted count, for example from a wrong baud rate, must not
+     * overflow the buffer */
+    if (prvDataBytesToRead > UART_COMM_BUFFER_SIZE)
+      prvCurrentState = UART_CommStateHeader1;
+    else if (prvDataBytesToRead == 0)
+      prvCurrentState = UART_CommStateChecksum;
+    else
+      prvCurrentState = UART_CommStateData;
   }
   /* Data =================================================================== */
   else if (prvCurrentState == UART_CommStateData)
@@ -201,10 +343,14 @@ void UART_COMM_HandleReceivedByte(uint8_t Byte)
   {
     if (Byte == prvChecksum)
     {
-      /* Full FLASH erase command */
+      ErrorStatus status = SUCCESS;
+      /* Full FLASH erase command, the assets and the table go with it */
       if (prvCurrentCommand == UART_COMM_COMMAND_ERASE_FULL_FLASH)
       {
-        SPI_FLASH_EraseChipFromISR();
+        prvAssetUploadActive = false;
+        status = SPI_FLASH_EraseChip();
+        if (status == SUCCESS)
+          status = ASSET_TABLE_Reset();
       }
       /* Set write address for FLASH */
       else if (prvCurrentCommand == UART_COMM_COMMAND_SET_FLASH_WRITE_ADDRESS)
@@ -215,6 +361,23 @@ void UART_COMM_HandleReceivedByte(uint8_t Byte)
             ((uint32_t)prvDataBuffer[2] << 8) |
             (uint32_t)prvDataBuffer[3];
       }
+      /* Set baud rate, the ACK is sent with the old one */
+      else if (prvCurrentCommand == UART_COMM_COMMAND_SET_BAUD_RATE)
+      {
+        uint32_t baudRate =
+            ((uint32_t)prvDataBuffer[0] << 24) |
+            ((uint32_t)prvDataBuffer[1] << 16) |
+            ((uint32_t)prvDataBuffer[2] << 8) |
+            (uint32_t)prvDataBuffer[3];
+        if (UART1_BaudRateSupported(baudRate))
+        {
+          UART1_SendByte(UART_COMM_ACK);
+          UART1_SetBaudRate(baudRate);
+        }
+        else
+          UART1_SendByte(UART_COMM_NACK);
+        goto change_state;
+      }
       /* Get current write address */
       else if (prvCurrentCommand == UART_COMM_COMMAND_GET_FLASH_WRITE_ADDRESS)
       {
@@ -234,14 +397,24 @@ void UART_COMM_HandleReceivedByte(uint8_t Byte)
             ((uint32_t)prvDataBuffer[1] << 16) |
             ((uint32_t)prvDataBuffer[2] << 8) |
             (uint32_t)prvDataBuffer[3];
-        SPI_FLASH_EraseSectorFromISR(sectorAddress);
+        /* The table sectors and the assets can only be changed through the
+         * asset commands */
+        sectorAddress &= ~(UART_COMM_SECTOR_SIZE - 1);
+        if (ASSET_TABLE_RangeIsFree(sectorAddress, UART_COMM_SECTOR_SIZE))
+          status = SPI_FLASH_EraseSector(sectorAddress);
+        else
+          status = ERROR;
       }
       /* Write to flash */
       else if (prvCurrentCommand == UART_COMM_COMMAND_WRITE_DATA_TO_FLASH)
       {
-        SPI_FLASH_WriteBufferFromISR(prvDataBuffer, prvCurrentFlashWriteAddress, prvDataBytesRead);
+        if (ASSET_TABLE_RangeIsFree(prvCurrentFlashWriteAddress, prvDataBytesRead))
+          status = SPI_FLASH_WriteBuffer(prvDataBuffer, prvCurrentFlashWriteAddress, prvDataBytesRead);
+        else
+          status = ERROR;
         /* Auto-increment the write address */
-        prvCurrentFlashWriteAddress += prvDataBytesRead;
+        if (status == SUCCESS)
+          prvCurrentFlashWriteAddress += prvDataBytesRead;
       }
       /* Read from flash */
       else if (prvCurrentCommand == UART_COMM_COMMAND_READ_DATA_FROM_FLASH)
@@ -254,20 +427,65 @@ void UART_COMM_HandleReceivedByte(uint8_t Byte)
             (uint32_t)prvDataBuffer[3];
         uint8_t dataSize = prvDataBuffer[4];
         /* Read the data */
-        SPI_FLASH_ReadBufferFromISR(prvDataBuffer, readAddress, dataSize);
+        if (dataSize != 0 && SPI_FLASH_ReadBuffer(prvDataBuffer, readAddress, dataSize) != SUCCESS)
+        {
+          UART1_SendByte(UART_COMM_NACK);
+          goto change_state;
+        }
         /* Send the data back + ACK */
         prvDataBuffer[dataSize] = UART_COMM_ACK;
         UART1_SendBuffer(prvDataBuffer, dataSize + 1);
         goto change_state;
       }
+      /* Windowed write of asset data, answered with a window ACK or NACK */
+      else if (prvCurrentCommand == UART_COMM_COMMAND_WRITE_WINDOWED_DATA)
+      {
+        prvHandleWindowedFrame();
+        goto change_state;
+      }
+      /* Start an asset upload, answers with the address and window size */
+      else if (prvCurrentCommand == UART_COMM_COMMAND_START_ASSET_UPLOAD)
+      {
+        if (prvStartAssetUpload() != SUCCESS)
+          UART1_SendByte(UART_COMM_NACK);
+        goto change_state;
+      }
+      /* Check the uploaded asset and add it */
+      else if (prvCurrentCommand == UART_COMM_COMMAND_FINISH_ASSET_UPLOAD)
+      {
+        status = prvFinishAssetUpload();
+      }
+      /* Send the asset table */
+      else if (prvCurrentCommand == UART_COMM_COMMAND_GET_ASSET_TABLE)
+      {
+        prvSendAssetTable();
+        goto change_state;
+      }
+      /* Delete an asset */
+      else if (prvCurrentCommand == UART_COMM_COMMAND_DELETE_ASSET)
+      {
+        char name[ASSET_TABLE_NAME_LENGTH] = {0};
+        if (prvDataBytesRead < ASSET_TABLE_NAME_LENGTH)
+        {
+          memcpy(name, prvDataBuffer, prvDataBytesRead);
+          status = ASSET_TABLE_Remove(name);
+        }
+        else
+          status = ERROR;
+      }
       else
       {
         /* Command not recognized */
         UART1_SendByte(UART_COMM_UNKNOWN_COMMAND);
         goto change_state;
       }
-      /* Checksum OK */
-      UART1_SendByte(UART_COMM_ACK);
+      /* Checksum OK, tell if the FLASH operation worked */
+      UART1_SendByte((status == SUCCESS) ? UART_COMM_ACK : UART_COMM_NACK);
+    }
+    /* Checksum wrong, tell the host where to restart a windowed write */
+    else if (prvCurrentCommand == UART_COMM_COMMAND_WRITE_WINDOWED_DATA)
+    {
+      prvSendWindowResponse(UART_COMM_WINDOW_NACK);
     }
     else
     {
@@ -285,4 +503,224 @@ change_state:
 }
 
 /** Private functions .-------------------------------------------------------*/
+/**
+ * @brief   Resync on the next header if received bytes were lost
+ * @param   None
+ * @retval  None
+ */
+static void prvCheckRxOverflow()
+{
+  /* Lost bytes break the command that's being received */
+  if (UART1_RxOverflowed())
+  {
+    if (prvCurrentState != UART_CommStateHeader1)
+      UART1_SendByte(UART_COMM_NACK);
+    prvCurrentState = UART_CommStateHeader1;
+  }
+}
+
+/**
+ * @brief   Check and write a received windowed write frame
+ * @param   None
+ * @retval  None
+ */
+static void prvHandleWindowedFrame()
+{
+  if (!prvAssetUploadActive ||
+      prvDataBytesRead <= UART_COMM_WINDOW_FRAME_OVERHEAD ||
+      prvDataBytesRead > UART_COMM_WINDOW_FRAME_OVERHEAD + UART_COMM_WINDOW_MAX_DATA)
+  {
+    prvSendWindowResponse(UART_COMM_WINDOW_NACK);
+    return;
+  }
+
+  uint32_t crcOffset = prvDataBytesRead - 4;
+  uint32_t crc = prvGetUint32(&prvDataBuffer[crcOffset]);
+  uint16_t sequenceNumber = ((uint16_t)prvDataBuffer[0] << 8) | prvDataBuffer[1];
+  uint32_t address = prvGetUint32(&prvDataBuffer[2]);
+  uint32_t count = crcOffset - 6;
+
+  if (crc != CRC32_Calculate(prvDataBuffer, crcOffset))
+  {
+    prvSendWindowResponse(UART_COMM_WINDOW_NACK);
+    return;
+  }
+
+  /* Frames behind the next sequence number were resent because an ACK got
+   * lost and are already written, frames ahead of it come after a lost frame */
+  if (sequenceNumber != prvNextSequenceNumber)
+  {
+    if ((uint16_t)(prvNextSequenceNumber - sequenceNumber) < 0x8000)
+      prvSendWindowResponse(UART_COMM_WINDOW_ACK);
+    else
+      prvSendWindowResponse(UART_COMM_WINDOW_NACK);
+    return;
+  }
+
+  /* Nothing outside the room given to the asset is touched */
+  if (address < prvAssetUpload.address ||
+      address + count > prvAssetUpload.address + prvAssetUpload.size)
+  {
+    prvSendWindowResponse(UART_COMM_WINDOW_NACK);
+    return;
+  }
+
+  /* The data comes in order so each sector is erased when the data first
+   * reaches it, the frames in flight wait in the RX buffer meanwhile */
+  while (prvAssetErasedEnd < address + count)
+  {
+    if (SPI_FLASH_EraseSector(prvAssetErasedEnd) != SUCCESS)
+    {
+      prvSendWindowResponse(UART_COMM_WINDOW_NACK);
+      return;
+    }
+    prvAssetErasedEnd += UART_COMM_SECTOR_SIZE;
+  }
+
+  if (SPI_FLASH_WriteBuffer(&prvDataBuffer[6], address, count) != SUCCESS)
+  {
+    prvSendWindowResponse(UART_COMM_WINDOW_NACK);
+    return;
+  }
+
+  prvNextSequenceNumber++;
+  prvSendWindowResponse(UART_COMM_WINDOW_ACK);
+}
+
+/**
+ * @brief   Send an ACK or NACK with the next sequence number expected
+ * @param   Response: UART_COMM_WINDOW_ACK or UART_COMM_WINDOW_NACK
+ * @retval  None
+ */
+static void prvSendWindowResponse(uint8_t Response)
+{
+  uint8_t response[3];
+  response[0] = Response;
+  response[1] = (prvNextSequenceNumber >> 8) & 0xFF;
+  response[2] = prvNextSequenceNumber & 0xFF;
+  UART1_SendBuffer(response, 3);
+}
+
+/**
+ * @brief   Find room for the asset in the received command and answer with
+ *          the address and window size, nothing is erased yet
+ * @param   None
+ * @retval  SUCCESS or ERROR if the command is invalid or the asset doesn't fit
+ */
+static ErrorStatus prvStartAssetUpload()
+{
+  uint32_t nameLength = prvDataBytesRead - UART_COMM_ASSET_INFO_SIZE;
+  if (prvDataBytesRead <= UART_COMM_ASSET_INFO_SIZE || nameLength >= ASSET_TABLE_NAME_LENGTH)
+    return ERROR;
+
+  memset(&prvAssetUpload, 0, sizeof(prvAssetUpload));
+  prvAssetUpload.type = prvDataBuffer[0];
+  prvAssetUpload.size = prvGetUint32(&prvDataBuffer[1]);
+  prvAssetUpload.crc = prvGetUint32(&prvDataBuffer[5]);
+  memcpy(prvAssetUpload.name, &prvDataBuffer[UART_COMM_ASSET_INFO_SIZE], nameLength);
+  if (strlen(prvAssetUpload.name) != nameLength ||
+      ASSET_TABLE_Allocate(prvAssetUpload.size, &prvAssetUpload.address) != SUCCESS)
+  {
+    prvAssetUploadActive = false;
+    return ERROR;
+  }
+
+  prvAssetUploadActive = true;
+  prvAssetErasedEnd = prvAssetUpload.address;
+  prvNextSequenceNumber = 0;
+
+  prvDataBuffer[0] = (prvAssetUpload.address >> 24) & 0xFF;
+  prvDataBuffer[1] = (prvAssetUpload.address >> 16) & 0xFF;
+  prvDataBuffer[2] = (prvAssetUpload.address >> 8) & 0xFF;
+  prvDataBuffer[3] = (prvAssetUpload.address) & 0xFF;
+  prvDataBuffer[4] = UART_COMM_WINDOW_SIZE;
+  prvDataBuffer[5] = UART_COMM_ACK;
+  UART1_SendBuffer(prvDataBuffer, 6);
+  return SUCCESS;
+}
+
+/**
+ * @brief   Check the CRC32 of the uploaded asset in the flash and add it to
+ *          the asset table
+ * @param   None
+ * @retval  SUCCESS or ERROR if there is no upload, the data is wrong or the
+ *          table could not be saved
+ */
+static ErrorStatus prvFinishAssetUpload()
+{
+  if (!prvAssetUploadActive)
+    return ERROR;
+  prvAssetUploadActive = false;
+
+  /* Sectors that were never written still hold old data */
+  if (prvAssetErasedEnd < prvAssetUpload.address + prvAssetUpload.size)
+    return ERROR;
+
+  uint32_t crc = CRC32_INITIAL_VALUE;
+  for (uint32_t offset = 0; offset < prvAssetUpload.size; offset += UART_COMM_BUFFER_SIZE)
+  {
+    uint32_t count = prvAssetUpload.size - offset;
+    if (count > UART_COMM_BUFFER_SIZE)
+      count = UART_COMM_BUFFER_SIZE;
+    if (SPI_FLASH_ReadBuffer(prvDataBuffer, prvAssetUpload.address + offset, count) != SUCCESS)
+      return ERROR;
+    crc = CRC32_Update(crc, prvDataBuffer, count);
+  }
+  if (~crc != prvAssetUpload.crc)
+    return ERROR;
+
+  return ASSET_TABLE_Add(&prvAssetUpload);
+}
+
+/**
+ * @brief   Send the asset table followed by an ACK, the name of each asset
+ *          is sent straight from the copy of the entry
+ * @param   None
+ * @retval  None
+ */
+static void prvSendAssetTable()
+{
+  uint8_t numOfAssets = ASSET_TABLE_GetEntries(prvAssetEntries, ASSET_TABLE_MAX_ASSETS);
+  UART1_SendByte(numOfAssets);
+
+  for (uint32_t i = 0; i < numOfAssets; i++)
+  {
+    ASSET_TABLE_Entry* pEntry = &prvAssetEntries[i];
+    uint8_t* pRecord = &prvDataBuffer[i * UART_COMM_ASSET_RECORD_SIZE];
+    pRecord[0] = pEntry->type;
+    pRecord[1] = (pEntry->address >> 24) & 0xFF;
+    pRecord[2] = (pEntry->address >> 16) & 0xFF;
+    pRecord[3] = (pEntry->address >> 8) & 0xFF;
+    pRecord[4] = (pEntry->address) & 0xFF;
+    pRecord[5] = (pEntry->size >> 24) & 0xFF;
+    pRecord[6] = (pEntry->size >> 16) & 0xFF;
+    pRecord[7] = (pEntry->size >> 8) & 0xFF;
+    pRecord[8] = (pEntry->size) & 0xFF;
+    pRecord[9] = (pEntry->crc >> 24) & 0xFF;
+    pRecord[10] = (pEntry->crc >> 16) & 0xFF;
+    pRecord[11] = (pEntry->crc >> 8) & 0xFF;
+    pRecord[12] = (pEntry->crc) & 0xFF;
+
+    UART1_Buffer buffers[2] = {
+      {(const uint8_t*)pEntry->name, ASSET_TABLE_NAME_LENGTH},
+      {pRecord, UART_COMM_ASSET_RECORD_SIZE},
+    };
+    UART1_SendBuffers(buffers, 2, portMAX_DELAY);
+  }
+  UART1_SendByte(UART_COMM_ACK);
+}
+
+/**
+ * @brief   Get a 4 byte value that is sent MSByte first
+ * @param   pData: The first byte
+ * @retval  The value
+ */
+static uint32_t prvGetUint32(uint8_t* pData)
+{
+  return ((uint32_t)pData[0] << 24) |
+         ((uint32_t)pData[1] << 16) |
+         ((uint32_t)pData[2] << 8) |
+         (uint32_t)pData[3];
+}
+
 /** Interrupt Handlers -------------------------------------------------------*/
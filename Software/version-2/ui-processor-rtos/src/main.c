@@ -37,12 +37,14 @@
 #include "background_task.h"
 #include "lcd_task.h"
 #include "main_task.h"
+#include "flash_task.h"
 
 
 /** Priorities at which the tasks are created. */
 #define mainBACKGROUND_TASK_PRIORITY    (tskIDLE_PRIORITY)
 #define mainLCD_TASK_PRIORITY           (tskIDLE_PRIORITY + 1)
 #define mainMAIN_TASK_PRIORITY          (tskIDLE_PRIORITY + 2)
+#define mainFLASH_TASK_PRIORITY         (tskIDLE_PRIORITY + 1)
 
 /** ----- Main -------------------------------------------------------------- */
 int main()
@@ -81,6 +83,15 @@ int main()
               NULL);                        /* Handle for the created task */
 #endif
 
+#if 1
+  xTaskCreate(flashTask,                    /* Pointer to the task entry function */
+              "Flash",                      /* Name for the task */
+              configMINIMAL_STACK_SIZE*2,   /* The size of the stack */
+              NULL,                         /* Pointer to parameters for the task */
+              mainFLASH_TASK_PRIORITY,      /* The priority for the task */
+              NULL);                        /* Handle for the created task */
+#endif
+
   /* Start the scheduler */
   vTaskStartScheduler();
 
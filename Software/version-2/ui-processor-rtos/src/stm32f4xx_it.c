@@ -29,7 +29,7 @@
 #include "ft5206.h"
 #include "lcd.h"
 #include "uart1.h"
-#include "uart_comm.h"
+#include "spi_flash.h"
 
 /** Private defines ----------------------------------------------------------*/
 /** Private typedefs ---------------------------------------------------------*/
@@ -84,19 +84,47 @@ void LTDC_IRQHandler(void)
   */
 void USART1_IRQHandler(void)
 {
-  /* Check if it's a RX interrupt */
+  /* Check if it's an idle line interrupt, RX and TX are done by DMA */
   uint32_t tmp_flag = 0, tmp_it_source = 0;
-  tmp_flag = __HAL_UART_GET_FLAG(&UART_Handle, UART_FLAG_RXNE);
-  tmp_it_source = __HAL_UART_GET_IT_SOURCE(&UART_Handle, UART_IT_RXNE);
+  tmp_flag = __HAL_UART_GET_FLAG(&UART_Handle, UART_FLAG_IDLE);
+  tmp_it_source = __HAL_UART_GET_IT_SOURCE(&UART_Handle, UART_IT_IDLE);
   if ((tmp_flag != RESET) && (tmp_it_source != RESET))
   {
-//    UART1_DataReceivedHandler();
-    uint8_t temp = (uint8_t)(UART_Handle.Instance->DR & (uint8_t)0x00FF);
-    UART_COMM_HandleReceivedByte(temp);
+    UART1_IdleLineHandler();
   }
   /* Otherwise call the HAL IRQ handler */
   else
     HAL_UART_IRQHandler(&UART_Handle);
 }
 
+/**
+  * @brief  This function handles the UART RX DMA interrupt request.
+  * @param  None
+  * @retval None
+  */
+void DMA2_Stream2_IRQHandler(void)
+{
+  UART1_RxDmaHandler();
+}
+
+/**
+  * @brief  This function handles the UART TX DMA interrupt request.
+  * @param  None
+  * @retval None
+  */
+void DMA2_Stream7_IRQHandler(void)
+{
+  UART1_TxDmaHandler();
+}
+
+/**
+  * @brief  This function handles the SPI FLASH RX DMA interrupt request.
+  * @param  None
+  * @retval None
+  */
+void DMA2_Stream0_IRQHandler(void)
+{
+  SPI_FLASH_RxDmaHandler();
+}
+
 /** HAL Callback functions ---------------------------------------------------*/